@@ -0,0 +1,15 @@
+# Use the installed Google Benchmark if there is one, otherwise build it from source.
+find_package(benchmark QUIET)
+
+if(NOT benchmark_FOUND)
+    include(FetchContent)
+    FetchContent_Declare(
+      googlebenchmark
+      URL https://github.com/google/benchmark/archive/refs/tags/v1.7.1.tar.gz
+    )
+
+    set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+    set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+    set(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+    FetchContent_MakeAvailable(googlebenchmark)
+endif()
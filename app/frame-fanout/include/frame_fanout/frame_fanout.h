@@ -0,0 +1,140 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef FRAME_FANOUT_H
+#define FRAME_FANOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kvs/nalu.h"
+#include "kvs/port.h"
+
+#include "shared_frame/shared_frame.h"
+
+/*
+ * A frame fan-out publishes each video frame to several sinks, e.g. the KVS stream, WebRTC and a recorder. A frame is
+ * analyzed once when it's published, and every sink receives the same shared frame with its AVCC view and NALU info,
+ * so no sink parses or copies the frame again. Each sink has its own queue and backpressure policy, so a slow sink
+ * drops its own frames without stalling the publisher or other sinks.
+ */
+typedef struct FrameFanout *FrameFanoutHandle;
+
+typedef struct FrameFanoutSink *FrameFanoutSinkHandle;
+
+/* The max number of sinks of a fan-out */
+#ifndef FRAME_FANOUT_MAX_SINKS
+#define FRAME_FANOUT_MAX_SINKS  (4)
+#endif
+
+typedef enum
+{
+    eFanoutDropNewest = 0,  /* It's default value. A frame is dropped if the queue of the sink is full. */
+    eFanoutDropOldest,      /* Whenever the queue is full, it drops the oldest frame. */
+    eFanoutDropOldestGop    /* Whenever the queue is full, it drops the oldest GOP, so the queue always starts from a
+                             * key frame. The sink starts from a key frame, and if the whole queue is one GOP, it
+                             * waits for the next key frame. */
+} eFrameFanoutBackpressure;
+
+typedef struct FrameFanoutSinkParameter
+{
+    size_t uQueueLen;                       /* Max number of frames in the queue of the sink */
+    eFrameFanoutBackpressure eBackpressure;
+    KvsEventHandle xWakeEvent;              /* It's signaled whenever a frame is queued, or NULL if the sink polls */
+} FrameFanoutSinkParameter_t;
+
+typedef struct FrameFanoutFrame
+{
+    SharedFrameHandle xFrame;               /* The receiver holds a reference, and it releases it when it's done */
+    uint64_t uTimestampMs;
+    bool bIsKeyFrame;
+    uint8_t *pAvcc;                         /* The AVCC view of the frame, which must not be modified */
+    size_t uAvccLen;
+    const NaluFrameInfo_t *pxFrameInfo;     /* NALU info of the AVCC view */
+} FrameFanoutFrame_t;
+
+typedef struct FrameFanoutSinkStatistics
+{
+    size_t uQueuedCount;    /* Number of frames in the queue */
+    size_t uDeliveredCount; /* Number of frames received by the sink */
+    size_t uDroppedCount;   /* Number of frames dropped by the backpressure policy */
+} FrameFanoutSinkStat_t;
+
+/**
+ * Create a frame fan-out without any sinks.
+ *
+ * @return Handle of the frame fan-out on success, or NULL otherwise
+ */
+FrameFanoutHandle FrameFanout_create(void);
+
+/**
+ * Terminate a frame fan-out. All sinks are removed, and their queued frames are released.
+ *
+ * @param[in] handle Handle of the frame fan-out
+ */
+void FrameFanout_terminate(FrameFanoutHandle handle);
+
+/**
+ * Add a sink to a frame fan-out. The sink receives frames published after it's added.
+ *
+ * @param[in] handle Handle of the frame fan-out
+ * @param[in] pxParameter Parameter of the sink
+ * @return Handle of the sink on success, or NULL otherwise
+ */
+FrameFanoutSinkHandle FrameFanout_addSink(FrameFanoutHandle handle, FrameFanoutSinkParameter_t *pxParameter);
+
+/**
+ * Remove a sink from a frame fan-out, and release its queued frames. Frames that are received by the sink are not
+ * affected.
+ *
+ * @param[in] handle Handle of the frame fan-out
+ * @param[in] sinkHandle Handle of the sink
+ */
+void FrameFanout_removeSink(FrameFanoutHandle handle, FrameFanoutSinkHandle sinkHandle);
+
+/**
+ * Publish a video frame to all sinks. The frame is analyzed and converted to AVCC once, and each sink that queues it
+ * holds its own reference, so the caller still releases its reference after it's published.
+ *
+ * @param[in] handle Handle of the frame fan-out
+ * @param[in] xFrame Shared video frame
+ * @param[in] uTimestampMs Timestamp of the frame in milliseconds
+ * @return 0 on success, non-zero value otherwise
+ */
+int FrameFanout_publish(FrameFanoutHandle handle, SharedFrameHandle xFrame, uint64_t uTimestampMs);
+
+/**
+ * Receive the next frame of a sink without blocking. The sink holds a reference of the received frame, which is
+ * released by SharedFrame_release().
+ *
+ * @param[in] handle Handle of the frame fan-out
+ * @param[in] sinkHandle Handle of the sink
+ * @param[out] pxFrame The received frame
+ * @return 0 if a frame is received, non-zero value if the queue is empty or otherwise
+ */
+int FrameFanout_receive(FrameFanoutHandle handle, FrameFanoutSinkHandle sinkHandle, FrameFanoutFrame_t *pxFrame);
+
+/**
+ * Get statistics of a sink.
+ *
+ * @param[in] handle Handle of the frame fan-out
+ * @param[in] sinkHandle Handle of the sink
+ * @param[out] pxStat Statistics of the sink
+ * @return 0 on success, non-zero value otherwise
+ */
+int FrameFanout_getSinkStat(FrameFanoutHandle handle, FrameFanoutSinkHandle sinkHandle, FrameFanoutSinkStat_t *pxStat);
+
+#endif /* FRAME_FANOUT_H */
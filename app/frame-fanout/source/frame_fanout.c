@@ -0,0 +1,357 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "frame_fanout/frame_fanout.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* Thirdparty headers */
+#include "azure_c_shared_utility/lock.h"
+
+#define ERRNO_NONE 0
+#define ERRNO_FAIL __LINE__
+
+typedef struct FrameFanoutSink
+{
+    FrameFanoutSinkParameter_t xParameter;
+
+    /* A circular queue of received frames, which starts at uHead and has uCount frames. */
+    FrameFanoutFrame_t *pxQueue;
+    size_t uHead;
+    size_t uCount;
+
+    /* The whole queue was one GOP when it's dropped, so frames are dropped until the next key frame. */
+    bool bWaitKeyFrame;
+
+    size_t uDeliveredCount;
+    size_t uDroppedCount;
+} FrameFanoutSink_t;
+
+typedef struct FrameFanout
+{
+    /* Every sink is updated by both the publisher and its receiver, so they're all protected by this lock. */
+    LOCK_HANDLE xLock;
+
+    FrameFanoutSink_t *pxSinks[FRAME_FANOUT_MAX_SINKS];
+} FrameFanout_t;
+
+static void prvSinkDropOldest(FrameFanoutSink_t *pxSink)
+{
+    SharedFrame_release(pxSink->pxQueue[pxSink->uHead].xFrame);
+    memset(&(pxSink->pxQueue[pxSink->uHead]), 0, sizeof(FrameFanoutFrame_t));
+    pxSink->uHead = (pxSink->uHead + 1) % pxSink->xParameter.uQueueLen;
+    pxSink->uCount--;
+    pxSink->uDroppedCount++;
+}
+
+/* It returns true if the frame can be queued after the backpressure policy is applied. */
+static bool prvSinkMakeRoom(FrameFanoutSink_t *pxSink, bool bIsKeyFrame)
+{
+    bool bCanQueue = true;
+
+    if (pxSink->xParameter.eBackpressure == eFanoutDropOldestGop)
+    {
+        if (pxSink->uCount == pxSink->xParameter.uQueueLen)
+        {
+            /* The head is a key frame unless the sink is waiting for one, so the oldest GOP is dropped as a whole. */
+            do
+            {
+                prvSinkDropOldest(pxSink);
+            } while (pxSink->uCount > 0 && !pxSink->pxQueue[pxSink->uHead].bIsKeyFrame);
+
+            if (pxSink->uCount == 0)
+            {
+                pxSink->bWaitKeyFrame = true;
+            }
+        }
+
+        if (bIsKeyFrame)
+        {
+            pxSink->bWaitKeyFrame = false;
+        }
+        else if (pxSink->bWaitKeyFrame)
+        {
+            bCanQueue = false;
+        }
+        else
+        {
+            /* nop */
+        }
+    }
+    else if (pxSink->uCount < pxSink->xParameter.uQueueLen)
+    {
+        /* nop */
+    }
+    else if (pxSink->xParameter.eBackpressure == eFanoutDropOldest)
+    {
+        prvSinkDropOldest(pxSink);
+    }
+    else
+    {
+        bCanQueue = false;
+    }
+
+    return bCanQueue;
+}
+
+static void prvSinkTerminate(FrameFanoutSink_t *pxSink)
+{
+    while (pxSink->uCount > 0)
+    {
+        prvSinkDropOldest(pxSink);
+    }
+    free(pxSink);
+}
+
+static int prvFindSink(FrameFanout_t *pFanout, FrameFanoutSink_t *pxSink)
+{
+    int idx = 0;
+
+    while (idx < FRAME_FANOUT_MAX_SINKS && pFanout->pxSinks[idx] != pxSink)
+    {
+        idx++;
+    }
+
+    return (idx < FRAME_FANOUT_MAX_SINKS) ? idx : -1;
+}
+
+FrameFanoutHandle FrameFanout_create(void)
+{
+    FrameFanout_t *pFanout = NULL;
+
+    if ((pFanout = (FrameFanout_t *)malloc(sizeof(FrameFanout_t))) == NULL)
+    {
+        /* nop */
+    }
+    else
+    {
+        memset(pFanout, 0, sizeof(FrameFanout_t));
+        if ((pFanout->xLock = Lock_Init()) == NULL)
+        {
+            free(pFanout);
+            pFanout = NULL;
+        }
+    }
+
+    return pFanout;
+}
+
+void FrameFanout_terminate(FrameFanoutHandle handle)
+{
+    FrameFanout_t *pFanout = (FrameFanout_t *)handle;
+    int i = 0;
+
+    if (pFanout != NULL)
+    {
+        for (i = 0; i < FRAME_FANOUT_MAX_SINKS; i++)
+        {
+            if (pFanout->pxSinks[i] != NULL)
+            {
+                prvSinkTerminate(pFanout->pxSinks[i]);
+            }
+        }
+
+        Lock_Deinit(pFanout->xLock);
+        free(pFanout);
+    }
+}
+
+FrameFanoutSinkHandle FrameFanout_addSink(FrameFanoutHandle handle, FrameFanoutSinkParameter_t *pxParameter)
+{
+    FrameFanout_t *pFanout = (FrameFanout_t *)handle;
+    FrameFanoutSink_t *pxSink = NULL;
+    int idx = 0;
+
+    if (pFanout == NULL || pxParameter == NULL || pxParameter->uQueueLen == 0 ||
+        pxParameter->uQueueLen > (SIZE_MAX - sizeof(FrameFanoutSink_t)) / sizeof(FrameFanoutFrame_t))
+    {
+        /* nop */
+    }
+    else if ((pxSink = (FrameFanoutSink_t *)malloc(sizeof(FrameFanoutSink_t) + pxParameter->uQueueLen * sizeof(FrameFanoutFrame_t))) == NULL)
+    {
+        /* nop */
+    }
+    else
+    {
+        memset(pxSink, 0, sizeof(FrameFanoutSink_t) + pxParameter->uQueueLen * sizeof(FrameFanoutFrame_t));
+        memcpy(&(pxSink->xParameter), pxParameter, sizeof(FrameFanoutSinkParameter_t));
+        pxSink->pxQueue = (FrameFanoutFrame_t *)(pxSink + 1);
+        pxSink->bWaitKeyFrame = (pxParameter->eBackpressure == eFanoutDropOldestGop);
+
+        if (Lock(pFanout->xLock) != LOCK_OK)
+        {
+            free(pxSink);
+            pxSink = NULL;
+        }
+        else
+        {
+            if ((idx = prvFindSink(pFanout, NULL)) < 0)
+            {
+                free(pxSink);
+                pxSink = NULL;
+            }
+            else
+            {
+                pFanout->pxSinks[idx] = pxSink;
+            }
+
+            Unlock(pFanout->xLock);
+        }
+    }
+
+    return pxSink;
+}
+
+void FrameFanout_removeSink(FrameFanoutHandle handle, FrameFanoutSinkHandle sinkHandle)
+{
+    FrameFanout_t *pFanout = (FrameFanout_t *)handle;
+    FrameFanoutSink_t *pxSink = (FrameFanoutSink_t *)sinkHandle;
+    int idx = 0;
+
+    if (pFanout != NULL && pxSink != NULL && Lock(pFanout->xLock) == LOCK_OK)
+    {
+        if ((idx = prvFindSink(pFanout, pxSink)) >= 0)
+        {
+            pFanout->pxSinks[idx] = NULL;
+            prvSinkTerminate(pxSink);
+        }
+
+        Unlock(pFanout->xLock);
+    }
+}
+
+int FrameFanout_publish(FrameFanoutHandle handle, SharedFrameHandle xFrame, uint64_t uTimestampMs)
+{
+    int res = ERRNO_NONE;
+    FrameFanout_t *pFanout = (FrameFanout_t *)handle;
+    FrameFanoutFrame_t xFanoutFrame = {0};
+    FrameFanoutSink_t *pxSink = NULL;
+    int i = 0;
+
+    if (pFanout == NULL || xFrame == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else if (
+        SharedFrame_getAvcc(xFrame, &(xFanoutFrame.pAvcc), &(xFanoutFrame.uAvccLen)) != 0 ||
+        SharedFrame_getFrameInfo(xFrame, &(xFanoutFrame.pxFrameInfo)) != 0)
+    {
+        /* The frame is analyzed here, and the AVCC view and its info are shared by all sinks. */
+        res = ERRNO_FAIL;
+    }
+    else if (Lock(pFanout->xLock) != LOCK_OK)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        xFanoutFrame.xFrame = xFrame;
+        xFanoutFrame.uTimestampMs = uTimestampMs;
+        xFanoutFrame.bIsKeyFrame = xFanoutFrame.pxFrameInfo->bIsKeyFrame;
+
+        for (i = 0; i < FRAME_FANOUT_MAX_SINKS; i++)
+        {
+            if ((pxSink = pFanout->pxSinks[i]) == NULL)
+            {
+                /* nop */
+            }
+            else if (!prvSinkMakeRoom(pxSink, xFanoutFrame.bIsKeyFrame))
+            {
+                pxSink->uDroppedCount++;
+            }
+            else
+            {
+                SharedFrame_retain(xFrame);
+                memcpy(&(pxSink->pxQueue[(pxSink->uHead + pxSink->uCount) % pxSink->xParameter.uQueueLen]), &xFanoutFrame, sizeof(FrameFanoutFrame_t));
+                pxSink->uCount++;
+
+                if (pxSink->xParameter.xWakeEvent != NULL)
+                {
+                    kvsEventSignal(pxSink->xParameter.xWakeEvent);
+                }
+            }
+        }
+
+        Unlock(pFanout->xLock);
+    }
+
+    return res;
+}
+
+int FrameFanout_receive(FrameFanoutHandle handle, FrameFanoutSinkHandle sinkHandle, FrameFanoutFrame_t *pxFrame)
+{
+    int res = ERRNO_NONE;
+    FrameFanout_t *pFanout = (FrameFanout_t *)handle;
+    FrameFanoutSink_t *pxSink = (FrameFanoutSink_t *)sinkHandle;
+
+    if (pFanout == NULL || pxSink == NULL || pxFrame == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else if (Lock(pFanout->xLock) != LOCK_OK)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        if (pxSink->uCount == 0)
+        {
+            res = ERRNO_FAIL;
+        }
+        else
+        {
+            /* The reference of the queue is handed over to the receiver. */
+            memcpy(pxFrame, &(pxSink->pxQueue[pxSink->uHead]), sizeof(FrameFanoutFrame_t));
+            memset(&(pxSink->pxQueue[pxSink->uHead]), 0, sizeof(FrameFanoutFrame_t));
+            pxSink->uHead = (pxSink->uHead + 1) % pxSink->xParameter.uQueueLen;
+            pxSink->uCount--;
+            pxSink->uDeliveredCount++;
+        }
+
+        Unlock(pFanout->xLock);
+    }
+
+    return res;
+}
+
+int FrameFanout_getSinkStat(FrameFanoutHandle handle, FrameFanoutSinkHandle sinkHandle, FrameFanoutSinkStat_t *pxStat)
+{
+    int res = ERRNO_NONE;
+    FrameFanout_t *pFanout = (FrameFanout_t *)handle;
+    FrameFanoutSink_t *pxSink = (FrameFanoutSink_t *)sinkHandle;
+
+    if (pFanout == NULL || pxSink == NULL || pxStat == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else if (Lock(pFanout->xLock) != LOCK_OK)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        pxStat->uQueuedCount = pxSink->uCount;
+        pxStat->uDeliveredCount = pxSink->uDeliveredCount;
+        pxStat->uDroppedCount = pxSink->uDroppedCount;
+
+        Unlock(pFanout->xLock);
+    }
+
+    return res;
+}
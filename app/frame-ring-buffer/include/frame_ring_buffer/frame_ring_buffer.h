@@ -23,6 +23,21 @@ typedef struct FrameRingBuffer *FrameRingBufferHandle;
 
 typedef struct FrameKey *FrameKeyHandle;
 
+typedef struct FrameRingBufferReader *FrameRingBufferReaderHandle;
+
+/*
+ * Writers, i.e. enqueue, dequeue and the drop frame policy, are serialized by a lock. Readers, i.e. getFrame and
+ * readFrame, never take the lock, so they can be called by any number of threads while frames are enqueued. The data of
+ * a frame is owned by the buffer, and it's only valid until the frame is dropped and destructed.
+ *
+ * A ring can also be in shared memory, so processes on the same Linux host, e.g. capture, the uploader and an RTSP
+ * server, read the same frames without copying them. Any of the processes can enqueue, and they're serialized by a
+ * process-shared mutex in the segment.
+ */
+
+/* Flags of a frame */
+#define FRAME_RING_BUFFER_FLAG_KEY_FRAME    (1 << 0)    /* The frame can be decoded without earlier frames. */
+
 typedef struct FrameDestructorInfo
 {
     int (*frameDestructor)(uint8_t *pData, size_t uLen, FrameKeyHandle keyHandle, void *pAppData);
@@ -33,13 +48,16 @@ typedef struct FrameRingBufferStatistics
 {
     size_t uFrameUsedCount;
     size_t uFrameFreeCount;
-    size_t uSumOfFrameMemory;
+    size_t uSumOfFrameMemory;   /* Sum of frame lengths, which are in the storage if the buffer owns one */
+    size_t uBufferMemory;       /* Memory allocated by the buffer itself, including the storage */
 } FrameRingBufferStat_t;
 
 typedef enum
 {
     eDontDrop = 0,  /* It's default value and no drop frame policy. Frame is dropped manually by using dequeue API. */
-    eDropOldest     /* Whenever frame exceeds the memory limit, it drops oldest frame first. */
+    eDropOldest,    /* Whenever frame exceeds the memory limit, it drops oldest frame first. */
+    eDropOldestGop  /* Like eDropOldest, and then it drops the rest of the GOP, so the buffer always starts from a key
+                     * frame flagged by FRAME_RING_BUFFER_FLAG_KEY_FRAME. It uses xDropOldestPolicyParameter. */
 } eDropFramePolicyType;
 
 typedef struct DropOldestPolicyParameter
@@ -65,7 +83,43 @@ typedef struct DropFramePolicy
 FrameRingBufferHandle FrameRingBuffer_create(size_t uCapacity);
 
 /**
- * Terminate frame ring buffer and free all resources.
+ * Create a frame ring buffer that owns a contiguous storage of frames. Frames are written into the storage either by
+ * FrameRingBuffer_reserve() and FrameRingBuffer_commit(), or copied by FrameRingBuffer_enqueue(), so there's no
+ * allocation per frame. The oldest frames are dropped whenever the storage has no room for a new frame.
+ *
+ * @param[in] uCapacity Capacity of the frame ring buffer
+ * @param[in] uStorageSize Size of the storage, or 0 to keep pointers of application frames like FrameRingBuffer_create()
+ * @return Handle of the frame ring buffer on success, or NULL otherwise
+ */
+FrameRingBufferHandle FrameRingBuffer_createWithStorage(size_t uCapacity, size_t uStorageSize);
+
+/**
+ * Create a frame ring buffer in a POSIX shared memory segment, which other processes open by
+ * FrameRingBuffer_openShared(). The elements and the storage are in the segment, and frames are always copied into the
+ * storage, so frames have no destructor. A segment of the same name that is left by an earlier run is replaced.
+ *
+ * It's only supported on Linux, and it returns NULL on other platforms.
+ *
+ * @param[in] pcName Name of the segment, e.g. "/kvs-camera"
+ * @param[in] uCapacity Capacity of the frame ring buffer
+ * @param[in] uStorageSize Size of the storage, which must not be 0
+ * @return Handle of the frame ring buffer on success, or NULL otherwise
+ */
+FrameRingBufferHandle FrameRingBuffer_createShared(const char *pcName, size_t uCapacity, size_t uStorageSize);
+
+/**
+ * Open a frame ring buffer that another process created by FrameRingBuffer_createShared(). It fails until the creator
+ * has initialized the segment, so it can be retried. Both processes have to be built with the same version of this
+ * library.
+ *
+ * @param[in] pcName Name of the segment
+ * @return Handle of the frame ring buffer on success, or NULL otherwise
+ */
+FrameRingBufferHandle FrameRingBuffer_openShared(const char *pcName);
+
+/**
+ * Terminate frame ring buffer and free all resources. A shared memory ring is unmapped, and its segment is unlinked if
+ * this process created it. Processes that opened it can still use it until they terminate their handles.
  *
  * @param[in] handle Handle of the frame ring buffer
  */
@@ -73,6 +127,8 @@ void FrameRingBuffer_terminate(FrameRingBufferHandle handle);
 
 /**
  * Enqueue a frame and return a key handle of the frame. This frame key handle is for a application to check and validate if the frame is still available.
+ * If the frame ring buffer owns a storage, the frame is copied into it, and the application keeps the ownership of
+ * pData.
  *
  * @param[in] handle Handle of the frame ring buffer
  * @param[in] pData Data pointer of the frame
@@ -82,6 +138,39 @@ void FrameRingBuffer_terminate(FrameRingBufferHandle handle);
  */
 FrameKeyHandle FrameRingBuffer_enqueue(FrameRingBufferHandle handle, uint8_t *pData, size_t uLen, FrameDestructorInfo_t *pFrameDestructorInfo);
 
+/**
+ * Enqueue a frame with flags, e.g. FRAME_RING_BUFFER_FLAG_KEY_FRAME so that readers can seek to it.
+ *
+ * @param[in] handle Handle of the frame ring buffer
+ * @param[in] pData Data pointer of the frame
+ * @param[in] uLen Length of the frame
+ * @param[in] uFlags Flags of the frame
+ * @param[in] pFrameDestructorInfo Destructor of the frame
+ * @return Frame key handle on success, NULL otherwise
+ */
+FrameKeyHandle FrameRingBuffer_enqueueEx(FrameRingBufferHandle handle, uint8_t *pData, size_t uLen, uint32_t uFlags, FrameDestructorInfo_t *pFrameDestructorInfo);
+
+/**
+ * Reserve contiguous bytes of the storage for the next frame, which is then written in place and enqueued by
+ * FrameRingBuffer_commit(). The oldest frames are dropped to make room. Only one frame can be reserved at a time.
+ *
+ * @param[in] handle Handle of the frame ring buffer
+ * @param[in] uLen Max length of the frame
+ * @return Pointer of the reserved bytes on success, NULL otherwise
+ */
+uint8_t *FrameRingBuffer_reserve(FrameRingBufferHandle handle, size_t uLen);
+
+/**
+ * Enqueue the reserved frame. Committing 0 bytes cancels the reservation.
+ *
+ * @param[in] handle Handle of the frame ring buffer
+ * @param[in] uLen Length of the frame, which is no more than the reserved length
+ * @param[in] uFlags Flags of the frame
+ * @param[in] pFrameDestructorInfo Destructor of the frame, which is notified when the frame is dropped, or NULL
+ * @return Frame key handle on success, NULL otherwise
+ */
+FrameKeyHandle FrameRingBuffer_commit(FrameRingBufferHandle handle, size_t uLen, uint32_t uFlags, FrameDestructorInfo_t *pFrameDestructorInfo);
+
 /**
  * Specifically dequeue a frame. In most cases, frames are expected to dequeued by its policy instead of manually dequeued by this API.
  *
@@ -91,7 +180,10 @@ FrameKeyHandle FrameRingBuffer_enqueue(FrameRingBufferHandle handle, uint8_t *pD
 int FrameRingBuffer_dequeue(FrameRingBufferHandle handle);
 
 /**
- * Get a frame by frame key handle. This API can be used to validate a frame key handle.
+ * Get a frame by frame key handle. This API can be used to validate a frame key handle. It doesn't take the lock.
+ *
+ * A key is valid for FRAME_RING_BUFFER_KEY_LAPS laps of the buffer, i.e. it's not found after its frame is dropped, but
+ * it matches a newer frame if it's kept for more laps than that.
  *
  * @param[in] keyHandle Frame key handle
  * @param[out] ppData Pointer of the frame
@@ -100,6 +192,26 @@ int FrameRingBuffer_dequeue(FrameRingBufferHandle handle);
  */
 int FrameRingBuffer_getFrame(FrameKeyHandle keyHandle, uint8_t **ppData, size_t *puLen);
 
+/**
+ * Get the serial number of a frame key, which identifies the key in every process of a shared memory ring, e.g. to
+ * pass a frame to another process.
+ *
+ * @param[in] keyHandle Frame key handle
+ * @param[out] puSerialNumber Serial number of the key
+ * @return 0 on success, non-zero value otherwise
+ */
+int FrameRingBuffer_getKeySerialNumber(FrameKeyHandle keyHandle, size_t *puSerialNumber);
+
+/**
+ * Get the frame key handle of a serial number in this process. The key is checked by FrameRingBuffer_getFrame() as
+ * usual, so a key of a frame that has been dropped is not found.
+ *
+ * @param[in] handle Handle of the frame ring buffer
+ * @param[in] uSerialNumber Serial number from FrameRingBuffer_getKeySerialNumber()
+ * @return Frame key handle on success, NULL otherwise
+ */
+FrameKeyHandle FrameRingBuffer_getKeyBySerialNumber(FrameRingBufferHandle handle, size_t uSerialNumber);
+
 /**
  * Get statistics of frame ring buffer.
  *
@@ -118,4 +230,40 @@ int FrameRingBuffer_getMemoryStat(FrameRingBufferHandle handle, FrameRingBufferS
  */
 int FrameRingBuffer_setDropFramePolicy(FrameRingBufferHandle handle, DropFramePolicy_t *pPolicy);
 
+/**
+ * Create a reader of a frame ring buffer. A reader reads frames in order, starting from the next enqueued frame. Each
+ * reader is used by one thread, and it should be terminated before the frame ring buffer.
+ *
+ * @param[in] handle Handle of the frame ring buffer
+ * @return Handle of the reader on success, or NULL otherwise
+ */
+FrameRingBufferReaderHandle FrameRingBuffer_createReader(FrameRingBufferHandle handle);
+
+/**
+ * Terminate a reader.
+ *
+ * @param[in] readerHandle Handle of the reader
+ */
+void FrameRingBuffer_terminateReader(FrameRingBufferReaderHandle readerHandle);
+
+/**
+ * Read the next frame of a reader without taking the lock. Frames that are dropped before they're read are skipped.
+ *
+ * @param[in] readerHandle Handle of the reader
+ * @param[out] ppData Pointer of the frame
+ * @param[out] puLen Length of the frame
+ * @param[out] pKeyHandle Frame key handle of the frame, or NULL if it's not needed
+ * @return 0 on success, non-zero value if there is no new frame
+ */
+int FrameRingBuffer_readFrame(FrameRingBufferReaderHandle readerHandle, uint8_t **ppData, size_t *puLen, FrameKeyHandle *pKeyHandle);
+
+/**
+ * Move a reader back to the newest key frame in the buffer, so that a new consumer can start decoding from buffered
+ * frames instead of waiting for the next key frame. The reader is not moved if there is no key frame.
+ *
+ * @param[in] readerHandle Handle of the reader
+ * @return 0 on success, non-zero value if there is no key frame in the buffer
+ */
+int FrameRingBuffer_seekLatestKeyFrame(FrameRingBufferReaderHandle readerHandle);
+
 #endif /* FRAME_RING_BUFFER_H */
\ No newline at end of file
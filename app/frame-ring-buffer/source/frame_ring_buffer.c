@@ -13,6 +13,16 @@
  * permissions and limitations under the License.
  */
 
+/* Shared memory rings need POSIX shared memory and robust process-shared mutexes. */
+#if defined(__linux__)
+#define FRB_SHARED_MEMORY 1
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#else
+#define FRB_SHARED_MEMORY 0
+#endif
+
 #include "frame_ring_buffer/frame_ring_buffer.h"
 
 #include <stdint.h>
@@ -23,56 +33,141 @@
 #include <inttypes.h>
 #include <limits.h>
 
+#if FRB_SHARED_MEMORY
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /* Thirdparty headers */
 #include "azure_c_shared_utility/lock.h"
 
 #define ERRNO_NONE 0
 #define ERRNO_FAIL __LINE__
 
+/* Readers don't take the lock, so the fields they read are published with these. */
+#define FRB_ATOMIC_LOAD(p)          __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define FRB_ATOMIC_LOAD_RELAXED(p)  __atomic_load_n((p), __ATOMIC_RELAXED)
+#define FRB_ATOMIC_STORE(p, v)      __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define FRB_ATOMIC_STORE_RELAXED(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define FRB_ATOMIC_FENCE()          __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* A frame key stays valid for this many laps of the ring, and a key that is held longer may match a newer frame. */
+#ifndef FRAME_RING_BUFFER_KEY_LAPS
+#define FRAME_RING_BUFFER_KEY_LAPS  (8)
+#endif
+
+/* "FRBS" marks a shared memory segment that is initialized by its creator. */
+#define FRB_SEGMENT_MAGIC           (0x46524253)
+
+/* Keys are immutable, and a key is the serial number of all frames of that serial number. */
 typedef struct FrameKey
 {
     struct FrameRingBuffer *pFrameRingBuffer;
-    uint16_t uSerialNumber;
+    size_t uSerialNumber;
 } FrameKey_t;
 
 typedef struct FrameElement
 {
-    uint8_t *pData;
+    /* It's odd while the writer updates the element, and readers retry until they see the same even value before and
+     * after they read the element. */
+    uint32_t uSeq;
+
+    bool bUsed;
+    size_t uFrameNo;
+    /* The pointer of an application frame, or the offset of the frame in the storage, because the storage of a shared
+     * memory ring is mapped at different addresses by processes. */
+    uintptr_t uData;
     size_t uLen;
-
-    FrameKey_t xKey;
+    uint32_t uFlags;
 
     FrameDestructorInfo_t xFrameDestructInfo;
 } FrameElement_t;
 
+/* The state that writers change under the lock. It's in the shared memory segment of a shared memory ring. */
+typedef struct FrameRingBufferState
+{
+    /* uHead is the frame number of the next frame to enqueue, and uTail is the one of the oldest frame. */
+    size_t uHead;
+    size_t uTail;
+
+    /* Frames are written in order into the storage if the buffer owns one, so the oldest frame is always at the storage
+     * offset of the tail element, and one frame at a time is reserved at uWriteOff or at the start of the storage. */
+    size_t uWriteOff;
+    size_t uReservedOff;
+    size_t uReservedLen;
+    bool bReserved;
+
+    FrameRingBufferStat_t xStat;
+
+    DropFramePolicy_t xDropFramePolicy;
+} FrameRingBufferState_t;
+
+/* A shared memory segment is this header, the elements and then the storage. Keys hold the address of the ring, so
+ * every process keeps its own keys, and a key is passed to another process by its serial number. */
+typedef struct FrameRingBufferSegment
+{
+    uint32_t uMagic;
+    size_t uCapacity;
+    size_t uStorageSize;
+    size_t uSegmentSize;
+
+#if FRB_SHARED_MEMORY
+    pthread_mutex_t xMutex;
+#endif
+
+    FrameRingBufferState_t xState;
+} FrameRingBufferSegment_t;
+
 typedef struct FrameRingBuffer
 {
+    /* Writers, i.e. enqueue, dequeue and policy, are serialized by the lock, or by the mutex of the segment if the
+     * ring is in shared memory. Readers never take it. */
     LOCK_HANDLE xLock;
+    FrameRingBufferSegment_t *pSegment;
 
+    /* The name of the segment if this process created it, so it's unlinked when the ring is terminated */
+    char *pcSegmentName;
+
+    FrameRingBufferState_t *pState;
+
+    /* Frame N is kept in element N % uCapacity. Frame numbers wrap around at uMaxFrameNo, which is a multiple of
+     * uKeyCount, so elements and keys are still in order after the wrap around. */
     FrameElement_t *pBuf;
-    size_t uHeadIdx;
-    size_t uTailIdx;
-    size_t uSize;
     size_t uCapacity;
+    size_t uMaxFrameNo;
 
-    unsigned short uNextSerialNumber;
-    unsigned short uMaxSerialNumber;
+    FrameKey_t *pKeys;
+    size_t uKeyCount;
 
-    FrameRingBufferStat_t xStat;
+    uint8_t *pStorage;
+    size_t uStorageSize;
 
-    DropFramePolicy_t xDropFramePolicy;
+    /* Memory allocated for the ring itself, i.e. elements, keys and the storage */
+    size_t uBufferMemory;
 } FrameRingBuffer_t;
 
+typedef struct FrameRingBufferReader
+{
+    FrameRingBuffer_t *pFrameRingBuffer;
+
+    /* The frame number of the next frame to read */
+    size_t uCursor;
+} FrameRingBufferReader_t;
+
 static int prvDequeue(FrameRingBuffer_t *pFrameRingBuffer);
 
 static size_t prvGetFreeCount(FrameRingBuffer_t *pFrameRingBuffer)
 {
-    return pFrameRingBuffer->xStat.uFrameFreeCount;
+    return pFrameRingBuffer->pState->xStat.uFrameFreeCount;
 }
 
 static size_t prvGetUsedCount(FrameRingBuffer_t *pFrameRingBuffer)
 {
-    return pFrameRingBuffer->xStat.uFrameUsedCount;
+    return pFrameRingBuffer->pState->xStat.uFrameUsedCount;
 }
 
 static bool prvIsFull(FrameRingBuffer_t *pFrameRingBuffer)
@@ -85,23 +180,160 @@ static bool prvIsEmpty(FrameRingBuffer_t *pFrameRingBuffer)
     return prvGetUsedCount(pFrameRingBuffer) == 0;
 }
 
-static void stepSerialNumber(FrameRingBuffer_t *pFrameRingBuffer, FrameKey_t *pKey)
+static size_t prvNextFrameNo(FrameRingBuffer_t *pFrameRingBuffer, size_t uFrameNo)
+{
+    return (uFrameNo + 1 == pFrameRingBuffer->uMaxFrameNo) ? 0 : uFrameNo + 1;
+}
+
+static size_t prvFrameNoDiff(FrameRingBuffer_t *pFrameRingBuffer, size_t uFrameNo, size_t uOlderFrameNo)
 {
-    if (pKey->uSerialNumber == (pFrameRingBuffer->uSize) * 2 - 1)
+    return (uFrameNo >= uOlderFrameNo) ? (uFrameNo - uOlderFrameNo) : (uFrameNo + pFrameRingBuffer->uMaxFrameNo - uOlderFrameNo);
+}
+
+static FrameKey_t *prvKeyOfFrame(FrameRingBuffer_t *pFrameRingBuffer, size_t uFrameNo)
+{
+    return &(pFrameRingBuffer->pKeys[uFrameNo % pFrameRingBuffer->uKeyCount]);
+}
+
+static uintptr_t prvDataRef(FrameRingBuffer_t *pFrameRingBuffer, uint8_t *pData)
+{
+    return (pFrameRingBuffer->pStorage == NULL) ? (uintptr_t)pData : (uintptr_t)(pData - pFrameRingBuffer->pStorage);
+}
+
+static uint8_t *prvDataOf(FrameRingBuffer_t *pFrameRingBuffer, uintptr_t uData)
+{
+    return (pFrameRingBuffer->pStorage == NULL) ? (uint8_t *)uData : pFrameRingBuffer->pStorage + uData;
+}
+
+static void prvBeginWrite(FrameElement_t *pFrameElement)
+{
+    FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->uSeq), pFrameElement->uSeq + 1);
+    FRB_ATOMIC_FENCE();
+}
+
+static void prvEndWrite(FrameElement_t *pFrameElement)
+{
+    FRB_ATOMIC_STORE(&(pFrameElement->uSeq), pFrameElement->uSeq + 1);
+}
+
+/**
+ * Read an element without the lock. The snapshot is consistent, but the frame may be dropped right after it's read, so
+ * the data is only valid as long as the application keeps the frame from being dropped.
+ */
+static void prvReadElement(FrameRingBuffer_t *pFrameRingBuffer, FrameElement_t *pFrameElement, bool *pbUsed, size_t *puFrameNo, uint8_t **ppData, size_t *puLen, uint32_t *puFlags)
+{
+    uint32_t uSeq = 0;
+    uintptr_t uData = 0;
+
+    do
     {
-        pKey->uSerialNumber = 0;
+        while ((uSeq = FRB_ATOMIC_LOAD(&(pFrameElement->uSeq))) & 1)
+        {
+            /* nop */
+        }
+
+        *pbUsed = FRB_ATOMIC_LOAD_RELAXED(&(pFrameElement->bUsed));
+        *puFrameNo = FRB_ATOMIC_LOAD_RELAXED(&(pFrameElement->uFrameNo));
+        uData = FRB_ATOMIC_LOAD_RELAXED(&(pFrameElement->uData));
+        *puLen = FRB_ATOMIC_LOAD_RELAXED(&(pFrameElement->uLen));
+        *puFlags = FRB_ATOMIC_LOAD_RELAXED(&(pFrameElement->uFlags));
+
+        FRB_ATOMIC_FENCE();
+    } while (FRB_ATOMIC_LOAD_RELAXED(&(pFrameElement->uSeq)) != uSeq);
+
+    *ppData = prvDataOf(pFrameRingBuffer, uData);
+}
+
+#if FRB_SHARED_MEMORY
+/**
+ * Make the ring consistent again after a process died while it held the mutex. An element that it was writing is left
+ * with an odd sequence, which readers would wait for forever, so the element is released. The head and the tail are
+ * only moved after the element is written, so the frame in it was either not enqueued yet or is dropped again.
+ */
+static void prvRecoverSegment(FrameRingBuffer_t *pFrameRingBuffer)
+{
+    FrameElement_t *pFrameElement = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < pFrameRingBuffer->uCapacity; i++)
+    {
+        pFrameElement = &(pFrameRingBuffer->pBuf[i]);
+        if (pFrameElement->uSeq & 1)
+        {
+            FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->bUsed), false);
+            prvEndWrite(pFrameElement);
+        }
+    }
+}
+
+static int prvLockSegment(FrameRingBuffer_t *pFrameRingBuffer)
+{
+    int res = ERRNO_NONE;
+    int err = pthread_mutex_lock(&(pFrameRingBuffer->pSegment->xMutex));
+
+    if (err == EOWNERDEAD)
+    {
+        prvRecoverSegment(pFrameRingBuffer);
+        err = pthread_mutex_consistent(&(pFrameRingBuffer->pSegment->xMutex));
+    }
+
+    if (err != 0)
+    {
+        res = ERRNO_FAIL;
+    }
+
+    return res;
+}
+
+static void prvUnlockSegment(FrameRingBuffer_t *pFrameRingBuffer)
+{
+    pthread_mutex_unlock(&(pFrameRingBuffer->pSegment->xMutex));
+}
+#else
+static int prvLockSegment(FrameRingBuffer_t *pFrameRingBuffer)
+{
+    return ERRNO_FAIL;
+}
+
+static void prvUnlockSegment(FrameRingBuffer_t *pFrameRingBuffer)
+{
+}
+#endif /* FRB_SHARED_MEMORY */
+
+static int prvLock(FrameRingBuffer_t *pFrameRingBuffer)
+{
+    int res = ERRNO_NONE;
+
+    if (pFrameRingBuffer->pSegment != NULL)
+    {
+        res = prvLockSegment(pFrameRingBuffer);
+    }
+    else if (Lock(pFrameRingBuffer->xLock) != LOCK_OK)
+    {
+        res = ERRNO_FAIL;
+    }
+
+    return res;
+}
+
+static void prvUnlock(FrameRingBuffer_t *pFrameRingBuffer)
+{
+    if (pFrameRingBuffer->pSegment != NULL)
+    {
+        prvUnlockSegment(pFrameRingBuffer);
     }
     else
     {
-        pKey->uSerialNumber = pKey->uSerialNumber + 1;
+        Unlock(pFrameRingBuffer->xLock);
     }
 }
 
-static int prvEnqueue(FrameRingBuffer_t *pFrameRingBuffer, uint8_t *pData, size_t uLen, FrameKey_t **ppKey, FrameDestructorInfo_t *pFrameDestructorInfo)
+static int prvEnqueue(FrameRingBuffer_t *pFrameRingBuffer, uint8_t *pData, size_t uLen, uint32_t uFlags, FrameKey_t **ppKey, FrameDestructorInfo_t *pFrameDestructorInfo)
 {
     int res = ERRNO_NONE;
     FrameElement_t *pFrameElement = NULL;
-    FrameRingBufferStat_t *pStat = &(pFrameRingBuffer->xStat);
+    FrameRingBufferStat_t *pStat = &(pFrameRingBuffer->pState->xStat);
+    size_t uFrameNo = pFrameRingBuffer->pState->uHead;
 
     if (prvIsFull(pFrameRingBuffer) && prvDequeue(pFrameRingBuffer) != ERRNO_NONE)
     {
@@ -109,33 +341,27 @@ static int prvEnqueue(FrameRingBuffer_t *pFrameRingBuffer, uint8_t *pData, size_
     }
     else
     {
-        pFrameElement = &(pFrameRingBuffer->pBuf[pFrameRingBuffer->uHeadIdx]);
-        pFrameElement->pData = pData;
-        pFrameElement->uLen = uLen;
-
-        pFrameElement->xKey.uSerialNumber = pFrameRingBuffer->uNextSerialNumber;
-        pFrameRingBuffer->uNextSerialNumber++;
-        if (pFrameRingBuffer->uNextSerialNumber == pFrameRingBuffer->uMaxSerialNumber)
-        {
-            pFrameRingBuffer->uNextSerialNumber = 0;
-        }
-        pFrameElement->xKey.pFrameRingBuffer = pFrameRingBuffer;
-
+        /* The element is free, since the oldest frame is dropped if the buffer is full. */
+        pFrameElement = &(pFrameRingBuffer->pBuf[uFrameNo % pFrameRingBuffer->uCapacity]);
+
+        prvBeginWrite(pFrameElement);
+        FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->bUsed), true);
+        FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->uFrameNo), uFrameNo);
+        FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->uData), prvDataRef(pFrameRingBuffer, pData));
+        FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->uLen), uLen);
+        FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->uFlags), uFlags);
         if (pFrameDestructorInfo != NULL)
         {
             memcpy(&(pFrameElement->xFrameDestructInfo), pFrameDestructorInfo, sizeof(FrameDestructorInfo_t));
         }
+        prvEndWrite(pFrameElement);
 
-        pFrameRingBuffer->uHeadIdx++;
-        if (pFrameRingBuffer->uHeadIdx >= pFrameRingBuffer->uSize)
-        {
-            pFrameRingBuffer->uHeadIdx = 0;
-        }
+        FRB_ATOMIC_STORE(&(pFrameRingBuffer->pState->uHead), prvNextFrameNo(pFrameRingBuffer, uFrameNo));
 
-        *ppKey = &(pFrameElement->xKey);
+        *ppKey = prvKeyOfFrame(pFrameRingBuffer, uFrameNo);
 
         /* Update statistics */
-        pStat->uSumOfFrameMemory += pFrameElement->uLen;
+        pStat->uSumOfFrameMemory += uLen;
         pStat->uFrameFreeCount--;
         pStat->uFrameUsedCount++;
     }
@@ -146,14 +372,24 @@ static int prvEnqueue(FrameRingBuffer_t *pFrameRingBuffer, uint8_t *pData, size_
 static int prvRemoveFrame(FrameRingBuffer_t *pFrameRingBuffer, FrameElement_t *pFrameElement)
 {
     int res = ERRNO_NONE;
-    int (*frameDestructor)(uint8_t *pData, size_t uLen, FrameKeyHandle keyHandle, void *pAppData);
-
-    frameDestructor = pFrameElement->xFrameDestructInfo.frameDestructor;
-    if (frameDestructor != NULL)
+    FrameDestructorInfo_t xFrameDestructInfo = pFrameElement->xFrameDestructInfo;
+    uint8_t *pData = prvDataOf(pFrameRingBuffer, pFrameElement->uData);
+    size_t uLen = pFrameElement->uLen;
+    FrameKey_t *pKey = prvKeyOfFrame(pFrameRingBuffer, pFrameElement->uFrameNo);
+
+    /* Readers stop seeing the frame before it's destructed. */
+    prvBeginWrite(pFrameElement);
+    FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->bUsed), false);
+    FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->uData), 0);
+    FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->uLen), 0);
+    FRB_ATOMIC_STORE_RELAXED(&(pFrameElement->uFlags), 0);
+    memset(&(pFrameElement->xFrameDestructInfo), 0, sizeof(FrameDestructorInfo_t));
+    prvEndWrite(pFrameElement);
+
+    if (xFrameDestructInfo.frameDestructor != NULL)
     {
-        frameDestructor(pFrameElement->pData, pFrameElement->uLen, &(pFrameElement->xKey), pFrameElement->xFrameDestructInfo.pAppData);
+        xFrameDestructInfo.frameDestructor(pData, uLen, pKey, xFrameDestructInfo.pAppData);
     }
-    memset(pFrameElement, 0, sizeof(FrameElement_t));
 
     return res;
 }
@@ -163,7 +399,7 @@ static int prvDequeue(FrameRingBuffer_t *pFrameRingBuffer)
     int res = ERRNO_NONE;
     FrameElement_t *pFrameElement = NULL;
     size_t uFrameLen = 0;
-    FrameRingBufferStat_t *pStat = &(pFrameRingBuffer->xStat);
+    FrameRingBufferStat_t *pStat = &(pFrameRingBuffer->pState->xStat);
 
     if (prvIsEmpty(pFrameRingBuffer))
     {
@@ -171,16 +407,12 @@ static int prvDequeue(FrameRingBuffer_t *pFrameRingBuffer)
     }
     else
     {
-        pFrameElement = &(pFrameRingBuffer->pBuf[pFrameRingBuffer->uTailIdx]);
+        pFrameElement = &(pFrameRingBuffer->pBuf[pFrameRingBuffer->pState->uTail % pFrameRingBuffer->uCapacity]);
         uFrameLen = pFrameElement->uLen;
 
         prvRemoveFrame(pFrameRingBuffer, pFrameElement);
 
-        pFrameRingBuffer->uTailIdx++;
-        if (pFrameRingBuffer->uTailIdx >= pFrameRingBuffer->uSize)
-        {
-            pFrameRingBuffer->uTailIdx = 0;
-        }
+        pFrameRingBuffer->pState->uTail = prvNextFrameNo(pFrameRingBuffer, pFrameRingBuffer->pState->uTail);
 
         /* Update statistics */
         pStat->uSumOfFrameMemory -= uFrameLen;
@@ -191,66 +423,125 @@ static int prvDequeue(FrameRingBuffer_t *pFrameRingBuffer)
     return res;
 }
 
-static int prvFindFrameInContinuousRange(FrameRingBuffer_t *pFrameRingBuffer, FrameKey_t *pKey, size_t *puIdx, int uLeft, int uRight)
+/**
+ * Find frame of a key without the lock. The element of the key is checked against the serial number of the key, so a
+ * key of a frame that is dropped, or whose element is reused by a newer frame, is not found.
+ */
+static int prvFindFrame(FrameKey_t *pKey, uint8_t **ppData, size_t *puLen)
 {
     int res = ERRNO_NONE;
-    size_t uIdx = 0;
-
-    uIdx = pKey->uSerialNumber % (pFrameRingBuffer->uSize);
-    if (uIdx < uLeft || uIdx > uRight)
+    FrameRingBuffer_t *pFrameRingBuffer = pKey->pFrameRingBuffer;
+    FrameElement_t *pFrameElement = &(pFrameRingBuffer->pBuf[pKey->uSerialNumber % pFrameRingBuffer->uCapacity]);
+    bool bUsed = false;
+    size_t uFrameNo = 0;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    uint32_t uFlags = 0;
+
+    prvReadElement(pFrameRingBuffer, pFrameElement, &bUsed, &uFrameNo, &pData, &uLen, &uFlags);
+    if (!bUsed || uFrameNo % pFrameRingBuffer->uKeyCount != pKey->uSerialNumber)
     {
         res = ERRNO_FAIL;
     }
     else
     {
-        if (pFrameRingBuffer->pBuf[uIdx].xKey.uSerialNumber != pKey->uSerialNumber)
+        *ppData = pData;
+        *puLen = uLen;
+    }
+
+    return res;
+}
+
+/**
+ * Reserve contiguous bytes in the storage, where the oldest frames are dropped until there is enough room.
+ */
+static uint8_t *prvReserve(FrameRingBuffer_t *pFrameRingBuffer, size_t uLen)
+{
+    uint8_t *pReserved = NULL;
+    size_t uTailOff = 0;
+    size_t uWriteOff = 0;
+    bool bDrop = false;
+
+    if (pFrameRingBuffer->pStorage == NULL || pFrameRingBuffer->pState->bReserved || uLen == 0 || uLen > pFrameRingBuffer->uStorageSize)
+    {
+        /* nop */
+    }
+    else
+    {
+        do
         {
-            res = ERRNO_FAIL;
-        }
-        else
+            bDrop = false;
+            uWriteOff = pFrameRingBuffer->pState->uWriteOff;
+
+            if (prvIsEmpty(pFrameRingBuffer))
+            {
+                pFrameRingBuffer->pState->uWriteOff = 0;
+                pReserved = pFrameRingBuffer->pStorage;
+            }
+            else
+            {
+                uTailOff = pFrameRingBuffer->pBuf[pFrameRingBuffer->pState->uTail % pFrameRingBuffer->uCapacity].uData;
+
+                /* Frames are in [uTailOff, uWriteOff), or they wrap around and the free room is in between. */
+                if (uWriteOff > uTailOff && pFrameRingBuffer->uStorageSize - uWriteOff >= uLen)
+                {
+                    pReserved = pFrameRingBuffer->pStorage + uWriteOff;
+                }
+                else if (uWriteOff > uTailOff && uTailOff >= uLen)
+                {
+                    pReserved = pFrameRingBuffer->pStorage;
+                }
+                else if (uWriteOff < uTailOff && uTailOff - uWriteOff >= uLen)
+                {
+                    pReserved = pFrameRingBuffer->pStorage + uWriteOff;
+                }
+                else
+                {
+                    bDrop = (prvDequeue(pFrameRingBuffer) == ERRNO_NONE);
+                }
+            }
+        } while (bDrop);
+
+        if (pReserved != NULL)
         {
-            *puIdx = uIdx;
+            pFrameRingBuffer->pState->uReservedOff = pReserved - pFrameRingBuffer->pStorage;
+            pFrameRingBuffer->pState->uReservedLen = uLen;
+            pFrameRingBuffer->pState->bReserved = true;
         }
     }
 
-
-    return res;
+    return pReserved;
 }
 
-static int prvFindFrame(FrameRingBuffer_t *pFrameRingBuffer, FrameKey_t *pKey, size_t *puIdx)
+static int prvCommit(FrameRingBuffer_t *pFrameRingBuffer, size_t uLen, uint32_t uFlags, FrameKey_t **ppKey, FrameDestructorInfo_t *pFrameDestructorInfo)
 {
     int res = ERRNO_NONE;
-    size_t uLatestIdx = 0;
-    size_t uIdx = 0;
 
-    if (prvIsEmpty(pFrameRingBuffer))
+    if (!pFrameRingBuffer->pState->bReserved || uLen > pFrameRingBuffer->pState->uReservedLen)
     {
         res = ERRNO_FAIL;
     }
     else
     {
-        uLatestIdx = (pFrameRingBuffer->uHeadIdx == 0) ? pFrameRingBuffer->uCapacity : pFrameRingBuffer->uHeadIdx - 1;
-        if (uLatestIdx >= pFrameRingBuffer->uTailIdx)
+        pFrameRingBuffer->pState->bReserved = false;
+
+        /* Committing zero bytes cancels the reservation. */
+        if (uLen == 0)
         {
-            /* Frames are in one continuous range. */
-            res = prvFindFrameInContinuousRange(pFrameRingBuffer, pKey, &uIdx, pFrameRingBuffer->uTailIdx, uLatestIdx);
+            res = ERRNO_FAIL;
         }
-        else
+        /* A destructor is a function of one process, while a frame of a shared memory ring is dropped by any of them. */
+        else if (pFrameRingBuffer->pSegment != NULL && pFrameDestructorInfo != NULL && pFrameDestructorInfo->frameDestructor != NULL)
         {
-            /* Frames are in two separate range. The first range is 0 to uLatestIdx, the second range is uTailIdx to uCapacity */
-            res = prvFindFrameInContinuousRange(pFrameRingBuffer, pKey, &uIdx, 0, (int)uLatestIdx);
-            if (res != 0)
-            {
-                res = prvFindFrameInContinuousRange(pFrameRingBuffer, pKey, &uIdx, (int)(pFrameRingBuffer->uTailIdx), (int)(pFrameRingBuffer->uCapacity));
-            }
+            res = ERRNO_FAIL;
         }
-    }
-
-    if (res == ERRNO_NONE)
-    {
-        if (puIdx != NULL)
+        else if ((res = prvEnqueue(pFrameRingBuffer, pFrameRingBuffer->pStorage + pFrameRingBuffer->pState->uReservedOff, uLen, uFlags, ppKey, pFrameDestructorInfo)) == ERRNO_NONE)
         {
-            *puIdx = uIdx;
+            pFrameRingBuffer->pState->uWriteOff = pFrameRingBuffer->pState->uReservedOff + uLen;
+        }
+        else
+        {
+            /* nop */
         }
     }
 
@@ -259,7 +550,7 @@ static int prvFindFrame(FrameRingBuffer_t *pFrameRingBuffer, FrameKey_t *pKey, s
 
 static size_t prvSumOfFrameMemory(FrameRingBuffer_t *pFrameRingBuffer)
 {
-    return pFrameRingBuffer->xStat.uSumOfFrameMemory;
+    return pFrameRingBuffer->pState->xStat.uSumOfFrameMemory;
 }
 
 static int prvGetMemoryStat(FrameRingBuffer_t *pFrameRingBuffer, FrameRingBufferStat_t *pStat)
@@ -269,6 +560,7 @@ static int prvGetMemoryStat(FrameRingBuffer_t *pFrameRingBuffer, FrameRingBuffer
     pStat->uFrameUsedCount = prvGetUsedCount(pFrameRingBuffer);
     pStat->uFrameFreeCount = prvGetFreeCount(pFrameRingBuffer);
     pStat->uSumOfFrameMemory = prvSumOfFrameMemory(pFrameRingBuffer);
+    pStat->uBufferMemory = pFrameRingBuffer->uBufferMemory;
 
     return res;
 }
@@ -287,31 +579,131 @@ static int prvApplyPolicyDropOldest(FrameRingBuffer_t *pFrameRingBuffer, DropOld
     return res;
 }
 
+static bool prvIsTailKeyFrame(FrameRingBuffer_t *pFrameRingBuffer)
+{
+    return (pFrameRingBuffer->pBuf[pFrameRingBuffer->pState->uTail % pFrameRingBuffer->uCapacity].uFlags & FRAME_RING_BUFFER_FLAG_KEY_FRAME) != 0;
+}
+
+static bool prvHasKeyFrame(FrameRingBuffer_t *pFrameRingBuffer)
+{
+    bool bHasKeyFrame = false;
+    size_t uFrameNo = pFrameRingBuffer->pState->uTail;
+    size_t i = 0;
+
+    for (i = 0; !bHasKeyFrame && i < prvGetUsedCount(pFrameRingBuffer); i++)
+    {
+        bHasKeyFrame = (pFrameRingBuffer->pBuf[uFrameNo % pFrameRingBuffer->uCapacity].uFlags & FRAME_RING_BUFFER_FLAG_KEY_FRAME) != 0;
+        uFrameNo = prvNextFrameNo(pFrameRingBuffer, uFrameNo);
+    }
+
+    return bHasKeyFrame;
+}
+
+static int prvApplyPolicyDropOldestGop(FrameRingBuffer_t *pFrameRingBuffer, DropOldestPolicyParameter_t *pDropOldestPolicyParameter)
+{
+    int res = ERRNO_NONE;
+    bool bDropped = false;
+
+    while (prvSumOfFrameMemory(pFrameRingBuffer) > pDropOldestPolicyParameter->uMaxMem &&
+        prvDequeue(pFrameRingBuffer) == ERRNO_NONE)
+    {
+        bDropped = true;
+    }
+
+    /* The rest of a GOP can't be decoded without its key frame, so it's dropped as well. Frames are kept if there is no
+     * key frame to start from, e.g. the key frames aren't flagged. */
+    if (bDropped && prvHasKeyFrame(pFrameRingBuffer))
+    {
+        while (!prvIsTailKeyFrame(pFrameRingBuffer) && prvDequeue(pFrameRingBuffer) == ERRNO_NONE)
+        {
+            /* nop */
+        }
+    }
+
+    return res;
+}
+
 static int prvApplyPolicy(FrameRingBuffer_t *pFrameRingBuffer)
 {
     int res = ERRNO_NONE;
 
-    if (pFrameRingBuffer->xDropFramePolicy.type == eDontDrop)
+    if (pFrameRingBuffer->pState->xDropFramePolicy.type == eDontDrop)
     {
         /* nop */
     }
-    else if (pFrameRingBuffer->xDropFramePolicy.type == eDropOldest)
+    else if (pFrameRingBuffer->pState->xDropFramePolicy.type == eDropOldest)
     {
-        res = prvApplyPolicyDropOldest(pFrameRingBuffer, &(pFrameRingBuffer->xDropFramePolicy.u.xDropOldestPolicyParameter));
+        res = prvApplyPolicyDropOldest(pFrameRingBuffer, &(pFrameRingBuffer->pState->xDropFramePolicy.u.xDropOldestPolicyParameter));
+    }
+    else if (pFrameRingBuffer->pState->xDropFramePolicy.type == eDropOldestGop)
+    {
+        res = prvApplyPolicyDropOldestGop(pFrameRingBuffer, &(pFrameRingBuffer->pState->xDropFramePolicy.u.xDropOldestPolicyParameter));
     }
 
     return res;
 }
 
+static bool prvIsSizeValid(size_t uCapacity, size_t uStorageSize)
+{
+    return uCapacity > 0 && uCapacity <= SIZE_MAX / FRAME_RING_BUFFER_KEY_LAPS / sizeof(FrameKey_t) / 2 &&
+        uStorageSize <= SIZE_MAX / 2 - sizeof(FrameRingBuffer_t) - sizeof(FrameRingBufferSegment_t) - uCapacity * sizeof(FrameElement_t);
+}
+
+static void prvInitState(FrameRingBufferState_t *pState, size_t uCapacity)
+{
+    pState->uHead = 0;
+    pState->uTail = 0;
+    pState->xStat.uSumOfFrameMemory = 0;
+    pState->xStat.uFrameUsedCount = 0;
+    pState->xStat.uFrameFreeCount = uCapacity;
+}
+
+/**
+ * Point a handle at the state and the elements, which are followed by the storage, and set up its keys, which follow
+ * the handle.
+ */
+static void prvInitRing(FrameRingBuffer_t *pFrameRingBuffer, FrameRingBufferState_t *pState, FrameElement_t *pBuf, size_t uCapacity, size_t uStorageSize)
+{
+    size_t uKeyCount = uCapacity * FRAME_RING_BUFFER_KEY_LAPS;
+    size_t i = 0;
+
+    pFrameRingBuffer->pState = pState;
+    pFrameRingBuffer->uCapacity = uCapacity;
+    pFrameRingBuffer->pBuf = pBuf;
+    pFrameRingBuffer->uMaxFrameNo = (SIZE_MAX / uKeyCount) * uKeyCount;
+
+    pFrameRingBuffer->pKeys = (FrameKey_t *)(pFrameRingBuffer + 1);
+    pFrameRingBuffer->uKeyCount = uKeyCount;
+    for (i = 0; i < uKeyCount; i++)
+    {
+        pFrameRingBuffer->pKeys[i].pFrameRingBuffer = pFrameRingBuffer;
+        pFrameRingBuffer->pKeys[i].uSerialNumber = i;
+    }
+
+    if (uStorageSize > 0)
+    {
+        pFrameRingBuffer->pStorage = (uint8_t *)(pBuf + uCapacity);
+        pFrameRingBuffer->uStorageSize = uStorageSize;
+    }
+}
+
 FrameRingBufferHandle FrameRingBuffer_create(size_t uCapacity)
+{
+    return FrameRingBuffer_createWithStorage(uCapacity, 0);
+}
+
+FrameRingBufferHandle FrameRingBuffer_createWithStorage(size_t uCapacity, size_t uStorageSize)
 {
     FrameRingBuffer_t *pFrameRingBuffer = NULL;
+    FrameRingBufferState_t *pState = NULL;
     uint8_t *pMem = NULL;
     size_t uMemRequired = 0;
+    size_t uKeysSize = uCapacity * FRAME_RING_BUFFER_KEY_LAPS * sizeof(FrameKey_t);
 
-    if (uCapacity > 0)
+    if (prvIsSizeValid(uCapacity, uStorageSize))
     {
-        uMemRequired = sizeof(FrameRingBuffer_t) + (uCapacity + 1) * sizeof(FrameElement_t);
+        /* The handle is followed by the keys, the state, the elements and then the storage. */
+        uMemRequired = sizeof(FrameRingBuffer_t) + uKeysSize + sizeof(FrameRingBufferState_t) + uCapacity * sizeof(FrameElement_t) + uStorageSize;
         if ((pMem = (uint8_t *)malloc(uMemRequired)) != NULL) {
             memset(pMem, 0, uMemRequired);
 
@@ -324,18 +716,10 @@ FrameRingBufferHandle FrameRingBuffer_create(size_t uCapacity)
             }
             else
             {
-                pFrameRingBuffer->uCapacity = uCapacity;
-                pFrameRingBuffer->uSize = uCapacity + 1; /* 1 more to check buffer full */
-                pFrameRingBuffer->pBuf = (FrameElement_t *)(pMem + sizeof(FrameRingBuffer_t));
-                pFrameRingBuffer->uHeadIdx = 0;
-                pFrameRingBuffer->uTailIdx = 0;
-
-                pFrameRingBuffer->xStat.uSumOfFrameMemory = 0;
-                pFrameRingBuffer->xStat.uFrameUsedCount = 0;
-                pFrameRingBuffer->xStat.uFrameFreeCount = pFrameRingBuffer->uCapacity;
-
-                pFrameRingBuffer->uNextSerialNumber = 0;
-                pFrameRingBuffer->uMaxSerialNumber = (UINT16_MAX / pFrameRingBuffer->uSize) * pFrameRingBuffer->uSize;
+                pState = (FrameRingBufferState_t *)(pMem + sizeof(FrameRingBuffer_t) + uKeysSize);
+                prvInitState(pState, uCapacity);
+                prvInitRing(pFrameRingBuffer, pState, (FrameElement_t *)(pState + 1), uCapacity, uStorageSize);
+                pFrameRingBuffer->uBufferMemory = uMemRequired;
             }
         }
     }
@@ -343,20 +727,207 @@ FrameRingBufferHandle FrameRingBuffer_create(size_t uCapacity)
     return pFrameRingBuffer;
 }
 
+#if FRB_SHARED_MEMORY
+static size_t prvSegmentSize(size_t uCapacity, size_t uStorageSize)
+{
+    return sizeof(FrameRingBufferSegment_t) + uCapacity * sizeof(FrameElement_t) + uStorageSize;
+}
+
+/**
+ * Create the handle of a segment that is mapped by this process. Keys are in the handle, since they hold its address.
+ */
+static FrameRingBuffer_t *prvCreateSegmentHandle(FrameRingBufferSegment_t *pSegment)
+{
+    FrameRingBuffer_t *pFrameRingBuffer = NULL;
+    size_t uMemRequired = sizeof(FrameRingBuffer_t) + pSegment->uCapacity * FRAME_RING_BUFFER_KEY_LAPS * sizeof(FrameKey_t);
+
+    if ((pFrameRingBuffer = (FrameRingBuffer_t *)malloc(uMemRequired)) != NULL)
+    {
+        memset(pFrameRingBuffer, 0, uMemRequired);
+
+        pFrameRingBuffer->pSegment = pSegment;
+        prvInitRing(pFrameRingBuffer, &(pSegment->xState), (FrameElement_t *)(pSegment + 1), pSegment->uCapacity, pSegment->uStorageSize);
+        pFrameRingBuffer->uBufferMemory = pSegment->uSegmentSize + uMemRequired;
+    }
+
+    return pFrameRingBuffer;
+}
+
+static int prvInitSegmentMutex(FrameRingBufferSegment_t *pSegment)
+{
+    int res = ERRNO_NONE;
+    pthread_mutexattr_t xAttr;
+
+    if (pthread_mutexattr_init(&xAttr) != 0)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        /* The mutex is robust, so a process that dies while it holds the mutex doesn't block the others. */
+        if (pthread_mutexattr_setpshared(&xAttr, PTHREAD_PROCESS_SHARED) != 0 ||
+            pthread_mutexattr_setrobust(&xAttr, PTHREAD_MUTEX_ROBUST) != 0 ||
+            pthread_mutex_init(&(pSegment->xMutex), &xAttr) != 0)
+        {
+            res = ERRNO_FAIL;
+        }
+
+        pthread_mutexattr_destroy(&xAttr);
+    }
+
+    return res;
+}
+
+FrameRingBufferHandle FrameRingBuffer_createShared(const char *pcName, size_t uCapacity, size_t uStorageSize)
+{
+    FrameRingBuffer_t *pFrameRingBuffer = NULL;
+    FrameRingBufferSegment_t *pSegment = NULL;
+    size_t uSegmentSize = 0;
+    char *pcSegmentName = NULL;
+    int fd = -1;
+
+    if (pcName == NULL || uStorageSize == 0 || !prvIsSizeValid(uCapacity, uStorageSize))
+    {
+        /* nop */
+    }
+    else if ((pcSegmentName = strdup(pcName)) == NULL)
+    {
+        /* nop */
+    }
+    else
+    {
+        uSegmentSize = prvSegmentSize(uCapacity, uStorageSize);
+
+        /* A segment that is left by an earlier run is replaced. Processes that still map it keep the old one. */
+        shm_unlink(pcName);
+        if ((fd = shm_open(pcName, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) < 0)
+        {
+            /* nop */
+        }
+        else if (ftruncate(fd, (off_t)uSegmentSize) != 0 ||
+                 (pSegment = (FrameRingBufferSegment_t *)mmap(NULL, uSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        {
+            pSegment = NULL;
+        }
+        else
+        {
+            /* The segment is zero filled by ftruncate(). */
+            pSegment->uCapacity = uCapacity;
+            pSegment->uStorageSize = uStorageSize;
+            pSegment->uSegmentSize = uSegmentSize;
+            prvInitState(&(pSegment->xState), uCapacity);
+        }
+
+        if (pSegment == NULL)
+        {
+            /* nop */
+        }
+        else if (prvInitSegmentMutex(pSegment) != ERRNO_NONE || (pFrameRingBuffer = prvCreateSegmentHandle(pSegment)) == NULL)
+        {
+            munmap(pSegment, uSegmentSize);
+        }
+        else
+        {
+            pFrameRingBuffer->pcSegmentName = pcSegmentName;
+
+            /* Other processes can open the segment once the magic is there. */
+            FRB_ATOMIC_STORE(&(pSegment->uMagic), FRB_SEGMENT_MAGIC);
+        }
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        if (pFrameRingBuffer == NULL)
+        {
+            if (fd >= 0)
+            {
+                shm_unlink(pcName);
+            }
+            free(pcSegmentName);
+        }
+    }
+
+    return pFrameRingBuffer;
+}
+
+FrameRingBufferHandle FrameRingBuffer_openShared(const char *pcName)
+{
+    FrameRingBuffer_t *pFrameRingBuffer = NULL;
+    FrameRingBufferSegment_t *pSegment = NULL;
+    struct stat xStat;
+    int fd = -1;
+
+    if (pcName == NULL || (fd = shm_open(pcName, O_RDWR, 0)) < 0)
+    {
+        /* nop */
+    }
+    else
+    {
+        if (fstat(fd, &xStat) != 0 || xStat.st_size < (off_t)sizeof(FrameRingBufferSegment_t) ||
+            (pSegment = (FrameRingBufferSegment_t *)mmap(NULL, (size_t)xStat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        {
+            pSegment = NULL;
+        }
+        /* The segment is rejected if its creator hasn't initialized it yet, or it's created by another build. */
+        else if (FRB_ATOMIC_LOAD(&(pSegment->uMagic)) != FRB_SEGMENT_MAGIC || pSegment->uSegmentSize != (size_t)xStat.st_size ||
+                 !prvIsSizeValid(pSegment->uCapacity, pSegment->uStorageSize) ||
+                 prvSegmentSize(pSegment->uCapacity, pSegment->uStorageSize) != pSegment->uSegmentSize ||
+                 (pFrameRingBuffer = prvCreateSegmentHandle(pSegment)) == NULL)
+        {
+            munmap(pSegment, (size_t)xStat.st_size);
+        }
+
+        close(fd);
+    }
+
+    return pFrameRingBuffer;
+}
+#else
+FrameRingBufferHandle FrameRingBuffer_createShared(const char *pcName, size_t uCapacity, size_t uStorageSize)
+{
+    return NULL;
+}
+
+FrameRingBufferHandle FrameRingBuffer_openShared(const char *pcName)
+{
+    return NULL;
+}
+#endif /* FRB_SHARED_MEMORY */
+
 void FrameRingBuffer_terminate(FrameRingBufferHandle handle)
 {
     FrameRingBuffer_t *pFrameRingBuffer = (FrameRingBuffer_t *)handle;
 
-    if (pFrameRingBuffer != NULL)
+    if (pFrameRingBuffer == NULL)
+    {
+        /* nop */
+    }
+    else if (pFrameRingBuffer->pSegment != NULL)
+    {
+        /* Frames of a shared memory ring have no destructor, and they stay for other processes until the last one
+         * unmaps the segment. */
+#if FRB_SHARED_MEMORY
+        munmap(pFrameRingBuffer->pSegment, pFrameRingBuffer->pSegment->uSegmentSize);
+        if (pFrameRingBuffer->pcSegmentName != NULL)
+        {
+            shm_unlink(pFrameRingBuffer->pcSegmentName);
+            free(pFrameRingBuffer->pcSegmentName);
+        }
+#endif
+        free(pFrameRingBuffer);
+    }
+    else
     {
-        if (Lock(pFrameRingBuffer->xLock) == LOCK_OK)
+        if (prvLock(pFrameRingBuffer) == ERRNO_NONE)
         {
             while (prvDequeue(pFrameRingBuffer) == 0)
             {
                 /* nop */
             }
 
-            Unlock(pFrameRingBuffer->xLock);
+            prvUnlock(pFrameRingBuffer);
         }
 
         Lock_Deinit(pFrameRingBuffer->xLock);
@@ -365,26 +936,93 @@ void FrameRingBuffer_terminate(FrameRingBufferHandle handle)
 }
 
 FrameKeyHandle FrameRingBuffer_enqueue(FrameRingBufferHandle handle, uint8_t *pData, size_t uLen, FrameDestructorInfo_t *pFrameDestructorInfo)
+{
+    return FrameRingBuffer_enqueueEx(handle, pData, uLen, 0, pFrameDestructorInfo);
+}
+
+FrameKeyHandle FrameRingBuffer_enqueueEx(FrameRingBufferHandle handle, uint8_t *pData, size_t uLen, uint32_t uFlags, FrameDestructorInfo_t *pFrameDestructorInfo)
 {
     int res = ERRNO_NONE;
     FrameKey_t *pKey = NULL;
     FrameRingBuffer_t *pFrameRingBuffer = (FrameRingBuffer_t *)handle;
+    uint8_t *pReserved = NULL;
 
     if (pFrameRingBuffer == NULL || pData == NULL || uLen == 0)
     {
         res = ERRNO_FAIL;
     }
-    else if (Lock(pFrameRingBuffer->xLock) != LOCK_OK)
+    else if (prvLock(pFrameRingBuffer) != ERRNO_NONE)
     {
         res = ERRNO_FAIL;
     }
     else
     {
-        res = prvEnqueue(pFrameRingBuffer, pData, uLen, &pKey, pFrameDestructorInfo);
+        if (pFrameRingBuffer->pStorage == NULL)
+        {
+            res = prvEnqueue(pFrameRingBuffer, pData, uLen, uFlags, &pKey, pFrameDestructorInfo);
+        }
+        else if ((pReserved = prvReserve(pFrameRingBuffer, uLen)) == NULL)
+        {
+            res = ERRNO_FAIL;
+        }
+        else
+        {
+            memcpy(pReserved, pData, uLen);
+            res = prvCommit(pFrameRingBuffer, uLen, uFlags, &pKey, pFrameDestructorInfo);
+        }
 
         prvApplyPolicy(pFrameRingBuffer);
 
-        Unlock(pFrameRingBuffer->xLock);
+        prvUnlock(pFrameRingBuffer);
+    }
+
+    return pKey;
+}
+
+uint8_t *FrameRingBuffer_reserve(FrameRingBufferHandle handle, size_t uLen)
+{
+    uint8_t *pReserved = NULL;
+    FrameRingBuffer_t *pFrameRingBuffer = (FrameRingBuffer_t *)handle;
+
+    if (pFrameRingBuffer == NULL)
+    {
+        /* nop */
+    }
+    else if (prvLock(pFrameRingBuffer) != ERRNO_NONE)
+    {
+        /* nop */
+    }
+    else
+    {
+        pReserved = prvReserve(pFrameRingBuffer, uLen);
+
+        prvUnlock(pFrameRingBuffer);
+    }
+
+    return pReserved;
+}
+
+FrameKeyHandle FrameRingBuffer_commit(FrameRingBufferHandle handle, size_t uLen, uint32_t uFlags, FrameDestructorInfo_t *pFrameDestructorInfo)
+{
+    FrameKey_t *pKey = NULL;
+    FrameRingBuffer_t *pFrameRingBuffer = (FrameRingBuffer_t *)handle;
+
+    if (pFrameRingBuffer == NULL)
+    {
+        /* nop */
+    }
+    else if (prvLock(pFrameRingBuffer) != ERRNO_NONE)
+    {
+        /* nop */
+    }
+    else
+    {
+        if (prvCommit(pFrameRingBuffer, uLen, uFlags, &pKey, pFrameDestructorInfo) == ERRNO_NONE)
+        {
+            prvApplyPolicy(pFrameRingBuffer);
+        }
+
+        prvUnlock(pFrameRingBuffer);
     }
 
     return pKey;
@@ -399,7 +1037,7 @@ int FrameRingBuffer_dequeue(FrameRingBufferHandle handle)
     {
         res = ERRNO_FAIL;
     }
-    else if (Lock(pFrameRingBuffer->xLock) != LOCK_OK)
+    else if (prvLock(pFrameRingBuffer) != ERRNO_NONE)
     {
         res = ERRNO_FAIL;
     }
@@ -407,7 +1045,7 @@ int FrameRingBuffer_dequeue(FrameRingBufferHandle handle)
     {
         res = prvDequeue(pFrameRingBuffer);
 
-        Unlock(pFrameRingBuffer->xLock);
+        prvUnlock(pFrameRingBuffer);
     }
 
     return res;
@@ -416,9 +1054,7 @@ int FrameRingBuffer_dequeue(FrameRingBufferHandle handle)
 int FrameRingBuffer_getFrame(FrameKeyHandle keyHandle, uint8_t **ppData, size_t *puLen)
 {
     int res = ERRNO_NONE;
-    FrameRingBuffer_t *pFrameRingBuffer = NULL;
     FrameKey_t *pKey = (FrameKey_t *)keyHandle;
-    size_t uIdx = 0;
 
     if (pKey == NULL || pKey->pFrameRingBuffer == NULL || ppData == NULL || puLen == NULL)
     {
@@ -426,27 +1062,42 @@ int FrameRingBuffer_getFrame(FrameKeyHandle keyHandle, uint8_t **ppData, size_t
     }
     else
     {
-        pFrameRingBuffer = pKey->pFrameRingBuffer;
+        res = prvFindFrame(pKey, ppData, puLen);
+    }
 
-        if (Lock(pFrameRingBuffer->xLock) != LOCK_OK)
-        {
-            res = ERRNO_FAIL;
-        }
-        else
-        {
-            if ((res = prvFindFrame(pFrameRingBuffer, pKey, &uIdx)) == ERRNO_NONE)
-            {
-                *ppData = pFrameRingBuffer->pBuf[uIdx].pData;
-                *puLen = pFrameRingBuffer->pBuf[uIdx].uLen;
-            }
+    return res;
+}
 
-            Unlock(pFrameRingBuffer->xLock);
-        }
+int FrameRingBuffer_getKeySerialNumber(FrameKeyHandle keyHandle, size_t *puSerialNumber)
+{
+    int res = ERRNO_NONE;
+    FrameKey_t *pKey = (FrameKey_t *)keyHandle;
+
+    if (pKey == NULL || puSerialNumber == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        *puSerialNumber = pKey->uSerialNumber;
     }
 
     return res;
 }
 
+FrameKeyHandle FrameRingBuffer_getKeyBySerialNumber(FrameRingBufferHandle handle, size_t uSerialNumber)
+{
+    FrameRingBuffer_t *pFrameRingBuffer = (FrameRingBuffer_t *)handle;
+    FrameKey_t *pKey = NULL;
+
+    if (pFrameRingBuffer != NULL && uSerialNumber < pFrameRingBuffer->uKeyCount)
+    {
+        pKey = &(pFrameRingBuffer->pKeys[uSerialNumber]);
+    }
+
+    return pKey;
+}
+
 int FrameRingBuffer_getMemoryStat(FrameRingBufferHandle handle, FrameRingBufferStat_t *pStat)
 {
     int res = ERRNO_NONE;
@@ -456,7 +1107,7 @@ int FrameRingBuffer_getMemoryStat(FrameRingBufferHandle handle, FrameRingBufferS
     {
         res = ERRNO_FAIL;
     }
-    else if (Lock(pFrameRingBuffer->xLock) != LOCK_OK)
+    else if (prvLock(pFrameRingBuffer) != ERRNO_NONE)
     {
         res = ERRNO_FAIL;
     }
@@ -464,7 +1115,7 @@ int FrameRingBuffer_getMemoryStat(FrameRingBufferHandle handle, FrameRingBufferS
     {
         res = prvGetMemoryStat(pFrameRingBuffer, pStat);
 
-        Unlock(pFrameRingBuffer->xLock);
+        prvUnlock(pFrameRingBuffer);
     }
 
     return res;
@@ -480,18 +1131,126 @@ int FrameRingBuffer_setDropFramePolicy(FrameRingBufferHandle handle, DropFramePo
         res = ERRNO_FAIL;
     }
     /* Lock here because we may enqueue/dequeue frames at the moment. */
-    else if (Lock(pFrameRingBuffer->xLock) != LOCK_OK)
+    else if (prvLock(pFrameRingBuffer) != ERRNO_NONE)
     {
         res = ERRNO_FAIL;
     }
     else
     {
-        memcpy(&(pFrameRingBuffer->xDropFramePolicy), pPolicy, sizeof(DropFramePolicy_t));
+        memcpy(&(pFrameRingBuffer->pState->xDropFramePolicy), pPolicy, sizeof(DropFramePolicy_t));
 
         prvApplyPolicy(pFrameRingBuffer);
 
-        Unlock(pFrameRingBuffer->xLock);
+        prvUnlock(pFrameRingBuffer);
     }
 
     return res;
-}
\ No newline at end of file
+}
+
+FrameRingBufferReaderHandle FrameRingBuffer_createReader(FrameRingBufferHandle handle)
+{
+    FrameRingBuffer_t *pFrameRingBuffer = (FrameRingBuffer_t *)handle;
+    FrameRingBufferReader_t *pReader = NULL;
+
+    if (pFrameRingBuffer != NULL && (pReader = (FrameRingBufferReader_t *)malloc(sizeof(FrameRingBufferReader_t))) != NULL)
+    {
+        pReader->pFrameRingBuffer = pFrameRingBuffer;
+        pReader->uCursor = FRB_ATOMIC_LOAD(&(pFrameRingBuffer->pState->uHead));
+    }
+
+    return pReader;
+}
+
+void FrameRingBuffer_terminateReader(FrameRingBufferReaderHandle readerHandle)
+{
+    if (readerHandle != NULL)
+    {
+        free(readerHandle);
+    }
+}
+
+int FrameRingBuffer_readFrame(FrameRingBufferReaderHandle readerHandle, uint8_t **ppData, size_t *puLen, FrameKeyHandle *pKeyHandle)
+{
+    int res = ERRNO_FAIL;
+    FrameRingBufferReader_t *pReader = (FrameRingBufferReader_t *)readerHandle;
+    FrameRingBuffer_t *pFrameRingBuffer = NULL;
+    size_t uHead = 0;
+    bool bUsed = false;
+    size_t uFrameNo = 0;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    uint32_t uFlags = 0;
+
+    if (pReader == NULL || ppData == NULL || puLen == NULL)
+    {
+        /* nop */
+    }
+    else
+    {
+        pFrameRingBuffer = pReader->pFrameRingBuffer;
+        uHead = FRB_ATOMIC_LOAD(&(pFrameRingBuffer->pState->uHead));
+
+        /* A reader that is lapped by the writer goes on from the oldest frame that can still be in the buffer. */
+        if (prvFrameNoDiff(pFrameRingBuffer, uHead, pReader->uCursor) > pFrameRingBuffer->uCapacity)
+        {
+            pReader->uCursor = prvFrameNoDiff(pFrameRingBuffer, uHead, pFrameRingBuffer->uCapacity);
+        }
+
+        /* Frames that are dropped before they're read are skipped. */
+        while (res != ERRNO_NONE && pReader->uCursor != uHead)
+        {
+            prvReadElement(pFrameRingBuffer, &(pFrameRingBuffer->pBuf[pReader->uCursor % pFrameRingBuffer->uCapacity]), &bUsed, &uFrameNo, &pData, &uLen, &uFlags);
+            if (bUsed && uFrameNo == pReader->uCursor)
+            {
+                *ppData = pData;
+                *puLen = uLen;
+                if (pKeyHandle != NULL)
+                {
+                    *pKeyHandle = prvKeyOfFrame(pFrameRingBuffer, uFrameNo);
+                }
+                res = ERRNO_NONE;
+            }
+            pReader->uCursor = prvNextFrameNo(pFrameRingBuffer, pReader->uCursor);
+        }
+    }
+
+    return res;
+}
+
+int FrameRingBuffer_seekLatestKeyFrame(FrameRingBufferReaderHandle readerHandle)
+{
+    int res = ERRNO_FAIL;
+    FrameRingBufferReader_t *pReader = (FrameRingBufferReader_t *)readerHandle;
+    FrameRingBuffer_t *pFrameRingBuffer = NULL;
+    size_t uCursor = 0;
+    size_t i = 0;
+    bool bUsed = false;
+    size_t uFrameNo = 0;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    uint32_t uFlags = 0;
+
+    if (pReader == NULL)
+    {
+        /* nop */
+    }
+    else
+    {
+        pFrameRingBuffer = pReader->pFrameRingBuffer;
+        uCursor = FRB_ATOMIC_LOAD(&(pFrameRingBuffer->pState->uHead));
+
+        /* Search backward from the newest frame, so the reader starts as close to the live frame as possible. */
+        for (i = 0; res != ERRNO_NONE && i < pFrameRingBuffer->uCapacity; i++)
+        {
+            uCursor = prvFrameNoDiff(pFrameRingBuffer, uCursor, 1);
+            prvReadElement(pFrameRingBuffer, &(pFrameRingBuffer->pBuf[uCursor % pFrameRingBuffer->uCapacity]), &bUsed, &uFrameNo, &pData, &uLen, &uFlags);
+            if (bUsed && uFrameNo == uCursor && (uFlags & FRAME_RING_BUFFER_FLAG_KEY_FRAME) != 0)
+            {
+                pReader->uCursor = uCursor;
+                res = ERRNO_NONE;
+            }
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef SHARED_FRAME_H
+#define SHARED_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kvs/nalu.h"
+
+/*
+ * A shared frame is an immutable payload that is shared by several consumers, e.g. the KVS stream and RTP payloaders.
+ * Each consumer holds a reference, and the payload is destructed when the last reference is released. The payload is
+ * never modified, and an AVCC view of an Annex-B video frame is derived on demand and shared by all consumers.
+ */
+typedef struct SharedFrame *SharedFrameHandle;
+
+typedef struct SharedFrameDestructorInfo
+{
+    void (*frameDestructor)(uint8_t *pData, size_t uLen, void *pAppData);
+    void *pAppData;
+} SharedFrameDestructorInfo_t;
+
+/**
+ * Create a shared frame which takes the ownership of the payload. The caller holds the first reference.
+ *
+ * @param[in] pData Payload of the frame
+ * @param[in] uLen Length of the payload
+ * @param[in] bIsHevc true if it's a H265 frame, false if it's a H264 frame or not a video frame
+ * @param[in] pDestructorInfo Destructor of the payload, or NULL if the payload is freed by free()
+ * @return Handle of the shared frame on success, or NULL otherwise
+ */
+SharedFrameHandle SharedFrame_create(uint8_t *pData, size_t uLen, bool bIsHevc, SharedFrameDestructorInfo_t *pDestructorInfo);
+
+/**
+ * Add a reference of a shared frame.
+ *
+ * @param[in] handle Handle of the shared frame
+ * @return The same handle
+ */
+SharedFrameHandle SharedFrame_retain(SharedFrameHandle handle);
+
+/**
+ * Release a reference of a shared frame. The payload and the AVCC view are freed when the last reference is released.
+ *
+ * @param[in] handle Handle of the shared frame
+ */
+void SharedFrame_release(SharedFrameHandle handle);
+
+/**
+ * Get the payload of a shared frame as it's created.
+ *
+ * @param[in] handle Handle of the shared frame
+ * @param[out] ppData Payload of the frame
+ * @param[out] puLen Length of the payload
+ * @return 0 on success, non-zero value otherwise
+ */
+int SharedFrame_getData(SharedFrameHandle handle, uint8_t **ppData, size_t *puLen);
+
+/**
+ * Get the AVCC view of a video frame. It's the payload itself if the payload is already AVCC, otherwise it's converted
+ * once by the first consumer asking for it. Consumers must not modify it either.
+ *
+ * @param[in] handle Handle of the shared frame
+ * @param[out] ppData AVCC frame
+ * @param[out] puLen Length of the AVCC frame
+ * @return 0 on success, non-zero value otherwise
+ */
+int SharedFrame_getAvcc(SharedFrameHandle handle, uint8_t **ppData, size_t *puLen);
+
+/**
+ * Get the NALU info of the AVCC view of a video frame. The frame is analyzed once by the first consumer asking for the
+ * AVCC view or its info, so consumers don't need to parse NALUs again. It's valid while the reference is held.
+ *
+ * @param[in] handle Handle of the shared frame
+ * @param[out] ppxFrameInfo NALU info of the AVCC frame
+ * @return 0 on success, non-zero value otherwise
+ */
+int SharedFrame_getFrameInfo(SharedFrameHandle handle, const NaluFrameInfo_t **ppxFrameInfo);
+
+#endif /* SHARED_FRAME_H */
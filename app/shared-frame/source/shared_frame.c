@@ -0,0 +1,252 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "shared_frame/shared_frame.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* Public headers */
+#include "kvs/errors.h"
+#include "kvs/nalu.h"
+
+#define ERRNO_NONE 0
+#define ERRNO_FAIL __LINE__
+
+/* The reference count and the AVCC view are shared by consumers of other threads, so they're updated with these. */
+#define SF_ATOMIC_LOAD(p)               __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define SF_ATOMIC_ADD(p, v)             __atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define SF_ATOMIC_SUB(p, v)             __atomic_sub_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define SF_ATOMIC_CAS(p, pExpected, v)  __atomic_compare_exchange_n((p), (pExpected), (v), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+typedef struct AvccView
+{
+    NaluFrameInfo_t xFrameInfo;
+
+    /* It's the payload itself if the payload is already AVCC, otherwise it's the converted copy in pBuf. */
+    uint8_t *pData;
+    size_t uLen;
+    uint8_t pBuf[];
+} AvccView_t;
+
+typedef struct SharedFrame
+{
+    uint32_t uRefCount;
+
+    uint8_t *pData;
+    size_t uLen;
+    bool bIsHevc;
+    SharedFrameDestructorInfo_t xDestructorInfo;
+
+    /* It's NULL until the first consumer asks for it, and it's never changed after it's published. */
+    AvccView_t *pAvccView;
+} SharedFrame_t;
+
+static AvccView_t *prvCreateAvccView(SharedFrame_t *pSharedFrame)
+{
+    AvccView_t *pAvccView = NULL;
+    NaluFrameInfo_t xFrameInfo = {0};
+    uint32_t uAvccLen = 0;
+    size_t uBufSize = 0;
+
+    if (NALU_analyzeFrame(pSharedFrame->pData, (uint32_t)pSharedFrame->uLen, pSharedFrame->bIsHevc, &xFrameInfo) != KVS_ERRNO_NONE)
+    {
+        /* nop */
+    }
+    else if (!xFrameInfo.bIsAnnexB)
+    {
+        if ((pAvccView = (AvccView_t *)malloc(sizeof(AvccView_t))) != NULL)
+        {
+            memcpy(&(pAvccView->xFrameInfo), &xFrameInfo, sizeof(NaluFrameInfo_t));
+            pAvccView->pData = pSharedFrame->pData;
+            pAvccView->uLen = pSharedFrame->uLen;
+        }
+    }
+    else
+    {
+        /* The payload is copied and converted in place, which needs the larger size of Annex-B and AVCC. */
+        uBufSize = (xFrameInfo.uAvccLen > pSharedFrame->uLen) ? xFrameInfo.uAvccLen : pSharedFrame->uLen;
+        if ((pAvccView = (AvccView_t *)malloc(sizeof(AvccView_t) + uBufSize)) != NULL)
+        {
+            memcpy(pAvccView->pBuf, pSharedFrame->pData, pSharedFrame->uLen);
+            if (NALU_convertAnnexBToAvccWithFrameInfo(pAvccView->pBuf, (uint32_t)uBufSize, &xFrameInfo, 0, &uAvccLen) != KVS_ERRNO_NONE)
+            {
+                free(pAvccView);
+                pAvccView = NULL;
+            }
+            else
+            {
+                /* The frame info is updated to the AVCC frame by the conversion. */
+                memcpy(&(pAvccView->xFrameInfo), &xFrameInfo, sizeof(NaluFrameInfo_t));
+                pAvccView->pData = pAvccView->pBuf;
+                pAvccView->uLen = uAvccLen;
+            }
+        }
+    }
+
+    return pAvccView;
+}
+
+static AvccView_t *prvGetAvccView(SharedFrame_t *pSharedFrame)
+{
+    AvccView_t *pAvccView = NULL;
+    AvccView_t *pExpected = NULL;
+
+    if ((pAvccView = SF_ATOMIC_LOAD(&(pSharedFrame->pAvccView))) == NULL && (pAvccView = prvCreateAvccView(pSharedFrame)) != NULL)
+    {
+        /* Consumers racing to analyze the frame keep the view that is published first. */
+        if (!SF_ATOMIC_CAS(&(pSharedFrame->pAvccView), &pExpected, pAvccView))
+        {
+            free(pAvccView);
+            pAvccView = pExpected;
+        }
+    }
+
+    return pAvccView;
+}
+
+SharedFrameHandle SharedFrame_create(uint8_t *pData, size_t uLen, bool bIsHevc, SharedFrameDestructorInfo_t *pDestructorInfo)
+{
+    SharedFrame_t *pSharedFrame = NULL;
+
+    if (pData == NULL || uLen == 0 || uLen > UINT32_MAX)
+    {
+        /* nop */
+    }
+    else if ((pSharedFrame = (SharedFrame_t *)malloc(sizeof(SharedFrame_t))) == NULL)
+    {
+        /* nop */
+    }
+    else
+    {
+        memset(pSharedFrame, 0, sizeof(SharedFrame_t));
+        pSharedFrame->uRefCount = 1;
+        pSharedFrame->pData = pData;
+        pSharedFrame->uLen = uLen;
+        pSharedFrame->bIsHevc = bIsHevc;
+        if (pDestructorInfo != NULL)
+        {
+            memcpy(&(pSharedFrame->xDestructorInfo), pDestructorInfo, sizeof(SharedFrameDestructorInfo_t));
+        }
+    }
+
+    return pSharedFrame;
+}
+
+SharedFrameHandle SharedFrame_retain(SharedFrameHandle handle)
+{
+    SharedFrame_t *pSharedFrame = (SharedFrame_t *)handle;
+
+    if (pSharedFrame != NULL)
+    {
+        SF_ATOMIC_ADD(&(pSharedFrame->uRefCount), 1);
+    }
+
+    return pSharedFrame;
+}
+
+void SharedFrame_release(SharedFrameHandle handle)
+{
+    SharedFrame_t *pSharedFrame = (SharedFrame_t *)handle;
+
+    if (pSharedFrame != NULL && SF_ATOMIC_SUB(&(pSharedFrame->uRefCount), 1) == 0)
+    {
+        if (pSharedFrame->xDestructorInfo.frameDestructor != NULL)
+        {
+            pSharedFrame->xDestructorInfo.frameDestructor(pSharedFrame->pData, pSharedFrame->uLen, pSharedFrame->xDestructorInfo.pAppData);
+        }
+        else
+        {
+            free(pSharedFrame->pData);
+        }
+
+        if (pSharedFrame->pAvccView != NULL)
+        {
+            free(pSharedFrame->pAvccView);
+        }
+        free(pSharedFrame);
+    }
+}
+
+int SharedFrame_getData(SharedFrameHandle handle, uint8_t **ppData, size_t *puLen)
+{
+    int res = ERRNO_NONE;
+    SharedFrame_t *pSharedFrame = (SharedFrame_t *)handle;
+
+    if (pSharedFrame == NULL || ppData == NULL || puLen == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        *ppData = pSharedFrame->pData;
+        *puLen = pSharedFrame->uLen;
+    }
+
+    return res;
+}
+
+int SharedFrame_getAvcc(SharedFrameHandle handle, uint8_t **ppData, size_t *puLen)
+{
+    int res = ERRNO_NONE;
+    SharedFrame_t *pSharedFrame = (SharedFrame_t *)handle;
+    AvccView_t *pAvccView = NULL;
+
+    if (pSharedFrame == NULL || ppData == NULL || puLen == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else if (!NALU_isAnnexBFrame(pSharedFrame->pData, pSharedFrame->uLen))
+    {
+        *ppData = pSharedFrame->pData;
+        *puLen = pSharedFrame->uLen;
+    }
+    else if ((pAvccView = prvGetAvccView(pSharedFrame)) == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        *ppData = pAvccView->pData;
+        *puLen = pAvccView->uLen;
+    }
+
+    return res;
+}
+
+int SharedFrame_getFrameInfo(SharedFrameHandle handle, const NaluFrameInfo_t **ppxFrameInfo)
+{
+    int res = ERRNO_NONE;
+    SharedFrame_t *pSharedFrame = (SharedFrame_t *)handle;
+    AvccView_t *pAvccView = NULL;
+
+    if (pSharedFrame == NULL || ppxFrameInfo == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else if ((pAvccView = prvGetAvccView(pSharedFrame)) == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        *ppxFrameInfo = &(pAvccView->xFrameInfo);
+    }
+
+    return res;
+}
@@ -2146,6 +2146,21 @@ typedef struct {
 } FrameEx, *PFrameEx;
 
 PUBLIC_API STATUS writeFrameEx(PRtcRtpTransceiver, PFrame, PFrameEx);
+
+/**
+ * @brief Write a frame to several transceivers, e.g. the video transceivers of all viewers
+ *
+ * The frame is packetized once for each codec and MTU, and the RTP payloads are shared by the transceivers. Only the RTP headers,
+ * SRTP and sending are done for each transceiver. Transceivers whose SRTP session isn't ready yet are skipped.
+ *
+ * @param [in] PRtcRtpTransceiver* Transceivers to write to. NULL entries are skipped.
+ * @param [in] UINT32 Number of transceivers
+ * @param [in] PFrame Frame to write
+ * @param [in] PFrameEx Retransmission callback of the frame
+ *
+ * @return STATUS code of the execution. The first failure of a transceiver, or STATUS_SUCCESS.
+ */
+PUBLIC_API STATUS writeFrameExToTransceivers(PRtcRtpTransceiver*, UINT32, PFrame, PFrameEx);
 #endif
 
 /*!@} */
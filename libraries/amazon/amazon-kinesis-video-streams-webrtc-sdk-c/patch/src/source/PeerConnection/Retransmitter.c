@@ -41,6 +41,28 @@ CleanUp:
 }
 
 #ifdef SUPPORT_SHARE_BUFFER
+/* It refills the token bucket of retransmissions and takes the tokens of a packet if there are enough tokens. */
+static BOOL takeResendTokens(PRtpRollingBuffer pRollingBuffer, UINT32 packetLen, UINT64 now)
+{
+    BOOL taken = FALSE;
+    UINT64 elapsed = 0;
+
+    if (now > pRollingBuffer->lastResendRefillTime) {
+        elapsed = MIN(now - pRollingBuffer->lastResendRefillTime, HUNDREDS_OF_NANOS_IN_A_SECOND);
+        pRollingBuffer->resendTokens =
+            MIN(pRollingBuffer->resendTokens + elapsed * RTP_RETRANSMIT_RATE_BYTES_PER_SECOND / HUNDREDS_OF_NANOS_IN_A_SECOND,
+                RTP_RETRANSMIT_BURST_BYTES);
+        pRollingBuffer->lastResendRefillTime = now;
+    }
+
+    if (pRollingBuffer->resendTokens >= packetLen) {
+        pRollingBuffer->resendTokens -= packetLen;
+        taken = TRUE;
+    }
+
+    return taken;
+}
+
 STATUS resendPacketOnNack(PRtcpPacket pRtcpPacket, PKvsPeerConnection pKvsPeerConnection)
 {
     ENTERS();
@@ -59,7 +81,8 @@ STATUS resendPacketOnNack(PRtcpPacket pRtcpPacket, PKvsPeerConnection pKvsPeerCo
     BOOL isRtpPacketRefValid = TRUE;
     PBYTE rawPacket = NULL;
     UINT32 packetLen = 0;
-    UINT32 allocSize = 0;
+    UINT32 allocSize = 0, rawPacketSize = 0;
+    UINT64 now = 0;
 
     CHK(pKvsPeerConnection != NULL && pRtcpPacket != NULL, STATUS_NULL_ARG);
     CHK_STATUS(rtcpNackListGet(pRtcpPacket->payload, pRtcpPacket->payloadLength, &senderSsrc, &receiverSsrc, NULL, &filledLen));
@@ -84,30 +107,44 @@ STATUS resendPacketOnNack(PRtcpPacket pRtcpPacket, PKvsPeerConnection pKvsPeerCo
     validIndexListLen = pRetransmitter->validIndexListLen;
     CHK_STATUS(rtpRollingBufferGetValidSeqIndexList(pSenderTranceiver->sender.packetBuffer, pRetransmitter->sequenceNumberList, filledLen,
                                                     pRetransmitter->validIndexList, &validIndexListLen));
+    now = GETTIME();
     for (index = 0; index < validIndexListLen; index++) {
         retStatus = rollingBufferExtractData(pSenderTranceiver->sender.packetBuffer->pRollingBuffer, pRetransmitter->validIndexList[index], &item);
         pRtpPacketRef = (PRtpPacketRef) item;
         CHK(retStatus == STATUS_SUCCESS, retStatus);
 
-        isRtpPacketRefValid = TRUE;
         if (pRtpPacketRef == NULL) {
+            continue;
+        }
+
+        isRtpPacketRefValid = TRUE;
+        if (pRtpPacketRef->lastResendTime != 0 && now - pRtpPacketRef->lastResendTime < RTP_RETRANSMIT_SUPPRESS_INTERVAL) {
+            // Duplicate NACK of a packet that has just been retransmitted
             isRtpPacketRefValid = FALSE;
-        } else {
-            if (pRtpPacketRef->onRtpResend != NULL) {
-                uint8_t *pData = NULL;
-                size_t uLen = 0;
-                if (pRtpPacketRef->onRtpResend(&pData, &uLen, pRtpPacketRef->pAppData) != 0) {
-                    isRtpPacketRefValid = FALSE;
-                } else {
-                    /* TODO: Should we check refAddr too? */
-                }
+        } else if (!takeResendTokens(pSenderTranceiver->sender.packetBuffer, pRtpPacketRef->rawPacketHdrLength + pRtpPacketRef->refLength, now)) {
+            // Retransmissions are over budget, and fresh frames go first
+            DLOGV("Retransmission is paced out");
+            isRtpPacketRefValid = FALSE;
+        } else if (pRtpPacketRef->onRtpResend != NULL) {
+            uint8_t *pData = NULL;
+            size_t uLen = 0;
+            if (pRtpPacketRef->onRtpResend(&pData, &uLen, pRtpPacketRef->pAppData) != 0) {
+                isRtpPacketRefValid = FALSE;
+            } else {
+                /* TODO: Should we check refAddr too? */
             }
         }
 
         if (isRtpPacketRefValid == TRUE) {
+            // One buffer is reused for all retransmissions of the NACK
             allocSize = pRtpPacketRef->rawPacketHdrLength + pRtpPacketRef->refLength + SRTP_AUTH_TAG_OVERHEAD;
-            rawPacket = (PBYTE) MEMALLOC(allocSize);
-            CHK(rawPacket != NULL, STATUS_NOT_ENOUGH_MEMORY);
+            if (allocSize > rawPacketSize) {
+                SAFE_MEMFREE(rawPacket);
+                rawPacketSize = 0;
+                rawPacket = (PBYTE) MEMALLOC(allocSize);
+                CHK(rawPacket != NULL, STATUS_NOT_ENOUGH_MEMORY);
+                rawPacketSize = allocSize;
+            }
             MEMCPY(rawPacket, pRtpPacketRef->pRawPacketHdr, pRtpPacketRef->rawPacketHdrLength);
             MEMCPY(rawPacket + pRtpPacketRef->rawPacketHdrLength, pRtpPacketRef->refAddr + pRtpPacketRef->refOffset, pRtpPacketRef->refLength);
             packetLen = pRtpPacketRef->rawPacketHdrLength + pRtpPacketRef->refLength;
@@ -124,6 +161,7 @@ STATUS resendPacketOnNack(PRtcpPacket pRtcpPacket, PKvsPeerConnection pKvsPeerCo
             }
             // resendPacket
             if (STATUS_SUCCEEDED(retStatus)) {
+                pRtpPacketRef->lastResendTime = now;
                 retransmittedPacketsSent++;
                 retransmittedBytesSent += pRtpPacketRef->refLength;
                 DLOGV("Resent packet succeeded");
@@ -132,22 +170,21 @@ STATUS resendPacketOnNack(PRtcpPacket pRtcpPacket, PKvsPeerConnection pKvsPeerCo
             } else {
                 DLOGV("Resent packet failed 0x%08x", retStatus);
             }
-            // putBackPacketToRollingBuffer
-            retStatus =
-                rollingBufferInsertData(pSenderTranceiver->sender.packetBuffer->pRollingBuffer, pRetransmitter->sequenceNumberList[index], item);
-            CHK(retStatus == STATUS_SUCCESS || retStatus == STATUS_ROLLING_BUFFER_NOT_IN_RANGE, retStatus);
+            freeRtpPacket(&pRtxRtpPacket);
+        }
 
-            // free the packet if it is not in the valid range any more
-            if (retStatus == STATUS_ROLLING_BUFFER_NOT_IN_RANGE) {
-                DLOGS("Retransmit STATUS_ROLLING_BUFFER_NOT_IN_RANGE free %lu by self", pRtpPacket->header.sequenceNumber);
-                free(pRtpPacketRef);
-                retStatus = STATUS_SUCCESS;
-            } else {
-                DLOGS("Retransmit add back to rolling %lu", pRtpPacket->header.sequenceNumber);
-            }
+        // putBackPacketToRollingBuffer, also when it's not resent, so that a later NACK can still get it
+        retStatus =
+            rollingBufferInsertData(pSenderTranceiver->sender.packetBuffer->pRollingBuffer, pRetransmitter->sequenceNumberList[index], item);
+        CHK(retStatus == STATUS_SUCCESS || retStatus == STATUS_ROLLING_BUFFER_NOT_IN_RANGE, retStatus);
 
-            freeRtpPacket(&pRtxRtpPacket);
-            SAFE_MEMFREE(rawPacket);
+        // free the packet if it is not in the valid range any more
+        if (retStatus == STATUS_ROLLING_BUFFER_NOT_IN_RANGE) {
+            DLOGS("Retransmit STATUS_ROLLING_BUFFER_NOT_IN_RANGE free by self");
+            freeRtpRollingBufferDataWithRef(&item);
+            retStatus = STATUS_SUCCESS;
+        } else {
+            DLOGS("Retransmit add back to rolling");
         }
     }
 CleanUp:
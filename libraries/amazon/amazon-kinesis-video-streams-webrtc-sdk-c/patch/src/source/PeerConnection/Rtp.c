@@ -266,7 +266,12 @@ STATUS writeFrame(PRtcRtpTransceiver pRtcRtpTransceiver, PFrame pFrame)
     }
     if (pPayloadArray->payloadSubLenSize > pPayloadArray->maxPayloadSubLenSize) {
         SAFE_MEMFREE(pPayloadArray->payloadSubLength);
+#ifdef SUPPORT_SHARE_BUFFER
+        /* Payloaders put offsets and lengths of the references after the sub lengths, see writeFrameEx(). */
+        pPayloadArray->payloadSubLength = (PUINT32) MEMALLOC(pPayloadArray->payloadSubLenSize * 3 * SIZEOF(UINT32));
+#else
         pPayloadArray->payloadSubLength = (PUINT32) MEMALLOC(pPayloadArray->payloadSubLenSize * SIZEOF(UINT32));
+#endif
         pPayloadArray->maxPayloadSubLenSize = pPayloadArray->payloadSubLenSize;
     }
     CHK_STATUS(rtpPayloadFunc(pKvsPeerConnection->MTU, (PBYTE) pFrame->frameData, pFrame->size, pPayloadArray->payloadBuffer,
@@ -296,10 +301,24 @@ STATUS writeFrame(PRtcRtpTransceiver pRtcRtpTransceiver, PFrame pFrame)
         CHK(NULL != (rawPacket = (PBYTE) MEMALLOC(allocSize)), STATUS_NOT_ENOUGH_MEMORY);
         CHK_STATUS(createBytesFromRtpPacket(pRtpPacket, rawPacket, &packetLen));
 
+#ifdef SUPPORT_SHARE_BUFFER
+        /* The rolling buffer only holds packets with references. Without a frame to refer to, the whole packet is kept as header. */
+        pRtpPacket->refAddr = NULL;
+        pRtpPacket->refOffset = 0;
+        pRtpPacket->refLength = 0;
+        pRtpPacket->onRtpResend = NULL;
+        pRtpPacket->pAppData = NULL;
+        bufferAfterEncrypt = FALSE;
+#endif
+
         if (!bufferAfterEncrypt) {
             pRtpPacket->pRawPacket = rawPacket;
             pRtpPacket->rawPacketLength = packetLen;
+#ifdef SUPPORT_SHARE_BUFFER
+            CHK_STATUS(rtpRollingBufferAddRtpPacketWithRef(pKvsRtpTransceiver->sender.packetBuffer, pRtpPacket));
+#else
             CHK_STATUS(rtpRollingBufferAddRtpPacket(pKvsRtpTransceiver->sender.packetBuffer, pRtpPacket));
+#endif /* SUPPORT_SHARE_BUFFER */
         }
 
         CHK_STATUS(encryptRtpPacket(pKvsPeerConnection->pSrtpSession, rawPacket, (PINT32) &packetLen));
@@ -445,191 +464,207 @@ CleanUp:
 }
 
 #ifdef SUPPORT_SHARE_BUFFER
-STATUS writeFrameEx(PRtcRtpTransceiver pRtcRtpTransceiver, PFrame pFrame, PFrameEx pFrameEx)
+static STATUS getRtpPayloadFuncWithRef(RTC_CODEC codec, UINT64 presentationTs, RtpPayloadFunc* pRtpPayloadFunc, PUINT64 pRtpTimestamp)
 {
     STATUS retStatus = STATUS_SUCCESS;
-    PKvsPeerConnection pKvsPeerConnection = NULL;
-    PKvsRtpTransceiver pKvsRtpTransceiver = (PKvsRtpTransceiver) pRtcRtpTransceiver;
-    BOOL locked = FALSE, bufferAfterEncrypt = FALSE;
-    PRtpPacket pPacketList = NULL, pRtpPacket = NULL;
-    UINT32 i = 0, packetLen = 0, headerLen = 0, allocSize;
-    PBYTE rawPacket = NULL;
-    PPayloadArray pPayloadArray = NULL;
-    RtpPayloadFunc rtpPayloadFunc = NULL;
     UINT64 randomRtpTimeoffset = 0; // TODO: spec requires random rtp time offset
-    UINT64 rtpTimestamp = 0;
-    UINT64 now = GETTIME();
-
-    // stats updates
-    DOUBLE fps = 0.0;
-    UINT32 frames = 0, keyframes = 0, bytesSent = 0, packetsSent = 0, headerBytesSent = 0, framesSent = 0;
-    UINT32 packetsDiscardedOnSend = 0, bytesDiscardedOnSend = 0, framesDiscardedOnSend = 0;
-    UINT64 lastPacketSentTimestamp = 0;
 
-    // temp vars :(
-    UINT64 tmpFrames, tmpTime;
-    UINT16 twsn;
-    UINT32 extpayload;
-    STATUS sendStatus;
-
-    CHK(pKvsRtpTransceiver != NULL && pFrame != NULL, STATUS_NULL_ARG);
-    pKvsPeerConnection = pKvsRtpTransceiver->pKvsPeerConnection;
-    pPayloadArray = &(pKvsRtpTransceiver->sender.payloadArray);
-    if (MEDIA_STREAM_TRACK_KIND_VIDEO == pKvsRtpTransceiver->sender.track.kind) {
-        frames++;
-        if (0 != (pFrame->flags & FRAME_FLAG_KEY_FRAME)) {
-            keyframes++;
-        }
-        if (pKvsRtpTransceiver->sender.lastKnownFrameCountTime == 0) {
-            pKvsRtpTransceiver->sender.lastKnownFrameCountTime = now;
-            pKvsRtpTransceiver->sender.lastKnownFrameCount = pKvsRtpTransceiver->outboundStats.framesEncoded + frames;
-        } else if (now - pKvsRtpTransceiver->sender.lastKnownFrameCountTime > HUNDREDS_OF_NANOS_IN_A_SECOND) {
-            tmpFrames = (pKvsRtpTransceiver->outboundStats.framesEncoded + frames) - pKvsRtpTransceiver->sender.lastKnownFrameCount;
-            tmpTime = now - pKvsRtpTransceiver->sender.lastKnownFrameCountTime;
-            fps = (DOUBLE) (tmpFrames * HUNDREDS_OF_NANOS_IN_A_SECOND) / (DOUBLE) tmpTime;
-        }
-    }
-
-    MUTEX_LOCK(pKvsPeerConnection->pSrtpSessionLock);
-    locked = TRUE;
-    CHK(pKvsPeerConnection->pSrtpSession != NULL, STATUS_SRTP_NOT_READY_YET); // Discard packets till SRTP is ready
-    switch (pKvsRtpTransceiver->sender.track.codec) {
+    switch (codec) {
         case RTC_CODEC_H264_PROFILE_42E01F_LEVEL_ASYMMETRY_ALLOWED_PACKETIZATION_MODE:
-            rtpPayloadFunc = createPayloadForH264;
-            rtpTimestamp = CONVERT_TIMESTAMP_TO_RTP(VIDEO_CLOCKRATE, pFrame->presentationTs);
+            /* NALUs are taken from the frame when packets are assembled, so they don't have to be copied into payloadBuffer. */
+            *pRtpPayloadFunc = createPayloadRefForH264;
+            *pRtpTimestamp = CONVERT_TIMESTAMP_TO_RTP(VIDEO_CLOCKRATE, presentationTs);
             break;
 
         case RTC_CODEC_OPUS:
-            rtpPayloadFunc = createPayloadForOpus;
-            rtpTimestamp = CONVERT_TIMESTAMP_TO_RTP(OPUS_CLOCKRATE, pFrame->presentationTs);
+            *pRtpPayloadFunc = createPayloadForOpus;
+            *pRtpTimestamp = CONVERT_TIMESTAMP_TO_RTP(OPUS_CLOCKRATE, presentationTs);
             break;
 
         case RTC_CODEC_MULAW:
         case RTC_CODEC_ALAW:
-            rtpPayloadFunc = createPayloadForG711;
-            rtpTimestamp = CONVERT_TIMESTAMP_TO_RTP(PCM_CLOCKRATE, pFrame->presentationTs);
+            *pRtpPayloadFunc = createPayloadForG711;
+            *pRtpTimestamp = CONVERT_TIMESTAMP_TO_RTP(PCM_CLOCKRATE, presentationTs);
             break;
 
         case RTC_CODEC_VP8:
-            rtpPayloadFunc = createPayloadForVP8;
-            rtpTimestamp = CONVERT_TIMESTAMP_TO_RTP(VIDEO_CLOCKRATE, pFrame->presentationTs);
+            *pRtpPayloadFunc = createPayloadForVP8;
+            *pRtpTimestamp = CONVERT_TIMESTAMP_TO_RTP(VIDEO_CLOCKRATE, presentationTs);
             break;
 
         default:
             CHK(FALSE, STATUS_NOT_IMPLEMENTED);
     }
 
-    rtpTimestamp += randomRtpTimeoffset;
+    *pRtpTimestamp += randomRtpTimeoffset;
 
-    CHK_STATUS(rtpPayloadFunc(pKvsPeerConnection->MTU, (PBYTE) pFrame->frameData, pFrame->size, NULL, &(pPayloadArray->payloadLength), NULL,
+CleanUp:
+
+    return retStatus;
+}
+
+/* Packetize a frame into a payload array. It only depends on the codec and the MTU, and the packets of every transceiver are
+ * constructed from it, so transceivers of the same codec and MTU share it. */
+static STATUS packetizeFrameWithRef(RtpPayloadFunc rtpPayloadFunc, UINT32 mtu, PFrame pFrame, PPayloadArray pPayloadArray)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+
+    CHK_STATUS(rtpPayloadFunc(mtu, (PBYTE) pFrame->frameData, pFrame->size, NULL, &(pPayloadArray->payloadLength), NULL,
                               &(pPayloadArray->payloadSubLenSize)));
     if (pPayloadArray->payloadLength > pPayloadArray->maxPayloadLength) {
         SAFE_MEMFREE(pPayloadArray->payloadBuffer);
-        pPayloadArray->payloadBuffer = (PBYTE) MEMALLOC(pPayloadArray->payloadLength);
+        pPayloadArray->maxPayloadLength = 0;
+        CHK(NULL != (pPayloadArray->payloadBuffer = (PBYTE) MEMALLOC(pPayloadArray->payloadLength)), STATUS_NOT_ENOUGH_MEMORY);
         pPayloadArray->maxPayloadLength = pPayloadArray->payloadLength;
     }
     if (pPayloadArray->payloadSubLenSize > pPayloadArray->maxPayloadSubLenSize) {
         SAFE_MEMFREE(pPayloadArray->payloadSubLength);
-#ifdef SUPPORT_SHARE_BUFFER
+        pPayloadArray->maxPayloadSubLenSize = 0;
         /* william: We separate payloadSubLength into 3 parts.
          *     The first part doesn't change.
          *     The second part is for putting offset of a frame.
          *     The third part is for calculate RTP header length including codec header.
          * It's not a good solution. But it's a way to not rewrite all rtpPayloadFuc. */
-        pPayloadArray->payloadSubLength = (PUINT32) MEMALLOC(pPayloadArray->payloadSubLenSize * 3 * SIZEOF(UINT32));
-#else
-        pPayloadArray->payloadSubLength = (PUINT32) MEMALLOC(pPayloadArray->payloadSubLenSize * SIZEOF(UINT32));
-#endif
+        CHK(NULL != (pPayloadArray->payloadSubLength = (PUINT32) MEMALLOC(pPayloadArray->payloadSubLenSize * 3 * SIZEOF(UINT32))),
+            STATUS_NOT_ENOUGH_MEMORY);
         pPayloadArray->maxPayloadSubLenSize = pPayloadArray->payloadSubLenSize;
     }
-#ifdef SUPPORT_SHARE_BUFFER
     pPayloadArray->payloadRefOffset = pPayloadArray->payloadSubLength + pPayloadArray->payloadSubLenSize;
     pPayloadArray->payloadRefLength = pPayloadArray->payloadSubLength + pPayloadArray->payloadSubLenSize * 2;
     pPayloadArray->currentOffset = 0;
-#endif
 
-    CHK_STATUS(rtpPayloadFunc(pKvsPeerConnection->MTU, (PBYTE) pFrame->frameData, pFrame->size, pPayloadArray->payloadBuffer,
-                              &(pPayloadArray->payloadLength), pPayloadArray->payloadSubLength, &(pPayloadArray->payloadSubLenSize)));
-    pPacketList = (PRtpPacket) MEMALLOC(pPayloadArray->payloadSubLenSize * SIZEOF(RtpPacket));
+    CHK_STATUS(rtpPayloadFunc(mtu, (PBYTE) pFrame->frameData, pFrame->size, pPayloadArray->payloadBuffer, &(pPayloadArray->payloadLength),
+                              pPayloadArray->payloadSubLength, &(pPayloadArray->payloadSubLenSize)));
 
-    CHK_STATUS(constructRtpPackets(pPayloadArray, pKvsRtpTransceiver->sender.payloadType, pKvsRtpTransceiver->sender.sequenceNumber, rtpTimestamp,
-                                   pKvsRtpTransceiver->sender.ssrc, pPacketList, pPayloadArray->payloadSubLenSize));
-    pKvsRtpTransceiver->sender.sequenceNumber = GET_UINT16_SEQ_NUM(pKvsRtpTransceiver->sender.sequenceNumber + pPayloadArray->payloadSubLenSize);
-
-    bufferAfterEncrypt = (pKvsRtpTransceiver->sender.payloadType == pKvsRtpTransceiver->sender.rtxPayloadType);
-    for (i = 0; i < pPayloadArray->payloadSubLenSize; i++) {
-        pRtpPacket = pPacketList + i;
-        if (pKvsRtpTransceiver->pKvsPeerConnection->twccExtId != 0) {
-            pRtpPacket->header.extension = TRUE;
-            pRtpPacket->header.extensionProfile = TWCC_EXT_PROFILE;
-            pRtpPacket->header.extensionLength = SIZEOF(UINT32);
-            twsn = (UINT16) ATOMIC_INCREMENT(&pKvsRtpTransceiver->pKvsPeerConnection->transportWideSequenceNumber);
-            extpayload = TWCC_PAYLOAD(pKvsRtpTransceiver->pKvsPeerConnection->twccExtId, twsn);
-            pRtpPacket->header.extensionPayload = (PBYTE) &extpayload;
-        }
-        // Get the required size first
-        CHK_STATUS(createBytesFromRtpPacket(pRtpPacket, NULL, &packetLen));
+CleanUp:
 
-        // Account for SRTP authentication tag
-        allocSize = packetLen + SRTP_AUTH_TAG_OVERHEAD;
-        CHK(NULL != (rawPacket = (PBYTE) MEMALLOC(allocSize)), STATUS_NOT_ENOUGH_MEMORY);
-        CHK_STATUS(createBytesFromRtpPacket(pRtpPacket, rawPacket, &packetLen));
+    return retStatus;
+}
 
-#ifdef SUPPORT_SHARE_BUFFER
-        pRtpPacket->refAddr = pFrame->frameData;
-        pRtpPacket->refOffset = pPayloadArray->payloadRefOffset[i];
-        pRtpPacket->refLength = pPayloadArray->payloadRefLength[i];
+/* Construct, encrypt and send the packets of a packetized frame on a transceiver. The payload array is only read, so it can be
+ * packetized by another transceiver of the same codec and MTU. */
+static STATUS sendPacketizedFrame(PKvsRtpTransceiver pKvsRtpTransceiver, PFrame pFrame, PFrameEx pFrameEx, PPayloadArray pPayloadArray,
+                                  UINT64 rtpTimestamp)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PKvsPeerConnection pKvsPeerConnection = NULL;
+    BOOL locked = FALSE;
+    PRtpPacket pPacketList = NULL, pRtpPacket = NULL;
+    UINT32 i = 0, j = 0, batchLen = 0, packetLen = 0, headerLen = 0, allocSize;
+    PBYTE rawPackets[RTP_ENCRYPT_BATCH_SIZE] = {NULL};
+    INT32 rawPacketLens[RTP_ENCRYPT_BATCH_SIZE];
+    UINT32 extpayloads[RTP_ENCRYPT_BATCH_SIZE];
+    UINT64 randomRtpTimeoffset = 0; // TODO: spec requires random rtp time offset
+    UINT64 now = GETTIME();
 
-        pRtpPacket->onRtpResend = pFrameEx->onRtpResend;
-        pRtpPacket->pAppData = pFrameEx->pAppData;
+    // stats updates
+    DOUBLE fps = 0.0;
+    UINT32 frames = 0, keyframes = 0, bytesSent = 0, packetsSent = 0, headerBytesSent = 0, framesSent = 0;
+    UINT32 packetsDiscardedOnSend = 0, bytesDiscardedOnSend = 0, framesDiscardedOnSend = 0;
+    UINT64 lastPacketSentTimestamp = 0;
 
-        /* To share buffer, we always buffer the unencrypted packet. */
-        bufferAfterEncrypt = FALSE;
-#endif
+    // temp vars :(
+    UINT64 tmpFrames, tmpTime;
+    UINT16 twsn;
+    STATUS sendStatus;
 
-        if (!bufferAfterEncrypt) {
-            pRtpPacket->pRawPacket = rawPacket;
-            pRtpPacket->rawPacketLength = packetLen;
-#ifdef SUPPORT_SHARE_BUFFER
-            CHK_STATUS(rtpRollingBufferAddRtpPacketWithRef(pKvsRtpTransceiver->sender.packetBuffer, pRtpPacket));
-#else
-            CHK_STATUS(rtpRollingBufferAddRtpPacket(pKvsRtpTransceiver->sender.packetBuffer, pRtpPacket));
-#endif /* SUPPORT_SHARE_BUFFER */
+    pKvsPeerConnection = pKvsRtpTransceiver->pKvsPeerConnection;
+    if (MEDIA_STREAM_TRACK_KIND_VIDEO == pKvsRtpTransceiver->sender.track.kind) {
+        frames++;
+        if (0 != (pFrame->flags & FRAME_FLAG_KEY_FRAME)) {
+            keyframes++;
         }
-
-        CHK_STATUS(encryptRtpPacket(pKvsPeerConnection->pSrtpSession, rawPacket, (PINT32) &packetLen));
-        sendStatus = iceAgentSendPacket(pKvsPeerConnection->pIceAgent, rawPacket, packetLen);
-        if (sendStatus == STATUS_SEND_DATA_FAILED) {
-            packetsDiscardedOnSend++;
-            bytesDiscardedOnSend += packetLen - headerLen;
-            // TODO is frame considered discarded when at least one of its packets is discarded or all of its packets discarded?
-            framesDiscardedOnSend = 1;
-            SAFE_MEMFREE(rawPacket);
-            continue;
-        } else if (sendStatus == STATUS_SUCCESS && pKvsRtpTransceiver->pKvsPeerConnection->twccExtId != 0) {
-            pRtpPacket->sentTime = GETTIME();
-            twccManagerOnPacketSent(pKvsPeerConnection, pRtpPacket);
+        if (pKvsRtpTransceiver->sender.lastKnownFrameCountTime == 0) {
+            pKvsRtpTransceiver->sender.lastKnownFrameCountTime = now;
+            pKvsRtpTransceiver->sender.lastKnownFrameCount = pKvsRtpTransceiver->outboundStats.framesEncoded + frames;
+        } else if (now - pKvsRtpTransceiver->sender.lastKnownFrameCountTime > HUNDREDS_OF_NANOS_IN_A_SECOND) {
+            tmpFrames = (pKvsRtpTransceiver->outboundStats.framesEncoded + frames) - pKvsRtpTransceiver->sender.lastKnownFrameCount;
+            tmpTime = now - pKvsRtpTransceiver->sender.lastKnownFrameCountTime;
+            fps = (DOUBLE) (tmpFrames * HUNDREDS_OF_NANOS_IN_A_SECOND) / (DOUBLE) tmpTime;
         }
-        CHK_STATUS(sendStatus);
-        if (bufferAfterEncrypt) {
-            pRtpPacket->pRawPacket = rawPacket;
+    }
+
+    MUTEX_LOCK(pKvsPeerConnection->pSrtpSessionLock);
+    locked = TRUE;
+    CHK(pKvsPeerConnection->pSrtpSession != NULL, STATUS_SRTP_NOT_READY_YET); // Discard packets till SRTP is ready
+    CHK(NULL != (pPacketList = (PRtpPacket) MEMALLOC(pPayloadArray->payloadSubLenSize * SIZEOF(RtpPacket))), STATUS_NOT_ENOUGH_MEMORY);
+
+    CHK_STATUS(constructRtpPackets(pPayloadArray, pKvsRtpTransceiver->sender.payloadType, pKvsRtpTransceiver->sender.sequenceNumber, rtpTimestamp,
+                                   pKvsRtpTransceiver->sender.ssrc, pPacketList, pPayloadArray->payloadSubLenSize));
+    pKvsRtpTransceiver->sender.sequenceNumber = GET_UINT16_SEQ_NUM(pKvsRtpTransceiver->sender.sequenceNumber + pPayloadArray->payloadSubLenSize);
+
+    /* Packets are assembled and encrypted in batches, then sent. The unencrypted packets are buffered for retransmission as references
+     * to the frame. */
+    for (i = 0; i < pPayloadArray->payloadSubLenSize; i += batchLen) {
+        batchLen = MIN(RTP_ENCRYPT_BATCH_SIZE, pPayloadArray->payloadSubLenSize - i);
+
+        for (j = 0; j < batchLen; j++) {
+            pRtpPacket = pPacketList + i + j;
+            if (pKvsRtpTransceiver->pKvsPeerConnection->twccExtId != 0) {
+                pRtpPacket->header.extension = TRUE;
+                pRtpPacket->header.extensionProfile = TWCC_EXT_PROFILE;
+                pRtpPacket->header.extensionLength = SIZEOF(UINT32);
+                twsn = (UINT16) ATOMIC_INCREMENT(&pKvsRtpTransceiver->pKvsPeerConnection->transportWideSequenceNumber);
+                // The extension payload has to live until the packet is reported to twcc manager after it's sent
+                extpayloads[j] = TWCC_PAYLOAD(pKvsRtpTransceiver->pKvsPeerConnection->twccExtId, twsn);
+                pRtpPacket->header.extensionPayload = (PBYTE) &extpayloads[j];
+            }
+            /* Only the RTP header and the codec header are serialized from the packet. The payload is copied straight from the frame
+             * right behind them, and the packet is encrypted in place, so every byte of the frame is copied once per packet. */
+            pRtpPacket->payloadLength -= pPayloadArray->payloadRefLength[i + j];
+
+            // Get the required size first
+            CHK_STATUS(createBytesFromRtpPacket(pRtpPacket, NULL, &packetLen));
+
+            // Account for the payload and SRTP authentication tag
+            allocSize = packetLen + pPayloadArray->payloadRefLength[i + j] + SRTP_AUTH_TAG_OVERHEAD;
+            CHK(NULL != (rawPackets[j] = (PBYTE) MEMALLOC(allocSize)), STATUS_NOT_ENOUGH_MEMORY);
+            CHK_STATUS(createBytesFromRtpPacket(pRtpPacket, rawPackets[j], &packetLen));
+            MEMCPY(rawPackets[j] + packetLen, pFrame->frameData + pPayloadArray->payloadRefOffset[i + j], pPayloadArray->payloadRefLength[i + j]);
+            packetLen += pPayloadArray->payloadRefLength[i + j];
+            pRtpPacket->payloadLength += pPayloadArray->payloadRefLength[i + j];
+            rawPacketLens[j] = (INT32) packetLen;
+
+            pRtpPacket->refAddr = pFrame->frameData;
+            pRtpPacket->refOffset = pPayloadArray->payloadRefOffset[i + j];
+            pRtpPacket->refLength = pPayloadArray->payloadRefLength[i + j];
+
+            pRtpPacket->onRtpResend = pFrameEx->onRtpResend;
+            pRtpPacket->pAppData = pFrameEx->pAppData;
+
+            /* To share buffer, we always buffer the unencrypted packet. */
+            pRtpPacket->pRawPacket = rawPackets[j];
             pRtpPacket->rawPacketLength = packetLen;
-#ifdef SUPPORT_SHARE_BUFFER
             CHK_STATUS(rtpRollingBufferAddRtpPacketWithRef(pKvsRtpTransceiver->sender.packetBuffer, pRtpPacket));
-#else
-            CHK_STATUS(rtpRollingBufferAddRtpPacket(pKvsRtpTransceiver->sender.packetBuffer, pRtpPacket));
-#endif /* SUPPORT_SHARE_BUFFER */
         }
 
-        // https://tools.ietf.org/html/rfc3550#section-6.4.1
-        // The total number of payload octets (i.e., not including header or padding) transmitted in RTP data packets by the sender
-        headerLen = RTP_HEADER_LEN(pRtpPacket);
-        bytesSent += packetLen - headerLen;
-        packetsSent++;
-        lastPacketSentTimestamp = KVS_CONVERT_TIMESCALE(GETTIME(), HUNDREDS_OF_NANOS_IN_A_SECOND, 1000);
-        headerBytesSent += headerLen;
-
-        SAFE_MEMFREE(rawPacket);
+        CHK_STATUS(encryptRtpPackets(pKvsPeerConnection->pSrtpSession, (PVOID*) rawPackets, rawPacketLens, batchLen));
+
+        for (j = 0; j < batchLen; j++) {
+            pRtpPacket = pPacketList + i + j;
+            packetLen = (UINT32) rawPacketLens[j];
+            sendStatus = iceAgentSendPacket(pKvsPeerConnection->pIceAgent, rawPackets[j], packetLen);
+            SAFE_MEMFREE(rawPackets[j]);
+            if (sendStatus == STATUS_SEND_DATA_FAILED) {
+                packetsDiscardedOnSend++;
+                bytesDiscardedOnSend += packetLen - headerLen;
+                // TODO is frame considered discarded when at least one of its packets is discarded or all of its packets discarded?
+                framesDiscardedOnSend = 1;
+                continue;
+            } else if (sendStatus == STATUS_SUCCESS && pKvsRtpTransceiver->pKvsPeerConnection->twccExtId != 0) {
+                pRtpPacket->sentTime = GETTIME();
+                twccManagerOnPacketSent(pKvsPeerConnection, pRtpPacket);
+            }
+            CHK_STATUS(sendStatus);
+
+            // https://tools.ietf.org/html/rfc3550#section-6.4.1
+            // The total number of payload octets (i.e., not including header or padding) transmitted in RTP data packets by the sender
+            headerLen = RTP_HEADER_LEN(pRtpPacket);
+            bytesSent += packetLen - headerLen;
+            packetsSent++;
+            lastPacketSentTimestamp = KVS_CONVERT_TIMESCALE(GETTIME(), HUNDREDS_OF_NANOS_IN_A_SECOND, 1000);
+            headerBytesSent += headerLen;
+        }
     }
 
     if (MEDIA_STREAM_TRACK_KIND_VIDEO == pKvsRtpTransceiver->sender.track.kind) {
@@ -675,7 +710,9 @@ STATUS writeFrameEx(PRtcRtpTransceiver pRtcRtpTransceiver, PFrame pFrame, PFrame
     pKvsRtpTransceiver->outboundStats.bytesDiscardedOnSend += bytesDiscardedOnSend;
     MUTEX_UNLOCK(pKvsRtpTransceiver->statsLock);
 
-    SAFE_MEMFREE(rawPacket);
+    for (j = 0; j < RTP_ENCRYPT_BATCH_SIZE; j++) {
+        SAFE_MEMFREE(rawPackets[j]);
+    }
     SAFE_MEMFREE(pPacketList);
     if (retStatus != STATUS_SRTP_NOT_READY_YET) {
         CHK_LOG_ERR(retStatus);
@@ -683,4 +720,81 @@ STATUS writeFrameEx(PRtcRtpTransceiver pRtcRtpTransceiver, PFrame pFrame, PFrame
 
     return retStatus;
 }
+
+STATUS writeFrameEx(PRtcRtpTransceiver pRtcRtpTransceiver, PFrame pFrame, PFrameEx pFrameEx)
+{
+    STATUS retStatus = STATUS_SUCCESS;
+    PKvsRtpTransceiver pKvsRtpTransceiver = (PKvsRtpTransceiver) pRtcRtpTransceiver;
+    RtpPayloadFunc rtpPayloadFunc = NULL;
+    UINT64 rtpTimestamp = 0;
+
+    CHK(pKvsRtpTransceiver != NULL && pFrame != NULL && pFrameEx != NULL, STATUS_NULL_ARG);
+    CHK_STATUS(getRtpPayloadFuncWithRef(pKvsRtpTransceiver->sender.track.codec, pFrame->presentationTs, &rtpPayloadFunc, &rtpTimestamp));
+    CHK_STATUS(packetizeFrameWithRef(rtpPayloadFunc, pKvsRtpTransceiver->pKvsPeerConnection->MTU, pFrame, &(pKvsRtpTransceiver->sender.payloadArray)));
+    retStatus = sendPacketizedFrame(pKvsRtpTransceiver, pFrame, pFrameEx, &(pKvsRtpTransceiver->sender.payloadArray), rtpTimestamp);
+
+CleanUp:
+
+    return retStatus;
+}
+
+static BOOL isSamePacketization(PKvsRtpTransceiver pKvsRtpTransceiver, PKvsRtpTransceiver pOtherKvsRtpTransceiver)
+{
+    return pKvsRtpTransceiver->sender.track.codec == pOtherKvsRtpTransceiver->sender.track.codec &&
+        pKvsRtpTransceiver->pKvsPeerConnection->MTU == pOtherKvsRtpTransceiver->pKvsPeerConnection->MTU;
+}
+
+STATUS writeFrameExToTransceivers(PRtcRtpTransceiver* ppRtcRtpTransceivers, UINT32 transceiverCount, PFrame pFrame, PFrameEx pFrameEx)
+{
+    STATUS retStatus = STATUS_SUCCESS, groupStatus = STATUS_SUCCESS, sendStatus = STATUS_SUCCESS;
+    PKvsRtpTransceiver pPacketizer = NULL, pKvsRtpTransceiver = NULL;
+    PPayloadArray pPayloadArray = NULL;
+    RtpPayloadFunc rtpPayloadFunc = NULL;
+    UINT64 rtpTimestamp = 0;
+    UINT32 i = 0, j = 0;
+    BOOL packetized = FALSE;
+
+    CHK(ppRtcRtpTransceivers != NULL && pFrame != NULL && pFrameEx != NULL, STATUS_NULL_ARG);
+
+    /* Transceivers are grouped by codec and MTU. The first transceiver of a group packetizes the frame into its payload array, and
+     * every transceiver of the group constructs its own RTP headers from it, then encrypts with its own SRTP session. */
+    for (i = 0; i < transceiverCount; i++) {
+        pPacketizer = (PKvsRtpTransceiver) ppRtcRtpTransceivers[i];
+        if (pPacketizer == NULL) {
+            continue;
+        }
+
+        for (j = 0, packetized = FALSE; j < i && !packetized; j++) {
+            pKvsRtpTransceiver = (PKvsRtpTransceiver) ppRtcRtpTransceivers[j];
+            packetized = pKvsRtpTransceiver != NULL && isSamePacketization(pPacketizer, pKvsRtpTransceiver);
+        }
+        if (packetized) {
+            continue;
+        }
+
+        pPayloadArray = &(pPacketizer->sender.payloadArray);
+        groupStatus = getRtpPayloadFuncWithRef(pPacketizer->sender.track.codec, pFrame->presentationTs, &rtpPayloadFunc, &rtpTimestamp);
+        if (STATUS_SUCCEEDED(groupStatus)) {
+            groupStatus = packetizeFrameWithRef(rtpPayloadFunc, pPacketizer->pKvsPeerConnection->MTU, pFrame, pPayloadArray);
+        }
+
+        for (j = i; j < transceiverCount; j++) {
+            pKvsRtpTransceiver = (PKvsRtpTransceiver) ppRtcRtpTransceivers[j];
+            if (pKvsRtpTransceiver == NULL || !isSamePacketization(pPacketizer, pKvsRtpTransceiver)) {
+                continue;
+            }
+
+            sendStatus = STATUS_SUCCEEDED(groupStatus) ? sendPacketizedFrame(pKvsRtpTransceiver, pFrame, pFrameEx, pPayloadArray, rtpTimestamp)
+                                                       : groupStatus;
+            // A peer that isn't connected yet doesn't fail the others
+            if (STATUS_FAILED(sendStatus) && sendStatus != STATUS_SRTP_NOT_READY_YET && STATUS_SUCCEEDED(retStatus)) {
+                retStatus = sendStatus;
+            }
+        }
+    }
+
+CleanUp:
+
+    return retStatus;
+}
 #endif
\ No newline at end of file
@@ -2,6 +2,104 @@
 
 #include "../Include_i.h"
 
+#ifdef SUPPORT_SHARE_BUFFER
+static STATUS createRtpPacketRefPool(UINT32 capacity, PRtpPacketRefPool* ppPool)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+    PRtpPacketRefPool pPool = NULL;
+    PRtpPacketRef pRtpPacketRef = NULL;
+    UINT32 i = 0;
+
+    pPool = (PRtpPacketRefPool) MEMCALLOC(1, SIZEOF(RtpPacketRefPool));
+    CHK(pPool != NULL, STATUS_NOT_ENOUGH_MEMORY);
+    pPool->lock = INVALID_MUTEX_VALUE;
+
+    // Keep every slot aligned for the pointers of RtpPacketRef
+    pPool->slotSize = (SIZEOF(RtpPacketRef) + RTP_PACKET_REF_POOL_HDR_SIZE + SIZEOF(UINT64) - 1) & ~(SIZEOF(UINT64) - 1);
+    pPool->capacity = capacity;
+    pPool->pSlots = (PBYTE) MEMALLOC((SIZE_T) pPool->slotSize * capacity);
+    CHK(pPool->pSlots != NULL, STATUS_NOT_ENOUGH_MEMORY);
+    pPool->lock = MUTEX_CREATE(FALSE);
+    CHK(IS_VALID_MUTEX_VALUE(pPool->lock), STATUS_INVALID_OPERATION);
+
+    for (i = capacity; i > 0; i--) {
+        pRtpPacketRef = (PRtpPacketRef) (pPool->pSlots + (SIZE_T) pPool->slotSize * (i - 1));
+        pRtpPacketRef->pPool = pPool;
+        pRtpPacketRef->pNext = pPool->pFreeList;
+        pPool->pFreeList = pRtpPacketRef;
+    }
+
+CleanUp:
+    if (STATUS_FAILED(retStatus) && pPool != NULL) {
+        SAFE_MEMFREE(pPool->pSlots);
+        SAFE_MEMFREE(pPool);
+    }
+
+    *ppPool = pPool;
+
+    LEAVES();
+    return retStatus;
+}
+
+static VOID freeRtpPacketRefPool(PRtpPacketRefPool* ppPool)
+{
+    PRtpPacketRefPool pPool = *ppPool;
+
+    if (pPool != NULL) {
+        if (IS_VALID_MUTEX_VALUE(pPool->lock)) {
+            MUTEX_FREE(pPool->lock);
+        }
+        SAFE_MEMFREE(pPool->pSlots);
+        SAFE_MEMFREE(*ppPool);
+    }
+}
+
+/* It returns a packet whose header buffer is big enough for rawHdrLen, either from the pool or from heap. */
+static PRtpPacketRef getRtpPacketRef(PRtpPacketRefPool pPool, UINT32 rawHdrLen)
+{
+    PRtpPacketRef pRtpPacketRef = NULL;
+    PUINT8 pMem = NULL;
+
+    if (pPool != NULL && rawHdrLen <= RTP_PACKET_REF_POOL_HDR_SIZE) {
+        MUTEX_LOCK(pPool->lock);
+        if ((pRtpPacketRef = pPool->pFreeList) != NULL) {
+            pPool->pFreeList = pRtpPacketRef->pNext;
+        }
+        MUTEX_UNLOCK(pPool->lock);
+    }
+
+    if (pRtpPacketRef == NULL) {
+        // The pool runs out of packets when retransmission holds more of them than the headroom
+        if ((pMem = (PUINT8) MEMALLOC(SIZEOF(RtpPacketRef) + rawHdrLen)) != NULL) {
+            pRtpPacketRef = (PRtpPacketRef) pMem;
+            pRtpPacketRef->pPool = NULL;
+        }
+    }
+
+    if (pRtpPacketRef != NULL) {
+        pRtpPacketRef->pRawPacketHdr = (PBYTE) (pRtpPacketRef + 1);
+        pRtpPacketRef->pNext = NULL;
+    }
+
+    return pRtpPacketRef;
+}
+
+static VOID putRtpPacketRef(PRtpPacketRef pRtpPacketRef)
+{
+    PRtpPacketRefPool pPool = pRtpPacketRef->pPool;
+
+    if (pPool != NULL) {
+        MUTEX_LOCK(pPool->lock);
+        pRtpPacketRef->pNext = pPool->pFreeList;
+        pPool->pFreeList = pRtpPacketRef;
+        MUTEX_UNLOCK(pPool->lock);
+    } else {
+        MEMFREE(pRtpPacketRef);
+    }
+}
+#endif /* SUPPORT_SHARE_BUFFER */
+
 STATUS createRtpRollingBuffer(UINT32 capacity, PRtpRollingBuffer* ppRtpRollingBuffer)
 {
     ENTERS();
@@ -13,6 +111,11 @@ STATUS createRtpRollingBuffer(UINT32 capacity, PRtpRollingBuffer* ppRtpRollingBu
     pRtpRollingBuffer = (PRtpRollingBuffer) MEMALLOC(SIZEOF(RtpRollingBuffer));
     CHK(pRtpRollingBuffer != NULL, STATUS_NOT_ENOUGH_MEMORY);
 #ifdef SUPPORT_SHARE_BUFFER
+    pRtpRollingBuffer->pPool = NULL;
+    pRtpRollingBuffer->resendTokens = RTP_RETRANSMIT_BURST_BYTES;
+    pRtpRollingBuffer->lastResendRefillTime = GETTIME();
+    // The pool is sized from the NACK window, so packets are not allocated once the rolling buffer is full
+    CHK_STATUS(createRtpPacketRefPool(capacity + RTP_PACKET_REF_POOL_HEADROOM, &pRtpRollingBuffer->pPool));
     CHK_STATUS(createRollingBuffer(capacity, freeRtpRollingBufferDataWithRef, &pRtpRollingBuffer->pRollingBuffer));
 #else
     CHK_STATUS(createRollingBuffer(capacity, freeRtpRollingBufferData, &pRtpRollingBuffer->pRollingBuffer));
@@ -35,6 +138,10 @@ STATUS freeRtpRollingBuffer(PRtpRollingBuffer* ppRtpRollingBuffer)
 
     if (*ppRtpRollingBuffer != NULL) {
         freeRollingBuffer(&(*ppRtpRollingBuffer)->pRollingBuffer);
+#ifdef SUPPORT_SHARE_BUFFER
+        // All packets of the rolling buffer are back to the pool now
+        freeRtpPacketRefPool(&(*ppRtpRollingBuffer)->pPool);
+#endif
     }
     SAFE_MEMFREE(*ppRtpRollingBuffer);
 CleanUp:
@@ -90,7 +197,9 @@ STATUS freeRtpRollingBufferDataWithRef(PUINT64 pData)
     PRtpPacketRef pRtpPacketRef = NULL;
     CHK(pData != NULL, STATUS_NULL_ARG);
     pRtpPacketRef = (PRtpPacketRef)(*pData);
-    SAFE_MEMFREE(pRtpPacketRef);
+    if (pRtpPacketRef != NULL) {
+        putRtpPacketRef(pRtpPacketRef);
+    }
 CleanUp:
     LEAVES();
     return retStatus;
@@ -100,7 +209,6 @@ STATUS rtpRollingBufferAddRtpPacketWithRef(PRtpRollingBuffer pRollingBuffer, PRt
 {
     ENTERS();
     STATUS retStatus = STATUS_SUCCESS;
-    PUINT8 pMem = NULL;
     PRtpPacketRef pRtpPacketRef = NULL;
     UINT32 rtpRawHdrLen = 0;
     UINT64 index = 0;
@@ -108,10 +216,8 @@ STATUS rtpRollingBufferAddRtpPacketWithRef(PRtpRollingBuffer pRollingBuffer, PRt
 
     CHK(pRtpPacket->rawPacketLength >= pRtpPacket->refLength + MIN_HEADER_LENGTH, STATUS_INVALID_ARG);
     rtpRawHdrLen = pRtpPacket->rawPacketLength - pRtpPacket->refLength;
-    pMem = (PUINT8) MEMALLOC(sizeof(RtpPacketRef) + rtpRawHdrLen);
-    CHK(pMem != NULL, STATUS_NOT_ENOUGH_MEMORY);
-    pRtpPacketRef = (PRtpPacketRef) pMem;
-    pRtpPacketRef->pRawPacketHdr = pMem + sizeof(RtpPacketRef);
+    pRtpPacketRef = getRtpPacketRef(pRollingBuffer->pPool, rtpRawHdrLen);
+    CHK(pRtpPacketRef != NULL, STATUS_NOT_ENOUGH_MEMORY);
     MEMCPY(pRtpPacketRef->pRawPacketHdr, pRtpPacket->pRawPacket, rtpRawHdrLen);
     pRtpPacketRef->rawPacketHdrLength = rtpRawHdrLen;
     pRtpPacketRef->refAddr = pRtpPacket->refAddr;
@@ -120,11 +226,16 @@ STATUS rtpRollingBufferAddRtpPacketWithRef(PRtpRollingBuffer pRollingBuffer, PRt
 
     pRtpPacketRef->onRtpResend = pRtpPacket->onRtpResend;
     pRtpPacketRef->pAppData = pRtpPacket->pAppData;
+    pRtpPacketRef->lastResendTime = 0;
 
     CHK_STATUS(rollingBufferAppendData(pRollingBuffer->pRollingBuffer, (UINT64) pRtpPacketRef, &index));
     pRollingBuffer->lastIndex = index;
+    pRtpPacketRef = NULL;
 
 CleanUp:
+    if (pRtpPacketRef != NULL) {
+        putRtpPacketRef(pRtpPacketRef);
+    }
     CHK_LOG_ERR(retStatus);
 
     LEAVES();
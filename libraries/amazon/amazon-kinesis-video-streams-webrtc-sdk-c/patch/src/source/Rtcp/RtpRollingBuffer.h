@@ -10,10 +10,43 @@ RTCP Rolling Buffer include file
 extern "C" {
 #endif
 
+#ifdef SUPPORT_SHARE_BUFFER
+// Max raw header length of a pooled packet, i.e. the RTP header with extensions and the codec header. Packets with a longer header are
+// allocated from heap.
+#define RTP_PACKET_REF_POOL_HDR_SIZE 32
+
+// Extra packets of the pool, which covers packets that are extracted for retransmission while the rolling buffer is full
+#define RTP_PACKET_REF_POOL_HEADROOM 8
+
+// Retransmissions of a sender are paced by a token bucket of this rate and burst, in bytes
+#define RTP_RETRANSMIT_RATE_BYTES_PER_SECOND (256 * 1024)
+#define RTP_RETRANSMIT_BURST_BYTES           (64 * 1024)
+
+// A packet isn't retransmitted again within this interval, so duplicate NACKs of a compound RTCP packet or of a NACK burst are dropped
+#define RTP_RETRANSMIT_SUPPRESS_INTERVAL (20 * HUNDREDS_OF_NANOS_IN_A_MILLISECOND)
+
+typedef struct __RtpPacketRefPool RtpPacketRefPool;
+struct __RtpPacketRefPool {
+    MUTEX lock;
+    PBYTE pSlots;
+    UINT32 slotSize;
+    UINT32 capacity;
+    PRtpPacketRef pFreeList;
+};
+typedef RtpPacketRefPool* PRtpPacketRefPool;
+#endif /* SUPPORT_SHARE_BUFFER */
+
 typedef struct {
     PRollingBuffer pRollingBuffer;
     // index of last rtp packet in rolling buffer
     UINT64 lastIndex;
+#ifdef SUPPORT_SHARE_BUFFER
+    // packets of the rolling buffer are recycled in place instead of being allocated for every packet sent
+    PRtpPacketRefPool pPool;
+    // token bucket of retransmissions
+    UINT64 resendTokens;
+    UINT64 lastResendRefillTime;
+#endif
 } RtpRollingBuffer, *PRtpRollingBuffer;
 
 STATUS createRtpRollingBuffer(UINT32, PRtpRollingBuffer*);
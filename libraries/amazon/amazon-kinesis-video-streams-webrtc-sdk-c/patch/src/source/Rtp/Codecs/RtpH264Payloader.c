@@ -46,8 +46,8 @@ CleanUp:
 }
 #endif
 
-STATUS createPayloadForH264(UINT32 mtu, PBYTE nalus, UINT32 nalusLength, PBYTE payloadBuffer, PUINT32 pPayloadLength, PUINT32 pPayloadSubLength,
-                            PUINT32 pPayloadSubLenSize)
+static STATUS createPayloadForH264Internal(UINT32 mtu, PBYTE nalus, UINT32 nalusLength, PBYTE payloadBuffer, PUINT32 pPayloadLength,
+                                           PUINT32 pPayloadSubLength, PUINT32 pPayloadSubLenSize, BOOL refOnly)
 {
     ENTERS();
     STATUS retStatus = STATUS_SUCCESS;
@@ -80,6 +80,9 @@ STATUS createPayloadForH264(UINT32 mtu, PBYTE nalus, UINT32 nalusLength, PBYTE p
         payloadArray.currentOffset = 0;
         payloadArray.payloadRefOffset = pPayloadSubLength + (*pPayloadSubLenSize);
         payloadArray.payloadRefLength = pPayloadSubLength + (*pPayloadSubLenSize) * 2;
+        payloadArray.refOnly = refOnly;
+#else
+        UNUSED_PARAM(refOnly);
 #endif
     }
     payloadArray.payloadBuffer = payloadBuffer;
@@ -197,6 +200,20 @@ CleanUp:
     return retStatus;
 }
 
+STATUS createPayloadForH264(UINT32 mtu, PBYTE nalus, UINT32 nalusLength, PBYTE payloadBuffer, PUINT32 pPayloadLength, PUINT32 pPayloadSubLength,
+                            PUINT32 pPayloadSubLenSize)
+{
+    return createPayloadForH264Internal(mtu, nalus, nalusLength, payloadBuffer, pPayloadLength, pPayloadSubLength, pPayloadSubLenSize, FALSE);
+}
+
+#ifdef SUPPORT_SHARE_BUFFER
+STATUS createPayloadRefForH264(UINT32 mtu, PBYTE nalus, UINT32 nalusLength, PBYTE payloadBuffer, PUINT32 pPayloadLength, PUINT32 pPayloadSubLength,
+                               PUINT32 pPayloadSubLenSize)
+{
+    return createPayloadForH264Internal(mtu, nalus, nalusLength, payloadBuffer, pPayloadLength, pPayloadSubLength, pPayloadSubLenSize, TRUE);
+}
+#endif
+
 STATUS createPayloadFromNalu(UINT32 mtu, PBYTE nalu, UINT32 naluLength, PPayloadArray pPayloadArray, PUINT32 filledLength, PUINT32 filledSubLenSize)
 {
     ENTERS();
@@ -234,7 +251,13 @@ STATUS createPayloadFromNalu(UINT32 mtu, PBYTE nalu, UINT32 naluLength, PPayload
                 STATUS_BUFFER_TOO_SMALL);
 
             // Single NALU https://tools.ietf.org/html/rfc6184#section-5.6
+#ifdef SUPPORT_SHARE_BUFFER
+            if (!pPayloadArray->refOnly) {
+                MEMCPY(pPayload, nalu, naluLength);
+            }
+#else
             MEMCPY(pPayload, nalu, naluLength);
+#endif
             pPayloadArray->payloadSubLength[payloadSubLenSize - 1] = naluLength;
             pPayload += pPayloadArray->payloadSubLength[payloadSubLenSize - 1];
 #ifdef SUPPORT_SHARE_BUFFER
@@ -250,6 +273,11 @@ STATUS createPayloadFromNalu(UINT32 mtu, PBYTE nalu, UINT32 naluLength, PPayload
         // According to the RFC, the first octet is skipped due to redundant information
         remainingNaluLength--;
         pCurPtrInNalu = nalu + 1;
+#ifdef SUPPORT_SHARE_BUFFER
+        if (!sizeCalculationOnly) {
+            pPayloadArray->currentOffset++;
+        }
+#endif
 
         while (remainingNaluLength != 0) {
             curPayloadSize = MIN(maxPayloadSize, remainingNaluLength);
@@ -260,7 +288,13 @@ STATUS createPayloadFromNalu(UINT32 mtu, PBYTE nalu, UINT32 naluLength, PPayload
                 CHK(payloadSubLenSize <= pPayloadArray->maxPayloadSubLenSize && payloadLength <= pPayloadArray->maxPayloadLength,
                     STATUS_BUFFER_TOO_SMALL);
 
+#ifdef SUPPORT_SHARE_BUFFER
+                if (!pPayloadArray->refOnly) {
+                    MEMCPY(pPayload + FU_A_HEADER_SIZE, pCurPtrInNalu, curPayloadSize);
+                }
+#else
                 MEMCPY(pPayload + FU_A_HEADER_SIZE, pCurPtrInNalu, curPayloadSize);
+#endif
                 /* FU-A indicator is 28 */
                 pPayload[0] = 28 | naluRefIdc;
                 pPayload[1] = naluType;
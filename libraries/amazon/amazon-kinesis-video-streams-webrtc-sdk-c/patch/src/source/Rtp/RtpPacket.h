@@ -95,6 +95,8 @@ struct __Payloads {
     UINT32 currentOffset;
     PUINT32 payloadRefOffset;
     PUINT32 payloadRefLength;
+    // Only codec headers are written into payloadBuffer, and the payload of each packet is taken from the frame by reference
+    BOOL refOnly;
 #endif
 };
 typedef struct __Payloads PayloadArray;
@@ -133,6 +135,13 @@ struct __RtpPacketRef {
 
     int (*onRtpResend)(uint8_t **ppData, size_t *puLen, void *pAppData);
     void *pAppData;
+
+    // Pool that the packet is recycled to, or NULL if the packet is allocated from heap
+    struct __RtpPacketRefPool* pPool;
+    // Next free packet of the pool
+    RtpPacketRef* pNext;
+    // Time of the last retransmission, which is used to drop duplicate NACKs
+    UINT64 lastResendTime;
 };
 typedef RtpPacketRef* PRtpPacketRef;
 #endif
@@ -147,6 +156,19 @@ STATUS createBytesFromRtpPacket(PRtpPacket, PBYTE, PUINT32);
 STATUS setBytesFromRtpPacket(PRtpPacket, PBYTE, UINT32);
 STATUS constructRtpPackets(PPayloadArray, UINT8, UINT16, UINT32, UINT32, PRtpPacket, UINT32);
 
+#ifdef SUPPORT_SHARE_BUFFER
+// Same as createPayloadForH264, except that NALUs are not copied into payloadBuffer. Only FU-A headers are written.
+STATUS createPayloadRefForH264(UINT32, PBYTE, UINT32, PBYTE, PUINT32, PUINT32, PUINT32);
+
+// Max number of packets of a frame that are encrypted by one call of encryptRtpPackets
+#define RTP_ENCRYPT_BATCH_SIZE 16
+
+struct __SrtpSession;
+// Encrypt packets in place with the transmit session, where each length is updated to the encrypted length. It's implemented in
+// SrtpSession.c.
+STATUS encryptRtpPackets(struct __SrtpSession*, PVOID*, PINT32, UINT32);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
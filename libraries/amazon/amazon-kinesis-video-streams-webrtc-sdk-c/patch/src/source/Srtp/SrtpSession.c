@@ -142,6 +142,30 @@ CleanUp:
     return retStatus;
 }
 
+STATUS encryptRtpPackets(PSrtpSession pSrtpSession, PVOID* pMessages, PINT32 pLens, UINT32 count)
+{
+    ENTERS();
+    STATUS retStatus = STATUS_SUCCESS;
+    srtp_err_status_t status = srtp_err_status_ok;
+    srtp_t transmitSession = NULL;
+    UINT32 i = 0;
+
+    CHK(pSrtpSession != NULL && pMessages != NULL && pLens != NULL, STATUS_NULL_ARG);
+
+    // Packets of a frame share the session and its stream, which stay in cache while they are protected back to back
+    transmitSession = pSrtpSession->srtp_transmit_session;
+    for (i = 0; i < count && status == srtp_err_status_ok; i++) {
+        status = srtp_protect(transmitSession, pMessages[i], &pLens[i]);
+    }
+
+    CHK_ERR(status == srtp_err_status_ok, STATUS_SRTP_ENCRYPT_FAILED, "srtp_protect returned %lu for packet %u on srtp session %" PRIu64, status,
+            i - 1, transmitSession);
+
+CleanUp:
+    LEAVES();
+    return retStatus;
+}
+
 STATUS encryptRtcpPacket(PSrtpSession pSrtpSession, PVOID message, PINT32 len)
 {
     ENTERS();
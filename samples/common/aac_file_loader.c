@@ -51,9 +51,31 @@ typedef struct AacFileLoader
     bool bKeepRotate;
     bool bStopLoading;
 
+    /* Mappings of files from the start index to the end index, which are mapped once they're loaded */
+    bool bMapFiles;
+    FileMapping_t *pxMappings;
+
     AudioTrackInfo_t xAudioTrackInfo;
 } AacFileLoader_t;
 
+static int mapFrame(AacFileLoader_t *pLoader, char *pcFilename, char **ppData, size_t *puDataLen)
+{
+    int res = ERRNO_NONE;
+    FileMapping_t *pxMapping = &(pLoader->pxMappings[pLoader->xFileCurrentIdx - pLoader->xFileStartIdx]);
+
+    if (pxMapping->pData == NULL && mapFile(pcFilename, pxMapping) != 0)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        *ppData = pxMapping->pData;
+        *puDataLen = pxMapping->uDataLen;
+    }
+
+    return res;
+}
+
 static int loadFrame(AacFileLoader_t *pLoader, char **ppData, size_t *puDataLen)
 {
     int res = ERRNO_NONE;
@@ -79,6 +101,14 @@ static int loadFrame(AacFileLoader_t *pLoader, char **ppData, size_t *puDataLen)
         printf("Unable to setup filename\r\n");
         res = ERRNO_FAIL;
     }
+    else if (pLoader->bMapFiles)
+    {
+        if (mapFrame(pLoader, pcFilename, ppData, puDataLen) != 0)
+        {
+            printf("Unable to map data frame: %s\r\n", pcFilename);
+            res = ERRNO_FAIL;
+        }
+    }
     else if (getFileSize(pcFilename, &uDataLen) != 0 || (pData = (char *)malloc(uDataLen)) == NULL || readFile(pcFilename, pData, uDataLen, &uDataLen) != 0)
     {
         printf("Unable to load data frame: %s\r\n", pcFilename);
@@ -134,7 +164,8 @@ AacFileLoaderHandle AacFileLoaderCreate(FileLoaderPara_t *pFileLoaderPara, Mpeg4
     AacFileLoader_t *pLoader = NULL;
     size_t uStLen = 0;
 
-    if (pFileLoaderPara == NULL || pFileLoaderPara->pcTrackName == NULL || pFileLoaderPara->pcFileFormat == NULL || pFileLoaderPara->xFileStartIdx < 0)
+    if (pFileLoaderPara == NULL || pFileLoaderPara->pcTrackName == NULL || pFileLoaderPara->pcFileFormat == NULL || pFileLoaderPara->xFileStartIdx < 0 ||
+        (pFileLoaderPara->bMapFiles && pFileLoaderPara->xFileEndIdx < pFileLoaderPara->xFileStartIdx))
     {
         printf("Invalid H264 File Loader arguments while creating\r\n");
         res = ERRNO_FAIL;
@@ -168,7 +199,14 @@ AacFileLoaderHandle AacFileLoaderCreate(FileLoaderPara_t *pFileLoaderPara, Mpeg4
             pLoader->xFileEndIdx = pFileLoaderPara->xFileEndIdx;
             pLoader->bKeepRotate = pFileLoaderPara->bKeepRotate;
             pLoader->bStopLoading = false;
-            if (initializeAudioTrackInfo(pLoader, xObjectType, uFrequency, uChannelNumber) != 0)
+            pLoader->bMapFiles = pFileLoaderPara->bMapFiles;
+            if (pLoader->bMapFiles &&
+                (pLoader->pxMappings = (FileMapping_t *)calloc(pLoader->xFileEndIdx - pLoader->xFileStartIdx + 1, sizeof(FileMapping_t))) == NULL)
+            {
+                printf("OOM: pxMappings in AAC File Loader\r\n");
+                res = ERRNO_FAIL;
+            }
+            else if (initializeAudioTrackInfo(pLoader, xObjectType, uFrequency, uChannelNumber) != 0)
             {
                 printf("Failed to initialize video track info\r\n");
                 res = ERRNO_FAIL;
@@ -188,9 +226,18 @@ AacFileLoaderHandle AacFileLoaderCreate(FileLoaderPara_t *pFileLoaderPara, Mpeg4
 void AacFileLoaderTerminate(AacFileLoaderHandle xLoader)
 {
     AacFileLoader_t *pLoader = xLoader;
+    int i = 0;
 
     if (pLoader != NULL)
     {
+        if (pLoader->pxMappings != NULL)
+        {
+            for (i = 0; i <= pLoader->xFileEndIdx - pLoader->xFileStartIdx; i++)
+            {
+                unmapFile(&(pLoader->pxMappings[i]));
+            }
+            SAFE_FREE(pLoader->pxMappings);
+        }
         SAFE_FREE(pLoader->xAudioTrackInfo.pCodecPrivate);
         SAFE_FREE(pLoader->pcTrackName);
         SAFE_FREE(pLoader->pcFileFormat);
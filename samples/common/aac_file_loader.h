@@ -44,7 +44,7 @@ AacFileLoaderHandle AacFileLoaderCreate(FileLoaderPara_t *pFileLoaderPara, Mpeg4
 void AacFileLoaderTerminate(AacFileLoaderHandle xLoader);
 
 /**
- * @brief Load a AAC file into a memory allocated pointer
+ * @brief Load a AAC file into a memory allocated pointer, or a slice of its mapping if bMapFiles is set
  *
  * @param[in] xLoader handle of AAC file loader
  * @param[out] ppData AAC frame pointer
@@ -15,6 +15,16 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
 
 #include "file_io.h"
 
@@ -95,4 +105,86 @@ int readFile(char *pcFilename, char *pBuf, size_t uBufSize, size_t *puBytesRead)
     fclose(fp);
 
     return res;
-}
\ No newline at end of file
+}
+
+int mapFile(char *pcFilename, FileMapping_t *pxMapping)
+{
+    int res = ERRNO_NONE;
+#ifdef HAVE_MMAP
+    int fd = -1;
+    struct stat xStat;
+    void *pData = MAP_FAILED;
+#else
+    size_t uFileSize = 0;
+    char *pData = NULL;
+#endif /* HAVE_MMAP */
+
+    if (pcFilename == NULL || pxMapping == NULL)
+    {
+        printf("Invalid filename\r\n");
+        res = ERRNO_FAIL;
+    }
+#ifdef HAVE_MMAP
+    else if ((fd = open(pcFilename, O_RDONLY)) < 0)
+    {
+        printf("Failed to open file: %s\r\n", pcFilename);
+        res = ERRNO_FAIL;
+    }
+    else if (fstat(fd, &xStat) != 0 || xStat.st_size <= 0)
+    {
+        printf("Failed to calculate file size\r\n");
+        res = ERRNO_FAIL;
+    }
+    else if ((pData = mmap(NULL, (size_t)(xStat.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        printf("Failed to map file: %s\r\n", pcFilename);
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        pxMapping->pData = (char *)pData;
+        pxMapping->uDataLen = (size_t)(xStat.st_size);
+        pxMapping->bIsMapped = true;
+    }
+
+    /* The mapping stays valid after the file is closed. */
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#else
+    else if (getFileSize(pcFilename, &uFileSize) != 0 || uFileSize == 0 || (pData = (char *)malloc(uFileSize)) == NULL ||
+             readFile(pcFilename, pData, uFileSize, &uFileSize) != 0)
+    {
+        printf("Failed to load file: %s\r\n", pcFilename);
+        free(pData);
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        pxMapping->pData = pData;
+        pxMapping->uDataLen = uFileSize;
+        pxMapping->bIsMapped = false;
+    }
+#endif /* HAVE_MMAP */
+
+    return res;
+}
+
+void unmapFile(FileMapping_t *pxMapping)
+{
+    if (pxMapping != NULL && pxMapping->pData != NULL)
+    {
+#ifdef HAVE_MMAP
+        if (pxMapping->bIsMapped)
+        {
+            munmap(pxMapping->pData, pxMapping->uDataLen);
+        }
+        else
+#endif /* HAVE_MMAP */
+        {
+            free(pxMapping->pData);
+        }
+        memset(pxMapping, 0, sizeof(FileMapping_t));
+    }
+}
@@ -16,8 +16,18 @@
 #ifndef FILE_IO_H
 #define FILE_IO_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
+typedef struct FileMapping
+{
+    char *pData;
+    size_t uDataLen;
+
+    /* It's true if pData is mapped from the file, or false if it's a memory allocated copy of the file. */
+    bool bIsMapped;
+} FileMapping_t;
+
 /**
  * @brief Get filesize by given a filename
  *
@@ -38,4 +48,23 @@ int getFileSize(char *pcFilename, size_t *puFileSize);
  */
 int readFile(char *pcFilename, char *pBuf, size_t uBufSize, size_t *puBytesRead);
 
+/**
+ * @brief Map a whole file into memory
+ *
+ * The file is mapped privately, so it can be modified in place without changing the file. A memory allocated copy of
+ * the file is made on platforms without mmap.
+ *
+ * @param[in] pcFilename filename
+ * @param[out] pxMapping the mapping of the file
+ * @return 0 on success, non-zero value otherwise
+ */
+int mapFile(char *pcFilename, FileMapping_t *pxMapping);
+
+/**
+ * @brief Unmap a file mapped by mapFile, and reset the mapping
+ *
+ * @param[in] pxMapping the mapping of the file
+ */
+void unmapFile(FileMapping_t *pxMapping);
+
 #endif /* FILE_IO_H */
\ No newline at end of file
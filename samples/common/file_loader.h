@@ -16,6 +16,8 @@
 #ifndef FILE_LOADER_H
 #define FILE_LOADER_H
 
+#include <stdbool.h>
+
 typedef struct FileLoaderPara
 {
     char *pcTrackName;
@@ -23,6 +25,10 @@ typedef struct FileLoaderPara
     int xFileStartIdx;
     int xFileEndIdx;
     bool bKeepRotate;
+
+    /* Set to true to map each file once, and load frames as slices of the mappings without copy. Frames are owned by
+     * the loader and valid until it's terminated, so they must not be freed. It needs an end index. */
+    bool bMapFiles;
 } FileLoaderPara_t;
 
 #endif /* FILE_LOADER_H */
\ No newline at end of file
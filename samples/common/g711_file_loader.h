@@ -44,7 +44,7 @@ G711FileLoaderHandle G711FileLoaderCreate(FileLoaderPara_t *pFileLoaderPara, Pcm
 void G711FileLoaderTerminate(G711FileLoaderHandle xLoader);
 
 /**
- * @brief Load a G711 file into a memory allocated pointer
+ * @brief Load a G711 file into a memory allocated pointer, or a slice of its mapping if bMapFiles is set
  *
  * @param[in] xLoader handle of G711 file loader
  * @param[out] ppData G711 frame pointer
@@ -53,9 +53,75 @@ typedef struct H264FileLoader
     bool bKeepRotate;
     bool bStopLoading;
 
+    /* Mappings of files from the start index to the end index, which are mapped once they're loaded */
+    bool bMapFiles;
+    FileMapping_t *pxMappings;
+
     VideoTrackInfo_t xVideoTrackInfo;
 } H264FileLoader_t;
 
+static int convertMappingToAvcc(FileMapping_t *pxMapping)
+{
+    int res = ERRNO_NONE;
+    NaluFrameInfo_t xFrameInfo = {0};
+    FileMapping_t xCopy = {0};
+    uint32_t uAvccLen = 0;
+
+    if (NALU_analyzeFrame((uint8_t *)(pxMapping->pData), (uint32_t)(pxMapping->uDataLen), false, &xFrameInfo) != 0)
+    {
+        res = ERRNO_FAIL;
+    }
+    else if (!xFrameInfo.bIsAnnexB)
+    {
+        /* nop */
+    }
+    else if (xFrameInfo.uAvccLen > pxMapping->uDataLen && (xCopy.pData = (char *)malloc(xFrameInfo.uAvccLen)) == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        /* A frame that grows when it's converted is copied once, and the rest are converted in their mappings. */
+        if (xCopy.pData != NULL)
+        {
+            memcpy(xCopy.pData, pxMapping->pData, pxMapping->uDataLen);
+            xCopy.uDataLen = pxMapping->uDataLen;
+            unmapFile(pxMapping);
+            *pxMapping = xCopy;
+        }
+
+        if (NALU_convertAnnexBToAvccInPlace((uint8_t *)(pxMapping->pData), (uint32_t)(pxMapping->uDataLen), xFrameInfo.uAvccLen, &uAvccLen) != 0)
+        {
+            res = ERRNO_FAIL;
+        }
+        else
+        {
+            pxMapping->uDataLen = uAvccLen;
+        }
+    }
+
+    return res;
+}
+
+static int mapFrame(H264FileLoader_t *pLoader, char *pcFilename, char **ppData, size_t *puDataLen)
+{
+    int res = ERRNO_NONE;
+    FileMapping_t *pxMapping = &(pLoader->pxMappings[pLoader->xFileCurrentIdx - pLoader->xFileStartIdx]);
+
+    if (pxMapping->pData == NULL && (mapFile(pcFilename, pxMapping) != 0 || convertMappingToAvcc(pxMapping) != 0))
+    {
+        unmapFile(pxMapping);
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        *ppData = pxMapping->pData;
+        *puDataLen = pxMapping->uDataLen;
+    }
+
+    return res;
+}
+
 static int loadFrame(H264FileLoader_t *pLoader, char **ppData, size_t *puDataLen)
 {
     int res = ERRNO_NONE;
@@ -81,6 +147,14 @@ static int loadFrame(H264FileLoader_t *pLoader, char **ppData, size_t *puDataLen
         printf("Unable to setup filename\r\n");
         res = ERRNO_FAIL;
     }
+    else if (pLoader->bMapFiles)
+    {
+        if (mapFrame(pLoader, pcFilename, ppData, puDataLen) != 0)
+        {
+            printf("Unable to map data frame: %s\r\n", pcFilename);
+            res = ERRNO_FAIL;
+        }
+    }
     else if (
         getFileSize(pcFilename, &uDataLen) != 0 || (pData = (char *)malloc(uDataLen + ANNEXB_TO_AVCC_EXTRA_MEMSIZE)) == NULL ||
         readFile(pcFilename, pData, uDataLen + ANNEXB_TO_AVCC_EXTRA_MEMSIZE, &uDataLen) != 0)
@@ -157,7 +231,10 @@ static int initializeVideoTrackInfo(H264FileLoader_t *pLoader)
                     bVideoTrackInfoInitialized = true;
                 }
 
-                free(pData);
+                if (!pLoader->bMapFiles)
+                {
+                    free(pData);
+                }
             }
         }
 
@@ -173,7 +250,8 @@ H264FileLoaderHandle H264FileLoaderCreate(FileLoaderPara_t *pFileLoaderPara)
     H264FileLoader_t *pLoader = NULL;
     size_t uStLen = 0;
 
-    if (pFileLoaderPara == NULL || pFileLoaderPara->pcTrackName == NULL || pFileLoaderPara->pcFileFormat == NULL || pFileLoaderPara->xFileStartIdx < 0)
+    if (pFileLoaderPara == NULL || pFileLoaderPara->pcTrackName == NULL || pFileLoaderPara->pcFileFormat == NULL || pFileLoaderPara->xFileStartIdx < 0 ||
+        (pFileLoaderPara->bMapFiles && pFileLoaderPara->xFileEndIdx < pFileLoaderPara->xFileStartIdx))
     {
         printf("Invalid H264 File Loader arguments while creating\r\n");
         res = ERRNO_FAIL;
@@ -207,7 +285,14 @@ H264FileLoaderHandle H264FileLoaderCreate(FileLoaderPara_t *pFileLoaderPara)
             pLoader->xFileEndIdx = pFileLoaderPara->xFileEndIdx;
             pLoader->bKeepRotate = pFileLoaderPara->bKeepRotate;
             pLoader->bStopLoading = false;
-            if (initializeVideoTrackInfo(pLoader) != 0)
+            pLoader->bMapFiles = pFileLoaderPara->bMapFiles;
+            if (pLoader->bMapFiles &&
+                (pLoader->pxMappings = (FileMapping_t *)calloc(pLoader->xFileEndIdx - pLoader->xFileStartIdx + 1, sizeof(FileMapping_t))) == NULL)
+            {
+                printf("OOM: pxMappings in H264 File Loader\r\n");
+                res = ERRNO_FAIL;
+            }
+            else if (initializeVideoTrackInfo(pLoader) != 0)
             {
                 printf("Failed to initialize video track info\r\n");
                 res = ERRNO_FAIL;
@@ -227,9 +312,18 @@ H264FileLoaderHandle H264FileLoaderCreate(FileLoaderPara_t *pFileLoaderPara)
 void H264FileLoaderTerminate(H264FileLoaderHandle xLoader)
 {
     H264FileLoader_t *pLoader = xLoader;
+    int i = 0;
 
     if (pLoader != NULL)
     {
+        if (pLoader->pxMappings != NULL)
+        {
+            for (i = 0; i <= pLoader->xFileEndIdx - pLoader->xFileStartIdx; i++)
+            {
+                unmapFile(&(pLoader->pxMappings[i]));
+            }
+            SAFE_FREE(pLoader->pxMappings);
+        }
         SAFE_FREE(pLoader->xVideoTrackInfo.pCodecPrivate);
         SAFE_FREE(pLoader->pcTrackName);
         SAFE_FREE(pLoader->pcFileFormat);
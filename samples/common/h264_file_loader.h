@@ -37,7 +37,7 @@ H264FileLoaderHandle H264FileLoaderCreate(FileLoaderPara_t *pFileLoaderPara);
 void H264FileLoaderTerminate(H264FileLoaderHandle xLoader);
 
 /**
- * @brief Load a H264 file into a memory allocated pointer
+ * @brief Load a H264 file into a memory allocated pointer, or a slice of its mapping if bMapFiles is set
  *
  * @param[in] xLoader handle of the H264 file loader
  * @param[out] ppData H264 frame pointer
@@ -49,6 +49,11 @@
 #define ISP_HW_SLOT         1
 #define VIDEO_OUTPUT_BUFFER_SIZE    ( VIDEO_HEIGHT * VIDEO_WIDTH / 10 )
 
+/* The encoder writes frames into this ring, and the stream sends them from where they are. It holds the frames that
+ * the stream buffers, the one being encoded, and the gap left when a frame doesn't fit at the end. */
+#define VIDEO_RING_SIZE     ( STREAM_MAX_BUFFERING_SIZE + 2 * VIDEO_OUTPUT_BUFFER_SIZE )
+#define VIDEO_RING_ALIGN(x) ( ( ( x ) + 7 ) & ~( ( size_t ) 7 ) )
+
 #if ENABLE_AUDIO_TRACK
 #define AUDIO_DMA_PAGE_NUM 2
 #define AUDIO_DMA_PAGE_SIZE ( 2 * 1024 )
@@ -74,6 +79,24 @@ typedef struct isp_s
     xQueueHandle output_recycle;
 } isp_t;
 
+typedef struct VideoRingHdr
+{
+    uint32_t uLen;
+    uint32_t bReleased;
+} VideoRingHdr_t;
+
+/* Frames are allocated at the tail and released in any order, and the head moves past the released ones. */
+typedef struct VideoRing
+{
+    uint8_t *pBuf;
+    size_t uHead;
+    size_t uTail;
+    size_t uUsed;
+    SemaphoreHandle_t xLock;
+} VideoRing_t;
+
+static VideoRing_t xVideoRing;
+
 typedef struct Kvs
 {
 #if ENABLE_IOT_CREDENTIAL
@@ -130,6 +153,126 @@ void isp_frame_cb(void* p)
         taskYIELD ();
 }
 
+static int videoRingInit(void)
+{
+    int res = ERRNO_NONE;
+
+    memset(&xVideoRing, 0, sizeof(VideoRing_t));
+    if ((xVideoRing.pBuf = (uint8_t *)malloc(VIDEO_RING_SIZE)) == NULL)
+    {
+        printf("OOM: xVideoRing.pBuf\r\n");
+        res = ERRNO_FAIL;
+    }
+    else if ((xVideoRing.xLock = xSemaphoreCreateMutex()) == NULL)
+    {
+        printf("Failed to create video ring lock\r\n");
+        res = ERRNO_FAIL;
+    }
+
+    return res;
+}
+
+/* Get room for the encoder to write a frame of at most uMaxLen bytes. It's not taken until videoRingCommit(). */
+static uint8_t *videoRingAlloc(size_t uMaxLen)
+{
+    VideoRingHdr_t *pHdr = NULL;
+    size_t uNeed = sizeof(VideoRingHdr_t) + VIDEO_RING_ALIGN(uMaxLen);
+    size_t uOffset = VIDEO_RING_SIZE;
+    uint8_t *pData = NULL;
+
+    xSemaphoreTake(xVideoRing.xLock, portMAX_DELAY);
+    if (xVideoRing.uUsed == 0)
+    {
+        xVideoRing.uHead = xVideoRing.uTail = 0;
+    }
+
+    if (xVideoRing.uTail > xVideoRing.uHead || xVideoRing.uUsed == 0)
+    {
+        if (VIDEO_RING_SIZE - xVideoRing.uTail >= uNeed)
+        {
+            uOffset = xVideoRing.uTail;
+        }
+        else if (xVideoRing.uHead >= uNeed)
+        {
+            /* The end of the ring is left as a released gap, and the frame goes to the beginning. */
+            pHdr = (VideoRingHdr_t *)(xVideoRing.pBuf + xVideoRing.uTail);
+            pHdr->uLen = VIDEO_RING_SIZE - xVideoRing.uTail - sizeof(VideoRingHdr_t);
+            pHdr->bReleased = 1;
+            xVideoRing.uUsed += VIDEO_RING_SIZE - xVideoRing.uTail;
+            xVideoRing.uTail = 0;
+            uOffset = 0;
+        }
+    }
+    else if (xVideoRing.uTail < xVideoRing.uHead && xVideoRing.uHead - xVideoRing.uTail >= uNeed)
+    {
+        uOffset = xVideoRing.uTail;
+    }
+
+    if (uOffset != VIDEO_RING_SIZE)
+    {
+        pData = xVideoRing.pBuf + uOffset + sizeof(VideoRingHdr_t);
+    }
+    xSemaphoreGive(xVideoRing.xLock);
+
+    return pData;
+}
+
+/* Take the room of a frame of uLen bytes that is written at pData. */
+static void videoRingCommit(uint8_t *pData, size_t uLen)
+{
+    VideoRingHdr_t *pHdr = (VideoRingHdr_t *)(pData - sizeof(VideoRingHdr_t));
+
+    xSemaphoreTake(xVideoRing.xLock, portMAX_DELAY);
+    pHdr->uLen = VIDEO_RING_ALIGN(uLen);
+    pHdr->bReleased = 0;
+    xVideoRing.uTail = (uint8_t *)pHdr - xVideoRing.pBuf + sizeof(VideoRingHdr_t) + pHdr->uLen;
+    xVideoRing.uUsed += sizeof(VideoRingHdr_t) + pHdr->uLen;
+    if (xVideoRing.uTail == VIDEO_RING_SIZE)
+    {
+        xVideoRing.uTail = 0;
+    }
+    xSemaphoreGive(xVideoRing.xLock);
+}
+
+static void videoRingRelease(uint8_t *pData)
+{
+    VideoRingHdr_t *pHdr = (VideoRingHdr_t *)(pData - sizeof(VideoRingHdr_t));
+
+    xSemaphoreTake(xVideoRing.xLock, portMAX_DELAY);
+    pHdr->bReleased = 1;
+    while (xVideoRing.uUsed > 0)
+    {
+        pHdr = (VideoRingHdr_t *)(xVideoRing.pBuf + xVideoRing.uHead);
+        if (!pHdr->bReleased)
+        {
+            break;
+        }
+        xVideoRing.uHead += sizeof(VideoRingHdr_t) + pHdr->uLen;
+        xVideoRing.uUsed -= sizeof(VideoRingHdr_t) + pHdr->uLen;
+        if (xVideoRing.uHead == VIDEO_RING_SIZE)
+        {
+            xVideoRing.uHead = 0;
+        }
+    }
+    xSemaphoreGive(xVideoRing.xLock);
+}
+
+/* Video frames are sent from the ring, and audio frames are allocated by the audio thread. */
+static void dataFrameRelease(DataFrameHandle xDataFrameHandle)
+{
+    DataFrameIn_t *pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+
+    if (pDataFrameIn->xTrackType == TRACK_VIDEO)
+    {
+        videoRingRelease((uint8_t *)pDataFrameIn->pData);
+    }
+    else
+    {
+        free(pDataFrameIn->pData);
+    }
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+}
+
 int KvsVideoInitTrackInfo(VIDEO_BUFFER *pVideoBuf, Kvs_t *pKvs)
 {
     int res = ERRNO_NONE;
@@ -204,31 +347,24 @@ static void sendVideoFrame(VIDEO_BUFFER *pBuffer, Kvs_t *pKvs)
                 printf("Failed to convert Annex-B to AVCC\r\n");
                 res = ERRNO_FAIL;
             }
-            else if ((xDataFrameIn.pData = (char *)malloc(uAvccLen)) == NULL)
-            {
-                printf("OOM: xDataFrameIn.pData\r\n");
-                res = ERRNO_FAIL;
-            }
             else if (Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotal) != 0)
             {
                 printf("Failed to get stream mem state\r\n");
             }
-            else
+            else if (uMemTotal < STREAM_MAX_BUFFERING_SIZE)
             {
-                if (uMemTotal < STREAM_MAX_BUFFERING_SIZE)
-                {
-                    memcpy(xDataFrameIn.pData, pBuffer->output_buffer, uAvccLen);
-                    xDataFrameIn.uDataLen = uAvccLen;
+                /* The frame is sent from the encoder's output buffer, which is released when the data frame is. */
+                videoRingCommit(pBuffer->output_buffer, uAvccLen);
+                xDataFrameIn.pData = (char *)pBuffer->output_buffer;
+                xDataFrameIn.uDataLen = uAvccLen;
 
-                    Kvs_streamAddDataFrame(pKvs->xStreamHandle, &xDataFrameIn);
-                }
-                else
+                if (Kvs_streamAddDataFrame(pKvs->xStreamHandle, &xDataFrameIn) == NULL)
                 {
-                    free(xDataFrameIn.pData);
+                    videoRingRelease(pBuffer->output_buffer);
                 }
             }
         }
-        free(pBuffer->output_buffer);
+        /* A frame that is not committed leaves its room to the next one. */
     }
 
 }
@@ -244,6 +380,11 @@ static void camera_thread(void *param)
 
     vTaskDelay( 2000 / portTICK_PERIOD_MS );
 
+    if (videoRingInit() != ERRNO_NONE)
+    {
+        vTaskDelete( NULL );
+    }
+
     printf("[H264] init video related settings\n\r");
     
     memset(&isp_init_cfg, 0, sizeof(isp_init_cfg));
@@ -351,18 +492,16 @@ static void camera_thread(void *param)
             continue;
         }
 
-        // [H264] encode data
+        // [H264] encode data into the ring, or skip the frame if the stream still holds all of it
         video_buf.output_buffer_size = VIDEO_OUTPUT_BUFFER_SIZE;
-        video_buf.output_buffer = malloc( VIDEO_OUTPUT_BUFFER_SIZE );
+        video_buf.output_buffer = videoRingAlloc( VIDEO_OUTPUT_BUFFER_SIZE );
         if (video_buf.output_buffer== NULL) {
-            printf("Allocate output buffer fail\n\r");
+            xQueueSend(isp_ctx.output_recycle, &isp_buf, 10);
             continue;
         }
         ret = h264_encode_frame(h264_ctx, &isp_buf, &video_buf);
         if (ret != H264_OK) {
             printf("\n\rh264_encode_frame err %d\n\r",ret);
-            if (video_buf.output_buffer != NULL)
-                free(video_buf.output_buffer);
             continue;
         }
         enc_cnt++;
@@ -386,11 +525,6 @@ static void camera_thread(void *param)
                 }
                 sendVideoFrame(&video_buf, pKvs);
             }
-            else
-            {
-                if (video_buf.output_buffer != NULL)
-                    free(video_buf.output_buffer);
-            }
         }
     }
     
@@ -458,7 +592,6 @@ int KvsAudioInitTrackInfo(Kvs_t *pKvs)
 static void audio_thread(void *param)
 {
     uint8_t *pAudioRxBuffer = NULL;
-    uint8_t *pAudioFrame = NULL;
     DataFrameIn_t xDataFrameIn = {0};
     Kvs_t *pKvs = (Kvs_t *)param;
     size_t uMemTotal = 0;
@@ -492,16 +625,6 @@ static void audio_thread(void *param)
     {
         xQueueReceive(audioQueue, &pAudioRxBuffer, portMAX_DELAY);
 
-        pAudioFrame = (uint8_t *)malloc(RX_PAGE_SIZE);
-        if( pAudioFrame == NULL )
-        {
-            printf("OOM: pAudioFrame\r\n");
-            continue;
-        }
-
-        memcpy(pAudioFrame, pAudioRxBuffer, RX_PAGE_SIZE);
-        audio_set_rx_page(&audio);
-
         memset(&xDataFrameIn, 0, sizeof(DataFrameIn_t));
         xDataFrameIn.bIsKeyFrame = false;
         xDataFrameIn.uTimestampMs = getEpochTimestampInMs();
@@ -512,13 +635,17 @@ static void audio_thread(void *param)
         pAacFrame = (uint8_t *)malloc( max_bytes_output );
         if( pAacFrame == NULL )
         {
-            printf("%s(): out of memory\r\n");
+            printf("OOM: pAacFrame\r\n");
+            audio_set_rx_page(&audio);
             continue;
         }
-        int xFrameSize = aac_encode_run(faac_enc, pAudioFrame, 1024, pAacFrame, max_bytes_output);
+
+        /* The page is encoded where DMA wrote it, and it's handed back right after. A page lasts far longer than the
+         * encoding, so the other page is still being filled meanwhile. */
+        int xFrameSize = aac_encode_run(faac_enc, pAudioRxBuffer, 1024, pAacFrame, max_bytes_output);
+        audio_set_rx_page(&audio);
         xDataFrameIn.pData = (char *)pAacFrame;
         xDataFrameIn.uDataLen = xFrameSize;
-        free(pAudioFrame);
         
         if (Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotal) != 0)
         {
@@ -661,13 +788,10 @@ static int setupDataEndpoint(Kvs_t *pKvs)
 static void streamFlush(StreamHandle xStreamHandle)
 {
     DataFrameHandle xDataFrameHandle = NULL;
-    DataFrameIn_t *pDataFrameIn = NULL;
 
     while ((xDataFrameHandle = Kvs_streamPop(xStreamHandle)) != NULL)
     {
-        pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
-        free(pDataFrameIn->pData);
-        Kvs_dataFrameTerminate(xDataFrameHandle);
+        dataFrameRelease(xDataFrameHandle);
     }
 }
 
@@ -693,9 +817,7 @@ static void streamFlushToNextCluster(StreamHandle xStreamHandle)
             else
             {
                 xDataFrameHandle = Kvs_streamPop(xStreamHandle);
-                pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
-                free(pDataFrameIn->pData);
-                Kvs_dataFrameTerminate(xDataFrameHandle);
+                dataFrameRelease(xDataFrameHandle);
             }
         }
     }
@@ -705,7 +827,6 @@ static int putMediaSendData(Kvs_t *pKvs, int *pxSendCnt)
 {
     int res = 0;
     DataFrameHandle xDataFrameHandle = NULL;
-    DataFrameIn_t *pDataFrameIn = NULL;
     uint8_t *pData = NULL;
     size_t uDataLen = 0;
     uint8_t *pMkvHeader = NULL;
@@ -740,9 +861,7 @@ static int putMediaSendData(Kvs_t *pKvs, int *pxSendCnt)
 
         if (xDataFrameHandle != NULL)
         {
-            pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
-            free(pDataFrameIn->pData);
-            Kvs_dataFrameTerminate(xDataFrameHandle);
+            dataFrameRelease(xDataFrameHandle);
         }
     }
 
@@ -246,7 +246,7 @@ void app_main()
     ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
     prvInitialiseWifi();
 
-    if (xTaskCreate(&aws_task, "aws_task", 4 * 1024, NULL, 5, NULL) != pdPASS) {
+    if (xTaskCreatePinnedToCore(&aws_task, "aws_task", 4 * 1024, NULL, KVS_NETWORK_TASK_PRIORITY, NULL, KVS_NETWORK_TASK_CORE) != pdPASS) {
         printf("create aws task failed\r\n");
     }
 }
\ No newline at end of file
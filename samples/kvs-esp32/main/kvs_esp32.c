@@ -19,11 +19,15 @@
 #include <string.h>
 #include <unistd.h>
 
+/* Headers for ESP-IDF */
+#include "esp_pthread.h"
+
 /* Headers for KVS */
 #include "kvs/kvsapp.h"
 #include "kvs/port.h"
 
 #include "h264_file_loader.h"
+#include "kvs_esp32.h"
 #include "sample_config.h"
 #include "option_configuration.h"
 
@@ -39,13 +43,38 @@
 #define ERRNO_NONE 0
 #define ERRNO_FAIL __LINE__
 
+#define HANDOFF_ATOMIC_LOAD(p)          __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define HANDOFF_ATOMIC_STORE(p, v)      __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+typedef struct FrameHandoffEntry
+{
+    uint8_t *pData;
+    size_t uDataLen;
+    uint64_t uTimestamp;
+} FrameHandoffEntry_t;
+
+/*
+ * A single-producer single-consumer ring of frames from a capture task to the network task. Neither side takes a lock,
+ * so a capture task never waits for the stream lock, which the network task takes while a frame is being sent.
+ */
+typedef struct FrameHandoff
+{
+    FrameHandoffEntry_t xEntries[FRAME_HANDOFF_CAPACITY];
+    TrackType_t xTrackType;
+    uint32_t uHead; /* Written by the capture task only */
+    uint32_t uTail; /* Written by the network task only */
+    uint32_t uDropCount;
+} FrameHandoff_t;
+
 static KvsAppHandle kvsAppHandle = NULL;
 
 static pthread_t videoTid;
 static H264FileLoaderHandle xVideoFileLoader = NULL;
+static FrameHandoff_t xVideoHandoff = {.xTrackType = TRACK_VIDEO};
 
 #if ENABLE_AUDIO_TRACK
 static pthread_t audioTid;
+static FrameHandoff_t xAudioHandoff = {.xTrackType = TRACK_AUDIO};
 #if USE_AUDIO_AAC_SAMPLE
 static AacFileLoaderHandle xAudioFileLoader = NULL;
 #endif /* USE_AUDIO_AAC_SAMPLE */
@@ -87,6 +116,149 @@ static int onMkvSent(uint8_t *pData, size_t uDataLen, void *pAppData)
 }
 #endif
 
+#if ENABLE_MAPPED_FILE_LOADER
+/* Frames are slices of the file mappings, which are owned by the file loaders. */
+static int onMappedFrameTerminate(uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType, void *pAppData)
+{
+    return 0;
+}
+
+static DataFrameCallbacks_t xMappedFrameCallbacks = {
+    .onDataFrameTerminateInfo = {.onDataFrameTerminate = onMappedFrameTerminate},
+};
+#endif /* ENABLE_MAPPED_FILE_LOADER */
+
+static void prvAddFrame(KvsAppHandle kvsAppHandle, uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType)
+{
+#if ENABLE_MAPPED_FILE_LOADER
+    KvsApp_addFrameWithCallbacks(kvsAppHandle, pData, uDataLen, uDataLen, uTimestamp, xTrackType, &xMappedFrameCallbacks);
+#else
+    KvsApp_addFrame(kvsAppHandle, pData, uDataLen, uDataLen, uTimestamp, xTrackType);
+#endif /* ENABLE_MAPPED_FILE_LOADER */
+}
+
+static void prvDropFrame(uint8_t *pData)
+{
+#if !ENABLE_MAPPED_FILE_LOADER
+    /* The frames are allocated by the file loaders, and they're freed by KVS once they're added. */
+    free(pData);
+#endif /* !ENABLE_MAPPED_FILE_LOADER */
+}
+
+/* It's called by the capture task only. The frame is dropped if the network task is too far behind. */
+static void prvHandoffPush(FrameHandoff_t *pxHandoff, uint8_t *pData, size_t uDataLen, uint64_t uTimestamp)
+{
+    uint32_t uHead = pxHandoff->uHead;
+    FrameHandoffEntry_t *pxEntry = NULL;
+
+    if (uHead - HANDOFF_ATOMIC_LOAD(&(pxHandoff->uTail)) >= FRAME_HANDOFF_CAPACITY)
+    {
+        prvDropFrame(pData);
+        pxHandoff->uDropCount++;
+    }
+    else
+    {
+        pxEntry = &(pxHandoff->xEntries[uHead % FRAME_HANDOFF_CAPACITY]);
+        pxEntry->pData = pData;
+        pxEntry->uDataLen = uDataLen;
+        pxEntry->uTimestamp = uTimestamp;
+        HANDOFF_ATOMIC_STORE(&(pxHandoff->uHead), uHead + 1);
+    }
+}
+
+/* It's called by the network task only, and it returns the oldest frame without removing it. */
+static FrameHandoffEntry_t *prvHandoffPeek(FrameHandoff_t *pxHandoff)
+{
+    uint32_t uTail = pxHandoff->uTail;
+
+    return (HANDOFF_ATOMIC_LOAD(&(pxHandoff->uHead)) == uTail) ? NULL : &(pxHandoff->xEntries[uTail % FRAME_HANDOFF_CAPACITY]);
+}
+
+static void prvHandoffPop(FrameHandoff_t *pxHandoff)
+{
+    HANDOFF_ATOMIC_STORE(&(pxHandoff->uTail), pxHandoff->uTail + 1);
+}
+
+/* Frames of both tracks are added to KVS in the order of their timestamps. */
+static void prvHandoffDrain(KvsAppHandle kvsAppHandle)
+{
+    FrameHandoff_t *pxHandoff = NULL;
+    FrameHandoffEntry_t *pxVideo = NULL;
+    FrameHandoffEntry_t *pxEntry = NULL;
+#if ENABLE_AUDIO_TRACK
+    FrameHandoffEntry_t *pxAudio = NULL;
+#endif /* ENABLE_AUDIO_TRACK */
+
+    while (1)
+    {
+        pxHandoff = &xVideoHandoff;
+        pxEntry = pxVideo = prvHandoffPeek(&xVideoHandoff);
+#if ENABLE_AUDIO_TRACK
+        pxAudio = prvHandoffPeek(&xAudioHandoff);
+        if (pxAudio != NULL && (pxVideo == NULL || pxAudio->uTimestamp < pxVideo->uTimestamp))
+        {
+            pxHandoff = &xAudioHandoff;
+            pxEntry = pxAudio;
+        }
+#endif /* ENABLE_AUDIO_TRACK */
+
+        if (pxEntry == NULL)
+        {
+            break;
+        }
+        prvAddFrame(kvsAppHandle, pxEntry->pData, pxEntry->uDataLen, pxEntry->uTimestamp, pxHandoff->xTrackType);
+        prvHandoffPop(pxHandoff);
+    }
+}
+
+/* It's called after the capture task exits. */
+static void prvHandoffClear(FrameHandoff_t *pxHandoff)
+{
+    FrameHandoffEntry_t *pxEntry = NULL;
+
+    while ((pxEntry = prvHandoffPeek(pxHandoff)) != NULL)
+    {
+        prvDropFrame(pxEntry->pData);
+        prvHandoffPop(pxHandoff);
+    }
+
+    if (pxHandoff->uDropCount > 0)
+    {
+        printf("%s frames dropped by the handoff: %u\n", (pxHandoff->xTrackType == TRACK_VIDEO) ? "Video" : "Audio", (unsigned int)pxHandoff->uDropCount);
+        pxHandoff->uDropCount = 0;
+    }
+}
+
+/* Capture tasks are created by pthread, which takes the core and priority from the calling task. */
+static int prvSetCaptureTaskConfig(void)
+{
+    int res = ERRNO_NONE;
+    esp_pthread_cfg_t xCfg = esp_pthread_get_default_config();
+
+    xCfg.pin_to_core = KVS_CAPTURE_TASK_CORE;
+    xCfg.prio = KVS_CAPTURE_TASK_PRIORITY;
+    if (esp_pthread_set_cfg(&xCfg) != ESP_OK)
+    {
+        res = ERRNO_FAIL;
+    }
+
+    return res;
+}
+
+/* It returns the timestamp of the next frame, and it waits for the frame duration unless it's fast forwarding. */
+static uint64_t prvPaceFrame(uint64_t uTimestamp, uint32_t uFps)
+{
+#if ENABLE_FAST_FORWARD
+    return (uTimestamp == 0) ? getEpochTimestampInMs() : uTimestamp + 1000 / uFps;
+#else
+    if (uTimestamp != 0)
+    {
+        sleepInMs(1000 / uFps);
+    }
+    return getEpochTimestampInMs();
+#endif /* ENABLE_FAST_FORWARD */
+}
+
 static void *videoThread(void *arg)
 {
     int res = 0;
@@ -118,11 +290,9 @@ static void *videoThread(void *arg)
             }
             else
             {
-                uTimestamp = getEpochTimestampInMs();
-                KvsApp_addFrame(kvsAppHandle, pData, uDataLen, uDataLen, uTimestamp, TRACK_VIDEO);
+                uTimestamp = prvPaceFrame(uTimestamp, uFps);
+                prvHandoffPush(&xVideoHandoff, pData, uDataLen, uTimestamp);
             }
-
-            sleepInMs(1000 / uFps);
         }
     }
 
@@ -166,11 +336,9 @@ static void *audioThread(void *arg)
             }
             else
             {
-                uTimestamp = getEpochTimestampInMs();
-                KvsApp_addFrame(kvsAppHandle, pData, uDataLen, uDataLen, uTimestamp, TRACK_AUDIO);
+                uTimestamp = prvPaceFrame(uTimestamp, uFps);
+                prvHandoffPush(&xAudioHandoff, pData, uDataLen, uTimestamp);
             }
-
-            sleepInMs(1000 / uFps);
         }
     }
 
@@ -274,6 +442,7 @@ void Kvs_run()
     xVideoFileLoaderParam.xFileStartIdx = H264_FILE_IDX_BEGIN;
     xVideoFileLoaderParam.xFileEndIdx = H264_FILE_IDX_END;
     xVideoFileLoaderParam.bKeepRotate = true;
+    xVideoFileLoaderParam.bMapFiles = ENABLE_MAPPED_FILE_LOADER;
 
 #if ENABLE_AUDIO_TRACK
 #if USE_AUDIO_AAC_SAMPLE
@@ -282,6 +451,7 @@ void Kvs_run()
     xAudioFileLoaderParam.xFileStartIdx = AAC_FILE_IDX_BEGIN;
     xAudioFileLoaderParam.xFileEndIdx = AAC_FILE_IDX_END;
     xAudioFileLoaderParam.bKeepRotate = true;
+    xAudioFileLoaderParam.bMapFiles = ENABLE_MAPPED_FILE_LOADER;
 #endif /* USE_AUDIO_AAC_SAMPLE */
 #if USE_AUDIO_G711_SAMPLE
     xAudioFileLoaderParam.pcTrackName = AUDIO_TRACK_NAME;
@@ -289,6 +459,7 @@ void Kvs_run()
     xAudioFileLoaderParam.xFileStartIdx = G711_FILE_IDX_BEGIN;
     xAudioFileLoaderParam.xFileEndIdx = G711_FILE_IDX_END;
     xAudioFileLoaderParam.bKeepRotate = true;
+    xAudioFileLoaderParam.bMapFiles = ENABLE_MAPPED_FILE_LOADER;
 #endif /* USE_AUDIO_G711_SAMPLE */
 #endif /* ENABLE_AUDIO_TRACK */
 
@@ -317,6 +488,10 @@ void Kvs_run()
     {
         printf("Failed to set options\n");
     }
+    else if (prvSetCaptureTaskConfig() != ERRNO_NONE)
+    {
+        printf("Failed to set capture task config\n");
+    }
     else if (pthread_create(&videoTid, NULL, videoThread, kvsAppHandle) != 0)
     {
         printf("Failed to create video thread\n");
@@ -336,6 +511,8 @@ void Kvs_run()
                 break;
             }
 
+            /* Frames captured while it's connecting are added first. */
+            prvHandoffDrain(kvsAppHandle);
             if (KvsApp_open(kvsAppHandle) != 0)
             {
                 printf("Failed to open KVS app\n");
@@ -349,6 +526,7 @@ void Kvs_run()
                     break;
                 }
 
+                prvHandoffDrain(kvsAppHandle);
                 if (KvsApp_doWork(kvsAppHandle) != 0)
                 {
                     break;
@@ -362,10 +540,10 @@ void Kvs_run()
                     }
                 }
 
-                if (getEpochTimestampInMs() > uLastPrintMemStatTimestamp + 1000)
+                if (getMonotonicTimeInMs() > uLastPrintMemStatTimestamp + 1000)
                 {
                     printf("Buffer memory used: %zu\n", KvsApp_getStreamMemStatTotal(kvsAppHandle));
-                    uLastPrintMemStatTimestamp = getEpochTimestampInMs();
+                    uLastPrintMemStatTimestamp = getMonotonicTimeInMs();
                 }
             }
 
@@ -404,6 +582,17 @@ void Kvs_run()
 
     KvsApp_close(kvsAppHandle);
 
+    pthread_join(videoTid, NULL);
+    prvHandoffClear(&xVideoHandoff);
+#if ENABLE_AUDIO_TRACK
+    pthread_join(audioTid, NULL);
+    prvHandoffClear(&xAudioHandoff);
+#endif /* ENABLE_AUDIO_TRACK */
+
+    /* Frames may be slices of the file loaders, so the loaders are terminated after KVS. */
+    KvsApp_terminate(kvsAppHandle);
+    kvsAppHandle = NULL;
+
     H264FileLoaderTerminate(xVideoFileLoader);
     xVideoFileLoader = NULL;
 
@@ -416,14 +605,6 @@ void Kvs_run()
 #endif /* USE_AUDIO_G711_SAMPLE */
     xAudioFileLoader = NULL;
 #endif /* ENABLE_AUDIO_TRACK */
-
-    pthread_join(videoTid, NULL);
-#if ENABLE_AUDIO_TRACK
-    pthread_join(audioTid, NULL);
-#endif /* ENABLE_AUDIO_TRACK */
-
-    KvsApp_terminate(kvsAppHandle);
-    kvsAppHandle = NULL;
 }
 
 void Kvs_terminate()
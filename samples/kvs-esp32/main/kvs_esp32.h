@@ -16,6 +16,22 @@
 #ifndef KVS_ESP32_H
 #define KVS_ESP32_H
 
+#include "sdkconfig.h"
+
+/* Capture tasks and the network task are pinned to different cores, so TLS encryption never delays capture. */
+#if CONFIG_FREERTOS_UNICORE
+#define KVS_CAPTURE_TASK_CORE           0
+#define KVS_NETWORK_TASK_CORE           0
+#else
+#define KVS_CAPTURE_TASK_CORE           CONFIG_KVS_CAPTURE_TASK_CORE
+#define KVS_NETWORK_TASK_CORE           CONFIG_KVS_NETWORK_TASK_CORE
+#endif /* CONFIG_FREERTOS_UNICORE */
+#define KVS_CAPTURE_TASK_PRIORITY       CONFIG_KVS_CAPTURE_TASK_PRIORITY
+#define KVS_NETWORK_TASK_PRIORITY       CONFIG_KVS_NETWORK_TASK_PRIORITY
+
+/**
+ * Run KVS in the calling task, which is the network task. Capture tasks are created on KVS_CAPTURE_TASK_CORE.
+ */
 void Kvs_run();
 
 void Kvs_terminate();
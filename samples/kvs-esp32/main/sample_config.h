@@ -34,6 +34,18 @@
 #define ENABLE_RING_BUFFER_MEM_LIMIT    1
 #define DEBUG_STORE_MEDIA_TO_FILE       0
 
+/* Set to 1 to map each media file once and send frames right from the mappings, so file I/O is out of the way when
+ * the sample is used as a throughput benchmark. All media files are kept in memory. */
+#define ENABLE_MAPPED_FILE_LOADER       0
+
+/* Set to 1 to send frames as fast as possible instead of pacing them by their FPS. Timestamps still advance by one
+ * frame duration per frame, so they run ahead of the clock. */
+#define ENABLE_FAST_FORWARD             0
+
+/* Frames that each capture task can hand over to the network task before it drops them. It must be a power of 2. Only
+ * pointers are kept, so it's cheap to cover a reconnection. */
+#define FRAME_HANDOFF_CAPACITY          64
+
 /* Video configuration */
 #define H264_FILE_FORMAT                "/sdcard/h264_annexb/frame-%03d.h264"
 #define H264_FILE_IDX_BEGIN             1
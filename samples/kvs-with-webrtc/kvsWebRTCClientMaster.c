@@ -409,6 +409,7 @@ int webrtc_taskAddVideoFrame(uint8_t *pData, size_t uLen, uint64_t uTimestamp, F
     PSampleConfiguration pSampleConfiguration = gSampleConfiguration;
     Frame frame = {0};
     FrameEx frameEx = {0};
+    PRtcRtpTransceiver transceivers[DEFAULT_MAX_CONCURRENT_STREAMING_SESSION];
     STATUS status;
     UINT32 i;
 
@@ -420,11 +421,18 @@ int webrtc_taskAddVideoFrame(uint8_t *pData, size_t uLen, uint64_t uTimestamp, F
         frameEx.onRtpResend = webrtc_onRtpResend;
         frameEx.pAppData = keyHandle;
 
+        /* The frame is packetized once for all viewers, and only SRTP and sending are done for each of them. */
         MUTEX_LOCK(pSampleConfiguration->streamingSessionListReadLock);
         for (i = 0; i < pSampleConfiguration->streamingSessionCount; ++i) {
-            status = writeFrameEx(pSampleConfiguration->sampleStreamingSessionList[i]->pVideoRtcRtpTransceiver, &frame, &frameEx);
+            transceivers[i] = pSampleConfiguration->sampleStreamingSessionList[i]->pVideoRtcRtpTransceiver;
         }
+        status = writeFrameExToTransceivers(transceivers, pSampleConfiguration->streamingSessionCount, &frame, &frameEx);
         MUTEX_UNLOCK(pSampleConfiguration->streamingSessionListReadLock);
+#ifdef VERBOSE
+        if (status != STATUS_SUCCESS) {
+            printf("writeFrameExToTransceivers() failed with 0x%08x\n", status);
+        }
+#endif
     }
 
     return 0;
@@ -24,21 +24,28 @@
 #include <signal.h>
 
 #include "kvs_with_webrtc.h"
+#include "frame_fanout/frame_fanout.h"
 #include "frame_ring_buffer/frame_ring_buffer.h"
 #include "kvs/nalu.h"
+#include "kvs/port.h"
 
 #define ERRNO_NONE      0
 #define ERRNO_FAIL      __LINE__
 
 #define MAX_FILENAME_PATH_SIZE   256
 
-#define ANNEXB_TO_AVCC_EXTRA_BUFSIZE 16
-
 #ifdef KVS_USE_POOL_ALLOCATOR
 #include "kvs/pool_allocator.h"
 static char pMemPool[POOL_ALLOCATOR_SIZE];
 #endif
 
+/* Frames are published to the fan-out by the video source, and KVS and WebRTC receive them from their own sinks. */
+typedef struct VideoPipeline
+{
+    FrameFanoutHandle frameFanoutHandle;
+    FrameRingBufferHandle frameRingBufferHandle;
+} VideoPipeline_t;
+
 /* A global variable to exit program if it's set to true. It can be set to true if signal.h is available and user press Ctrl+c. It can also be set to true via debugger. */
 bool gStopRunning = false;
 
@@ -65,11 +72,6 @@ static void signalHandler(int signum)
     }
 }
 
-static void sleepInMs(uint32_t ms)
-{
-    usleep(ms * 1000);
-}
-
 static uint64_t getTimestampInMs(void)
 {
     struct timeval tv;
@@ -98,12 +100,13 @@ static void *webrtcThread(void *arg)
 #if ENABLE_PRODUCER
 static void *producerThread(void *arg)
 {
+    VideoPipeline_t *pVideoPipeline = (VideoPipeline_t *)arg;
     int argc = 1;
     char *argv[] = { "producer" };
 
     sleepInMs(2000);
     printf("Start %s task\n", argv[0]);
-    producer_main(argc, argv);
+    producer_main(argc, argv, pVideoPipeline->frameFanoutHandle);
     printf("Stop %s task\n", argv[0]);
 
     return NULL;
@@ -112,10 +115,8 @@ static void *producerThread(void *arg)
 
 static int frameDestructor(uint8_t *pData, size_t uLen, FrameKeyHandle keyHandle, void *pAppData)
 {
-    if (pData != NULL)
-    {
-        free(pData);
-    }
+    /* The ring buffer releases its reference, and the frame is freed after the last consumer releases it too. */
+    SharedFrame_release((SharedFrameHandle)pAppData);
 
     return 0;
 }
@@ -144,7 +145,7 @@ static int readFile(char *pfilePath, uint8_t **ppData, size_t *puLen)
         printf("Failed to calculate file size\n");
         res = ERRNO_FAIL;
     }
-    else if ((pData = (uint8_t *)malloc(xFileSize + ANNEXB_TO_AVCC_EXTRA_BUFSIZE)) == NULL)
+    else if ((pData = (uint8_t *)malloc(xFileSize)) == NULL)
     {
         printf("OOM: pData for file %s\n", pfilePath);
         res = ERRNO_FAIL;
@@ -168,38 +169,93 @@ static int readFile(char *pfilePath, uint8_t **ppData, size_t *puLen)
     return res;
 }
 
-static void *videoSourceThread(void *arg)
+#if ENABLE_WEBRTC
+static void *webrtcSinkThread(void *arg)
 {
-    FrameRingBufferHandle frameRingBufferHandle = (FrameRingBufferHandle)arg;
+    VideoPipeline_t *pVideoPipeline = (VideoPipeline_t *)arg;
+    KvsEventHandle wakeEvent = NULL;
+    FrameFanoutSinkHandle sinkHandle = NULL;
+    FrameFanoutFrame_t fanoutFrame = {0};
     FrameKeyHandle frameKeyHandle = NULL;
-    uint64_t uCurrentTimestamp = 0;
-    int xFileIdx = 0;
-    char pFilePath[MAX_FILENAME_PATH_SIZE];
-    uint8_t *pData = NULL;
-    size_t uLen = 0;
+    FrameFanoutSinkParameter_t sinkParameter = {
+        .uQueueLen = WEBRTC_SINK_QUEUE_LEN,
+        .eBackpressure = eFanoutDropOldest,
+        .xWakeEvent = NULL
+    };
     FrameDestructorInfo_t frameDestructorInfo = {
         .frameDestructor = frameDestructor,
         .pAppData = NULL
     };
 
-    while (!gStopRunning)
+    if ((sinkParameter.xWakeEvent = wakeEvent = kvsEventCreate()) == NULL)
     {
-        xFileIdx = xFileIdx % NUMBER_OF_VIDEO_FRAME_FILES + 1;
-        snprintf(pFilePath, MAX_FILENAME_PATH_SIZE, VIDEO_FRAME_FILEPATH_FORMAT, xFileIdx);
-        readFile(pFilePath, &pData, &uLen);
-        uCurrentTimestamp = getTimestampInMs();
+        printf("Failed to create wake event\n");
+    }
+    else if ((sinkHandle = FrameFanout_addSink(pVideoPipeline->frameFanoutHandle, &sinkParameter)) == NULL)
+    {
+        printf("Failed to add WebRTC sink\n");
+    }
+    else
+    {
+        while (!gStopRunning)
+        {
+            kvsEventWait(wakeEvent, WEBRTC_SINK_WAIT_TIMEOUT_MS);
+            while (FrameFanout_receive(pVideoPipeline->frameFanoutHandle, sinkHandle, &fanoutFrame) == 0)
+            {
+                /* The reference of the sink is handed over to the ring buffer, which keeps the frame for NACKs. */
+                frameDestructorInfo.pAppData = fanoutFrame.xFrame;
+                frameKeyHandle = FrameRingBuffer_enqueueEx(
+                    pVideoPipeline->frameRingBufferHandle, fanoutFrame.pAvcc, fanoutFrame.uAvccLen,
+                    fanoutFrame.bIsKeyFrame ? FRAME_RING_BUFFER_FLAG_KEY_FRAME : 0, &frameDestructorInfo);
+
+                webrtc_taskAddVideoFrame(fanoutFrame.pAvcc, fanoutFrame.uAvccLen, fanoutFrame.uTimestampMs, frameKeyHandle);
+
+                if (frameKeyHandle == NULL)
+                {
+                    SharedFrame_release(fanoutFrame.xFrame);
+                }
+            }
+        }
 
-        NALU_convertAnnexBToAvccInPlace(pData, uLen, uLen + ANNEXB_TO_AVCC_EXTRA_BUFSIZE, (uint32_t *)&(uLen));
+        FrameFanout_removeSink(pVideoPipeline->frameFanoutHandle, sinkHandle);
+    }
 
-        frameKeyHandle = FrameRingBuffer_enqueue(frameRingBufferHandle, pData, uLen, &frameDestructorInfo);
+    kvsEventTerminate(wakeEvent);
 
-#if ENABLE_WEBRTC
-        webrtc_taskAddVideoFrame(pData, uLen, uCurrentTimestamp, frameKeyHandle);
+    return NULL;
+}
 #endif /* #if ENABLE_WEBRTC */
 
-#if ENABLE_PRODUCER
-        producer_taskAddVideoFrame(pData, uLen, uCurrentTimestamp, frameKeyHandle);
-#endif /* #if ENABLE_PRODUCER */
+static void *videoSourceThread(void *arg)
+{
+    VideoPipeline_t *pVideoPipeline = (VideoPipeline_t *)arg;
+    SharedFrameHandle sharedFrameHandle = NULL;
+    int xFileIdx = 0;
+    char pFilePath[MAX_FILENAME_PATH_SIZE];
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+
+    while (!gStopRunning)
+    {
+        xFileIdx = xFileIdx % NUMBER_OF_VIDEO_FRAME_FILES + 1;
+        snprintf(pFilePath, MAX_FILENAME_PATH_SIZE, VIDEO_FRAME_FILEPATH_FORMAT, xFileIdx);
+        if (readFile(pFilePath, &pData, &uLen) != ERRNO_NONE)
+        {
+            /* nop */
+        }
+        else if ((sharedFrameHandle = SharedFrame_create(pData, uLen, false, NULL)) == NULL)
+        {
+            free(pData);
+        }
+        else
+        {
+            /* The frame is analyzed once by the fan-out, and every sink shares the same AVCC view of it. */
+            if (FrameFanout_publish(pVideoPipeline->frameFanoutHandle, sharedFrameHandle, getTimestampInMs()) != 0)
+            {
+                printf("Failed to publish frame %s\n", pFilePath);
+            }
+            SharedFrame_release(sharedFrameHandle);
+        }
 
         sleepInMs(1000 / VIDEO_FPS);
     }
@@ -212,7 +268,8 @@ int main(int argc, char *argv[])
     pthread_t videoSourceTid = 0;
     pthread_t producerTid = 0;
     pthread_t webrtcTid = 0;
-    FrameRingBufferHandle frameRingBufferHandle = NULL;
+    pthread_t webrtcSinkTid = 0;
+    VideoPipeline_t videoPipeline = {0};
 
     signal(SIGINT, signalHandler);
 
@@ -221,27 +278,35 @@ int main(int argc, char *argv[])
 #endif
 
     DropFramePolicy_t dropFramePolicy = {0};
-    dropFramePolicy.type = eDropOldest;
+    dropFramePolicy.type = eDropOldestGop;
     dropFramePolicy.u.xDropOldestPolicyParameter.uMaxMem = FRAME_RING_BUFFER_MAX_MEMORY_LIMIT;
 
-    if ((frameRingBufferHandle = FrameRingBuffer_create(FRAME_RING_BUFFER_CAPACITY)) == NULL ||
-        FrameRingBuffer_setDropFramePolicy(frameRingBufferHandle, &dropFramePolicy) != 0)
+    if ((videoPipeline.frameRingBufferHandle = FrameRingBuffer_create(FRAME_RING_BUFFER_CAPACITY)) == NULL ||
+        FrameRingBuffer_setDropFramePolicy(videoPipeline.frameRingBufferHandle, &dropFramePolicy) != 0)
     {
         printf("Failed to create frame ring buffer\n");
     }
+    else if ((videoPipeline.frameFanoutHandle = FrameFanout_create()) == NULL)
+    {
+        printf("Failed to create frame fan-out\n");
+    }
 #if ENABLE_WEBRTC
     else if (pthread_create(&(webrtcTid), NULL, webrtcThread, NULL) != 0)
     {
         printf("Failed to create WebRTC main thread\n");
     }
+    else if (pthread_create(&(webrtcSinkTid), NULL, webrtcSinkThread, &videoPipeline) != 0)
+    {
+        printf("Failed to create WebRTC sink thread\n");
+    }
 #endif /* #if ENABLE_WEBRTC */
 #if ENABLE_PRODUCER
-    else if (pthread_create(&(producerTid), NULL, producerThread, NULL) != 0)
+    else if (pthread_create(&(producerTid), NULL, producerThread, &videoPipeline) != 0)
     {
         printf("Failed to create producer main thread\n");
     }
 #endif /* #if ENABLE_PRODUCER */
-    else if (pthread_create(&videoSourceTid, NULL, videoSourceThread, frameRingBufferHandle) != 0)
+    else if (pthread_create(&videoSourceTid, NULL, videoSourceThread, &videoPipeline) != 0)
     {
         printf("Failed to create video source thread\n");
     }
@@ -269,10 +334,13 @@ int main(int argc, char *argv[])
 #endif /* #if ENABLE_PRODUCER */
 
 #if ENABLE_WEBRTC
+    pthread_join(webrtcSinkTid, NULL);
     pthread_join(webrtcTid, NULL);
 #endif /* #if ENABLE_WEBRTC */
 
-    FrameRingBuffer_terminate(frameRingBufferHandle);
+    /* Sinks are removed by their threads, and then frames kept for NACKs are released. */
+    FrameFanout_terminate(videoPipeline.frameFanoutHandle);
+    FrameRingBuffer_terminate(videoPipeline.frameRingBufferHandle);
 
 #ifdef KVS_USE_POOL_ALLOCATOR
     poolAllocatorDeinit();
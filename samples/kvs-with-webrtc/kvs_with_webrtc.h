@@ -17,11 +17,17 @@
 #define KVS_WITH_WEBRTC_H
 
 #include <stdint.h>
+#include "frame_fanout/frame_fanout.h"
 #include "frame_ring_buffer/frame_ring_buffer.h"
+#include "shared_frame/shared_frame.h"
 
 #define FRAME_RING_BUFFER_CAPACITY  (30 * 3)
 #define FRAME_RING_BUFFER_MAX_MEMORY_LIMIT  (1536 * 1024)
 
+/* WebRTC sends frames right away, so its sink only queues a few frames and drops the oldest ones if it falls behind. */
+#define WEBRTC_SINK_QUEUE_LEN       (8)
+#define WEBRTC_SINK_WAIT_TIMEOUT_MS (100)
+
 #define ENABLE_PRODUCER     (1)
 #define ENABLE_WEBRTC       (1)
 
@@ -48,8 +54,7 @@
 #define VIDEO_FRAME_FILEPATH_FORMAT     "../res/media/h264_annexb/frame-%03d.h264"
 #define VIDEO_FPS                       30
 
-int producer_main(int argc, char *argv[]);
-int producer_taskAddVideoFrame(uint8_t *pData, size_t uLen, uint64_t uTimestamp, FrameKeyHandle keyHandle);
+int producer_main(int argc, char *argv[], FrameFanoutHandle frameFanoutHandle);
 
 int webrtc_main(int argc, char* argv[]);
 int webrtc_taskAddVideoFrame(uint8_t *pData, size_t uLen, uint64_t uTimestamp, FrameKeyHandle keyHandle);
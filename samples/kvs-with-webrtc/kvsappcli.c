@@ -24,7 +24,8 @@
 #include "kvs/kvsapp.h"
 #include "kvs/port.h"
 
-#include "frame_ring_buffer/frame_ring_buffer.h"
+#include "frame_fanout/frame_fanout.h"
+#include "shared_frame/shared_frame.h"
 
 #include "sample_config.h"
 #include "option_configuration.h"
@@ -32,9 +33,14 @@
 #define ERRNO_NONE 0
 #define ERRNO_FAIL __LINE__
 
+/* Frames are queued for KVS while it's connecting, and the oldest GOP is dropped if it can't keep up. */
+#define PRODUCER_SINK_QUEUE_LEN     (30 * 2)
+
+/* The loop waits for frames of the sink up to this long, and then it reads acks. */
+#define PRODUCER_WAIT_TIMEOUT_MS    (50)
+
 /* A global variable to exit program if it's set to true. */
 extern bool gStopRunning;
-static KvsAppHandle gKvsAppHandle = NULL;
 
 static int setKvsAppOptions(KvsAppHandle kvsAppHandle)
 {
@@ -80,9 +86,47 @@ static int setKvsAppOptions(KvsAppHandle kvsAppHandle)
     return res;
 }
 
-int producer_main(int argc, char *argv[])
+static int producer_onDataFrameTerminateCallback(uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType, void *pAppData)
+{
+    /* KVS releases the reference of the sink, so the frame stays valid until it's sent even if the ring buffer drops it. */
+    SharedFrame_release((SharedFrameHandle)pAppData);
+
+    return 0;
+}
+
+static FrameFanoutSinkHandle addSink(FrameFanoutHandle frameFanoutHandle, KvsEventHandle wakeEvent)
+{
+    FrameFanoutSinkParameter_t sinkParameter = {
+        .uQueueLen = PRODUCER_SINK_QUEUE_LEN,
+        .eBackpressure = eFanoutDropOldestGop,
+        .xWakeEvent = wakeEvent
+    };
+
+    return FrameFanout_addSink(frameFanoutHandle, &sinkParameter);
+}
+
+static void addFramesOfSink(KvsAppHandle kvsAppHandle, FrameFanoutHandle frameFanoutHandle, FrameFanoutSinkHandle sinkHandle)
+{
+    FrameFanoutFrame_t fanoutFrame = {0};
+    DataFrameCallbacks_t producerCallbacks = {0};
+
+    producerCallbacks.onDataFrameTerminateInfo.onDataFrameTerminate = producer_onDataFrameTerminateCallback;
+
+    while (FrameFanout_receive(frameFanoutHandle, sinkHandle, &fanoutFrame) == 0)
+    {
+        /* The frame has been analyzed by the fan-out, and its AVCC view is passed as is, so KVS neither parses nor
+         * converts it again. The frame is terminated even if it fails to be added. */
+        producerCallbacks.onDataFrameTerminateInfo.pAppData = fanoutFrame.xFrame;
+        KvsApp_addVideoFrameWithFrameInfo(
+            kvsAppHandle, fanoutFrame.pAvcc, fanoutFrame.uAvccLen, fanoutFrame.uAvccLen, fanoutFrame.uTimestampMs, fanoutFrame.pxFrameInfo, &producerCallbacks);
+    }
+}
+
+int producer_main(int argc, char *argv[], FrameFanoutHandle frameFanoutHandle)
 {
     KvsAppHandle kvsAppHandle = NULL;
+    KvsEventHandle wakeEvent = NULL;
+    FrameFanoutSinkHandle sinkHandle = NULL;
     ePutMediaFragmentAckEventType eAckEventType = eUnknown;
     uint64_t uFragmentTimecode = 0;
     unsigned int uErrorId = 0;
@@ -99,10 +143,16 @@ int producer_main(int argc, char *argv[])
     {
         printf("Failed to set options\n");
     }
+    else if ((wakeEvent = kvsEventCreate()) == NULL || KvsApp_setSharedWakeEvent(kvsAppHandle, wakeEvent) != 0)
+    {
+        printf("Failed to create wake event\n");
+    }
+    else if ((sinkHandle = addSink(frameFanoutHandle, wakeEvent)) == NULL)
+    {
+        printf("Failed to add KVS sink\n");
+    }
     else
     {
-        gKvsAppHandle = kvsAppHandle;
-
         while (!gStopRunning)
         {
             if (KvsApp_open(kvsAppHandle) != 0)
@@ -113,10 +163,13 @@ int producer_main(int argc, char *argv[])
 
             while (!gStopRunning)
             {
+                /* KVS and the sink share the wake event, so the loop wakes up for either new frames or sending. */
+                addFramesOfSink(kvsAppHandle, frameFanoutHandle, sinkHandle);
                 if (KvsApp_doWork(kvsAppHandle) != 0)
                 {
                     break;
                 }
+                kvsEventWait(wakeEvent, PRODUCER_WAIT_TIMEOUT_MS);
 
                 while (KvsApp_readFragmentAck(kvsAppHandle, &eAckEventType, &uFragmentTimecode, &uErrorId) == 0)
                 {
@@ -149,52 +202,13 @@ int producer_main(int argc, char *argv[])
         }
     }
 
-    KvsApp_close(kvsAppHandle);
-
-    gKvsAppHandle = NULL;
+    FrameFanout_removeSink(frameFanoutHandle, sinkHandle);
 
+    KvsApp_close(kvsAppHandle);
+    KvsApp_setSharedWakeEvent(kvsAppHandle, NULL);
     KvsApp_terminate(kvsAppHandle);
 
-    return 0;
-}
+    kvsEventTerminate(wakeEvent);
 
-int producer_onDataFrameTerminateCallback(uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType, void *pAppData)
-{
-    /* Do nothing, this frame will be freed by frame ring buffer. */
     return 0;
 }
-
-static int producer_onDataFrameToBeSent(uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType, void *pAppData)
-{
-    int res = 0;
-    FrameKeyHandle keyHandle = (FrameKeyHandle)pAppData;
-    uint8_t *pRefData = NULL;
-    size_t uRefDataLen = 0;
-
-    res = FrameRingBuffer_getFrame(keyHandle, &pRefData, &uRefDataLen);
-
-    if (res != 0)
-    {
-        res = FrameRingBuffer_getFrame(keyHandle, &pRefData, &uRefDataLen);
-    }
-
-    return res;
-}
-
-int producer_taskAddVideoFrame(uint8_t *pData, size_t uLen, uint64_t uTimestamp, FrameKeyHandle keyHandle)
-{
-    int res = ERRNO_NONE;
-    DataFrameCallbacks_t producerCallbacks = {0};
-
-    if (gKvsAppHandle != NULL)
-    {
-        producerCallbacks.onDataFrameTerminateInfo.onDataFrameTerminate = producer_onDataFrameTerminateCallback;
-        producerCallbacks.onDataFrameTerminateInfo.pAppData = NULL;
-        producerCallbacks.onDataFrameToBeSentInfo.onDataFrameToBeSent = producer_onDataFrameToBeSent;
-        producerCallbacks.onDataFrameToBeSentInfo.pAppData = keyHandle;
-
-        res = KvsApp_addFrameWithCallbacks(gKvsAppHandle, pData, uLen, uLen, uTimestamp, TRACK_VIDEO, &producerCallbacks);
-    }
-
-    return res;
-}
@@ -19,6 +19,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/* The value (int) of this parameter is 0 to encode each sample by segment search instead of the lookup tables, which
+ * is the reference for the tables. The tables are used by default. */
+#define ALAW_ENCODER_PARAM_LOOKUP_TABLE     "lookupTable"
+
 /**
  * Create an PCM a-law encoder.
  *
@@ -29,6 +33,16 @@
  */
 void *AlawEncoder_create(const unsigned int uSampleRate, const unsigned int uChannels, const unsigned int uBitRate);
 
+/**
+ * Create an PCM mu-law encoder. The rest of AlawEncoder functions are used for its handle.
+ *
+ * @param[in] uSampleRate The audio sample rate
+ * @param[in] uChannels The audio channel numbers
+ * @param[in] uBitRate The bit rate. In most cases, one PCM sample is 16 bits long. So it equals uSampleRate * uChannels * 16.
+ * @return The handle of the PCM mu-law encoder.
+ */
+void *MulawEncoder_create(const unsigned int uSampleRate, const unsigned int uChannels, const unsigned int uBitRate);
+
 /**
  * Terminate the PCM a-law encoder
  *
@@ -33,10 +33,45 @@
 #define ENABLE_IOT_CREDENTIAL           0
 #define ENABLE_RING_BUFFER_MEM_LIMIT    1
 #define DEBUG_STORE_MEDIA_TO_FILE       0
+#define ENABLE_BITRATE_ADAPTATION       1
+
+/* Video frames are sent right from the IMP stream buffer, and a stream is released once KVS sends or drops its frame. At
+ * most VIDEO_MAX_HELD_STREAMS streams are held, and the encoder pauses when all of them are held, e.g. while KVS is
+ * reconnecting, so the encoder stream buffer should be sized for them. A frame that wraps around the end of the stream
+ * buffer is copied as before. */
+#define ENABLE_ZERO_COPY_VIDEO          1
+
+#if ENABLE_ZERO_COPY_VIDEO
+#define VIDEO_MAX_HELD_STREAMS          (30)
+#endif /* ENABLE_ZERO_COPY_VIDEO */
 
 #define VIDEO_CODEC_NAME                "V_MPEG4/ISO/AVC"
 #define VIDEO_TRACK_NAME                "kvs video track"
 
+#if ENABLE_BITRATE_ADAPTATION
+/* The range of video bitrate that follows the bitrate hint from KVS */
+#define VIDEO_BITRATE_MIN_KBPS          (256)
+#define VIDEO_BITRATE_MAX_KBPS          (2048)
+#endif /* ENABLE_BITRATE_ADAPTATION */
+
+/* Set to 1 to encode the sub stream of VIDEO_SUB_STREAM_CHN as well, and send it instead of the main stream while the
+ * bitrate hint is below VIDEO_SUB_STREAM_SWITCH_DOWN_KBPS, until the hint is back to VIDEO_SUB_STREAM_SWITCH_UP_KBPS.
+ * Streams are switched at a key frame, and KVS starts a new MKV segment with the parameter sets of the other stream. */
+#define ENABLE_SUB_STREAM_SWITCHING     0
+
+#if ENABLE_SUB_STREAM_SWITCHING
+#if !ENABLE_BITRATE_ADAPTATION
+#error "ENABLE_SUB_STREAM_SWITCHING needs ENABLE_BITRATE_ADAPTATION"
+#endif
+#define VIDEO_SUB_STREAM_CHN                (1)
+#define VIDEO_SUB_STREAM_SWITCH_DOWN_KBPS   (VIDEO_BITRATE_MIN_KBPS)
+#define VIDEO_SUB_STREAM_SWITCH_UP_KBPS     (512)
+
+/* The range of sub stream bitrate that follows the bitrate hint from KVS */
+#define VIDEO_SUB_BITRATE_MIN_KBPS          (64)
+#define VIDEO_SUB_BITRATE_MAX_KBPS          (512)
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
+
 /* Audio configuration */
 #if ENABLE_AUDIO_TRACK
 #define USE_AUDIO_AAC                   1   /* Set to 1 to use AAC as audio track */
@@ -52,13 +87,27 @@
 #endif /* USE_AUDIO_AAC */
 
 #if USE_AUDIO_G711
+#define USE_AUDIO_G711_MULAW            0   /* Set to 1 to use mu-law instead of a-law */
 #define AUDIO_CODEC_NAME                "A_MS/ACM"
+#if USE_AUDIO_G711_MULAW
+#define AUDIO_PCM_OBJECT_TYPE           PCM_FORMAT_CODE_MULAW
+#else
 #define AUDIO_PCM_OBJECT_TYPE           PCM_FORMAT_CODE_ALAW
+#endif /* USE_AUDIO_G711_MULAW */
 #endif /* USE_AUDIO_G711 */
 
 #define AUDIO_TRACK_NAME                "kvs audio track"
 #define AUDIO_FREQUENCY                 8000
 #define AUDIO_CHANNEL_NUMBER            1
+
+/* Encoded audio frames are written into a pool of buffers, and KVS returns a buffer once its frame is sent or dropped.
+ * A frame is encoded into a new buffer freed by KVS when all buffers of the pool are held. */
+#define AUDIO_ENC_BUF_POOL_COUNT        (64)
+
+/* Set to 1 to lace audio frames within AUDIO_LACE_DURATION_MS into one simple block, which delays audio by up to the
+ * duration. Laced frames are copied by KVS, so their buffers are returned to the pool right away. */
+#define ENABLE_AUDIO_LACING             0
+#define AUDIO_LACE_DURATION_MS          (100)
 #endif /* ENABLE_AUDIO_TRACK */
 
 /* IoT credential configuration */
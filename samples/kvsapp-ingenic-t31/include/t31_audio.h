@@ -28,6 +28,14 @@ typedef struct T31Audio *T31AudioHandle;
  */
 T31AudioHandle T31Audio_create(KvsAppHandle kvsAppHandle);
 
+/**
+ * Stop adding frames to KVS. Encode buffers held by KVS are returned to the pool when KVS terminates their frames, so
+ * the KVS app is terminated after this and before T31Audio_terminate().
+ *
+ * @param handle T31 audio handle
+ */
+void T31Audio_stop(T31AudioHandle handle);
+
 /**
  * Terminate T31 audio and its thread.
  *
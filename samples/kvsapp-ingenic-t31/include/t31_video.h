@@ -28,7 +28,15 @@ typedef struct T31Video *T31VideoHandle;
 T31VideoHandle T31Video_create(KvsAppHandle kvsAppHandle);
 
 /**
- * Terminate T31 video and its thread.
+ * Stop adding frames to KVS. Frames held by KVS are returned to the encoder when KVS terminates them, so the KVS app is
+ * terminated after this and before T31Video_terminate().
+ *
+ * @param handle T31 video handle
+ */
+void T31Video_stop(T31VideoHandle handle);
+
+/**
+ * Terminate T31 video and its thread. It's stopped first if it's not stopped yet.
  *
  * @param handle T31 video handle
  */
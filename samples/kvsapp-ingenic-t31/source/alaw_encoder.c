@@ -13,6 +13,7 @@
  * permissions and limitations under the License.
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -26,14 +27,30 @@
 #define ERRNO_NONE 0
 #define ERRNO_FAIL __LINE__
 
+/* A-law is encoded from the 13 most significant bits of a PCM sample, and mu-law from the 14 most significant bits. */
+#define ALAW_TABLE_SHIFT    (3)
+#define MULAW_TABLE_SHIFT   (2)
+
+#define MULAW_BIAS          (0x21)
+#define MULAW_CLIP          (8159)
+
 typedef struct AlawEncoder
 {
     unsigned int uSampleRate;
     unsigned int uChannels;
     unsigned int uBitRate;
+
+    bool bIsMulaw;
+    bool bUseLookupTable;
 } AlawEncoder_t;
 
 static int16_t xSegmentAlawEnd[8] = {0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF};
+static int16_t xSegmentMulawEnd[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+
+/* Lookup tables indexed by the unsigned bits of a PCM sample, which are built once by the first encoder. */
+static uint8_t pAlawTable[1 << (16 - ALAW_TABLE_SHIFT)];
+static uint8_t pMulawTable[1 << (16 - MULAW_TABLE_SHIFT)];
+static bool bIsTableInitialized = false;
 
 static uint8_t prvEncodePcmToAlaw(int16_t xPcmVal)
 {
@@ -74,7 +91,85 @@ static uint8_t prvEncodePcmToAlaw(int16_t xPcmVal)
     return uAlawVal;
 }
 
-void *AlawEncoder_create(const unsigned int uSampleRate, const unsigned int uChannels, const unsigned int uBitRate)
+static uint8_t prvEncodePcmToMulaw(int16_t xPcmVal)
+{
+    uint8_t uMask = 0xFF;
+    size_t uSegIdx = 0;
+    uint8_t uMulawVal = 0;
+
+    xPcmVal = xPcmVal >> 2;
+
+    if (xPcmVal < 0)
+    {
+        xPcmVal = -xPcmVal;
+        uMask = 0x7F;
+    }
+
+    if (xPcmVal > MULAW_CLIP)
+    {
+        xPcmVal = MULAW_CLIP;
+    }
+    xPcmVal += MULAW_BIAS;
+
+    for (uSegIdx = 0; uSegIdx<8; uSegIdx++)
+    {
+        if (xPcmVal <= xSegmentMulawEnd[uSegIdx])
+        {
+            break;
+        }
+    }
+
+    if (uSegIdx >= 8)
+    {
+        uMulawVal = 0x7F ^ uMask;
+    }
+    else
+    {
+        uMulawVal = (uSegIdx << 4) | ((xPcmVal >> (uSegIdx + 1)) & 0x0F);
+        uMulawVal ^= uMask;
+    }
+
+    return uMulawVal;
+}
+
+static void prvInitLookupTables(void)
+{
+    size_t i = 0;
+
+    if (!bIsTableInitialized)
+    {
+        /* The bits dropped by each law are zero here, so every entry is exactly the encoded value of its samples. */
+        for (i = 0; i < sizeof(pAlawTable); i++)
+        {
+            pAlawTable[i] = prvEncodePcmToAlaw((int16_t)(uint16_t)(i << ALAW_TABLE_SHIFT));
+        }
+        for (i = 0; i < sizeof(pMulawTable); i++)
+        {
+            pMulawTable[i] = prvEncodePcmToMulaw((int16_t)(uint16_t)(i << MULAW_TABLE_SHIFT));
+        }
+        bIsTableInitialized = true;
+    }
+}
+
+static void prvEncodeWithTable(const uint8_t *pTable, unsigned int uShift, const int16_t *pPcmData, uint8_t *pEncBuf, size_t uSampleCount)
+{
+    size_t i = 0;
+
+    /* It's unrolled because lookups of different samples don't depend on each other. */
+    for (i = 0; i + 4 <= uSampleCount; i += 4)
+    {
+        pEncBuf[i] = pTable[(uint16_t)(pPcmData[i]) >> uShift];
+        pEncBuf[i + 1] = pTable[(uint16_t)(pPcmData[i + 1]) >> uShift];
+        pEncBuf[i + 2] = pTable[(uint16_t)(pPcmData[i + 2]) >> uShift];
+        pEncBuf[i + 3] = pTable[(uint16_t)(pPcmData[i + 3]) >> uShift];
+    }
+    for (; i < uSampleCount; i++)
+    {
+        pEncBuf[i] = pTable[(uint16_t)(pPcmData[i]) >> uShift];
+    }
+}
+
+static void *prvCreate(const unsigned int uSampleRate, const unsigned int uChannels, const unsigned int uBitRate, bool bIsMulaw)
 {
     AlawEncoder_t *pAlawEncoder = NULL;
 
@@ -94,11 +189,24 @@ void *AlawEncoder_create(const unsigned int uSampleRate, const unsigned int uCha
         pAlawEncoder->uChannels = uChannels;
         pAlawEncoder->uBitRate = uBitRate;
 
+        pAlawEncoder->bIsMulaw = bIsMulaw;
+        pAlawEncoder->bUseLookupTable = true;
+        prvInitLookupTables();
     }
 
     return (void *)pAlawEncoder;
 }
 
+void *AlawEncoder_create(const unsigned int uSampleRate, const unsigned int uChannels, const unsigned int uBitRate)
+{
+    return prvCreate(uSampleRate, uChannels, uBitRate, false);
+}
+
+void *MulawEncoder_create(const unsigned int uSampleRate, const unsigned int uChannels, const unsigned int uBitRate)
+{
+    return prvCreate(uSampleRate, uChannels, uBitRate, true);
+}
+
 void AlawEncoder_terminate(void *pHandle)
 {
     AlawEncoder_t *pAlawEncoder = (AlawEncoder_t *)pHandle;
@@ -112,14 +220,19 @@ void AlawEncoder_terminate(void *pHandle)
 int AlawEncoder_setParameter(void *pHandle, char *pKey, void *pValue)
 {
     int res = ERRNO_NONE;
+    AlawEncoder_t *pAlawEncoder = (AlawEncoder_t *)pHandle;
 
     if (pHandle == NULL || pKey == NULL || pValue == NULL)
     {
         res = ERRNO_FAIL;
     }
+    else if (strcmp(pKey, ALAW_ENCODER_PARAM_LOOKUP_TABLE) == 0)
+    {
+        pAlawEncoder->bUseLookupTable = (*((int *)pValue) != 0);
+    }
     else
     {
-        /* No parameter is needed for a-law encoder. */
+        res = ERRNO_FAIL;
     }
 
     return res;
@@ -144,6 +257,7 @@ int AlawEncoder_getParameter(void *pHandle, char *pKey, void *pValue)
 int AlawEncoder_encode(void *pHandle, uint8_t *pPcmBuf, size_t uPcmBufLen, uint8_t *pEncBuf, size_t uEncBufSize, size_t *puEncBufLen, size_t *puPcmBufUsed, uint64_t *puTimestampMs)
 {
     int res = ERRNO_NONE;
+    AlawEncoder_t *pAlawEncoder = (AlawEncoder_t *)pHandle;
     size_t uEncBufLen = 0;
     int16_t *pPcmData = NULL;
     struct timeval tv;
@@ -176,9 +290,21 @@ int AlawEncoder_encode(void *pHandle, uint8_t *pPcmBuf, size_t uPcmBufLen, uint8
             else
             {
                 pPcmData = (int16_t *)(pPcmBuf);
-                for (size_t i = 0; i < uPcmBufLen/2; i++)
+                if (pAlawEncoder->bUseLookupTable)
+                {
+                    prvEncodeWithTable(
+                        pAlawEncoder->bIsMulaw ? pMulawTable : pAlawTable,
+                        pAlawEncoder->bIsMulaw ? MULAW_TABLE_SHIFT : ALAW_TABLE_SHIFT,
+                        pPcmData,
+                        pEncBuf,
+                        uPcmBufLen / 2);
+                }
+                else
                 {
-                    pEncBuf[i] = prvEncodePcmToAlaw(pPcmData[i]);
+                    for (size_t i = 0; i < uPcmBufLen/2; i++)
+                    {
+                        pEncBuf[i] = pAlawEncoder->bIsMulaw ? prvEncodePcmToMulaw(pPcmData[i]) : prvEncodePcmToAlaw(pPcmData[i]);
+                    }
                 }
                 *puEncBufLen = uEncBufLen;
                 *puPcmBufUsed = uPcmBufLen;
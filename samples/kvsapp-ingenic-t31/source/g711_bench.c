@@ -0,0 +1,135 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alaw_encoder.h"
+
+#define ERRNO_NONE 0
+#define ERRNO_FAIL __LINE__
+
+/* One second of 8 kHz mono audio, encoded BENCH_ROUNDS times by each encoder */
+#define BENCH_SAMPLE_COUNT  (8000)
+#define BENCH_ROUNDS        (1000)
+
+static uint64_t prvGetTimeInUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)(ts.tv_sec) * 1000000 + (uint64_t)(ts.tv_nsec) / 1000;
+}
+
+static int prvEncode(void *pEncoder, int16_t *pPcm, size_t uSampleCount, uint8_t *pEnc)
+{
+    size_t uEncLen = 0;
+    size_t uPcmUsed = 0;
+    uint64_t uTimestampMs = 0;
+
+    return AlawEncoder_encode(pEncoder, (uint8_t *)pPcm, uSampleCount * 2, pEnc, uSampleCount, &uEncLen, &uPcmUsed, &uTimestampMs);
+}
+
+/* It checks the lookup tables against the segment search for every sample value, and then times both of them. */
+static int prvBench(const char *pName, void *(*create)(const unsigned int, const unsigned int, const unsigned int))
+{
+    int res = ERRNO_NONE;
+    void *pTableEncoder = create(8000, 1, 8000 * 16);
+    void *pSearchEncoder = create(8000, 1, 8000 * 16);
+    int bUseLookupTable = 0;
+    int16_t *pPcm = (int16_t *)malloc(65536 * sizeof(int16_t));
+    uint8_t *pEnc = (uint8_t *)malloc(65536);
+    uint8_t *pExpected = (uint8_t *)malloc(65536);
+    uint64_t uSearchUs = 0;
+    uint64_t uTableUs = 0;
+    uint64_t uStartUs = 0;
+    size_t i = 0;
+
+    if (pTableEncoder == NULL || pSearchEncoder == NULL || pPcm == NULL || pEnc == NULL || pExpected == NULL)
+    {
+        printf("OOM\n");
+        res = ERRNO_FAIL;
+    }
+    else if (AlawEncoder_setParameter(pSearchEncoder, ALAW_ENCODER_PARAM_LOOKUP_TABLE, &bUseLookupTable) != 0)
+    {
+        printf("Failed to disable the lookup table\n");
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        for (i = 0; i < 65536; i++)
+        {
+            pPcm[i] = (int16_t)(uint16_t)i;
+        }
+        if (prvEncode(pSearchEncoder, pPcm, 65536, pExpected) != 0 || prvEncode(pTableEncoder, pPcm, 65536, pEnc) != 0)
+        {
+            printf("Failed to encode\n");
+            res = ERRNO_FAIL;
+        }
+        else if (memcmp(pExpected, pEnc, 65536) != 0)
+        {
+            printf("%s: lookup table mismatch\n", pName);
+            res = ERRNO_FAIL;
+        }
+        else
+        {
+            srand(1);
+            for (i = 0; i < BENCH_SAMPLE_COUNT; i++)
+            {
+                pPcm[i] = (int16_t)(rand() - RAND_MAX / 2);
+            }
+
+            uStartUs = prvGetTimeInUs();
+            for (i = 0; i < BENCH_ROUNDS; i++)
+            {
+                prvEncode(pSearchEncoder, pPcm, BENCH_SAMPLE_COUNT, pEnc);
+            }
+            uSearchUs = prvGetTimeInUs() - uStartUs;
+
+            uStartUs = prvGetTimeInUs();
+            for (i = 0; i < BENCH_ROUNDS; i++)
+            {
+                prvEncode(pTableEncoder, pPcm, BENCH_SAMPLE_COUNT, pEnc);
+            }
+            uTableUs = prvGetTimeInUs() - uStartUs;
+
+            printf("%s: segment search %.3f us/s of audio, lookup table %.3f us/s of audio\n", pName, (double)uSearchUs / BENCH_ROUNDS, (double)uTableUs / BENCH_ROUNDS);
+        }
+    }
+
+    AlawEncoder_terminate(pTableEncoder);
+    AlawEncoder_terminate(pSearchEncoder);
+    free(pPcm);
+    free(pEnc);
+    free(pExpected);
+
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = ERRNO_NONE;
+
+    if (prvBench("a-law", AlawEncoder_create) != ERRNO_NONE || prvBench("mu-law", MulawEncoder_create) != ERRNO_NONE)
+    {
+        res = ERRNO_FAIL;
+    }
+
+    return (res == ERRNO_NONE) ? 0 : 1;
+}
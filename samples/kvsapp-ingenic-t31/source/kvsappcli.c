@@ -119,6 +119,13 @@ static int setKvsAppOptions(KvsAppHandle kvsAppHandle)
     {
         printf("Failed to set audio track info\n");
     }
+#if ENABLE_AUDIO_LACING
+    unsigned int uAudioLaceDurationMs = AUDIO_LACE_DURATION_MS;
+    if (KvsApp_setoption(kvsAppHandle, OPTION_STREAM_AUDIO_LACE_DURATION_MS, (const char *)&uAudioLaceDurationMs) != 0)
+    {
+        printf("Failed to set audio lace duration\n");
+    }
+#endif /* ENABLE_AUDIO_LACING */
 #endif /* ENABLE_AUDIO_TRACK */
 
 #if ENABLE_RING_BUFFER_MEM_LIMIT
@@ -198,10 +205,10 @@ int main(int argc, char *argv[])
                     break;
                 }
 
-                if (getEpochTimestampInMs() > uLastPrintMemStatTimestamp + 1000)
+                if (getMonotonicTimeInMs() > uLastPrintMemStatTimestamp + 1000)
                 {
                     printf("Buffer memory used: %zu\n", KvsApp_getStreamMemStatTotal(kvsAppHandle));
-                    uLastPrintMemStatTimestamp = getEpochTimestampInMs();
+                    uLastPrintMemStatTimestamp = getMonotonicTimeInMs();
 
 #ifdef KVS_USE_POOL_ALLOCATOR
                     PoolStats_t stats = {0};
@@ -237,13 +244,19 @@ int main(int argc, char *argv[])
 
     KvsApp_close(kvsAppHandle);
 
-    T31Video_terminate(videoHandle);
+    /* Video frames and audio buffers may be held by KVS until it's terminated, and then they're returned. */
+    T31Video_stop(videoHandle);
 #if ENABLE_AUDIO_TRACK
-    T31Audio_terminate(audioHandle);
+    T31Audio_stop(audioHandle);
 #endif
 
     KvsApp_terminate(kvsAppHandle);
 
+    T31Video_terminate(videoHandle);
+#if ENABLE_AUDIO_TRACK
+    T31Audio_terminate(audioHandle);
+#endif
+
 #ifdef KVS_USE_POOL_ALLOCATOR
     poolAllocatorDeinit();
 #endif
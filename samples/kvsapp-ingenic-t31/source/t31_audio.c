@@ -48,7 +48,11 @@ typedef struct AudioEncoder
 #if USE_AUDIO_G711
 #include "alaw_encoder.h"
 static AudioEncoder_t xAudioEncoder = {
+#if USE_AUDIO_G711_MULAW
+    .create = MulawEncoder_create,
+#else
     .create = AlawEncoder_create,
+#endif /* USE_AUDIO_G711_MULAW */
     .terminate = AlawEncoder_terminate,
     .setParameter = AlawEncoder_setParameter,
     .getParameter = AlawEncoder_getParameter,
@@ -83,6 +87,14 @@ typedef struct AudioConfiguration
     size_t uPcmBufSize;
 } AudioConfiguration_t;
 
+typedef struct AudioEncBuf
+{
+    struct T31Audio *pAudio;
+    uint8_t *pBuf;
+    size_t uBufSize;
+    bool isInUse;
+} AudioEncBuf_t;
+
 typedef struct T31Audio
 {
     pthread_mutex_t lock;
@@ -96,6 +108,9 @@ typedef struct T31Audio
     AudioTrackInfo_t *pAudioTrackInfo;
 
     AudioConfiguration_t xAudioConf;
+
+    /* Encode buffers, which are returned by KVS under the lock */
+    AudioEncBuf_t encBufs[AUDIO_ENC_BUF_POOL_COUNT];
 } T31Audio_t;
 
 static void prvSleepInMs(uint32_t ms)
@@ -248,10 +263,65 @@ static int checkAndInitBuf(uint8_t **ppBuf, size_t *puBufSize, size_t uNeededSiz
     return res;
 }
 
+static int onEncBufTerminate(uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType, void *pAppData)
+{
+    AudioEncBuf_t *pEncBuf = (AudioEncBuf_t *)pAppData;
+    T31Audio_t *pAudio = pEncBuf->pAudio;
+
+    /* It's called by KVS, so the buffer is only marked free, and it's reused by the audio thread. */
+    pthread_mutex_lock(&(pAudio->lock));
+    pEncBuf->isInUse = false;
+    pthread_mutex_unlock(&(pAudio->lock));
+
+    return 0;
+}
+
+/* It returns a free buffer of the pool with at least uNeededSize bytes, or NULL if all buffers are held by KVS. */
+static AudioEncBuf_t *acquireEncBuf(T31Audio_t *pAudio, size_t uNeededSize)
+{
+    AudioEncBuf_t *pEncBuf = NULL;
+    AudioEncBuf_t *pFreeEncBuf = NULL;
+    size_t i = 0;
+
+    pthread_mutex_lock(&(pAudio->lock));
+    for (i = 0; i < AUDIO_ENC_BUF_POOL_COUNT; i++)
+    {
+        if (!pAudio->encBufs[i].isInUse)
+        {
+            pFreeEncBuf = &(pAudio->encBufs[i]);
+            if (pFreeEncBuf->uBufSize >= uNeededSize)
+            {
+                break;
+            }
+        }
+    }
+    if (pFreeEncBuf != NULL)
+    {
+        pFreeEncBuf->isInUse = true;
+    }
+    pthread_mutex_unlock(&(pAudio->lock));
+
+    /* A buffer only grows, so it's allocated once for frames of the same size. */
+    if (pFreeEncBuf != NULL && checkAndInitBuf(&(pFreeEncBuf->pBuf), &(pFreeEncBuf->uBufSize), uNeededSize) != ERRNO_NONE)
+    {
+        pthread_mutex_lock(&(pAudio->lock));
+        pFreeEncBuf->isInUse = false;
+        pthread_mutex_unlock(&(pAudio->lock));
+    }
+    else
+    {
+        pEncBuf = pFreeEncBuf;
+    }
+
+    return pEncBuf;
+}
+
 int sendAudioFrame(T31Audio_t *pAudio, IMPAudioFrame *pFrame)
 {
     int res = ERRNO_NONE;
     AudioConfiguration_t *pConf = NULL;
+    AudioEncBuf_t *pPoolBuf = NULL;
+    DataFrameCallbacks_t callbacks = {0};
     uint8_t *pEncBuf = NULL;
     size_t uEncBufSize = 0;
     size_t uEncBufLen = 0;
@@ -282,23 +352,57 @@ int sendAudioFrame(T31Audio_t *pAudio, IMPAudioFrame *pFrame)
                 /* Do nothing here because the PCM data is not enough to do the encoding. The audio encoder is responsible to buffer these PCM data until next time. */
                 break;
             }
-            else if (checkAndInitBuf(&(pConf->pPcmBuf), &(pConf->uPcmBufSize), uPcmLen) != 0 ||
-                     checkAndInitBuf(&pEncBuf, &uEncBufSize, uEncBufLen) != 0)
+            else if (checkAndInitBuf(&(pConf->pPcmBuf), &(pConf->uPcmBufSize), uPcmLen) != 0)
             {
-                printf("%s(): Failed to init pcm and enc buf\n", __FUNCTION__ );
+                printf("%s(): Failed to init pcm buf\n", __FUNCTION__ );
                 res = ERRNO_FAIL;
             }
             else
             {
+                if ((pPoolBuf = acquireEncBuf(pAudio, uEncBufLen)) != NULL)
+                {
+                    pEncBuf = pPoolBuf->pBuf;
+                    uEncBufSize = pPoolBuf->uBufSize;
+                }
+                else
+                {
+                    /* All buffers are held by KVS, so this one is freed by KVS. */
+                    pEncBuf = NULL;
+                    if (checkAndInitBuf(&pEncBuf, &uEncBufSize, uEncBufLen) != 0)
+                    {
+                        printf("%s(): Failed to init enc buf\n", __FUNCTION__ );
+                        res = ERRNO_FAIL;
+                        break;
+                    }
+                }
+
                 memcpy(pConf->pPcmBuf, pPcmSrc, uPcmLen);
                 if (xAudioEncoder.encode(pConf->pEncoderHandle, pConf->pPcmBuf, uPcmLen, pEncBuf, uEncBufSize, &uEncBufLen, &uPcmBufUsed, &uTimestampMs) != 0)
                 {
                     printf("%s(): Failed to encode\n", __FUNCTION__);
                     res = ERRNO_FAIL;
+                    if (pPoolBuf != NULL)
+                    {
+                        onEncBufTerminate(pEncBuf, 0, 0, TRACK_AUDIO, pPoolBuf);
+                    }
+                    else
+                    {
+                        free(pEncBuf);
+                    }
                 }
                 else
                 {
-                    KvsApp_addFrame(pAudio->kvsAppHandle, pEncBuf, uEncBufSize, uEncBufLen, uTimestampMs, TRACK_AUDIO);
+                    if (pPoolBuf != NULL)
+                    {
+                        /* The buffer is returned to the pool even if the frame fails to be added. */
+                        callbacks.onDataFrameTerminateInfo.onDataFrameTerminate = onEncBufTerminate;
+                        callbacks.onDataFrameTerminateInfo.pAppData = pPoolBuf;
+                        KvsApp_addFrameWithCallbacks(pAudio->kvsAppHandle, pEncBuf, uEncBufLen, uEncBufSize, uTimestampMs, TRACK_AUDIO, &callbacks);
+                    }
+                    else
+                    {
+                        KvsApp_addFrame(pAudio->kvsAppHandle, pEncBuf, uEncBufLen, uEncBufSize, uTimestampMs, TRACK_AUDIO);
+                    }
                     uPcmLen -= uPcmBufUsed;
                     pPcmSrc += uPcmBufUsed;
                 }
@@ -445,6 +549,7 @@ T31AudioHandle T31Audio_create(KvsAppHandle kvsAppHandle)
 {
     int res = ERRNO_NONE;
     T31Audio_t *pAudio = NULL;
+    size_t i = 0;
 
     if ((pAudio = (T31Audio_t *)malloc(sizeof(T31Audio_t))) == NULL)
     {
@@ -460,6 +565,11 @@ T31AudioHandle T31Audio_create(KvsAppHandle kvsAppHandle)
 
         pAudio->kvsAppHandle = kvsAppHandle;
 
+        for (i = 0; i < AUDIO_ENC_BUF_POOL_COUNT; i++)
+        {
+            pAudio->encBufs[i].pAudio = pAudio;
+        }
+
         if (pthread_mutex_init(&(pAudio->lock), NULL) != 0)
         {
             printf("%s(): Failed to initialize lock\n", __FUNCTION__);
@@ -491,13 +601,24 @@ T31AudioHandle T31Audio_create(KvsAppHandle kvsAppHandle)
     return pAudio;
 }
 
-void T31Audio_terminate(T31AudioHandle handle)
+void T31Audio_stop(T31AudioHandle handle)
 {
     T31Audio_t *pAudio = (T31Audio_t *)handle;
 
     if (pAudio != NULL)
     {
         pAudio->isTerminating = true;
+    }
+}
+
+void T31Audio_terminate(T31AudioHandle handle)
+{
+    T31Audio_t *pAudio = (T31Audio_t *)handle;
+    size_t i = 0;
+
+    if (pAudio != NULL)
+    {
+        T31Audio_stop(pAudio);
         while (!pAudio->isTerminated)
         {
             prvSleepInMs(10);
@@ -505,6 +626,14 @@ void T31Audio_terminate(T31AudioHandle handle)
 
         pthread_join(pAudio->tid, NULL);
 
+        for (i = 0; i < AUDIO_ENC_BUF_POOL_COUNT; i++)
+        {
+            if (pAudio->encBufs[i].pBuf != NULL)
+            {
+                free(pAudio->encBufs[i].pBuf);
+            }
+        }
+
         pthread_mutex_destroy(&(pAudio->lock));
         free(pAudio);
     }
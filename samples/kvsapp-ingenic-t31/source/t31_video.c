@@ -29,6 +29,7 @@
 
 /* KVS headers */
 #include "kvs/kvsapp.h"
+#include "kvs/nalu.h"
 #include "kvs/port.h"
 
 #include "sample_config.h"
@@ -37,6 +38,20 @@
 #define ERRNO_NONE 0
 #define ERRNO_FAIL __LINE__
 
+#if ENABLE_ZERO_COPY_VIDEO
+struct T31Video;
+
+typedef struct HeldStream
+{
+    struct T31Video *pVideo;
+    int chnNum;
+    IMPEncoderStream stream;
+
+    /* KVS has terminated the frame, or the frame was copied, so the stream can be released. */
+    bool isDone;
+} HeldStream_t;
+#endif /* ENABLE_ZERO_COPY_VIDEO */
+
 typedef struct T31Video
 {
     pthread_mutex_t lock;
@@ -46,6 +61,26 @@ typedef struct T31Video
     bool isTerminated;
 
     KvsAppHandle kvsAppHandle;
+
+    /* Encoder channels of the main stream and the sub stream, and the sub stream is -1 if it's not encoded. */
+    int mainChn;
+    int subChn;
+
+#if ENABLE_ZERO_COPY_VIDEO
+    /* Streams are released in the order they're got, so every stream got while any is held is queued here. */
+    HeldStream_t heldStreams[VIDEO_MAX_HELD_STREAMS];
+    size_t uHeldHead;
+    size_t uHeldCount;
+#endif /* ENABLE_ZERO_COPY_VIDEO */
+
+    /* The bitrate hinted by KVS, and it's applied to the encoder in video thread. */
+    uint32_t uTargetBitrateKbps;
+    bool isBitrateUpdated;
+
+#if ENABLE_SUB_STREAM_SWITCHING
+    /* The bitrate hint asks for the sub stream, and the video thread switches to it at its next key frame. */
+    bool isSubStreamWanted;
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
 } T31Video_t;
 
 extern struct chn_conf chn[];
@@ -55,6 +90,86 @@ static void prvSleepInMs(uint32_t ms)
     usleep(ms * 1000);
 }
 
+#if ENABLE_BITRATE_ADAPTATION
+static int onBitrateHint(uint32_t uBitrateBps, void *pAppData)
+{
+    T31Video_t *pVideo = (T31Video_t *)pAppData;
+    uint32_t uBitrateKbps = uBitrateBps / 1000;
+
+    pthread_mutex_lock(&(pVideo->lock));
+#if ENABLE_SUB_STREAM_SWITCHING
+    /* The thresholds are apart, so a hint around one of them doesn't switch streams back and forth. */
+    if (uBitrateKbps < VIDEO_SUB_STREAM_SWITCH_DOWN_KBPS)
+    {
+        pVideo->isSubStreamWanted = true;
+    }
+    else if (uBitrateKbps >= VIDEO_SUB_STREAM_SWITCH_UP_KBPS)
+    {
+        pVideo->isSubStreamWanted = false;
+    }
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
+    if (uBitrateKbps != pVideo->uTargetBitrateKbps)
+    {
+        pVideo->uTargetBitrateKbps = uBitrateKbps;
+        pVideo->isBitrateUpdated = true;
+    }
+    pthread_mutex_unlock(&(pVideo->lock));
+
+    return 0;
+}
+
+/* The hint is clamped to the range of the stream that it's applied to. */
+static uint32_t clampBitrate(int chnNum, T31Video_t *pVideo, uint32_t uBitrateKbps)
+{
+    uint32_t uMinKbps = VIDEO_BITRATE_MIN_KBPS;
+    uint32_t uMaxKbps = VIDEO_BITRATE_MAX_KBPS;
+
+#if ENABLE_SUB_STREAM_SWITCHING
+    if (chnNum == pVideo->subChn)
+    {
+        uMinKbps = VIDEO_SUB_BITRATE_MIN_KBPS;
+        uMaxKbps = VIDEO_SUB_BITRATE_MAX_KBPS;
+    }
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
+
+    if (uBitrateKbps < uMinKbps)
+    {
+        uBitrateKbps = uMinKbps;
+    }
+    else if (uBitrateKbps > uMaxKbps)
+    {
+        uBitrateKbps = uMaxKbps;
+    }
+
+    return uBitrateKbps;
+}
+
+static void updateBitrate(int chnNum, T31Video_t *pVideo)
+{
+    uint32_t uBitrateKbps = 0;
+    bool isBitrateUpdated = false;
+
+    pthread_mutex_lock(&(pVideo->lock));
+    isBitrateUpdated = pVideo->isBitrateUpdated;
+    uBitrateKbps = pVideo->uTargetBitrateKbps;
+    pVideo->isBitrateUpdated = false;
+    pthread_mutex_unlock(&(pVideo->lock));
+
+    if (isBitrateUpdated)
+    {
+        uBitrateKbps = clampBitrate(chnNum, pVideo, uBitrateKbps);
+        if (IMP_Encoder_SetChnBitRate(chnNum, (int)uBitrateKbps, (int)(uBitrateKbps * 4 / 3)) < 0)
+        {
+            printf("%s(): IMP_Encoder_SetChnBitRate(%d) failed\n", __FUNCTION__, chnNum);
+        }
+        else
+        {
+            printf("Video bitrate is set to %u kbps\n", uBitrateKbps);
+        }
+    }
+}
+#endif /* ENABLE_BITRATE_ADAPTATION */
+
 static int getPacket(IMPEncoderStream *pStream, IMPEncoderPack *pPack, uint8_t *pPacketBuf, size_t uPacketSize)
 {
     int res = ERRNO_NONE;
@@ -90,6 +205,164 @@ static int getPacket(IMPEncoderStream *pStream, IMPEncoderPack *pPack, uint8_t *
     return res;
 }
 
+#if ENABLE_ZERO_COPY_VIDEO
+static int onHeldFrameTerminate(uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType, void *pAppData)
+{
+    HeldStream_t *pHeldStream = (HeldStream_t *)pAppData;
+
+    /* It's called by KVS, so the stream is released later by the video thread which owns the encoder. */
+    pthread_mutex_lock(&(pHeldStream->pVideo->lock));
+    pHeldStream->isDone = true;
+    pthread_mutex_unlock(&(pHeldStream->pVideo->lock));
+
+    return 0;
+}
+
+/* It returns the number of streams that are still held. Streams of both channels are queued together, so each channel
+ * releases its streams in the order they're got. */
+static size_t releaseDoneStreams(T31Video_t *pVideo)
+{
+    HeldStream_t *pHeldStream = NULL;
+    size_t uHeldCount = 0;
+
+    pthread_mutex_lock(&(pVideo->lock));
+    while (pVideo->uHeldCount > 0 && (pHeldStream = &(pVideo->heldStreams[pVideo->uHeldHead]))->isDone)
+    {
+        IMP_Encoder_ReleaseStream(pHeldStream->chnNum, &(pHeldStream->stream));
+        pVideo->uHeldHead = (pVideo->uHeldHead + 1) % VIDEO_MAX_HELD_STREAMS;
+        pVideo->uHeldCount--;
+    }
+    uHeldCount = pVideo->uHeldCount;
+    pthread_mutex_unlock(&(pVideo->lock));
+
+    return uHeldCount;
+}
+
+/* It returns the queued stream, or NULL if no streams are held and the stream can be released right away. */
+static HeldStream_t *queueStream(T31Video_t *pVideo, int chnNum, IMPEncoderStream *pStream, bool isDone)
+{
+    HeldStream_t *pHeldStream = NULL;
+
+    pthread_mutex_lock(&(pVideo->lock));
+    if ((!isDone || pVideo->uHeldCount > 0) && pVideo->uHeldCount < VIDEO_MAX_HELD_STREAMS)
+    {
+        pHeldStream = &(pVideo->heldStreams[(pVideo->uHeldHead + pVideo->uHeldCount) % VIDEO_MAX_HELD_STREAMS]);
+        pHeldStream->pVideo = pVideo;
+        pHeldStream->chnNum = chnNum;
+        memcpy(&(pHeldStream->stream), pStream, sizeof(IMPEncoderStream));
+        pHeldStream->isDone = isDone;
+        pVideo->uHeldCount++;
+    }
+    pthread_mutex_unlock(&(pVideo->lock));
+
+    return pHeldStream;
+}
+
+/* The packs are usually contiguous in the stream buffer, unless the frame wraps around the end of it. */
+static bool getContiguousFrame(IMPEncoderStream *pStream, uint8_t **ppFrame, size_t *puFrameLen)
+{
+    bool isContiguous = (pStream->packCount > 0);
+    IMPEncoderPack *pPack = NULL;
+    uint32_t uNextOffset = 0;
+    size_t uFrameLen = 0;
+
+    for (int i = 0; i < pStream->packCount && isContiguous; i++)
+    {
+        pPack = &pStream->pack[i];
+        if (pPack->length == 0 || pPack->offset >= pStream->streamSize || pStream->streamSize - pPack->offset < pPack->length ||
+            (i > 0 && pPack->offset != uNextOffset))
+        {
+            isContiguous = false;
+        }
+        else
+        {
+            uNextOffset = pPack->offset + pPack->length;
+            uFrameLen += pPack->length;
+        }
+    }
+
+    if (isContiguous)
+    {
+        *ppFrame = (uint8_t *)(pStream->virAddr + pStream->pack[0].offset);
+        *puFrameLen = uFrameLen;
+    }
+
+    return isContiguous;
+}
+
+/* If the frame wraps around the end of the stream buffer, each pack is a segment as long as no pack is cut into 2 pieces. */
+static bool getFrameSegments(IMPEncoderStream *pStream, DataFrameSegment_t *pSegments, size_t *puSegmentCount)
+{
+    bool isSegmented = (pStream->packCount > 0 && pStream->packCount <= DATA_FRAME_MAX_SEGMENTS);
+    IMPEncoderPack *pPack = NULL;
+    NaluFrameInfo_t frameInfo = {0};
+
+    for (int i = 0; i < pStream->packCount && isSegmented; i++)
+    {
+        pPack = &pStream->pack[i];
+        if (pPack->length == 0 || pPack->offset >= pStream->streamSize || pStream->streamSize - pPack->offset < pPack->length)
+        {
+            isSegmented = false;
+        }
+        else
+        {
+            pSegments[i].pData = (uint8_t *)(pStream->virAddr + pPack->offset);
+            pSegments[i].uLen = pPack->length;
+
+            /* Each segment is converted to AVCC in place by KVS. */
+            isSegmented = (NALU_analyzeFrame(pSegments[i].pData, (uint32_t)(pSegments[i].uLen), false, &frameInfo) == 0 && frameInfo.uAvccLen <= pSegments[i].uLen);
+        }
+    }
+
+    if (isSegmented)
+    {
+        *puSegmentCount = (size_t)(pStream->packCount);
+    }
+
+    return isSegmented;
+}
+
+/* It returns true if the frame is handed over to KVS without copy, and the stream is released after KVS terminates it. */
+static bool sendHeldVideoFrame(T31Video_t *pVideo, int chnNum, IMPEncoderStream *pStream)
+{
+    bool isSent = false;
+    uint8_t *pFrame = NULL;
+    size_t uFrameLen = 0;
+    NaluFrameInfo_t frameInfo = {0};
+    DataFrameSegment_t segments[DATA_FRAME_MAX_SEGMENTS];
+    size_t uSegmentCount = 0;
+    HeldStream_t *pHeldStream = NULL;
+    DataFrameCallbacks_t callbacks = {0};
+    int res = 0;
+
+    /* The frame is converted to AVCC in place, so it's copied if the conversion doesn't fit in the stream buffer. */
+    if (getContiguousFrame(pStream, &pFrame, &uFrameLen) && NALU_analyzeFrame(pFrame, (uint32_t)uFrameLen, false, &frameInfo) == 0 &&
+        frameInfo.uAvccLen <= uFrameLen && (pHeldStream = queueStream(pVideo, chnNum, pStream, false)) != NULL)
+    {
+        callbacks.onDataFrameTerminateInfo.onDataFrameTerminate = onHeldFrameTerminate;
+        callbacks.onDataFrameTerminateInfo.pAppData = pHeldStream;
+
+        /* The frame is terminated even if it fails to be added, so the stream is always released. */
+        res = KvsApp_addVideoFrameWithFrameInfo(pVideo->kvsAppHandle, pFrame, uFrameLen, uFrameLen, getEpochTimestampInMs(), &frameInfo, &callbacks);
+        isSent = true;
+    }
+    else if (getFrameSegments(pStream, segments, &uSegmentCount) && (pHeldStream = queueStream(pVideo, chnNum, pStream, false)) != NULL)
+    {
+        callbacks.onDataFrameTerminateInfo.onDataFrameTerminate = onHeldFrameTerminate;
+        callbacks.onDataFrameTerminateInfo.pAppData = pHeldStream;
+        res = KvsApp_addFrameV(pVideo->kvsAppHandle, segments, uSegmentCount, getEpochTimestampInMs(), TRACK_VIDEO, &callbacks);
+        isSent = true;
+    }
+
+    if (res != 0)
+    {
+        printf("%s(): Failed to add video frame\n", __FUNCTION__);
+    }
+
+    return isSent;
+}
+#endif /* ENABLE_ZERO_COPY_VIDEO */
+
 static int sendVideoFrame(T31Video_t *pVideo, IMPEncoderStream *pStream)
 {
     int res = ERRNO_NONE;
@@ -131,14 +404,156 @@ static int sendVideoFrame(T31Video_t *pVideo, IMPEncoderStream *pStream)
     return res;
 }
 
-static int doVideoStreaming(int chnNum, T31Video_t *pVideo)
+/* Send the frame of a stream, and release the stream once KVS is done with it. */
+static void sendStream(T31Video_t *pVideo, int chnNum, IMPEncoderStream *pStream)
+{
+#if ENABLE_ZERO_COPY_VIDEO
+    if (sendHeldVideoFrame(pVideo, chnNum, pStream))
+    {
+        /* nop */
+    }
+    else
+    {
+        if (sendVideoFrame(pVideo, pStream) != 0)
+        {
+            printf("%s(): Failed to send video frame\n", __FUNCTION__);
+        }
+
+        /* The frame is copied, but the stream still waits for the held streams in front of it. */
+        if (queueStream(pVideo, chnNum, pStream, true) == NULL)
+        {
+            IMP_Encoder_ReleaseStream(chnNum, pStream);
+        }
+    }
+#else
+    if (sendVideoFrame(pVideo, pStream) != 0)
+    {
+        printf("%s(): Failed to send video frame\n", __FUNCTION__);
+    }
+    IMP_Encoder_ReleaseStream(chnNum, pStream);
+#endif /* ENABLE_ZERO_COPY_VIDEO */
+}
+
+/* It returns false if all streams are held by KVS, and the encoder keeps new frames until KVS terminates some of them. */
+static bool canGetStream(T31Video_t *pVideo)
+{
+#if ENABLE_ZERO_COPY_VIDEO
+    return releaseDoneStreams(pVideo) < VIDEO_MAX_HELD_STREAMS;
+#else
+    return true;
+#endif /* ENABLE_ZERO_COPY_VIDEO */
+}
+
+#if ENABLE_SUB_STREAM_SWITCHING
+/* An IDR slice of any pack makes it a key frame. Only the NALU header is read, so a pack cut into 2 pieces is fine. */
+static bool isKeyStream(IMPEncoderStream *pStream)
+{
+    bool isKey = false;
+    IMPEncoderPack *pPack = NULL;
+    uint8_t pHdr[5];
+
+    for (int i = 0; i < pStream->packCount && !isKey; i++)
+    {
+        pPack = &pStream->pack[i];
+        if (pPack->length >= sizeof(pHdr) && pPack->offset < pStream->streamSize)
+        {
+            for (size_t j = 0; j < sizeof(pHdr); j++)
+            {
+                pHdr[j] = *(uint8_t *)(pStream->virAddr + (pPack->offset + j) % pStream->streamSize);
+            }
+            isKey = (NALU_getNaluType(pHdr, sizeof(pHdr)) == NALU_TYPE_IFRAME);
+        }
+    }
+
+    return isKey;
+}
+
+static int getWantedChn(T31Video_t *pVideo)
+{
+    bool isSubStreamWanted = false;
+
+    pthread_mutex_lock(&(pVideo->lock));
+    isSubStreamWanted = pVideo->isSubStreamWanted;
+    pthread_mutex_unlock(&(pVideo->lock));
+
+    return isSubStreamWanted ? pVideo->subChn : pVideo->mainChn;
+}
+
+/**
+ * Get the frames of the channel that isn't sent without waiting. They're dropped, unless the bitrate hint asks for the
+ * channel and it's a key frame, and then it becomes the active channel. KVS finds the parameter sets of the other
+ * stream in the key frame, and starts a new MKV segment with them.
+ *
+ * It returns false if all streams are held by KVS after it.
+ */
+static bool pollInactiveChn(T31Video_t *pVideo, int *pActiveChn, int *pIdrRequestedChn)
+{
+    int inactiveChn = (*pActiveChn == pVideo->mainChn) ? pVideo->subChn : pVideo->mainChn;
+    int wantedChn = getWantedChn(pVideo);
+    IMPEncoderStream stream = {0};
+
+    if (wantedChn != *pActiveChn && wantedChn != *pIdrRequestedChn)
+    {
+        /* The switch doesn't wait for the next GOP. */
+        if (IMP_Encoder_RequestIDR(wantedChn) < 0)
+        {
+            printf("%s(): IMP_Encoder_RequestIDR(%d) failed\n", __FUNCTION__, wantedChn);
+        }
+        *pIdrRequestedChn = wantedChn;
+    }
+
+    while (canGetStream(pVideo) && IMP_Encoder_PollingStream(inactiveChn, 0) >= 0 && IMP_Encoder_GetStream(inactiveChn, &stream, 0) >= 0)
+    {
+        if (inactiveChn == wantedChn && isKeyStream(&stream))
+        {
+            printf("Switch video to the %s stream\n", (inactiveChn == pVideo->subChn) ? "sub" : "main");
+            *pActiveChn = inactiveChn;
+            *pIdrRequestedChn = -1;
+
+            /* The latest hint is applied to the new active channel in its own range. */
+            pthread_mutex_lock(&(pVideo->lock));
+            pVideo->isBitrateUpdated = (pVideo->uTargetBitrateKbps > 0);
+            pthread_mutex_unlock(&(pVideo->lock));
+
+            sendStream(pVideo, inactiveChn, &stream);
+            break;
+        }
+        else
+        {
+#if ENABLE_ZERO_COPY_VIDEO
+            /* The stream still waits for the held streams in front of it. */
+            if (queueStream(pVideo, inactiveChn, &stream, true) == NULL)
+            {
+                IMP_Encoder_ReleaseStream(inactiveChn, &stream);
+            }
+#else
+            IMP_Encoder_ReleaseStream(inactiveChn, &stream);
+#endif /* ENABLE_ZERO_COPY_VIDEO */
+        }
+    }
+
+    return canGetStream(pVideo);
+}
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
+
+static int doVideoStreaming(T31Video_t *pVideo)
 {
     int res = ERRNO_NONE;
     IMPEncoderStream stream = {0};
+    int activeChn = pVideo->mainChn;
+#if ENABLE_SUB_STREAM_SWITCHING
+    int idrRequestedChn = -1;
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
 
-    if (IMP_Encoder_StartRecvPic(chnNum) < 0)
+    if (IMP_Encoder_StartRecvPic(pVideo->mainChn) < 0)
+    {
+        printf("%s(): IMP_Encoder_StartRecvPic(%d) failed\n", __FUNCTION__, pVideo->mainChn);
+        res = ERRNO_FAIL;
+    }
+    else if (pVideo->subChn >= 0 && IMP_Encoder_StartRecvPic(pVideo->subChn) < 0)
     {
-        printf("%s(): IMP_Encoder_StartRecvPic(%d) failed\n", __FUNCTION__, chnNum);
+        printf("%s(): IMP_Encoder_StartRecvPic(%d) failed\n", __FUNCTION__, pVideo->subChn);
+        IMP_Encoder_StopRecvPic(pVideo->mainChn);
         res = ERRNO_FAIL;
     }
     else
@@ -149,30 +564,48 @@ static int doVideoStreaming(int chnNum, T31Video_t *pVideo)
             {
                 break;
             }
-            else if (IMP_Encoder_PollingStream(chnNum, 1000) < 0)
+            else if (!canGetStream(pVideo))
+            {
+                prvSleepInMs(10);
+                continue;
+            }
+#if ENABLE_SUB_STREAM_SWITCHING
+            else if (!pollInactiveChn(pVideo, &activeChn, &idrRequestedChn))
+            {
+                continue;
+            }
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
+            else if (IMP_Encoder_PollingStream(activeChn, 1000) < 0)
             {
-                printf("%s(): IMP_Encoder_PollingStream(%d) timeout\n", __FUNCTION__, chnNum);
+                printf("%s(): IMP_Encoder_PollingStream(%d) timeout\n", __FUNCTION__, activeChn);
                 continue;
             }
-            else if (IMP_Encoder_GetStream(chnNum, &stream, 1) < 0)
+            else if (IMP_Encoder_GetStream(activeChn, &stream, 1) < 0)
             {
-                printf("%s(): IMP_Encoder_GetStream(%d) failed\n", __FUNCTION__, chnNum);
+                printf("%s(): IMP_Encoder_GetStream(%d) failed\n", __FUNCTION__, activeChn);
                 res = ERRNO_FAIL;
                 break;
             }
             else
             {
-                if (sendVideoFrame(pVideo, &stream) != 0)
-                {
-                    printf("%s(): Failed to send video frame\n", __FUNCTION__);
-                }
-                IMP_Encoder_ReleaseStream(chnNum, &stream);
+                sendStream(pVideo, activeChn, &stream);
+#if ENABLE_BITRATE_ADAPTATION
+                updateBitrate(activeChn, pVideo);
+#endif /* ENABLE_BITRATE_ADAPTATION */
             }
         }
 
-        if (IMP_Encoder_StopRecvPic(chnNum) < 0)
+#if ENABLE_ZERO_COPY_VIDEO
+        /* KVS terminates the frames it holds when it's terminated, and then the streams are released. */
+        while (releaseDoneStreams(pVideo) > 0)
         {
-            printf("%s(): IMP_Encoder_StopRecvPic(%d) failed\n", __FUNCTION__, chnNum);
+            prvSleepInMs(10);
+        }
+#endif /* ENABLE_ZERO_COPY_VIDEO */
+
+        if (IMP_Encoder_StopRecvPic(pVideo->mainChn) < 0 || (pVideo->subChn >= 0 && IMP_Encoder_StopRecvPic(pVideo->subChn) < 0))
+        {
+            printf("%s(): IMP_Encoder_StopRecvPic failed\n", __FUNCTION__);
             res = ERRNO_FAIL;
         }
     }
@@ -184,10 +617,12 @@ static void *videoThread(void *arg)
 {
     int res = ERRNO_NONE;
     int i = 0;
-    int selectedChannel = -1;
     T31Video_t *pVideo = (T31Video_t *)arg;
 
     chn[0].payloadType = IMP_ENC_PROFILE_AVC_MAIN;
+#if ENABLE_SUB_STREAM_SWITCHING
+    chn[VIDEO_SUB_STREAM_CHN].payloadType = IMP_ENC_PROFILE_AVC_MAIN;
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
 
     if (pVideo == NULL)
     {
@@ -206,37 +641,60 @@ static void *videoThread(void *arg)
         {
             if (chn[i].enable)
             {
-                if (IMP_Encoder_CreateGroup(chn[i].index) < 0)
-                {
-                    printf("%s(): IMP_Encoder_CreateGroup(%d) error !\n", __FUNCTION__, chn[i].index);
-                    res = ERRNO_FAIL;
-                }
-                else
-                {
-                    selectedChannel = i;
-                }
+                pVideo->mainChn = i;
                 break;
             }
         }
 
+#if ENABLE_SUB_STREAM_SWITCHING
+        if (chn[VIDEO_SUB_STREAM_CHN].enable && VIDEO_SUB_STREAM_CHN != pVideo->mainChn)
+        {
+            pVideo->subChn = VIDEO_SUB_STREAM_CHN;
+        }
+        else
+        {
+            printf("%s(): Sub stream channel %d is not enabled, and only the main stream is sent\n", __FUNCTION__, VIDEO_SUB_STREAM_CHN);
+        }
+#endif /* ENABLE_SUB_STREAM_SWITCHING */
+
+        if (pVideo->mainChn < 0)
+        {
+            printf("%s(): No channel is enabled\n", __FUNCTION__);
+            res = ERRNO_FAIL;
+        }
+        else if (IMP_Encoder_CreateGroup(chn[pVideo->mainChn].index) < 0)
+        {
+            printf("%s(): IMP_Encoder_CreateGroup(%d) error !\n", __FUNCTION__, chn[pVideo->mainChn].index);
+            res = ERRNO_FAIL;
+        }
+        else if (pVideo->subChn >= 0 && IMP_Encoder_CreateGroup(chn[pVideo->subChn].index) < 0)
+        {
+            printf("%s(): IMP_Encoder_CreateGroup(%d) error !\n", __FUNCTION__, chn[pVideo->subChn].index);
+            res = ERRNO_FAIL;
+        }
+
         if (res != ERRNO_NONE)
         {
             printf("%s(): Encoder init failed\n", __FUNCTION__);
         }
-        else if (sample_encoder_init() < 0 || IMP_System_Bind(&chn[selectedChannel].framesource_chn, &chn[selectedChannel].imp_encoder) < 0 || sample_framesource_streamon() < 0)
+        else if (sample_encoder_init() < 0 || IMP_System_Bind(&chn[pVideo->mainChn].framesource_chn, &chn[pVideo->mainChn].imp_encoder) < 0 ||
+                 (pVideo->subChn >= 0 && IMP_System_Bind(&chn[pVideo->subChn].framesource_chn, &chn[pVideo->subChn].imp_encoder) < 0) ||
+                 sample_framesource_streamon() < 0)
         {
             printf("%s(): Encoder init failed\n", __FUNCTION__);
             res = ERRNO_FAIL;
         }
         else
         {
-            if (doVideoStreaming(selectedChannel, pVideo) != ERRNO_NONE)
+            if (doVideoStreaming(pVideo) != ERRNO_NONE)
             {
                 printf("%s(): ImpStreamOn failed\n", __FUNCTION__);
                 res = ERRNO_FAIL;
             }
 
-            if (sample_framesource_streamoff() < 0 || IMP_System_UnBind(&chn[i].framesource_chn, &chn[i].imp_encoder) < 0 || sample_encoder_exit() < 0 ||
+            if (sample_framesource_streamoff() < 0 ||
+                (pVideo->subChn >= 0 && IMP_System_UnBind(&chn[pVideo->subChn].framesource_chn, &chn[pVideo->subChn].imp_encoder) < 0) ||
+                IMP_System_UnBind(&chn[pVideo->mainChn].framesource_chn, &chn[pVideo->mainChn].imp_encoder) < 0 || sample_encoder_exit() < 0 ||
                 sample_framesource_exit() < 0 || sample_system_exit() < 0)
             {
                 printf("%s(): Failed to release video resource\n", __FUNCTION__);
@@ -245,7 +703,7 @@ static void *videoThread(void *arg)
         }
     }
 
-    if (pVideo != NULL && pVideo->isTerminating)
+    if (pVideo != NULL)
     {
         pVideo->isTerminated = true;
     }
@@ -271,6 +729,8 @@ T31VideoHandle T31Video_create(KvsAppHandle kvsAppHandle)
         pVideo->isTerminated = false;
 
         pVideo->kvsAppHandle = kvsAppHandle;
+        pVideo->mainChn = -1;
+        pVideo->subChn = -1;
 
         if (pthread_mutex_init(&(pVideo->lock), NULL) != 0)
         {
@@ -279,6 +739,13 @@ T31VideoHandle T31Video_create(KvsAppHandle kvsAppHandle)
         }
         else
         {
+#if ENABLE_BITRATE_ADAPTATION
+            if (KvsApp_setOnBitrateHintCallback(kvsAppHandle, onBitrateHint, pVideo) != 0)
+            {
+                printf("%s(): Failed to set bitrate hint callback\n", __FUNCTION__);
+            }
+#endif /* ENABLE_BITRATE_ADAPTATION */
+
             if (pthread_create(&(pVideo->tid), NULL, videoThread, pVideo) != 0)
             {
                 printf("%s(): Failed to create video thread\n", __FUNCTION__);
@@ -290,13 +757,27 @@ T31VideoHandle T31Video_create(KvsAppHandle kvsAppHandle)
     return pVideo;
 }
 
+void T31Video_stop(T31VideoHandle handle)
+{
+    T31Video_t *pVideo = (T31Video_t *)handle;
+
+    if (pVideo != NULL && !pVideo->isTerminating)
+    {
+#if ENABLE_BITRATE_ADAPTATION
+        KvsApp_setOnBitrateHintCallback(pVideo->kvsAppHandle, NULL, NULL);
+#endif /* ENABLE_BITRATE_ADAPTATION */
+
+        pVideo->isTerminating = true;
+    }
+}
+
 void T31Video_terminate(T31VideoHandle handle)
 {
     T31Video_t *pVideo = (T31Video_t *)handle;
 
     if (pVideo != NULL)
     {
-        pVideo->isTerminating = true;
+        T31Video_stop(pVideo);
         while (!pVideo->isTerminated)
         {
             prvSleepInMs(10);
@@ -419,10 +419,10 @@ int main(int argc, char *argv[])
                     }
                 }
 
-                if (getEpochTimestampInMs() > uLastPrintMemStatTimestamp + 1000)
+                if (getMonotonicTimeInMs() > uLastPrintMemStatTimestamp + 1000)
                 {
                     printf("Buffer memory used: %zu\n", KvsApp_getStreamMemStatTotal(kvsAppHandle));
-                    uLastPrintMemStatTimestamp = getEpochTimestampInMs();
+                    uLastPrintMemStatTimestamp = getMonotonicTimeInMs();
 #ifdef KVS_USE_POOL_ALLOCATOR
                     PoolStats_t stats = {0};
                     poolAllocatorGetStats(&stats);
@@ -0,0 +1,511 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "mbedtls/certs.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+#include "mock_server.h"
+
+#define ERRNO_NONE 0
+#define ERRNO_FAIL __LINE__
+
+#define MOCK_SERVER_HOST "127.0.0.1"
+#define MOCK_SERVER_RECV_BUFSIZE (16 * 1024)
+#define MOCK_SERVER_REQ_HDR_MAX_LEN (4 * 1024)
+#define MOCK_SERVER_ACK_MAX_LEN (256)
+
+#define HTTP_RSP_PUT_MEDIA "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n"
+#define HTTP_RSP_NOT_FOUND "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"
+#define HTTP_REQ_PUT_MEDIA "POST /putMedia "
+
+/* A cluster starts with its ID, an unknown size, and the timestamp element of 8 bytes. */
+static const uint8_t gClusterPrefix[] = {0x1F, 0x43, 0xB6, 0x75, 0xFF, 0xE7, 0x88};
+#define CLUSTER_TIMECODE_LEN (8)
+
+typedef enum
+{
+    CHUNK_SIZE = 0,
+    CHUNK_SIZE_EXT,
+    CHUNK_DATA,
+    CHUNK_DATA_CRLF,
+    CHUNK_END
+} ChunkState_t;
+
+typedef struct PutMediaSession
+{
+    mbedtls_ssl_context *pxSsl;
+
+    /* De-chunking of the request body */
+    ChunkState_t eChunkState;
+    size_t uChunkRemaining;
+
+    /* Matching of cluster headers across chunks */
+    size_t uPrefixMatched;
+    size_t uTimecodeMatched;
+    uint64_t uTimecode;
+
+    bool bHasFragment;
+    uint64_t uFragmentTimecode;
+    uint64_t uFragmentNumber;
+} PutMediaSession_t;
+
+typedef struct MockServer
+{
+    mbedtls_net_context xListenFd;
+    mbedtls_entropy_context xEntropy;
+    mbedtls_ctr_drbg_context xCtrDrbg;
+    mbedtls_ssl_config xConf;
+    mbedtls_x509_crt xCert;
+    mbedtls_pk_context xKey;
+} MockServer_t;
+
+static volatile sig_atomic_t gStopServer = 0;
+
+static void prvSignalHandler(int signum)
+{
+    (void)signum;
+    gStopServer = 1;
+}
+
+static int prvSslWriteAll(mbedtls_ssl_context *pxSsl, const uint8_t *pBuf, size_t uLen)
+{
+    int res = ERRNO_NONE;
+    int retVal = 0;
+    size_t uBytesSent = 0;
+
+    while (res == ERRNO_NONE && uBytesSent < uLen)
+    {
+        if ((retVal = mbedtls_ssl_write(pxSsl, pBuf + uBytesSent, uLen - uBytesSent)) > 0)
+        {
+            uBytesSent += (size_t)retVal;
+        }
+        else if (gStopServer || (retVal != MBEDTLS_ERR_SSL_WANT_READ && retVal != MBEDTLS_ERR_SSL_WANT_WRITE))
+        {
+            res = ERRNO_FAIL;
+        }
+    }
+
+    return res;
+}
+
+static int prvSendFragmentAck(PutMediaSession_t *pxSession, const char *pcEventType, uint64_t uFragmentTimecode)
+{
+    char pcAck[MOCK_SERVER_ACK_MAX_LEN];
+    char pcMsg[MOCK_SERVER_ACK_MAX_LEN];
+    int xMsgLen = 0;
+    int xAckLen = 0;
+
+    /* The same format as KVS, where each ack is a chunk of the response body. */
+    xMsgLen = snprintf(
+        pcMsg,
+        sizeof(pcMsg),
+        "{\"EventType\":\"%s\",\"FragmentTimecode\":%" PRIu64 ",\"FragmentNumber\":\"9134385233318150%021" PRIu64 "\"}",
+        pcEventType,
+        uFragmentTimecode,
+        pxSession->uFragmentNumber);
+    xAckLen = snprintf(pcAck, sizeof(pcAck), "%x\r\n%s\r\n", xMsgLen, pcMsg);
+
+    return prvSslWriteAll(pxSession->pxSsl, (const uint8_t *)pcAck, (size_t)xAckLen);
+}
+
+static int prvOnClusterStart(PutMediaSession_t *pxSession, uint64_t uTimecode)
+{
+    int res = ERRNO_NONE;
+
+    /* A fragment is received and persisted once the next one starts, and the new one is buffering. */
+    if (pxSession->bHasFragment &&
+        ((res = prvSendFragmentAck(pxSession, "RECEIVED", pxSession->uFragmentTimecode)) != ERRNO_NONE ||
+         (res = prvSendFragmentAck(pxSession, "PERSISTED", pxSession->uFragmentTimecode)) != ERRNO_NONE))
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        pxSession->bHasFragment = true;
+        pxSession->uFragmentTimecode = uTimecode;
+        pxSession->uFragmentNumber++;
+        res = prvSendFragmentAck(pxSession, "BUFFERING", uTimecode);
+    }
+
+    return res;
+}
+
+static int prvScanMkv(PutMediaSession_t *pxSession, const uint8_t *pData, size_t uLen)
+{
+    int res = ERRNO_NONE;
+    size_t i = 0;
+    uint8_t b = 0;
+
+    for (i = 0; i < uLen && res == ERRNO_NONE; i++)
+    {
+        b = pData[i];
+        if (pxSession->uPrefixMatched == sizeof(gClusterPrefix))
+        {
+            pxSession->uTimecode = (pxSession->uTimecode << 8) | b;
+            pxSession->uTimecodeMatched++;
+            if (pxSession->uTimecodeMatched == CLUSTER_TIMECODE_LEN)
+            {
+                res = prvOnClusterStart(pxSession, pxSession->uTimecode);
+                pxSession->uPrefixMatched = 0;
+                pxSession->uTimecodeMatched = 0;
+                pxSession->uTimecode = 0;
+            }
+        }
+        else if (b == gClusterPrefix[pxSession->uPrefixMatched])
+        {
+            pxSession->uPrefixMatched++;
+        }
+        else
+        {
+            /* The prefix doesn't repeat its first byte, so a mismatch only restarts at this byte. */
+            pxSession->uPrefixMatched = (b == gClusterPrefix[0]) ? 1 : 0;
+        }
+    }
+
+    return res;
+}
+
+static int prvParseHexDigit(uint8_t c)
+{
+    int xDigit = -1;
+
+    if (c >= '0' && c <= '9')
+    {
+        xDigit = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+        xDigit = c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+        xDigit = c - 'A' + 10;
+    }
+
+    return xDigit;
+}
+
+static int prvDechunk(PutMediaSession_t *pxSession, const uint8_t *pData, size_t uLen)
+{
+    int res = ERRNO_NONE;
+    size_t i = 0;
+    size_t uDataLen = 0;
+    int xDigit = 0;
+
+    while (i < uLen && res == ERRNO_NONE && pxSession->eChunkState != CHUNK_END)
+    {
+        switch (pxSession->eChunkState)
+        {
+            case CHUNK_SIZE:
+                if ((xDigit = prvParseHexDigit(pData[i])) >= 0)
+                {
+                    pxSession->uChunkRemaining = pxSession->uChunkRemaining * 16 + (size_t)xDigit;
+                }
+                else if (pData[i] == '\n')
+                {
+                    pxSession->eChunkState = (pxSession->uChunkRemaining == 0) ? CHUNK_END : CHUNK_DATA;
+                }
+                else
+                {
+                    pxSession->eChunkState = CHUNK_SIZE_EXT;
+                }
+                i++;
+                break;
+            case CHUNK_SIZE_EXT:
+                if (pData[i] == '\n')
+                {
+                    pxSession->eChunkState = (pxSession->uChunkRemaining == 0) ? CHUNK_END : CHUNK_DATA;
+                }
+                i++;
+                break;
+            case CHUNK_DATA:
+                uDataLen = (uLen - i < pxSession->uChunkRemaining) ? uLen - i : pxSession->uChunkRemaining;
+                res = prvScanMkv(pxSession, pData + i, uDataLen);
+                pxSession->uChunkRemaining -= uDataLen;
+                i += uDataLen;
+                if (pxSession->uChunkRemaining == 0)
+                {
+                    pxSession->eChunkState = CHUNK_DATA_CRLF;
+                }
+                break;
+            case CHUNK_DATA_CRLF:
+                if (pData[i] == '\n')
+                {
+                    pxSession->eChunkState = CHUNK_SIZE;
+                }
+                i++;
+                break;
+            default:
+                res = ERRNO_FAIL;
+                break;
+        }
+    }
+
+    return res;
+}
+
+static void prvServePutMedia(mbedtls_ssl_context *pxSsl, const uint8_t *pBody, size_t uBodyLen, uint8_t *pRecvBuf)
+{
+    PutMediaSession_t xSession = {0};
+    int retVal = 0;
+
+    xSession.pxSsl = pxSsl;
+    xSession.eChunkState = CHUNK_SIZE;
+
+    if (prvSslWriteAll(pxSsl, (const uint8_t *)HTTP_RSP_PUT_MEDIA, sizeof(HTTP_RSP_PUT_MEDIA) - 1) == ERRNO_NONE &&
+        prvDechunk(&xSession, pBody, uBodyLen) == ERRNO_NONE)
+    {
+        while (!gStopServer && xSession.eChunkState != CHUNK_END)
+        {
+            if ((retVal = mbedtls_ssl_read(pxSsl, pRecvBuf, MOCK_SERVER_RECV_BUFSIZE)) > 0)
+            {
+                if (prvDechunk(&xSession, pRecvBuf, (size_t)retVal) != ERRNO_NONE)
+                {
+                    break;
+                }
+            }
+            else if (retVal != MBEDTLS_ERR_SSL_WANT_READ && retVal != MBEDTLS_ERR_SSL_WANT_WRITE)
+            {
+                break;
+            }
+        }
+    }
+
+    /* The last fragment is complete when the stream ends. */
+    if (xSession.eChunkState == CHUNK_END && xSession.bHasFragment)
+    {
+        prvSendFragmentAck(&xSession, "RECEIVED", xSession.uFragmentTimecode);
+        prvSendFragmentAck(&xSession, "PERSISTED", xSession.uFragmentTimecode);
+    }
+}
+
+static void prvServeConnection(mbedtls_ssl_context *pxSsl, uint8_t *pRecvBuf)
+{
+    size_t uReqLen = 0;
+    char *pcHdrEnd = NULL;
+    int retVal = 0;
+
+    while ((retVal = mbedtls_ssl_handshake(pxSsl)) != 0)
+    {
+        if (gStopServer || (retVal != MBEDTLS_ERR_SSL_WANT_READ && retVal != MBEDTLS_ERR_SSL_WANT_WRITE))
+        {
+            return;
+        }
+    }
+
+    /* Requests are served one by one on a kept alive connection, until it's closed or it turns into PUT MEDIA. */
+    while (!gStopServer)
+    {
+        while (!gStopServer && (pcHdrEnd = strstr((char *)pRecvBuf, "\r\n\r\n")) == NULL && uReqLen < MOCK_SERVER_REQ_HDR_MAX_LEN)
+        {
+            if ((retVal = mbedtls_ssl_read(pxSsl, pRecvBuf + uReqLen, MOCK_SERVER_REQ_HDR_MAX_LEN - uReqLen)) > 0)
+            {
+                uReqLen += (size_t)retVal;
+                pRecvBuf[uReqLen] = '\0';
+            }
+            else if (retVal != MBEDTLS_ERR_SSL_WANT_READ && retVal != MBEDTLS_ERR_SSL_WANT_WRITE)
+            {
+                return;
+            }
+        }
+
+        if (pcHdrEnd == NULL)
+        {
+            break;
+        }
+        else if (strncmp((char *)pRecvBuf, HTTP_REQ_PUT_MEDIA, sizeof(HTTP_REQ_PUT_MEDIA) - 1) == 0)
+        {
+            pcHdrEnd += 4;
+            prvServePutMedia(pxSsl, (const uint8_t *)pcHdrEnd, uReqLen - (size_t)(pcHdrEnd - (char *)pRecvBuf), pRecvBuf);
+            break;
+        }
+        else if (prvSslWriteAll(pxSsl, (const uint8_t *)HTTP_RSP_NOT_FOUND, sizeof(HTTP_RSP_NOT_FOUND) - 1) != ERRNO_NONE)
+        {
+            break;
+        }
+        else
+        {
+            /* Requests other than PUT MEDIA are not expected to have a body. */
+            pcHdrEnd += 4;
+            uReqLen -= (size_t)(pcHdrEnd - (char *)pRecvBuf);
+            memmove(pRecvBuf, pcHdrEnd, uReqLen);
+            pRecvBuf[uReqLen] = '\0';
+        }
+    }
+
+    mbedtls_ssl_close_notify(pxSsl);
+}
+
+static int prvSetupServer(MockServer_t *pxServer, char *pcPort, size_t uPortSize)
+{
+    int res = ERRNO_NONE;
+    struct sockaddr_in xAddr = {0};
+    socklen_t xAddrLen = sizeof(xAddr);
+
+    mbedtls_net_init(&(pxServer->xListenFd));
+    mbedtls_entropy_init(&(pxServer->xEntropy));
+    mbedtls_ctr_drbg_init(&(pxServer->xCtrDrbg));
+    mbedtls_ssl_config_init(&(pxServer->xConf));
+    mbedtls_x509_crt_init(&(pxServer->xCert));
+    mbedtls_pk_init(&(pxServer->xKey));
+
+    if (mbedtls_ctr_drbg_seed(&(pxServer->xCtrDrbg), mbedtls_entropy_func, &(pxServer->xEntropy), NULL, 0) != 0 ||
+        mbedtls_x509_crt_parse(&(pxServer->xCert), (const unsigned char *)mbedtls_test_srv_crt, mbedtls_test_srv_crt_len) != 0 ||
+        mbedtls_pk_parse_key(&(pxServer->xKey), (const unsigned char *)mbedtls_test_srv_key, mbedtls_test_srv_key_len, NULL, 0) != 0)
+    {
+        printf("Failed to load the test certificate of mbedTLS\n");
+        res = ERRNO_FAIL;
+    }
+    else if (
+        mbedtls_ssl_config_defaults(&(pxServer->xConf), MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0 ||
+        mbedtls_ssl_conf_own_cert(&(pxServer->xConf), &(pxServer->xCert), &(pxServer->xKey)) != 0)
+    {
+        printf("Failed to configure TLS\n");
+        res = ERRNO_FAIL;
+    }
+    /* Port 0 binds an ephemeral port, so that benchmarks don't conflict with each other. */
+    else if (
+        mbedtls_net_bind(&(pxServer->xListenFd), MOCK_SERVER_HOST, "0", MBEDTLS_NET_PROTO_TCP) != 0 ||
+        getsockname(pxServer->xListenFd.fd, (struct sockaddr *)&xAddr, &xAddrLen) != 0)
+    {
+        printf("Failed to bind %s\n", MOCK_SERVER_HOST);
+        res = ERRNO_FAIL;
+    }
+    else
+    {
+        mbedtls_ssl_conf_rng(&(pxServer->xConf), mbedtls_ctr_drbg_random, &(pxServer->xCtrDrbg));
+        snprintf(pcPort, uPortSize, "%u", (unsigned int)ntohs(xAddr.sin_port));
+    }
+
+    return res;
+}
+
+static void prvTerminateServer(MockServer_t *pxServer)
+{
+    mbedtls_net_free(&(pxServer->xListenFd));
+    mbedtls_pk_free(&(pxServer->xKey));
+    mbedtls_x509_crt_free(&(pxServer->xCert));
+    mbedtls_ssl_config_free(&(pxServer->xConf));
+    mbedtls_ctr_drbg_free(&(pxServer->xCtrDrbg));
+    mbedtls_entropy_free(&(pxServer->xEntropy));
+}
+
+static void prvRunServer(MockServer_t *pxServer)
+{
+    mbedtls_net_context xClientFd;
+    mbedtls_ssl_context xSsl;
+    uint8_t *pRecvBuf = NULL;
+
+    mbedtls_net_init(&xClientFd);
+    mbedtls_ssl_init(&xSsl);
+
+    /* One more byte to terminate request headers. */
+    if ((pRecvBuf = (uint8_t *)malloc(MOCK_SERVER_RECV_BUFSIZE + 1)) == NULL)
+    {
+        printf("OOM: pRecvBuf\n");
+    }
+    else if (mbedtls_ssl_setup(&xSsl, &(pxServer->xConf)) != 0)
+    {
+        printf("Failed to setup TLS\n");
+    }
+    else
+    {
+        while (!gStopServer && mbedtls_net_accept(&(pxServer->xListenFd), &xClientFd, NULL, 0, NULL) == 0)
+        {
+            mbedtls_ssl_set_bio(&xSsl, &xClientFd, mbedtls_net_send, mbedtls_net_recv, NULL);
+            pRecvBuf[0] = '\0';
+            prvServeConnection(&xSsl, pRecvBuf);
+
+            mbedtls_net_free(&xClientFd);
+            mbedtls_ssl_session_reset(&xSsl);
+        }
+    }
+
+    mbedtls_ssl_free(&xSsl);
+    free(pRecvBuf);
+}
+
+int MockServer_start(char *pcPort, size_t uPortSize, pid_t *pxPid)
+{
+    int res = ERRNO_NONE;
+    MockServer_t xServer;
+    struct sigaction xAction = {0};
+    pid_t xPid = 0;
+
+    if (pcPort == NULL || uPortSize == 0 || pxPid == NULL)
+    {
+        res = ERRNO_FAIL;
+    }
+    /* The port is bound before fork, so it's accepting once this function returns. */
+    else if ((res = prvSetupServer(&xServer, pcPort, uPortSize)) != ERRNO_NONE)
+    {
+        prvTerminateServer(&xServer);
+    }
+    else if ((xPid = fork()) < 0)
+    {
+        printf("Failed to fork the mock server\n");
+        prvTerminateServer(&xServer);
+        res = ERRNO_FAIL;
+    }
+    else if (xPid == 0)
+    {
+        /* Without SA_RESTART, a blocking accept or read returns once the server is stopped. */
+        xAction.sa_handler = prvSignalHandler;
+        sigaction(SIGTERM, &xAction, NULL);
+        signal(SIGPIPE, SIG_IGN);
+
+        prvRunServer(&xServer);
+        prvTerminateServer(&xServer);
+        _exit(0);
+    }
+    else
+    {
+        /* The parent only keeps the child process. mbedtls_net_free() shuts the socket down for the child as well, so
+         * it's only closed here. */
+        close(xServer.xListenFd.fd);
+        xServer.xListenFd.fd = -1;
+        prvTerminateServer(&xServer);
+        *pxPid = xPid;
+    }
+
+    return res;
+}
+
+void MockServer_stop(pid_t xPid)
+{
+    if (xPid > 0)
+    {
+        kill(xPid, SIGTERM);
+        waitpid(xPid, NULL, 0);
+    }
+}
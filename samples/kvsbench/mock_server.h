@@ -0,0 +1,43 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef MOCK_SERVER_H
+#define MOCK_SERVER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief Start a mock PUT MEDIA endpoint on 127.0.0.1
+ *
+ * The server runs in a child process, so that its CPU time and memory are not counted in the producer. It accepts one
+ * TLS connection at a time with the test certificate of mbedTLS, answers chunked PUT MEDIA requests with 200, and
+ * sends BUFFERING, RECEIVED and PERSISTED fragment acks for the clusters it receives. Other requests get 404.
+ *
+ * @param[out] pcPort Buffer of the ephemeral port that the server listens on
+ * @param[in] uPortSize Size of the buffer
+ * @param[out] pxPid Process ID of the server
+ * @return 0 on success, non-zero value otherwise
+ */
+int MockServer_start(char *pcPort, size_t uPortSize, pid_t *pxPid);
+
+/**
+ * @brief Stop the mock server and wait until it exits
+ *
+ * @param[in] xPid Process ID of the server
+ */
+void MockServer_stop(pid_t xPid);
+
+#endif /* MOCK_SERVER_H */
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVS_ALLOC_TRACE_H
+#define KVS_ALLOC_TRACE_H
+
+#include <stddef.h>
+
+/* Allocations are traced only if KVS lib is built with USE_ALLOC_TRACE, otherwise these APIs return
+ * KVS_ERROR_ALLOC_TRACE_NOT_ENABLED. */
+
+/* Max number of call sites that are traced separately. Allocations of further call sites are summed up in the last one,
+ * whose file is NULL. */
+#ifndef KVS_ALLOC_TRACE_MAX_SITES
+#define KVS_ALLOC_TRACE_MAX_SITES   (128)
+#endif
+
+/* Components of the allocations, which are told by the source directory of the call site */
+typedef enum KvsAllocComponent
+{
+    KVS_ALLOC_COMPONENT_STREAM = 0, /* Frames, spill and replay buffers in source/stream */
+    KVS_ALLOC_COMPONENT_NETIO,      /* Network I/O handles and TLS contexts in source/net/netio* */
+    KVS_ALLOC_COMPONENT_REST,       /* HTTP requests and responses of the KVS REST APIs, and the SigV4 signer */
+    KVS_ALLOC_COMPONENT_CREDENTIAL, /* IoT credentials in source/restful/iot */
+    KVS_ALLOC_COMPONENT_MKV,        /* MKV headers and track info in source/mkv */
+    KVS_ALLOC_COMPONENT_APP,        /* KvsApp and KvsMultiApp in source/app, including cached credentials */
+    KVS_ALLOC_COMPONENT_OTHER,      /* Everything else, like the codec parsers and the allocations of applications */
+    KVS_ALLOC_COMPONENT_COUNT
+} KvsAllocComponent_t;
+
+typedef struct KvsAllocStats
+{
+    size_t uAllocs;         /* Number of allocations, where a re-allocation counts as a free and an allocation */
+    size_t uFrees;          /* Number of frees */
+    size_t uLiveBlocks;     /* Number of blocks that are not freed yet */
+    size_t uLiveBytes;      /* Bytes of blocks that are not freed yet */
+    size_t uPeakLiveBytes;  /* High-water mark of live bytes */
+    size_t uSites;          /* Number of call sites */
+} KvsAllocStats_t;
+
+typedef struct KvsAllocSite
+{
+    const char *pcFile;
+    int line;
+    size_t uAllocs;
+    size_t uFrees;
+    size_t uBytes;          /* Bytes of all allocations */
+    size_t uLiveBytes;
+    size_t uPeakLiveBytes;
+    KvsAllocComponent_t xComponent;
+} KvsAllocSite_t;
+
+typedef struct KvsAllocFootprint
+{
+    size_t uLiveBytes[KVS_ALLOC_COMPONENT_COUNT];       /* Live bytes of each component */
+    size_t uPeakLiveBytes[KVS_ALLOC_COMPONENT_COUNT];   /* High-water mark of live bytes of each component */
+} KvsAllocFootprint_t;
+
+/**
+ * Get totals of all traced allocations.
+ *
+ * @param[out] pxStats Allocation statistics
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsAllocTraceGetStats(KvsAllocStats_t *pxStats);
+
+/**
+ * Get statistics of a call site. Call sites are indexed in the order of their first allocation.
+ *
+ * @param[in] uIdx Index of call site, which is less than uSites of kvsAllocTraceGetStats()
+ * @param[out] pxSite Statistics of the call site
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsAllocTraceGetSite(size_t uIdx, KvsAllocSite_t *pxSite);
+
+/**
+ * Get live bytes by component. Only the allocations of KVS lib are counted, so the heap that mbedTLS allocates by
+ * itself, like its record buffers, is not included in KVS_ALLOC_COMPONENT_NETIO unless mbedTLS is configured to
+ * allocate with kvsCalloc.
+ *
+ * @param[out] pxFootprint Footprint of each component
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsAllocTraceGetFootprint(KvsAllocFootprint_t *pxFootprint);
+
+/**
+ * Get the name of a component, like "stream".
+ *
+ * @param[in] xComponent Component
+ * @return Name of the component, or "unknown" if it's out of range
+ */
+const char *kvsAllocTraceComponentName(KvsAllocComponent_t xComponent);
+
+/**
+ * Log totals, the footprint of each component and statistics of all call sites.
+ */
+void kvsAllocTraceDump(void);
+
+#endif /* KVS_ALLOC_TRACE_H */
@@ -16,6 +16,8 @@
 #ifndef KVS_ERRORS_H
 #define KVS_ERRORS_H
 
+#include "kvs/kvs_config.h"
+
 typedef enum KvsModule {
     KVS_MODULE_COMMON = 0,
     KVS_MODULE_RESTFUL = 1,
@@ -48,6 +50,13 @@ typedef enum KvsModule {
 #define KVS_ERROR_C_UTIL_UNABLE_TO_CREATE_BUFFER        (-(KVS_ERROR_COMMON_BASE + 0x0006))
 #define KVS_ERROR_C_UTIL_UNABLE_TO_ENLARGE_BUFFER       (-(KVS_ERROR_COMMON_BASE + 0x0007))
 #define KVS_ERROR_TLSF_FAILED_TO_CREATE_POOL            (-(KVS_ERROR_COMMON_BASE + 0x0008))
+#define KVS_ERROR_EVENT_ERROR                           (-(KVS_ERROR_COMMON_BASE + 0x0009))
+#define KVS_ERROR_THREAD_ERROR                          (-(KVS_ERROR_COMMON_BASE + 0x000A))
+#define KVS_ERROR_CRYPTO_ENGINE_ERROR                   (-(KVS_ERROR_COMMON_BASE + 0x000B))
+#define KVS_ERROR_ALLOC_TRACE_NOT_ENABLED               (-(KVS_ERROR_COMMON_BASE + 0x000C))
+#define KVS_ERROR_TRACEPOINTS_NOT_ENABLED               (-(KVS_ERROR_COMMON_BASE + 0x000D))
+#define KVS_ERROR_FEATURE_NOT_ENABLED                   (-(KVS_ERROR_COMMON_BASE + 0x000E))
+#define KVS_ERROR_MEMORY_BUDGET_EXCEEDED                (-(KVS_ERROR_COMMON_BASE + 0x000F))
 
 /* Transport layer errors */
 #define KVS_ERROR_NETIO_SEND_MORE_THAN_REMAINING_DATA   (-(KVS_ERROR_COMMON_BASE + 0x0041))
@@ -55,6 +64,8 @@ typedef enum KvsModule {
 #define KVS_ERROR_NETIO_UNABLE_TO_SET_SEND_TIMEOUT      (-(KVS_ERROR_COMMON_BASE + 0x0043))
 #define KVS_ERROR_UNKNOWN_MBEDTLS_MESSAGE_DIGEST        (-(KVS_ERROR_COMMON_BASE + 0x0044))
 #define KVS_ERROR_INVALID_MBEDTLS_MESSAGE_DIGEST_SIZE   (-(KVS_ERROR_COMMON_BASE + 0x0045))
+#define KVS_ERROR_NETIO_CONNECT_TIMEOUT                 (-(KVS_ERROR_COMMON_BASE + 0x0046))
+#define KVS_ERROR_NETIO_CONNECT_NOT_STARTED             (-(KVS_ERROR_COMMON_BASE + 0x0047))
 
 /* RESTful and HTTP errors */
 #define KVS_ERROR_UNABLE_TO_GET_HTTP_HEADER_COUNT       (-(KVS_ERROR_COMMON_BASE + 0x0101))
@@ -79,6 +90,11 @@ typedef enum KvsModule {
 #define KVS_ERROR_FAIL_TO_CREATE_PUT_MEDIA_HANDLE       (-(KVS_ERROR_COMMON_BASE + 0x0114))
 #define KVS_ERROR_NO_PUTMEDIA_FRAGMENT_ACK_AVAILABLE    (-(KVS_ERROR_COMMON_BASE + 0x0115))
 #define KVS_ERROR_NO_AWS_ACCESS_KEY_OR_SECRET_KEY       (-(KVS_ERROR_COMMON_BASE + 0x0116))
+#define KVS_ERROR_INCOMPLETE_FRAGMENT_ACK               (-(KVS_ERROR_COMMON_BASE + 0x0117))
+#define KVS_ERROR_TOO_MANY_HTTP_HEADERS                 (-(KVS_ERROR_COMMON_BASE + 0x0118))
+#define KVS_ERROR_HTTP_REQ_BUFFER_TOO_SMALL             (-(KVS_ERROR_COMMON_BASE + 0x0119))
+#define KVS_ERROR_JSON_INVALID                          (-(KVS_ERROR_COMMON_BASE + 0x011A))
+#define KVS_ERROR_JSON_TOO_MANY_TOKENS                  (-(KVS_ERROR_COMMON_BASE + 0x011B))
 
 /* MKV errors */
 #define KVS_ERROR_MKV_UNKNOWN_CLUSTER_TYPE              (-(KVS_ERROR_COMMON_BASE + 0x0201))
@@ -89,6 +105,8 @@ typedef enum KvsModule {
 #define KVS_ERROR_EXCEED_MAX_NALU_COUNT_LIMIT           (-(KVS_ERROR_COMMON_BASE + 0x0206))
 #define KVS_ERROR_NO_ENOUGH_SPACE_FOR_NALU_CONVERSION   (-(KVS_ERROR_COMMON_BASE + 0x0207))
 #define KVS_ERROR_MKV_INVALID_AUDIO_FREQUENCY           (-(KVS_ERROR_COMMON_BASE + 0x0208))
+#define KVS_ERROR_MKV_INVALID_LACING                    (-(KVS_ERROR_COMMON_BASE + 0x0209))
+#define KVS_ERROR_SPS_IS_BROKEN                         (-(KVS_ERROR_COMMON_BASE + 0x020A))
 
 /* Streaming errors */
 #define KVS_ERROR_STREAM_MKV_IS_NOT_INITIALIZED         (-(KVS_ERROR_COMMON_BASE + 0x0301))
@@ -99,9 +117,20 @@ typedef enum KvsModule {
 #define KVS_ERROR_ADD_FRAME_WHOSE_TIMESTAMP_GOES_BACK   (-(KVS_ERROR_COMMON_BASE + 0x0306))
 #define KVS_ERROR_STREAM_NOT_READY                      (-(KVS_ERROR_COMMON_BASE + 0x0307))
 #define KVS_ERROR_FAIL_TO_ADD_DATA_FRAME_TO_STREAM      (-(KVS_ERROR_COMMON_BASE + 0x0308))
+#define KVS_ERROR_STREAM_INGEST_RING_FULL               (-(KVS_ERROR_COMMON_BASE + 0x0309))
+#define KVS_ERROR_STREAM_SPILL_IO_ERROR                 (-(KVS_ERROR_COMMON_BASE + 0x030A))
+#define KVS_ERROR_STREAM_SPILL_FULL                     (-(KVS_ERROR_COMMON_BASE + 0x030B))
+#define KVS_ERROR_STREAM_RECORDER_IO_ERROR              (-(KVS_ERROR_COMMON_BASE + 0x030C))
+#define KVS_ERROR_STREAM_MKV_FILE_IO_ERROR              (-(KVS_ERROR_COMMON_BASE + 0x030D))
+#define KVS_ERROR_STREAM_MKV_FILE_IS_BROKEN             (-(KVS_ERROR_COMMON_BASE + 0x030E))
 
 /* KVS application errors */
 #define KVS_ERROR_KVSAPP_UNKNOWN_DO_WORK_TYPE           (-(KVS_ERROR_COMMON_BASE + 0x0341))
+#define KVS_ERROR_KVSAPP_WORKER_ALREADY_STARTED         (-(KVS_ERROR_COMMON_BASE + 0x0342))
+#define KVS_ERROR_KVSMULTIAPP_NO_AVAILABLE_SLOT         (-(KVS_ERROR_COMMON_BASE + 0x0343))
+#define KVS_ERROR_KVSMULTIAPP_APP_NOT_FOUND             (-(KVS_ERROR_COMMON_BASE + 0x0344))
+#define KVS_ERROR_KVSAPP_UPLOAD_WHILE_OPEN              (-(KVS_ERROR_COMMON_BASE + 0x0345))
+#define KVS_ERROR_KVSAPP_UPLOAD_ACK_TIMEOUT             (-(KVS_ERROR_COMMON_BASE + 0x0346))
 
 #define KVS_ERRNO_NONE      0
 #define KVS_ERRNO_FAIL      KVS_ERROR_GENERIC
@@ -16,6 +16,8 @@
 #ifndef _AWS_IOT_CREDENTIAL_PROVIDER_H_
 #define _AWS_IOT_CREDENTIAL_PROVIDER_H_
 
+#include <stdint.h>
+
 typedef struct
 {
     char *pCredentialHost;
@@ -24,6 +26,9 @@ typedef struct
     char *pRootCA;
     char *pCertificate;
     char *pPrivateKey;
+
+    /* TLS max fragment length (512, 1024, 2048 or 4096) to negotiate, or 0 not to negotiate it */
+    unsigned int uTlsMaxFragLen;
 } IotCredentialRequest_t;
 
 typedef struct
@@ -31,6 +36,9 @@ typedef struct
     char *pAccessKeyId;
     char *pSecretAccessKey;
     char *pSessionToken;
+
+    /* Epoch time in milliseconds when the credential expires, or 0 if it's unknown */
+    uint64_t uExpirationMs;
 } IotCredentialToken_t;
 
 /**
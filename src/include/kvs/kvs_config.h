@@ -0,0 +1,70 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVS_CONFIG_H
+#define KVS_CONFIG_H
+
+/* Compile-time feature switches of KVS lib. Each of them can be set with a compiler definition, or in a header that
+ * is named by KVS_USER_CONFIG_FILE, e.g. -DKVS_USER_CONFIG_FILE=\"my_kvs_config.h\". A subsystem that is switched off
+ * is not compiled, and the options of it are unknown to KvsApp_setoption(). The lib and the application have to be
+ * built with the same switches. */
+
+#ifdef KVS_USER_CONFIG_FILE
+#include KVS_USER_CONFIG_FILE
+#endif
+
+/* Audio track and audio lacing. Without it, OPTION_KVS_AUDIO_TRACK_INFO and OPTION_STREAM_AUDIO_LACE_DURATION_MS are
+ * unknown, and audio frames are rejected. */
+#ifndef KVS_CONFIG_AUDIO
+#define KVS_CONFIG_AUDIO 1
+#endif
+
+/* Getting credentials from the AWS IoT credential provider. Without it, OPTION_IOT_* are unknown, and only the AWS
+ * access key and secret key can be used. */
+#ifndef KVS_CONFIG_IOT_CREDENTIAL
+#define KVS_CONFIG_IOT_CREDENTIAL 1
+#endif
+
+/* STREAM_POLICY_RING_BUFFER. Without it, the policy is rejected and OPTION_STREAM_POLICY_RING_BUFFER_* are unknown. */
+#ifndef KVS_CONFIG_RING_BUFFER_POLICY
+#define KVS_CONFIG_RING_BUFFER_POLICY 1
+#endif
+
+/* The memory budget of kvs/mem_budget.h. Every allocation of KVS lib is prefixed by its size, so it's off by default. */
+#ifndef KVS_CONFIG_MEM_BUDGET
+#define KVS_CONFIG_MEM_BUDGET 0
+#endif
+
+#define KVS_LOG_LEVEL_NONE 0
+#define KVS_LOG_LEVEL_ERROR 1
+#define KVS_LOG_LEVEL_INFO 2
+
+/* Logs below this level are not compiled, so their format strings don't take any flash. */
+#ifndef KVS_CONFIG_LOG_LEVEL
+#define KVS_CONFIG_LOG_LEVEL KVS_LOG_LEVEL_INFO
+#endif
+
+#if KVS_CONFIG_LOG_LEVEL < KVS_LOG_LEVEL_INFO
+/* The log macros of the lib come from xlogging.h, which is included first so they're not defined again later. */
+#include "azure_c_shared_utility/xlogging.h"
+#undef LogInfo
+#define LogInfo(...) ((void)0)
+#if KVS_CONFIG_LOG_LEVEL < KVS_LOG_LEVEL_ERROR
+#undef LogError
+#define LogError(...) ((void)0)
+#endif
+#endif
+
+#endif /* KVS_CONFIG_H */
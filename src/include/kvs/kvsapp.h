@@ -18,7 +18,10 @@
 
 #include "kvs/kvsapp_options.h"
 #include "kvs/mkv_generator.h"
+#include "kvs/nalu.h"
+#include "kvs/port.h"
 #include "kvs/restapi.h"
+#include "kvs/stream.h"
 #include "kvs/errors.h"
 #include <inttypes.h>
 
@@ -58,6 +61,70 @@ typedef int (*OnDataFrameToBeSentCallback_t)(uint8_t *pData, size_t uDataLen, ui
  */
 typedef int (*OnMkvSentCallback_t)(uint8_t *pData, size_t uDataLen, void *pAppData);
 
+/**
+ * This callback is called whenever the cached data endpoint is resolved or invalidated. Application can persist it and
+ * set it back with OPTION_KVS_DATA_ENDPOINT after reboot.
+ *
+ * @param[in] pcDataEndpoint The data endpoint, or NULL if it's invalidated
+ * @param[in] pAppData Pointer of application data that is assigned in function KvsApp_setOnDataEndpointUpdatedCallback()
+ */
+typedef int (*OnDataEndpointUpdatedCallback_t)(const char *pcDataEndpoint, void *pAppData);
+
+/**
+ * This callback is called periodically with a bitrate that the uplink is expected to sustain. The estimate comes from
+ * the bytes sent, the time blocked in sending, and the growth of the stream buffer, so encoder can lower its bitrate
+ * before the buffer is full and data frames are evicted. It's called in the context of KvsApp_doWork().
+ *
+ * @param[in] uBitrateBps The suggested bitrate in bits per second, with headroom below the estimated throughput
+ * @param[in] pAppData Pointer of application data that is assigned in function KvsApp_setOnBitrateHintCallback()
+ */
+typedef int (*OnBitrateHintCallback_t)(uint32_t uBitrateBps, void *pAppData);
+
+typedef enum KvsAppBackpressure
+{
+    /* The stream has room. */
+    KVS_APP_BACKPRESSURE_NONE = 0,
+
+    /* The stream is filling up, e.g. skip non-reference frames or lower the frame rate. */
+    KVS_APP_BACKPRESSURE_HIGH,
+
+    /* The stream is about to evict or reject data frames, e.g. send keyframes only. */
+    KVS_APP_BACKPRESSURE_CRITICAL
+} KvsAppBackpressure_t;
+
+/**
+ * This callback is called when the backpressure level of the stream changes, so encoder can lower its frame rate or
+ * skip frames at the source instead of having them queued and then evicted. It's called in the context of
+ * KvsApp_addFrame() and its variants, so it must not block.
+ *
+ * @param[in] xLevel The new backpressure level
+ * @param[in] uPercent How full the stream is, in percent of what its policy or the memory budget allows
+ * @param[in] pAppData Pointer of application data that is assigned in function KvsApp_setOnBackpressureCallback()
+ */
+typedef int (*OnBackpressureCallback_t)(KvsAppBackpressure_t xLevel, unsigned int uPercent, void *pAppData);
+
+/**
+ * This callback is called for every fragment ack right after it's parsed, in the context of KvsApp_doWork(), so it
+ * must not block.
+ *
+ * @param[in] eAckEventType The event type of the ack
+ * @param[in] uFragmentTimecode The fragment timecode of the ack
+ * @param[in] uErrorId The error ID of an eError ack, or 0 otherwise
+ * @param[in] pAppData Pointer of application data that is assigned in function KvsApp_setOnFragmentAckCallback()
+ */
+typedef void (*OnFragmentAckCallback_t)(ePutMediaFragmentAckEventType eAckEventType, uint64_t uFragmentTimecode, unsigned int uErrorId, void *pAppData);
+
+typedef struct KvsAppMetrics KvsAppMetrics_t;
+
+/**
+ * This callback is called periodically with a snapshot of the metrics, so an agent can ship them without parsing logs.
+ * It's called in the context of KvsApp_doWork().
+ *
+ * @param[in] pxMetrics The metrics, which are only valid in the callback
+ * @param[in] pAppData Pointer of application data that is assigned in function KvsApp_setOnMetricsCallback()
+ */
+typedef int (*OnMetricsCallback_t)(const KvsAppMetrics_t *pxMetrics, void *pAppData);
+
 typedef struct OnDataFrameTerminateCallbackInfo
 {
     OnDataFrameTerminateCallback_t onDataFrameTerminate;
@@ -76,6 +143,130 @@ typedef struct DataFrameCallbacks
     OnDataFrameToBeSentInfo_t onDataFrameToBeSentInfo;
 } DataFrameCallbacks_t;
 
+typedef struct KvsAppStreamStats
+{
+    /* Statistics of queued data frames */
+    StreamStats_t xStreamStats;
+
+    /* The number of data frames evicted or dropped by stream policy since the last reset */
+    size_t uEvictedFrameCount;
+
+    /* The number of data frames sent since the last reset */
+    size_t uSentFrameCount;
+
+    /* The estimated uplink throughput in bits per second, or 0 if it's unknown yet */
+    uint32_t uUplinkBps;
+} KvsAppStreamStats_t;
+
+typedef struct KvsAppSnapshot
+{
+    /* The keyframe in the application's buffer, which must not be modified */
+    const uint8_t *pData;
+    size_t uDataLen;
+
+    /* true if the keyframe is in Annex-B format, or false if it's in AVCC format */
+    bool bIsAnnexB;
+
+    uint64_t uTimestampMs;
+
+    /* The codec private data of the track, i.e. the SPS and PPS of H.264 in AVCC decoder configuration record format */
+    const uint8_t *pCodecPrivate;
+    size_t uCodecPrivateLen;
+} KvsAppSnapshot_t;
+
+typedef struct KeyframeSnapshot *KvsAppSnapshotHandle;
+
+typedef struct KvsAppLatency
+{
+    /* The number of samples since the last reset */
+    uint32_t uSampleCount;
+
+    /* Percentiles of the latest samples, and the max of all samples since the last reset */
+    uint32_t uP50Ms;
+    uint32_t uP95Ms;
+    uint32_t uMaxMs;
+} KvsAppLatency_t;
+
+typedef struct KvsAppLatencyStats
+{
+    /* Latency from the time a cluster is added to the time it's sent completely */
+    KvsAppLatency_t xSent;
+
+    /* Latency from the time a cluster is added to the time its BUFFERING, RECEIVED and PERSISTED acks arrive */
+    KvsAppLatency_t xBuffering;
+    KvsAppLatency_t xReceived;
+    KvsAppLatency_t xPersisted;
+} KvsAppLatencyStats_t;
+
+/* Send calls are counted by duration. Bucket 0 is under 1 ms, bucket i is [2^(i-1), 2^i) ms, and the last one has the
+ * rest. */
+#define KVS_APP_SEND_LATENCY_BUCKET_COUNT       ( 12 )
+
+typedef enum KvsAppRestApi
+{
+    KVS_APP_REST_IOT_CREDENTIAL = 0,
+    KVS_APP_REST_DESCRIBE_STREAM,
+    KVS_APP_REST_CREATE_STREAM,
+    KVS_APP_REST_GET_DATA_ENDPOINT,
+    KVS_APP_REST_PUT_MEDIA,
+    KVS_APP_REST_API_COUNT
+} KvsAppRestApi_t;
+
+typedef struct KvsAppRestMetrics
+{
+    uint32_t uCallCount;
+    uint32_t uFailureCount;
+
+    /* Time from the start of a call to its response, including DNS, TCP and TLS of its connection */
+    uint32_t uLastLatencyMs;
+    uint32_t uMaxLatencyMs;
+    uint64_t uTotalLatencyMs;
+} KvsAppRestMetrics_t;
+
+typedef struct KvsAppTrackMetrics
+{
+    /* Data frames, and their MKV bytes including their headers, sent from the stream or the spill buffer */
+    uint64_t uSentFrameCount;
+    uint64_t uSentBytes;
+} KvsAppTrackMetrics_t;
+
+/* All counters are accumulated since the handle is created, and they're never reset. */
+struct KvsAppMetrics
+{
+    KvsAppTrackMetrics_t xVideo;
+    KvsAppTrackMetrics_t xAudio;
+
+    /* Bytes sent again from the replay buffer after reconnection */
+    uint64_t uReplayedBytes;
+
+    /* Durations of the PUT MEDIA calls that send data frames, spilled records and replayed bytes */
+    uint32_t puSendLatencyHistogram[KVS_APP_SEND_LATENCY_BUCKET_COUNT];
+
+    /* TLS records sent by PUT MEDIA connections, or 0 if the transport doesn't count them */
+    uint64_t uTlsRecordCount;
+
+    /* A reconnection is the time from closing an established PUT MEDIA connection to establishing the next one. */
+    uint32_t uReconnectCount;
+    uint32_t uLastReconnectMs;
+    uint64_t uTotalReconnectMs;
+
+    KvsAppRestMetrics_t xRest[KVS_APP_REST_API_COUNT];
+
+    /* Data frames evicted or dropped by stream policy */
+    uint64_t uEvictedFrameCount;
+
+    /* Skips to a later keyframe because the stream fell behind, and data frames dropped by them, which are also counted
+     * in uEvictedFrameCount */
+    uint32_t uLatencyDropCount;
+    uint64_t uLatencyDroppedFrameCount;
+
+    /* Fragment acks indexed by ePutMediaFragmentAckEventType */
+    uint32_t puAckCount[eIdle + 1];
+
+    /* The high-water mark of live bytes allocated by the library, or 0 unless it's built with USE_ALLOC_TRACE */
+    size_t uAllocPeakBytes;
+};
+
 typedef enum DoWorkExType
 {
     /* The default behaviro is the same as KvsApp_doWork. */
@@ -90,6 +281,32 @@ typedef struct DoWorkExParamter
     DoWorkExType_t eType;
 } DoWorkExParamter_t;
 
+typedef struct KvsAppWorkerParameter
+{
+    /* Stack size of the worker thread in bytes, or 0 for the platform default */
+    size_t uStackSize;
+
+    /* The core to pin the worker thread on, or -1 for no affinity */
+    int xCoreId;
+
+    /* The delay before reconnection starts from the min value, and doubles on each failure up to the max value. */
+    unsigned int uReconnectMinBackoffMs;
+    unsigned int uReconnectMaxBackoffMs;
+} KvsAppWorkerParameter_t;
+
+typedef struct KvsAppUploadParameter
+{
+    /* The size of HTTP chunks that the file is sent in, or 0 for 256 KB */
+    size_t uChunkSize;
+
+    /* How long to wait for the last fragment to be persisted after the file is sent, or 0 for 30 seconds */
+    unsigned int uAckTimeoutMs;
+
+    /* The timecode of the last persisted fragment, or 0 to upload the whole file. Clusters up to it are skipped, and
+     * it's updated with the persisted acks of the upload, so a failed upload can be resumed with it. */
+    uint64_t uPersistedTimecodeMs;
+} KvsAppUploadParameter_t;
+
 /**
  * Create a KVS application.
  *
@@ -118,10 +335,38 @@ void KvsApp_terminate(KvsAppHandle handle);
  */
 int KvsApp_setoption(KvsAppHandle handle, const char *pcOptionName, const char *pValue);
 
+/**
+ * Set an integer option to KVS application without matching its name. It's safe to call from any thread, e.g. the
+ * capture thread while KvsApp_doWork() runs in another, and the connection lock is only held while the option is
+ * stored.
+ *
+ * @param[in] handle KVS application handle
+ * @param[in] xOptionId Option ID, one of the integer options of KvsApp_optionId_t
+ * @param[in] iValue Value, which must fit the type of the string option
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_setOptionInt(KvsAppHandle handle, KvsApp_optionId_t xOptionId, int64_t iValue);
+
+/**
+ * Set a pointer option to KVS application without matching its name. The value is copied.
+ *
+ * @param[in] handle KVS application handle
+ * @param[in] xOptionId Option ID, one of the pointer options of KvsApp_optionId_t
+ * @param[in] pValue Value
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_setOptionPtr(KvsAppHandle handle, KvsApp_optionId_t xOptionId, const void *pValue);
+
 /**
  * Open KVS application. It includes validating if stream exist, getting PUT_MEDIA data endpoint, and setup PUT_MEDIA
  * connection. It also tries to setup stream buffer if track info are already set.
  *
+ * If OPTION_KVS_ASYNC_OPEN is set, it returns once the PUT_MEDIA connection is started, and KvsApp_doWork() finishes
+ * the connection without blocking. Errors of the connection are returned by KvsApp_doWork() then.
+ *
+ * If OPTION_KVS_FAST_OPEN is set, DNS lookups, the IoT credential and the PUT_MEDIA connection overlap each other, and
+ * DescribeStream is only called if the stream has to be created.
+ *
  * @param[in] handle KVS application handle.
  * @return 0 on success, non-zero value otherwise
  */
@@ -164,6 +409,72 @@ int KvsApp_addFrame(KvsAppHandle handle, uint8_t *pData, size_t uDataLen, size_t
  */
 int KvsApp_addFrameWithCallbacks(KvsAppHandle handle, uint8_t *pData, size_t uDataLen, size_t uDataSize, uint64_t uTimestamp, TrackType_t xTrackType, DataFrameCallbacks_t *pCallbacks);
 
+/**
+ * Add a frame that has headroom in front of it to KVS application. The MKV header and the HTTP chunk size line are
+ * written into the headroom, and the HTTP chunk end is written right after the frame if the buffer has room for it,
+ * so the frame is sent as one contiguous buffer without copy. Headroom of Mkv_getClusterHdrLen(MKV_CLUSTER) +
+ * PUT_MEDIA_CHUNK_SIZE_LINE_MAX_LEN bytes is enough for any frame, and a frame with less headroom is sent in the same
+ * way as KvsApp_addFrameWithCallbacks().
+ *
+ * The frame must not be modified until it's terminated. The terminate callback is invoked with pBuf rather than the
+ * frame.
+ *
+ * @param[in] handle KVS application handle
+ * @param[in] pBuf Buffer pointer, and the frame starts at pBuf + uHeadroom
+ * @param[in] uHeadroom The number of bytes in front of the frame that can be overwritten
+ * @param[in] uDataLen Data length
+ * @param[in] uBufSize Buffer size, including the headroom
+ * @param[in] uTimestamp Frame absolution timestamp in milliseconds.
+ * @param[in] xTrackType Track type, it could be TRACK_VIDEO or TRACK_AUDIO
+ * @param[in] pCallbacks Callbacks, or NULL to use default callbacks
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_addFrameWithHeadroom(KvsAppHandle handle, uint8_t *pBuf, size_t uHeadroom, size_t uDataLen, size_t uBufSize, uint64_t uTimestamp, TrackType_t xTrackType, DataFrameCallbacks_t *pCallbacks);
+
+/**
+ * Add a video frame that has been analyzed by NALU_analyzeFrame() to KVS application, so the frame is not parsed again.
+ * It's for frames that are analyzed once and shared with other consumers, e.g. the frame fan-out of the samples. An
+ * AVCC frame is never modified unless the NALU filter is set, so a read-only frame shared by other consumers can be
+ * added as long as it's kept alive until it's terminated.
+ *
+ * @param[in] handle KVS application handle
+ * @param[in] pData Data buffer pointer
+ * @param[in] uDataLen Data length, which must be the length of the frame info
+ * @param[in] uDataSize Data buffer size
+ * @param[in] uTimestamp Frame absolution timestamp in milliseconds.
+ * @param[in] pxFrameInfo Frame info of the frame, or NULL to analyze the frame here
+ * @param[in] pCallbacks Callbacks, or NULL to use default callbacks
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_addVideoFrameWithFrameInfo(
+    KvsAppHandle handle,
+    uint8_t *pData,
+    size_t uDataLen,
+    size_t uDataSize,
+    uint64_t uTimestamp,
+    const NaluFrameInfo_t *pxFrameInfo,
+    DataFrameCallbacks_t *pCallbacks);
+
+/**
+ * Add a frame that is made of non-contiguous segments to KVS application, e.g. the packs of an encoder, or a frame that
+ * wraps around a ring buffer. The segments are kept by the stream as they are, and they're sent to the socket in order
+ * without being gathered into one buffer.
+ *
+ * Each segment of a video frame starts at a NALU boundary, and it's analyzed and converted to AVCC in place, so an
+ * Annex-B segment must use 4 bytes start codes. The segments must not be modified until the frame is terminated. The
+ * terminate callback is invoked with the first segment and the frame length. The segments are owned by the
+ * application, so nothing is freed if pCallbacks is NULL. Audio frames of segments are not laced.
+ *
+ * @param[in] handle KVS application handle
+ * @param[in] pxSegments Segments of the frame in order
+ * @param[in] uSegmentCount The number of segments, which is no more than DATA_FRAME_MAX_SEGMENTS
+ * @param[in] uTimestamp Frame absolution timestamp in milliseconds.
+ * @param[in] xTrackType Track type, it could be TRACK_VIDEO or TRACK_AUDIO
+ * @param[in] pCallbacks Callbacks, or NULL if the segments don't need to be released
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_addFrameV(KvsAppHandle handle, const DataFrameSegment_t *pxSegments, size_t uSegmentCount, uint64_t uTimestamp, TrackType_t xTrackType, DataFrameCallbacks_t *pCallbacks);
+
 /**
  * Let KVS application do works. It will try to send out frames, and check if any messages from server.
  *
@@ -203,6 +514,85 @@ int KvsApp_readFragmentAck(KvsAppHandle handle, ePutMediaFragmentAckEventType *p
  */
 size_t KvsApp_getStreamMemStatTotal(KvsAppHandle handle);
 
+/**
+ * Get the statistics of the stream buffer.
+ *
+ * It returns queued frames and bytes per track, the oldest and newest queued timestamps, the max queue depth, and the
+ * number of frames evicted and sent since the last reset. All of them are updated incrementally, so it's cheap to be
+ * polled periodically.
+ *
+ * @param[in] handle KVS application handle
+ * @param[out] pxStats The statistics
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_getStreamStats(KvsAppHandle handle, KvsAppStreamStats_t *pxStats);
+
+/**
+ * Get the end-to-end latency of clusters.
+ *
+ * A cluster is tracked from the time its key frame is added, and it's matched to fragment acks by its timecode. Acks
+ * are observed inside KvsApp_doWork(), so it works no matter whether KvsApp_readFragmentAck() is called.
+ *
+ * @param[in] handle KVS application handle
+ * @param[out] pxStats The latency statistics
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_getLatencyStats(KvsAppHandle handle, KvsAppLatencyStats_t *pxStats);
+
+/**
+ * Reset the max queue depth, the number of frames evicted and sent of the stream buffer, and the latency statistics.
+ *
+ * @param[in] handle KVS application handle
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_resetStreamStats(KvsAppHandle handle);
+
+/**
+ * Get a snapshot of the metrics.
+ *
+ * Counters are updated incrementally on the way, so it's cheap to be polled periodically.
+ *
+ * @param[in] handle KVS application handle
+ * @param[out] pxMetrics The metrics
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_getMetrics(KvsAppHandle handle, KvsAppMetrics_t *pxMetrics);
+
+/**
+ * Acquire the latest video keyframe, e.g. for a thumbnail or the first frame of a live view, without copying it.
+ *
+ * It's kept only if OPTION_KVS_KEYFRAME_SNAPSHOT is enabled. The keyframe stays in the application's buffer, so the
+ * terminate callback of the keyframe is deferred until it has been sent or dropped, a later keyframe has replaced it,
+ * and every snapshot of it has been released. Then the callback is invoked by the thread that releases the last
+ * reference, which may be the caller of KvsApp_releaseKeyframeSnapshot(). Frames added by KvsApp_addFrameV() are not
+ * kept.
+ *
+ * @param[in] handle KVS application handle
+ * @param[out] pxSnapshotHandle The handle to be released by KvsApp_releaseKeyframeSnapshot()
+ * @param[out] pxSnapshot The keyframe, which is valid until it's released
+ * @return 0 on success, KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME if no keyframe is kept, non-zero value otherwise
+ */
+int KvsApp_acquireKeyframeSnapshot(KvsAppHandle handle, KvsAppSnapshotHandle *pxSnapshotHandle, KvsAppSnapshot_t *pxSnapshot);
+
+/**
+ * Release a snapshot acquired by KvsApp_acquireKeyframeSnapshot(). Every snapshot must be released before
+ * KvsApp_terminate().
+ *
+ * @param[in] xSnapshotHandle The snapshot handle
+ */
+void KvsApp_releaseKeyframeSnapshot(KvsAppSnapshotHandle xSnapshotHandle);
+
+/**
+ * Set onMetricsCallback. It's invoked with a snapshot of KvsApp_getMetrics() every interval.
+ *
+ * @param handle KVS application handle
+ * @param onMetrics Callback, or NULL to stop it
+ * @param uIntervalMs The interval in milliseconds
+ * @param pAppData The application data that will be passed in the argument of the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_setOnMetricsCallback(KvsAppHandle handle, OnMetricsCallback_t onMetrics, unsigned int uIntervalMs, void *pAppData);
+
 /**
  * Set onMkvSentCallback. Whenever a data has been sent to PUT MEDIA endpoint, it'll invoke this callback.
  *
@@ -213,4 +603,110 @@ size_t KvsApp_getStreamMemStatTotal(KvsAppHandle handle);
  */
 int KvsApp_setOnMkvSentCallback(KvsAppHandle handle, OnMkvSentCallback_t onMkvSentCallback, void *pAppData);
 
+/**
+ * Set onDataEndpointUpdatedCallback. Whenever the cached data endpoint is resolved or invalidated, it'll invoke this
+ * callback.
+ *
+ * @param handle KVS application handle
+ * @param onDataEndpointUpdated Callback
+ * @param pAppData The application data that will be passed in the argument of the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_setOnDataEndpointUpdatedCallback(KvsAppHandle handle, OnDataEndpointUpdatedCallback_t onDataEndpointUpdated, void *pAppData);
+
+/**
+ * Set onBitrateHintCallback. It's invoked every OPTION_KVS_BITRATE_HINT_INTERVAL_MS while data frames are sent or piling
+ * up.
+ *
+ * @param handle KVS application handle
+ * @param onBitrateHint Callback
+ * @param pAppData The application data that will be passed in the argument of the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_setOnBitrateHintCallback(KvsAppHandle handle, OnBitrateHintCallback_t onBitrateHint, void *pAppData);
+
+/**
+ * Set onBackpressureCallback. It's invoked by the data frame that changes the backpressure level.
+ *
+ * The stream is measured against its policy, i.e. the memory limit of STREAM_POLICY_RING_BUFFER, the window of
+ * STREAM_POLICY_TIME_WINDOW or the pre-roll, and against the memory budget if it's enabled. The high level starts at
+ * 75 percent and the critical level at 90 percent, and each is left 10 percent below where it starts. Without any of
+ * them, the level stays KVS_APP_BACKPRESSURE_NONE.
+ *
+ * @param handle KVS application handle
+ * @param onBackpressure Callback
+ * @param pAppData The application data that will be passed in the argument of the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_setOnBackpressureCallback(KvsAppHandle handle, OnBackpressureCallback_t onBackpressure, void *pAppData);
+
+/**
+ * Get the backpressure level as of the last data frame added, which is cheap enough to be checked before encoding
+ * each frame.
+ *
+ * @param[in] handle KVS application handle
+ * @param[out] pxLevel The backpressure level
+ * @param[out] puPercent How full the stream is in percent, or NULL if it's not needed
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_getBackpressure(KvsAppHandle handle, KvsAppBackpressure_t *pxLevel, unsigned int *puPercent);
+
+/**
+ * Set onFragmentAckCallback. Acks are pushed to it instead of being queued, so KvsApp_readFragmentAck() has nothing to
+ * read while it's set. It takes effect on the next connection, so set it before KvsApp_open().
+ *
+ * @param handle KVS application handle
+ * @param onFragmentAck Callback, or NULL to queue acks for KvsApp_readFragmentAck() again
+ * @param pAppData The application data that will be passed in the argument of the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_setOnFragmentAckCallback(KvsAppHandle handle, OnFragmentAckCallback_t onFragmentAck, void *pAppData);
+
+/**
+ * Share a wake event with other KVS applications serviced by the same thread. Adding a frame signals this event instead
+ * of the internal one, and KvsApp_doWork() returns without waiting so the thread can wait on the shared event for all
+ * of them. The event must outlive its use, so set it back to NULL before it's terminated.
+ *
+ * @param handle KVS application handle
+ * @param xWakeEvent The shared event, or NULL to use the internal one
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_setSharedWakeEvent(KvsAppHandle handle, KvsEventHandle xWakeEvent);
+
+/**
+ * Start a worker thread that owns the connection. It opens KVS application, calls KvsApp_doWork() until it fails, then
+ * closes it and reconnects with backoff, until KvsApp_stopWorker() is called. Application only needs to add frames
+ * while the worker is running, and it must not call KvsApp_open(), KvsApp_close(), KvsApp_doWork() or
+ * KvsApp_readFragmentAck() by itself.
+ *
+ * @param[in] handle KVS application handle
+ * @param[in] pxPara Worker parameters, or NULL for the default values
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_startWorker(KvsAppHandle handle, KvsAppWorkerParameter_t *pxPara);
+
+/**
+ * Stop the worker thread and wait until it exits. The connection is closed, and the stream buffer is kept.
+ *
+ * @param[in] handle KVS application handle
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_stopWorker(KvsAppHandle handle);
+
+/**
+ * Upload an MKV file, e.g. one written by the recorder during an outage, on a PUT MEDIA connection of its own. Its
+ * clusters are sent as they are in large chunks, without being parsed into frames and packed again, so backfill is only
+ * limited by the bandwidth. It blocks until the last fragment is persisted, and the acks are also passed to the
+ * onFragmentAck callback.
+ *
+ * Timecodes of the file are sent as absolute ones, like the ones that are streamed. It shares the credentials and the
+ * data endpoint with the stream, so it can't be called while KVS application is open or the worker is running.
+ *
+ * @param[in] handle KVS application handle
+ * @param[in] pcFilename The MKV file name
+ * @param[in,out] pxPara Upload parameters, or NULL for the default values
+ * @return 0 on success, non-zero value otherwise
+ */
+int KvsApp_uploadMkvFile(KvsAppHandle handle, const char *pcFilename, KvsAppUploadParameter_t *pxPara);
+
 #endif /* KVSAPP_H */
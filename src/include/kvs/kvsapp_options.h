@@ -20,9 +20,25 @@ typedef enum KvsApp_streamPolicy
 {
     STREAM_POLICY_NONE = 0,
     STREAM_POLICY_RING_BUFFER,
+    STREAM_POLICY_TIME_WINDOW,
     STREAM_POLICY_MAX
 } KvsApp_streamPolicy_t;
 
+typedef enum KvsApp_videoCodec
+{
+    VIDEO_CODEC_H264 = 0,
+    VIDEO_CODEC_HEVC,
+    VIDEO_CODEC_MAX
+} KvsApp_videoCodec_t;
+
+typedef enum KvsApp_videoFormat
+{
+    VIDEO_FORMAT_AUTO = 0,  /* The format is detected from the first bytes of each frame. */
+    VIDEO_FORMAT_AVCC,
+    VIDEO_FORMAT_ANNEX_B,
+    VIDEO_FORMAT_MAX
+} KvsApp_videoFormat_t;
+
 static const char * const OPTION_AWS_ACCESS_KEY_ID = "Aws_accessKeyId";
 static const char * const OPTION_AWS_SECRET_ACCESS_KEY = "Aws_secretAccessKey";
 static const char * const OPTION_AWS_SESSION_TOKEN = "Aws_sessionToken";
@@ -36,13 +52,200 @@ static const char * const OPTION_IOT_X509_KEY = "Iot_x509PrivateKey";
 
 static const char * const OPTION_KVS_DATA_RETENTION_IN_HOURS = "Kvs_dataRetentionInHours";
 static const char * const OPTION_KVS_VIDEO_TRACK_INFO = "Kvs_videoTrackInfo";
+/* The codec (KvsApp_videoCodec_t) of video frames, which is H264 by default. Key frames are detected and the video track
+ * info is generated from frames by this codec. It must be set before the stream is created. */
+static const char * const OPTION_KVS_VIDEO_CODEC = "Kvs_videoCodec";
+/* The format (KvsApp_videoFormat_t) of video frames, which is detected per frame by default. If it's AVCC, frames are
+ * not checked for start codes and never converted. If it's Annex-B, frames are not modified: the stream keeps the NALUs
+ * of a frame where they are, and start codes are replaced by AVCC lengths while the frame is sent. A frame with more
+ * NALUs than NALU_MAX_COUNT_IN_A_FRAME is still converted in place. Frames of KvsApp_addFrameV() are always converted
+ * in place. It must be set before the stream is created. */
+static const char * const OPTION_KVS_VIDEO_FORMAT = "Kvs_videoFormat";
+/* NALU types (uint64_t) to be removed from video frames, e.g. SEI, AUD and filler data that playback doesn't need. It's
+ * built by NALU_FILTER_BIT() in kvs/nalu.h with NALU types of the video codec, and frames are compacted in place while
+ * they're converted to AVCC. VCL NALUs and parameter sets should not be filtered. It must be set before the stream is
+ * created, and 0 disables it by default. */
+static const char * const OPTION_KVS_NALU_FILTER_MASK = "Kvs_naluFilterMask";
 static const char * const OPTION_KVS_AUDIO_TRACK_INFO = "Kvs_audioTrackInfo";
+/* If it's set (unsigned int, in milliseconds), a standby PUT MEDIA connection is opened once the active one has been
+ * used for this long, and it takes over at the next cluster boundary so there is no gap in the upload. */
+static const char * const OPTION_KVS_PUT_MEDIA_ROTATION_MS = "Kvs_putMediaRotationMs";
+/* A data endpoint (string) resolved before, e.g. one persisted by OnDataEndpointUpdatedCallback_t. If it's set,
+ * KvsApp_open skips describing the stream and getting the data endpoint. */
+static const char * const OPTION_KVS_DATA_ENDPOINT = "Kvs_dataEndpoint";
+/* How long (unsigned int, in milliseconds) the data endpoint is cached. 0 means it's cached until PUT MEDIA fails to
+ * connect or returns 404. */
+static const char * const OPTION_KVS_DATA_ENDPOINT_TTL_MS = "Kvs_dataEndpointTtlMs";
+/* The port (string) of all connections of the KVS service, which is 443 by default. It's used to connect to a local
+ * endpoint, e.g. the mock server of kvsbench. */
+static const char * const OPTION_KVS_PORT = "Kvs_port";
+/* If it's set (bool), KvsApp_open returns once the PUT MEDIA connection is started, and KvsApp_doWork establishes it
+ * step by step without blocking. Data frames are buffered in the meantime. */
+static const char * const OPTION_KVS_ASYNC_OPEN = "Kvs_asyncOpen";
+/* If it's set (bool), KvsApp_open resolves all hosts in parallel, gets the IoT credential while it connects to a cached
+ * data endpoint, and asks GetDataEndpoint before DescribeStream, which is skipped unless the stream is not found. It
+ * works with OPTION_KVS_ASYNC_OPEN. */
+static const char * const OPTION_KVS_FAST_OPEN = "Kvs_fastOpen";
+/* If it's set (unsigned int, in milliseconds), data frames are buffered from boot until the first PUT MEDIA connection
+ * is established, and only GOPs of this duration are kept. The stream is built from the first SPS/PPS, or from the
+ * video track info if it's set, regardless of the connection. 0 disables it by default. */
+static const char * const OPTION_KVS_PREROLL_DURATION_MS = "Kvs_prerollDurationMs";
+/* If it's set (unsigned int, in milliseconds), GOPs that fall behind the newest cluster by more than this, e.g. after an
+ * outage, are moved to a backlog. The primary PUT MEDIA connection goes on from the live edge, and the backlog is sent
+ * on a second PUT MEDIA connection in order. 0 disables it by default. */
+static const char * const OPTION_KVS_CATCH_UP_THRESHOLD_MS = "Kvs_catchUpThresholdMs";
+/* The rate cap (unsigned int, in bits per second) of the catch-up connection. 0 means no cap. */
+static const char * const OPTION_KVS_CATCH_UP_RATE_BPS = "Kvs_catchUpRateBps";
+/* How often (unsigned int, in milliseconds) the uplink throughput is estimated and OnBitrateHintCallback_t is invoked.
+ * 0 disables the estimator. */
+static const char * const OPTION_KVS_BITRATE_HINT_INTERVAL_MS = "Kvs_bitrateHintIntervalMs";
+/* If it's set (size_t, in bytes), sent clusters are kept in a replay buffer of this size until they are persisted.
+ * After reconnection, the clusters that are not persisted are sent again from their first frame, and the stream
+ * continues where it stopped. It must be set before the stream is created, and 0 disables it by default. */
+static const char * const OPTION_KVS_REPLAY_BUFFER_SIZE = "Kvs_replayBufferSize";
+/* If the recorder file prefix is set, the sent MKV bytes are also written into local files named by the prefix and the
+ * timestamp of their first cluster. A new file starts at the first cluster after the file duration (unsigned int, in
+ * milliseconds), and Cues are written at the end of each file. Writes are buffered into whole blocks of the write
+ * buffer size (size_t, in bytes). They must be set before the stream is created. */
+static const char * const OPTION_KVS_RECORDER_FILE_PREFIX = "Kvs_recorderFilePrefix";
+static const char * const OPTION_KVS_RECORDER_FILE_DURATION_MS = "Kvs_recorderFileDurationMs";
+static const char * const OPTION_KVS_RECORDER_WRITE_BUFFER_SIZE = "Kvs_recorderWriteBufferSize";
+/* If it's set (bool), the latest video keyframe is kept for KvsApp_acquireKeyframeSnapshot(), together with a copy of
+ * the codec private data. The keyframe is not copied, so its buffer is returned to the application later. */
+static const char * const OPTION_KVS_KEYFRAME_SNAPSHOT = "Kvs_keyframeSnapshot";
+/* If it's set (bool), the stream has only the audio track of OPTION_KVS_AUDIO_TRACK_INFO, and video frames are
+ * rejected. A cluster starts on the first audio frame and then every max fragment duration, or every 2 seconds if it's
+ * not set. It must be set before the stream is created. */
+static const char * const OPTION_KVS_AUDIO_ONLY = "Kvs_audioOnly";
 
 static const char * const OPTION_STREAM_POLICY = "Stream_policy";
 static const char * const OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT = "Stream_RbMemlimit";
+static const char * const OPTION_STREAM_POLICY_RING_BUFFER_DROP_NON_REF_FRAMES = "Stream_RbDropNonRefFrames";
+static const char * const OPTION_STREAM_POLICY_RING_BUFFER_DROP_AUDIO_FRAMES = "Stream_RbDropAudioFrames";
+static const char * const OPTION_STREAM_POLICY_TIME_WINDOW_MS = "Stream_TwWindowMs";
+/* If the oldest queued data frame is more than this latency (unsigned int, in milliseconds) behind the newest one, the
+ * stream skips to a later keyframe before sending, so stale inter frames are dropped instead of sent late. It works
+ * with any stream policy, and 0 disables it by default. */
+static const char * const OPTION_STREAM_LATENCY_DROP_MS = "Stream_latencyDropMs";
+static const char * const OPTION_STREAM_FRAME_SLAB_SIZE = "Stream_frameSlabSize";
+static const char * const OPTION_STREAM_INGEST_RING_SIZE = "Stream_ingestRingSize";
+/* If spill file and its size are set, GOPs are moved from the head of the stream into the preallocated spill file
+ * when the stream is over the spill memory limit, and they are sent before the rest of the stream. Callbacks of
+ * OnDataFrameToBeSent are not invoked on spilled data frames. */
+static const char * const OPTION_STREAM_SPILL_FILE = "Stream_spillFile";
+static const char * const OPTION_STREAM_SPILL_FILE_SIZE = "Stream_spillFileSize";
+static const char * const OPTION_STREAM_SPILL_MEM_LIMIT = "Stream_spillMemlimit";
+/* If checkpoint file is set, the fragment timecode of the last PERSISTED ack is saved to it at most once the interval
+ * (unsigned int, in milliseconds, 10 seconds by default) and on close, and the spill file is kept across reboots. When
+ * the stream is created, only the spilled GOPs that are newer than the checkpoint are recovered and sent. */
+static const char * const OPTION_STREAM_CHECKPOINT_FILE = "Stream_checkpointFile";
+static const char * const OPTION_STREAM_CHECKPOINT_INTERVAL_MS = "Stream_checkpointIntervalMs";
+/* Limits of data frames and bytes (size_t) sent in one KvsApp_doWork call. 0 means no limit, and the frame budget is
+ * 1 by default. A larger budget lets a backlog be drained at the rate of the link after reconnection. */
+static const char * const OPTION_STREAM_SEND_FRAME_BUDGET = "Stream_sendFrameBudget";
+static const char * const OPTION_STREAM_SEND_BYTE_BUDGET = "Stream_sendByteBudget";
+/* Burst mode for devices that power down the radio between uploads. Data frames accumulate until the burst interval
+ * (unsigned int, in milliseconds) has passed since the last burst, or the queued data frames reach the burst bytes
+ * (size_t). Then the stream is drained in one burst on the PUT MEDIA connection that is kept open, and the radio can
+ * sleep until the next one. Raise the send budgets so a burst is sent in few doWork calls, and keep the interval below
+ * the idle timeout of the service and the TCP keepalive idle time, or the connection is made again with TLS session
+ * resumption. 0 disables them by default, and data frames are sent as soon as they're ready. */
+static const char * const OPTION_STREAM_BURST_INTERVAL_MS = "Stream_burstIntervalMs";
+static const char * const OPTION_STREAM_BURST_BYTES = "Stream_burstBytes";
+/* When there is nothing to send, KvsApp_doWork waits until a data frame is added or this timeout (unsigned int, in
+ * milliseconds) expires. The timeout also bounds how late fragment acks are read on an idle stream. */
+static const char * const OPTION_STREAM_WAIT_TIMEOUT_MS = "Stream_waitTimeoutMs";
+/* Consecutive audio frames within this duration (unsigned int, in milliseconds) are copied into one laced simple block,
+ * and 0 disables it. The lace is added once a later audio or video frame is past its duration, so audio is delayed by
+ * up to this duration. Keep it short, e.g. 100 ms, because a lace older than sent data frames is dropped. Callbacks of
+ * OnDataFrameToBeSent are not invoked on laced audio frames. The lace is locked, so audio and video frames can be added
+ * from different threads like the samples do. */
+static const char * const OPTION_STREAM_AUDIO_LACE_DURATION_MS = "Stream_audioLaceDurationMs";
+/* If a video frame is this duration (unsigned int, in milliseconds) past the last cluster, a new cluster starts on it
+ * even if it's not a keyframe. It bounds the delay of fragment acks and the data kept for each fragment with long
+ * GOPs, and keeps the timecodes of simple blocks within their 16-bit range. A cluster that starts on an inter frame
+ * can't be decoded on its own, so a skip to it, e.g. by eviction or reconnection, shows artifacts until the next
+ * keyframe. 0 disables it by default, and clusters only start on keyframes. */
+static const char * const OPTION_STREAM_MAX_FRAGMENT_DURATION_MS = "Stream_maxFragmentDurationMs";
+/* Audio frames are sent behind video frames, so a stalled encoder holds audio back too. If no video frame is queued and
+ * the queued audio spans this latency (unsigned int, in milliseconds), audio is sent without waiting for video. Video
+ * frames that arrive later with older timestamps are rejected with KVS_ERROR_ADD_FRAME_WHOSE_TIMESTAMP_GOES_BACK.
+ * 0 disables it by default. */
+static const char * const OPTION_STREAM_AUDIO_MAX_LATENCY_MS = "Stream_audioMaxLatencyMs";
+/* A data frame that waits for the other track to keep audio and video interleaved, e.g. video with
+ * DO_WORK_SEND_END_OF_FRAMES while the audio encoder lags, is sent anyway once it has been queued for this window
+ * (unsigned int, in milliseconds). It's checked whenever doWork runs, so it's late by up to the wait timeout. Frames of
+ * the other track that arrive later with older timestamps are rejected with KVS_ERROR_ADD_FRAME_WHOSE_TIMESTAMP_GOES_BACK.
+ * 0 disables it by default, and frames wait as long as it takes. */
+static const char * const OPTION_STREAM_INTERLEAVE_WINDOW_MS = "Stream_interleaveWindowMs";
 
 static const char * const OPTION_NETIO_CONNECTION_TIMEOUT = "NetIo_connTimeout";
 static const char * const OPTION_NETIO_STREAMING_RECV_TIMEOUT = "NetIo_recvTimeout";
 static const char * const OPTION_NETIO_STREAMING_SEND_TIMEOUT = "NetIo_sendTimeout";
+/* Socket options of PUT MEDIA connections, applied from the next connection. TCP_NODELAY is a bool, and the others are
+ * unsigned int where 0 keeps the OS default. Options that the platform doesn't support are logged and ignored, e.g.
+ * lwIP has no TCP_NOTSENT_LOWAT and sizes its send buffer with TCP_SND_BUF at build time. */
+static const char * const OPTION_NETIO_TCP_NODELAY = "NetIo_tcpNoDelay";
+static const char * const OPTION_NETIO_SEND_BUF_SIZE = "NetIo_sendBufSize";
+static const char * const OPTION_NETIO_NOT_SENT_LOWAT = "NetIo_notSentLowat";
+static const char * const OPTION_NETIO_KEEPALIVE_IDLE_SEC = "NetIo_keepAliveIdleSec";
+static const char * const OPTION_NETIO_KEEPALIVE_INTERVAL_SEC = "NetIo_keepAliveIntervalSec";
+static const char * const OPTION_NETIO_KEEPALIVE_COUNT = "NetIo_keepAliveCount";
+/* Token-bucket pacing of PUT MEDIA sends, also applied to the current connection. A large frame is sent in bursts of
+ * the burst size (unsigned int, in bytes, 0 for 16 KB) at the rate (unsigned int, in bits per second, 0 disables it)
+ * instead of filling the buffers of the modem at once. If the pacing follows the uplink (bool), the rate is updated to
+ * a bit above the estimated uplink throughput of OPTION_KVS_BITRATE_HINT_INTERVAL_MS, and the rate set is its cap. */
+static const char * const OPTION_NETIO_PACING_RATE_BPS = "NetIo_pacingRateBps";
+static const char * const OPTION_NETIO_PACING_BURST_BYTES = "NetIo_pacingBurstBytes";
+static const char * const OPTION_NETIO_PACING_FOLLOWS_UPLINK = "NetIo_pacingFollowsUplink";
+/* TLS max fragment length (unsigned int: 512, 1024, 2048 or 4096) negotiated on all connections from the next one,
+ * including the IoT credential one. It saves heap on small devices only if mbedTLS is built with
+ * MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH and the server accepts the extension. */
+static const char * const OPTION_NETIO_TLS_MAX_FRAG_LEN = "NetIo_tlsMaxFragLen";
+/* Network interfaces (unsigned int, an interface index, e.g. from if_nametoindex(), 0 for the default route) that PUT
+ * MEDIA connections are bound to from the next connection, e.g. Wi-Fi and LTE. If the standby interface and the
+ * failover send latency (unsigned int, in milliseconds) are set, a standby PUT MEDIA connection is kept open on the
+ * interface that is not active. When a data frame takes longer than the latency to send, including the waits of pacing,
+ * the standby takes over at the next cluster and the interfaces swap roles. A failed connection also swaps them, so
+ * the application reconnects on the other interface. Hostnames are still resolved on the default route, and binding
+ * needs SO_BINDTODEVICE of Linux. */
+static const char * const OPTION_NETIO_INTERFACE = "NetIo_interface";
+static const char * const OPTION_NETIO_STANDBY_INTERFACE = "NetIo_standbyInterface";
+static const char * const OPTION_NETIO_FAILOVER_SEND_LATENCY_MS = "NetIo_failoverSendLatencyMs";
+
+/* Options of KvsApp_setOptionInt() and KvsApp_setOptionPtr(), which are dispatched by a switch instead of comparing
+ * names. They mean the same as the string options in the comments, and they can be changed while streaming: stream
+ * options apply to the next data frame, and NetIo options also apply to the current PUT MEDIA connection. */
+typedef enum KvsApp_optionId
+{
+    /* Integer options */
+    KVS_APP_OPTION_STREAM_POLICY = 0,                           /* OPTION_STREAM_POLICY */
+    KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT,         /* OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT */
+    KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_DROP_NON_REF_FRAMES, /* OPTION_STREAM_POLICY_RING_BUFFER_DROP_NON_REF_FRAMES */
+    KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_DROP_AUDIO_FRAMES, /* OPTION_STREAM_POLICY_RING_BUFFER_DROP_AUDIO_FRAMES */
+    KVS_APP_OPTION_STREAM_POLICY_TIME_WINDOW_MS,                /* OPTION_STREAM_POLICY_TIME_WINDOW_MS */
+    KVS_APP_OPTION_STREAM_LATENCY_DROP_MS,                      /* OPTION_STREAM_LATENCY_DROP_MS */
+    KVS_APP_OPTION_STREAM_SEND_FRAME_BUDGET,                    /* OPTION_STREAM_SEND_FRAME_BUDGET */
+    KVS_APP_OPTION_STREAM_SEND_BYTE_BUDGET,                     /* OPTION_STREAM_SEND_BYTE_BUDGET */
+    KVS_APP_OPTION_STREAM_BURST_INTERVAL_MS,                    /* OPTION_STREAM_BURST_INTERVAL_MS */
+    KVS_APP_OPTION_STREAM_BURST_BYTES,                          /* OPTION_STREAM_BURST_BYTES */
+    KVS_APP_OPTION_STREAM_WAIT_TIMEOUT_MS,                      /* OPTION_STREAM_WAIT_TIMEOUT_MS */
+    KVS_APP_OPTION_STREAM_AUDIO_LACE_DURATION_MS,               /* OPTION_STREAM_AUDIO_LACE_DURATION_MS */
+    KVS_APP_OPTION_STREAM_MAX_FRAGMENT_DURATION_MS,             /* OPTION_STREAM_MAX_FRAGMENT_DURATION_MS */
+    KVS_APP_OPTION_STREAM_AUDIO_MAX_LATENCY_MS,                 /* OPTION_STREAM_AUDIO_MAX_LATENCY_MS */
+    KVS_APP_OPTION_STREAM_INTERLEAVE_WINDOW_MS,                 /* OPTION_STREAM_INTERLEAVE_WINDOW_MS */
+    KVS_APP_OPTION_KVS_BITRATE_HINT_INTERVAL_MS,                /* OPTION_KVS_BITRATE_HINT_INTERVAL_MS */
+    KVS_APP_OPTION_NETIO_STREAMING_RECV_TIMEOUT,                /* OPTION_NETIO_STREAMING_RECV_TIMEOUT */
+    KVS_APP_OPTION_NETIO_STREAMING_SEND_TIMEOUT,                /* OPTION_NETIO_STREAMING_SEND_TIMEOUT */
+    KVS_APP_OPTION_NETIO_PACING_RATE_BPS,                       /* OPTION_NETIO_PACING_RATE_BPS */
+    KVS_APP_OPTION_NETIO_PACING_BURST_BYTES,                    /* OPTION_NETIO_PACING_BURST_BYTES */
+    KVS_APP_OPTION_NETIO_PACING_FOLLOWS_UPLINK,                 /* OPTION_NETIO_PACING_FOLLOWS_UPLINK, non-zero for true */
+
+    /* Pointer options, which are copied. Track info can only be set before the stream is created. */
+    KVS_APP_OPTION_KVS_VIDEO_TRACK_INFO,                        /* OPTION_KVS_VIDEO_TRACK_INFO, VideoTrackInfo_t */
+    KVS_APP_OPTION_KVS_AUDIO_TRACK_INFO,                        /* OPTION_KVS_AUDIO_TRACK_INFO, AudioTrackInfo_t */
+
+    KVS_APP_OPTION_MAX
+} KvsApp_optionId_t;
 
 #endif
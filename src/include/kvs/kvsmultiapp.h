@@ -0,0 +1,83 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVSMULTIAPP_H
+#define KVSMULTIAPP_H
+
+#include <stddef.h>
+
+#include "kvs/kvsapp.h"
+
+typedef struct KvsMultiApp *KvsMultiAppHandle;
+
+typedef struct KvsMultiAppParameter
+{
+    /* The number of worker threads. KVS applications are spread over them evenly. */
+    size_t uWorkerCount;
+
+    /* Stack size of worker threads in bytes, or 0 for the platform default */
+    size_t uStackSize;
+
+    /* The core to pin worker threads on, or -1 for no affinity */
+    int xCoreId;
+
+    /* The delay before reconnection starts from the min value, and doubles on each failure up to the max value. */
+    unsigned int uReconnectMinBackoffMs;
+    unsigned int uReconnectMaxBackoffMs;
+
+    /* How long a worker waits for new data frames before it checks fragment acks again */
+    unsigned int uWaitTimeoutMs;
+} KvsMultiAppParameter_t;
+
+/**
+ * Create a multi-stream manager that runs many KVS applications on a small pool of worker threads.
+ *
+ * Each worker services its KVS applications in turn: it opens them with OPTION_KVS_ASYNC_OPEN so a slow connection
+ * doesn't stall the others, calls KvsApp_doWork() on each of them, and reconnects them with backoff on failure. Then it
+ * waits on one event that is shared by all of its KVS applications until a data frame is added or the timeout expires.
+ *
+ * @param[in] pxPara Parameters, or NULL for the default values
+ * @return The multi-stream manager handle on success, NULL otherwise
+ */
+KvsMultiAppHandle KvsMultiApp_create(KvsMultiAppParameter_t *pxPara);
+
+/**
+ * Stop all workers and terminate a multi-stream manager. KVS applications that are still added are closed but not
+ * terminated.
+ *
+ * @param[in] handle The multi-stream manager handle
+ */
+void KvsMultiApp_terminate(KvsMultiAppHandle handle);
+
+/**
+ * Add a KVS application to the worker that has the fewest. Application only needs to add frames after that, and it
+ * must not call KvsApp_open(), KvsApp_close(), KvsApp_doWork(), KvsApp_readFragmentAck() or KvsApp_startWorker().
+ *
+ * @param[in] handle The multi-stream manager handle
+ * @param[in] xKvsAppHandle KVS application handle
+ * @return 0 on success, KVS_ERROR_KVSMULTIAPP_NO_AVAILABLE_SLOT if all workers are full, non-zero value otherwise
+ */
+int KvsMultiApp_addApp(KvsMultiAppHandle handle, KvsAppHandle xKvsAppHandle);
+
+/**
+ * Remove a KVS application. It's closed if it's opened, and it can be terminated once this returns.
+ *
+ * @param[in] handle The multi-stream manager handle
+ * @param[in] xKvsAppHandle KVS application handle
+ * @return 0 on success, KVS_ERROR_KVSMULTIAPP_APP_NOT_FOUND if it's not added, non-zero value otherwise
+ */
+int KvsMultiApp_removeApp(KvsMultiAppHandle handle, KvsAppHandle xKvsAppHandle);
+
+#endif /* KVSMULTIAPP_H */
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+
+#ifndef KVS_MEM_BUDGET_H
+#define KVS_MEM_BUDGET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* The memory budget of KVS lib is only available if it's built with USE_MEM_BUDGET (KVS_CONFIG_MEM_BUDGET), otherwise
+ * these APIs return KVS_ERROR_FEATURE_NOT_ENABLED and media is always admitted.
+ *
+ * Every allocation of kvsMalloc, kvsRealloc and kvsCalloc is counted, and so are the frames that are queued in a
+ * stream, whose buffers belong to the application. Media can use the budget except the reserved bytes, which are left
+ * for the allocations of connection setup, like the TLS contexts and HTTP requests of a reconnect. Other allocations can
+ * use the whole budget. Memory that mbedTLS allocates by itself is not counted unless mbedTLS is configured to allocate
+ * with kvsCalloc. */
+
+typedef struct KvsMemBudgetStats
+{
+    size_t uLimit;              /* The budget in bytes, or 0 if it's unlimited */
+    size_t uReserved;           /* Bytes of the budget that media can't use */
+    size_t uUsedBytes;          /* Live bytes of allocations and queued media */
+    size_t uMediaBytes;         /* Live bytes of queued media, which are included in uUsedBytes */
+    size_t uPeakUsedBytes;      /* High-water mark of used bytes */
+    size_t uAllocRejects;       /* Number of allocations that are refused by the budget */
+    size_t uMediaRejects;       /* Number of media that are refused by the budget */
+} KvsMemBudgetStats_t;
+
+/**
+ * Set the memory budget. It can be set at any time, and memory that is already used over a smaller budget is kept
+ * until it's freed.
+ *
+ * @param[in] uLimit The budget in bytes, or 0 for no limit
+ * @param[in] uReserved Bytes of the budget that media can't use, which must be less than the budget
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsMemBudgetSet(size_t uLimit, size_t uReserved);
+
+/**
+ * Get statistics of the memory budget.
+ *
+ * @param[out] pxStats Budget statistics
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsMemBudgetGetStats(KvsMemBudgetStats_t *pxStats);
+
+/**
+ * Charge media to the budget before it's queued. It fails if the media would leave less than the reserved bytes of the
+ * budget.
+ *
+ * @param[in] bytes Size of the media
+ * @return true if it's charged, false if it doesn't fit
+ */
+bool kvsMemBudgetChargeMedia(size_t bytes);
+
+/**
+ * Release media that is charged by kvsMemBudgetChargeMedia().
+ *
+ * @param[in] bytes Size of the media
+ */
+void kvsMemBudgetReleaseMedia(size_t bytes);
+
+#endif /* KVS_MEM_BUDGET_H */
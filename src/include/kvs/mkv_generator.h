@@ -51,6 +51,17 @@ typedef enum MkvClusterType
     MKV_CLUSTER = 1,
 } MkvClusterType_t;
 
+/* The lacing of a simple block. The values are the lacing bits in the flags of a simple block. */
+typedef enum MkvLacing
+{
+    MKV_LACING_NONE = 0x00,
+    MKV_LACING_FIXED_SIZE = 0x04,
+    MKV_LACING_EBML = 0x06,
+} MkvLacing_t;
+
+/* The max number of frames in a laced simple block */
+#define MKV_LACE_MAX_FRAME_COUNT ( 256 )
+
 // 5 bits (Audio Object Type) | 4 bits (frequency index) | 4 bits (channel configuration) | 3 bits (not used)
 #define MKV_AAC_CPD_SIZE_BYTE                ( 2 )
 
@@ -119,7 +130,7 @@ typedef struct AudioTrackInfo
  * @brief Initialize MKV EBML and segment header
  *
  * @param[in] pMkvHeader The MKV header to be initialized that is memory allocated
- * @param[in] pVideoTrackInfo The video track info
+ * @param[in] pVideoTrackInfo The video track info, or NULL if there is only an audio track
  * @param[in] pAudioTrackInfo The audio track info if any, or NULL if there is no audio track
  * @return 0 on success, non-zero value otherwise
  */
@@ -154,6 +165,54 @@ size_t Mkv_getClusterHdrLen(MkvClusterType_t xType);
  */
 int Mkv_initializeClusterHdr(uint8_t *pMkvHeader, size_t uMkvHeaderSize, MkvClusterType_t xType, size_t uFrameSize, TrackType_t xTrackType, bool bIsKeyFrame, uint64_t uAbsoluteTimestamp, uint16_t uDeltaTimestamp);
 
+/**
+ * @brief Set the lacing of the simple block in a MKV header that is initialized by Mkv_initializeClusterHdr()
+ *
+ * @param[in] pMkvHeader MKV header buffer
+ * @param[in] uMkvHeaderLen MKV header length
+ * @param[in] xType the MKV header type, either MKV cluster or MKV simple block
+ * @param[in] xLacing the lacing of the simple block
+ * @return 0 on success, non-zero value otherwise
+ */
+int Mkv_setSimpleBlockLacing(uint8_t *pMkvHeader, size_t uMkvHeaderLen, MkvClusterType_t xType, MkvLacing_t xLacing);
+
+/**
+ * @brief Set the delta timestamp of the simple block in a MKV header that is initialized by Mkv_initializeClusterHdr()
+ *
+ * It only patches 2 bytes, so the header can be built once and fixed up when the cluster it belongs to is known.
+ *
+ * @param[in] pMkvHeader MKV header buffer
+ * @param[in] uMkvHeaderLen MKV header length
+ * @param[in] xType the MKV header type, either MKV cluster or MKV simple block
+ * @param[in] uDeltaTimestamp delta timestamp in milliseconds compare to the cluster data frame
+ * @return 0 on success, non-zero value otherwise
+ */
+int Mkv_setSimpleBlockDeltaTimestamp(uint8_t *pMkvHeader, size_t uMkvHeaderLen, MkvClusterType_t xType, uint16_t uDeltaTimestamp);
+
+/**
+ * @brief Return the length of the lace header of a laced simple block
+ *
+ * The lace header is put in front of the frames, and the frame size of the simple block includes it.
+ *
+ * @param[in] xLacing the lacing, either fixed-size or EBML lacing
+ * @param[in] puFrameSizes the sizes of frames in the lace
+ * @param[in] uFrameCount the number of frames in the lace, from 1 to MKV_LACE_MAX_FRAME_COUNT
+ * @return the length of the lace header, or 0 if the lacing or frames are invalid
+ */
+size_t Mkv_getLaceHdrLen(MkvLacing_t xLacing, const size_t *puFrameSizes, size_t uFrameCount);
+
+/**
+ * @brief Initialize the lace header of a laced simple block
+ *
+ * @param[in] pLaceHeader lace header buffer
+ * @param[in] uLaceHeaderSize lace header buffer size
+ * @param[in] xLacing the lacing, either fixed-size or EBML lacing
+ * @param[in] puFrameSizes the sizes of frames in the lace. They're the same if it's fixed-size lacing.
+ * @param[in] uFrameCount the number of frames in the lace, from 1 to MKV_LACE_MAX_FRAME_COUNT
+ * @return 0 on success, non-zero value otherwise
+ */
+int Mkv_initializeLaceHdr(uint8_t *pLaceHeader, size_t uLaceHeaderSize, MkvLacing_t xLacing, const size_t *puFrameSizes, size_t uFrameCount);
+
 /**
  * @brief Create MKV codec private date for H264 from AVCC NALUs
  *
@@ -189,6 +248,40 @@ int Mkv_generateH264CodecPrivateDataFromAvccNalus(uint8_t *pAvccBuf, size_t uAvc
  */
 int Mkv_generateH264CodecPrivateDataFromSpsPps(uint8_t *pSps, size_t uSpsLen, uint8_t *pPps, size_t uPpsLen, uint8_t **ppCodecPrivateData, size_t *puCodecPrivateDataLen);
 
+/**
+ * @brief Create MKV codec private data for H265 from AVCC NALUs
+ *
+ * @param[in] pAvccBuf The AVCC NALUs that have VPS, SPS and PPS
+ * @param[in] uAvccLen the length of AVCC NALUs
+ * @param[out] ppCodecPrivateData the generated codec private data that is memory allocated
+ * @param[out] puCodecPrivateDataLen the length of generated codec private data
+ * @return 0 on success, non-zero value otherwise
+ */
+int Mkv_generateHevcCodecPrivateDataFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t **ppCodecPrivateData, size_t *puCodecPrivateDataLen);
+
+/**
+ * @brief Generate H265 codec private data, i.e. HEVCDecoderConfigurationRecord, from VPS, SPS and PPS
+ *
+ * @param[in] pVps The VPS buffer
+ * @param[in] uVpsLen The length of VPS
+ * @param[in] pSps The SPS buffer
+ * @param[in] uSpsLen The length of SPS
+ * @param[in] pPps The PPS buffer
+ * @param[in] uPpsLen The length of PPS
+ * @param[out] ppCodecPrivateData the generated codec private data that is memory allocated
+ * @param[out] puCodecPrivateDataLen the length of generated codec private data
+ * @return 0 on success, non-zero value otherwise
+ */
+int Mkv_generateHevcCodecPrivateDataFromVpsSpsPps(
+    uint8_t *pVps,
+    size_t uVpsLen,
+    uint8_t *pSps,
+    size_t uSpsLen,
+    uint8_t *pPps,
+    size_t uPpsLen,
+    uint8_t **ppCodecPrivateData,
+    size_t *puCodecPrivateDataLen);
+
 /**
  * @brief Create MKV codec private data for AAC
  *
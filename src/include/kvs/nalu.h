@@ -33,6 +33,55 @@
 #define NALU_TYPE_SEI               (6)
 #define NALU_TYPE_SPS               (7)
 #define NALU_TYPE_PPS               (8)
+#define NALU_TYPE_AUD               (9)
+#define NALU_TYPE_FILLER            (12)
+
+/* H265 VCL of IRAP pictures, from BLA_W_LP to RSV_IRAP_VCL23 */
+#define NALU_TYPE_HEVC_BLA_W_LP         (16)
+#define NALU_TYPE_HEVC_RSV_IRAP_VCL23   (23)
+
+/* H265 non-VCL */
+#define NALU_TYPE_HEVC_VPS              (32)
+#define NALU_TYPE_HEVC_SPS              (33)
+#define NALU_TYPE_HEVC_PPS              (34)
+#define NALU_TYPE_HEVC_AUD              (35)
+#define NALU_TYPE_HEVC_FILLER           (38)
+#define NALU_TYPE_HEVC_PREFIX_SEI       (39)
+#define NALU_TYPE_HEVC_SUFFIX_SEI       (40)
+
+/* The bit of a NALU type in a NALU filter mask. NALUs of the types in the mask are removed from a frame. */
+#define NALU_FILTER_BIT(uNaluType)      (1ULL << (uNaluType))
+
+/* The max number of NALUs of a frame that are recorded by NALU_analyzeFrame(). NALUs beyond it are still analyzed. */
+#ifndef NALU_MAX_COUNT_IN_A_FRAME
+#define NALU_MAX_COUNT_IN_A_FRAME   (16)
+#endif
+
+typedef struct NaluEntry
+{
+    uint32_t uOffset;   /* Offset of the NALU header in the frame, i.e. right after the start code or the length */
+    uint32_t uLen;      /* Length of the NALU */
+    uint8_t uHdr;       /* The first byte of the NALU header, or 0 if the NALU is empty */
+} NaluEntry_t;
+
+typedef struct NaluFrameInfo
+{
+    bool bIsHevc;           /* It's a H265 frame, otherwise it's a H264 frame */
+    bool bIsAnnexB;         /* The frame is in Annex-B format, otherwise it's in AVCC format */
+    bool bIsKeyFrame;       /* There is an IDR picture of H264, or an IRAP picture of H265 */
+    bool bIsNonReference;   /* All VCL NALUs of H264 have zero nal_ref_idc. It's always false for H265. */
+    uint32_t uLen;          /* The frame length */
+    uint32_t uAvccLen;      /* The frame length after it's converted to AVCC */
+
+    /* The first NALUs of the frame, and the number of all NALUs that may be more than the ones recorded. */
+    NaluEntry_t pxNalus[NALU_MAX_COUNT_IN_A_FRAME];
+    uint32_t uNaluCount;
+
+    /* The first parameter sets in the frame. The length is 0 if there is none. */
+    NaluEntry_t xVps;
+    NaluEntry_t xSps;
+    NaluEntry_t xPps;
+} NaluFrameInfo_t;
 
 /**
  * @brief Check if the frame is key frame
@@ -52,6 +101,15 @@ bool isKeyFrame(uint8_t *pBuf, size_t uLen);
  */
 int NALU_getNaluType(uint8_t *pBuf, size_t uLen);
 
+/**
+ * @brief Check if the H265 frame is key frame, i.e. an IRAP picture
+ *
+ * @param[in] pBuf The AVCC or Annex-B buffer
+ * @param[in] uLen The length of buffer
+ * @return true if it's key-frame, or false otherwise
+ */
+bool NALU_isHevcKeyFrame(uint8_t *pBuf, size_t uLen);
+
 /**
  * @brief Get specific NALU type from AVCC NALUs
  *
@@ -64,6 +122,30 @@ int NALU_getNaluType(uint8_t *pBuf, size_t uLen);
  */
 int NALU_getNaluFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen);
 
+/**
+ * @brief Get specific H265 NALU type from AVCC NALUs, i.e. NALUs with 4 bytes length prefix
+ *
+ * @param[in] pAvccBuf The buffer of AVCC NALUs
+ * @param[in] uAvccLen The length of buffer
+ * @param[in] uNaluType The H265 NALU type to be query
+ * @param[out] ppNalu The address of queried NALU type that is not memory allocated
+ * @param[out] puNaluLen The length of queried NALU type
+ * @return 0 on success, non-zero value otherwise
+ */
+int NALU_getHevcNaluFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen);
+
+/**
+ * @brief Check if AVCC NALUs are a non-reference frame
+ *
+ * A frame is non-reference if all its VCL NALUs have zero nal_ref_idc. No other frame is decoded from it, so it can be
+ * dropped without breaking the rest of the GOP.
+ *
+ * @param[in] pAvccBuf The buffer of AVCC NALUs
+ * @param[in] uAvccLen The length of buffer
+ * @return true if it's a non-reference frame, or false otherwise
+ */
+bool NALU_isNonReferenceFrame(uint8_t *pAvccBuf, size_t uAvccLen);
+
 /**
  * @brief Get specific NALU type from Annex-B NALUs
  *
@@ -76,6 +158,18 @@ int NALU_getNaluFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t uNaluT
  */
 int NALU_getNaluFromAnnexBNalus(uint8_t *pAnnexBBuf, size_t uAnnexBLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen);
 
+/**
+ * @brief Get specific H265 NALU type from Annex-B NALUs
+ *
+ * @param[in] pAnnexBBuf The buffer of Annex-B NALUs
+ * @param[in] uAnnexBLen The length of buffer
+ * @param[in] uNaluType The H265 NALU type to be query
+ * @param[out] ppNalu The address of queried NALU type that is not memory allocated
+ * @param[out] puNaluLen The length of queried NALU type
+ * @return 0 on success, non-zero value otherwise
+ */
+int NALU_getHevcNaluFromAnnexBNalus(uint8_t *pAnnexBBuf, size_t uAnnexBLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen);
+
 /**
  * @brief Check if a NALU is Annex-B NALU
  *
@@ -88,7 +182,8 @@ bool NALU_isAnnexBFrame(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen);
 /**
  * @brief Convert a Annex-B NALU into AVCC NALU in place
  *
- * An AVCC NALU may has larger length than Annex-B NALU, so a larger Annex-B buffer size may needed.
+ * An AVCC NALU may has larger length than Annex-B NALU, so a larger Annex-B buffer size may needed. NALUs are converted
+ * as they're found with constant stack use, so there is no limit of the NALU count.
  *
  * @param[in,out] pAnnexbBuf The Annex-B NALU buffer
  * @param[in] uAnnexbBufLen The length Annex-B NALU
@@ -98,6 +193,61 @@ bool NALU_isAnnexBFrame(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen);
  */
 int NALU_convertAnnexBToAvccInPlace(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen, uint32_t uAnnexbBufSize, uint32_t *pAvccLen);
 
+/**
+ * @brief Analyze a video frame in a single scan
+ *
+ * It records the NALUs of the frame, whether it's a key frame or a non-reference frame, and where the parameter sets
+ * are, so the frame doesn't need to be scanned again for them.
+ *
+ * @param[in] pBuf The AVCC or Annex-B buffer
+ * @param[in] uLen The length of buffer
+ * @param[in] bIsHevc true if it's a H265 frame, false if it's a H264 frame
+ * @param[out] pxInfo The frame info
+ * @return 0 on success, non-zero value otherwise
+ */
+int NALU_analyzeFrame(uint8_t *pBuf, uint32_t uLen, bool bIsHevc, NaluFrameInfo_t *pxInfo);
+
+/**
+ * @brief Analyze a video frame of a known format in a single scan
+ *
+ * It works the same as NALU_analyzeFrame() without checking the first bytes for an Annex-B start code, so an AVCC frame
+ * whose first NALU length looks like a start code, e.g. 0x000001XX, is not mistaken for an Annex-B one.
+ *
+ * @param[in] pBuf The AVCC or Annex-B buffer
+ * @param[in] uLen The length of buffer
+ * @param[in] bIsHevc true if it's a H265 frame, false if it's a H264 frame
+ * @param[in] bIsAnnexB true if it's an Annex-B frame, false if it's an AVCC frame
+ * @param[out] pxInfo The frame info
+ * @return 0 on success, non-zero value otherwise
+ */
+int NALU_analyzeFrameOfFormat(uint8_t *pBuf, uint32_t uLen, bool bIsHevc, bool bIsAnnexB, NaluFrameInfo_t *pxInfo);
+
+/**
+ * @brief Check if a NALU is removed by a NALU filter mask
+ *
+ * @param[in] uHdr The first byte of the NALU header
+ * @param[in] bIsHevc true if it's a H265 NALU, false if it's a H264 NALU
+ * @param[in] uFilterMask The NALU types to be removed, built by NALU_FILTER_BIT() of the codec of the NALU
+ * @return true if the NALU is filtered, or false otherwise
+ */
+bool NALU_isNaluFiltered(uint8_t uHdr, bool bIsHevc, uint64_t uFilterMask);
+
+/**
+ * @brief Convert an Annex-B frame analyzed by NALU_analyzeFrame() to AVCC in place without scanning it again
+ *
+ * NALUs of the types in the filter mask are removed while the frame is compacted, and so are they if it's already an
+ * AVCC frame. The frame info is updated to the AVCC frame. Nothing is changed if it's an AVCC frame and no NALU is
+ * filtered.
+ *
+ * @param[in,out] pAnnexbBuf The Annex-B buffer
+ * @param[in] uAnnexbBufSize The buffer size of Annex-B buffer
+ * @param[in,out] pxInfo The frame info
+ * @param[in] uFilterMask The NALU types to be removed, built by NALU_FILTER_BIT() of the codec of the frame
+ * @param[out] pAvccLen The length of AVCC frame
+ * @return 0 on success, KVS_ERROR_MISSING_NALU if all NALUs are filtered, non-zero value otherwise
+ */
+int NALU_convertAnnexBToAvccWithFrameInfo(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufSize, NaluFrameInfo_t *pxInfo, uint64_t uFilterMask, uint32_t *pAvccLen);
+
 /**
  * @brief Parse the video resolution from a SPS NALU
  *
@@ -109,4 +259,15 @@ int NALU_convertAnnexBToAvccInPlace(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen,
  */
 int NALU_getH264VideoResolutionFromSps(uint8_t *pSps, size_t uSpsLen, uint16_t *puWidth, uint16_t *puHeight);
 
+/**
+ * @brief Parse the video resolution from a H265 SPS NALU
+ *
+ * @param[in] pSps The SPS NALU, including its 2 bytes NALU header
+ * @param[in] uSpsLen The length of SPS NALU
+ * @param[out] puWidth The width of video
+ * @param[out] puHeight The height of video
+ * @return 0 on success, non-zero value otherwise
+ */
+int NALU_getHevcVideoResolutionFromSps(uint8_t *pSps, size_t uSpsLen, uint16_t *puWidth, uint16_t *puHeight);
+
 #endif /* KVS_NALU_H */
\ No newline at end of file
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef NETIO_TRANSPORT_H
+#define NETIO_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct NetIoVec
+{
+    const unsigned char *pBase;
+    size_t uLen;
+} NetIoVec_t;
+
+typedef enum NetIoOption
+{
+    NETIO_OPTION_TCP_NODELAY = 0,        /* 1 to disable Nagle's algorithm */
+    NETIO_OPTION_SEND_BUF_SIZE,          /* Socket send buffer size in bytes, or 0 for the OS default */
+    NETIO_OPTION_NOT_SENT_LOWAT,         /* Limit of unsent bytes in the socket, or 0 for the OS default */
+    NETIO_OPTION_KEEPALIVE_IDLE_SEC,     /* Idle time before the first keepalive probe, or 0 for the OS default */
+    NETIO_OPTION_KEEPALIVE_INTERVAL_SEC, /* Interval between keepalive probes, or 0 for the OS default */
+    NETIO_OPTION_KEEPALIVE_COUNT,        /* Number of unanswered keepalive probes, or 0 for the OS default */
+    NETIO_OPTION_TLS_MAX_FRAG_LEN,       /* TLS max_fragment_length to negotiate, or 0 not to negotiate it */
+    NETIO_OPTION_BIND_IF_INDEX           /* Index of the network interface that the socket is bound to, or 0 for the default route */
+} NetIoOption_t;
+
+typedef struct NetIoStats
+{
+    uint64_t uBytesSent;        /* Bytes passed to send and sendv, before TLS */
+    uint64_t uBytesReceived;    /* Bytes returned by recv, after TLS */
+    uint64_t uTlsRecordsSent;   /* TLS application data records sent, or 0 if the transport doesn't count them */
+} NetIoStats_t;
+
+/**
+ * Transport backend of network I/O handles, like the TLS offload of a network processor, kTLS, or an in-memory
+ * transport for tests. Every function gets the context returned by create().
+ *
+ * create, terminate, connect, send and recv are required, and the others can be NULL:
+ *  - connectStart and connectPoll: connectStart falls back to a blocking connect, so they're both set or both NULL.
+ *  - disconnect: nothing is sent before the context is terminated.
+ *  - sendv: segments are sent one by one with send.
+ *  - isDataAvailable: data is never reported available.
+ *  - getSocket: there is no socket to wait on, so a waiter only wakes on its event or timeout.
+ *  - getStats: TLS records are not counted. Bytes are always counted by the caller, so it only sets uTlsRecordsSent.
+ *  - setRecvTimeout, setSendTimeout and setOption: the values are logged and ignored.
+ *
+ * Functions return 0 on success, and a KVS error code otherwise, which is passed through to the caller.
+ */
+typedef struct NetIoTransport
+{
+    /* Create a context for one connection, or return NULL on failure */
+    void *(*create)(void);
+    void (*terminate)(void *pCtx);
+
+    /* The X509 arguments are all NULL if there is no client certificate. */
+    int (*connect)(void *pCtx, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey);
+    int (*connectStart)(void *pCtx, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey);
+    int (*connectPoll)(void *pCtx, bool *pbConnected);
+    void (*disconnect)(void *pCtx);
+
+    /* send and sendv return after all the data is sent. */
+    int (*send)(void *pCtx, const unsigned char *pBuffer, size_t uBytesToSend);
+    int (*sendv)(void *pCtx, const NetIoVec_t *pxIov, size_t uIovCnt);
+    int (*recv)(void *pCtx, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived);
+    bool (*isDataAvailable)(void *pCtx);
+
+    /* Return the socket descriptor that becomes readable when data arrives, or -1 if it's not connected. */
+    int (*getSocket)(void *pCtx);
+    int (*getStats)(void *pCtx, NetIoStats_t *pxStats);
+
+    int (*setRecvTimeout)(void *pCtx, unsigned int uRecvTimeoutMs);
+    int (*setSendTimeout)(void *pCtx, unsigned int uSendTimeoutMs);
+    int (*setOption)(void *pCtx, NetIoOption_t xOption, unsigned int uValue);
+} NetIoTransport_t;
+
+/**
+ * @brief Get the built-in transport of mbedTLS over BSD sockets
+ *
+ * It's the transport of network I/O handles unless NetIo_setDefaultTransport() selects another one. A transport can
+ * also wrap it, e.g. to count the bytes or to inject errors.
+ *
+ * @return The mbedTLS transport
+ */
+const NetIoTransport_t *NetIo_getMbedtlsTransport(void);
+
+/**
+ * @brief Get the mbedTLS transport that offloads the encryption of sent data to Linux kernel TLS (kTLS)
+ *
+ * mbedTLS does the handshake, then the client write key is installed into the socket with TLS_TX, so sent data is
+ * encrypted by the kernel, or by the NIC if it supports TLS offload. Received data is still decrypted by mbedTLS. It
+ * supports TLS 1.2 with AES-GCM cipher suites and needs the tls kernel module. Otherwise, the connection works the same
+ * as the mbedTLS transport.
+ *
+ * @return The kTLS transport, or NULL if the library isn't built with USE_KTLS
+ */
+const NetIoTransport_t *NetIo_getKtlsTransport(void);
+
+/**
+ * @brief Resolve hostnames in parallel into the DNS cache of the mbedTLS and kTLS transports
+ *
+ * Later connections to these hosts skip the DNS lookup while the cache entries are fresh, so a device that wakes up
+ * can resolve all of its hosts in about one round trip before it connects to any of them. Hosts that are already cached
+ * are not resolved again. Other transports resolve hosts by themselves, and they don't use the cache.
+ *
+ * @param[in] ppcHosts The hostnames, where NULL entries are skipped
+ * @param[in] uHostCount The number of hostnames
+ * @param[in] pcPort The port of the connections
+ * @return 0 if all of the hosts are resolved or the cache is disabled, non-zero value otherwise
+ */
+int NetIo_prefetchHosts(const char *const *ppcHosts, size_t uHostCount, const char *pcPort);
+
+/**
+ * @brief Select the transport of network I/O handles, including the ones of the REST APIs and the IoT credential provider
+ *
+ * A handle keeps the transport that is selected when it's created, so it should be called before any Kvs or KvsApp
+ * API. The transport must outlive all of the handles.
+ *
+ * @param[in] pxTransport The transport, or NULL for the mbedTLS transport
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setDefaultTransport(const NetIoTransport_t *pxTransport);
+
+#endif /* NETIO_TRANSPORT_H */
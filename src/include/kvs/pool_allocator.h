@@ -28,6 +28,8 @@ typedef struct PoolStats
     size_t uSizeOfLargestFreeBlock;
 } PoolStats_t;
 
+typedef struct PoolAllocator *PoolAllocatorHandle;
+
 /**
  * Init pool allocator with specified size. The pool is allocated from default malloc.
  *
@@ -64,7 +66,8 @@ void *poolAllocatorRealloc(void *ptr, size_t bytes);
 void *poolAllocatorCalloc(size_t num, size_t bytes);
 
 /**
- * Free memory from memory pool.
+ * Free memory from memory pool. Small blocks are kept in a cache of the calling thread and reused by its next
+ * allocations of the same size class, and the cache is freed to the pool when the thread exits.
  *
  * @param[in] ptr Pointer to be freed
  */
@@ -76,10 +79,74 @@ void poolAllocatorFree(void *ptr);
 void poolAllocatorDeinit(void);
 
 /**
- * Get statistics of pool allocator.
+ * Get statistics of pool allocator. Blocks cached by other threads are counted as used.
  *
  * @param[in] pPoolStats Pool statistics
  */
 void poolAllocatorGetStats(PoolStats_t *pPoolStats);
 
+/**
+ * Create a pool allocator on a memory pool. It's independent of the pool of poolAllocatorInit() and other pools, so
+ * allocations of different lifetimes can be put in different pools and don't fragment each other.
+ *
+ * The pool handle is kept at the beginning of the memory pool, so no memory is allocated for it.
+ *
+ * @param[in] pMemPool Pointer of memory pool
+ * @param[in] bytes Memory pool size
+ * @return The pool handle on success, NULL otherwise
+ */
+PoolAllocatorHandle poolAllocatorCreate(void *pMemPool, size_t bytes);
+
+/**
+ * Terminate a pool allocator. The memory pool can be reused afterwards.
+ *
+ * @param[in] xPool The pool handle
+ */
+void poolAllocatorTerminate(PoolAllocatorHandle xPool);
+
+/**
+ * Allocate memory from a pool allocator.
+ *
+ * @param[in] xPool The pool handle
+ * @param[in] bytes Size of memory
+ * @return Newly allocated memory on success, NULL otherwise
+ */
+void *poolAllocatorMallocFrom(PoolAllocatorHandle xPool, size_t bytes);
+
+/**
+ * Re-allocate memory from a pool allocator. The memory must be allocated from the same pool.
+ *
+ * @param[in] xPool The pool handle
+ * @param[in] ptr Pointer to be re-allocate
+ * @param[in] bytes New memory size
+ * @return Newly allocated memory on success, NULL otherwise
+ */
+void *poolAllocatorReallocFrom(PoolAllocatorHandle xPool, void *ptr, size_t bytes);
+
+/**
+ * Allocate and clear memory from a pool allocator.
+ *
+ * @param[in] xPool The pool handle
+ * @param[in] num Number of elements
+ * @param[in] bytes Element size
+ * @return Newly allocated memory on success, NULL otherwise
+ */
+void *poolAllocatorCallocFrom(PoolAllocatorHandle xPool, size_t num, size_t bytes);
+
+/**
+ * Free memory to the pool allocator that it's allocated from.
+ *
+ * @param[in] xPool The pool handle
+ * @param[in] ptr Pointer to be freed
+ */
+void poolAllocatorFreeFrom(PoolAllocatorHandle xPool, void *ptr);
+
+/**
+ * Get statistics of a pool allocator.
+ *
+ * @param[in] xPool The pool handle
+ * @param[out] pPoolStats Pool statistics
+ */
+void poolAllocatorGetStatsFrom(PoolAllocatorHandle xPool, PoolStats_t *pPoolStats);
+
 #endif /* POOL_ALLOCATOR_H */
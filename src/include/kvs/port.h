@@ -17,6 +17,8 @@
 #define KVS_PORT_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 /* The string length of "date + time" format of ISO 8601 required by AWS Signature V4. */
 #define DATE_TIME_ISO_8601_FORMAT_STRING_SIZE           ( 17 )
@@ -32,7 +34,8 @@ int platformInit(void);
  * @brief Return time in ISO 8601 format: YYYYMMDD'T'HHMMSS'Z'
  *
  * AWS Signature V4 requires HTTP header x-amz-date which is in ISO 8601 format. ISO 8601 format is YYYYMMDD'T'HHMMSS'Z'.
- * For example, "20150830T123600Z" is a valid timestamp.
+ * For example, "20150830T123600Z" is a valid timestamp. The string is cached and formatted again only when the second
+ * changes.
  *
  * @param[out] buf The buffer to store ths ISO 8601 string (including end of string character)
  * @param[out] uBufSize The buffer size
@@ -47,6 +50,23 @@ int getTimeInIso8601(char *buf, size_t uBufSize);
  */
 uint64_t getEpochTimestampInMs(void);
 
+/**
+ * @brief return time of a monotonic clock in unit of microsecond
+ *
+ * Unlike the epoch time, it never goes back or jumps when the system time is set, e.g. by NTP on boot. Its origin is
+ * unspecified, so it's only for intervals, deadlines and latency. Timestamps of frames still use the epoch time.
+ *
+ * @return monotonic time in microsecond
+ */
+uint64_t getMonotonicTimeInUs(void);
+
+/**
+ * @brief return time of the monotonic clock of getMonotonicTimeInUs() in unit of millisecond
+ *
+ * @return monotonic time in millisecond
+ */
+uint64_t getMonotonicTimeInMs(void);
+
 /**
  * @brief return a random number
  *
@@ -61,4 +81,146 @@ uint8_t getRandomNumber(void);
  */
 void sleepInMs(uint32_t ms);
 
+typedef struct KvsEvent *KvsEventHandle;
+
+/**
+ * @brief Create an auto-reset event
+ *
+ * An event is either signaled or not. A wait on a signaled event returns immediately and resets the event, and
+ * signals that happen before the wait are not lost.
+ *
+ * @return The event handle on success, NULL otherwise
+ */
+KvsEventHandle kvsEventCreate(void);
+
+/**
+ * @brief Terminate an event
+ *
+ * @param[in] xEvent The event handle
+ */
+void kvsEventTerminate(KvsEventHandle xEvent);
+
+/**
+ * @brief Signal an event and wake up the task waiting on it. It can be called from any task.
+ *
+ * @param[in] xEvent The event handle
+ */
+void kvsEventSignal(KvsEventHandle xEvent);
+
+/**
+ * @brief Wait until an event is signaled or the timeout expires
+ *
+ * @param[in] xEvent The event handle
+ * @param[in] uTimeoutMs Timeout in milliseconds
+ * @return true if the event is signaled, false on timeout
+ */
+bool kvsEventWait(KvsEventHandle xEvent, uint32_t uTimeoutMs);
+
+/* Results of kvsEventWaitSocket(), which are both set if the event is signaled and the socket is readable. */
+#define KVS_EVENT_SIGNALED                              ( 1 << 0 )
+#define KVS_EVENT_SOCKET_READABLE                       ( 1 << 1 )
+
+/**
+ * @brief Wait until an event is signaled, a socket is readable, or the timeout expires
+ *
+ * A task that sends data and reads responses on the same socket can sleep until either of them needs it. Like
+ * kvsEventWait(), a signaled event is reset. A socket that is closed by the peer or fails is also readable, and the
+ * socket stays readable until its data is read.
+ *
+ * @param[in] xEvent The event handle
+ * @param[in] xSocket The socket descriptor, or -1 to wait on the event only
+ * @param[in] uTimeoutMs Timeout in milliseconds
+ * @return A mask of KVS_EVENT_SIGNALED and KVS_EVENT_SOCKET_READABLE, or 0 on timeout
+ */
+int kvsEventWaitSocket(KvsEventHandle xEvent, int xSocket, uint32_t uTimeoutMs);
+
+typedef struct KvsThread *KvsThreadHandle;
+
+typedef void (*KvsThreadFunc_t)(void *pArg);
+
+/**
+ * @brief Create a thread
+ *
+ * @param[in] xThreadFunc The thread function
+ * @param[in] pArg The argument passed to the thread function
+ * @param[in] uStackSize Stack size in bytes, or 0 for the platform default
+ * @param[in] xCoreId The core to pin the thread on, or -1 for no affinity. It's ignored if the platform doesn't support it.
+ * @return The thread handle on success, NULL otherwise
+ */
+KvsThreadHandle kvsThreadCreate(KvsThreadFunc_t xThreadFunc, void *pArg, size_t uStackSize, int xCoreId);
+
+/**
+ * @brief Wait until a thread returns from its thread function, and release its resources
+ *
+ * @param[in] xThread The thread handle
+ */
+void kvsThreadJoin(KvsThreadHandle xThread);
+
+/**
+ * @brief Get an ID of the calling thread, which is unique among the running threads
+ *
+ * @return The thread ID
+ */
+uint32_t kvsThreadGetCurrentId(void);
+
+/* Classes of KVS allocations, so a port with memories of different speeds can place each of them. */
+typedef enum KvsAllocClass
+{
+    KVS_ALLOC_CLASS_DEFAULT = 0,
+    KVS_ALLOC_CLASS_MEDIA,      /* Large buffers of media payload that are accessed sequentially */
+    KVS_ALLOC_CLASS_METADATA,   /* Stream descriptors, frame nodes and acks that are accessed on every frame */
+    KVS_ALLOC_CLASS_CRYPTO,     /* TLS and signing contexts */
+} KvsAllocClass_t;
+
+/*
+ * By default every allocation class is allocated by kvsMalloc. A port that places them itself, e.g. ESP32 with PSRAM,
+ * defines KVS_USE_PORT_ALLOC_CLASS and provides kvsMallocClass(). The memory is still freed by kvsFree, so the heap of
+ * the port has to accept it, and it can't be used with USE_POOL_ALLOCATOR_LIB.
+ */
+#ifdef KVS_USE_PORT_ALLOC_CLASS
+/**
+ * @brief Allocate memory of an allocation class
+ *
+ * @param[in] bytes Memory size
+ * @param[in] xClass The allocation class
+ * @return New allocated address on success, NULL otherwise
+ */
+void *kvsMallocClass(size_t bytes, KvsAllocClass_t xClass);
+#endif /* KVS_USE_PORT_ALLOC_CLASS */
+
+/* The length of SHA-256 digest and HMAC-SHA256 in bytes. */
+#define KVS_SHA256_DIGEST_LENGTH                        ( 32 )
+
+/*
+ * Crypto hooks used by AWS Signature V4. The default implementation in port_crypto_mbedtls.c runs mbedTLS, so it
+ * already runs on the accelerator if the mbedTLS of the board is built with MBEDTLS_SHA256_ALT (ESP-IDF does it with
+ * CONFIG_MBEDTLS_HARDWARE_SHA). A port that talks to its crypto engine directly defines KVS_USE_HW_CRYPTO and provides
+ * these functions itself.
+ *
+ * TLS records are encrypted inside mbedTLS, so hardware AES-GCM is enabled in the mbedTLS config of the board with
+ * MBEDTLS_AES_ALT and MBEDTLS_GCM_ALT (CONFIG_MBEDTLS_HARDWARE_AES on ESP-IDF) instead.
+ */
+
+/**
+ * @brief Calculate SHA-256 of a message
+ *
+ * @param[in] pMsg The message
+ * @param[in] uMsgLen The message length
+ * @param[out] pDigest The buffer of KVS_SHA256_DIGEST_LENGTH bytes to store the digest
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsSha256(const uint8_t *pMsg, size_t uMsgLen, uint8_t *pDigest);
+
+/**
+ * @brief Calculate HMAC-SHA256 of a message. The output buffer may be the same as the key buffer.
+ *
+ * @param[in] pKey The key
+ * @param[in] uKeyLen The key length
+ * @param[in] pMsg The message
+ * @param[in] uMsgLen The message length
+ * @param[out] pMac The buffer of KVS_SHA256_DIGEST_LENGTH bytes to store the HMAC
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsHmacSha256(const uint8_t *pKey, size_t uKeyLen, const uint8_t *pMsg, size_t uMsgLen, uint8_t *pMac);
+
 #endif /* KVS_PORT_H */
\ No newline at end of file
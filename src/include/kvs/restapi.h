@@ -17,6 +17,11 @@
 #define KVS_REST_API_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kvs/netio_transport.h"
+#include "kvs/stream.h"
 
 typedef struct
 {
@@ -32,6 +37,12 @@ typedef struct
 
     unsigned int uRecvTimeoutMs;
     unsigned int uSendTimeoutMs;
+
+    /* TLS max fragment length (512, 1024, 2048 or 4096) to negotiate on all connections, or 0 not to negotiate it */
+    unsigned int uTlsMaxFragLen;
+
+    /* Port of all connections, or NULL for 443 */
+    char *pcPort;
 } KvsServiceParameter_t;
 
 typedef struct
@@ -56,6 +67,30 @@ typedef enum
     TIMECODE_TYPE_RELATIVE = 1
 } FragmentTimecodeType_t;
 
+/* PUT MEDIA Fragment ACK event type */
+typedef enum
+{
+    eUnknown = 0,
+    eBuffering,
+    eReceived,
+    ePersisted,
+    eError,
+    eIdle
+} ePutMediaFragmentAckEventType;
+
+/**
+ * Callback that is invoked for every fragment ack of a PUT MEDIA connection, in the thread that calls
+ * Kvs_putMediaDoWork(). It's invoked before the ack can be read by Kvs_putMediaReadFragmentAck().
+ *
+ * @param[in] eAckEventType The event type of the ack
+ * @param[in] uFragmentTimecode The fragment timecode of the ack
+ * @param[in] uErrorId The error ID of an eError ack, or 0 otherwise
+ * @param[in] pAppData The application data
+ */
+typedef void (*OnPutMediaFragmentAckCallback_t)(ePutMediaFragmentAckEventType eAckEventType, uint64_t uFragmentTimecode, unsigned int uErrorId, void *pAppData);
+
+typedef struct PutMediaTemplate *PutMediaTemplateHandle;
+
 typedef struct
 {
     char *pcStreamName;
@@ -64,20 +99,36 @@ typedef struct
 
     unsigned int uRecvTimeoutMs;
     unsigned int uSendTimeoutMs;
+
+    /* Socket options of the PUT MEDIA connection. 0 or false keeps the OS default. */
+    bool bTcpNoDelay;
+    unsigned int uSendBufSize;
+    unsigned int uNotSentLowat;
+    unsigned int uKeepAliveIdleSec;
+    unsigned int uKeepAliveIntervalSec;
+    unsigned int uKeepAliveCount;
+
+    /* Optional index of the network interface that the PUT MEDIA connection is bound to, and 0 means the default route. */
+    unsigned int uBindIfIndex;
+
+    /* Optional token-bucket pacing of sends in bits per second, and 0 means no pacing. 0 burst means the default. */
+    unsigned int uPacingRateBps;
+    unsigned int uPacingBurstBytes;
+
+    /* Optional callback of fragment acks, and NULL means no callback. If the callback only is set, acks are not queued
+     * for Kvs_putMediaReadFragmentAck(). */
+    OnPutMediaFragmentAckCallback_t onFragmentAck;
+    void *pFragmentAckAppData;
+    bool bFragmentAckCallbackOnly;
+
+    /* Optional request template from Kvs_putMediaTemplateCreate(), and NULL means the request is built from scratch. */
+    PutMediaTemplateHandle xReqTemplate;
 } KvsPutMediaParameter_t;
 
 typedef struct PutMedia *PutMediaHandle;
 
-/* PUT MEDIA Fragment ACK event type */
-typedef enum
-{
-    eUnknown = 0,
-    eBuffering,
-    eReceived,
-    ePersisted,
-    eError,
-    eIdle
-} ePutMediaFragmentAckEventType;
+/* The max length of the HTTP chunk size line of PUT MEDIA, i.e. the chunk size in hex and CRLF. */
+#define PUT_MEDIA_CHUNK_SIZE_LINE_MAX_LEN (sizeof(size_t) * 2 + 2)
 
 /**
  * @brief Describe stream
@@ -113,6 +164,34 @@ int Kvs_createStream(KvsServiceParameter_t *pServPara, KvsCreateStreamParameter_
  */
 int Kvs_getDataEndpoint(KvsServiceParameter_t *pServPara, KvsGetDataEndpointParameter_t *pGetDataEpPara, unsigned int* puHttpStatusCode, char **ppcDataEndpoint);
 
+/**
+ * @brief Close control plane connections that are kept for reuse
+ *
+ * Describe stream, create stream and get data endpoint keep their connection after the response, so the next call to
+ * the same host reuses it. Call it when no more control plane calls are expected soon, to release the memory of the
+ * TLS connections.
+ */
+void Kvs_closeControlConnections(void);
+
+/**
+ * @brief Create a PUT MEDIA request template
+ *
+ * A template keeps the parts of the PUT MEDIA request that are the same for every connection of a stream, and the
+ * date, security token, producer start timestamp and signature are filled in on each start. It's built by the first
+ * start that uses it, and it's rebuilt if the endpoint, stream name, timecode type or the use of security token
+ * changes. Starts that use the same template should not run at the same time.
+ *
+ * @return The template handle on success, NULL otherwise
+ */
+PutMediaTemplateHandle Kvs_putMediaTemplateCreate(void);
+
+/**
+ * @brief Terminate a PUT MEDIA request template
+ *
+ * @param[in] xReqTemplate The template handle
+ */
+void Kvs_putMediaTemplateTerminate(PutMediaTemplateHandle xReqTemplate);
+
 /**
  * @brief Put media
  *
@@ -128,6 +207,58 @@ int Kvs_getDataEndpoint(KvsServiceParameter_t *pServPara, KvsGetDataEndpointPara
  */
 int Kvs_putMediaStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, unsigned int* puHttpStatusCode, PutMediaHandle *pPutMediaHandle);
 
+/**
+ * @brief Put media without blocking on the connection
+ *
+ * It's the same as Kvs_putMediaStart() except that it returns once the connection is started. Use
+ * Kvs_putMediaStartPoll() to establish the connection and receive the HTTP response, and the handle can't be used to
+ * stream until then. The handle should be terminated by Kvs_putMediaFinish() on failure or non-200 status code.
+ *
+ * @param[in] pServPara The parameter for KVS service
+ * @param[in] pPutMediaPara The parameter for put media
+ * @param[out] pPutMediaHandle The pointer of PUT MEDIA handle on success, or NULL if fail.
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaStartAsync(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, PutMediaHandle *pPutMediaHandle);
+
+/**
+ * @brief Start connecting to the data endpoint before the PUT MEDIA request can be signed
+ *
+ * The TCP connection and TLS handshake make progress in Kvs_putMediaStartPoll() while credentials are fetched, and
+ * the request is given later by Kvs_putMediaStartRequest(). Only pcPutMediaEndpoint, pcPort, the timeouts and the TLS
+ * options of the service parameter are used. Kvs_putMediaStartAsync() is this function followed by
+ * Kvs_putMediaStartRequest().
+ *
+ * @param[in] pServPara The parameter for KVS service
+ * @param[in] pPutMediaPara The parameter for put media
+ * @param[out] pPutMediaHandle The pointer of PUT MEDIA handle on success, or NULL if fail.
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaConnectStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, PutMediaHandle *pPutMediaHandle);
+
+/**
+ * @brief Sign the PUT MEDIA request of a handle from Kvs_putMediaConnectStart()
+ *
+ * The request is sent by Kvs_putMediaStartPoll() once the connection is established, or right away if it already is.
+ *
+ * @param[in] xPutMediaHandle The handle of PUT MEDIA
+ * @param[in] pServPara The parameter for KVS service, with the credentials
+ * @param[in] pPutMediaPara The parameter for put media
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaStartRequest(PutMediaHandle xPutMediaHandle, KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara);
+
+/**
+ * @brief Make progress on a PUT MEDIA handle from Kvs_putMediaStartAsync() without blocking
+ *
+ * @param[in] xPutMediaHandle The handle of PUT MEDIA
+ * @param[out] puHttpStatusCode The HTTP status code once it's done
+ * @param[out] pbDone true if the HTTP response is received, false if it's still in progress, or if the request isn't
+ * given yet
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaStartPoll(PutMediaHandle xPutMediaHandle, unsigned int* puHttpStatusCode, bool *pbDone);
+
 /**
  * @brief Update MKV header and frame data by using PUT MEDIA handle
  *
@@ -140,6 +271,21 @@ int Kvs_putMediaStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *
  */
 int Kvs_putMediaUpdate(PutMediaHandle xPutMediaHandle, uint8_t *pMkvHeader, size_t uMkvHeaderLen, uint8_t *pData, size_t uDataLen);
 
+/**
+ * @brief Update MKV header and a data frame made of segments by using PUT MEDIA handle
+ *
+ * The segments are sent to the socket in order without being gathered into one buffer.
+ *
+ * @param[in] xPutMediaHandle The handle of PUT MEDIA
+ * @param[in] pMkvHeader The MKV header
+ * @param[in] uMkvHeaderLen The length of MKV header
+ * @param[in] pxSegments The segments of the data frame
+ * @param[in] uSegmentCount The number of segments, which is no more than DATA_FRAME_MAX_SEGMENTS
+ * @param[in] bPrefixSegmentLen Send each segment with its length as a big-endian prefix, e.g. NALUs sent as AVCC
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaUpdateV(PutMediaHandle xPutMediaHandle, uint8_t *pMkvHeader, size_t uMkvHeaderLen, const DataFrameSegment_t *pxSegments, size_t uSegmentCount, bool bPrefixSegmentLen);
+
 /**
  * @brief Update raw data by using PUT MEDIA handle
  *
@@ -150,6 +296,33 @@ int Kvs_putMediaUpdate(PutMediaHandle xPutMediaHandle, uint8_t *pMkvHeader, size
  */
 int Kvs_putMediaUpdateRaw(PutMediaHandle xPutMediaHandle, uint8_t *pBuf, size_t uLen);
 
+/**
+ * @brief Update raw data by using PUT MEDIA handle, and write the HTTP chunk framing around the data in place
+ *
+ * If there are at least PUT_MEDIA_CHUNK_SIZE_LINE_MAX_LEN bytes of headroom in front of the data and 2 bytes of
+ * tailroom after it, the chunk size line and the chunk end are written into them, so the whole HTTP chunk is sent as
+ * one contiguous buffer. Otherwise it works the same as Kvs_putMediaUpdateRaw().
+ *
+ * @param[in] xPutMediaHandle The handle of PUT MEDIA
+ * @param[in] pBuf The data, e.g. the MKV header and the data frame right after it
+ * @param[in] uLen The length of the data
+ * @param[in] uHeadroom The number of bytes in front of pBuf that can be overwritten
+ * @param[in] uTailroom The number of bytes after the data that can be overwritten
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaUpdateInPlace(PutMediaHandle xPutMediaHandle, uint8_t *pBuf, size_t uLen, size_t uHeadroom, size_t uTailroom);
+
+/**
+ * @brief End the data of PUT MEDIA with the last chunk of the HTTP chunked body
+ *
+ * The server acks the fragments that are left, including the last one, and then ends the response. Nothing can be
+ * updated afterwards, but fragment acks are still read by Kvs_putMediaDoWork() until the handle is terminated.
+ *
+ * @param[in] xPutMediaHandle The handle of PUT MEDIA
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaEnd(PutMediaHandle xPutMediaHandle);
+
 /**
  * @brief Do PUT MEDIA regular work
  * 
@@ -158,6 +331,25 @@ int Kvs_putMediaUpdateRaw(PutMediaHandle xPutMediaHandle, uint8_t *pBuf, size_t
  */
 int Kvs_putMediaDoWork(PutMediaHandle xPutMediaHandle);
 
+/**
+ * @brief Get the socket of PUT MEDIA, which is readable when a fragment ACK arrives
+ *
+ * It's for waiting with kvsEventWaitSocket() between Kvs_putMediaDoWork() calls. The socket must not be read directly.
+ *
+ * @param[in] xPutMediaHandle The handle of PUT MEDIA
+ * @return The socket descriptor, or -1 if there is none
+ */
+int Kvs_putMediaGetSocket(PutMediaHandle xPutMediaHandle);
+
+/**
+ * @brief Get the bytes and TLS records that are sent and received by the connection of PUT MEDIA
+ *
+ * @param[in] xPutMediaHandle The handle of PUT MEDIA
+ * @param[out] pxStats The statistics
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaGetNetIoStats(PutMediaHandle xPutMediaHandle, NetIoStats_t *pxStats);
+
 /**
  * @brief Terminate the handle of PUT MEDIA
  *
@@ -187,6 +379,19 @@ int Kvs_putMediaUpdateRecvTimeout(PutMediaHandle xPutMediaHandle, unsigned int u
 */
 int Kvs_putMediaUpdateSendTimeout(PutMediaHandle xPutMediaHandle, unsigned int uSendTimeoutMs);
 
+/**
+ * @brief Update the pacing of sends.
+ *
+ * Pacing has been set in PUT MEDIA parameters and is applied during connection setup. It can be altered during streaming,
+ * e.g. to follow the estimated uplink throughput.
+ *
+ * @param[in] xPutMediaHandle The handle of PUT MEDIA
+ * @param[in] uRateBps The rate in bits per second, or 0 to disable pacing
+ * @param[in] uBurstBytes The burst size in bytes, or 0 for the default
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_putMediaUpdatePacing(PutMediaHandle xPutMediaHandle, unsigned int uRateBps, unsigned int uBurstBytes);
+
 /**
  * @brief Non-blocking read a fragment ACK if any.
  *
@@ -201,4 +406,19 @@ int Kvs_putMediaUpdateSendTimeout(PutMediaHandle xPutMediaHandle, unsigned int u
  */
 int Kvs_putMediaReadFragmentAck(PutMediaHandle xPutMediaHandle, ePutMediaFragmentAckEventType *peAckEventType, uint64_t *puFragmentTimecode, unsigned int *puErrorId);
 
+/**
+ * @brief Parse a fragment ACK at the beginning of a PUT MEDIA response body, i.e. a chunk of a JSON message.
+ *
+ * It's the parser used by Kvs_putMediaDoWork(), and it's exposed for benchmarks and fuzzing.
+ *
+ * @param[in] pcSrc The received bytes of the response body
+ * @param[in] uLen The length of the bytes
+ * @param[out] peAckEventType Pointer to the fragment ACK event type
+ * @param[out] puFragmentTimecode Pointer to the fragment timecode
+ * @param[out] puErrorId Pointer to the error ID
+ * @param[out] puFragAckLen Pointer to the length of the parsed fragment ACK, including its chunk length and delimiters
+ * @return 0 on success, KVS_ERROR_INCOMPLETE_FRAGMENT_ACK if more bytes are needed, non-zero value otherwise
+ */
+int Kvs_parseFragmentAck(const char *pcSrc, size_t uLen, ePutMediaFragmentAckEventType *peAckEventType, uint64_t *puFragmentTimecode, unsigned int *puErrorId, size_t *puFragAckLen);
+
 #endif /* KVS_REST_API_H */
\ No newline at end of file
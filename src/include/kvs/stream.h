@@ -18,6 +18,18 @@
 
 #include "kvs/mkv_generator.h"
 
+/* The max number of segments of a data frame. It's enough for one segment per NALU recorded by NALU_analyzeFrame(). */
+#define DATA_FRAME_MAX_SEGMENTS         (16)
+
+/* The length of the big-endian length prefix of a segment if bPrefixSegmentLen of DataFrameIn_t is set. */
+#define DATA_FRAME_SEGMENT_LEN_PREFIX   (4)
+
+typedef struct DataFrameSegment
+{
+    uint8_t *pData;
+    size_t uLen;
+} DataFrameSegment_t;
+
 typedef struct DataFrameIn
 {
     MkvClusterType_t xClusterType;
@@ -25,23 +37,98 @@ typedef struct DataFrameIn
     size_t uDataLen;
     uint64_t uTimestampMs;
     bool bIsKeyFrame;
+
+    /* If it's true, the data frame can be dropped under congestion without breaking other data frames. */
+    bool bIsDisposable;
     TrackType_t xTrackType;
     void *pUserData;
+
+    /* The number of bytes in front of pData that can be overwritten. If it's not less than the MKV header length, the
+     * MKV header is written right in front of pData instead of a separate buffer, so they're contiguous. */
+    size_t uHeadroom;
+
+    /* The lacing of the simple block. If it's laced, pData starts with the lace header that is followed by frames. */
+    MkvLacing_t xLacing;
+
+    /* If uSegmentCount is not 0, the data is made of these non-contiguous segments in order, and uDataLen is the sum
+     * of their lengths. The stream keeps its own copy of the segment list. pData is kept as the buffer that the segments
+     * are in, or it's set to the first segment if it's NULL, and uHeadroom is the headroom in front of pData. */
+    DataFrameSegment_t *pxSegments;
+    size_t uSegmentCount;
+
+    /* If it's true, each segment is sent with its length as a DATA_FRAME_SEGMENT_LEN_PREFIX bytes big-endian prefix,
+     * e.g. NALU payloads of an Annex-B frame that are sent as AVCC, and uDataLen includes the prefixes. */
+    bool bPrefixSegmentLen;
 } DataFrameIn_t;
 
+typedef struct StreamConfig
+{
+    /* The number of slots in the frame slab, or 0 to allocate all data frames from heap. */
+    size_t uFrameSlabSize;
+
+    /* The size of user data stored in each data frame, or 0 to keep pUserData of DataFrameIn_t as it is. */
+    size_t uUserDataSize;
+
+    /* The number of slots in the lock-free ingest ring, or 0 to disable it. */
+    size_t uIngestRingSize;
+} StreamConfig_t;
+
+typedef struct StreamStats
+{
+    size_t uVideoFrameCount;
+    size_t uVideoMemTotal;
+    size_t uAudioFrameCount;
+    size_t uAudioMemTotal;
+
+    /* Timestamps of the oldest and the newest queued data frames, or 0 if the stream is empty. */
+    uint64_t uOldestTimestampMs;
+    uint64_t uNewestTimestampMs;
+
+    /* The max number of queued data frames since the stream is created or it's reset. */
+    size_t uMaxFrameCount;
+} StreamStats_t;
+
 typedef struct DataFrame *DataFrameHandle;
 
 typedef struct Stream *StreamHandle;
 
+/**
+ * @brief Callback of a data frame evicted from a stream. The callback owns the data frame, and it's responsible for
+ * terminating it.
+ */
+typedef void (*OnDataFrameEvicted_t)(DataFrameHandle xDataFrameHandle, void *pAppData);
+
 /**
  * @brief Create a stream
  *
- * @param[in] pVideoTrackInfo The video track info
+ * @param[in] pVideoTrackInfo The video track info, or NULL for an audio-only stream
  * @param[in] pAudioTrackInfo The audio track info if any
  * @return The stream handle on success, NULL otherwise
  */
 StreamHandle Kvs_streamCreate(VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo);
 
+/**
+ * @brief Create a stream with configurations
+ *
+ * The frame slab is a set of fixed-size slots, and each slot holds a data frame handle, its MKV header and user
+ * data. Data frames take slots from the slab and give them back on termination, so there is no memory allocation
+ * in steady state.  If all slots are in use, data frames are allocated from heap instead.
+ *
+ * If uUserDataSize is not zero, uUserDataSize bytes that pUserData of DataFrameIn_t points to are copied into the
+ * data frame when it's added, and pUserData of the data frame points to the copy, which is released along with the
+ * data frame.
+ *
+ * If uIngestRingSize is not zero, Kvs_streamIngestDataFrame() can be used to hand over data frames without lock.
+ *
+ * All data frames must be terminated before the stream is terminated.
+ *
+ * @param[in] pVideoTrackInfo The video track info, or NULL for an audio-only stream
+ * @param[in] pAudioTrackInfo The audio track info if any
+ * @param[in] pxConfig The stream configurations, or NULL to use default configurations
+ * @return The stream handle on success, NULL otherwise
+ */
+StreamHandle Kvs_streamCreateEx(VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo, StreamConfig_t *pxConfig);
+
 /**
  * @brief Terminate a stream handle
  *
@@ -59,18 +146,73 @@ void Kvs_streamTermintate(StreamHandle xStreamHandle);
  */
 int Kvs_streamGetMkvEbmlSegHdr(StreamHandle xStreamHandle, uint8_t **ppMkvHeader, size_t *puMkvHeaderLen);
 
+typedef struct MkvEbmlSegHdr *MkvEbmlSegHdrHandle;
+
+/**
+ * @brief Take a reference of the MKV EBML and segment header of a stream
+ *
+ * The header is immutable, and it stays valid until the reference is released even if the stream has moved to a new
+ * header, so it can be sent without holding any lock.
+ *
+ * @param[in] xStreamHandle The stream handle
+ * @param[out] pxMkvEbmlSegHdrHandle The reference to be released by Kvs_streamReleaseMkvEbmlSegHdr()
+ * @param[out] ppMkvHeader The MKV EBML and segment header
+ * @param[out] puMkvHeaderLen The length of MKV header
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_streamAcquireMkvEbmlSegHdr(StreamHandle xStreamHandle, MkvEbmlSegHdrHandle *pxMkvEbmlSegHdrHandle, uint8_t **ppMkvHeader, size_t *puMkvHeaderLen);
+
+/**
+ * @brief Release a reference taken by Kvs_streamAcquireMkvEbmlSegHdr()
+ *
+ * @param[in] xMkvEbmlSegHdrHandle The reference, or NULL
+ */
+void Kvs_streamReleaseMkvEbmlSegHdr(MkvEbmlSegHdrHandle xMkvEbmlSegHdrHandle);
+
+/**
+ * @brief Replace the MKV EBML and segment header of a stream with new track info, e.g. when a new segment starts
+ *
+ * If the track info, including the codec private data, is the same as the one of the current header, the header is
+ * kept. Otherwise, the header returned by Kvs_streamGetMkvEbmlSegHdr() before is released, and the references taken
+ * by Kvs_streamAcquireMkvEbmlSegHdr() keep the old header until they're released.
+ *
+ * @param[in] xStreamHandle The stream handle
+ * @param[in] pVideoTrackInfo The video track info. It's ignored if the stream has no video track.
+ * @param[in] pAudioTrackInfo The audio track info. It's ignored if the stream has no audio track.
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_streamUpdateMkvEbmlSegHdr(StreamHandle xStreamHandle, VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo);
+
 /**
  * @brief Add a data Frame to a stream
  *
  * Data members in DataFrameIn_t are set by application, then it will be added into stream with needed information
  * and return DataFrameHandle which wrapped these information.
  *
+ * Each track has its own queue, and data frames of a track are expected to be added in timestamp order.  The MKV
+ * header of a data frame is built from the template of its track when it's added. Only the delta timestamp is patched
+ * when it's peeked or popped, because it depends on the cluster sent before it.
+ *
  * @param xStreamHandle[in] The stream handle
  * @param pxDataFrameIn[in] The data frame that is set by application
  * @return The data frame handle on success, NULL otherwise
  */
 DataFrameHandle Kvs_streamAddDataFrame(StreamHandle xStreamHandle, DataFrameIn_t *pxDataFrameIn);
 
+/**
+ * @brief Hand over a data Frame to a stream through the ingest ring without lock
+ *
+ * The data frame is copied into the single-producer/single-consumer ingest ring, and it's moved into the stream by
+ * the next call of pop, peek, or any other query of the stream. Only one thread can call this function at a time.
+ * If the ingest ring is full, the caller can fall back to Kvs_streamAddDataFrame(). Data frames made of segments are
+ * not accepted, because the segment list is copied when the data frame is moved into the stream.
+ *
+ * @param xStreamHandle[in] The stream handle
+ * @param pxDataFrameIn[in] The data frame that is set by application
+ * @return 0 on success, KVS_ERROR_STREAM_INGEST_RING_FULL if the ingest ring is full, non-zero value otherwise
+ */
+int Kvs_streamIngestDataFrame(StreamHandle xStreamHandle, DataFrameIn_t *pxDataFrameIn);
+
 /**
  * @brief Pop a data frame from a stream
  *
@@ -87,6 +229,71 @@ DataFrameHandle Kvs_streamPop(StreamHandle xStreamHandle);
  */
 DataFrameHandle Kvs_streamPeek(StreamHandle xStreamHandle);
 
+/**
+ * @brief Evict data frames from the head of a stream by whole GOPs until its memory total is under a limit
+ *
+ * The stream keeps an index of pending clusters and the memory of each GOP, so eviction drops whole GOPs without
+ * walking data frames one by one, and the head of the stream is always a cluster after eviction. The data frames
+ * that are left from a GOP whose cluster has been popped are evicted first. The GOP of the newest cluster is never
+ * evicted, so the memory total may still be above the limit.
+ *
+ * Evicted data frames are passed to the callback in the order they would have been popped, after the stream is
+ * unlocked.
+ *
+ * @param xStreamHandle[in] The stream handle
+ * @param uMemLimit[in] The memory limit of the stream
+ * @param onDataFrameEvicted[in] The callback of evicted data frames
+ * @param pAppData[in] The application data passed to the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_streamEvictGopsUntilMem(StreamHandle xStreamHandle, size_t uMemLimit, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData);
+
+/**
+ * @brief Evict data frames from the head of a stream by whole GOPs until the time between the oldest and the newest
+ * pending cluster is within a window
+ *
+ * It works the same as Kvs_streamEvictGopsUntilMem(), except that the limit is the timestamp difference between the
+ * first and the last pending cluster, so the backlog is bounded in time no matter what the bitrate is.
+ *
+ * @param xStreamHandle[in] The stream handle
+ * @param uTimeWindowMs[in] The time window in milliseconds
+ * @param onDataFrameEvicted[in] The callback of evicted data frames
+ * @param pAppData[in] The application data passed to the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_streamEvictGopsUntilTimeWindow(StreamHandle xStreamHandle, uint64_t uTimeWindowMs, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData);
+
+/**
+ * @brief Skip the head of a stream to a later cluster if the oldest data frame is too far behind the newest one
+ *
+ * The age of the stream is the timestamp difference between the oldest and the newest queued data frame. If it's over
+ * the latency, data frames are evicted up to the first pending cluster that is within the latency, or the newest
+ * pending cluster, so stale inter frames are dropped instead of sent late. The rest of a GOP whose cluster has been
+ * popped is evicted as well. If there is no later cluster to skip to, nothing is evicted.
+ *
+ * @param xStreamHandle[in] The stream handle
+ * @param uLatencyMs[in] The latency in milliseconds
+ * @param onDataFrameEvicted[in] The callback of evicted data frames
+ * @param pAppData[in] The application data passed to the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_streamEvictGopsUntilLatency(StreamHandle xStreamHandle, uint64_t uLatencyMs, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData);
+
+/**
+ * @brief Drop disposable data frames from a stream until its memory total is under a limit
+ *
+ * Data frames marked with bIsDisposable are dropped from the oldest one, and the rest of data frames are kept in
+ * place. Clusters are never dropped. It's used before GOP eviction, so the stream degrades to a lower frame rate
+ * before whole GOPs are lost. Dropped data frames are passed to the callback after the stream is unlocked.
+ *
+ * @param xStreamHandle[in] The stream handle
+ * @param uMemLimit[in] The memory limit of the stream
+ * @param onDataFrameEvicted[in] The callback of dropped data frames
+ * @param pAppData[in] The application data passed to the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_streamDropDisposableUntilMem(StreamHandle xStreamHandle, size_t uMemLimit, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData);
+
 /**
  * @brief Check if there is any data available in the stream
  * 
@@ -114,15 +321,45 @@ bool Kvs_streamAvailOnTrack(StreamHandle xStreamHandle, TrackType_t xTrackType);
  *
  * Memory total = size of stream handle + MKV EBML & segment len + total size of data frame handle and data
  *
+ * The memory used by data frames is maintained incrementally on add and pop, so it's cheap to be called on every frame.
+ *
  * @param xStreamHandle[in] The stream handle
  * @param puMemTotal[out] The total memory used
  * @return 0 on success, non-zero value otherwise
  */
 int Kvs_streamMemStatTotal(StreamHandle xStreamHandle, size_t *puMemTotal);
 
+/**
+ * @brief Get the memory used and the number of data frames pending on a specific track
+ *
+ * Memory used on a track = total size of data frame handle and data of this track
+ *
+ * @param xStreamHandle[in] The stream handle
+ * @param xTrackType[in] The specific track type
+ * @param puMemTotal[out] The memory used by data frames of this track
+ * @param puFrameCount[out] The number of data frames of this track
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_streamMemStatOnTrack(StreamHandle xStreamHandle, TrackType_t xTrackType, size_t *puMemTotal, size_t *puFrameCount);
+
+/**
+ * @brief Get the statistics of queued data frames in a stream
+ *
+ * All statistics are maintained incrementally on add and pop, so it doesn't walk through data frames.
+ *
+ * @param xStreamHandle[in] The stream handle
+ * @param pxStats[out] The statistics
+ * @param bResetMaxFrameCount[in] Reset the max number of queued data frames to the current number after it's read
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_streamGetStats(StreamHandle xStreamHandle, StreamStats_t *pxStats, bool bResetMaxFrameCount);
+
 /**
  * @brief Get MKV header and data from a data frame
  *
+ * If the data frame has enough headroom, the MKV header is right in front of the data. If the data frame is made of
+ * segments, ppData is set to NULL, and the segments are got by Kvs_dataFrameGetSegments().
+ *
  * @param xDataFrameHandle[in] The data frame handle
  * @param ppMkvHeader[out] The MKV header
  * @param puMkvHeaderLen[out] THe MKV header length
@@ -132,6 +369,16 @@ int Kvs_streamMemStatTotal(StreamHandle xStreamHandle, size_t *puMemTotal);
  */
 int Kvs_dataFrameGetContent(DataFrameHandle xDataFrameHandle, uint8_t **ppMkvHeader, size_t *puMkvHeaderLen, uint8_t **ppData, size_t *puDataLen);
 
+/**
+ * @brief Get the segments of a data frame
+ *
+ * @param xDataFrameHandle[in] The data frame handle
+ * @param ppxSegments[out] The segments, or NULL if the data is contiguous
+ * @param puSegmentCount[out] The number of segments, or 0 if the data is contiguous
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_dataFrameGetSegments(DataFrameHandle xDataFrameHandle, const DataFrameSegment_t **ppxSegments, size_t *puSegmentCount);
+
 /**
  * @brief Terminate a data frame handle
  *
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVS_TRACEPOINT_H
+#define KVS_TRACEPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tracepoints are compiled only if KVS lib is built with USE_TRACEPOINTS, otherwise they cost nothing and these APIs
+ * return KVS_ERROR_TRACEPOINTS_NOT_ENABLED. */
+
+/* Number of events kept in the ring, which must be a power of 2. The oldest events are overwritten. */
+#ifndef KVS_TRACE_RING_SIZE
+#define KVS_TRACE_RING_SIZE     (4096)
+#endif
+
+/* Each of them is a slice of the trip of a frame, which begins and ends in the same thread. */
+typedef enum KvsTraceEventId
+{
+    KVS_TRACE_APP_ADD_FRAME = 0,    /* KvsApp_addFrameWithCallbacks() */
+    KVS_TRACE_STREAM_ADD_FRAME,     /* Kvs_streamAddDataFrame() */
+    KVS_TRACE_APP_SEND_DATA,        /* Sending a data frame, a spilled record or replayed bytes in KvsApp_doWork() */
+    KVS_TRACE_NETIO_SEND,           /* NetIo_send() and NetIo_sendv() */
+    KVS_TRACE_EVENT_COUNT
+} KvsTraceEventId_t;
+
+/**
+ * Output of kvsTraceDump(). The JSON is written in pieces, so it can be streamed to a file or a socket.
+ *
+ * @param[in] pcData The piece of JSON, which is not NULL terminated
+ * @param[in] uLen Length of the piece
+ * @param[in] pAppData The application data passed to kvsTraceDump()
+ * @return 0 on success, non-zero value to stop the dump
+ */
+typedef int (*KvsTraceWrite_t)(const char *pcData, size_t uLen, void *pAppData);
+
+/**
+ * Dump the events in the ring in Chrome trace event format, which can be opened by chrome://tracing or Perfetto.
+ *
+ * Timestamps are monotonic time in microseconds, and each thread is a track. Events are still recorded while it dumps,
+ * so the newest ones may be missing, and a slice whose begin has been overwritten only has its end.
+ *
+ * @param[in] write The output
+ * @param[in] pAppData The application data passed to the output
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsTraceDump(KvsTraceWrite_t write, void *pAppData);
+
+/**
+ * Drop all events in the ring.
+ *
+ * @return 0 on success, non-zero value otherwise
+ */
+int kvsTraceClear(void);
+
+#endif /* KVS_TRACEPOINT_H */
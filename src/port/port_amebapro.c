@@ -15,24 +15,71 @@
 
 #include <inttypes.h>
 #include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <time.h>
 
 /* Headers for FreeRTOS */
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
+
+#ifdef KVS_USE_HW_CRYPTO
+/* Headers for the crypto engine */
+#include "crypto_api.h"
+#include "device_lock.h"
+#endif
 
 #include "kvs/errors.h"
 #include "kvs/port.h"
 
 #define PAST_OLD_TIME_IN_EPOCH 1600000000
 
+#define THREAD_PRIORITY (tskIDLE_PRIORITY + 1)
+#define DEFAULT_THREAD_STACK_SIZE (8 * 1024)
+#define EVENT_SOCKET_POLL_INTERVAL_MS (10)
+
+/* The ISO 8601 string of the last second, shared by all the tasks that sign requests */
+static time_t gxIso8601Time = 0;
+static char gpcIso8601[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE] = {0};
+
+/* The tick count is extended to 64 bits, so the monotonic clock doesn't wrap around. */
+static TickType_t gxLastTickCount = 0;
+static uint64_t guTickCountHigh = 0;
+
+typedef struct KvsThread
+{
+    TaskHandle_t xTask;
+    KvsThreadFunc_t xThreadFunc;
+    void *pArg;
+
+    /* FreeRTOS has no join, so the task gives this semaphore before it deletes itself. */
+    SemaphoreHandle_t xExited;
+} KvsThread_t;
+
+static void prvThreadRoutine(void *pArg)
+{
+    KvsThread_t *pxThread = (KvsThread_t *)pArg;
+
+    pxThread->xThreadFunc(pxThread->pArg);
+    xSemaphoreGive(pxThread->xExited);
+    vTaskDelete(NULL);
+}
+
 int platformInit(void)
 {
     int res = KVS_ERRNO_NONE;
 
     srand(time(NULL));
 
+#ifdef KVS_USE_HW_CRYPTO
+    if (crypto_init() != 0)
+    {
+        res = KVS_ERROR_CRYPTO_ENGINE_ERROR;
+    }
+#endif
+
     return res;
 }
 
@@ -40,6 +87,8 @@ int getTimeInIso8601(char *pBuf, size_t uBufSize)
 {
     int res = KVS_ERRNO_NONE;
     time_t xTimeUtcNow = {0};
+    struct tm xTm = {0};
+    bool bCached = false;
 
     if (pBuf == NULL || uBufSize < DATE_TIME_ISO_8601_FORMAT_STRING_SIZE)
     {
@@ -55,7 +104,22 @@ int getTimeInIso8601(char *pBuf, size_t uBufSize)
         }
         else
         {
-            strftime(pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE, "%Y%m%dT%H%M%SZ", gmtime(&xTimeUtcNow));
+            taskENTER_CRITICAL();
+            if (xTimeUtcNow == gxIso8601Time)
+            {
+                memcpy(pBuf, gpcIso8601, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE);
+                bCached = true;
+            }
+            taskEXIT_CRITICAL();
+
+            if (!bCached)
+            {
+                strftime(pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE, "%Y%m%dT%H%M%SZ", gmtime_r(&xTimeUtcNow, &xTm));
+                taskENTER_CRITICAL();
+                memcpy(gpcIso8601, pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE);
+                gxIso8601Time = xTimeUtcNow;
+                taskEXIT_CRITICAL();
+            }
         }
     }
 
@@ -73,6 +137,31 @@ uint64_t getEpochTimestampInMs(void)
     return timestamp;
 }
 
+uint64_t getMonotonicTimeInUs(void)
+{
+    TickType_t xTickCount = 0;
+    uint64_t uTicks = 0;
+
+    /* Its resolution is a tick. It has to be called at least once per wrap around of the tick count, which is 49 days
+     * at 1000 Hz, and KVS calls it on every doWork. */
+    taskENTER_CRITICAL();
+    xTickCount = xTaskGetTickCount();
+    if (xTickCount < gxLastTickCount)
+    {
+        guTickCountHigh += (uint64_t)portMAX_DELAY + 1;
+    }
+    gxLastTickCount = xTickCount;
+    uTicks = guTickCountHigh + xTickCount;
+    taskEXIT_CRITICAL();
+
+    return uTicks * 1000000 / configTICK_RATE_HZ;
+}
+
+uint64_t getMonotonicTimeInMs(void)
+{
+    return getMonotonicTimeInUs() / 1000;
+}
+
 uint8_t getRandomNumber(void)
 {
     return (uint8_t)rand();
@@ -81,4 +170,187 @@ uint8_t getRandomNumber(void)
 void sleepInMs(uint32_t ms)
 {
     vTaskDelay( ms / portTICK_PERIOD_MS );
-}
\ No newline at end of file
+}
+
+KvsEventHandle kvsEventCreate(void)
+{
+    /* A binary semaphore keeps one pending signal, which is exactly an auto-reset event. */
+    return (KvsEventHandle)xSemaphoreCreateBinary();
+}
+
+void kvsEventTerminate(KvsEventHandle xEvent)
+{
+    if (xEvent != NULL)
+    {
+        vSemaphoreDelete((SemaphoreHandle_t)xEvent);
+    }
+}
+
+void kvsEventSignal(KvsEventHandle xEvent)
+{
+    if (xEvent != NULL)
+    {
+        xSemaphoreGive((SemaphoreHandle_t)xEvent);
+    }
+}
+
+bool kvsEventWait(KvsEventHandle xEvent, uint32_t uTimeoutMs)
+{
+    bool bSignaled = false;
+
+    if (xEvent != NULL)
+    {
+        bSignaled = (xSemaphoreTake((SemaphoreHandle_t)xEvent, uTimeoutMs / portTICK_PERIOD_MS) == pdTRUE);
+    }
+
+    return bSignaled;
+}
+
+int kvsEventWaitSocket(KvsEventHandle xEvent, int xSocket, uint32_t uTimeoutMs)
+{
+    int xResult = 0;
+    TickType_t xStartTick = xTaskGetTickCount();
+    TickType_t xTimeoutTicks = uTimeoutMs / portTICK_PERIOD_MS;
+    TickType_t xElapsedTicks = 0;
+    TickType_t xWaitTicks = 0;
+    fd_set xReadFds;
+    struct timeval tv = {0};
+
+    if (xEvent == NULL)
+    {
+        /* nop */
+    }
+    else if (xSocket < 0)
+    {
+        xResult = kvsEventWait(xEvent, uTimeoutMs) ? KVS_EVENT_SIGNALED : 0;
+    }
+    else
+    {
+        /* lwIP can't wait on a semaphore and a socket at once, so the socket is checked between short waits on the
+         * event. A signal wakes it immediately, and a readable socket is seen within the poll interval. */
+        do
+        {
+            FD_ZERO(&xReadFds);
+            FD_SET(xSocket, &xReadFds);
+            if (select(xSocket + 1, &xReadFds, NULL, NULL, &tv) != 0)
+            {
+                xResult |= KVS_EVENT_SOCKET_READABLE;
+            }
+
+            xWaitTicks = (xResult != 0) ? 0 : xTimeoutTicks - xElapsedTicks;
+            if (xWaitTicks > EVENT_SOCKET_POLL_INTERVAL_MS / portTICK_PERIOD_MS)
+            {
+                xWaitTicks = EVENT_SOCKET_POLL_INTERVAL_MS / portTICK_PERIOD_MS;
+            }
+            if (xSemaphoreTake((SemaphoreHandle_t)xEvent, xWaitTicks) == pdTRUE)
+            {
+                xResult |= KVS_EVENT_SIGNALED;
+            }
+
+            xElapsedTicks = xTaskGetTickCount() - xStartTick;
+        } while (xResult == 0 && xElapsedTicks < xTimeoutTicks);
+    }
+
+    return xResult;
+}
+
+KvsThreadHandle kvsThreadCreate(KvsThreadFunc_t xThreadFunc, void *pArg, size_t uStackSize, int xCoreId)
+{
+    KvsThread_t *pxThread = NULL;
+    bool bCreated = false;
+
+    (void)xCoreId;
+
+    if (xThreadFunc != NULL && (pxThread = (KvsThread_t *)pvPortMalloc(sizeof(KvsThread_t))) != NULL &&
+        (pxThread->xExited = xSemaphoreCreateBinary()) != NULL)
+    {
+        pxThread->xThreadFunc = xThreadFunc;
+        pxThread->pArg = pArg;
+        if (uStackSize == 0)
+        {
+            uStackSize = DEFAULT_THREAD_STACK_SIZE;
+        }
+        bCreated = (xTaskCreate(prvThreadRoutine, "kvsThread", (uint16_t)(uStackSize / sizeof(StackType_t)), pxThread, THREAD_PRIORITY, &(pxThread->xTask)) == pdPASS);
+    }
+
+    if (!bCreated && pxThread != NULL)
+    {
+        if (pxThread->xExited != NULL)
+        {
+            vSemaphoreDelete(pxThread->xExited);
+        }
+        vPortFree(pxThread);
+        pxThread = NULL;
+    }
+
+    return pxThread;
+}
+
+void kvsThreadJoin(KvsThreadHandle xThread)
+{
+    KvsThread_t *pxThread = xThread;
+
+    if (pxThread != NULL)
+    {
+        xSemaphoreTake(pxThread->xExited, portMAX_DELAY);
+        vSemaphoreDelete(pxThread->xExited);
+        vPortFree(pxThread);
+    }
+}
+
+uint32_t kvsThreadGetCurrentId(void)
+{
+    return (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+}
+
+#ifdef KVS_USE_HW_CRYPTO
+int kvsSha256(const uint8_t *pMsg, size_t uMsgLen, uint8_t *pDigest)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pMsg == NULL || pDigest == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        /* The engine is shared with the mbedTLS of the SDK. */
+        device_mutex_lock(RT_DEV_LOCK_CRYPTO);
+        if (crypto_sha2_256(pMsg, uMsgLen, pDigest) != 0)
+        {
+            res = KVS_ERROR_CRYPTO_ENGINE_ERROR;
+        }
+        device_mutex_unlock(RT_DEV_LOCK_CRYPTO);
+    }
+
+    return res;
+}
+
+int kvsHmacSha256(const uint8_t *pKey, size_t uKeyLen, const uint8_t *pMsg, size_t uMsgLen, uint8_t *pMac)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t pDigest[KVS_SHA256_DIGEST_LENGTH] = {0};
+
+    if (pKey == NULL || pMsg == NULL || pMac == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        /* The output may be the key buffer, so it's copied after the engine is done with the key. */
+        device_mutex_lock(RT_DEV_LOCK_CRYPTO);
+        if (crypto_hmac_sha2_256(pMsg, uMsgLen, pKey, uKeyLen, pDigest) != 0)
+        {
+            res = KVS_ERROR_CRYPTO_ENGINE_ERROR;
+        }
+        device_mutex_unlock(RT_DEV_LOCK_CRYPTO);
+
+        if (res == KVS_ERRNO_NONE)
+        {
+            memcpy(pMac, pDigest, KVS_SHA256_DIGEST_LENGTH);
+        }
+    }
+
+    return res;
+}
+#endif /* KVS_USE_HW_CRYPTO */
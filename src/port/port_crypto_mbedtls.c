@@ -0,0 +1,79 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stddef.h>
+
+/* Thirdparty headers */
+#include "mbedtls/md.h"
+#include "mbedtls/sha256.h"
+
+#include "kvs/errors.h"
+#include "kvs/port.h"
+
+#ifndef KVS_USE_HW_CRYPTO
+
+int kvsSha256(const uint8_t *pMsg, size_t uMsgLen, uint8_t *pDigest)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+
+    if (pMsg == NULL || pDigest == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((retVal = mbedtls_sha256_ret(pMsg, uMsgLen, pDigest, 0)) != 0)
+    {
+        res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return res;
+}
+
+int kvsHmacSha256(const uint8_t *pKey, size_t uKeyLen, const uint8_t *pMsg, size_t uMsgLen, uint8_t *pMac)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+    const mbedtls_md_info_t *pxMdInfo = NULL;
+
+    if (pKey == NULL || pMsg == NULL || pMac == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((pxMdInfo = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256)) == NULL)
+    {
+        res = KVS_ERROR_UNKNOWN_MBEDTLS_MESSAGE_DIGEST;
+    }
+    else if (mbedtls_md_get_size(pxMdInfo) != KVS_SHA256_DIGEST_LENGTH)
+    {
+        res = KVS_ERROR_INVALID_MBEDTLS_MESSAGE_DIGEST_SIZE;
+    }
+    /* The key is copied into the HMAC context before the output is written, so they can share the buffer. */
+    else if ((retVal = mbedtls_md_hmac(pxMdInfo, pKey, uKeyLen, pMsg, uMsgLen, pMac)) != 0)
+    {
+        res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return res;
+}
+
+#endif /* KVS_USE_HW_CRYPTO */
@@ -15,17 +15,54 @@
 
 #include <inttypes.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#ifdef KVS_USE_PORT_ALLOC_CLASS
+#include "esp_heap_caps.h"
+#endif
 
 #include "kvs/errors.h"
 #include "kvs/port.h"
 
 #define PAST_OLD_TIME_IN_EPOCH 1600000000
 
+#define THREAD_PRIORITY (tskIDLE_PRIORITY + 5)
+#define DEFAULT_THREAD_STACK_SIZE (8 * 1024)
+#define EVENT_SOCKET_POLL_INTERVAL_MS (10)
+
+/* The ISO 8601 string of the last second, shared by all the tasks that sign requests */
+static time_t gxIso8601Time = 0;
+static char gpcIso8601[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE] = {0};
+static portMUX_TYPE gxIso8601Mux = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct KvsThread
+{
+    TaskHandle_t xTask;
+    KvsThreadFunc_t xThreadFunc;
+    void *pArg;
+
+    /* FreeRTOS has no join, so the task gives this semaphore before it deletes itself. */
+    SemaphoreHandle_t xExited;
+} KvsThread_t;
+
+static void prvThreadRoutine(void *pArg)
+{
+    KvsThread_t *pxThread = (KvsThread_t *)pArg;
+
+    pxThread->xThreadFunc(pxThread->pArg);
+    xSemaphoreGive(pxThread->xExited);
+    vTaskDelete(NULL);
+}
+
 int platformInit(void)
 {
     int res = KVS_ERRNO_NONE;
@@ -39,6 +76,8 @@ int getTimeInIso8601(char *pBuf, size_t uBufSize)
 {
     int res = KVS_ERRNO_NONE;
     time_t xTimeUtcNow = {0};
+    struct tm xTm = {0};
+    bool bCached = false;
 
     if (pBuf == NULL || uBufSize < DATE_TIME_ISO_8601_FORMAT_STRING_SIZE)
     {
@@ -54,7 +93,22 @@ int getTimeInIso8601(char *pBuf, size_t uBufSize)
         }
         else
         {
-            strftime(pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE, "%Y%m%dT%H%M%SZ", gmtime(&xTimeUtcNow));
+            portENTER_CRITICAL(&gxIso8601Mux);
+            if (xTimeUtcNow == gxIso8601Time)
+            {
+                memcpy(pBuf, gpcIso8601, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE);
+                bCached = true;
+            }
+            portEXIT_CRITICAL(&gxIso8601Mux);
+
+            if (!bCached)
+            {
+                strftime(pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE, "%Y%m%dT%H%M%SZ", gmtime_r(&xTimeUtcNow, &xTm));
+                portENTER_CRITICAL(&gxIso8601Mux);
+                memcpy(gpcIso8601, pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE);
+                gxIso8601Time = xTimeUtcNow;
+                portEXIT_CRITICAL(&gxIso8601Mux);
+            }
         }
     }
 
@@ -72,12 +126,176 @@ uint64_t getEpochTimestampInMs(void)
     return timestamp;
 }
 
+uint64_t getMonotonicTimeInUs(void)
+{
+    /* The high resolution timer counts from boot, and it isn't changed by settimeofday(). */
+    return (uint64_t)esp_timer_get_time();
+}
+
+uint64_t getMonotonicTimeInMs(void)
+{
+    return getMonotonicTimeInUs() / 1000;
+}
+
 uint8_t getRandomNumber(void)
 {
     return (uint8_t)rand();
 }
 
+#ifdef KVS_USE_PORT_ALLOC_CLASS
+void *kvsMallocClass(size_t bytes, KvsAllocClass_t xClass)
+{
+    void *ptr = NULL;
+
+    if (xClass == KVS_ALLOC_CLASS_MEDIA)
+    {
+        /* Media buffers are large and accessed sequentially, so they can afford the latency of PSRAM. */
+        ptr = heap_caps_malloc_prefer(bytes, 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    else if (xClass == KVS_ALLOC_CLASS_METADATA || xClass == KVS_ALLOC_CLASS_CRYPTO)
+    {
+        /* Hot structures stay in internal SRAM as long as it has room. */
+        ptr = heap_caps_malloc_prefer(bytes, 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    else
+    {
+        ptr = malloc(bytes);
+    }
+
+    return ptr;
+}
+#endif /* KVS_USE_PORT_ALLOC_CLASS */
+
 void sleepInMs(uint32_t ms)
 {
     vTaskDelay( ms / portTICK_PERIOD_MS );
+}
+
+KvsEventHandle kvsEventCreate(void)
+{
+    /* A binary semaphore keeps one pending signal, which is exactly an auto-reset event. */
+    return (KvsEventHandle)xSemaphoreCreateBinary();
+}
+
+void kvsEventTerminate(KvsEventHandle xEvent)
+{
+    if (xEvent != NULL)
+    {
+        vSemaphoreDelete((SemaphoreHandle_t)xEvent);
+    }
+}
+
+void kvsEventSignal(KvsEventHandle xEvent)
+{
+    if (xEvent != NULL)
+    {
+        xSemaphoreGive((SemaphoreHandle_t)xEvent);
+    }
+}
+
+bool kvsEventWait(KvsEventHandle xEvent, uint32_t uTimeoutMs)
+{
+    bool bSignaled = false;
+
+    if (xEvent != NULL)
+    {
+        bSignaled = (xSemaphoreTake((SemaphoreHandle_t)xEvent, uTimeoutMs / portTICK_PERIOD_MS) == pdTRUE);
+    }
+
+    return bSignaled;
+}
+
+int kvsEventWaitSocket(KvsEventHandle xEvent, int xSocket, uint32_t uTimeoutMs)
+{
+    int xResult = 0;
+    TickType_t xStartTick = xTaskGetTickCount();
+    TickType_t xTimeoutTicks = uTimeoutMs / portTICK_PERIOD_MS;
+    TickType_t xElapsedTicks = 0;
+    TickType_t xWaitTicks = 0;
+    fd_set xReadFds;
+    struct timeval tv = {0};
+
+    if (xEvent == NULL)
+    {
+        /* nop */
+    }
+    else if (xSocket < 0)
+    {
+        xResult = kvsEventWait(xEvent, uTimeoutMs) ? KVS_EVENT_SIGNALED : 0;
+    }
+    else
+    {
+        /* lwIP can't wait on a semaphore and a socket at once, so the socket is checked between short waits on the
+         * event. A signal wakes it immediately, and a readable socket is seen within the poll interval. */
+        do
+        {
+            FD_ZERO(&xReadFds);
+            FD_SET(xSocket, &xReadFds);
+            if (select(xSocket + 1, &xReadFds, NULL, NULL, &tv) != 0)
+            {
+                xResult |= KVS_EVENT_SOCKET_READABLE;
+            }
+
+            xWaitTicks = (xResult != 0) ? 0 : xTimeoutTicks - xElapsedTicks;
+            if (xWaitTicks > EVENT_SOCKET_POLL_INTERVAL_MS / portTICK_PERIOD_MS)
+            {
+                xWaitTicks = EVENT_SOCKET_POLL_INTERVAL_MS / portTICK_PERIOD_MS;
+            }
+            if (xSemaphoreTake((SemaphoreHandle_t)xEvent, xWaitTicks) == pdTRUE)
+            {
+                xResult |= KVS_EVENT_SIGNALED;
+            }
+
+            xElapsedTicks = xTaskGetTickCount() - xStartTick;
+        } while (xResult == 0 && xElapsedTicks < xTimeoutTicks);
+    }
+
+    return xResult;
+}
+
+KvsThreadHandle kvsThreadCreate(KvsThreadFunc_t xThreadFunc, void *pArg, size_t uStackSize, int xCoreId)
+{
+    KvsThread_t *pxThread = NULL;
+    bool bCreated = false;
+
+    if (xThreadFunc != NULL && (pxThread = (KvsThread_t *)pvPortMalloc(sizeof(KvsThread_t))) != NULL &&
+        (pxThread->xExited = xSemaphoreCreateBinary()) != NULL)
+    {
+        pxThread->xThreadFunc = xThreadFunc;
+        pxThread->pArg = pArg;
+        if (uStackSize == 0)
+        {
+            uStackSize = DEFAULT_THREAD_STACK_SIZE;
+        }
+        bCreated = (xTaskCreatePinnedToCore(prvThreadRoutine, "kvsThread", (uint32_t)uStackSize, pxThread, THREAD_PRIORITY, &(pxThread->xTask), (xCoreId >= 0) ? xCoreId : tskNO_AFFINITY) == pdPASS);
+    }
+
+    if (!bCreated && pxThread != NULL)
+    {
+        if (pxThread->xExited != NULL)
+        {
+            vSemaphoreDelete(pxThread->xExited);
+        }
+        vPortFree(pxThread);
+        pxThread = NULL;
+    }
+
+    return pxThread;
+}
+
+void kvsThreadJoin(KvsThreadHandle xThread)
+{
+    KvsThread_t *pxThread = xThread;
+
+    if (pxThread != NULL)
+    {
+        xSemaphoreTake(pxThread->xExited, portMAX_DELAY);
+        vSemaphoreDelete(pxThread->xExited);
+        vPortFree(pxThread);
+    }
+}
+
+uint32_t kvsThreadGetCurrentId(void)
+{
+    return (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
 }
\ No newline at end of file
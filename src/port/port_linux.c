@@ -13,9 +13,20 @@
  * permissions and limitations under the License.
  */
 
+#ifndef _GNU_SOURCE
+/* needed for pthread_attr_setaffinity_np() */
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
@@ -25,6 +36,39 @@
 
 #define PAST_OLD_TIME_IN_EPOCH 1600000000
 
+/* The ISO 8601 string of the last second, shared by all the tasks that sign requests */
+static time_t gxIso8601Time = 0;
+static char gpcIso8601[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE] = {0};
+static pthread_mutex_t gxIso8601Lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct KvsEvent
+{
+    pthread_mutex_t xMutex;
+    pthread_cond_t xCond;
+    bool bSignaled;
+
+    /* A condition variable can't be polled with a socket, so a socket waiter is woken by a pipe. It's created by the
+     * first kvsEventWaitSocket(). */
+    int xPipe[2];
+    bool bSocketWaiting;
+} KvsEvent_t;
+
+typedef struct KvsThread
+{
+    pthread_t xTid;
+    KvsThreadFunc_t xThreadFunc;
+    void *pArg;
+} KvsThread_t;
+
+static void *prvThreadRoutine(void *pArg)
+{
+    KvsThread_t *pxThread = (KvsThread_t *)pArg;
+
+    pxThread->xThreadFunc(pxThread->pArg);
+
+    return NULL;
+}
+
 int platformInit(void)
 {
     int res = KVS_ERRNO_NONE;
@@ -38,6 +82,8 @@ int getTimeInIso8601(char *pBuf, size_t uBufSize)
 {
     int res = KVS_ERRNO_NONE;
     time_t xTimeUtcNow = {0};
+    struct tm xTm = {0};
+    bool bCached = false;
 
     if (pBuf == NULL || uBufSize < DATE_TIME_ISO_8601_FORMAT_STRING_SIZE)
     {
@@ -53,7 +99,22 @@ int getTimeInIso8601(char *pBuf, size_t uBufSize)
         }
         else
         {
-            strftime(pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE, "%Y%m%dT%H%M%SZ", gmtime(&xTimeUtcNow));
+            pthread_mutex_lock(&gxIso8601Lock);
+            if (xTimeUtcNow == gxIso8601Time)
+            {
+                memcpy(pBuf, gpcIso8601, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE);
+                bCached = true;
+            }
+            pthread_mutex_unlock(&gxIso8601Lock);
+
+            if (!bCached)
+            {
+                strftime(pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE, "%Y%m%dT%H%M%SZ", gmtime_r(&xTimeUtcNow, &xTm));
+                pthread_mutex_lock(&gxIso8601Lock);
+                memcpy(gpcIso8601, pBuf, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE);
+                gxIso8601Time = xTimeUtcNow;
+                pthread_mutex_unlock(&gxIso8601Lock);
+            }
         }
     }
 
@@ -71,6 +132,20 @@ uint64_t getEpochTimestampInMs(void)
     return timestamp;
 }
 
+uint64_t getMonotonicTimeInUs(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)(ts.tv_sec) * 1000000 + (uint64_t)(ts.tv_nsec) / 1000;
+}
+
+uint64_t getMonotonicTimeInMs(void)
+{
+    return getMonotonicTimeInUs() / 1000;
+}
+
 uint8_t getRandomNumber(void)
 {
     return (uint8_t)rand();
@@ -79,4 +154,224 @@ uint8_t getRandomNumber(void)
 void sleepInMs(uint32_t ms)
 {
     usleep(ms * 1000);
+}
+
+KvsEventHandle kvsEventCreate(void)
+{
+    KvsEvent_t *pxEvent = NULL;
+
+    if ((pxEvent = (KvsEvent_t *)malloc(sizeof(KvsEvent_t))) != NULL)
+    {
+        pxEvent->bSignaled = false;
+        pxEvent->xPipe[0] = -1;
+        pxEvent->xPipe[1] = -1;
+        pxEvent->bSocketWaiting = false;
+        if (pthread_mutex_init(&(pxEvent->xMutex), NULL) != 0)
+        {
+            free(pxEvent);
+            pxEvent = NULL;
+        }
+        else if (pthread_cond_init(&(pxEvent->xCond), NULL) != 0)
+        {
+            pthread_mutex_destroy(&(pxEvent->xMutex));
+            free(pxEvent);
+            pxEvent = NULL;
+        }
+    }
+
+    return pxEvent;
+}
+
+void kvsEventTerminate(KvsEventHandle xEvent)
+{
+    KvsEvent_t *pxEvent = xEvent;
+
+    if (pxEvent != NULL)
+    {
+        if (pxEvent->xPipe[0] >= 0)
+        {
+            close(pxEvent->xPipe[0]);
+            close(pxEvent->xPipe[1]);
+        }
+        pthread_cond_destroy(&(pxEvent->xCond));
+        pthread_mutex_destroy(&(pxEvent->xMutex));
+        free(pxEvent);
+    }
+}
+
+void kvsEventSignal(KvsEventHandle xEvent)
+{
+    KvsEvent_t *pxEvent = xEvent;
+
+    if (pxEvent != NULL && pthread_mutex_lock(&(pxEvent->xMutex)) == 0)
+    {
+        pxEvent->bSignaled = true;
+        pthread_cond_signal(&(pxEvent->xCond));
+        if (pxEvent->bSocketWaiting && write(pxEvent->xPipe[1], "", 1) < 0)
+        {
+            /* The pipe is full, so the waiter is woken anyway. */
+        }
+        pthread_mutex_unlock(&(pxEvent->xMutex));
+    }
+}
+
+bool kvsEventWait(KvsEventHandle xEvent, uint32_t uTimeoutMs)
+{
+    KvsEvent_t *pxEvent = xEvent;
+    bool bSignaled = false;
+    struct timespec xDeadline = {0};
+    int xRet = 0;
+
+    if (pxEvent != NULL && pthread_mutex_lock(&(pxEvent->xMutex)) == 0)
+    {
+        clock_gettime(CLOCK_REALTIME, &xDeadline);
+        xDeadline.tv_sec += uTimeoutMs / 1000;
+        xDeadline.tv_nsec += (long)(uTimeoutMs % 1000) * 1000000;
+        if (xDeadline.tv_nsec >= 1000000000)
+        {
+            xDeadline.tv_sec++;
+            xDeadline.tv_nsec -= 1000000000;
+        }
+
+        while (!pxEvent->bSignaled && xRet != ETIMEDOUT)
+        {
+            xRet = pthread_cond_timedwait(&(pxEvent->xCond), &(pxEvent->xMutex), &xDeadline);
+        }
+
+        bSignaled = pxEvent->bSignaled;
+        pxEvent->bSignaled = false;
+        pthread_mutex_unlock(&(pxEvent->xMutex));
+    }
+
+    return bSignaled;
+}
+
+static void prvEventPipeCreate(KvsEvent_t *pxEvent)
+{
+    int i = 0;
+
+    if (pipe(pxEvent->xPipe) != 0)
+    {
+        pxEvent->xPipe[0] = -1;
+        pxEvent->xPipe[1] = -1;
+    }
+    else
+    {
+        for (i = 0; i < 2; i++)
+        {
+            fcntl(pxEvent->xPipe[i], F_SETFL, fcntl(pxEvent->xPipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(pxEvent->xPipe[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+}
+
+int kvsEventWaitSocket(KvsEventHandle xEvent, int xSocket, uint32_t uTimeoutMs)
+{
+    KvsEvent_t *pxEvent = xEvent;
+    int xResult = 0;
+    int xPollTimeoutMs = 0;
+    struct pollfd xFds[2] = {0};
+    char pDrainBuf[16];
+
+    if (xSocket < 0)
+    {
+        xResult = kvsEventWait(xEvent, uTimeoutMs) ? KVS_EVENT_SIGNALED : 0;
+    }
+    else if (pxEvent != NULL && pthread_mutex_lock(&(pxEvent->xMutex)) == 0)
+    {
+        if (pxEvent->xPipe[0] < 0)
+        {
+            /* If it fails, the socket is still polled, and a signal is only seen after the poll returns. */
+            prvEventPipeCreate(pxEvent);
+        }
+        pxEvent->bSocketWaiting = true;
+        xPollTimeoutMs = pxEvent->bSignaled ? 0 : (int)((uTimeoutMs > INT_MAX) ? INT_MAX : uTimeoutMs);
+        pthread_mutex_unlock(&(pxEvent->xMutex));
+
+        xFds[0].fd = xSocket;
+        xFds[0].events = POLLIN;
+        xFds[1].fd = pxEvent->xPipe[0];
+        xFds[1].events = POLLIN;
+        if (poll(xFds, 2, xPollTimeoutMs) > 0 && (xFds[0].revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+        {
+            xResult |= KVS_EVENT_SOCKET_READABLE;
+        }
+
+        pthread_mutex_lock(&(pxEvent->xMutex));
+        pxEvent->bSocketWaiting = false;
+        if ((xFds[1].revents & POLLIN) != 0)
+        {
+            while (read(pxEvent->xPipe[0], pDrainBuf, sizeof(pDrainBuf)) > 0)
+            {
+                /* nop */
+            }
+        }
+        if (pxEvent->bSignaled)
+        {
+            pxEvent->bSignaled = false;
+            xResult |= KVS_EVENT_SIGNALED;
+        }
+        pthread_mutex_unlock(&(pxEvent->xMutex));
+    }
+
+    return xResult;
+}
+
+KvsThreadHandle kvsThreadCreate(KvsThreadFunc_t xThreadFunc, void *pArg, size_t uStackSize, int xCoreId)
+{
+    KvsThread_t *pxThread = NULL;
+    pthread_attr_t xAttr;
+    bool bCreated = false;
+#if defined(__linux__) && defined(__GLIBC__)
+    cpu_set_t xCpuSet;
+#endif
+
+    if (xThreadFunc != NULL && (pxThread = (KvsThread_t *)malloc(sizeof(KvsThread_t))) != NULL &&
+        pthread_attr_init(&xAttr) == 0)
+    {
+        pxThread->xThreadFunc = xThreadFunc;
+        pxThread->pArg = pArg;
+
+        if (uStackSize > 0)
+        {
+            pthread_attr_setstacksize(&xAttr, uStackSize);
+        }
+#if defined(__linux__) && defined(__GLIBC__)
+        if (xCoreId >= 0)
+        {
+            CPU_ZERO(&xCpuSet);
+            CPU_SET(xCoreId, &xCpuSet);
+            pthread_attr_setaffinity_np(&xAttr, sizeof(cpu_set_t), &xCpuSet);
+        }
+#else
+        (void)xCoreId;
+#endif
+        bCreated = (pthread_create(&(pxThread->xTid), &xAttr, prvThreadRoutine, pxThread) == 0);
+        pthread_attr_destroy(&xAttr);
+    }
+
+    if (!bCreated && pxThread != NULL)
+    {
+        free(pxThread);
+        pxThread = NULL;
+    }
+
+    return pxThread;
+}
+
+void kvsThreadJoin(KvsThreadHandle xThread)
+{
+    KvsThread_t *pxThread = xThread;
+
+    if (pxThread != NULL)
+    {
+        pthread_join(pxThread->xTid, NULL);
+        free(pxThread);
+    }
+}
+
+uint32_t kvsThreadGetCurrentId(void)
+{
+    /* pthread_t is an integer or a pointer on the supported libc, and its low bits are unique. */
+    return (uint32_t)(uintptr_t)pthread_self();
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
  * permissions and limitations under the License.
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -22,9 +23,13 @@
 #include "azure_c_shared_utility/xlogging.h"
 
 /* KVS headers */
+#include "kvs/alloc_trace.h"
 #include "kvs/errors.h"
 #include "kvs/iot_credential_provider.h"
+#include "kvs/kvs_config.h"
+#include "kvs/mem_budget.h"
 #include "kvs/nalu.h"
+#include "kvs/netio_transport.h"
 #include "kvs/port.h"
 #include "kvs/restapi.h"
 #include "kvs/stream.h"
@@ -34,8 +39,16 @@
 
 /* Internal headers */
 #include "os/allocator.h"
+#include "os/endian.h"
+#include "os/tracepoint.h"
+#include "stream/latency_tracker.h"
+#include "stream/mkv_file.h"
+#include "stream/recorder.h"
+#include "stream/replay.h"
+#include "stream/spill.h"
 
 #define VIDEO_CODEC_NAME "V_MPEG4/ISO/AVC"
+#define VIDEO_HEVC_CODEC_NAME "V_MPEGH/ISO/HEVC"
 #define VIDEO_TRACK_NAME "kvs video track"
 
 #define DEFAULT_CONNECTION_TIMEOUT_MS (10 * 1000)
@@ -43,18 +56,85 @@
 #define DEFAULT_PUT_MEDIA_RECV_TIMEOUT_MS (1 * 1000)
 #define DEFAULT_PUT_MEDIA_SEND_TIMEOUT_MS (1 * 1000)
 #define DEFAULT_RING_BUFFER_MEM_LIMIT (1 * 1024 * 1024)
+#define DEFAULT_TIME_WINDOW_MS (10 * 1000)
+#define DEFAULT_FRAME_SLAB_SIZE (0)
+#define DEFAULT_INGEST_RING_SIZE (0)
+#define DEFAULT_SPILL_MEM_LIMIT (512 * 1024)
+#define SPILL_READ_BUF_SIZE (4 * 1024)
+#define DEFAULT_CHECKPOINT_INTERVAL_MS (10 * 1000)
+#define DEFAULT_REPLAY_BUFFER_SIZE (0)
+#define REPLAY_SEND_CHUNK_SIZE (4 * 1024)
+#define DEFAULT_RECORDER_FILE_DURATION_MS (60 * 1000)
+#define DEFAULT_RECORDER_WRITE_BUF_SIZE (64 * 1024)
+#define DEFAULT_UPLOAD_CHUNK_SIZE (256 * 1024)
+#define DEFAULT_UPLOAD_ACK_TIMEOUT_MS (30 * 1000)
+#define DEFAULT_SEND_FRAME_BUDGET (1)
+#define DEFAULT_SEND_BYTE_BUDGET (0)
+#define DEFAULT_WAIT_TIMEOUT_MS (50)
+#define DEFAULT_AUDIO_LACE_DURATION_MS (0)
+#define AUDIO_LACE_MAX_FRAME_COUNT (16)
+#define AUDIO_LACE_INITIAL_BUF_SIZE (1024)
+/* Room after a laced block for the HTTP chunk end */
+#define AUDIO_LACE_TAILROOM (2)
+#define DEFAULT_AUDIO_ONLY_FRAGMENT_DURATION_MS (2 * 1000)
+/* Audio sent ahead of stalled video starts a cluster this long after the last one, so block timecodes stay in 16 bits. */
+#define AUDIO_CLUSTER_MAX_DURATION_MS (30 * 1000)
+#define DEFAULT_WORKER_MIN_BACKOFF_MS (1 * 1000)
+#define DEFAULT_WORKER_MAX_BACKOFF_MS (30 * 1000)
+#define DEFAULT_PUT_MEDIA_ROTATION_MS (0)
+#define STANDBY_RETRY_INTERVAL_MS (5 * 1000)
+#define DEFAULT_DATA_ENDPOINT_TTL_MS (0)
+#define IOT_CREDENTIAL_REFRESH_MARGIN_MS (5 * 60 * 1000)
+#define DEFAULT_BITRATE_HINT_INTERVAL_MS (2000)
+#define DEFAULT_KVS_PORT "443"
+
+/* The IoT credential is fetched in a thread of this stack size by a fast open, which is enough for a TLS handshake. */
+#ifndef KVS_APP_OPEN_THREAD_STACK_SIZE
+#define KVS_APP_OPEN_THREAD_STACK_SIZE (16 * 1024)
+#endif
+#define FAST_OPEN_POLL_INTERVAL_MS (10)
+
+/* The bitrate hint leaves this much headroom (in percent) below the estimated uplink throughput, and more when the
+ * stream buffer is growing so the backlog can drain. */
+#define BITRATE_HINT_HEADROOM_PERCENT (10)
+#define BITRATE_HINT_CONGESTED_HEADROOM_PERCENT (25)
+
+/* Pacing that follows the uplink runs this much (in percent) above the estimated throughput, so the estimate can grow. */
+#define PACING_UPLINK_HEADROOM_PERCENT (25)
+
+/* Backpressure levels are entered at these fills (in percent) of the stream policy, and left this much below them so
+ * they don't flap. */
+#define BACKPRESSURE_HIGH_PERCENT (75)
+#define BACKPRESSURE_CRITICAL_PERCENT (90)
+#define BACKPRESSURE_HYSTERESIS_PERCENT (10)
+
+#define APP_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define APP_ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/* The ring buffer policy is folded away at compile time if it's not configured. */
+#define IS_RING_BUFFER_POLICY(pKvs) (KVS_CONFIG_RING_BUFFER_POLICY && (pKvs)->xStrategy.xPolicy == STREAM_POLICY_RING_BUFFER)
 
 typedef struct PolicyRingBufferParameter
 {
     size_t uMemLimit;
+
+    /* Under congestion, drop non-reference video frames and audio frames if enabled before evicting GOPs. */
+    bool bDropNonRefFrames;
+    bool bDropAudioFrames;
 } PolicyRingBufferParameter_t;
 
+typedef struct PolicyTimeWindowParameter
+{
+    unsigned int uTimeWindowMs;
+} PolicyTimeWindowParameter_t;
+
 typedef struct StreamStrategy
 {
     KvsApp_streamPolicy_t xPolicy;
     union
     {
         PolicyRingBufferParameter_t xRingBufferPara;
+        PolicyTimeWindowParameter_t xTimeWindowPara;
     };
 } StreamStrategy_t;
 
@@ -64,15 +144,95 @@ typedef struct OnMkvSentCallbackInfo
     void *pAppData;
 } OnMkvSentCallbackInfo_t;
 
+typedef struct OnDataEndpointUpdatedCallbackInfo
+{
+    OnDataEndpointUpdatedCallback_t onDataEndpointUpdated;
+    void *pAppData;
+} OnDataEndpointUpdatedCallbackInfo_t;
+
+typedef struct OnBitrateHintCallbackInfo
+{
+    OnBitrateHintCallback_t onBitrateHint;
+    void *pAppData;
+} OnBitrateHintCallbackInfo_t;
+
+typedef struct OnMetricsCallbackInfo
+{
+    OnMetricsCallback_t onMetrics;
+    void *pAppData;
+} OnMetricsCallbackInfo_t;
+
+typedef struct OnBackpressureCallbackInfo
+{
+    OnBackpressureCallback_t onBackpressure;
+    void *pAppData;
+} OnBackpressureCallbackInfo_t;
+
+typedef struct OnFragmentAckCallbackInfo
+{
+    OnFragmentAckCallback_t onFragmentAck;
+    void *pAppData;
+} OnFragmentAckCallbackInfo_t;
+
+#if KVS_CONFIG_AUDIO
+typedef struct AudioLace
+{
+    /* Frames are copied after the headroom, and the lace header is written right in front of them when the lace is
+     * added to the stream. The buffer is owned by the data frame afterwards. */
+    uint8_t *pBuf;
+    size_t uBufSize;
+    size_t uLen;
+    size_t puFrameSizes[AUDIO_LACE_MAX_FRAME_COUNT];
+    size_t uFrameCount;
+    uint64_t uTimestampMs;
+} AudioLace_t;
+#endif /* KVS_CONFIG_AUDIO */
+
+/* A data frame of the backlog, which is sent on the catch-up connection */
+typedef struct CatchUpFrame
+{
+    DataFrameHandle xDataFrameHandle;
+    size_t uMemLen;
+    struct CatchUpFrame *pxNext;
+} CatchUpFrame_t;
+
+/* The latest video keyframe. It refers to the application's buffer instead of a copy, so the terminate callback of the
+ * data frame is deferred until both the stream and the readers release it. */
+typedef struct KeyframeSnapshot
+{
+    size_t uRefCnt;
+    KvsAppSnapshot_t xInfo;
+
+    /* Arguments of the terminate callback of the data frame */
+    uint8_t *pBuf;
+    size_t uTerminateLen;
+    TrackType_t xTrackType;
+    OnDataFrameTerminateInfo_t xTerminateInfo;
+
+    /* A copy of the codec private data of the track that the keyframe belongs to */
+    uint8_t pCodecPrivate[];
+} KeyframeSnapshot_t;
+
 typedef struct KvsApp
 {
-    LOCK_HANDLE xLock;
+    /* Guards the PUT MEDIA connections and options that change them. It's never held across network I/O, so the
+     * connection to close is swapped out under it and closed afterwards. */
+    LOCK_HANDLE xConnLock;
+    /* Guards the video track info that is handed over from addFrame to doWork, and the cluster decision of the tracks
+     * that are added from different threads. */
+    LOCK_HANDLE xTrackLock;
 
     char *pHost;
     char *pRegion;
     char *pService;
     char *pStreamName;
     char *pDataEndpoint;
+    char *pPort;
+
+    /* The data endpoint is cached until it expires, or until PUT MEDIA fails in a way that it may be stale. 0 TTL
+     * means it never expires. */
+    unsigned int uDataEndpointTtlMs;
+    uint64_t uDataEndpointExpirationMs;
 
     /* AWS access key, access secret and session token */
     char *pAwsAccessKeyId;
@@ -97,32 +257,259 @@ typedef struct KvsApp
 
     unsigned int uDataRetentionInHours;
 
-    /* KVS streaming variables */
+    /* KVS streaming variables. The earliest timestamp is written by doWork and read by addFrame with
+     * prvEarliestTimestampGet(), and the EBML header flag is accessed with APP_ATOMIC_LOAD/STORE. */
     uint64_t uEarliestTimestamp;
+    uint32_t uEarliestTimestampSeq;
     StreamHandle xStreamHandle;
     PutMediaHandle xPutMediaHandle;
     bool isEbmlHeaderUpdated;
+
+    /* A standby PUT MEDIA connection is opened when the active one is due to rotate, and it takes over at the next
+     * cluster boundary. */
+    unsigned int uPutMediaRotationMs;
+    uint64_t uNextStandbyTimestampMs;
+    uint64_t uStandbyRetryTimestampMs;
+    PutMediaHandle xStandbyPutMediaHandle;
+
+    /* If the standby interface and the send latency are set, the standby connection is kept open on the interface that
+     * is not active, and it takes over at the next cluster boundary once a data frame takes longer than the latency to
+     * send. Interfaces are 0 for the default route. */
+    unsigned int uIfIndex;
+    unsigned int uStandbyIfIndex;
+    unsigned int uFailoverSendLatencyMs;
+    bool bOnStandbyIf;
+    bool bFailoverPending;
+
+    /* If it's set, KvsApp_open only starts the PUT MEDIA connection, and doWork establishes it without blocking. */
+    bool bAsyncOpen;
+    PutMediaHandle xPendingPutMediaHandle;
+
+    /* If it's set, KvsApp_open overlaps DNS, the IoT credential and the PUT MEDIA connection, and skips DescribeStream. */
+    bool bFastOpen;
+
+    /* Until the first PUT MEDIA connection is established, only this much (in milliseconds) of the latest GOPs is kept.
+     * 0 disables pre-roll. */
+    unsigned int uPrerollDurationMs;
+    bool bPrerollDone;
+
+    /* If uCatchUpThresholdMs is set, GOPs that fall behind the newest cluster by more than this are moved to a backlog,
+     * and the backlog is sent on its own PUT MEDIA connection at most uCatchUpRateBps, so the live edge goes out on
+     * the primary one first. They're only used by doWork. */
+    unsigned int uCatchUpThresholdMs;
+    unsigned int uCatchUpRateBps;
+    CatchUpFrame_t *pxCatchUpHead;
+    CatchUpFrame_t *pxCatchUpTail;
+    size_t uCatchUpMemTotal;
+    bool bCatchUpCollectToCluster;
+    bool bCatchUpSkipToCluster;
+    PutMediaHandle xCatchUpPutMediaHandle;
+    bool bCatchUpConnected;
+    uint32_t uCatchUpSegmentId;
+    int64_t xCatchUpTokens;
+    uint64_t uCatchUpRefillMs;
+    uint64_t uNextCatchUpTimestampMs;
     StreamStrategy_t xStrategy;
+    size_t uFrameSlabSize;
+    size_t uIngestRingSize;
+
+    /* Spill buffer that takes GOPs from the head of the stream when it's over the memory limit */
+    char *pSpillFilename;
+    size_t uSpillFileSize;
+    size_t uSpillMemLimit;
+    SpillHandle xSpillHandle;
+    LOCK_HANDLE xSpillLock;
+    uint8_t *pSpillReadBuf;
+    bool bSpillSkipToCluster;
+
+    /* Checkpoint of the last PERSISTED fragment timecode, which is saved at most once an interval. The spill buffer is
+     * recovered from it after reboot. */
+    char *pCheckpointFilename;
+    unsigned int uCheckpointIntervalMs;
+    uint64_t uCheckpointTimecodeMs;
+    uint64_t uNextCheckpointMs;
+    bool bCheckpointDirty;
+
+    /* Replay buffer that keeps sent clusters until they are persisted, and they are sent again after reconnection. */
+    size_t uReplayBufSize;
+    ReplayHandle xReplayHandle;
+
+    /* Recorder that writes the sent MKV bytes into rotating local files */
+    char *pRecorderFilePrefix;
+    unsigned int uRecorderFileDurationMs;
+    size_t uRecorderWriteBufSize;
+    RecorderHandle xRecorderHandle;
+
+    /* Limits of data frames and bytes sent in one doWork call, and 0 means no limit */
+    size_t uSendFrameBudget;
+    size_t uSendByteBudget;
+
+    /* In burst mode, data frames are held until the interval has passed since the last burst or the stream holds the
+     * bytes, and then the stream is drained. 0 disables them. */
+    unsigned int uBurstIntervalMs;
+    size_t uBurstBytes;
+    bool bBursting;
+    uint64_t uLastBurstMs;
+
+    /* Signaled when a data frame is added, so an idle doWork wakes up right away instead of polling. */
+    KvsEventHandle xWakeEvent;
+    unsigned int uWaitTimeoutMs;
+
+    /* If the stream falls behind by this latency, it skips to a later cluster before sending, and 0 disables it. */
+    unsigned int uLatencyDropMs;
+    size_t uLatencyDroppedFrameCount;
+
+#if KVS_CONFIG_AUDIO
+    /* Consecutive audio frames are packed into one laced simple block up to this duration, and 0 disables it. Audio
+     * frames append to the lace and frames of either track flush it, usually from different threads, so it's guarded
+     * by xAudioLaceLock. */
+    unsigned int uAudioLaceDurationMs;
+    AudioLace_t xAudioLace;
+    LOCK_HANDLE xAudioLaceLock;
+#endif
+
+    /* A video frame this long after the last cluster starts a new one even if it's not a keyframe, and 0 disables it. */
+    unsigned int uMaxFragmentDurationMs;
+    /* It's shared by the tracks, so it's guarded by xTrackLock. */
+    uint64_t uLastClusterTimestampMs;
+
+    /* The stream has only an audio track, and clusters start on audio frames. */
+    bool bAudioOnly;
+
+    /* Queued audio that spans this latency is sent without waiting for video, and 0 disables it. */
+    unsigned int uAudioMaxLatencyMs;
+
+    /* A data frame queued this long is sent without waiting for the other track, and 0 disables it. */
+    unsigned int uInterleaveWindowMs;
+
+    /* If it's set, it's signaled instead of xWakeEvent, and doWork doesn't wait. It's used when one thread services
+     * many handles, e.g. KvsMultiApp. */
+    KvsEventHandle xSharedWakeEvent;
+
+    /* Worker thread that runs the open, doWork and close loop */
+    KvsThreadHandle xWorkerThread;
+    KvsEventHandle xWorkerStopEvent;
+    KvsAppWorkerParameter_t xWorkerPara;
+
+    /* Statistics since the creation or the last reset. Data frames are evicted by any addFrame thread and the count is
+     * read or reset by the application, so it's accessed atomically. */
+    size_t uEvictedFrameCount;
+    size_t uSentFrameCount;
+
+    /* Uplink throughput estimator. Bytes sent and time spent in sending are accumulated in an interval, then they are
+     * folded into the smoothed estimate together with the growth of the stream buffer. */
+    unsigned int uBitrateHintIntervalMs;
+    uint64_t uBitrateWindowStartMs;
+    size_t uBitrateWindowStartMemTotal;
+    uint64_t uBitrateWindowSentBytes;
+    uint64_t uBitrateWindowSendTimeMs;
+    uint32_t uUplinkBps;
+    bool bPacingFollowsUplink;
+
+    /* End-to-end latency of clusters. It's updated by both addFrame and doWork, so it has its own lock. */
+    LatencyTrackerHandle xLatencyTracker;
+    LOCK_HANDLE xLatencyLock;
+    uint64_t uSendingClusterTimecodeMs;
+
+    /* Metrics are also updated by both addFrame and doWork, so they have their own lock. */
+    KvsAppMetrics_t xMetrics;
+    LOCK_HANDLE xMetricsLock;
+    uint64_t uDisconnectedMs;
+    uint64_t uPendingPutMediaStartMs;
+    unsigned int uMetricsIntervalMs;
+    uint64_t uNextMetricsMs;
+
+    /* The latest video keyframe is kept by addFrame and read by any thread, so it has its own lock. */
+    bool bKeyframeSnapshot;
+    LOCK_HANDLE xSnapshotLock;
+    KeyframeSnapshot_t *pxSnapshot;
+
+    /* Backpressure is evaluated by every addFrame, which may run in more than one thread, so it's updated atomically. */
+    KvsAppBackpressure_t xBackpressure;
+    unsigned int uBackpressurePercent;
 
     /* Track information */
     VideoTrackInfo_t *pVideoTrackInfo;
+    KvsApp_videoCodec_t xVideoCodec;
+    KvsApp_videoFormat_t xVideoFormat;
+    uint64_t uNaluFilterMask;
+    uint8_t *pVps;
+    size_t uVpsLen;
     uint8_t *pSps;
     size_t uSpsLen;
     uint8_t *pPps;
     size_t uPpsLen;
 
+    /* Video track info built from parameter sets that change in band. A new MKV segment starts with it at the first key
+     * frame of uSegmentId that is sent. It's set by addFrame and taken by doWork, so it's guarded by xTrackLock. */
+    VideoTrackInfo_t *pNextVideoTrackInfo;
+    uint32_t uSegmentId;
+    uint32_t uSentSegmentId;
+
     bool isAudioTrackPresent;
     AudioTrackInfo_t *pAudioTrackInfo;
 
     /* Session scope callbacks */
     OnMkvSentCallbackInfo_t onMkvSentCallbackInfo;
+    OnDataEndpointUpdatedCallbackInfo_t onDataEndpointUpdatedCallbackInfo;
+    OnBitrateHintCallbackInfo_t onBitrateHintCallbackInfo;
+    OnMetricsCallbackInfo_t onMetricsCallbackInfo;
+    OnBackpressureCallbackInfo_t onBackpressureCallbackInfo;
+    OnFragmentAckCallbackInfo_t onFragmentAckCallbackInfo;
 } KvsApp_t;
 
 typedef struct DataFrameUserData
 {
     DataFrameCallbacks_t xCallbacks;
+
+    /* The number of bytes after the data frame that can be overwritten. */
+    size_t uTailroom;
+
+    /* The MKV segment that the data frame belongs to. */
+    uint32_t uSegmentId;
+
+    /* Bytes of the application's buffer that are charged to the memory budget while the data frame is queued. */
+    size_t uBudgetBytes;
+
+    /* If the data frame is the keyframe snapshot, the snapshot is released instead of calling the terminate callback. */
+    KeyframeSnapshot_t *pxSnapshot;
+
+    /* Monotonic time when the data frame is added to the stream */
+    uint64_t uAddTimeMs;
 } DataFrameUserData_t;
 
+/**
+ * @brief Store the earliest timestamp, which is only written by doWork. The timestamp is 64 bits, which 32-bit targets
+ * can't store atomically, so it's published with a sequence number that is odd while it's written.
+ */
+static void prvEarliestTimestampSet(KvsApp_t *pKvs, uint64_t uTimestampMs)
+{
+    uint32_t uSeq = pKvs->uEarliestTimestampSeq;
+
+    __atomic_store_n(&(pKvs->uEarliestTimestampSeq), uSeq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    pKvs->uEarliestTimestamp = uTimestampMs;
+    APP_ATOMIC_STORE(&(pKvs->uEarliestTimestampSeq), uSeq + 2);
+}
+
+/**
+ * @brief Load the earliest timestamp from any thread without a lock. It retries if the timestamp is written meanwhile.
+ */
+static uint64_t prvEarliestTimestampGet(KvsApp_t *pKvs)
+{
+    uint32_t uSeq = 0;
+    uint64_t uTimestampMs = 0;
+
+    do
+    {
+        uSeq = APP_ATOMIC_LOAD(&(pKvs->uEarliestTimestampSeq));
+        uTimestampMs = pKvs->uEarliestTimestamp;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((uSeq & 1) != 0 || __atomic_load_n(&(pKvs->uEarliestTimestampSeq), __ATOMIC_RELAXED) != uSeq);
+
+    return uTimestampMs;
+}
+
 /**
  * Default implementation of OnDataFrameTerminateCallback_t. It calls free() to pData to release resource.
  *
@@ -144,6 +531,61 @@ static int defaultOnDataFrameTerminate(uint8_t *pData, size_t uDataLen, uint64_t
     return KVS_ERRNO_NONE;
 }
 
+/**
+ * @brief Get the data of a data frame as one buffer for consumers that need contiguous data. If the data frame is made
+ * of segments, they're gathered into a new buffer that is freed by the caller.
+ */
+static int prvDataFrameGetContiguousData(DataFrameIn_t *pDataFrameIn, uint8_t **ppData, uint8_t **ppGathered)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pGathered = NULL;
+    size_t uOffset = 0;
+    size_t i = 0;
+
+    if (pDataFrameIn->uSegmentCount == 0)
+    {
+        *ppData = (uint8_t *)(pDataFrameIn->pData);
+    }
+    else if ((pGathered = (uint8_t *)kvsMalloc(pDataFrameIn->uDataLen + 1)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pGathered");
+    }
+    else
+    {
+        for (i = 0; i < pDataFrameIn->uSegmentCount; i++)
+        {
+            if (pDataFrameIn->bPrefixSegmentLen)
+            {
+                PUT_UNALIGNED_4_byte_BE(pGathered + uOffset, pDataFrameIn->pxSegments[i].uLen);
+                uOffset += DATA_FRAME_SEGMENT_LEN_PREFIX;
+            }
+            memcpy(pGathered + uOffset, pDataFrameIn->pxSegments[i].pData, pDataFrameIn->pxSegments[i].uLen);
+            uOffset += pDataFrameIn->pxSegments[i].uLen;
+        }
+        *ppData = pGathered;
+        *ppGathered = pGathered;
+    }
+
+    return res;
+}
+
+static void prvKeyframeSnapshotRelease(KeyframeSnapshot_t *pxSnapshot)
+{
+    OnDataFrameTerminateInfo_t *pxTerminateInfo = NULL;
+
+    if (pxSnapshot != NULL && __atomic_sub_fetch(&(pxSnapshot->uRefCnt), 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pxTerminateInfo = &(pxSnapshot->xTerminateInfo);
+        if (pxTerminateInfo->onDataFrameTerminate != NULL)
+        {
+            pxTerminateInfo->onDataFrameTerminate(
+                pxSnapshot->pBuf, pxSnapshot->uTerminateLen, pxSnapshot->xInfo.uTimestampMs, pxSnapshot->xTrackType, pxTerminateInfo->pAppData);
+        }
+        kvsFree(pxSnapshot);
+    }
+}
+
 static void prvCallOnDataFrameTerminate(DataFrameIn_t *pDataFrameIn)
 {
     DataFrameUserData_t *pUserData = NULL;
@@ -154,10 +596,19 @@ static void prvCallOnDataFrameTerminate(DataFrameIn_t *pDataFrameIn)
         pUserData = (DataFrameUserData_t *)pDataFrameIn->pUserData;
         if (pUserData != NULL)
         {
+            if (pUserData->uBudgetBytes > 0)
+            {
+                kvsMemBudgetReleaseMedia(pUserData->uBudgetBytes);
+            }
+
             pOnDataFrameTerminateCallbackInfo = &(pUserData->xCallbacks.onDataFrameTerminateInfo);
-            if (pOnDataFrameTerminateCallbackInfo->onDataFrameTerminate != NULL)
+            if (pUserData->pxSnapshot != NULL)
+            {
+                prvKeyframeSnapshotRelease(pUserData->pxSnapshot);
+            }
+            else if (pOnDataFrameTerminateCallbackInfo->onDataFrameTerminate != NULL)
             {
-                pOnDataFrameTerminateCallbackInfo->onDataFrameTerminate((uint8_t *)(pDataFrameIn->pData), pDataFrameIn->uDataLen, pDataFrameIn->uTimestampMs, pDataFrameIn->xTrackType, pOnDataFrameTerminateCallbackInfo->pAppData);
+                pOnDataFrameTerminateCallbackInfo->onDataFrameTerminate((uint8_t *)(pDataFrameIn->pData - pDataFrameIn->uHeadroom), pDataFrameIn->uDataLen, pDataFrameIn->uTimestampMs, pDataFrameIn->xTrackType, pOnDataFrameTerminateCallbackInfo->pAppData);
             }
         }
     }
@@ -184,6 +635,7 @@ static void prvVideoTrackInfoTerminate(VideoTrackInfo_t *pVideoTrackInfo)
     }
 }
 
+#if KVS_CONFIG_AUDIO
 static void prvAudioTrackInfoTerminate(AudioTrackInfo_t *pAudioTrackInfo)
 {
     if (pAudioTrackInfo != NULL)
@@ -204,6 +656,7 @@ static void prvAudioTrackInfoTerminate(AudioTrackInfo_t *pAudioTrackInfo)
         kvsFree(pAudioTrackInfo);
     }
 }
+#endif /* KVS_CONFIG_AUDIO */
 
 static int prvMallocAndStrcpyHelper(char **destination, const char *source)
 {
@@ -272,10 +725,6 @@ static void prvStreamFlush(KvsApp_t *pKvs)
     {
         pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
         prvCallOnDataFrameTerminate(pDataFrameIn);
-        if (pDataFrameIn->pUserData != NULL)
-        {
-            kvsFree(pDataFrameIn->pUserData);
-        }
         Kvs_dataFrameTerminate(xDataFrameHandle);
     }
 }
@@ -304,7 +753,7 @@ static int prvStreamFlushToNextCluster(KvsApp_t *pKvs)
             pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
             if (pDataFrameIn->xClusterType == MKV_CLUSTER)
             {
-                pKvs->uEarliestTimestamp = pDataFrameIn->uTimestampMs;
+                prvEarliestTimestampSet(pKvs, pDataFrameIn->uTimestampMs);
                 break;
             }
             else
@@ -312,10 +761,6 @@ static int prvStreamFlushToNextCluster(KvsApp_t *pKvs)
                 xDataFrameHandle = Kvs_streamPop(xStreamHandle);
                 pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
                 prvCallOnDataFrameTerminate(pDataFrameIn);
-                if (pDataFrameIn->pUserData != NULL)
-                {
-                    kvsFree(pDataFrameIn->pUserData);
-                }
                 Kvs_dataFrameTerminate(xDataFrameHandle);
             }
         }
@@ -324,986 +769,5465 @@ static int prvStreamFlushToNextCluster(KvsApp_t *pKvs)
     return res;
 }
 
-static void prvStreamFlushHeadUntilMem(KvsApp_t *pKvs, size_t uMemLimit)
+static void prvMetricsAddEvicted(KvsApp_t *pKvs)
 {
-    StreamHandle xStreamHandle = pKvs->xStreamHandle;
-    DataFrameHandle xDataFrameHandle = NULL;
-    DataFrameIn_t *pDataFrameIn = NULL;
-    size_t uMemTotal = 0;
-
-    while (Kvs_streamMemStatTotal(xStreamHandle, &uMemTotal) == 0 && uMemTotal > uMemLimit && (xDataFrameHandle = Kvs_streamPop(xStreamHandle)) != NULL)
+    __atomic_add_fetch(&(pKvs->uEvictedFrameCount), 1, __ATOMIC_RELAXED);
+    if (Lock(pKvs->xMetricsLock) == LOCK_OK)
     {
-        pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
-        prvCallOnDataFrameTerminate(pDataFrameIn);
-        if (pDataFrameIn->pUserData != NULL)
-        {
-            kvsFree(pDataFrameIn->pUserData);
-        }
-        Kvs_dataFrameTerminate(xDataFrameHandle);
+        pKvs->xMetrics.uEvictedFrameCount++;
+        Unlock(pKvs->xMetricsLock);
     }
 }
 
-static VideoTrackInfo_t *prvCopyVideoTrackInfo(VideoTrackInfo_t *pSrcVideoTrackInfo)
+/**
+ * Account a PUT MEDIA call that sends data.
+ *
+ * @param[in] pKvs KVS application handle
+ * @param[in] uStartMs Monotonic time when the call starts
+ * @param[in] bReplay True if it's sent from the replay buffer, and xTrackType is ignored
+ * @param[in] xTrackType Track of the data frame
+ * @param[in] uLen Bytes sent
+ * @param[in] uFrameCount Data frames completed by the call
+ */
+static void prvMetricsAddSend(KvsApp_t *pKvs, uint64_t uStartMs, bool bReplay, TrackType_t xTrackType, size_t uLen, size_t uFrameCount)
 {
-    int res = KVS_ERRNO_NONE;
-    VideoTrackInfo_t *pDstVideoTrackInfo = NULL;
+    uint64_t uElapsedMs = getMonotonicTimeInMs() - uStartMs;
+    size_t uBucket = 0;
+    KvsAppTrackMetrics_t *pxTrack = NULL;
 
-    if ((pDstVideoTrackInfo = (VideoTrackInfo_t *)kvsMalloc(sizeof(VideoTrackInfo_t))) == NULL)
+    /* Bucket 0 is below 1 ms, and bucket i covers [2^(i-1), 2^i) ms. */
+    while (uBucket < KVS_APP_SEND_LATENCY_BUCKET_COUNT - 1 && uElapsedMs >= (1ULL << uBucket))
     {
-        res = KVS_ERROR_OUT_OF_MEMORY;
+        uBucket++;
     }
-    else
-    {
-        memset(pDstVideoTrackInfo, 0, sizeof(VideoTrackInfo_t));
 
-        if ((res = prvMallocAndStrcpyHelper(&(pDstVideoTrackInfo->pTrackName), pSrcVideoTrackInfo->pTrackName)) != KVS_ERRNO_NONE ||
-            (res = prvMallocAndStrcpyHelper(&(pDstVideoTrackInfo->pCodecName), pSrcVideoTrackInfo->pCodecName)) != KVS_ERRNO_NONE)
-        {
-            /* Propagate the res error */
-        }
-        else if ((pDstVideoTrackInfo->pCodecPrivate = (uint8_t *)kvsMalloc(pSrcVideoTrackInfo->uCodecPrivateLen)) == NULL)
+    if (Lock(pKvs->xMetricsLock) == LOCK_OK)
+    {
+        pKvs->xMetrics.puSendLatencyHistogram[uBucket]++;
+        if (bReplay)
         {
-            res = KVS_ERROR_OUT_OF_MEMORY;
+            pKvs->xMetrics.uReplayedBytes += uLen;
         }
         else
         {
-            pDstVideoTrackInfo->uWidth = pSrcVideoTrackInfo->uWidth;
-            pDstVideoTrackInfo->uHeight = pSrcVideoTrackInfo->uHeight;
+            pxTrack = (xTrackType == TRACK_AUDIO) ? &(pKvs->xMetrics.xAudio) : &(pKvs->xMetrics.xVideo);
+            pxTrack->uSentBytes += uLen;
+            pxTrack->uSentFrameCount += uFrameCount;
+        }
+        Unlock(pKvs->xMetricsLock);
+    }
+}
 
-            memcpy(pDstVideoTrackInfo->pCodecPrivate, pSrcVideoTrackInfo->pCodecPrivate, pSrcVideoTrackInfo->uCodecPrivateLen);
-            pDstVideoTrackInfo->uCodecPrivateLen = pSrcVideoTrackInfo->uCodecPrivateLen;
+static void prvMetricsAddRest(KvsApp_t *pKvs, KvsAppRestApi_t xApi, uint64_t uStartMs, bool bFailed)
+{
+    uint32_t uElapsedMs = (uint32_t)(getMonotonicTimeInMs() - uStartMs);
+    KvsAppRestMetrics_t *pxRest = &(pKvs->xMetrics.xRest[xApi]);
+
+    if (Lock(pKvs->xMetricsLock) == LOCK_OK)
+    {
+        pxRest->uCallCount++;
+        if (bFailed)
+        {
+            pxRest->uFailureCount++;
+        }
+        pxRest->uLastLatencyMs = uElapsedMs;
+        if (uElapsedMs > pxRest->uMaxLatencyMs)
+        {
+            pxRest->uMaxLatencyMs = uElapsedMs;
         }
+        pxRest->uTotalLatencyMs += uElapsedMs;
+        Unlock(pKvs->xMetricsLock);
     }
+}
 
-    if (res != KVS_ERRNO_NONE)
+static void prvMetricsAddReconnect(KvsApp_t *pKvs)
+{
+    uint32_t uElapsedMs = 0;
+
+    if (pKvs->uDisconnectedMs != 0 && Lock(pKvs->xMetricsLock) == LOCK_OK)
     {
-        prvVideoTrackInfoTerminate(pDstVideoTrackInfo);
-        pDstVideoTrackInfo = NULL;
+        uElapsedMs = (uint32_t)(getMonotonicTimeInMs() - pKvs->uDisconnectedMs);
+        pKvs->xMetrics.uReconnectCount++;
+        pKvs->xMetrics.uLastReconnectMs = uElapsedMs;
+        pKvs->xMetrics.uTotalReconnectMs += uElapsedMs;
+        Unlock(pKvs->xMetricsLock);
     }
+    pKvs->uDisconnectedMs = 0;
+}
 
-    return pDstVideoTrackInfo;
+/* TLS records of a PUT MEDIA connection are accumulated when it's finished. */
+static void prvPutMediaFinish(KvsApp_t *pKvs, PutMediaHandle xPutMediaHandle)
+{
+    NetIoStats_t xStats = {0};
+
+    if (Kvs_putMediaGetNetIoStats(xPutMediaHandle, &xStats) == KVS_ERRNO_NONE && Lock(pKvs->xMetricsLock) == LOCK_OK)
+    {
+        pKvs->xMetrics.uTlsRecordCount += xStats.uTlsRecordsSent;
+        Unlock(pKvs->xMetricsLock);
+    }
+    Kvs_putMediaFinish(xPutMediaHandle);
 }
 
-static AudioTrackInfo_t *prvCopyAudioTrackInfo(AudioTrackInfo_t *pSrcAudioTrackInfo)
+static void prvOnDataFrameEvicted(DataFrameHandle xDataFrameHandle, void *pAppData)
 {
-    int res = KVS_ERRNO_NONE;
-    AudioTrackInfo_t *pDstAudioTrackInfo = NULL;
+    KvsApp_t *pKvs = (KvsApp_t *)pAppData;
 
-    if ((pDstAudioTrackInfo = (AudioTrackInfo_t *)kvsMalloc(sizeof(AudioTrackInfo_t))) == NULL)
+    prvMetricsAddEvicted(pKvs);
+    prvCallOnDataFrameTerminate((DataFrameIn_t *)xDataFrameHandle);
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+}
+
+/**
+ * @brief Decide if a data frame starts a new cluster. It should be called with xTrackLock locked.
+ */
+static MkvClusterType_t prvGetClusterType(KvsApp_t *pKvs, TrackType_t xTrackType, bool bIsKeyFrame, uint64_t uTimestamp)
+{
+    MkvClusterType_t xClusterType = MKV_SIMPLE_BLOCK;
+
+    if (xTrackType == TRACK_VIDEO)
     {
-        res = KVS_ERROR_OUT_OF_MEMORY;
+        /* A cluster is only forced after the first keyframe, so the stream never starts on an inter frame. */
+        if (bIsKeyFrame ||
+            (pKvs->uMaxFragmentDurationMs > 0 && pKvs->uLastClusterTimestampMs != 0 && uTimestamp >= pKvs->uLastClusterTimestampMs + pKvs->uMaxFragmentDurationMs))
+        {
+            xClusterType = MKV_CLUSTER;
+            pKvs->uLastClusterTimestampMs = uTimestamp;
+        }
     }
-    else
+    else if (pKvs->bAudioOnly)
     {
-        memset(pDstAudioTrackInfo, 0, sizeof(AudioTrackInfo_t));
-
-        if ((res = prvMallocAndStrcpyHelper(&(pDstAudioTrackInfo->pTrackName), pSrcAudioTrackInfo->pTrackName) != KVS_ERRNO_NONE) ||
-            (res = prvMallocAndStrcpyHelper(&(pDstAudioTrackInfo->pCodecName), pSrcAudioTrackInfo->pCodecName)) != KVS_ERRNO_NONE)
+        /* Any audio frame can be decoded on its own, so the first one starts the stream. */
+        if (pKvs->uLastClusterTimestampMs == 0 ||
+            uTimestamp >= pKvs->uLastClusterTimestampMs + ((pKvs->uMaxFragmentDurationMs > 0) ? pKvs->uMaxFragmentDurationMs : DEFAULT_AUDIO_ONLY_FRAGMENT_DURATION_MS))
         {
-            /* Propagate the res error */
+            xClusterType = MKV_CLUSTER;
+            pKvs->uLastClusterTimestampMs = uTimestamp;
         }
-        else if ((pDstAudioTrackInfo->pCodecPrivate = (uint8_t *)kvsMalloc(pSrcAudioTrackInfo->uCodecPrivateLen)) == NULL)
+    }
+    else if (
+        (pKvs->uAudioMaxLatencyMs > 0 || pKvs->uInterleaveWindowMs > 0) && pKvs->uLastClusterTimestampMs != 0 &&
+        uTimestamp >= pKvs->uLastClusterTimestampMs + AUDIO_CLUSTER_MAX_DURATION_MS)
+    {
+        xClusterType = MKV_CLUSTER;
+        pKvs->uLastClusterTimestampMs = uTimestamp;
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return xClusterType;
+}
+
+static bool prvIsDataFrameDisposable(KvsApp_t *pKvs, DataFrameIn_t *pDataFrameIn, bool bIsNonReference)
+{
+    bool bIsDisposable = false;
+
+    if (IS_RING_BUFFER_POLICY(pKvs))
+    {
+        if (pDataFrameIn->xTrackType == TRACK_VIDEO)
         {
-            res = KVS_ERROR_OUT_OF_MEMORY;
+            /* Non-reference H265 pictures may still be referenced by higher temporal sub-layers, so they're kept. */
+            bIsDisposable = pKvs->xStrategy.xRingBufferPara.bDropNonRefFrames && !(pDataFrameIn->bIsKeyFrame) && pKvs->xVideoCodec == VIDEO_CODEC_H264 && bIsNonReference;
         }
         else
         {
-            pDstAudioTrackInfo->uFrequency = pSrcAudioTrackInfo->uFrequency;
-            pDstAudioTrackInfo->uChannelNumber = pSrcAudioTrackInfo->uChannelNumber;
-            pDstAudioTrackInfo->uBitsPerSample = pSrcAudioTrackInfo->uBitsPerSample;
-
-            memcpy(pDstAudioTrackInfo->pCodecPrivate, pSrcAudioTrackInfo->pCodecPrivate, pSrcAudioTrackInfo->uCodecPrivateLen);
-            pDstAudioTrackInfo->uCodecPrivateLen = pSrcAudioTrackInfo->uCodecPrivateLen;
+            bIsDisposable = pKvs->xStrategy.xRingBufferPara.bDropAudioFrames;
         }
     }
 
-    if (res != KVS_ERRNO_NONE)
-    {
-        prvAudioTrackInfoTerminate(pDstAudioTrackInfo);
-        pDstAudioTrackInfo = NULL;
-    }
-
-    return pDstAudioTrackInfo;
+    return bIsDisposable;
 }
 
-static bool isIotCertAvailable(KvsApp_t *pKvs)
+static void prvStreamDropDisposableUntilMem(KvsApp_t *pKvs, size_t uMemLimit)
 {
-    if (pKvs->pIotCredentialHost != NULL && pKvs->pIotRoleAlias != NULL && pKvs->pIotThingName != NULL && pKvs->pIotX509RootCa != NULL && pKvs->pIotX509Certificate != NULL &&
-        pKvs->pIotX509PrivateKey != NULL)
+    if (Kvs_streamDropDisposableUntilMem(pKvs->xStreamHandle, uMemLimit, prvOnDataFrameEvicted, pKvs) != KVS_ERRNO_NONE)
     {
-        return true;
+        LogError("Failed to drop data frames");
     }
-    else
+}
+
+static void prvStreamFlushHeadUntilMem(KvsApp_t *pKvs, size_t uMemLimit)
+{
+    /* Evict whole GOPs, so the stream always starts from a cluster and no partial GOP is uploaded. */
+    if (Kvs_streamEvictGopsUntilMem(pKvs->xStreamHandle, uMemLimit, prvOnDataFrameEvicted, pKvs) != KVS_ERRNO_NONE)
     {
-        return false;
+        LogError("Failed to evict data frames");
     }
 }
 
-static void updateIotCredential(KvsApp_t *pKvs)
+static void prvOnDataFrameLatencyDropped(DataFrameHandle xDataFrameHandle, void *pAppData)
 {
-    IotCredentialToken_t *pToken = NULL;
-    IotCredentialRequest_t xIotCredentialReq = {
-        .pCredentialHost = pKvs->pIotCredentialHost,
-        .pRoleAlias = pKvs->pIotRoleAlias,
-        .pThingName = pKvs->pIotThingName,
-        .pRootCA = pKvs->pIotX509RootCa,
-        .pCertificate = pKvs->pIotX509Certificate,
-        .pPrivateKey = pKvs->pIotX509PrivateKey};
+    KvsApp_t *pKvs = (KvsApp_t *)pAppData;
 
-    if (isIotCertAvailable(pKvs))
-    {
-        Iot_credentialTerminate(pKvs->pToken);
-        pKvs->pToken = NULL;
+    pKvs->uLatencyDroppedFrameCount++;
+    prvOnDataFrameEvicted(xDataFrameHandle, pAppData);
+}
 
-        if ((pToken = Iot_getCredential(&xIotCredentialReq)) == NULL)
-        {
-            LogError("Failed to get Iot credential");
-        }
-        else
+static void prvStreamSkipStaleFrames(KvsApp_t *pKvs)
+{
+    pKvs->uLatencyDroppedFrameCount = 0;
+    if (Kvs_streamEvictGopsUntilLatency(pKvs->xStreamHandle, pKvs->uLatencyDropMs, prvOnDataFrameLatencyDropped, pKvs) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to drop stale data frames");
+    }
+    else if (pKvs->uLatencyDroppedFrameCount > 0)
+    {
+        LogInfo("Stream is behind by over %u ms, drop %u data frames", pKvs->uLatencyDropMs, (unsigned int)(pKvs->uLatencyDroppedFrameCount));
+        if (Lock(pKvs->xMetricsLock) == LOCK_OK)
         {
-            pKvs->pToken = pToken;
+            pKvs->xMetrics.uLatencyDropCount++;
+            pKvs->xMetrics.uLatencyDroppedFrameCount += pKvs->uLatencyDroppedFrameCount;
+            Unlock(pKvs->xMetricsLock);
         }
     }
 }
 
-static int updateAndVerifyRestfulReqParameters(KvsApp_t *pKvs)
+static void prvStreamFlushHeadUntilTimeWindow(KvsApp_t *pKvs, unsigned int uTimeWindowMs)
 {
-    int res = KVS_ERRNO_NONE;
+    if (Kvs_streamEvictGopsUntilTimeWindow(pKvs->xStreamHandle, uTimeWindowMs, prvOnDataFrameEvicted, pKvs) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to evict data frames");
+    }
+}
 
-    pKvs->xServicePara.pcHost = pKvs->pHost;
-    pKvs->xServicePara.pcRegion = pKvs->pRegion;
-    pKvs->xServicePara.pcService = pKvs->pService;
-    pKvs->xServicePara.uRecvTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
-    pKvs->xServicePara.uSendTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
+static void prvOnDataFrameSpilled(DataFrameHandle xDataFrameHandle, void *pAppData)
+{
+    KvsApp_t *pKvs = (KvsApp_t *)pAppData;
+    DataFrameIn_t *pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+    SpillRecordInfo_t xInfo = {0};
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+    uint8_t *pGathered = NULL;
+    int res = KVS_ERRNO_NONE;
 
-    if (pKvs->pToken != NULL)
+    if (pDataFrameIn->xClusterType == MKV_CLUSTER)
     {
-        pKvs->xServicePara.pcAccessKey = pKvs->pToken->pAccessKeyId;
-        pKvs->xServicePara.pcSecretKey = pKvs->pToken->pSecretAccessKey;
-        pKvs->xServicePara.pcToken = pKvs->pToken->pSessionToken;
+        pKvs->bSpillSkipToCluster = false;
     }
-    else
+
+    /* Once a data frame is dropped, the rest of its GOP is dropped as well. */
+    if (!pKvs->bSpillSkipToCluster)
     {
-        if (pKvs->pAwsAccessKeyId == NULL || pKvs->pAwsSecretAccessKey == NULL)
+        xInfo.uTimestampMs = pDataFrameIn->uTimestampMs;
+        xInfo.xTrackType = pDataFrameIn->xTrackType;
+        xInfo.xClusterType = pDataFrameIn->xClusterType;
+        if ((res = Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen)) != KVS_ERRNO_NONE ||
+            (res = prvDataFrameGetContiguousData(pDataFrameIn, &pData, &pGathered)) != KVS_ERRNO_NONE ||
+            (res = Kvs_spillAppend(pKvs->xSpillHandle, &xInfo, pMkvHeader, uMkvHeaderLen, pData, uDataLen)) != KVS_ERRNO_NONE)
         {
-            res = KVS_ERROR_NO_AWS_ACCESS_KEY_OR_SECRET_KEY;
-            LogError("No available aws access key");
+            LogError("Failed to spill data frame, res: %d", res);
+            pKvs->bSpillSkipToCluster = true;
         }
-        else
+        if (pGathered != NULL)
         {
-            pKvs->xServicePara.pcAccessKey = pKvs->pAwsAccessKeyId;
-            pKvs->xServicePara.pcSecretKey = pKvs->pAwsSecretAccessKey;
-            pKvs->xServicePara.pcToken = pKvs->pAwsSessionToken;
+            kvsFree(pGathered);
         }
     }
 
-    if (res == KVS_ERRNO_NONE)
+    if (pKvs->bSpillSkipToCluster)
     {
-        pKvs->xDescPara.pcStreamName = pKvs->pStreamName;
-
-        pKvs->xCreatePara.pcStreamName = pKvs->pStreamName;
-        pKvs->xCreatePara.uDataRetentionInHours = pKvs->uDataRetentionInHours;
-
-        pKvs->xGetDataEpPara.pcStreamName = pKvs->pStreamName;
-
-        pKvs->xPutMediaPara.pcStreamName = pKvs->pStreamName;
-        pKvs->xPutMediaPara.xTimecodeType = TIMECODE_TYPE_ABSOLUTE;
-        pKvs->xPutMediaPara.uRecvTimeoutMs = DEFAULT_PUT_MEDIA_RECV_TIMEOUT_MS;
-        pKvs->xPutMediaPara.uSendTimeoutMs = DEFAULT_PUT_MEDIA_SEND_TIMEOUT_MS;
+        prvMetricsAddEvicted(pKvs);
     }
 
-    return res;
+    prvCallOnDataFrameTerminate(pDataFrameIn);
+    Kvs_dataFrameTerminate(xDataFrameHandle);
 }
 
-static int setupDataEndpoint(KvsApp_t *pKvs)
+static void prvStreamSpillHeadUntilMem(KvsApp_t *pKvs, size_t uMemLimit)
 {
-    int res = KVS_ERRNO_NONE;
-    unsigned int uHttpStatusCode = 0;
-
-    if (pKvs == NULL)
+    if (Lock(pKvs->xSpillLock) != LOCK_OK)
     {
-        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Failed to lock");
     }
     else
     {
-        if (pKvs->xServicePara.pcPutMediaEndpoint != NULL)
+        /* The spill lock makes sure data frames are in the spill buffer before a newer one is popped by sender. */
+        if (Kvs_streamEvictGopsUntilMem(pKvs->xStreamHandle, uMemLimit, prvOnDataFrameSpilled, pKvs) != KVS_ERRNO_NONE)
         {
-            /* Since we already have the endpoint, we needn't update it again. */
-        }
-        else
-        {
-            LogInfo("Try to describe stream");
-            if ((res = Kvs_describeStream(&(pKvs->xServicePara), &(pKvs->xDescPara), &uHttpStatusCode)) != KVS_ERRNO_NONE)
-            {
-                LogError("Unable to describe stream");
-                /* Propagate the res error */
-            }
-            else if (uHttpStatusCode != 200)
-            {
-                LogInfo("Failed to describe stream, status code:%u", uHttpStatusCode);
-                res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
-
-                LogInfo("Try to create stream");
-                if ((res = Kvs_createStream(&(pKvs->xServicePara), &(pKvs->xCreatePara), &uHttpStatusCode)) != KVS_ERRNO_NONE)
-                {
-                    LogError("Unable to create stream");
-                    /* Propagate the res error */
-                }
-                else if (uHttpStatusCode != 200)
-                {
-                    LogInfo("Failed to create stream, status code:%u", uHttpStatusCode);
-                    res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
-                }
-            }
-
-            if (res == KVS_ERRNO_NONE)
-            {
-                if ((res = Kvs_getDataEndpoint(&(pKvs->xServicePara), &(pKvs->xGetDataEpPara), &uHttpStatusCode, &(pKvs->pDataEndpoint))) != KVS_ERRNO_NONE)
-                {
-                    LogError("Unable to get data endpoint");
-                    /* Propagate the res error */
-                }
-                else if (uHttpStatusCode != 200)
-                {
-                    LogInfo("Failed to get data endpoint, status code:%u", uHttpStatusCode);
-                    res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
-                }
-                else
-                {
-                    pKvs->xServicePara.pcPutMediaEndpoint = pKvs->pDataEndpoint;
-                }
-            }
+            LogError("Failed to spill data frames");
         }
+        Unlock(pKvs->xSpillLock);
     }
+}
 
-    if (res == KVS_ERRNO_NONE)
+static void prvLatencyMark(KvsApp_t *pKvs, uint64_t uTimecodeMs, LatencyStage_t xStage)
+{
+    if (Lock(pKvs->xLatencyLock) == LOCK_OK)
     {
-        LogInfo("PUT MEDIA endpoint: %s", pKvs->xServicePara.pcPutMediaEndpoint);
+        Kvs_latencyTrackerMark(pKvs->xLatencyTracker, uTimecodeMs, xStage, getMonotonicTimeInMs());
+        Unlock(pKvs->xLatencyLock);
     }
+}
 
-    return res;
+static void prvLatencyMarkSent(KvsApp_t *pKvs, uint64_t uTimestampMs, MkvClusterType_t xClusterType)
+{
+    if (xClusterType == MKV_CLUSTER)
+    {
+        pKvs->uSendingClusterTimecodeMs = uTimestampMs;
+    }
+    prvLatencyMark(pKvs, pKvs->uSendingClusterTimecodeMs, LATENCY_STAGE_SENT);
 }
 
-static int updateEbmlHeader(KvsApp_t *pKvs)
+static void prvOnFragmentAck(ePutMediaFragmentAckEventType eAckEventType, uint64_t uFragmentTimecode, unsigned int uErrorId, void *pAppData)
 {
-    int res = KVS_ERRNO_NONE;
-    uint8_t *pEbmlSeg = NULL;
-    size_t uEbmlSegLen = 0;
+    KvsApp_t *pKvs = (KvsApp_t *)pAppData;
 
-    if (pKvs->xPutMediaHandle != NULL && !(pKvs->isEbmlHeaderUpdated))
+    if (eAckEventType <= eIdle && Lock(pKvs->xMetricsLock) == LOCK_OK)
     {
-        LogInfo("Flush to next cluster");
-        if ((res = prvStreamFlushToNextCluster(pKvs)) != KVS_ERRNO_NONE)
-        {
-            LogInfo("No cluster frame is found");
-            /* Propagate the res error */
-        }
-        else if ((res = Kvs_streamGetMkvEbmlSegHdr(pKvs->xStreamHandle, &pEbmlSeg, &uEbmlSegLen)) != KVS_ERRNO_NONE ||
-                 (res = Kvs_putMediaUpdateRaw(pKvs->xPutMediaHandle, pEbmlSeg, uEbmlSegLen)) != KVS_ERRNO_NONE)
-        {
-            LogError("Failed to update EBML header");
-            /* Propagate the res error */
-        }
-        else
-        {
-            pKvs->isEbmlHeaderUpdated = true;
+        pKvs->xMetrics.puAckCount[eAckEventType]++;
+        Unlock(pKvs->xMetricsLock);
+    }
 
-            if (pKvs->onMkvSentCallbackInfo.onMkvSentCallback != NULL)
-            {
-                /* FIXME: Handle the return value in a proper way. */
-                pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pEbmlSeg, uEbmlSegLen, pKvs->onMkvSentCallbackInfo.pAppData);
-            }
+    /* The timecode type is absolute, so the fragment timecode is the timestamp of the cluster. */
+    if (eAckEventType == eBuffering)
+    {
+        prvLatencyMark(pKvs, uFragmentTimecode, LATENCY_STAGE_BUFFERING);
+    }
+    else if (eAckEventType == eReceived)
+    {
+        prvLatencyMark(pKvs, uFragmentTimecode, LATENCY_STAGE_RECEIVED);
+    }
+    else if (eAckEventType == ePersisted)
+    {
+        prvLatencyMark(pKvs, uFragmentTimecode, LATENCY_STAGE_PERSISTED);
+        Kvs_replayAck(pKvs->xReplayHandle, uFragmentTimecode);
+        if (pKvs->pCheckpointFilename != NULL && uFragmentTimecode > pKvs->uCheckpointTimecodeMs)
+        {
+            pKvs->uCheckpointTimecodeMs = uFragmentTimecode;
+            pKvs->bCheckpointDirty = true;
         }
     }
+    else
+    {
+        /* nop */
+    }
 
-    return res;
+    if (pKvs->onFragmentAckCallbackInfo.onFragmentAck != NULL)
+    {
+        pKvs->onFragmentAckCallbackInfo.onFragmentAck(eAckEventType, uFragmentTimecode, uErrorId, pKvs->onFragmentAckCallbackInfo.pAppData);
+    }
 }
 
-static int createStream(KvsApp_t *pKvs)
+static void prvCheckpointSaveIfDue(KvsApp_t *pKvs, bool bForce)
 {
-    int res = KVS_ERRNO_NONE;
-    VideoTrackInfo_t xVideoTrackInfo = {0};
-    uint8_t *pCodecPrivateData = NULL;
-    size_t uCodecPrivateDataLen = 0;
+    uint64_t uNowMs = getMonotonicTimeInMs();
 
-    if (pKvs->xStreamHandle == NULL)
+    /* Acks are batched into one write an interval to limit the wear of flash. */
+    if (pKvs->bCheckpointDirty && (bForce || uNowMs >= pKvs->uNextCheckpointMs))
     {
-        if (pKvs->pVideoTrackInfo == NULL && pKvs->pSps != NULL && pKvs->pPps != NULL)
+        pKvs->uNextCheckpointMs = uNowMs + pKvs->uCheckpointIntervalMs;
+        if (Kvs_spillSaveCheckpoint(pKvs->pCheckpointFilename, pKvs->uCheckpointTimecodeMs) == KVS_ERRNO_NONE)
         {
-            /* We don't have video track info, but we have SPS & PPS to generate video track info from it. */
-            if ((res = NALU_getH264VideoResolutionFromSps(pKvs->pSps, pKvs->uSpsLen, &(xVideoTrackInfo.uWidth), &(xVideoTrackInfo.uHeight))) != KVS_ERRNO_NONE ||
-                (res = Mkv_generateH264CodecPrivateDataFromSpsPps(pKvs->pSps, pKvs->uSpsLen, pKvs->pPps, pKvs->uPpsLen, &pCodecPrivateData, &uCodecPrivateDataLen)) != KVS_ERRNO_NONE)
-            {
-                LogError("Failed to generate video track info");
-                /* Propagate the res error */
-            }
-            else
-            {
-                xVideoTrackInfo.pTrackName = VIDEO_TRACK_NAME;
-                xVideoTrackInfo.pCodecName = VIDEO_CODEC_NAME;
-                xVideoTrackInfo.pCodecPrivate = pCodecPrivateData;
-                xVideoTrackInfo.uCodecPrivateLen = uCodecPrivateDataLen;
-                pKvs->pVideoTrackInfo = prvCopyVideoTrackInfo(&xVideoTrackInfo);
-            }
-
-            if (pCodecPrivateData != NULL)
-            {
-                kvsFree(pCodecPrivateData);
-            }
+            pKvs->bCheckpointDirty = false;
         }
+    }
+}
 
-        if (pKvs->pVideoTrackInfo != NULL)
-        {
-            if ((pKvs->xStreamHandle = Kvs_streamCreate(pKvs->pVideoTrackInfo, pKvs->pAudioTrackInfo)) == NULL)
-            {
-                res = KVS_ERROR_FAIL_TO_CREATE_STREAM_HANDLE;
-            }
-            else
-            {
-                LogInfo("KVS stream buffer created");
+static void prvLatencyCopy(KvsApp_t *pKvs, LatencyStage_t xStage, KvsAppLatency_t *pxLatency)
+{
+    LatencySummary_t xSummary = {0};
 
-                pKvs->isAudioTrackPresent = (pKvs->pAudioTrackInfo != NULL);
-            }
-        }
+    if (Kvs_latencyTrackerGetSummary(pKvs->xLatencyTracker, xStage, &xSummary) == KVS_ERRNO_NONE)
+    {
+        pxLatency->uSampleCount = xSummary.uCount;
+        pxLatency->uP50Ms = xSummary.uP50Ms;
+        pxLatency->uP95Ms = xSummary.uP95Ms;
+        pxLatency->uMaxMs = xSummary.uMaxMs;
     }
+}
 
-    return res;
+static bool prvSpillIsEmpty(KvsApp_t *pKvs)
+{
+    bool bEmpty = true;
+
+    if (pKvs->xSpillHandle != NULL && Lock(pKvs->xSpillLock) == LOCK_OK)
+    {
+        bEmpty = Kvs_spillIsEmpty(pKvs->xSpillHandle);
+        Unlock(pKvs->xSpillLock);
+    }
+
+    return bEmpty;
 }
 
-static int checkAndBuildStream(KvsApp_t *pKvs, uint8_t *pData, size_t uDataLen, TrackType_t xTrackType)
+static int prvSpillFlushToNextCluster(KvsApp_t *pKvs)
 {
     int res = KVS_ERRNO_NONE;
-    uint8_t *pSps = NULL;
-    size_t uSpsLen = 0;
-    uint8_t *pPps = NULL;
-    size_t uPpsLen = 0;
+    SpillRecordInfo_t xInfo = {0};
 
-    if (pKvs->xStreamHandle == NULL)
+    if (pKvs->xSpillHandle == NULL)
     {
-        /* Try to build video track info from frames. */
-        if (pKvs->pVideoTrackInfo == NULL && xTrackType == TRACK_VIDEO)
+        res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
+    }
+    else if (Lock(pKvs->xSpillLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        while ((res = Kvs_spillPeekRecord(pKvs->xSpillHandle, &xInfo)) == KVS_ERRNO_NONE)
         {
-            if (pKvs->pSps == NULL && NALU_getNaluFromAvccNalus(pData, uDataLen, NALU_TYPE_SPS, &pSps, &uSpsLen) == KVS_ERRNO_NONE)
+            if (xInfo.xClusterType == MKV_CLUSTER && xInfo.uRemainingLen == xInfo.uLen)
             {
-                LogInfo("SPS is found");
-                if ((res = prvBufMallocAndCopy(&(pKvs->pSps), &(pKvs->uSpsLen), pSps, uSpsLen)) != KVS_ERRNO_NONE)
-                {
-                    /* Propagate the res error */
-                }
-                else
-                {
-                    LogInfo("SPS is set");
-                }
+                prvEarliestTimestampSet(pKvs, xInfo.uTimestampMs);
+                break;
             }
-            if (pKvs->pPps == NULL && NALU_getNaluFromAvccNalus(pData, uDataLen, NALU_TYPE_PPS, &pPps, &uPpsLen) == KVS_ERRNO_NONE)
+            else if ((res = Kvs_spillSkipRecord(pKvs->xSpillHandle)) != KVS_ERRNO_NONE)
             {
-                LogInfo("PPS is found");
-                if ((res = prvBufMallocAndCopy(&(pKvs->pPps), &(pKvs->uPpsLen), pPps, uPpsLen)) != KVS_ERRNO_NONE)
-                {
-                    /* Propagate the res error */
-                }
-                else
-                {
-                    LogInfo("PPS is set");
-                }
+                /* Propagate the res error */
+                break;
             }
         }
-
-        if (pKvs->pSps != NULL && pKvs->pPps != NULL)
-        {
-            res = createStream(pKvs);
-        }
+        Unlock(pKvs->xSpillLock);
     }
 
     return res;
 }
 
-static int prvCheckOnDataFrameToBeSent(DataFrameHandle xDataFrameHandle)
+static DataFrameHandle prvStreamPopUnlessSpilled(KvsApp_t *pKvs)
 {
-    int res = KVS_ERRNO_NONE;
-    int retval = 0;
-    DataFrameIn_t *pDataFrameIn = NULL;
-    DataFrameUserData_t *pUserData = NULL;
-    OnDataFrameToBeSentInfo_t *pOnDataFrameToBeSentCallbackInfo = NULL;
+    DataFrameHandle xDataFrameHandle = NULL;
 
-    if (xDataFrameHandle == NULL)
+    if (pKvs->xSpillHandle == NULL)
     {
-        res = KVS_ERROR_INVALID_ARGUMENT;
+        xDataFrameHandle = Kvs_streamPop(pKvs->xStreamHandle);
+    }
+    else if (Lock(pKvs->xSpillLock) != LOCK_OK)
+    {
+        LogError("Failed to lock");
     }
     else
     {
-        pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
-        pUserData = pDataFrameIn->pUserData;
-        pOnDataFrameToBeSentCallbackInfo = &(pUserData->xCallbacks.onDataFrameToBeSentInfo);
-        if (pOnDataFrameToBeSentCallbackInfo->onDataFrameToBeSent != NULL)
+        /* Spilled data frames are older than the ones in the stream, so they must be sent first. */
+        if (Kvs_spillIsEmpty(pKvs->xSpillHandle))
         {
-            retval = pOnDataFrameToBeSentCallbackInfo->onDataFrameToBeSent((uint8_t *)(pDataFrameIn->pData), pDataFrameIn->uDataLen, pDataFrameIn->uTimestampMs, pDataFrameIn->xTrackType, pOnDataFrameToBeSentCallbackInfo->pAppData);
-            if (retval != 0)
-            {
-                res = KVS_GENERATE_CALLBACK_ERROR(retval);
-            }
+            xDataFrameHandle = Kvs_streamPop(pKvs->xStreamHandle);
         }
+        Unlock(pKvs->xSpillLock);
     }
 
-    return res;
+    return xDataFrameHandle;
 }
 
-static int prvPutMediaSendData(KvsApp_t *pKvs, int *pxSendCnt, bool bForceSend)
+static int prvSpillCreate(KvsApp_t *pKvs)
 {
     int res = KVS_ERRNO_NONE;
-    int retVal = 0;
-    DataFrameHandle xDataFrameHandle = NULL;
-    DataFrameIn_t *pDataFrameIn = NULL;
-    uint8_t *pData = NULL;
-    size_t uDataLen = 0;
-    uint8_t *pMkvHeader = NULL;
-    size_t uMkvHeaderLen = 0;
-    int xSendCnt = 0;
 
-    if (pKvs->xStreamHandle != NULL &&
-        pKvs->isEbmlHeaderUpdated == true &&
-        Kvs_streamAvailOnTrack(pKvs->xStreamHandle, TRACK_VIDEO) &&
-        (!bForceSend || !pKvs->isAudioTrackPresent || Kvs_streamAvailOnTrack(pKvs->xStreamHandle, TRACK_AUDIO)))
+    if (pKvs->pCheckpointFilename != NULL && Kvs_spillLoadCheckpoint(pKvs->pCheckpointFilename, &(pKvs->uCheckpointTimecodeMs)) == KVS_ERRNO_NONE)
+    {
+        LogInfo("Fragments until timecode %" PRIu64 " are persisted", pKvs->uCheckpointTimecodeMs);
+    }
+
+    if (pKvs->xSpillHandle == NULL && pKvs->pSpillFilename != NULL && pKvs->uSpillFileSize > 0)
     {
-        if ((xDataFrameHandle = Kvs_streamPop(pKvs->xStreamHandle)) == NULL)
+        if ((pKvs->xSpillLock = Lock_Init()) == NULL)
         {
-            res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
-            LogError("Failed to get data frame");
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to init lock");
         }
-        else if ((res = prvCheckOnDataFrameToBeSent(xDataFrameHandle)) != KVS_ERRNO_NONE)
+        else if ((pKvs->pSpillReadBuf = (uint8_t *)kvsMallocClass(SPILL_READ_BUF_SIZE, KVS_ALLOC_CLASS_MEDIA)) == NULL)
         {
-            LogInfo("Failed to check OnDataFrameToBeSent");
-            /* Propagate the res error */
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: pSpillReadBuf");
         }
-        else if ((res = Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen)) != KVS_ERRNO_NONE)
+        else if (pKvs->pCheckpointFilename == NULL && (pKvs->xSpillHandle = Kvs_spillCreate(pKvs->pSpillFilename, pKvs->uSpillFileSize)) == NULL)
         {
-            LogError("Failed to get data and mkv header to send");
-            /* Propagate the res error */
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Failed to create spill buffer");
         }
-        else if ((res = Kvs_putMediaUpdate(pKvs->xPutMediaHandle, pMkvHeader, uMkvHeaderLen, pData, uDataLen)) != KVS_ERRNO_NONE)
+        else if (pKvs->pCheckpointFilename != NULL &&
+                 (pKvs->xSpillHandle = Kvs_spillRecover(pKvs->pSpillFilename, pKvs->uSpillFileSize, pKvs->uCheckpointTimecodeMs)) == NULL)
         {
-            LogError("Failed to update");
-            /* Propagate the res error */
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Failed to recover spill buffer");
         }
         else
         {
-            pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
-            pKvs->uEarliestTimestamp = pDataFrameIn->uTimestampMs;
-
-            xSendCnt++;
-
-            if (pKvs->onMkvSentCallbackInfo.onMkvSentCallback != NULL)
-            {
-                /* FIXME: Handle the return value in a proper way. */
-                if ((retVal = pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pMkvHeader, uMkvHeaderLen, pKvs->onMkvSentCallbackInfo.pAppData)) != 0)
-                {
-                    res = KVS_GENERATE_CALLBACK_ERROR(retVal);
-                }
-                else if ((retVal = pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pData, uDataLen, pKvs->onMkvSentCallbackInfo.pAppData)) != 0)
-                {
-                    res = KVS_GENERATE_CALLBACK_ERROR(retVal);
-                }
-                else
-                {
-                    /* nop */
-                }
-            }
-        }
-
-        if (xDataFrameHandle != NULL)
-        {
-            pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
-            prvCallOnDataFrameTerminate(pDataFrameIn);
-            if (pDataFrameIn->pUserData != NULL)
-            {
-                kvsFree(pDataFrameIn->pUserData);
-            }
-            Kvs_dataFrameTerminate(xDataFrameHandle);
+            LogInfo("KVS spill buffer created");
         }
     }
 
-    if (pxSendCnt != NULL)
+    return res;
+}
+
+static void prvSpillTerminate(KvsApp_t *pKvs)
+{
+    if (pKvs->xSpillHandle != NULL)
     {
-        *pxSendCnt = xSendCnt;
+        Kvs_spillTerminate(pKvs->xSpillHandle);
+        pKvs->xSpillHandle = NULL;
+    }
+    if (pKvs->pSpillReadBuf != NULL)
+    {
+        kvsFree(pKvs->pSpillReadBuf);
+        pKvs->pSpillReadBuf = NULL;
+    }
+    if (pKvs->xSpillLock != NULL)
+    {
+        Lock_Deinit(pKvs->xSpillLock);
+        pKvs->xSpillLock = NULL;
     }
-
-    return res;
 }
 
-static int prvPutMediaDoWorkDefault(KvsApp_t *pKvs)
+static int prvRecorderCreate(KvsApp_t *pKvs)
 {
     int res = KVS_ERRNO_NONE;
-    int xSendCnt = 0;
+    uint8_t *pEbmlSeg = NULL;
+    size_t uEbmlSegLen = 0;
+    MkvEbmlSegHdrHandle xEbmlSegHdr = NULL;
 
-    do
+    if (pKvs->xRecorderHandle == NULL && pKvs->pRecorderFilePrefix != NULL)
     {
-        if ((res = updateEbmlHeader(pKvs)) != KVS_ERRNO_NONE)
+        if ((pKvs->xRecorderHandle = Kvs_recorderCreate(pKvs->pRecorderFilePrefix, pKvs->uRecorderFileDurationMs, pKvs->uRecorderWriteBufSize)) == NULL)
         {
-            /* Propagate the res error */
-            break;
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("Failed to create recorder");
         }
-
-        if ((res = Kvs_putMediaDoWork(pKvs->xPutMediaHandle)) != KVS_ERRNO_NONE)
+        else if ((res = Kvs_streamAcquireMkvEbmlSegHdr(pKvs->xStreamHandle, &xEbmlSegHdr, &pEbmlSeg, &uEbmlSegLen)) != KVS_ERRNO_NONE ||
+                 (res = Kvs_recorderSetMkvEbmlSegHdr(pKvs->xRecorderHandle, pEbmlSeg, uEbmlSegLen)) != KVS_ERRNO_NONE)
         {
+            LogError("Failed to set MKV header of recorder");
             /* Propagate the res error */
-            break;
         }
-
-        if ((res = prvPutMediaSendData(pKvs, &xSendCnt, false)) != KVS_ERRNO_NONE)
+        else
         {
-            /* Propagate the res error */
-            break;
+            LogInfo("KVS recorder created");
         }
-    } while (false);
-
-    if (xSendCnt == 0)
-    {
-        sleepInMs(50);
     }
 
+    Kvs_streamReleaseMkvEbmlSegHdr(xEbmlSegHdr);
+
     return res;
 }
 
-static int prvPutMediaDoWorkSendEndOfFrames(KvsApp_t *pKvs)
+static VideoTrackInfo_t *prvCopyVideoTrackInfo(VideoTrackInfo_t *pSrcVideoTrackInfo)
 {
     int res = KVS_ERRNO_NONE;
-    int xSendCnt = 0;
+    VideoTrackInfo_t *pDstVideoTrackInfo = NULL;
 
-    do
+    if ((pDstVideoTrackInfo = (VideoTrackInfo_t *)kvsMalloc(sizeof(VideoTrackInfo_t))) == NULL)
     {
-        if ((res = updateEbmlHeader(pKvs)) != KVS_ERRNO_NONE)
-        {
-            /* Propagate the res error */
-            break;
-        }
-
-        if ((res = Kvs_putMediaDoWork(pKvs->xPutMediaHandle)) != KVS_ERRNO_NONE)
+        res = KVS_ERROR_OUT_OF_MEMORY;
+    }
+    else
+    {
+        memset(pDstVideoTrackInfo, 0, sizeof(VideoTrackInfo_t));
+
+        if ((res = prvMallocAndStrcpyHelper(&(pDstVideoTrackInfo->pTrackName), pSrcVideoTrackInfo->pTrackName)) != KVS_ERRNO_NONE ||
+            (res = prvMallocAndStrcpyHelper(&(pDstVideoTrackInfo->pCodecName), pSrcVideoTrackInfo->pCodecName)) != KVS_ERRNO_NONE)
         {
             /* Propagate the res error */
-            break;
         }
-
-        if ((res = prvPutMediaSendData(pKvs, &xSendCnt, true)) != KVS_ERRNO_NONE)
+        else if ((pDstVideoTrackInfo->pCodecPrivate = (uint8_t *)kvsMalloc(pSrcVideoTrackInfo->uCodecPrivateLen)) == NULL)
         {
-            /* Propagate the res error */
-            break;
+            res = KVS_ERROR_OUT_OF_MEMORY;
         }
-    } while (xSendCnt > 0);
+        else
+        {
+            pDstVideoTrackInfo->uWidth = pSrcVideoTrackInfo->uWidth;
+            pDstVideoTrackInfo->uHeight = pSrcVideoTrackInfo->uHeight;
 
-    return res;
+            memcpy(pDstVideoTrackInfo->pCodecPrivate, pSrcVideoTrackInfo->pCodecPrivate, pSrcVideoTrackInfo->uCodecPrivateLen);
+            pDstVideoTrackInfo->uCodecPrivateLen = pSrcVideoTrackInfo->uCodecPrivateLen;
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        prvVideoTrackInfoTerminate(pDstVideoTrackInfo);
+        pDstVideoTrackInfo = NULL;
+    }
+
+    return pDstVideoTrackInfo;
 }
 
-KvsAppHandle KvsApp_create(const char *pcHost, const char *pcRegion, const char *pcService, const char *pcStreamName)
+#if KVS_CONFIG_AUDIO
+static AudioTrackInfo_t *prvCopyAudioTrackInfo(AudioTrackInfo_t *pSrcAudioTrackInfo)
 {
     int res = KVS_ERRNO_NONE;
-    KvsApp_t *pKvs = NULL;
+    AudioTrackInfo_t *pDstAudioTrackInfo = NULL;
 
-    if (pcHost == NULL || pcRegion == NULL || pcService == NULL || pcStreamName == NULL)
-    {
-        res = KVS_ERROR_INVALID_ARGUMENT;
-        LogError("Invalid parameter");
-    }
-    else if ((pKvs = (KvsApp_t *)kvsMalloc(sizeof(KvsApp_t))) == NULL)
+    if ((pDstAudioTrackInfo = (AudioTrackInfo_t *)kvsMalloc(sizeof(AudioTrackInfo_t))) == NULL)
     {
         res = KVS_ERROR_OUT_OF_MEMORY;
-        LogError("OOM: pKvs");
     }
     else
     {
-        memset(pKvs, 0, sizeof(KvsApp_t));
+        memset(pDstAudioTrackInfo, 0, sizeof(AudioTrackInfo_t));
 
-        if ((pKvs->xLock = Lock_Init()) == NULL)
+        if ((res = prvMallocAndStrcpyHelper(&(pDstAudioTrackInfo->pTrackName), pSrcAudioTrackInfo->pTrackName) != KVS_ERRNO_NONE) ||
+            (res = prvMallocAndStrcpyHelper(&(pDstAudioTrackInfo->pCodecName), pSrcAudioTrackInfo->pCodecName)) != KVS_ERRNO_NONE)
         {
-            res = KVS_ERROR_LOCK_ERROR;
-            LogError("Failed to init lock");
+            /* Propagate the res error */
         }
-        else if (
-            (res = prvMallocAndStrcpyHelper(&(pKvs->pHost), pcHost)) != KVS_ERRNO_NONE ||
-            (res = prvMallocAndStrcpyHelper(&(pKvs->pRegion), pcRegion)) != KVS_ERRNO_NONE ||
-            (res = prvMallocAndStrcpyHelper(&(pKvs->pService), pcService)) != KVS_ERRNO_NONE ||
-            (res = prvMallocAndStrcpyHelper(&(pKvs->pStreamName), pcStreamName)) != KVS_ERRNO_NONE)
+        else if ((pDstAudioTrackInfo->pCodecPrivate = (uint8_t *)kvsMalloc(pSrcAudioTrackInfo->uCodecPrivateLen)) == NULL)
         {
-            LogError("OOM: parameters");
-            /* Propagate the res error */
+            res = KVS_ERROR_OUT_OF_MEMORY;
         }
         else
         {
-            pKvs->pDataEndpoint = NULL;
-            pKvs->pAwsAccessKeyId = NULL;
-            pKvs->pAwsSecretAccessKey = NULL;
-            pKvs->pIotCredentialHost = NULL;
-            pKvs->pIotRoleAlias = NULL;
-            pKvs->pIotThingName = NULL;
-            pKvs->pIotX509RootCa = NULL;
-            pKvs->pIotX509Certificate = NULL;
-            pKvs->pIotX509PrivateKey = NULL;
-            pKvs->pToken = NULL;
-
-            pKvs->uDataRetentionInHours = DEFAULT_DATA_RETENTION_IN_HOURS;
-
-            pKvs->uEarliestTimestamp = 0;
-            pKvs->xStreamHandle = NULL;
-            pKvs->xPutMediaHandle = NULL;
-            pKvs->isEbmlHeaderUpdated = false;
-            pKvs->xStrategy.xPolicy = STREAM_POLICY_NONE;
+            pDstAudioTrackInfo->uFrequency = pSrcAudioTrackInfo->uFrequency;
+            pDstAudioTrackInfo->uChannelNumber = pSrcAudioTrackInfo->uChannelNumber;
+            pDstAudioTrackInfo->uBitsPerSample = pSrcAudioTrackInfo->uBitsPerSample;
 
-            pKvs->pVideoTrackInfo = NULL;
-            pKvs->isAudioTrackPresent = false;
-            pKvs->pAudioTrackInfo = NULL;
+            memcpy(pDstAudioTrackInfo->pCodecPrivate, pSrcAudioTrackInfo->pCodecPrivate, pSrcAudioTrackInfo->uCodecPrivateLen);
+            pDstAudioTrackInfo->uCodecPrivateLen = pSrcAudioTrackInfo->uCodecPrivateLen;
         }
     }
 
     if (res != KVS_ERRNO_NONE)
     {
-        KvsApp_terminate(pKvs);
-        pKvs = NULL;
+        prvAudioTrackInfoTerminate(pDstAudioTrackInfo);
+        pDstAudioTrackInfo = NULL;
     }
 
-    return (KvsAppHandle)pKvs;
+    return pDstAudioTrackInfo;
 }
+#endif /* KVS_CONFIG_AUDIO */
 
-void KvsApp_terminate(KvsAppHandle handle)
+static bool isIotCertAvailable(KvsApp_t *pKvs)
 {
-    KvsApp_t *pKvs = (KvsApp_t *)handle;
+#if KVS_CONFIG_IOT_CREDENTIAL
+    if (pKvs->pIotCredentialHost != NULL && pKvs->pIotRoleAlias != NULL && pKvs->pIotThingName != NULL && pKvs->pIotX509RootCa != NULL && pKvs->pIotX509Certificate != NULL &&
+        pKvs->pIotX509PrivateKey != NULL)
+    {
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+static bool prvIsIotCredentialDue(KvsApp_t *pKvs)
+{
+    /* A token that is still valid for a while needn't be refreshed. */
+    return isIotCertAvailable(pKvs) && (pKvs->pToken == NULL || pKvs->pToken->uExpirationMs <= getEpochTimestampInMs() + IOT_CREDENTIAL_REFRESH_MARGIN_MS);
+}
+
+static void updateIotCredential(KvsApp_t *pKvs)
+{
+#if KVS_CONFIG_IOT_CREDENTIAL
+    IotCredentialToken_t *pToken = NULL;
+    IotCredentialRequest_t xIotCredentialReq = {
+        .pCredentialHost = pKvs->pIotCredentialHost,
+        .pRoleAlias = pKvs->pIotRoleAlias,
+        .pThingName = pKvs->pIotThingName,
+        .pRootCA = pKvs->pIotX509RootCa,
+        .pCertificate = pKvs->pIotX509Certificate,
+        .pPrivateKey = pKvs->pIotX509PrivateKey,
+        .uTlsMaxFragLen = pKvs->xServicePara.uTlsMaxFragLen};
+
+    uint64_t uNowMs = getEpochTimestampInMs();
+    uint64_t uStartMs = getMonotonicTimeInMs();
 
-    if (pKvs != NULL && Lock(pKvs->xLock) == LOCK_OK)
+    if (!prvIsIotCredentialDue(pKvs))
     {
-        if (pKvs->xStreamHandle != NULL)
-        {
-            prvStreamFlush(pKvs);
-            Kvs_streamTermintate(pKvs->xStreamHandle);
-            pKvs->xStreamHandle = NULL;
-        }
-        if (pKvs->pHost != NULL)
-        {
-            kvsFree(pKvs->pHost);
-            pKvs->pHost = NULL;
-        }
-        if (pKvs->pRegion != NULL)
-        {
-            kvsFree(pKvs->pRegion);
-            pKvs->pRegion = NULL;
-        }
-        if (pKvs->pService != NULL)
-        {
-            kvsFree(pKvs->pService);
-            pKvs->pService = NULL;
-        }
-        if (pKvs->pStreamName != NULL)
-        {
-            kvsFree(pKvs->pStreamName);
-            pKvs->pStreamName = NULL;
-        }
-        if (pKvs->pDataEndpoint != NULL)
-        {
-            kvsFree(pKvs->pDataEndpoint);
-            pKvs->pDataEndpoint = NULL;
-        }
-        if (pKvs->pAwsAccessKeyId != NULL)
-        {
-            kvsFree(pKvs->pAwsAccessKeyId);
-            pKvs->pAwsAccessKeyId = NULL;
-        }
-        if (pKvs->pAwsSecretAccessKey != NULL)
-        {
-            kvsFree(pKvs->pAwsSecretAccessKey);
-            pKvs->pAwsSecretAccessKey = NULL;
-        }
-        if (pKvs->pAwsSessionToken != NULL)
-        {
-            kvsFree(pKvs->pAwsSessionToken);
-            pKvs->pAwsSessionToken = NULL;
-        }
-        if (pKvs->pIotCredentialHost != NULL)
-        {
-            kvsFree(pKvs->pIotCredentialHost);
-            pKvs->pIotCredentialHost = NULL;
-        }
-        if (pKvs->pIotRoleAlias != NULL)
-        {
-            kvsFree(pKvs->pIotRoleAlias);
-            pKvs->pIotRoleAlias = NULL;
-        }
-        if (pKvs->pIotThingName != NULL)
-        {
-            kvsFree(pKvs->pIotThingName);
-            pKvs->pIotThingName = NULL;
-        }
-        if (pKvs->pIotX509RootCa != NULL)
-        {
-            kvsFree(pKvs->pIotX509RootCa);
-            pKvs->pIotX509RootCa = NULL;
-        }
-        if (pKvs->pIotX509Certificate != NULL)
-        {
-            kvsFree(pKvs->pIotX509Certificate);
-            pKvs->pIotX509Certificate = NULL;
-        }
-        if (pKvs->pIotX509PrivateKey != NULL)
-        {
-            kvsFree(pKvs->pIotX509PrivateKey);
-            pKvs->pIotX509PrivateKey = NULL;
-        }
-        if (pKvs->pVideoTrackInfo != NULL)
-        {
-            prvVideoTrackInfoTerminate(pKvs->pVideoTrackInfo);
-        }
-        if (pKvs->pAudioTrackInfo != NULL)
-        {
-            prvAudioTrackInfoTerminate(pKvs->pAudioTrackInfo);
-        }
-        if (pKvs->pSps != NULL)
-        {
-            kvsFree(pKvs->pSps);
-            pKvs->pSps = NULL;
-        }
-        if (pKvs->pPps != NULL)
+        /* nop */
+    }
+    else if ((pToken = Iot_getCredential(&xIotCredentialReq)) == NULL)
+    {
+        LogError("Failed to get Iot credential");
+        prvMetricsAddRest(pKvs, KVS_APP_REST_IOT_CREDENTIAL, uStartMs, true);
+
+        /* Keep using the old token until it expires. */
+        if (pKvs->pToken != NULL && pKvs->pToken->uExpirationMs <= uNowMs)
         {
-            kvsFree(pKvs->pPps);
-            pKvs->pPps = NULL;
+            Iot_credentialTerminate(pKvs->pToken);
+            pKvs->pToken = NULL;
         }
+    }
+    else
+    {
+        prvMetricsAddRest(pKvs, KVS_APP_REST_IOT_CREDENTIAL, uStartMs, false);
+        Iot_credentialTerminate(pKvs->pToken);
+        pKvs->pToken = pToken;
+    }
+#else
+    (void)pKvs;
+#endif
+}
+
+static void prvUpdateRestfulReqParameters(KvsApp_t *pKvs)
+{
+    pKvs->xServicePara.pcHost = pKvs->pHost;
+    pKvs->xServicePara.pcRegion = pKvs->pRegion;
+    pKvs->xServicePara.pcService = pKvs->pService;
+    pKvs->xServicePara.uRecvTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
+    pKvs->xServicePara.uSendTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
 
-        Unlock(pKvs->xLock);
+    pKvs->xDescPara.pcStreamName = pKvs->pStreamName;
 
-        Lock_Deinit(pKvs->xLock);
+    pKvs->xCreatePara.pcStreamName = pKvs->pStreamName;
+    pKvs->xCreatePara.uDataRetentionInHours = pKvs->uDataRetentionInHours;
 
-        memset(pKvs, 0, sizeof(KvsApp_t));
-        kvsFree(pKvs);
-    }
+    pKvs->xGetDataEpPara.pcStreamName = pKvs->pStreamName;
+
+    pKvs->xPutMediaPara.pcStreamName = pKvs->pStreamName;
+    pKvs->xPutMediaPara.xTimecodeType = TIMECODE_TYPE_ABSOLUTE;
+    pKvs->xPutMediaPara.uRecvTimeoutMs = DEFAULT_PUT_MEDIA_RECV_TIMEOUT_MS;
+    pKvs->xPutMediaPara.uSendTimeoutMs = DEFAULT_PUT_MEDIA_SEND_TIMEOUT_MS;
+    pKvs->xPutMediaPara.onFragmentAck = prvOnFragmentAck;
+    pKvs->xPutMediaPara.pFragmentAckAppData = pKvs;
 }
 
-int KvsApp_setoption(KvsAppHandle handle, const char *pcOptionName, const char *pValue)
+static int prvUpdateServiceCredential(KvsApp_t *pKvs)
 {
     int res = KVS_ERRNO_NONE;
-    KvsApp_t *pKvs = (KvsApp_t *)handle;
 
-    if (pKvs == NULL || pcOptionName == NULL)
+    if (pKvs->pToken != NULL)
     {
-        res = KVS_ERROR_INVALID_ARGUMENT;
+        pKvs->xServicePara.pcAccessKey = pKvs->pToken->pAccessKeyId;
+        pKvs->xServicePara.pcSecretKey = pKvs->pToken->pSecretAccessKey;
+        pKvs->xServicePara.pcToken = pKvs->pToken->pSessionToken;
     }
     else
     {
-        if (strcmp(pcOptionName, (const char *)OPTION_AWS_ACCESS_KEY_ID) == 0)
+        if (pKvs->pAwsAccessKeyId == NULL || pKvs->pAwsSecretAccessKey == NULL)
         {
-            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pAwsAccessKeyId), pValue)) != 0)
-            {
-                LogError("Failed to set pAwsAccessKeyId");
-                /* Propagate the res error */
-            }
+            res = KVS_ERROR_NO_AWS_ACCESS_KEY_OR_SECRET_KEY;
+            LogError("No available aws access key");
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_AWS_SECRET_ACCESS_KEY) == 0)
+        else
         {
-            if (prvMallocAndStrcpyHelper(&(pKvs->pAwsSecretAccessKey), pValue) != 0)
-            {
-                LogError("Failed to set pAwsSecretAccessKey");
-                /* Propagate the res error */
-            }
-        }
-        else if (strcmp(pcOptionName, (const char *)OPTION_AWS_SESSION_TOKEN) == 0)
+            pKvs->xServicePara.pcAccessKey = pKvs->pAwsAccessKeyId;
+            pKvs->xServicePara.pcSecretKey = pKvs->pAwsSecretAccessKey;
+            pKvs->xServicePara.pcToken = pKvs->pAwsSessionToken;
+        }
+    }
+
+    return res;
+}
+
+static int updateAndVerifyRestfulReqParameters(KvsApp_t *pKvs)
+{
+    prvUpdateRestfulReqParameters(pKvs);
+
+    return prvUpdateServiceCredential(pKvs);
+}
+
+static void prvDataEndpointUpdated(KvsApp_t *pKvs)
+{
+    pKvs->uDataEndpointExpirationMs = (pKvs->uDataEndpointTtlMs == 0) ? 0 : getMonotonicTimeInMs() + pKvs->uDataEndpointTtlMs;
+
+    if (pKvs->onDataEndpointUpdatedCallbackInfo.onDataEndpointUpdated != NULL)
+    {
+        pKvs->onDataEndpointUpdatedCallbackInfo.onDataEndpointUpdated(pKvs->xServicePara.pcPutMediaEndpoint, pKvs->onDataEndpointUpdatedCallbackInfo.pAppData);
+    }
+}
+
+static void prvDataEndpointInvalidate(KvsApp_t *pKvs)
+{
+    if (pKvs->xServicePara.pcPutMediaEndpoint != NULL)
+    {
+        LogInfo("Invalidate data endpoint");
+        pKvs->xServicePara.pcPutMediaEndpoint = NULL;
+        if (pKvs->pDataEndpoint != NULL)
         {
-            if (pValue == NULL)
-            {
-                if (pKvs->pAwsSessionToken != NULL)
-                {
-                    kvsFree(pKvs->pAwsSessionToken);
-                }
-                pKvs->pAwsSessionToken = NULL;
-            }
-            else if ((res = prvMallocAndStrcpyHelper(&(pKvs->pAwsSessionToken), pValue)) != 0)
-            {
-                LogError("Failed to set pAwsSessionToken");
-                /* Propagate the res error */
-            }
+            kvsFree(pKvs->pDataEndpoint);
+            pKvs->pDataEndpoint = NULL;
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_CREDENTIAL_HOST) == 0)
+        prvDataEndpointUpdated(pKvs);
+    }
+}
+
+static int prvCreateKvsStream(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    unsigned int uHttpStatusCode = 0;
+    uint64_t uStartMs = getMonotonicTimeInMs();
+
+    LogInfo("Try to create stream");
+    res = Kvs_createStream(&(pKvs->xServicePara), &(pKvs->xCreatePara), &uHttpStatusCode);
+    prvMetricsAddRest(pKvs, KVS_APP_REST_CREATE_STREAM, uStartMs, res != KVS_ERRNO_NONE || uHttpStatusCode != 200);
+    if (res != KVS_ERRNO_NONE)
+    {
+        LogError("Unable to create stream");
+        /* Propagate the res error */
+    }
+    else if (uHttpStatusCode != 200)
+    {
+        LogInfo("Failed to create stream, status code:%u", uHttpStatusCode);
+        res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
+    }
+
+    return res;
+}
+
+static int prvGetDataEndpoint(KvsApp_t *pKvs, unsigned int *puHttpStatusCode)
+{
+    int res = KVS_ERRNO_NONE;
+    uint64_t uStartMs = getMonotonicTimeInMs();
+
+    res = Kvs_getDataEndpoint(&(pKvs->xServicePara), &(pKvs->xGetDataEpPara), puHttpStatusCode, &(pKvs->pDataEndpoint));
+    prvMetricsAddRest(pKvs, KVS_APP_REST_GET_DATA_ENDPOINT, uStartMs, res != KVS_ERRNO_NONE || *puHttpStatusCode != 200);
+    if (res != KVS_ERRNO_NONE)
+    {
+        LogError("Unable to get data endpoint");
+        /* Propagate the res error */
+    }
+    else if (*puHttpStatusCode != 200)
+    {
+        LogInfo("Failed to get data endpoint, status code:%u", *puHttpStatusCode);
+        res = KVS_GENERATE_RESTFUL_ERROR(*puHttpStatusCode);
+    }
+    else
+    {
+        pKvs->xServicePara.pcPutMediaEndpoint = pKvs->pDataEndpoint;
+        prvDataEndpointUpdated(pKvs);
+    }
+
+    return res;
+}
+
+static void prvDataEndpointInvalidateIfExpired(KvsApp_t *pKvs)
+{
+    if (pKvs->xServicePara.pcPutMediaEndpoint != NULL && pKvs->uDataEndpointExpirationMs != 0 && getMonotonicTimeInMs() >= pKvs->uDataEndpointExpirationMs)
+    {
+        prvDataEndpointInvalidate(pKvs);
+    }
+}
+
+static int setupDataEndpoint(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    unsigned int uHttpStatusCode = 0;
+    uint64_t uStartMs = 0;
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        prvDataEndpointInvalidateIfExpired(pKvs);
+
+        if (pKvs->xServicePara.pcPutMediaEndpoint != NULL)
         {
-            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotCredentialHost), pValue)) != 0)
-            {
-                LogError("Failed to set pIotX509RootCa");
-                /* Propagate the res error */
-            }
+            /* Since we already have the endpoint, we needn't update it again. It also means the stream exists. */
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_ROLE_ALIAS) == 0)
+        else if (pKvs->bFastOpen)
         {
-            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotRoleAlias), pValue)) != 0)
+            /* The stream exists in most cases, so the endpoint is asked first, and the stream is created only if it's
+             * not found. It saves the round trip of DescribeStream. */
+            if ((res = prvGetDataEndpoint(pKvs, &uHttpStatusCode)) != KVS_ERRNO_NONE && uHttpStatusCode == 404 &&
+                (res = prvCreateKvsStream(pKvs)) == KVS_ERRNO_NONE)
             {
-                LogError("Failed to set pIotX509RootCa");
-                /* Propagate the res error */
+                res = prvGetDataEndpoint(pKvs, &uHttpStatusCode);
             }
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_THING_NAME) == 0)
+        else
         {
-            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotThingName), pValue)) != 0)
+            LogInfo("Try to describe stream");
+            uStartMs = getMonotonicTimeInMs();
+            res = Kvs_describeStream(&(pKvs->xServicePara), &(pKvs->xDescPara), &uHttpStatusCode);
+            prvMetricsAddRest(pKvs, KVS_APP_REST_DESCRIBE_STREAM, uStartMs, res != KVS_ERRNO_NONE || uHttpStatusCode != 200);
+            if (res != KVS_ERRNO_NONE)
             {
-                LogError("Failed to set pIotX509RootCa");
+                LogError("Unable to describe stream");
                 /* Propagate the res error */
             }
-        }
-        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_X509_ROOTCA) == 0)
-        {
-            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotX509RootCa), pValue)) != 0)
+            else if (uHttpStatusCode != 200)
             {
-                LogError("Failed to set pIotX509RootCa");
-                /* Propagate the res error */
+                LogInfo("Failed to describe stream, status code:%u", uHttpStatusCode);
+                res = prvCreateKvsStream(pKvs);
             }
-        }
-        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_X509_CERT) == 0)
-        {
-            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotX509Certificate), pValue)) != 0)
+
+            if (res == KVS_ERRNO_NONE)
             {
-                LogError("Failed to set pIotX509Certificate");
-                /* Propagate the res error */
+                res = prvGetDataEndpoint(pKvs, &uHttpStatusCode);
             }
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_X509_KEY) == 0)
+    }
+
+    /* PUT MEDIA goes to the data endpoint, so release the control plane connection before it's connected. */
+    Kvs_closeControlConnections();
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        LogInfo("PUT MEDIA endpoint: %s", pKvs->xServicePara.pcPutMediaEndpoint);
+    }
+
+    return res;
+}
+
+static int updateEbmlHeader(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pEbmlSeg = NULL;
+    size_t uEbmlSegLen = 0;
+    MkvEbmlSegHdrHandle xEbmlSegHdr = NULL;
+    bool bReplay = Kvs_replayIsPending(pKvs->xReplayHandle);
+
+    if (pKvs->xPutMediaHandle != NULL && !APP_ATOMIC_LOAD(&(pKvs->isEbmlHeaderUpdated)))
+    {
+        if (bReplay)
         {
-            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotX509PrivateKey), pValue)) != 0)
-            {
-                LogError("Failed to set pIotX509PrivateKey");
-                /* Propagate the res error */
-            }
+            /* The replayed bytes end where the stream stopped, so there is no need to skip to the next cluster. */
+            LogInfo("Replay clusters that are not persisted");
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_DATA_RETENTION_IN_HOURS) == 0)
+        else
         {
-            if (pValue == NULL)
-            {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Invalid value for KVS data retention in hours");
-            }
-            else
-            {
-                pKvs->uDataRetentionInHours = *((unsigned int *)(pValue));
-            }
+            LogInfo("Flush to next cluster");
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_VIDEO_TRACK_INFO) == 0)
+
+        if (!bReplay && prvSpillFlushToNextCluster(pKvs) != KVS_ERRNO_NONE && (res = prvStreamFlushToNextCluster(pKvs)) != KVS_ERRNO_NONE)
         {
-            if (pValue == NULL)
-            {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Invalid value set to KVS video track info");
-            }
-            else if ((pKvs->pVideoTrackInfo = prvCopyVideoTrackInfo((VideoTrackInfo_t *)pValue)) == NULL)
-            {
-                res = KVS_ERROR_OUT_OF_MEMORY;
-                LogError("failed to copy video track info");
-            }
+            LogInfo("No cluster frame is found");
+            /* Propagate the res error */
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_AUDIO_TRACK_INFO) == 0)
+        else if ((res = Kvs_streamAcquireMkvEbmlSegHdr(pKvs->xStreamHandle, &xEbmlSegHdr, &pEbmlSeg, &uEbmlSegLen)) != KVS_ERRNO_NONE ||
+                 (res = Kvs_putMediaUpdateRaw(pKvs->xPutMediaHandle, pEbmlSeg, uEbmlSegLen)) != KVS_ERRNO_NONE)
         {
-            if (pValue == NULL)
-            {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Invalid value set to KVS audio track info");
-            }
-            else if ((pKvs->pAudioTrackInfo = prvCopyAudioTrackInfo((AudioTrackInfo_t *)pValue)) == NULL)
+            LogError("Failed to update EBML header");
+            /* Propagate the res error */
+        }
+        else
+        {
+            APP_ATOMIC_STORE(&(pKvs->isEbmlHeaderUpdated), true);
+
+            if (pKvs->onMkvSentCallbackInfo.onMkvSentCallback != NULL)
             {
-                res = KVS_ERROR_OUT_OF_MEMORY;
-                LogError("failed to copy audio track info");
+                /* FIXME: Handle the return value in a proper way. */
+                pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pEbmlSeg, uEbmlSegLen, pKvs->onMkvSentCallbackInfo.pAppData);
             }
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_POLICY) == 0)
+    }
+
+    Kvs_streamReleaseMkvEbmlSegHdr(xEbmlSegHdr);
+
+    return res;
+}
+
+/**
+ * @brief Build video track info from the VPS, SPS and PPS that are found in frames. Nothing is built if any is missing.
+ */
+static int prvBuildVideoTrackInfo(KvsApp_t *pKvs, VideoTrackInfo_t **ppVideoTrackInfo)
+{
+    int res = KVS_ERRNO_NONE;
+    VideoTrackInfo_t xVideoTrackInfo = {0};
+    uint8_t *pCodecPrivateData = NULL;
+    size_t uCodecPrivateDataLen = 0;
+
+    if (pKvs->xVideoCodec == VIDEO_CODEC_HEVC && pKvs->pVps != NULL && pKvs->pSps != NULL && pKvs->pPps != NULL)
+    {
+        /* We don't have video track info, but we have VPS & SPS & PPS to generate video track info from it. */
+        if ((res = NALU_getHevcVideoResolutionFromSps(pKvs->pSps, pKvs->uSpsLen, &(xVideoTrackInfo.uWidth), &(xVideoTrackInfo.uHeight))) != KVS_ERRNO_NONE ||
+            (res = Mkv_generateHevcCodecPrivateDataFromVpsSpsPps(
+                 pKvs->pVps, pKvs->uVpsLen, pKvs->pSps, pKvs->uSpsLen, pKvs->pPps, pKvs->uPpsLen, &pCodecPrivateData, &uCodecPrivateDataLen)) != KVS_ERRNO_NONE)
         {
-            if (pValue == NULL)
+            LogError("Failed to generate video track info");
+            /* Propagate the res error */
+        }
+        else
+        {
+            xVideoTrackInfo.pTrackName = VIDEO_TRACK_NAME;
+            xVideoTrackInfo.pCodecName = VIDEO_HEVC_CODEC_NAME;
+            xVideoTrackInfo.pCodecPrivate = pCodecPrivateData;
+            xVideoTrackInfo.uCodecPrivateLen = uCodecPrivateDataLen;
+            *ppVideoTrackInfo = prvCopyVideoTrackInfo(&xVideoTrackInfo);
+        }
+    }
+    else if (pKvs->xVideoCodec == VIDEO_CODEC_H264 && pKvs->pSps != NULL && pKvs->pPps != NULL)
+    {
+        /* We don't have video track info, but we have SPS & PPS to generate video track info from it. */
+        if ((res = NALU_getH264VideoResolutionFromSps(pKvs->pSps, pKvs->uSpsLen, &(xVideoTrackInfo.uWidth), &(xVideoTrackInfo.uHeight))) != KVS_ERRNO_NONE ||
+            (res = Mkv_generateH264CodecPrivateDataFromSpsPps(pKvs->pSps, pKvs->uSpsLen, pKvs->pPps, pKvs->uPpsLen, &pCodecPrivateData, &uCodecPrivateDataLen)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to generate video track info");
+            /* Propagate the res error */
+        }
+        else
+        {
+            xVideoTrackInfo.pTrackName = VIDEO_TRACK_NAME;
+            xVideoTrackInfo.pCodecName = VIDEO_CODEC_NAME;
+            xVideoTrackInfo.pCodecPrivate = pCodecPrivateData;
+            xVideoTrackInfo.uCodecPrivateLen = uCodecPrivateDataLen;
+            *ppVideoTrackInfo = prvCopyVideoTrackInfo(&xVideoTrackInfo);
+        }
+    }
+
+    if (pCodecPrivateData != NULL)
+    {
+        kvsFree(pCodecPrivateData);
+    }
+
+    return res;
+}
+
+static int createStream(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    StreamConfig_t xStreamConfig = {0};
+
+    if (pKvs->xStreamHandle == NULL)
+    {
+        if (pKvs->pVideoTrackInfo == NULL && !(pKvs->bAudioOnly))
+        {
+            res = prvBuildVideoTrackInfo(pKvs, &(pKvs->pVideoTrackInfo));
+        }
+
+        if ((pKvs->bAudioOnly) ? (pKvs->pAudioTrackInfo != NULL) : (pKvs->pVideoTrackInfo != NULL))
+        {
+            xStreamConfig.uFrameSlabSize = pKvs->uFrameSlabSize;
+            xStreamConfig.uUserDataSize = sizeof(DataFrameUserData_t);
+            xStreamConfig.uIngestRingSize = pKvs->uIngestRingSize;
+            if ((pKvs->xStreamHandle = Kvs_streamCreateEx((pKvs->bAudioOnly) ? NULL : pKvs->pVideoTrackInfo, pKvs->pAudioTrackInfo, &xStreamConfig)) ==
+                NULL)
             {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Invalid value set to stream strategy");
+                res = KVS_ERROR_FAIL_TO_CREATE_STREAM_HANDLE;
             }
             else
             {
-                KvsApp_streamPolicy_t xPolicy = *((KvsApp_streamPolicy_t *)pValue);
-                if (xPolicy < STREAM_POLICY_NONE || xPolicy >= STREAM_POLICY_MAX)
+                LogInfo("KVS stream buffer created");
+
+                pKvs->isAudioTrackPresent = (pKvs->pAudioTrackInfo != NULL);
+
+                if ((res = prvSpillCreate(pKvs)) != KVS_ERRNO_NONE)
+                {
+                    /* Propagate the res error */
+                }
+                else if (pKvs->uReplayBufSize > 0 && (pKvs->xReplayHandle = Kvs_replayCreate(pKvs->uReplayBufSize)) == NULL)
                 {
-                    LogError("Invalid policy val: %d", xPolicy);
-                    res = KVS_ERROR_INVALID_STREAM_POLICY;
+                    res = KVS_ERROR_OUT_OF_MEMORY;
+                    LogError("Failed to create replay buffer");
+                }
+                else if ((res = prvRecorderCreate(pKvs)) != KVS_ERRNO_NONE)
+                {
+                    /* Propagate the res error */
                 }
                 else
                 {
-                    pKvs->xStrategy.xPolicy = xPolicy;
-                    if (pKvs->xStrategy.xPolicy == STREAM_POLICY_RING_BUFFER)
-                    {
-                        pKvs->xStrategy.xRingBufferPara.uMemLimit = DEFAULT_RING_BUFFER_MEM_LIMIT;
-                    }
+                    /* nop */
                 }
             }
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT) == 0)
-        {
-            if (pValue == NULL)
+    }
+
+    return res;
+}
+
+static bool prvIsPrerollActive(KvsApp_t *pKvs)
+{
+    return pKvs->uPrerollDurationMs > 0 && !(pKvs->bPrerollDone);
+}
+
+static int checkAndBuildStream(KvsApp_t *pKvs, uint8_t *pData, const NaluFrameInfo_t *pxFrameInfo, TrackType_t xTrackType)
+{
+    int res = KVS_ERRNO_NONE;
+    bool bIsHevc = (pKvs->xVideoCodec == VIDEO_CODEC_HEVC);
+
+    if (pKvs->xStreamHandle == NULL)
+    {
+        /* Try to build video track info from frames. */
+        if (pKvs->pVideoTrackInfo == NULL && xTrackType == TRACK_VIDEO)
+        {
+            if (bIsHevc && pKvs->pVps == NULL && pxFrameInfo->xVps.uLen > 0)
             {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Invalid value set to parameter of ring buffer policy");
+                LogInfo("VPS is found");
+                if ((res = prvBufMallocAndCopy(&(pKvs->pVps), &(pKvs->uVpsLen), pData + pxFrameInfo->xVps.uOffset, pxFrameInfo->xVps.uLen)) != KVS_ERRNO_NONE)
+                {
+                    /* Propagate the res error */
+                }
+                else
+                {
+                    LogInfo("VPS is set");
+                }
             }
-            else if (pKvs->xStrategy.xPolicy != STREAM_POLICY_RING_BUFFER)
+            if (pKvs->pSps == NULL && pxFrameInfo->xSps.uLen > 0)
             {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Cannot set parameter to policy: %d ", (int)(pKvs->xStrategy.xPolicy));
+                LogInfo("SPS is found");
+                if ((res = prvBufMallocAndCopy(&(pKvs->pSps), &(pKvs->uSpsLen), pData + pxFrameInfo->xSps.uOffset, pxFrameInfo->xSps.uLen)) != KVS_ERRNO_NONE)
+                {
+                    /* Propagate the res error */
+                }
+                else
+                {
+                    LogInfo("SPS is set");
+                }
             }
-            else
+            if (pKvs->pPps == NULL && pxFrameInfo->xPps.uLen > 0)
             {
-                size_t uMemLimit = *((size_t *)pValue);
-                pKvs->xStrategy.xRingBufferPara.uMemLimit = uMemLimit;
+                LogInfo("PPS is found");
+                if ((res = prvBufMallocAndCopy(&(pKvs->pPps), &(pKvs->uPpsLen), pData + pxFrameInfo->xPps.uOffset, pxFrameInfo->xPps.uLen)) != KVS_ERRNO_NONE)
+                {
+                    /* Propagate the res error */
+                }
+                else
+                {
+                    LogInfo("PPS is set");
+                }
             }
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_CONNECTION_TIMEOUT) == 0)
+
+        if (pKvs->bAudioOnly)
         {
-            if (pValue == NULL)
+            if (pKvs->pAudioTrackInfo != NULL)
             {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Invalid value set to connection timeout");
-            }
-            else
-            {
-                unsigned int uConnectionTimeoutMs = *((unsigned int *)pValue);
-                pKvs->xServicePara.uRecvTimeoutMs = uConnectionTimeoutMs;
-                pKvs->xServicePara.uSendTimeoutMs = uConnectionTimeoutMs;
+                res = createStream(pKvs);
             }
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_STREAMING_RECV_TIMEOUT) == 0)
+        else if (pKvs->pSps != NULL && pKvs->pPps != NULL && (!bIsHevc || pKvs->pVps != NULL))
         {
-            if (pValue == NULL)
+            res = createStream(pKvs);
+        }
+        else if (prvIsPrerollActive(pKvs) && pKvs->pVideoTrackInfo != NULL)
+        {
+            /* The track info is given by the application, so frames are accepted before the connection is ready. */
+            res = createStream(pKvs);
+        }
+    }
+
+    return res;
+}
+
+static bool prvIsParameterSetChanged(uint8_t *pParameterSet, size_t uParameterSetLen, uint8_t *pData, const NaluEntry_t *pxNalu)
+{
+    return pxNalu->uLen > 0 && (pParameterSet == NULL || uParameterSetLen != pxNalu->uLen || memcmp(pParameterSet, pData + pxNalu->uOffset, uParameterSetLen) != 0);
+}
+
+static int prvReplaceParameterSet(uint8_t **ppParameterSet, size_t *puParameterSetLen, uint8_t *pData, const NaluEntry_t *pxNalu)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pParameterSet = NULL;
+    size_t uParameterSetLen = 0;
+
+    if ((res = prvBufMallocAndCopy(&pParameterSet, &uParameterSetLen, pData + pxNalu->uOffset, pxNalu->uLen)) == KVS_ERRNO_NONE)
+    {
+        if (*ppParameterSet != NULL)
+        {
+            kvsFree(*ppParameterSet);
+        }
+        *ppParameterSet = pParameterSet;
+        *puParameterSetLen = uParameterSetLen;
+    }
+
+    return res;
+}
+
+/**
+ * @brief Check if a key frame has parameter sets that are different from the current ones, and if so, build the video
+ * track info of a new segment that starts at it.
+ */
+static int prvCheckParameterSetsChanged(KvsApp_t *pKvs, uint8_t *pData, const NaluFrameInfo_t *pxFrameInfo)
+{
+    int res = KVS_ERRNO_NONE;
+    bool bIsVpsChanged = (pKvs->xVideoCodec == VIDEO_CODEC_HEVC) && prvIsParameterSetChanged(pKvs->pVps, pKvs->uVpsLen, pData, &(pxFrameInfo->xVps));
+    bool bIsSpsChanged = prvIsParameterSetChanged(pKvs->pSps, pKvs->uSpsLen, pData, &(pxFrameInfo->xSps));
+    bool bIsPpsChanged = prvIsParameterSetChanged(pKvs->pPps, pKvs->uPpsLen, pData, &(pxFrameInfo->xPps));
+    VideoTrackInfo_t *pVideoTrackInfo = NULL;
+
+    if (!bIsVpsChanged && !bIsSpsChanged && !bIsPpsChanged)
+    {
+        /* nop */
+    }
+    else if (
+        (bIsVpsChanged && (res = prvReplaceParameterSet(&(pKvs->pVps), &(pKvs->uVpsLen), pData, &(pxFrameInfo->xVps))) != KVS_ERRNO_NONE) ||
+        (bIsSpsChanged && (res = prvReplaceParameterSet(&(pKvs->pSps), &(pKvs->uSpsLen), pData, &(pxFrameInfo->xSps))) != KVS_ERRNO_NONE) ||
+        (bIsPpsChanged && (res = prvReplaceParameterSet(&(pKvs->pPps), &(pKvs->uPpsLen), pData, &(pxFrameInfo->xPps))) != KVS_ERRNO_NONE))
+    {
+        LogError("Failed to update parameter sets");
+        /* Propagate the res error */
+    }
+    else if ((res = prvBuildVideoTrackInfo(pKvs, &pVideoTrackInfo)) != KVS_ERRNO_NONE || pVideoTrackInfo == NULL)
+    {
+        res = (res != KVS_ERRNO_NONE) ? res : KVS_ERROR_OUT_OF_MEMORY;
+        LogError("Failed to build video track info of new segment");
+    }
+    else if (Lock(pKvs->xTrackLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        LogInfo("Parameter sets are changed, and a new segment starts at the key frame");
+        prvVideoTrackInfoTerminate(pKvs->pNextVideoTrackInfo);
+        pKvs->pNextVideoTrackInfo = pVideoTrackInfo;
+        pVideoTrackInfo = NULL;
+        pKvs->uSegmentId++;
+        Unlock(pKvs->xTrackLock);
+    }
+
+    if (pVideoTrackInfo != NULL)
+    {
+        prvVideoTrackInfoTerminate(pVideoTrackInfo);
+    }
+
+    return res;
+}
+
+static int prvCheckOnDataFrameToBeSent(DataFrameHandle xDataFrameHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    int retval = 0;
+    DataFrameIn_t *pDataFrameIn = NULL;
+    DataFrameUserData_t *pUserData = NULL;
+    OnDataFrameToBeSentInfo_t *pOnDataFrameToBeSentCallbackInfo = NULL;
+    uint8_t *pData = NULL;
+    uint8_t *pGathered = NULL;
+
+    if (xDataFrameHandle == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+        pUserData = pDataFrameIn->pUserData;
+        pOnDataFrameToBeSentCallbackInfo = &(pUserData->xCallbacks.onDataFrameToBeSentInfo);
+        if (pOnDataFrameToBeSentCallbackInfo->onDataFrameToBeSent == NULL)
+        {
+            /* nop */
+        }
+        else if ((res = prvDataFrameGetContiguousData(pDataFrameIn, &pData, &pGathered)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else
+        {
+            retval = pOnDataFrameToBeSentCallbackInfo->onDataFrameToBeSent(pData, pDataFrameIn->uDataLen, pDataFrameIn->uTimestampMs, pDataFrameIn->xTrackType, pOnDataFrameToBeSentCallbackInfo->pAppData);
+            if (retval != 0)
             {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Invalid value set to streaming recv timeout");
+                res = KVS_GENERATE_CALLBACK_ERROR(retval);
             }
-            else
-            {
-                unsigned int uRecvTimeoutMs = *((unsigned int *)pValue);
-                pKvs->xPutMediaPara.uRecvTimeoutMs = uRecvTimeoutMs;
+        }
 
-                /* Try to update receive timeout if it's already streaming. */
-                Kvs_putMediaUpdateRecvTimeout(pKvs->xPutMediaHandle, uRecvTimeoutMs);
-            }
+        if (pGathered != NULL)
+        {
+            kvsFree(pGathered);
         }
-        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_STREAMING_SEND_TIMEOUT) == 0)
+    }
+
+    return res;
+}
+
+static void prvReplayAppend(KvsApp_t *pKvs, bool bIsClusterStart, uint64_t uTimestampMs, uint8_t *pData, size_t uDataLen)
+{
+    if (pKvs->xReplayHandle != NULL)
+    {
+        if (bIsClusterStart)
         {
-            if (pValue == NULL)
+            Kvs_replayBeginCluster(pKvs->xReplayHandle, uTimestampMs);
+        }
+        Kvs_replayAppend(pKvs->xReplayHandle, pData, uDataLen);
+    }
+}
+
+static int prvPutMediaUpdateDataFrame(KvsApp_t *pKvs, DataFrameIn_t *pDataFrameIn, uint8_t *pMkvHeader, size_t uMkvHeaderLen, uint8_t *pData, size_t uDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    DataFrameUserData_t *pUserData = (DataFrameUserData_t *)pDataFrameIn->pUserData;
+    uint8_t pLenPrefix[DATA_FRAME_SEGMENT_LEN_PREFIX];
+    size_t i = 0;
+    uint64_t uStartMs = getMonotonicTimeInMs();
+
+    if (pDataFrameIn->uSegmentCount > 0)
+    {
+        /* The segments are sent in order without being gathered. */
+        prvReplayAppend(pKvs, pDataFrameIn->xClusterType == MKV_CLUSTER, pDataFrameIn->uTimestampMs, pMkvHeader, uMkvHeaderLen);
+        for (i = 0; i < pDataFrameIn->uSegmentCount; i++)
+        {
+            if (pDataFrameIn->bPrefixSegmentLen)
             {
-                res = KVS_ERROR_INVALID_ARGUMENT;
-                LogError("Invalid value set to streaming send timeout");
+                PUT_UNALIGNED_4_byte_BE(pLenPrefix, pDataFrameIn->pxSegments[i].uLen);
+                prvReplayAppend(pKvs, false, pDataFrameIn->uTimestampMs, pLenPrefix, sizeof(pLenPrefix));
             }
-            else
-            {
-                unsigned int uSendTimeoutMs = *((unsigned int *)pValue);
-                pKvs->xPutMediaPara.uSendTimeoutMs = uSendTimeoutMs;
+            prvReplayAppend(pKvs, false, pDataFrameIn->uTimestampMs, pDataFrameIn->pxSegments[i].pData, pDataFrameIn->pxSegments[i].uLen);
+        }
+        res = Kvs_putMediaUpdateV(pKvs->xPutMediaHandle, pMkvHeader, uMkvHeaderLen, pDataFrameIn->pxSegments, pDataFrameIn->uSegmentCount, pDataFrameIn->bPrefixSegmentLen);
+    }
+    else if (pMkvHeader + uMkvHeaderLen == pData)
+    {
+        /* The MKV header has been written into the headroom, so the chunk is framed in place. */
+        prvReplayAppend(pKvs, pDataFrameIn->xClusterType == MKV_CLUSTER, pDataFrameIn->uTimestampMs, pMkvHeader, uMkvHeaderLen + uDataLen);
+        res = Kvs_putMediaUpdateInPlace(pKvs->xPutMediaHandle, pMkvHeader, uMkvHeaderLen + uDataLen, pDataFrameIn->uHeadroom - uMkvHeaderLen, pUserData->uTailroom);
+    }
+    else
+    {
+        /* It's kept before it's sent, so it's replayed even if sending fails. */
+        prvReplayAppend(pKvs, pDataFrameIn->xClusterType == MKV_CLUSTER, pDataFrameIn->uTimestampMs, pMkvHeader, uMkvHeaderLen);
+        prvReplayAppend(pKvs, false, pDataFrameIn->uTimestampMs, pData, uDataLen);
+        res = Kvs_putMediaUpdate(pKvs->xPutMediaHandle, pMkvHeader, uMkvHeaderLen, pData, uDataLen);
+    }
 
-                /* Try to update send timeout if it's already streaming. */
-                Kvs_putMediaUpdateSendTimeout(pKvs->xPutMediaHandle, uSendTimeoutMs);
-            }
+    if (res == KVS_ERRNO_NONE)
+    {
+        prvMetricsAddSend(pKvs, uStartMs, false, pDataFrameIn->xTrackType, uMkvHeaderLen + uDataLen, 1);
+    }
+
+    return res;
+}
+
+static bool prvIsNewSegment(KvsApp_t *pKvs, DataFrameIn_t *pDataFrameIn)
+{
+    DataFrameUserData_t *pUserData = (DataFrameUserData_t *)(pDataFrameIn->pUserData);
+
+    return pDataFrameIn->xClusterType == MKV_CLUSTER && pUserData != NULL && pUserData->uSegmentId != pKvs->uSentSegmentId;
+}
+
+/**
+ * @brief Start a new segment on the current connection by sending the EBML and segment header with the latest video
+ * track info.
+ */
+static int prvPutMediaStartSegment(KvsApp_t *pKvs, uint32_t uSegmentId)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pEbmlSeg = NULL;
+    size_t uEbmlSegLen = 0;
+    MkvEbmlSegHdrHandle xEbmlSegHdr = NULL;
+
+    if (Lock(pKvs->xTrackLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        if (pKvs->pNextVideoTrackInfo != NULL &&
+            (res = Kvs_streamUpdateMkvEbmlSegHdr(pKvs->xStreamHandle, pKvs->pNextVideoTrackInfo, pKvs->pAudioTrackInfo)) == KVS_ERRNO_NONE &&
+            uSegmentId == pKvs->uSegmentId)
+        {
+            /* The track info is kept until the latest segment starts. */
+            prvVideoTrackInfoTerminate(pKvs->pVideoTrackInfo);
+            pKvs->pVideoTrackInfo = pKvs->pNextVideoTrackInfo;
+            pKvs->pNextVideoTrackInfo = NULL;
         }
-        else
+        Unlock(pKvs->xTrackLock);
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if ((res = Kvs_streamAcquireMkvEbmlSegHdr(pKvs->xStreamHandle, &xEbmlSegHdr, &pEbmlSeg, &uEbmlSegLen)) != KVS_ERRNO_NONE ||
+             (res = Kvs_putMediaUpdateRaw(pKvs->xPutMediaHandle, pEbmlSeg, uEbmlSegLen)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to start a new segment");
+        /* Propagate the res error */
+    }
+    else
+    {
+        LogInfo("New segment started");
+        pKvs->uSentSegmentId = uSegmentId;
+
+        /* Clusters of the previous segment can't follow the new header, so they're not replayed after reconnection. */
+        Kvs_replayAck(pKvs->xReplayHandle, UINT64_MAX);
+
+        if (pKvs->xRecorderHandle != NULL)
         {
-            /* TODO: Propagate this option to KVS stream. */
+            Kvs_recorderSetMkvEbmlSegHdr(pKvs->xRecorderHandle, pEbmlSeg, uEbmlSegLen);
+        }
+
+        if (pKvs->onMkvSentCallbackInfo.onMkvSentCallback != NULL)
+        {
+            /* FIXME: Handle the return value in a proper way. */
+            pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pEbmlSeg, uEbmlSegLen, pKvs->onMkvSentCallbackInfo.pAppData);
+        }
+    }
+
+    Kvs_streamReleaseMkvEbmlSegHdr(xEbmlSegHdr);
+
+    return res;
+}
+
+static int prvPutMediaSendReplay(KvsApp_t *pKvs, int *pxSendCnt, size_t *puSendLen)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+    uint64_t uStartMs = getMonotonicTimeInMs();
+
+    if ((res = Kvs_replayRead(pKvs->xReplayHandle, REPLAY_SEND_CHUNK_SIZE, &pData, &uDataLen)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to read replay buffer");
+        /* Propagate the res error */
+    }
+    else if ((res = Kvs_putMediaUpdateRaw(pKvs->xPutMediaHandle, pData, uDataLen)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to update");
+        /* Propagate the res error */
+    }
+    else
+    {
+        /* OnMkvSent is not invoked, because these bytes have been reported when they were sent the first time. */
+        prvMetricsAddSend(pKvs, uStartMs, true, TRACK_VIDEO, uDataLen, 0);
+        *pxSendCnt = 1;
+        *puSendLen = uDataLen;
+    }
+
+    return res;
+}
+
+static int prvPutMediaSendSpilledRecord(KvsApp_t *pKvs, int *pxSendCnt, size_t *puSendLen)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+    SpillRecordInfo_t xInfo = {0};
+    size_t uReadLen = 0;
+    size_t uRemainingLen = 0;
+    bool bIsClusterStart = false;
+    uint64_t uStartMs = 0;
+
+    if (Lock(pKvs->xSpillLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        res = Kvs_spillPeekRecord(pKvs->xSpillHandle, &xInfo);
+        Unlock(pKvs->xSpillLock);
+    }
+
+    /* Only the sender reads the spill buffer, so the first record stays the same until it's read to the end. */
+    uRemainingLen = xInfo.uRemainingLen;
+    while (res == KVS_ERRNO_NONE && uRemainingLen > 0)
+    {
+        bIsClusterStart = (xInfo.xClusterType == MKV_CLUSTER && uRemainingLen == xInfo.uLen);
+        if (Lock(pKvs->xSpillLock) != LOCK_OK)
+        {
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to lock");
+            break;
+        }
+        res = Kvs_spillReadRecord(pKvs->xSpillHandle, pKvs->pSpillReadBuf, SPILL_READ_BUF_SIZE, &uReadLen);
+        Unlock(pKvs->xSpillLock);
+
+        if (res == KVS_ERRNO_NONE)
+        {
+            /* It's kept before it's sent, so it's replayed even if sending fails. */
+            prvReplayAppend(pKvs, bIsClusterStart, xInfo.uTimestampMs, pKvs->pSpillReadBuf, uReadLen);
         }
+
+        uStartMs = getMonotonicTimeInMs();
+        if (res != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to read spill record");
+            /* Propagate the res error */
+        }
+        else if ((res = Kvs_putMediaUpdateRaw(pKvs->xPutMediaHandle, pKvs->pSpillReadBuf, uReadLen)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to update");
+            /* Propagate the res error */
+        }
+        else
+        {
+            /* Spilled bytes are recorded once they are sent, so the file keeps the order of the stream. */
+            if (pKvs->xRecorderHandle != NULL)
+            {
+                Kvs_recorderWriteDataFrame(pKvs->xRecorderHandle, xInfo.uTimestampMs, bIsClusterStart, NULL, 0, pKvs->pSpillReadBuf, uReadLen);
+            }
+            uRemainingLen -= uReadLen;
+            prvMetricsAddSend(pKvs, uStartMs, false, xInfo.xTrackType, uReadLen, (uRemainingLen == 0) ? 1 : 0);
+
+            if (pKvs->onMkvSentCallbackInfo.onMkvSentCallback != NULL)
+            {
+                /* FIXME: Handle the return value in a proper way. */
+                if ((retVal = pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pKvs->pSpillReadBuf, uReadLen, pKvs->onMkvSentCallbackInfo.pAppData)) != 0)
+                {
+                    res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+                }
+            }
+        }
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        prvEarliestTimestampSet(pKvs, xInfo.uTimestampMs);
+        *pxSendCnt = 1;
+        *puSendLen = xInfo.uLen;
+        pKvs->uSentFrameCount++;
+        prvLatencyMarkSent(pKvs, xInfo.uTimestampMs, xInfo.xClusterType);
+    }
+
+    return res;
+}
+
+/**
+ * @brief Check if the head of the stream has been queued for the interleave window. Like the rotation check, the head is
+ * peeked without taking it, and only doWork pops data frames.
+ */
+static bool prvIsInterleaveWindowExpired(KvsApp_t *pKvs)
+{
+    bool bIsExpired = false;
+    DataFrameHandle xDataFrameHandle = NULL;
+    DataFrameUserData_t *pUserData = NULL;
+
+    if ((xDataFrameHandle = Kvs_streamPeek(pKvs->xStreamHandle)) != NULL)
+    {
+        pUserData = (DataFrameUserData_t *)(((DataFrameIn_t *)xDataFrameHandle)->pUserData);
+        bIsExpired = (pUserData == NULL || getMonotonicTimeInMs() >= pUserData->uAddTimeMs + pKvs->uInterleaveWindowMs);
+    }
+
+    return bIsExpired;
+}
+
+/**
+ * @brief Check if the head of the stream can be sent. Audio and video are sent in timestamp order, so a data frame is
+ * sent once the other track has caught up with it. Audio goes on its own if there is no video track, or if video has
+ * stalled for the audio latency, and any data frame goes on its own after the interleave window.
+ */
+static bool prvIsDataFrameReady(KvsApp_t *pKvs, bool bForceSend)
+{
+    bool bIsReady = false;
+    StreamStats_t xStats = {0};
+
+    if (pKvs->bAudioOnly)
+    {
+        bIsReady = Kvs_streamAvailOnTrack(pKvs->xStreamHandle, TRACK_AUDIO);
+    }
+    else if (Kvs_streamAvailOnTrack(pKvs->xStreamHandle, TRACK_VIDEO))
+    {
+        bIsReady = (!bForceSend || !pKvs->isAudioTrackPresent || Kvs_streamAvailOnTrack(pKvs->xStreamHandle, TRACK_AUDIO));
+    }
+    else if (pKvs->uAudioMaxLatencyMs > 0 && pKvs->isAudioTrackPresent && Kvs_streamGetStats(pKvs->xStreamHandle, &xStats, false) == KVS_ERRNO_NONE)
+    {
+        /* No video frame is queued, so the timestamps are the ones of the queued audio. */
+        bIsReady = (xStats.uAudioFrameCount > 0 && xStats.uNewestTimestampMs - xStats.uOldestTimestampMs >= pKvs->uAudioMaxLatencyMs);
+    }
+    else
+    {
+        /* nop */
+    }
+
+    if (!bIsReady && pKvs->uInterleaveWindowMs > 0)
+    {
+        bIsReady = prvIsInterleaveWindowExpired(pKvs);
+    }
+
+    return bIsReady;
+}
+
+static int prvPutMediaSendData(KvsApp_t *pKvs, int *pxSendCnt, size_t *puSendLen, bool bForceSend)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+    DataFrameHandle xDataFrameHandle = NULL;
+    DataFrameIn_t *pDataFrameIn = NULL;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    uint8_t *pGathered = NULL;
+    uint8_t pLenPrefix[DATA_FRAME_SEGMENT_LEN_PREFIX];
+    int xSendCnt = 0;
+    size_t uSendLen = 0;
+    size_t i = 0;
+
+    if (pKvs->xStreamHandle != NULL && APP_ATOMIC_LOAD(&(pKvs->isEbmlHeaderUpdated)) && Kvs_replayIsPending(pKvs->xReplayHandle))
+    {
+        KVS_TRACE_BEGIN(KVS_TRACE_APP_SEND_DATA);
+        res = prvPutMediaSendReplay(pKvs, &xSendCnt, &uSendLen);
+        KVS_TRACE_END(KVS_TRACE_APP_SEND_DATA, uSendLen);
+    }
+    else if (pKvs->xStreamHandle != NULL && APP_ATOMIC_LOAD(&(pKvs->isEbmlHeaderUpdated)) && !prvSpillIsEmpty(pKvs))
+    {
+        KVS_TRACE_BEGIN(KVS_TRACE_APP_SEND_DATA);
+        res = prvPutMediaSendSpilledRecord(pKvs, &xSendCnt, &uSendLen);
+        KVS_TRACE_END(KVS_TRACE_APP_SEND_DATA, uSendLen);
+    }
+    else if (pKvs->xStreamHandle != NULL && APP_ATOMIC_LOAD(&(pKvs->isEbmlHeaderUpdated)) && prvIsDataFrameReady(pKvs, bForceSend))
+    {
+        KVS_TRACE_BEGIN(KVS_TRACE_APP_SEND_DATA);
+        if ((xDataFrameHandle = prvStreamPopUnlessSpilled(pKvs)) == NULL)
+        {
+            if (prvSpillIsEmpty(pKvs))
+            {
+                res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
+                LogError("Failed to get data frame");
+            }
+        }
+        else if ((res = prvCheckOnDataFrameToBeSent(xDataFrameHandle)) != KVS_ERRNO_NONE)
+        {
+            LogInfo("Failed to check OnDataFrameToBeSent");
+            /* Propagate the res error */
+        }
+        else if (
+            prvIsNewSegment(pKvs, (DataFrameIn_t *)xDataFrameHandle) &&
+            (res = prvPutMediaStartSegment(pKvs, ((DataFrameUserData_t *)(((DataFrameIn_t *)xDataFrameHandle)->pUserData))->uSegmentId)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else if ((res = Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to get data and mkv header to send");
+            /* Propagate the res error */
+        }
+        else if ((res = prvPutMediaUpdateDataFrame(pKvs, (DataFrameIn_t *)xDataFrameHandle, pMkvHeader, uMkvHeaderLen, pData, uDataLen)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to update");
+            /* Propagate the res error */
+        }
+        else
+        {
+            pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+            prvEarliestTimestampSet(pKvs, pDataFrameIn->uTimestampMs);
+
+            /* Replayed bytes are not recorded again, and failures of the recorder don't stop the stream. */
+            if (pKvs->xRecorderHandle != NULL && prvDataFrameGetContiguousData(pDataFrameIn, &pData, &pGathered) == KVS_ERRNO_NONE)
+            {
+                Kvs_recorderWriteDataFrame(pKvs->xRecorderHandle, pDataFrameIn->uTimestampMs, pDataFrameIn->xClusterType == MKV_CLUSTER, pMkvHeader, uMkvHeaderLen, pData, uDataLen);
+            }
+
+            xSendCnt++;
+            uSendLen = uMkvHeaderLen + uDataLen;
+            pKvs->uSentFrameCount++;
+            prvLatencyMarkSent(pKvs, pDataFrameIn->uTimestampMs, pDataFrameIn->xClusterType);
+
+            if (pKvs->onMkvSentCallbackInfo.onMkvSentCallback != NULL)
+            {
+                /* FIXME: Handle the return value in a proper way. */
+                if ((retVal = pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pMkvHeader, uMkvHeaderLen, pKvs->onMkvSentCallbackInfo.pAppData)) != 0)
+                {
+                    res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+                }
+                else if (pDataFrameIn->uSegmentCount > 0)
+                {
+                    for (i = 0; i < pDataFrameIn->uSegmentCount && retVal == 0; i++)
+                    {
+                        if (pDataFrameIn->bPrefixSegmentLen)
+                        {
+                            PUT_UNALIGNED_4_byte_BE(pLenPrefix, pDataFrameIn->pxSegments[i].uLen);
+                            retVal = pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pLenPrefix, sizeof(pLenPrefix), pKvs->onMkvSentCallbackInfo.pAppData);
+                        }
+                        if (retVal == 0)
+                        {
+                            retVal = pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pDataFrameIn->pxSegments[i].pData, pDataFrameIn->pxSegments[i].uLen, pKvs->onMkvSentCallbackInfo.pAppData);
+                        }
+                    }
+                    if (retVal != 0)
+                    {
+                        res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+                    }
+                }
+                else if ((retVal = pKvs->onMkvSentCallbackInfo.onMkvSentCallback(pData, uDataLen, pKvs->onMkvSentCallbackInfo.pAppData)) != 0)
+                {
+                    res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+                }
+                else
+                {
+                    /* nop */
+                }
+            }
+        }
+
+        if (pGathered != NULL)
+        {
+            kvsFree(pGathered);
+        }
+
+        if (xDataFrameHandle != NULL)
+        {
+            pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+            prvCallOnDataFrameTerminate(pDataFrameIn);
+            Kvs_dataFrameTerminate(xDataFrameHandle);
+        }
+        KVS_TRACE_END(KVS_TRACE_APP_SEND_DATA, uSendLen);
+    }
+
+    if (pxSendCnt != NULL)
+    {
+        *pxSendCnt = xSendCnt;
+    }
+
+    if (puSendLen != NULL)
+    {
+        *puSendLen = uSendLen;
+    }
+
+    return res;
+}
+
+static int prvPutMediaStart(KvsApp_t *pKvs, unsigned int *puHttpStatusCode, PutMediaHandle *pxPutMediaHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    uint64_t uStartMs = getMonotonicTimeInMs();
+
+    res = Kvs_putMediaStart(&(pKvs->xServicePara), &(pKvs->xPutMediaPara), puHttpStatusCode, pxPutMediaHandle);
+    prvMetricsAddRest(pKvs, KVS_APP_REST_PUT_MEDIA, uStartMs, res != KVS_ERRNO_NONE || *puHttpStatusCode != 200);
+
+    return res;
+}
+
+static bool prvIsFailoverEnabled(KvsApp_t *pKvs)
+{
+    return pKvs->uStandbyIfIndex != 0 && pKvs->uFailoverSendLatencyMs > 0;
+}
+
+static unsigned int prvActiveIfIndex(KvsApp_t *pKvs)
+{
+    return pKvs->bOnStandbyIf ? pKvs->uStandbyIfIndex : pKvs->uIfIndex;
+}
+
+static unsigned int prvStandbyIfIndex(KvsApp_t *pKvs)
+{
+    if (!prvIsFailoverEnabled(pKvs))
+    {
+        /* A rotation stays on the same interface. */
+        return prvActiveIfIndex(pKvs);
+    }
+    else
+    {
+        return pKvs->bOnStandbyIf ? pKvs->uIfIndex : pKvs->uStandbyIfIndex;
+    }
+}
+
+/**
+ * @brief Move connections to the other interface of failover. New connections, including the next one of
+ * KvsApp_open, are bound to the active interface.
+ */
+static void prvFailoverSwapInterface(KvsApp_t *pKvs)
+{
+    if (prvIsFailoverEnabled(pKvs))
+    {
+        pKvs->bOnStandbyIf = !pKvs->bOnStandbyIf;
+        pKvs->xPutMediaPara.uBindIfIndex = prvActiveIfIndex(pKvs);
+    }
+    pKvs->bFailoverPending = false;
+}
+
+/**
+ * @brief Ask for a failover if sending a data frame on the active interface takes too long. It's only asked when the
+ * standby connection is ready to take over.
+ */
+static void prvFailoverCheckSendLatency(KvsApp_t *pKvs, uint64_t uSendLatencyMs)
+{
+    if (prvIsFailoverEnabled(pKvs) && !pKvs->bFailoverPending && pKvs->xStandbyPutMediaHandle != NULL && uSendLatencyMs > pKvs->uFailoverSendLatencyMs)
+    {
+        LogInfo("Send latency %u ms is over %u ms, fail over at the next cluster", (unsigned int)uSendLatencyMs, pKvs->uFailoverSendLatencyMs);
+        pKvs->bFailoverPending = true;
+    }
+}
+
+static int prvPutMediaOpenStandby(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    unsigned int uHttpStatusCode = 0;
+
+    /* The data endpoint is kept from the active connection, so only credentials need to be refreshed. */
+    updateIotCredential(pKvs);
+    if ((res = updateAndVerifyRestfulReqParameters(pKvs)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to setup KVS");
+        /* Propagate the res error */
+    }
+    else
+    {
+        pKvs->xPutMediaPara.uBindIfIndex = prvStandbyIfIndex(pKvs);
+        res = prvPutMediaStart(pKvs, &uHttpStatusCode, &(pKvs->xStandbyPutMediaHandle));
+        pKvs->xPutMediaPara.uBindIfIndex = prvActiveIfIndex(pKvs);
+
+        if (res != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to setup standby PUT MEDIA");
+            /* Propagate the res error */
+        }
+        else if (uHttpStatusCode != 200)
+        {
+            res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
+            LogError("Standby PUT MEDIA http status code:%d\n", uHttpStatusCode);
+        }
+        else
+        {
+            /* nop */
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE && pKvs->xStandbyPutMediaHandle != NULL)
+    {
+        prvPutMediaFinish(pKvs, pKvs->xStandbyPutMediaHandle);
+        pKvs->xStandbyPutMediaHandle = NULL;
+    }
+
+    return res;
+}
+
+static void prvOnDataFrameCaughtUp(DataFrameHandle xDataFrameHandle, void *pAppData)
+{
+    KvsApp_t *pKvs = (KvsApp_t *)pAppData;
+    DataFrameIn_t *pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+    DataFrameUserData_t *pUserData = (DataFrameUserData_t *)pDataFrameIn->pUserData;
+    CatchUpFrame_t *pxFrame = NULL;
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+
+    /* Clusters of a previous segment can't follow the EBML header of the stream anymore. */
+    if (pDataFrameIn->xClusterType == MKV_CLUSTER)
+    {
+        pKvs->bCatchUpCollectToCluster = (pUserData != NULL && pUserData->uSegmentId != pKvs->uSentSegmentId);
+    }
+
+    if (pKvs->bCatchUpCollectToCluster || Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen) != KVS_ERRNO_NONE ||
+        (pxFrame = (CatchUpFrame_t *)kvsMalloc(sizeof(CatchUpFrame_t))) == NULL)
+    {
+        /* Once a data frame is dropped, the rest of its GOP is dropped as well. */
+        pKvs->bCatchUpCollectToCluster = true;
+        prvOnDataFrameEvicted(xDataFrameHandle, pAppData);
+    }
+    else
+    {
+        pxFrame->xDataFrameHandle = xDataFrameHandle;
+        pxFrame->uMemLen = uMkvHeaderLen + uDataLen;
+        pxFrame->pxNext = NULL;
+        if (pKvs->pxCatchUpTail == NULL)
+        {
+            pKvs->pxCatchUpHead = pxFrame;
+        }
+        else
+        {
+            pKvs->pxCatchUpTail->pxNext = pxFrame;
+        }
+        pKvs->pxCatchUpTail = pxFrame;
+        pKvs->uCatchUpMemTotal += pxFrame->uMemLen;
+    }
+}
+
+static DataFrameHandle prvCatchUpPop(KvsApp_t *pKvs)
+{
+    CatchUpFrame_t *pxFrame = pKvs->pxCatchUpHead;
+    DataFrameHandle xDataFrameHandle = NULL;
+
+    if (pxFrame != NULL)
+    {
+        pKvs->pxCatchUpHead = pxFrame->pxNext;
+        if (pKvs->pxCatchUpHead == NULL)
+        {
+            pKvs->pxCatchUpTail = NULL;
+        }
+        pKvs->uCatchUpMemTotal -= pxFrame->uMemLen;
+        xDataFrameHandle = pxFrame->xDataFrameHandle;
+        kvsFree(pxFrame);
+    }
+
+    return xDataFrameHandle;
+}
+
+static void prvCatchUpFlush(KvsApp_t *pKvs)
+{
+    DataFrameHandle xDataFrameHandle = NULL;
+
+    while ((xDataFrameHandle = prvCatchUpPop(pKvs)) != NULL)
+    {
+        prvCallOnDataFrameTerminate((DataFrameIn_t *)xDataFrameHandle);
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+}
+
+/**
+ * @brief Move GOPs that are behind the live edge from the stream to the backlog, once the primary connection is ready
+ * to send the live edge. The backlog is bounded by the memory limit of the ring buffer policy.
+ */
+static void prvCatchUpCollect(KvsApp_t *pKvs)
+{
+    if (pKvs->uCatchUpThresholdMs > 0 && pKvs->xStreamHandle != NULL && pKvs->xPutMediaHandle != NULL && APP_ATOMIC_LOAD(&(pKvs->isEbmlHeaderUpdated)) &&
+        !Kvs_replayIsPending(pKvs->xReplayHandle))
+    {
+        /* The data frames in front of the first cluster are left from the GOP that the primary connection is sending. */
+        pKvs->bCatchUpCollectToCluster = true;
+        if (Kvs_streamEvictGopsUntilTimeWindow(pKvs->xStreamHandle, pKvs->uCatchUpThresholdMs, prvOnDataFrameCaughtUp, pKvs) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to move backlog");
+        }
+
+        while (IS_RING_BUFFER_POLICY(pKvs) && pKvs->uCatchUpMemTotal > pKvs->xStrategy.xRingBufferPara.uMemLimit &&
+               pKvs->pxCatchUpHead != NULL)
+        {
+            /* Drop the oldest GOP of the backlog as a whole. */
+            do
+            {
+                prvOnDataFrameEvicted(prvCatchUpPop(pKvs), pKvs);
+            } while (pKvs->pxCatchUpHead != NULL && ((DataFrameIn_t *)(pKvs->pxCatchUpHead->xDataFrameHandle))->xClusterType != MKV_CLUSTER);
+        }
+    }
+}
+
+static void prvCatchUpDisconnect(KvsApp_t *pKvs)
+{
+    if (pKvs->xCatchUpPutMediaHandle != NULL)
+    {
+        prvPutMediaFinish(pKvs, pKvs->xCatchUpPutMediaHandle);
+        pKvs->xCatchUpPutMediaHandle = NULL;
+        pKvs->bCatchUpConnected = false;
+    }
+}
+
+static int prvCatchUpConnect(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    unsigned int uHttpStatusCode = 0;
+    bool bDone = false;
+    uint8_t *pEbmlSeg = NULL;
+    size_t uEbmlSegLen = 0;
+    MkvEbmlSegHdrHandle xEbmlSegHdr = NULL;
+
+    if (pKvs->xCatchUpPutMediaHandle == NULL)
+    {
+        /* The data endpoint is kept from the primary connection, and the connection is established by later calls. */
+        updateIotCredential(pKvs);
+        if ((res = updateAndVerifyRestfulReqParameters(pKvs)) != KVS_ERRNO_NONE ||
+            (res = Kvs_putMediaStartAsync(&(pKvs->xServicePara), &(pKvs->xPutMediaPara), &(pKvs->xCatchUpPutMediaHandle))) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to start catch-up PUT MEDIA");
+            /* Propagate the res error */
+        }
+    }
+    else if ((res = Kvs_putMediaStartPoll(pKvs->xCatchUpPutMediaHandle, &uHttpStatusCode, &bDone)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to setup catch-up PUT MEDIA");
+        /* Propagate the res error */
+    }
+    else if (!bDone)
+    {
+        /* nop */
+    }
+    else if (uHttpStatusCode != 200)
+    {
+        res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
+        LogError("Catch-up PUT MEDIA http status code:%d\n", uHttpStatusCode);
+    }
+    else if ((res = Kvs_streamAcquireMkvEbmlSegHdr(pKvs->xStreamHandle, &xEbmlSegHdr, &pEbmlSeg, &uEbmlSegLen)) != KVS_ERRNO_NONE ||
+             (res = Kvs_putMediaUpdateRaw(pKvs->xCatchUpPutMediaHandle, pEbmlSeg, uEbmlSegLen)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to update EBML header of catch-up PUT MEDIA");
+        /* Propagate the res error */
+    }
+    else
+    {
+        LogInfo("Catch-up PUT MEDIA connection is established");
+        pKvs->bCatchUpConnected = true;
+        pKvs->uCatchUpSegmentId = pKvs->uSentSegmentId;
+        pKvs->xCatchUpTokens = 0;
+        pKvs->uCatchUpRefillMs = getMonotonicTimeInMs();
+    }
+
+    Kvs_streamReleaseMkvEbmlSegHdr(xEbmlSegHdr);
+
+    return res;
+}
+
+static int prvCatchUpUpdateDataFrame(KvsApp_t *pKvs, DataFrameIn_t *pDataFrameIn, uint8_t *pMkvHeader, size_t uMkvHeaderLen, uint8_t *pData, size_t uDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    DataFrameUserData_t *pUserData = (DataFrameUserData_t *)pDataFrameIn->pUserData;
+    uint64_t uStartMs = getMonotonicTimeInMs();
+
+    /* The backlog isn't kept in the replay buffer, which follows the primary connection. */
+    if (pDataFrameIn->uSegmentCount > 0)
+    {
+        res = Kvs_putMediaUpdateV(pKvs->xCatchUpPutMediaHandle, pMkvHeader, uMkvHeaderLen, pDataFrameIn->pxSegments, pDataFrameIn->uSegmentCount, pDataFrameIn->bPrefixSegmentLen);
+    }
+    else if (pMkvHeader + uMkvHeaderLen == pData)
+    {
+        res = Kvs_putMediaUpdateInPlace(pKvs->xCatchUpPutMediaHandle, pMkvHeader, uMkvHeaderLen + uDataLen, pDataFrameIn->uHeadroom - uMkvHeaderLen, pUserData->uTailroom);
+    }
+    else
+    {
+        res = Kvs_putMediaUpdate(pKvs->xCatchUpPutMediaHandle, pMkvHeader, uMkvHeaderLen, pData, uDataLen);
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        prvMetricsAddSend(pKvs, uStartMs, false, pDataFrameIn->xTrackType, uMkvHeaderLen + uDataLen, 1);
+    }
+
+    return res;
+}
+
+/**
+ * @brief Send the backlog on the catch-up connection as the rate allows. Failures of the catch-up connection don't
+ * stop the primary one, and it's connected again after a while.
+ */
+static void prvCatchUpDoWork(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    uint64_t uNowMs = getMonotonicTimeInMs();
+    int64_t xBytesPerSec = (int64_t)(pKvs->uCatchUpRateBps / 8);
+    DataFrameHandle xDataFrameHandle = NULL;
+    DataFrameIn_t *pDataFrameIn = NULL;
+    DataFrameUserData_t *pUserData = NULL;
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+
+    if (pKvs->pxCatchUpHead == NULL)
+    {
+        if (pKvs->xCatchUpPutMediaHandle != NULL)
+        {
+            LogInfo("Backlog is caught up");
+            prvCatchUpDisconnect(pKvs);
+        }
+    }
+    else if (!pKvs->bCatchUpConnected)
+    {
+        if (uNowMs >= pKvs->uNextCatchUpTimestampMs && prvCatchUpConnect(pKvs) != KVS_ERRNO_NONE)
+        {
+            prvCatchUpDisconnect(pKvs);
+            pKvs->uNextCatchUpTimestampMs = uNowMs + STANDBY_RETRY_INTERVAL_MS;
+        }
+    }
+    else if ((res = Kvs_putMediaDoWork(pKvs->xCatchUpPutMediaHandle)) != KVS_ERRNO_NONE)
+    {
+        LogError("Catch-up PUT MEDIA failed");
+    }
+    else
+    {
+        /* A token bucket of one second refills at the rate, and a frame is sent while there is any token left. */
+        if (xBytesPerSec > 0)
+        {
+            pKvs->xCatchUpTokens += xBytesPerSec * (int64_t)(uNowMs - pKvs->uCatchUpRefillMs) / 1000;
+            if (pKvs->xCatchUpTokens > xBytesPerSec)
+            {
+                pKvs->xCatchUpTokens = xBytesPerSec;
+            }
+        }
+        pKvs->uCatchUpRefillMs = uNowMs;
+
+        while (res == KVS_ERRNO_NONE && pKvs->pxCatchUpHead != NULL && (xBytesPerSec == 0 || pKvs->xCatchUpTokens > 0))
+        {
+            xDataFrameHandle = prvCatchUpPop(pKvs);
+            pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+            pUserData = (DataFrameUserData_t *)pDataFrameIn->pUserData;
+
+            /* A new connection starts at a cluster of the segment whose EBML header it has sent. */
+            if (pDataFrameIn->xClusterType == MKV_CLUSTER)
+            {
+                pKvs->bCatchUpSkipToCluster = (pUserData != NULL && pUserData->uSegmentId != pKvs->uCatchUpSegmentId);
+            }
+
+            if (pKvs->bCatchUpSkipToCluster)
+            {
+                prvOnDataFrameEvicted(xDataFrameHandle, pKvs);
+            }
+            else
+            {
+                if ((res = Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen)) != KVS_ERRNO_NONE ||
+                    (res = prvCatchUpUpdateDataFrame(pKvs, pDataFrameIn, pMkvHeader, uMkvHeaderLen, pData, uDataLen)) != KVS_ERRNO_NONE)
+                {
+                    LogError("Failed to send backlog");
+                }
+                else
+                {
+                    pKvs->uSentFrameCount++;
+                    pKvs->xCatchUpTokens -= (int64_t)(uMkvHeaderLen + uDataLen);
+                }
+                prvCallOnDataFrameTerminate(pDataFrameIn);
+                Kvs_dataFrameTerminate(xDataFrameHandle);
+            }
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        /* The rest of the GOP is dropped, and the backlog continues from the next cluster on a new connection. */
+        pKvs->bCatchUpSkipToCluster = true;
+        prvCatchUpDisconnect(pKvs);
+        pKvs->uNextCatchUpTimestampMs = uNowMs + STANDBY_RETRY_INTERVAL_MS;
+    }
+}
+
+static int prvPutMediaCheckStarted(KvsApp_t *pKvs, unsigned int uHttpStatusCode)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (uHttpStatusCode != 200)
+    {
+        res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
+        LogError("PUT MEDIA http status code:%d\n", uHttpStatusCode);
+        if (uHttpStatusCode == 404)
+        {
+            /* The stream has been deleted or moved, so it has to be described again. */
+            prvDataEndpointInvalidate(pKvs);
+        }
+    }
+    else
+    {
+        pKvs->uNextStandbyTimestampMs = getMonotonicTimeInMs() + pKvs->uPutMediaRotationMs;
+        prvMetricsAddReconnect(pKvs);
+        if (prvIsPrerollActive(pKvs))
+        {
+            /* The buffered GOPs are sent by doWork as fast as the link allows. */
+            LogInfo("Flush pre-roll buffer");
+            pKvs->bPrerollDone = true;
+        }
+
+        if ((res = createStream(pKvs)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to setup KVS stream");
+            /* Propagate the res error */
+        }
+    }
+
+    return res;
+}
+
+static int prvPutMediaPollPending(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    unsigned int uHttpStatusCode = 0;
+    bool bDone = false;
+
+    res = Kvs_putMediaStartPoll(pKvs->xPendingPutMediaHandle, &uHttpStatusCode, &bDone);
+    if (res != KVS_ERRNO_NONE || bDone)
+    {
+        prvMetricsAddRest(pKvs, KVS_APP_REST_PUT_MEDIA, pKvs->uPendingPutMediaStartMs, res != KVS_ERRNO_NONE || uHttpStatusCode != 200);
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to setup PUT MEDIA");
+        /* The endpoint may be unreachable. */
+        prvDataEndpointInvalidate(pKvs);
+        /* Propagate the res error */
+    }
+    else if (!bDone)
+    {
+        /* nop */
+    }
+    else if ((res = prvPutMediaCheckStarted(pKvs, uHttpStatusCode)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (Lock(pKvs->xConnLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        pKvs->xPutMediaHandle = pKvs->xPendingPutMediaHandle;
+        pKvs->xPendingPutMediaHandle = NULL;
+        Unlock(pKvs->xConnLock);
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        prvPutMediaFinish(pKvs, pKvs->xPendingPutMediaHandle);
+        pKvs->xPendingPutMediaHandle = NULL;
+    }
+
+    return res;
+}
+
+static bool prvIsNextDataFrameCluster(KvsApp_t *pKvs)
+{
+    bool bIsCluster = false;
+    SpillRecordInfo_t xInfo = {0};
+    DataFrameHandle xDataFrameHandle = NULL;
+
+    if (!prvSpillIsEmpty(pKvs))
+    {
+        if (Lock(pKvs->xSpillLock) == LOCK_OK)
+        {
+            bIsCluster = (Kvs_spillPeekRecord(pKvs->xSpillHandle, &xInfo) == KVS_ERRNO_NONE && xInfo.xClusterType == MKV_CLUSTER);
+            Unlock(pKvs->xSpillLock);
+        }
+    }
+    else if ((xDataFrameHandle = Kvs_streamPeek(pKvs->xStreamHandle)) != NULL)
+    {
+        bIsCluster = (((DataFrameIn_t *)xDataFrameHandle)->xClusterType == MKV_CLUSTER);
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return bIsCluster;
+}
+
+static void prvPutMediaRotate(KvsApp_t *pKvs)
+{
+    uint64_t uNowMs = getMonotonicTimeInMs();
+    PutMediaHandle xOldPutMediaHandle = NULL;
+    bool bFailover = prvIsFailoverEnabled(pKvs);
+    bool bRotationDue = (pKvs->uPutMediaRotationMs > 0 && uNowMs >= pKvs->uNextStandbyTimestampMs);
+
+    if ((pKvs->uPutMediaRotationMs == 0 && !bFailover) || pKvs->xPutMediaHandle == NULL || !APP_ATOMIC_LOAD(&(pKvs->isEbmlHeaderUpdated)) ||
+        Kvs_replayIsPending(pKvs->xReplayHandle))
+    {
+        /* nop */
+    }
+    else if (pKvs->xStandbyPutMediaHandle == NULL)
+    {
+        /* The standby of failover is always kept open, and the one of rotation is opened when it's due. */
+        if ((bFailover || bRotationDue) && uNowMs >= pKvs->uStandbyRetryTimestampMs && prvPutMediaOpenStandby(pKvs) != KVS_ERRNO_NONE)
+        {
+            pKvs->uStandbyRetryTimestampMs = uNowMs + STANDBY_RETRY_INTERVAL_MS;
+        }
+    }
+    else if ((pKvs->bFailoverPending || bRotationDue) && prvIsNextDataFrameCluster(pKvs) && Lock(pKvs->xConnLock) == LOCK_OK)
+    {
+        /* The previous cluster is complete on the old connection, and the EBML header is sent again on the new one
+         * before the next cluster. */
+        if (bFailover)
+        {
+            LogInfo("Fail over to PUT MEDIA connection on interface %u", prvStandbyIfIndex(pKvs));
+            prvFailoverSwapInterface(pKvs);
+        }
+        else
+        {
+            LogInfo("Switch to standby PUT MEDIA connection");
+        }
+        xOldPutMediaHandle = pKvs->xPutMediaHandle;
+        pKvs->xPutMediaHandle = pKvs->xStandbyPutMediaHandle;
+        pKvs->xStandbyPutMediaHandle = NULL;
+        APP_ATOMIC_STORE(&(pKvs->isEbmlHeaderUpdated), false);
+        pKvs->uNextStandbyTimestampMs = uNowMs + pKvs->uPutMediaRotationMs;
+        Unlock(pKvs->xConnLock);
+
+        prvPutMediaFinish(pKvs, xOldPutMediaHandle);
+    }
+    else
+    {
+        /* nop */
+    }
+}
+
+static size_t prvStreamMemTotal(KvsApp_t *pKvs)
+{
+    size_t uMemTotal = 0;
+
+    if (pKvs->xStreamHandle == NULL || Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotal) != KVS_ERRNO_NONE)
+    {
+        uMemTotal = 0;
+    }
+
+    return uMemTotal;
+}
+
+static void prvPacingFollowUplink(KvsApp_t *pKvs)
+{
+    uint64_t uRateBps = (uint64_t)pKvs->uUplinkBps * (100 + PACING_UPLINK_HEADROOM_PERCENT) / 100;
+
+    if (pKvs->xPutMediaPara.uPacingRateBps != 0 && uRateBps > pKvs->xPutMediaPara.uPacingRateBps)
+    {
+        uRateBps = pKvs->xPutMediaPara.uPacingRateBps;
+    }
+    uRateBps = (uRateBps > UINT_MAX) ? UINT_MAX : uRateBps;
+
+    if (pKvs->xPutMediaHandle != NULL && uRateBps > 0)
+    {
+        Kvs_putMediaUpdatePacing(pKvs->xPutMediaHandle, (unsigned int)uRateBps, pKvs->xPutMediaPara.uPacingBurstBytes);
+    }
+}
+
+static void prvBitrateEstimatorUpdate(KvsApp_t *pKvs)
+{
+    uint64_t uNowMs = getMonotonicTimeInMs();
+    uint64_t uElapsedMs = uNowMs - pKvs->uBitrateWindowStartMs;
+    size_t uMemTotal = 0;
+    bool bCongested = false;
+    uint64_t uSampleBps = 0;
+    uint64_t uLinkBps = 0;
+    uint32_t uHintBps = 0;
+
+    if (pKvs->uBitrateHintIntervalMs > 0 && uElapsedMs >= pKvs->uBitrateHintIntervalMs)
+    {
+        uMemTotal = prvStreamMemTotal(pKvs);
+        bCongested = (uMemTotal > pKvs->uBitrateWindowStartMemTotal || !prvSpillIsEmpty(pKvs));
+
+        if (pKvs->uBitrateWindowSentBytes > 0 || bCongested)
+        {
+            /* When data is piling up, what went through is all the link can take. Otherwise the link may take more,
+             * and the time blocked in sending tells how much. It probes up to twice the throughput in an interval. */
+            uSampleBps = pKvs->uBitrateWindowSentBytes * 8 * 1000 / uElapsedMs;
+            if (!bCongested && pKvs->uBitrateWindowSendTimeMs > 0)
+            {
+                uLinkBps = pKvs->uBitrateWindowSentBytes * 8 * 1000 / pKvs->uBitrateWindowSendTimeMs;
+                uLinkBps = (uLinkBps > uSampleBps * 2) ? uSampleBps * 2 : uLinkBps;
+                uSampleBps = (uLinkBps > uSampleBps) ? uLinkBps : uSampleBps;
+            }
+            uSampleBps = (uSampleBps > UINT32_MAX) ? UINT32_MAX : uSampleBps;
+
+            /* Drop quickly on congestion, and recover slowly. */
+            if (pKvs->uUplinkBps == 0)
+            {
+                pKvs->uUplinkBps = (uint32_t)uSampleBps;
+            }
+            else if (bCongested)
+            {
+                pKvs->uUplinkBps = (uint32_t)(((uint64_t)pKvs->uUplinkBps + uSampleBps) / 2);
+            }
+            else
+            {
+                pKvs->uUplinkBps = (uint32_t)(((uint64_t)pKvs->uUplinkBps * 3 + uSampleBps) / 4);
+            }
+
+            if (pKvs->bPacingFollowsUplink)
+            {
+                prvPacingFollowUplink(pKvs);
+            }
+
+            if (pKvs->onBitrateHintCallbackInfo.onBitrateHint != NULL)
+            {
+                uHintBps = (uint32_t)((uint64_t)pKvs->uUplinkBps * (100 - (bCongested ? BITRATE_HINT_CONGESTED_HEADROOM_PERCENT : BITRATE_HINT_HEADROOM_PERCENT)) / 100);
+                pKvs->onBitrateHintCallbackInfo.onBitrateHint(uHintBps, pKvs->onBitrateHintCallbackInfo.pAppData);
+            }
+        }
+
+        pKvs->uBitrateWindowStartMs = uNowMs;
+        pKvs->uBitrateWindowStartMemTotal = uMemTotal;
+        pKvs->uBitrateWindowSentBytes = 0;
+        pKvs->uBitrateWindowSendTimeMs = 0;
+    }
+}
+
+static bool prvIsSendBudgetAvailable(KvsApp_t *pKvs, size_t uSentFrames, size_t uSentBytes)
+{
+    size_t uFrameBudget = pKvs->uSendFrameBudget;
+
+    /* At least one of the budgets has to be set, or a live stream would keep doWork busy forever. */
+    if (uFrameBudget == 0 && pKvs->uSendByteBudget == 0)
+    {
+        uFrameBudget = DEFAULT_SEND_FRAME_BUDGET;
+    }
+
+    return (uFrameBudget == 0 || uSentFrames < uFrameBudget) && (pKvs->uSendByteBudget == 0 || uSentBytes < pKvs->uSendByteBudget);
+}
+
+/**
+ * @brief Check if data frames can be sent. In burst mode, a burst starts once it's due and lasts until the stream is
+ * drained, so the radio is busy in bursts instead of all the time.
+ */
+static bool prvIsBurstDue(KvsApp_t *pKvs)
+{
+    bool bIsDue = true;
+    size_t uMemTotal = 0;
+
+    if ((pKvs->uBurstIntervalMs > 0 || pKvs->uBurstBytes > 0) && !(pKvs->bBursting))
+    {
+        bIsDue = (pKvs->uBurstIntervalMs > 0 && getMonotonicTimeInMs() >= pKvs->uLastBurstMs + pKvs->uBurstIntervalMs) ||
+                 (pKvs->uBurstBytes > 0 && Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotal) == KVS_ERRNO_NONE && uMemTotal >= pKvs->uBurstBytes);
+        pKvs->bBursting = bIsDue;
+    }
+
+    return bIsDue;
+}
+
+static void prvBurstFinish(KvsApp_t *pKvs)
+{
+    if (pKvs->bBursting)
+    {
+        pKvs->bBursting = false;
+        pKvs->uLastBurstMs = getMonotonicTimeInMs();
+    }
+}
+
+static int prvPutMediaDoWorkDefault(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    int xSendCnt = 0;
+    size_t uSendLen = 0;
+    size_t uSentFrames = 0;
+    size_t uSentBytes = 0;
+    uint64_t uSendStartMs = 0;
+    uint64_t uFrameSendStartMs = 0;
+    uint64_t uNowMs = 0;
+
+    do
+    {
+        if (pKvs->xPendingPutMediaHandle != NULL &&
+            ((res = prvPutMediaPollPending(pKvs)) != KVS_ERRNO_NONE || pKvs->xPendingPutMediaHandle != NULL))
+        {
+            /* Propagate the res error, or wait until the connection is established. */
+            break;
+        }
+
+        prvPutMediaRotate(pKvs);
+
+        if ((res = updateEbmlHeader(pKvs)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+            break;
+        }
+
+        if ((res = Kvs_putMediaDoWork(pKvs->xPutMediaHandle)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+            break;
+        }
+
+        prvCatchUpCollect(pKvs);
+        if (pKvs->uLatencyDropMs > 0)
+        {
+            prvStreamSkipStaleFrames(pKvs);
+        }
+
+        /* Keep sending data frames until the budget runs out or there is nothing to send, so a backlog is drained at
+         * the rate of the link instead of the rate of doWork calls. */
+        uSendStartMs = getMonotonicTimeInMs();
+        uFrameSendStartMs = uSendStartMs;
+        while (prvIsBurstDue(pKvs) && prvIsSendBudgetAvailable(pKvs, uSentFrames, uSentBytes))
+        {
+            if ((res = prvPutMediaSendData(pKvs, &xSendCnt, &uSendLen, false)) != KVS_ERRNO_NONE || xSendCnt == 0)
+            {
+                break;
+            }
+            uSentFrames += (size_t)xSendCnt;
+            uSentBytes += uSendLen;
+            uNowMs = getMonotonicTimeInMs();
+            prvFailoverCheckSendLatency(pKvs, uNowMs - uFrameSendStartMs);
+            uFrameSendStartMs = uNowMs;
+        }
+        if (res == KVS_ERRNO_NONE && xSendCnt == 0)
+        {
+            /* The stream is drained. A burst that fails goes on after reconnection. */
+            prvBurstFinish(pKvs);
+        }
+        prvCatchUpDoWork(pKvs);
+
+        if (uSentFrames > 0)
+        {
+            pKvs->uBitrateWindowSentBytes += uSentBytes;
+            pKvs->uBitrateWindowSendTimeMs += getMonotonicTimeInMs() - uSendStartMs;
+        }
+        prvBitrateEstimatorUpdate(pKvs);
+    } while (false);
+
+    if (res != KVS_ERRNO_NONE && prvIsFailoverEnabled(pKvs))
+    {
+        /* The active interface is likely down, so the application reconnects on the other one. */
+        LogInfo("PUT MEDIA failed, reconnect on interface %u", prvStandbyIfIndex(pKvs));
+        prvFailoverSwapInterface(pKvs);
+    }
+
+    if (uSentFrames == 0 && pKvs->xSharedWakeEvent == NULL)
+    {
+        /* Wait for the next data frame, or for an ack, which is read by the next Kvs_putMediaDoWork(). */
+        kvsEventWaitSocket(pKvs->xWakeEvent, Kvs_putMediaGetSocket(pKvs->xPutMediaHandle), pKvs->uWaitTimeoutMs);
+    }
+
+    return res;
+}
+
+static int prvPutMediaDoWorkSendEndOfFrames(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    int xSendCnt = 0;
+
+    do
+    {
+        if ((res = updateEbmlHeader(pKvs)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+            break;
+        }
+
+        if ((res = Kvs_putMediaDoWork(pKvs->xPutMediaHandle)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+            break;
+        }
+
+        if ((res = prvPutMediaSendData(pKvs, &xSendCnt, NULL, true)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+            break;
+        }
+    } while (xSendCnt > 0);
+
+    return res;
+}
+
+KvsAppHandle KvsApp_create(const char *pcHost, const char *pcRegion, const char *pcService, const char *pcStreamName)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = NULL;
+
+    if (pcHost == NULL || pcRegion == NULL || pcService == NULL || pcStreamName == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid parameter");
+    }
+    else if ((pKvs = (KvsApp_t *)kvsMallocClass(sizeof(KvsApp_t), KVS_ALLOC_CLASS_METADATA)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pKvs");
+    }
+    else
+    {
+        memset(pKvs, 0, sizeof(KvsApp_t));
+
+        if ((pKvs->xConnLock = Lock_Init()) == NULL || (pKvs->xTrackLock = Lock_Init()) == NULL)
+        {
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to init lock");
+        }
+        else if ((pKvs->xWakeEvent = kvsEventCreate()) == NULL)
+        {
+            res = KVS_ERROR_EVENT_ERROR;
+            LogError("Failed to create event");
+        }
+        else if ((pKvs->xLatencyLock = Lock_Init()) == NULL || (pKvs->xMetricsLock = Lock_Init()) == NULL || (pKvs->xSnapshotLock = Lock_Init()) == NULL)
+        {
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to init lock");
+        }
+#if KVS_CONFIG_AUDIO
+        else if ((pKvs->xAudioLaceLock = Lock_Init()) == NULL)
+        {
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to init lock");
+        }
+#endif
+        else if ((pKvs->xLatencyTracker = Kvs_latencyTrackerCreate()) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: xLatencyTracker");
+        }
+        else if ((pKvs->xPutMediaPara.xReqTemplate = Kvs_putMediaTemplateCreate()) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: xReqTemplate");
+        }
+        else if (
+            (res = prvMallocAndStrcpyHelper(&(pKvs->pHost), pcHost)) != KVS_ERRNO_NONE ||
+            (res = prvMallocAndStrcpyHelper(&(pKvs->pRegion), pcRegion)) != KVS_ERRNO_NONE ||
+            (res = prvMallocAndStrcpyHelper(&(pKvs->pService), pcService)) != KVS_ERRNO_NONE ||
+            (res = prvMallocAndStrcpyHelper(&(pKvs->pStreamName), pcStreamName)) != KVS_ERRNO_NONE)
+        {
+            LogError("OOM: parameters");
+            /* Propagate the res error */
+        }
+        else
+        {
+            pKvs->pDataEndpoint = NULL;
+            pKvs->pPort = NULL;
+            pKvs->pAwsAccessKeyId = NULL;
+            pKvs->pAwsSecretAccessKey = NULL;
+            pKvs->pIotCredentialHost = NULL;
+            pKvs->pIotRoleAlias = NULL;
+            pKvs->pIotThingName = NULL;
+            pKvs->pIotX509RootCa = NULL;
+            pKvs->pIotX509Certificate = NULL;
+            pKvs->pIotX509PrivateKey = NULL;
+            pKvs->pToken = NULL;
+
+            pKvs->uDataRetentionInHours = DEFAULT_DATA_RETENTION_IN_HOURS;
+
+            pKvs->uEarliestTimestamp = 0;
+            pKvs->xStreamHandle = NULL;
+            pKvs->xPutMediaHandle = NULL;
+            pKvs->isEbmlHeaderUpdated = false;
+            pKvs->xStrategy.xPolicy = STREAM_POLICY_NONE;
+            pKvs->uFrameSlabSize = DEFAULT_FRAME_SLAB_SIZE;
+            pKvs->uIngestRingSize = DEFAULT_INGEST_RING_SIZE;
+            pKvs->pSpillFilename = NULL;
+            pKvs->uSpillFileSize = 0;
+            pKvs->uSpillMemLimit = DEFAULT_SPILL_MEM_LIMIT;
+            pKvs->xSpillHandle = NULL;
+            pKvs->bSpillSkipToCluster = false;
+            pKvs->pCheckpointFilename = NULL;
+            pKvs->uCheckpointIntervalMs = DEFAULT_CHECKPOINT_INTERVAL_MS;
+            pKvs->uReplayBufSize = DEFAULT_REPLAY_BUFFER_SIZE;
+            pKvs->xReplayHandle = NULL;
+            pKvs->pRecorderFilePrefix = NULL;
+            pKvs->uRecorderFileDurationMs = DEFAULT_RECORDER_FILE_DURATION_MS;
+            pKvs->uRecorderWriteBufSize = DEFAULT_RECORDER_WRITE_BUF_SIZE;
+            pKvs->xRecorderHandle = NULL;
+            pKvs->uSendFrameBudget = DEFAULT_SEND_FRAME_BUDGET;
+            pKvs->uSendByteBudget = DEFAULT_SEND_BYTE_BUDGET;
+            pKvs->uBurstIntervalMs = 0;
+            pKvs->uBurstBytes = 0;
+            pKvs->bBursting = false;
+            pKvs->uLastBurstMs = 0;
+            pKvs->uWaitTimeoutMs = DEFAULT_WAIT_TIMEOUT_MS;
+#if KVS_CONFIG_AUDIO
+            pKvs->uAudioLaceDurationMs = DEFAULT_AUDIO_LACE_DURATION_MS;
+#endif
+            pKvs->uPutMediaRotationMs = DEFAULT_PUT_MEDIA_ROTATION_MS;
+            pKvs->uDataEndpointTtlMs = DEFAULT_DATA_ENDPOINT_TTL_MS;
+            pKvs->uDataEndpointExpirationMs = 0;
+            pKvs->xStandbyPutMediaHandle = NULL;
+            pKvs->bAsyncOpen = false;
+            pKvs->xPendingPutMediaHandle = NULL;
+            pKvs->bFastOpen = false;
+            pKvs->uPrerollDurationMs = 0;
+            pKvs->bPrerollDone = false;
+            pKvs->uCatchUpThresholdMs = 0;
+            pKvs->uCatchUpRateBps = 0;
+            pKvs->pxCatchUpHead = NULL;
+            pKvs->pxCatchUpTail = NULL;
+            pKvs->xCatchUpPutMediaHandle = NULL;
+            pKvs->uBitrateHintIntervalMs = DEFAULT_BITRATE_HINT_INTERVAL_MS;
+            pKvs->uBitrateWindowStartMs = getMonotonicTimeInMs();
+            pKvs->uBitrateWindowStartMemTotal = 0;
+            pKvs->uBitrateWindowSentBytes = 0;
+            pKvs->uBitrateWindowSendTimeMs = 0;
+            pKvs->uUplinkBps = 0;
+            pKvs->bKeyframeSnapshot = false;
+            pKvs->pxSnapshot = NULL;
+            pKvs->bAudioOnly = false;
+            pKvs->uAudioMaxLatencyMs = 0;
+            pKvs->uInterleaveWindowMs = 0;
+
+            pKvs->pVideoTrackInfo = NULL;
+            pKvs->xVideoCodec = VIDEO_CODEC_H264;
+            pKvs->xVideoFormat = VIDEO_FORMAT_AUTO;
+            pKvs->isAudioTrackPresent = false;
+            pKvs->pAudioTrackInfo = NULL;
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        KvsApp_terminate(pKvs);
+        pKvs = NULL;
+    }
+
+    return (KvsAppHandle)pKvs;
+}
+
+void KvsApp_terminate(KvsAppHandle handle)
+{
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs != NULL && pKvs->xWorkerThread != NULL)
+    {
+        KvsApp_stopWorker(handle);
+    }
+
+    if (pKvs != NULL && Lock(pKvs->xConnLock) == LOCK_OK)
+    {
+        prvCatchUpDisconnect(pKvs);
+        prvCatchUpFlush(pKvs);
+        if (pKvs->xStreamHandle != NULL)
+        {
+            prvStreamFlush(pKvs);
+            Kvs_streamTermintate(pKvs->xStreamHandle);
+            pKvs->xStreamHandle = NULL;
+        }
+        /* Readers must have released their snapshots, so this is the last reference. */
+        prvKeyframeSnapshotRelease(pKvs->pxSnapshot);
+        pKvs->pxSnapshot = NULL;
+        prvSpillTerminate(pKvs);
+        prvCheckpointSaveIfDue(pKvs, true);
+        Kvs_replayTerminate(pKvs->xReplayHandle);
+        pKvs->xReplayHandle = NULL;
+        Kvs_recorderTerminate(pKvs->xRecorderHandle);
+        pKvs->xRecorderHandle = NULL;
+        if (pKvs->pRecorderFilePrefix != NULL)
+        {
+            kvsFree(pKvs->pRecorderFilePrefix);
+            pKvs->pRecorderFilePrefix = NULL;
+        }
+#if KVS_CONFIG_AUDIO
+        /* Audio frames in a lace that is not added yet are dropped. */
+        kvsFree(pKvs->xAudioLace.pBuf);
+        memset(&(pKvs->xAudioLace), 0, sizeof(AudioLace_t));
+#endif
+        if (pKvs->pSpillFilename != NULL)
+        {
+            kvsFree(pKvs->pSpillFilename);
+            pKvs->pSpillFilename = NULL;
+        }
+        if (pKvs->pCheckpointFilename != NULL)
+        {
+            kvsFree(pKvs->pCheckpointFilename);
+            pKvs->pCheckpointFilename = NULL;
+        }
+        if (pKvs->pHost != NULL)
+        {
+            kvsFree(pKvs->pHost);
+            pKvs->pHost = NULL;
+        }
+        if (pKvs->pRegion != NULL)
+        {
+            kvsFree(pKvs->pRegion);
+            pKvs->pRegion = NULL;
+        }
+        if (pKvs->pService != NULL)
+        {
+            kvsFree(pKvs->pService);
+            pKvs->pService = NULL;
+        }
+        if (pKvs->pStreamName != NULL)
+        {
+            kvsFree(pKvs->pStreamName);
+            pKvs->pStreamName = NULL;
+        }
+        if (pKvs->pDataEndpoint != NULL)
+        {
+            kvsFree(pKvs->pDataEndpoint);
+            pKvs->pDataEndpoint = NULL;
+        }
+        if (pKvs->pPort != NULL)
+        {
+            kvsFree(pKvs->pPort);
+            pKvs->pPort = NULL;
+        }
+        if (pKvs->pAwsAccessKeyId != NULL)
+        {
+            kvsFree(pKvs->pAwsAccessKeyId);
+            pKvs->pAwsAccessKeyId = NULL;
+        }
+        if (pKvs->pAwsSecretAccessKey != NULL)
+        {
+            kvsFree(pKvs->pAwsSecretAccessKey);
+            pKvs->pAwsSecretAccessKey = NULL;
+        }
+        if (pKvs->pAwsSessionToken != NULL)
+        {
+            kvsFree(pKvs->pAwsSessionToken);
+            pKvs->pAwsSessionToken = NULL;
+        }
+        if (pKvs->pIotCredentialHost != NULL)
+        {
+            kvsFree(pKvs->pIotCredentialHost);
+            pKvs->pIotCredentialHost = NULL;
+        }
+        if (pKvs->pIotRoleAlias != NULL)
+        {
+            kvsFree(pKvs->pIotRoleAlias);
+            pKvs->pIotRoleAlias = NULL;
+        }
+        if (pKvs->pIotThingName != NULL)
+        {
+            kvsFree(pKvs->pIotThingName);
+            pKvs->pIotThingName = NULL;
+        }
+        if (pKvs->pIotX509RootCa != NULL)
+        {
+            kvsFree(pKvs->pIotX509RootCa);
+            pKvs->pIotX509RootCa = NULL;
+        }
+        if (pKvs->pIotX509Certificate != NULL)
+        {
+            kvsFree(pKvs->pIotX509Certificate);
+            pKvs->pIotX509Certificate = NULL;
+        }
+        if (pKvs->pIotX509PrivateKey != NULL)
+        {
+            kvsFree(pKvs->pIotX509PrivateKey);
+            pKvs->pIotX509PrivateKey = NULL;
+        }
+        if (pKvs->pVideoTrackInfo != NULL)
+        {
+            prvVideoTrackInfoTerminate(pKvs->pVideoTrackInfo);
+        }
+        if (pKvs->pNextVideoTrackInfo != NULL)
+        {
+            prvVideoTrackInfoTerminate(pKvs->pNextVideoTrackInfo);
+        }
+#if KVS_CONFIG_AUDIO
+        if (pKvs->pAudioTrackInfo != NULL)
+        {
+            prvAudioTrackInfoTerminate(pKvs->pAudioTrackInfo);
+        }
+#endif
+        if (pKvs->pSps != NULL)
+        {
+            kvsFree(pKvs->pSps);
+            pKvs->pSps = NULL;
+        }
+        if (pKvs->pVps != NULL)
+        {
+            kvsFree(pKvs->pVps);
+            pKvs->pVps = NULL;
+        }
+        if (pKvs->pPps != NULL)
+        {
+            kvsFree(pKvs->pPps);
+            pKvs->pPps = NULL;
+        }
+
+        Unlock(pKvs->xConnLock);
+
+        Lock_Deinit(pKvs->xConnLock);
+        if (pKvs->xTrackLock != NULL)
+        {
+            Lock_Deinit(pKvs->xTrackLock);
+        }
+
+        if (pKvs->xWakeEvent != NULL)
+        {
+            kvsEventTerminate(pKvs->xWakeEvent);
+        }
+
+        if (pKvs->xLatencyLock != NULL)
+        {
+            Lock_Deinit(pKvs->xLatencyLock);
+        }
+        if (pKvs->xMetricsLock != NULL)
+        {
+            Lock_Deinit(pKvs->xMetricsLock);
+        }
+        if (pKvs->xSnapshotLock != NULL)
+        {
+            Lock_Deinit(pKvs->xSnapshotLock);
+        }
+#if KVS_CONFIG_AUDIO
+        if (pKvs->xAudioLaceLock != NULL)
+        {
+            Lock_Deinit(pKvs->xAudioLaceLock);
+        }
+#endif
+        Kvs_latencyTrackerTerminate(pKvs->xLatencyTracker);
+        Kvs_putMediaTemplateTerminate(pKvs->xPutMediaPara.xReqTemplate);
+
+        memset(pKvs, 0, sizeof(KvsApp_t));
+        kvsFree(pKvs);
+    }
+}
+
+static bool prvIsSizeOption(KvsApp_optionId_t xOptionId)
+{
+    return xOptionId == KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT || xOptionId == KVS_APP_OPTION_STREAM_SEND_FRAME_BUDGET ||
+           xOptionId == KVS_APP_OPTION_STREAM_SEND_BYTE_BUDGET || xOptionId == KVS_APP_OPTION_STREAM_BURST_BYTES;
+}
+
+static int prvSetOptionIntLocked(KvsApp_t *pKvs, KvsApp_optionId_t xOptionId, int64_t iValue)
+{
+    int res = KVS_ERRNO_NONE;
+    unsigned int uValue = (unsigned int)iValue;
+
+    switch (xOptionId)
+    {
+        case KVS_APP_OPTION_STREAM_POLICY:
+            if (iValue < STREAM_POLICY_NONE || iValue >= STREAM_POLICY_MAX)
+            {
+                LogError("Invalid policy val: %d", (int)iValue);
+                res = KVS_ERROR_INVALID_STREAM_POLICY;
+            }
+            else if (!KVS_CONFIG_RING_BUFFER_POLICY && iValue == STREAM_POLICY_RING_BUFFER)
+            {
+                LogError("Ring buffer policy is not enabled");
+                res = KVS_ERROR_FEATURE_NOT_ENABLED;
+            }
+            else
+            {
+                pKvs->xStrategy.xPolicy = (KvsApp_streamPolicy_t)iValue;
+                if (pKvs->xStrategy.xPolicy == STREAM_POLICY_RING_BUFFER)
+                {
+                    pKvs->xStrategy.xRingBufferPara.uMemLimit = DEFAULT_RING_BUFFER_MEM_LIMIT;
+                    pKvs->xStrategy.xRingBufferPara.bDropNonRefFrames = false;
+                    pKvs->xStrategy.xRingBufferPara.bDropAudioFrames = false;
+                }
+                else if (pKvs->xStrategy.xPolicy == STREAM_POLICY_TIME_WINDOW)
+                {
+                    pKvs->xStrategy.xTimeWindowPara.uTimeWindowMs = DEFAULT_TIME_WINDOW_MS;
+                }
+            }
+            break;
+        case KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT:
+        case KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_DROP_NON_REF_FRAMES:
+        case KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_DROP_AUDIO_FRAMES:
+            if (!KVS_CONFIG_RING_BUFFER_POLICY)
+            {
+                res = KVS_ERROR_FEATURE_NOT_ENABLED;
+                LogError("Ring buffer policy is not enabled");
+            }
+            else if (pKvs->xStrategy.xPolicy != STREAM_POLICY_RING_BUFFER)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set parameter to policy: %d ", (int)(pKvs->xStrategy.xPolicy));
+            }
+            else if (xOptionId == KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT)
+            {
+                pKvs->xStrategy.xRingBufferPara.uMemLimit = (size_t)iValue;
+            }
+            else if (xOptionId == KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_DROP_NON_REF_FRAMES)
+            {
+                pKvs->xStrategy.xRingBufferPara.bDropNonRefFrames = (iValue != 0);
+            }
+            else
+            {
+                pKvs->xStrategy.xRingBufferPara.bDropAudioFrames = (iValue != 0);
+            }
+            break;
+        case KVS_APP_OPTION_STREAM_POLICY_TIME_WINDOW_MS:
+            if (pKvs->xStrategy.xPolicy != STREAM_POLICY_TIME_WINDOW)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set parameter to policy: %d ", (int)(pKvs->xStrategy.xPolicy));
+            }
+            else
+            {
+                pKvs->xStrategy.xTimeWindowPara.uTimeWindowMs = uValue;
+            }
+            break;
+        case KVS_APP_OPTION_STREAM_LATENCY_DROP_MS:
+            pKvs->uLatencyDropMs = uValue;
+            break;
+        case KVS_APP_OPTION_STREAM_SEND_FRAME_BUDGET:
+            pKvs->uSendFrameBudget = (size_t)iValue;
+            break;
+        case KVS_APP_OPTION_STREAM_SEND_BYTE_BUDGET:
+            pKvs->uSendByteBudget = (size_t)iValue;
+            break;
+        case KVS_APP_OPTION_STREAM_BURST_INTERVAL_MS:
+            pKvs->uBurstIntervalMs = uValue;
+            break;
+        case KVS_APP_OPTION_STREAM_BURST_BYTES:
+            pKvs->uBurstBytes = (size_t)iValue;
+            break;
+        case KVS_APP_OPTION_STREAM_WAIT_TIMEOUT_MS:
+            pKvs->uWaitTimeoutMs = uValue;
+            break;
+        case KVS_APP_OPTION_STREAM_AUDIO_LACE_DURATION_MS:
+#if KVS_CONFIG_AUDIO
+            /* A pending lace is added with the next data frame if it's past the new duration. */
+            pKvs->uAudioLaceDurationMs = uValue;
+#else
+            res = KVS_ERROR_FEATURE_NOT_ENABLED;
+            LogError("Audio is not enabled");
+#endif
+            break;
+        case KVS_APP_OPTION_STREAM_MAX_FRAGMENT_DURATION_MS:
+            pKvs->uMaxFragmentDurationMs = uValue;
+            break;
+        case KVS_APP_OPTION_STREAM_INTERLEAVE_WINDOW_MS:
+            pKvs->uInterleaveWindowMs = uValue;
+            break;
+        case KVS_APP_OPTION_STREAM_AUDIO_MAX_LATENCY_MS:
+#if KVS_CONFIG_AUDIO
+            pKvs->uAudioMaxLatencyMs = uValue;
+#else
+            res = KVS_ERROR_FEATURE_NOT_ENABLED;
+            LogError("Audio is not enabled");
+#endif
+            break;
+        case KVS_APP_OPTION_KVS_BITRATE_HINT_INTERVAL_MS:
+            pKvs->uBitrateHintIntervalMs = uValue;
+            break;
+        case KVS_APP_OPTION_NETIO_STREAMING_RECV_TIMEOUT:
+            pKvs->xPutMediaPara.uRecvTimeoutMs = uValue;
+
+            /* Try to update receive timeout if it's already streaming. */
+            Kvs_putMediaUpdateRecvTimeout(pKvs->xPutMediaHandle, uValue);
+            break;
+        case KVS_APP_OPTION_NETIO_STREAMING_SEND_TIMEOUT:
+            pKvs->xPutMediaPara.uSendTimeoutMs = uValue;
+
+            /* Try to update send timeout if it's already streaming. */
+            Kvs_putMediaUpdateSendTimeout(pKvs->xPutMediaHandle, uValue);
+            break;
+        case KVS_APP_OPTION_NETIO_PACING_RATE_BPS:
+        case KVS_APP_OPTION_NETIO_PACING_BURST_BYTES:
+            if (xOptionId == KVS_APP_OPTION_NETIO_PACING_RATE_BPS)
+            {
+                pKvs->xPutMediaPara.uPacingRateBps = uValue;
+            }
+            else
+            {
+                pKvs->xPutMediaPara.uPacingBurstBytes = uValue;
+            }
+
+            /* Pacing that follows the uplink is capped by the new rate at the next estimate. */
+            if (!pKvs->bPacingFollowsUplink)
+            {
+                Kvs_putMediaUpdatePacing(pKvs->xPutMediaHandle, pKvs->xPutMediaPara.uPacingRateBps, pKvs->xPutMediaPara.uPacingBurstBytes);
+            }
+            break;
+        case KVS_APP_OPTION_NETIO_PACING_FOLLOWS_UPLINK:
+            pKvs->bPacingFollowsUplink = (iValue != 0);
+            break;
+        default:
+            res = KVS_ERROR_INVALID_ARGUMENT;
+            LogError("Not an integer option: %d", (int)xOptionId);
+            break;
+    }
+
+    return res;
+}
+
+/**
+ * @brief Set an integer option with xConnLock, which is shared by KvsApp_setoption() and KvsApp_setOptionInt().
+ */
+static int prvSetOptionInt(KvsApp_t *pKvs, KvsApp_optionId_t xOptionId, int64_t iValue)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (xOptionId != KVS_APP_OPTION_STREAM_POLICY &&
+        (iValue < 0 || (prvIsSizeOption(xOptionId) ? ((uint64_t)iValue > SIZE_MAX) : ((uint64_t)iValue > UINT_MAX))))
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Value out of range of option: %d", (int)xOptionId);
+    }
+    else if (Lock(pKvs->xConnLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        res = prvSetOptionIntLocked(pKvs, xOptionId, iValue);
+        Unlock(pKvs->xConnLock);
+    }
+
+    return res;
+}
+
+int KvsApp_setoption(KvsAppHandle handle, const char *pcOptionName, const char *pValue)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL || pcOptionName == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        if (strcmp(pcOptionName, (const char *)OPTION_AWS_ACCESS_KEY_ID) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pAwsAccessKeyId), pValue)) != 0)
+            {
+                LogError("Failed to set pAwsAccessKeyId");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_AWS_SECRET_ACCESS_KEY) == 0)
+        {
+            if (prvMallocAndStrcpyHelper(&(pKvs->pAwsSecretAccessKey), pValue) != 0)
+            {
+                LogError("Failed to set pAwsSecretAccessKey");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_AWS_SESSION_TOKEN) == 0)
+        {
+            if (pValue == NULL)
+            {
+                if (pKvs->pAwsSessionToken != NULL)
+                {
+                    kvsFree(pKvs->pAwsSessionToken);
+                }
+                pKvs->pAwsSessionToken = NULL;
+            }
+            else if ((res = prvMallocAndStrcpyHelper(&(pKvs->pAwsSessionToken), pValue)) != 0)
+            {
+                LogError("Failed to set pAwsSessionToken");
+                /* Propagate the res error */
+            }
+        }
+#if KVS_CONFIG_IOT_CREDENTIAL
+        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_CREDENTIAL_HOST) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotCredentialHost), pValue)) != 0)
+            {
+                LogError("Failed to set pIotX509RootCa");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_ROLE_ALIAS) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotRoleAlias), pValue)) != 0)
+            {
+                LogError("Failed to set pIotX509RootCa");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_THING_NAME) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotThingName), pValue)) != 0)
+            {
+                LogError("Failed to set pIotX509RootCa");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_X509_ROOTCA) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotX509RootCa), pValue)) != 0)
+            {
+                LogError("Failed to set pIotX509RootCa");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_X509_CERT) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotX509Certificate), pValue)) != 0)
+            {
+                LogError("Failed to set pIotX509Certificate");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_IOT_X509_KEY) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pIotX509PrivateKey), pValue)) != 0)
+            {
+                LogError("Failed to set pIotX509PrivateKey");
+                /* Propagate the res error */
+            }
+        }
+#endif /* KVS_CONFIG_IOT_CREDENTIAL */
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_DATA_RETENTION_IN_HOURS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value for KVS data retention in hours");
+            }
+            else
+            {
+                pKvs->uDataRetentionInHours = *((unsigned int *)(pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_VIDEO_TRACK_INFO) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to KVS video track info");
+            }
+            else if ((pKvs->pVideoTrackInfo = prvCopyVideoTrackInfo((VideoTrackInfo_t *)pValue)) == NULL)
+            {
+                res = KVS_ERROR_OUT_OF_MEMORY;
+                LogError("failed to copy video track info");
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_VIDEO_CODEC) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to KVS video codec");
+            }
+            else if (*((KvsApp_videoCodec_t *)pValue) < VIDEO_CODEC_H264 || *((KvsApp_videoCodec_t *)pValue) >= VIDEO_CODEC_MAX)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid video codec val: %d", *((KvsApp_videoCodec_t *)pValue));
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set video codec after stream is created");
+            }
+            else
+            {
+                pKvs->xVideoCodec = *((KvsApp_videoCodec_t *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_VIDEO_FORMAT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to KVS video format");
+            }
+            else if (*((KvsApp_videoFormat_t *)pValue) < VIDEO_FORMAT_AUTO || *((KvsApp_videoFormat_t *)pValue) >= VIDEO_FORMAT_MAX)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid video format val: %d", *((KvsApp_videoFormat_t *)pValue));
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set video format after stream is created");
+            }
+            else
+            {
+                pKvs->xVideoFormat = *((KvsApp_videoFormat_t *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_NALU_FILTER_MASK) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to NALU filter mask");
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set NALU filter mask after stream is created");
+            }
+            else
+            {
+                pKvs->uNaluFilterMask = *((uint64_t *)pValue);
+            }
+        }
+#if KVS_CONFIG_AUDIO
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_AUDIO_TRACK_INFO) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to KVS audio track info");
+            }
+            else if ((pKvs->pAudioTrackInfo = prvCopyAudioTrackInfo((AudioTrackInfo_t *)pValue)) == NULL)
+            {
+                res = KVS_ERROR_OUT_OF_MEMORY;
+                LogError("failed to copy audio track info");
+            }
+        }
+#endif /* KVS_CONFIG_AUDIO */
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_DATA_ENDPOINT) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pDataEndpoint), pValue)) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed to set data endpoint");
+                /* Propagate the res error */
+            }
+            else
+            {
+                pKvs->xServicePara.pcPutMediaEndpoint = pKvs->pDataEndpoint;
+                pKvs->uDataEndpointExpirationMs = (pKvs->uDataEndpointTtlMs == 0) ? 0 : getMonotonicTimeInMs() + pKvs->uDataEndpointTtlMs;
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_PORT) == 0)
+        {
+            if ((res = prvMallocAndStrcpyHelper(&(pKvs->pPort), pValue)) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed to set port");
+                /* Propagate the res error */
+            }
+
+            /* The old port may have been freed even if it fails. */
+            pKvs->xServicePara.pcPort = pKvs->pPort;
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_BITRATE_HINT_INTERVAL_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to bitrate hint interval");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_KVS_BITRATE_HINT_INTERVAL_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_REPLAY_BUFFER_SIZE) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to replay buffer size");
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set replay buffer size after stream is created");
+            }
+            else
+            {
+                pKvs->uReplayBufSize = *((size_t *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_RECORDER_FILE_PREFIX) == 0)
+        {
+            if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set recorder file prefix after stream is created");
+            }
+            else if ((res = prvMallocAndStrcpyHelper(&(pKvs->pRecorderFilePrefix), pValue)) != 0)
+            {
+                LogError("Failed to set pRecorderFilePrefix");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_RECORDER_FILE_DURATION_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to recorder file duration");
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set recorder file duration after stream is created");
+            }
+            else
+            {
+                pKvs->uRecorderFileDurationMs = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_RECORDER_WRITE_BUFFER_SIZE) == 0)
+        {
+            if (pValue == NULL || *((size_t *)pValue) == 0)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to recorder write buffer size");
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set recorder write buffer size after stream is created");
+            }
+            else
+            {
+                pKvs->uRecorderWriteBufSize = *((size_t *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_ASYNC_OPEN) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to async open");
+            }
+            else
+            {
+                pKvs->bAsyncOpen = *((bool *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_FAST_OPEN) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to fast open");
+            }
+            else
+            {
+                pKvs->bFastOpen = *((bool *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_KEYFRAME_SNAPSHOT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to keyframe snapshot");
+            }
+            else
+            {
+                pKvs->bKeyframeSnapshot = *((bool *)pValue);
+            }
+        }
+#if KVS_CONFIG_AUDIO
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_AUDIO_ONLY) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to audio only");
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Audio only can't be changed after the stream is created");
+            }
+            else
+            {
+                pKvs->bAudioOnly = *((bool *)pValue);
+            }
+        }
+#endif /* KVS_CONFIG_AUDIO */
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_CATCH_UP_THRESHOLD_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to catch-up threshold");
+            }
+            else
+            {
+                pKvs->uCatchUpThresholdMs = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_CATCH_UP_RATE_BPS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to catch-up rate");
+            }
+            else
+            {
+                pKvs->uCatchUpRateBps = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_PREROLL_DURATION_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to pre-roll duration");
+            }
+            else
+            {
+                pKvs->uPrerollDurationMs = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_DATA_ENDPOINT_TTL_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to data endpoint TTL");
+            }
+            else
+            {
+                pKvs->uDataEndpointTtlMs = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_KVS_PUT_MEDIA_ROTATION_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to PUT MEDIA rotation");
+            }
+            else
+            {
+                pKvs->uPutMediaRotationMs = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_POLICY) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to stream strategy");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_POLICY, (int64_t)*((KvsApp_streamPolicy_t *)pValue));
+            }
+        }
+#if KVS_CONFIG_RING_BUFFER_POLICY
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to parameter of ring buffer policy");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_MEM_LIMIT, (int64_t)*((size_t *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_POLICY_RING_BUFFER_DROP_NON_REF_FRAMES) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to parameter of ring buffer policy");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_DROP_NON_REF_FRAMES, (int64_t)*((bool *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_POLICY_RING_BUFFER_DROP_AUDIO_FRAMES) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to parameter of ring buffer policy");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_POLICY_RING_BUFFER_DROP_AUDIO_FRAMES, (int64_t)*((bool *)pValue));
+            }
+        }
+#endif /* KVS_CONFIG_RING_BUFFER_POLICY */
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_POLICY_TIME_WINDOW_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to parameter of time window policy");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_POLICY_TIME_WINDOW_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_FRAME_SLAB_SIZE) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to frame slab size");
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set frame slab size after stream is created");
+            }
+            else
+            {
+                pKvs->uFrameSlabSize = *((size_t *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_INGEST_RING_SIZE) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to ingest ring size");
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set ingest ring size after stream is created");
+            }
+            else
+            {
+                pKvs->uIngestRingSize = *((size_t *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_SPILL_FILE) == 0)
+        {
+            if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set spill file after stream is created");
+            }
+            else if ((res = prvMallocAndStrcpyHelper(&(pKvs->pSpillFilename), pValue)) != 0)
+            {
+                LogError("Failed to set pSpillFilename");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_SPILL_FILE_SIZE) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to spill file size");
+            }
+            else if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set spill file size after stream is created");
+            }
+            else
+            {
+                pKvs->uSpillFileSize = *((size_t *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_SPILL_MEM_LIMIT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to spill memory limit");
+            }
+            else
+            {
+                pKvs->uSpillMemLimit = *((size_t *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_CHECKPOINT_FILE) == 0)
+        {
+            if (pKvs->xStreamHandle != NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Cannot set checkpoint file after stream is created");
+            }
+            else if ((res = prvMallocAndStrcpyHelper(&(pKvs->pCheckpointFilename), pValue)) != 0)
+            {
+                LogError("Failed to set pCheckpointFilename");
+                /* Propagate the res error */
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_CHECKPOINT_INTERVAL_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to checkpoint interval");
+            }
+            else
+            {
+                pKvs->uCheckpointIntervalMs = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_SEND_FRAME_BUDGET) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to send frame budget");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_SEND_FRAME_BUDGET, (int64_t)*((size_t *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_SEND_BYTE_BUDGET) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to send byte budget");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_SEND_BYTE_BUDGET, (int64_t)*((size_t *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_BURST_INTERVAL_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to burst interval");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_BURST_INTERVAL_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_BURST_BYTES) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to burst bytes");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_BURST_BYTES, (int64_t)*((size_t *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_WAIT_TIMEOUT_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to wait timeout");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_WAIT_TIMEOUT_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_MAX_FRAGMENT_DURATION_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to max fragment duration");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_MAX_FRAGMENT_DURATION_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_INTERLEAVE_WINDOW_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to interleave window");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_INTERLEAVE_WINDOW_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_LATENCY_DROP_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to latency drop");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_LATENCY_DROP_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+#if KVS_CONFIG_AUDIO
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_AUDIO_LACE_DURATION_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to audio lace duration");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_AUDIO_LACE_DURATION_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_STREAM_AUDIO_MAX_LATENCY_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to audio max latency");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_STREAM_AUDIO_MAX_LATENCY_MS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+#endif /* KVS_CONFIG_AUDIO */
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_CONNECTION_TIMEOUT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to connection timeout");
+            }
+            else
+            {
+                unsigned int uConnectionTimeoutMs = *((unsigned int *)pValue);
+                pKvs->xServicePara.uRecvTimeoutMs = uConnectionTimeoutMs;
+                pKvs->xServicePara.uSendTimeoutMs = uConnectionTimeoutMs;
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_STREAMING_RECV_TIMEOUT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to streaming recv timeout");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_NETIO_STREAMING_RECV_TIMEOUT, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_STREAMING_SEND_TIMEOUT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to streaming send timeout");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_NETIO_STREAMING_SEND_TIMEOUT, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_TLS_MAX_FRAG_LEN) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to TLS max fragment length");
+            }
+            else
+            {
+                pKvs->xServicePara.uTlsMaxFragLen = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_INTERFACE) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to interface");
+            }
+            else
+            {
+                pKvs->uIfIndex = *((unsigned int *)pValue);
+                pKvs->xPutMediaPara.uBindIfIndex = prvActiveIfIndex(pKvs);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_STANDBY_INTERFACE) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to standby interface");
+            }
+            else
+            {
+                pKvs->uStandbyIfIndex = *((unsigned int *)pValue);
+                if (pKvs->uStandbyIfIndex == 0)
+                {
+                    pKvs->bOnStandbyIf = false;
+                }
+                pKvs->xPutMediaPara.uBindIfIndex = prvActiveIfIndex(pKvs);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_FAILOVER_SEND_LATENCY_MS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to failover send latency");
+            }
+            else
+            {
+                pKvs->uFailoverSendLatencyMs = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_TCP_NODELAY) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to TCP no delay");
+            }
+            else
+            {
+                pKvs->xPutMediaPara.bTcpNoDelay = *((bool *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_SEND_BUF_SIZE) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to send buffer size");
+            }
+            else
+            {
+                pKvs->xPutMediaPara.uSendBufSize = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_NOT_SENT_LOWAT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to not sent low water mark");
+            }
+            else
+            {
+                pKvs->xPutMediaPara.uNotSentLowat = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_KEEPALIVE_IDLE_SEC) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to keepalive idle time");
+            }
+            else
+            {
+                pKvs->xPutMediaPara.uKeepAliveIdleSec = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_KEEPALIVE_INTERVAL_SEC) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to keepalive interval");
+            }
+            else
+            {
+                pKvs->xPutMediaPara.uKeepAliveIntervalSec = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_KEEPALIVE_COUNT) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to keepalive count");
+            }
+            else
+            {
+                pKvs->xPutMediaPara.uKeepAliveCount = *((unsigned int *)pValue);
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_PACING_RATE_BPS) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to pacing rate");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_NETIO_PACING_RATE_BPS, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_PACING_BURST_BYTES) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to pacing burst size");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_NETIO_PACING_BURST_BYTES, (int64_t)*((unsigned int *)pValue));
+            }
+        }
+        else if (strcmp(pcOptionName, (const char *)OPTION_NETIO_PACING_FOLLOWS_UPLINK) == 0)
+        {
+            if (pValue == NULL)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+                LogError("Invalid value set to pacing follows uplink");
+            }
+            else
+            {
+                res = prvSetOptionInt(pKvs, KVS_APP_OPTION_NETIO_PACING_FOLLOWS_UPLINK, (int64_t)*((bool *)pValue));
+            }
+        }
+        else
+        {
+            /* TODO: Propagate this option to KVS stream. */
+        }
+    }
+
+    return res;
+}
+
+int KvsApp_setOptionInt(KvsAppHandle handle, KvsApp_optionId_t xOptionId, int64_t iValue)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        res = prvSetOptionInt(pKvs, xOptionId, iValue);
+    }
+
+    return res;
+}
+
+int KvsApp_setOptionPtr(KvsAppHandle handle, KvsApp_optionId_t xOptionId, const void *pValue)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+    VideoTrackInfo_t *pVideoTrackInfo = NULL;
+#if KVS_CONFIG_AUDIO
+    AudioTrackInfo_t *pAudioTrackInfo = NULL;
+#endif
+
+    if (pKvs == NULL || pValue == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (xOptionId != KVS_APP_OPTION_KVS_VIDEO_TRACK_INFO && xOptionId != KVS_APP_OPTION_KVS_AUDIO_TRACK_INFO)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Not a pointer option: %d", (int)xOptionId);
+    }
+    else if (!KVS_CONFIG_AUDIO && xOptionId == KVS_APP_OPTION_KVS_AUDIO_TRACK_INFO)
+    {
+        res = KVS_ERROR_FEATURE_NOT_ENABLED;
+        LogError("Audio is not enabled");
+    }
+    else if (xOptionId == KVS_APP_OPTION_KVS_VIDEO_TRACK_INFO && (pVideoTrackInfo = prvCopyVideoTrackInfo((VideoTrackInfo_t *)pValue)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("failed to copy video track info");
+    }
+#if KVS_CONFIG_AUDIO
+    else if (xOptionId == KVS_APP_OPTION_KVS_AUDIO_TRACK_INFO && (pAudioTrackInfo = prvCopyAudioTrackInfo((AudioTrackInfo_t *)pValue)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("failed to copy audio track info");
+    }
+#endif
+    else if (Lock(pKvs->xTrackLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        if (pKvs->xStreamHandle != NULL)
+        {
+            /* The tracks of the stream are fixed once it's created. */
+            res = KVS_ERROR_INVALID_ARGUMENT;
+            LogError("Track info can't be changed once the stream is created");
+        }
+        else if (pVideoTrackInfo != NULL)
+        {
+            prvVideoTrackInfoTerminate(pKvs->pVideoTrackInfo);
+            pKvs->pVideoTrackInfo = pVideoTrackInfo;
+            pVideoTrackInfo = NULL;
+        }
+#if KVS_CONFIG_AUDIO
+        else
+        {
+            prvAudioTrackInfoTerminate(pKvs->pAudioTrackInfo);
+            pKvs->pAudioTrackInfo = pAudioTrackInfo;
+            pAudioTrackInfo = NULL;
+        }
+#endif
+        Unlock(pKvs->xTrackLock);
+    }
+
+    /* It's not taken by the app. */
+    prvVideoTrackInfoTerminate(pVideoTrackInfo);
+#if KVS_CONFIG_AUDIO
+    prvAudioTrackInfoTerminate(pAudioTrackInfo);
+#endif
+
+    return res;
+}
+
+typedef struct FastOpenCredentialTask
+{
+    KvsApp_t *pKvs;
+    KvsEventHandle xDoneEvent;
+} FastOpenCredentialTask_t;
+
+static void prvFastOpenCredentialRoutine(void *pArg)
+{
+    FastOpenCredentialTask_t *pxTask = (FastOpenCredentialTask_t *)pArg;
+
+    updateIotCredential(pxTask->pKvs);
+    kvsEventSignal(pxTask->xDoneEvent);
+}
+
+static void prvFastOpenPrefetchHosts(KvsApp_t *pKvs)
+{
+    const char *pcKvsPort = (pKvs->pPort != NULL) ? pKvs->pPort : DEFAULT_KVS_PORT;
+    const char *ppcHosts[3] = {0};
+    size_t uHostCount = 0;
+
+    /* The control plane is only needed if the data endpoint isn't cached. */
+    ppcHosts[uHostCount++] = (pKvs->xServicePara.pcPutMediaEndpoint != NULL) ? pKvs->xServicePara.pcPutMediaEndpoint : pKvs->pHost;
+    if (prvIsIotCredentialDue(pKvs))
+    {
+        if (strcmp(pcKvsPort, DEFAULT_KVS_PORT) == 0)
+        {
+            ppcHosts[uHostCount++] = pKvs->pIotCredentialHost;
+        }
+        else
+        {
+            ppcHosts[2] = pKvs->pIotCredentialHost;
+        }
+    }
+
+    if (NetIo_prefetchHosts(ppcHosts, uHostCount, pcKvsPort) != KVS_ERRNO_NONE ||
+        (ppcHosts[2] != NULL && NetIo_prefetchHosts(&(ppcHosts[2]), 1, DEFAULT_KVS_PORT) != KVS_ERRNO_NONE))
+    {
+        /* Hosts that aren't resolved are resolved again when they are connected. */
+        LogInfo("Failed to resolve hosts ahead");
+    }
+}
+
+/* Get the IoT credential in another thread while the PUT MEDIA connection to a cached data endpoint is established,
+ * and the connection is handed over to xPendingPutMediaHandle. */
+static void prvFastOpenOverlapCredential(KvsApp_t *pKvs)
+{
+    FastOpenCredentialTask_t xTask = {.pKvs = pKvs, .xDoneEvent = NULL};
+    KvsThreadHandle xThread = NULL;
+    PutMediaHandle xPutMediaHandle = NULL;
+    unsigned int uHttpStatusCode = 0;
+    bool bDone = false;
+
+    pKvs->uPendingPutMediaStartMs = getMonotonicTimeInMs();
+    if (pKvs->xServicePara.pcPutMediaEndpoint != NULL &&
+        Kvs_putMediaConnectStart(&(pKvs->xServicePara), &(pKvs->xPutMediaPara), &xPutMediaHandle) != KVS_ERRNO_NONE)
+    {
+        LogInfo("Failed to pre-connect PUT MEDIA");
+        prvDataEndpointInvalidate(pKvs);
+    }
+
+    if (xPutMediaHandle == NULL || !prvIsIotCredentialDue(pKvs))
+    {
+        updateIotCredential(pKvs);
+    }
+    else if ((xTask.xDoneEvent = kvsEventCreate()) == NULL ||
+             (xThread = kvsThreadCreate(prvFastOpenCredentialRoutine, &xTask, KVS_APP_OPEN_THREAD_STACK_SIZE, -1)) == NULL)
+    {
+        LogInfo("Failed to get IoT credential in parallel");
+        updateIotCredential(pKvs);
+    }
+    else
+    {
+        /* The credential thread signals the event once it's done. */
+        while (!kvsEventWait(xTask.xDoneEvent, FAST_OPEN_POLL_INTERVAL_MS))
+        {
+            if (xPutMediaHandle != NULL && Kvs_putMediaStartPoll(xPutMediaHandle, &uHttpStatusCode, &bDone) != KVS_ERRNO_NONE)
+            {
+                LogInfo("Failed to pre-connect PUT MEDIA");
+                prvPutMediaFinish(pKvs, xPutMediaHandle);
+                xPutMediaHandle = NULL;
+                prvDataEndpointInvalidate(pKvs);
+            }
+        }
+        kvsThreadJoin(xThread);
+    }
+    kvsEventTerminate(xTask.xDoneEvent);
+
+    pKvs->xPendingPutMediaHandle = xPutMediaHandle;
+}
+
+static int prvFastOpen(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+
+    prvUpdateRestfulReqParameters(pKvs);
+    prvDataEndpointInvalidateIfExpired(pKvs);
+    prvFastOpenPrefetchHosts(pKvs);
+    prvFastOpenOverlapCredential(pKvs);
+
+    if ((res = prvUpdateServiceCredential(pKvs)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to setup KVS");
+        /* Propagate the res error */
+    }
+    else if (pKvs->xPendingPutMediaHandle != NULL)
+    {
+        if ((res = Kvs_putMediaStartRequest(pKvs->xPendingPutMediaHandle, &(pKvs->xServicePara), &(pKvs->xPutMediaPara))) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to start PUT MEDIA");
+            prvMetricsAddRest(pKvs, KVS_APP_REST_PUT_MEDIA, pKvs->uPendingPutMediaStartMs, true);
+            /* Propagate the res error */
+        }
+    }
+    else if ((res = setupDataEndpoint(pKvs)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to setup data endpoint");
+        /* Propagate the res error */
+    }
+    else
+    {
+        pKvs->uPendingPutMediaStartMs = getMonotonicTimeInMs();
+        if ((res = Kvs_putMediaStartAsync(&(pKvs->xServicePara), &(pKvs->xPutMediaPara), &(pKvs->xPendingPutMediaHandle))) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to start PUT MEDIA");
+            prvMetricsAddRest(pKvs, KVS_APP_REST_PUT_MEDIA, pKvs->uPendingPutMediaStartMs, true);
+            /* The endpoint may be unreachable. */
+            prvDataEndpointInvalidate(pKvs);
+            /* Propagate the res error */
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        if (pKvs->xPendingPutMediaHandle != NULL)
+        {
+            prvPutMediaFinish(pKvs, pKvs->xPendingPutMediaHandle);
+            pKvs->xPendingPutMediaHandle = NULL;
+        }
+    }
+    else if (!pKvs->bAsyncOpen)
+    {
+        /* The pending connection is finished here instead of in KvsApp_doWork. */
+        while ((res = prvPutMediaPollPending(pKvs)) == KVS_ERRNO_NONE && pKvs->xPendingPutMediaHandle != NULL)
+        {
+            sleepInMs(FAST_OPEN_POLL_INTERVAL_MS);
+        }
+    }
+
+    return res;
+}
+
+int KvsApp_open(KvsAppHandle handle)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+    unsigned int uHttpStatusCode = 0;
+    PutMediaHandle xPutMediaHandle = NULL;
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (pKvs->bFastOpen)
+    {
+        res = prvFastOpen(pKvs);
+    }
+    else
+    {
+        updateIotCredential(pKvs);
+        if ((res = updateAndVerifyRestfulReqParameters(pKvs)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to setup KVS");
+            /* Propagate the res error */
+        }
+        else if ((res = setupDataEndpoint(pKvs)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to setup data endpoint");
+            /* Propagate the res error */
+        }
+        else if (pKvs->bAsyncOpen)
+        {
+            pKvs->uPendingPutMediaStartMs = getMonotonicTimeInMs();
+            if ((res = Kvs_putMediaStartAsync(&(pKvs->xServicePara), &(pKvs->xPutMediaPara), &(pKvs->xPendingPutMediaHandle))) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed to start PUT MEDIA");
+                prvMetricsAddRest(pKvs, KVS_APP_REST_PUT_MEDIA, pKvs->uPendingPutMediaStartMs, true);
+                /* The endpoint may be unreachable. */
+                prvDataEndpointInvalidate(pKvs);
+                /* Propagate the res error */
+            }
+        }
+        else if ((res = prvPutMediaStart(pKvs, &uHttpStatusCode, &xPutMediaHandle)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to setup PUT MEDIA");
+            /* The endpoint may be unreachable. */
+            prvDataEndpointInvalidate(pKvs);
+            /* Propagate the res error */
+        }
+        else if (Lock(pKvs->xConnLock) != LOCK_OK)
+        {
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to lock");
+            prvPutMediaFinish(pKvs, xPutMediaHandle);
+        }
+        else
+        {
+            /* The handshake is done without the lock, and the connection is published once it's started. */
+            pKvs->xPutMediaHandle = xPutMediaHandle;
+            Unlock(pKvs->xConnLock);
+
+            res = prvPutMediaCheckStarted(pKvs, uHttpStatusCode);
+        }
+    }
+
+    return res;
+}
+
+int KvsApp_close(KvsAppHandle handle)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMediaHandle xPutMediaHandle = NULL;
+    PutMediaHandle xStandbyPutMediaHandle = NULL;
+    DataFrameHandle xDataFrameHandle = NULL;
+    DataFrameIn_t *pDataFrameIn = NULL;
+
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        if (pKvs->xPendingPutMediaHandle != NULL)
+        {
+            prvPutMediaFinish(pKvs, pKvs->xPendingPutMediaHandle);
+            pKvs->xPendingPutMediaHandle = NULL;
+        }
+
+        /* The backlog is kept, and it's sent on a new catch-up connection after the next open. */
+        prvCatchUpDisconnect(pKvs);
+
+        if (pKvs->xPutMediaHandle != NULL)
+        {
+            if (Lock(pKvs->xConnLock) != LOCK_OK)
+            {
+                res = KVS_ERROR_LOCK_ERROR;
+                LogError("Failed to lock");
+            }
+            else
+            {
+                xPutMediaHandle = pKvs->xPutMediaHandle;
+                xStandbyPutMediaHandle = pKvs->xStandbyPutMediaHandle;
+                pKvs->xPutMediaHandle = NULL;
+                pKvs->xStandbyPutMediaHandle = NULL;
+                pKvs->bFailoverPending = false;
+                APP_ATOMIC_STORE(&(pKvs->isEbmlHeaderUpdated), false);
+                Unlock(pKvs->xConnLock);
+
+                /* The connections are closed without the lock, because a TLS close may block until the send timeout. */
+                prvPutMediaFinish(pKvs, xPutMediaHandle);
+                pKvs->uDisconnectedMs = getMonotonicTimeInMs();
+                /* Clusters that are not persisted are sent again on the next connection. */
+                Kvs_replayRewind(pKvs->xReplayHandle);
+                if (xStandbyPutMediaHandle != NULL)
+                {
+                    prvPutMediaFinish(pKvs, xStandbyPutMediaHandle);
+                }
+            }
+        }
+
+        prvCheckpointSaveIfDue(pKvs, true);
+    }
+
+    return res;
+}
+
+/**
+ * @brief Charge a data frame to the memory budget. Policies that drop data anyway make room by evicting GOPs from the
+ * head, and STREAM_POLICY_NONE rejects the data frame instead, so the reserve of the budget is left for reconnection.
+ */
+static bool prvMemBudgetAdmit(KvsApp_t *pKvs, size_t uBytes)
+{
+    bool bAdmitted = false;
+    size_t uMemTotal = 0;
+    size_t uMemTotalAfter = 0;
+
+    while (!(bAdmitted = kvsMemBudgetChargeMedia(uBytes)) && pKvs->xStrategy.xPolicy != STREAM_POLICY_NONE &&
+           Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotal) == KVS_ERRNO_NONE)
+    {
+        prvStreamFlushHeadUntilMem(pKvs, (uMemTotal > uBytes) ? (uMemTotal - uBytes) : 0);
+
+        /* The GOP being sent can't be evicted, so it stops once nothing more is evicted. */
+        if (Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotalAfter) != KVS_ERRNO_NONE || uMemTotalAfter >= uMemTotal)
+        {
+            break;
+        }
+    }
+
+    return bAdmitted;
+}
+
+static unsigned int prvPercentOf(uint64_t uValue, uint64_t uLimit)
+{
+    unsigned int uPercent = 0;
+
+    if (uLimit > 0)
+    {
+        uPercent = (uValue >= uLimit) ? 100 : (unsigned int)(uValue * 100 / uLimit);
+    }
+
+    return uPercent;
+}
+
+/**
+ * @brief Get how full the stream is against what its policy evicts at, i.e. the memory limit of the ring buffer or the
+ * window of the time window and pre-roll, and against the share of the memory budget that data frames can use.
+ */
+static unsigned int prvBackpressurePercent(KvsApp_t *pKvs)
+{
+    unsigned int uPercent = 0;
+    unsigned int uBudgetPercent = 0;
+    size_t uMemTotal = 0;
+    StreamStats_t xStats = {0};
+    KvsMemBudgetStats_t xBudgetStats = {0};
+    unsigned int uTimeWindowMs = 0;
+
+    if (IS_RING_BUFFER_POLICY(pKvs))
+    {
+        if (Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotal) == KVS_ERRNO_NONE)
+        {
+            uPercent = prvPercentOf(uMemTotal, pKvs->xStrategy.xRingBufferPara.uMemLimit);
+        }
+    }
+    else
+    {
+        if (prvIsPrerollActive(pKvs))
+        {
+            uTimeWindowMs = pKvs->uPrerollDurationMs;
+        }
+        else if (pKvs->xStrategy.xPolicy == STREAM_POLICY_TIME_WINDOW)
+        {
+            uTimeWindowMs = pKvs->xStrategy.xTimeWindowPara.uTimeWindowMs;
+        }
+
+        if (uTimeWindowMs > 0 && Kvs_streamGetStats(pKvs->xStreamHandle, &xStats, false) == KVS_ERRNO_NONE &&
+            xStats.uNewestTimestampMs > xStats.uOldestTimestampMs)
+        {
+            uPercent = prvPercentOf(xStats.uNewestTimestampMs - xStats.uOldestTimestampMs, uTimeWindowMs);
+        }
+    }
+
+    /* The stats are not available unless the memory budget is enabled. */
+    if (kvsMemBudgetGetStats(&xBudgetStats) == KVS_ERRNO_NONE && xBudgetStats.uLimit > xBudgetStats.uReserved)
+    {
+        uBudgetPercent = prvPercentOf(xBudgetStats.uUsedBytes, xBudgetStats.uLimit - xBudgetStats.uReserved);
+        if (uBudgetPercent > uPercent)
+        {
+            uPercent = uBudgetPercent;
+        }
+    }
+
+    return uPercent;
+}
+
+static KvsAppBackpressure_t prvBackpressureLevel(KvsAppBackpressure_t xLevel, unsigned int uPercent)
+{
+    KvsAppBackpressure_t xNewLevel = KVS_APP_BACKPRESSURE_NONE;
+
+    if (uPercent >= BACKPRESSURE_CRITICAL_PERCENT ||
+        (xLevel == KVS_APP_BACKPRESSURE_CRITICAL && uPercent + BACKPRESSURE_HYSTERESIS_PERCENT >= BACKPRESSURE_CRITICAL_PERCENT))
+    {
+        xNewLevel = KVS_APP_BACKPRESSURE_CRITICAL;
+    }
+    else if (uPercent >= BACKPRESSURE_HIGH_PERCENT || (xLevel != KVS_APP_BACKPRESSURE_NONE && uPercent + BACKPRESSURE_HYSTERESIS_PERCENT >= BACKPRESSURE_HIGH_PERCENT))
+    {
+        xNewLevel = KVS_APP_BACKPRESSURE_HIGH;
+    }
+
+    return xNewLevel;
+}
+
+static void prvBackpressureUpdate(KvsApp_t *pKvs)
+{
+    unsigned int uPercent = prvBackpressurePercent(pKvs);
+    KvsAppBackpressure_t xLevel = prvBackpressureLevel(__atomic_load_n(&(pKvs->xBackpressure), __ATOMIC_RELAXED), uPercent);
+    OnBackpressureCallbackInfo_t *pxCallbackInfo = &(pKvs->onBackpressureCallbackInfo);
+
+    __atomic_store_n(&(pKvs->uBackpressurePercent), uPercent, __ATOMIC_RELAXED);
+
+    /* Only the thread that changes the level reports it. */
+    if (__atomic_exchange_n(&(pKvs->xBackpressure), xLevel, __ATOMIC_RELAXED) != xLevel && pxCallbackInfo->onBackpressure != NULL)
+    {
+        pxCallbackInfo->onBackpressure(xLevel, uPercent, pxCallbackInfo->pAppData);
+    }
+}
+
+static int prvAddDataFrameIn(KvsApp_t *pKvs, DataFrameIn_t *pDataFrameIn)
+{
+    int res = KVS_ERRNO_NONE;
+    DataFrameUserData_t *pUserData = (DataFrameUserData_t *)pDataFrameIn->pUserData;
+
+    if (pKvs->xSpillHandle != NULL)
+    {
+        prvStreamSpillHeadUntilMem(pKvs, pKvs->uSpillMemLimit);
+    }
+
+    if (prvIsPrerollActive(pKvs))
+    {
+        /* GOPs that are older than the pre-roll window are dropped as a whole, so the backlog starts at a key frame. */
+        prvStreamFlushHeadUntilTimeWindow(pKvs, pKvs->uPrerollDurationMs);
+    }
+
+    if (IS_RING_BUFFER_POLICY(pKvs))
+    {
+        prvStreamDropDisposableUntilMem(pKvs, pKvs->xStrategy.xRingBufferPara.uMemLimit);
+        prvStreamFlushHeadUntilMem(pKvs, pKvs->xStrategy.xRingBufferPara.uMemLimit);
+    }
+    else if (pKvs->xStrategy.xPolicy == STREAM_POLICY_TIME_WINDOW)
+    {
+        prvStreamFlushHeadUntilTimeWindow(pKvs, pKvs->xStrategy.xTimeWindowPara.uTimeWindowMs);
+    }
+
+    /* The user data is copied into the data frame, so the time is set before it's added. */
+    pUserData->uAddTimeMs = getMonotonicTimeInMs();
+
+    if (pUserData->uBudgetBytes > 0 && !prvMemBudgetAdmit(pKvs, pUserData->uBudgetBytes))
+    {
+        res = KVS_ERROR_MEMORY_BUDGET_EXCEEDED;
+        LogInfo("Memory budget exceeded, data frame dropped");
+    }
+    else if (pKvs->uIngestRingSize > 0 && pDataFrameIn->uSegmentCount == 0 && Kvs_streamIngestDataFrame(pKvs->xStreamHandle, pDataFrameIn) == KVS_ERRNO_NONE)
+    {
+        /* It's handed over to the stream without lock. */
+    }
+    else if (Kvs_streamAddDataFrame(pKvs->xStreamHandle, pDataFrameIn) == NULL)
+    {
+        res = KVS_ERROR_FAIL_TO_ADD_DATA_FRAME_TO_STREAM;
+        LogError("Failed to add data frame");
+        if (pUserData->uBudgetBytes > 0)
+        {
+            kvsMemBudgetReleaseMedia(pUserData->uBudgetBytes);
+        }
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        if (pDataFrameIn->xClusterType == MKV_CLUSTER && Lock(pKvs->xLatencyLock) == LOCK_OK)
+        {
+            Kvs_latencyTrackerAddCluster(pKvs->xLatencyTracker, pDataFrameIn->uTimestampMs, getMonotonicTimeInMs());
+            Unlock(pKvs->xLatencyLock);
+        }
+        kvsEventSignal((pKvs->xSharedWakeEvent != NULL) ? pKvs->xSharedWakeEvent : pKvs->xWakeEvent);
+    }
+
+    prvBackpressureUpdate(pKvs);
+
+    return res;
+}
+
+/**
+ * @brief Decide the cluster type of a data frame and add it to the stream under xTrackLock, so a cluster started by
+ * one track can't be raced by the other one before it's in the stream.
+ */
+static int prvAddDataFrameInWithCluster(KvsApp_t *pKvs, DataFrameIn_t *pDataFrameIn)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (Lock(pKvs->xTrackLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        pDataFrameIn->xClusterType = prvGetClusterType(pKvs, pDataFrameIn->xTrackType, pDataFrameIn->bIsKeyFrame, pDataFrameIn->uTimestampMs);
+        res = prvAddDataFrameIn(pKvs, pDataFrameIn);
+        Unlock(pKvs->xTrackLock);
+    }
+
+    return res;
+}
+
+#if KVS_CONFIG_AUDIO
+static int prvOnAudioLaceTerminate(uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType, void *pAppData)
+{
+    /* The lace buffer is allocated by KVS. */
+    kvsFree(pData);
+
+    return KVS_ERRNO_NONE;
+}
+
+static size_t prvAudioLaceHeadroom(void)
+{
+    /* The worst case of EBML lacing, the MKV header and the HTTP chunk size line */
+    return 1 + (AUDIO_LACE_MAX_FRAME_COUNT - 1) * 8 + Mkv_getClusterHdrLen(MKV_CLUSTER) + PUT_MEDIA_CHUNK_SIZE_LINE_MAX_LEN;
+}
+
+/* It should be called with xAudioLaceLock locked. */
+static int prvAudioLaceAppend(KvsApp_t *pKvs, uint8_t *pData, size_t uDataLen, uint64_t uTimestamp)
+{
+    int res = KVS_ERRNO_NONE;
+    AudioLace_t *pxLace = &(pKvs->xAudioLace);
+    size_t uHeadroom = prvAudioLaceHeadroom();
+    size_t uBufSize = uHeadroom + pxLace->uLen + uDataLen + AUDIO_LACE_TAILROOM;
+    uint8_t *pBuf = NULL;
+
+    if (uBufSize > pxLace->uBufSize)
+    {
+        if (uBufSize < pxLace->uBufSize * 2)
+        {
+            uBufSize = pxLace->uBufSize * 2;
+        }
+        else if (uBufSize < AUDIO_LACE_INITIAL_BUF_SIZE)
+        {
+            uBufSize = AUDIO_LACE_INITIAL_BUF_SIZE;
+        }
+
+        if ((pBuf = (uint8_t *)kvsRealloc(pxLace->pBuf, uBufSize)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: audio lace");
+        }
+        else
+        {
+            pxLace->pBuf = pBuf;
+            pxLace->uBufSize = uBufSize;
+        }
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        if (pxLace->uFrameCount == 0)
+        {
+            pxLace->uTimestampMs = uTimestamp;
+        }
+        memcpy(pxLace->pBuf + uHeadroom + pxLace->uLen, pData, uDataLen);
+        pxLace->uLen += uDataLen;
+        pxLace->puFrameSizes[pxLace->uFrameCount] = uDataLen;
+        pxLace->uFrameCount++;
+    }
+
+    return res;
+}
+
+/**
+ * @brief Add the pending audio lace to the stream as one simple block. Frames of the same size are laced with
+ * fixed-size lacing, and others are laced with EBML lacing. A lace of one frame is added without lacing. It should be
+ * called with xAudioLaceLock locked.
+ */
+static void prvAudioLaceFlush(KvsApp_t *pKvs)
+{
+    int res = KVS_ERRNO_NONE;
+    AudioLace_t *pxLace = &(pKvs->xAudioLace);
+    DataFrameIn_t xDataFrameIn = {0};
+    DataFrameUserData_t xUserData = {0};
+    MkvLacing_t xLacing = MKV_LACING_NONE;
+    size_t uLaceHdrLen = 0;
+    uint8_t *pFrames = NULL;
+
+    if (pxLace->uFrameCount > 0)
+    {
+        pFrames = pxLace->pBuf + prvAudioLaceHeadroom();
+        if (pxLace->uFrameCount > 1)
+        {
+            xLacing = (Mkv_getLaceHdrLen(MKV_LACING_FIXED_SIZE, pxLace->puFrameSizes, pxLace->uFrameCount) > 0) ? MKV_LACING_FIXED_SIZE : MKV_LACING_EBML;
+            uLaceHdrLen = Mkv_getLaceHdrLen(xLacing, pxLace->puFrameSizes, pxLace->uFrameCount);
+        }
+
+        xDataFrameIn.pData = (char *)(pFrames - uLaceHdrLen);
+        xDataFrameIn.uDataLen = uLaceHdrLen + pxLace->uLen;
+        xDataFrameIn.uHeadroom = (size_t)((uint8_t *)(xDataFrameIn.pData) - pxLace->pBuf);
+        xDataFrameIn.xLacing = xLacing;
+        xDataFrameIn.uTimestampMs = pxLace->uTimestampMs;
+        xDataFrameIn.xTrackType = TRACK_AUDIO;
+        xDataFrameIn.bIsDisposable = prvIsDataFrameDisposable(pKvs, &xDataFrameIn, false);
+        xUserData.xCallbacks.onDataFrameTerminateInfo.onDataFrameTerminate = prvOnAudioLaceTerminate;
+        xUserData.uTailroom = AUDIO_LACE_TAILROOM;
+        xDataFrameIn.pUserData = &xUserData;
+
+        if (xLacing != MKV_LACING_NONE &&
+            (res = Mkv_initializeLaceHdr((uint8_t *)(xDataFrameIn.pData), uLaceHdrLen, xLacing, pxLace->puFrameSizes, pxLace->uFrameCount)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to initialize lace header");
+            /* Propagate the res error */
+        }
+        else if (pxLace->uTimestampMs < prvEarliestTimestampGet(pKvs))
+        {
+            res = KVS_ERROR_ADD_FRAME_WHOSE_TIMESTAMP_GOES_BACK;
+            LogInfo("Audio lace is older than sent data frames");
+        }
+        else
+        {
+            res = prvAddDataFrameInWithCluster(pKvs, &xDataFrameIn);
+        }
+
+        if (res != KVS_ERRNO_NONE)
+        {
+            kvsFree(pxLace->pBuf);
+        }
+        memset(pxLace, 0, sizeof(AudioLace_t));
+    }
+}
+
+/**
+ * @brief Add the pending audio lace to the stream if a data frame at uTimestamp is past its duration, or if bForce is
+ * set. It's called before a data frame that isn't laced is added, so the lace stays in order.
+ */
+static void prvAudioLaceFlushIfDue(KvsApp_t *pKvs, uint64_t uTimestamp, bool bForce)
+{
+    AudioLace_t *pxLace = &(pKvs->xAudioLace);
+
+    if (Lock(pKvs->xAudioLaceLock) != LOCK_OK)
+    {
+        LogError("Failed to lock");
+    }
+    else
+    {
+        if (pxLace->uFrameCount > 0 && (bForce || uTimestamp >= pxLace->uTimestampMs + pKvs->uAudioLaceDurationMs))
+        {
+            /* The lace is full of its duration, or there has been no audio for a while. */
+            prvAudioLaceFlush(pKvs);
+        }
+        Unlock(pKvs->xAudioLaceLock);
+    }
+}
+
+/**
+ * @brief Copy an audio frame into the lace. The pending lace is added to the stream first if the frame is past its
+ * duration or the lace is full.
+ */
+static int prvAudioLaceAdd(KvsApp_t *pKvs, uint8_t *pData, size_t uDataLen, uint64_t uTimestamp)
+{
+    int res = KVS_ERRNO_NONE;
+    AudioLace_t *pxLace = &(pKvs->xAudioLace);
+
+    if (Lock(pKvs->xAudioLaceLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        if (pxLace->uFrameCount > 0 && (pxLace->uFrameCount == AUDIO_LACE_MAX_FRAME_COUNT || uTimestamp >= pxLace->uTimestampMs + pKvs->uAudioLaceDurationMs))
+        {
+            prvAudioLaceFlush(pKvs);
+        }
+        res = prvAudioLaceAppend(pKvs, pData, uDataLen, uTimestamp);
+        Unlock(pKvs->xAudioLaceLock);
+    }
+
+    return res;
+}
+#endif /* KVS_CONFIG_AUDIO */
+
+int KvsApp_addFrame(KvsAppHandle handle, uint8_t *pData, size_t uDataLen, size_t uDataSize, uint64_t uTimestamp, TrackType_t xTrackType)
+{
+    return KvsApp_addFrameWithCallbacks(handle, pData, uDataLen, uDataSize, uTimestamp, xTrackType, NULL);
+}
+
+int KvsApp_addFrameWithCallbacks(KvsAppHandle handle, uint8_t *pData, size_t uDataLen, size_t uDataSize, uint64_t uTimestamp, TrackType_t xTrackType, DataFrameCallbacks_t *pCallbacks)
+{
+    return KvsApp_addFrameWithHeadroom(handle, pData, 0, uDataLen, uDataSize, uTimestamp, xTrackType, pCallbacks);
+}
+
+static int prvAnalyzeVideoFrame(KvsApp_t *pKvs, uint8_t *pData, size_t uDataLen, NaluFrameInfo_t *pxFrameInfo)
+{
+    bool bIsHevc = (pKvs->xVideoCodec == VIDEO_CODEC_HEVC);
+
+    return (pKvs->xVideoFormat == VIDEO_FORMAT_AUTO) ? NALU_analyzeFrame(pData, (uint32_t)uDataLen, bIsHevc, pxFrameInfo)
+                                                     : NALU_analyzeFrameOfFormat(pData, (uint32_t)uDataLen, bIsHevc, pKvs->xVideoFormat == VIDEO_FORMAT_ANNEX_B, pxFrameInfo);
+}
+
+/**
+ * @brief Get the NALU payloads of an Annex-B frame of the declared Annex-B format as segments, so the frame is sent as
+ * AVCC without being converted in place. Filtered NALUs are left out.
+ *
+ * @return true if the frame is sent as segments, or false if it has to be converted in place
+ */
+static bool prvGetNaluSegments(KvsApp_t *pKvs, uint8_t *pData, const NaluFrameInfo_t *pxFrameInfo, DataFrameSegment_t *pxSegments, size_t *puSegmentCount, size_t *puAvccLen)
+{
+    const NaluEntry_t *pxNalu = NULL;
+    size_t uSegmentCount = 0;
+    size_t uAvccLen = 0;
+    uint32_t i = 0;
+
+    /* NALUs beyond NALU_MAX_COUNT_IN_A_FRAME are not recorded, so they can only be found by the conversion. */
+    if (pKvs->xVideoFormat == VIDEO_FORMAT_ANNEX_B && pxFrameInfo->bIsAnnexB && pxFrameInfo->uNaluCount <= NALU_MAX_COUNT_IN_A_FRAME &&
+        pxFrameInfo->uNaluCount <= DATA_FRAME_MAX_SEGMENTS)
+    {
+        for (i = 0; i < pxFrameInfo->uNaluCount; i++)
+        {
+            pxNalu = &(pxFrameInfo->pxNalus[i]);
+            if (pxNalu->uLen == 0 || !NALU_isNaluFiltered(pxNalu->uHdr, pxFrameInfo->bIsHevc, pKvs->uNaluFilterMask))
+            {
+                pxSegments[uSegmentCount].pData = pData + pxNalu->uOffset;
+                pxSegments[uSegmentCount].uLen = pxNalu->uLen;
+                uSegmentCount++;
+                uAvccLen += DATA_FRAME_SEGMENT_LEN_PREFIX + pxNalu->uLen;
+            }
+        }
+    }
+
+    *puSegmentCount = uSegmentCount;
+    *puAvccLen = uAvccLen;
+
+    return uSegmentCount > 0;
+}
+
+static KeyframeSnapshot_t *prvKeyframeSnapshotCreate(KvsApp_t *pKvs, const uint8_t *pData, size_t uDataLen, bool bIsAnnexB, DataFrameIn_t *pDataFrameIn)
+{
+    KeyframeSnapshot_t *pxSnapshot = NULL;
+    DataFrameUserData_t *pUserData = (DataFrameUserData_t *)pDataFrameIn->pUserData;
+    VideoTrackInfo_t *pVideoTrackInfo = NULL;
+
+    if (Lock(pKvs->xTrackLock) != LOCK_OK)
+    {
+        LogError("Failed to lock");
+    }
+    else
+    {
+        /* A keyframe with new parameter sets belongs to the next track info. */
+        pVideoTrackInfo = (pKvs->pNextVideoTrackInfo != NULL) ? pKvs->pNextVideoTrackInfo : pKvs->pVideoTrackInfo;
+        if (pVideoTrackInfo == NULL)
+        {
+            LogError("Video track info is not available");
+        }
+        else if ((pxSnapshot = (KeyframeSnapshot_t *)kvsMalloc(sizeof(KeyframeSnapshot_t) + pVideoTrackInfo->uCodecPrivateLen)) == NULL)
+        {
+            LogError("OOM: pxSnapshot");
+        }
+        else
+        {
+            memset(pxSnapshot, 0, sizeof(KeyframeSnapshot_t));
+            memcpy(pxSnapshot->pCodecPrivate, pVideoTrackInfo->pCodecPrivate, pVideoTrackInfo->uCodecPrivateLen);
+            pxSnapshot->xInfo.uCodecPrivateLen = pVideoTrackInfo->uCodecPrivateLen;
+        }
+        Unlock(pKvs->xTrackLock);
+    }
+
+    if (pxSnapshot != NULL)
+    {
+        /* One reference is held by the data frame, and the other by the cache. */
+        pxSnapshot->uRefCnt = 2;
+        pxSnapshot->xInfo.pData = pData;
+        pxSnapshot->xInfo.uDataLen = uDataLen;
+        pxSnapshot->xInfo.bIsAnnexB = bIsAnnexB;
+        pxSnapshot->xInfo.uTimestampMs = pDataFrameIn->uTimestampMs;
+        pxSnapshot->xInfo.pCodecPrivate = pxSnapshot->pCodecPrivate;
+        pxSnapshot->pBuf = (uint8_t *)(pDataFrameIn->pData - pDataFrameIn->uHeadroom);
+        pxSnapshot->uTerminateLen = pDataFrameIn->uDataLen;
+        pxSnapshot->xTrackType = pDataFrameIn->xTrackType;
+        memcpy(&(pxSnapshot->xTerminateInfo), &(pUserData->xCallbacks.onDataFrameTerminateInfo), sizeof(OnDataFrameTerminateInfo_t));
+        pUserData->pxSnapshot = pxSnapshot;
+    }
+
+    return pxSnapshot;
+}
+
+static void prvKeyframeSnapshotPublish(KvsApp_t *pKvs, KeyframeSnapshot_t *pxSnapshot)
+{
+    KeyframeSnapshot_t *pxOldSnapshot = pxSnapshot;
+
+    if (Lock(pKvs->xSnapshotLock) == LOCK_OK)
+    {
+        pxOldSnapshot = pKvs->pxSnapshot;
+        pKvs->pxSnapshot = pxSnapshot;
+        Unlock(pKvs->xSnapshotLock);
+    }
+
+    /* It may terminate the old keyframe if the stream has released it, so it's not done under the lock. */
+    prvKeyframeSnapshotRelease(pxOldSnapshot);
+}
+
+static int prvAddFrame(
+    KvsAppHandle handle,
+    uint8_t *pBuf,
+    size_t uHeadroom,
+    size_t uDataLen,
+    size_t uBufSize,
+    uint64_t uTimestamp,
+    TrackType_t xTrackType,
+    const NaluFrameInfo_t *pxFrameInfo,
+    DataFrameCallbacks_t *pCallbacks)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+    DataFrameIn_t xDataFrameIn = {0};
+    DataFrameUserData_t xUserData = {0};
+    uint8_t *pData = NULL;
+    size_t uDataSize = 0;
+    bool bIsLaced = false;
+    NaluFrameInfo_t xFrameInfo = {0};
+    DataFrameSegment_t xSegments[DATA_FRAME_MAX_SEGMENTS];
+    size_t uSegmentCount = 0;
+    size_t uAvccLen = 0;
+    KeyframeSnapshot_t *pxSnapshot = NULL;
+
+    KVS_TRACE_BEGIN(KVS_TRACE_APP_ADD_FRAME);
+    if (pBuf != NULL && uHeadroom <= uBufSize)
+    {
+        pData = pBuf + uHeadroom;
+        uDataSize = uBufSize - uHeadroom;
+    }
+
+    if (pxFrameInfo != NULL)
+    {
+        /* It may be converted below, so the caller's copy is kept as it is. */
+        memcpy(&xFrameInfo, pxFrameInfo, sizeof(NaluFrameInfo_t));
+    }
+
+    if (pKvs == NULL || pData == NULL || uDataLen == 0)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (!KVS_CONFIG_AUDIO && xTrackType == TRACK_AUDIO)
+    {
+        res = KVS_ERROR_FEATURE_NOT_ENABLED;
+        LogError("Audio is not enabled");
+    }
+    else if (pKvs->bAudioOnly && xTrackType == TRACK_VIDEO)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Video frames are not accepted by an audio-only stream");
+    }
+    else if (uTimestamp < prvEarliestTimestampGet(pKvs))
+    {
+        res = KVS_ERROR_ADD_FRAME_WHOSE_TIMESTAMP_GOES_BACK;
+    }
+    else if (xTrackType == TRACK_VIDEO && pxFrameInfo != NULL && pxFrameInfo->uLen != uDataLen)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Frame info doesn't match the frame");
+    }
+    else if (xTrackType == TRACK_VIDEO && pxFrameInfo == NULL && (res = prvAnalyzeVideoFrame(pKvs, pData, uDataLen, &xFrameInfo)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to analyze video frame");
+        /* Propagate the res error */
+    }
+    else if (
+        xTrackType == TRACK_VIDEO && (xFrameInfo.bIsAnnexB || pKvs->uNaluFilterMask != 0) &&
+        !prvGetNaluSegments(pKvs, pData, &xFrameInfo, xSegments, &uSegmentCount, &uAvccLen) &&
+        (res = NALU_convertAnnexBToAvccWithFrameInfo(pData, uDataSize, &xFrameInfo, pKvs->uNaluFilterMask, (uint32_t *)&uDataLen)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to convert Annex-B to Avcc in place");
+        /* Propagate the res error */
+    }
+    else if ((res = checkAndBuildStream(pKvs, pData, &xFrameInfo, xTrackType)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to build stream buffer");
+        /* Propagate the res error */
+    }
+    else if (pKvs->xStreamHandle == NULL)
+    {
+        res = KVS_ERROR_STREAM_NOT_READY;
+    }
+    else if (
+        xTrackType == TRACK_VIDEO && xFrameInfo.bIsKeyFrame && pKvs->pSps != NULL &&
+        (res = prvCheckParameterSetsChanged(pKvs, pData, &xFrameInfo)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        xDataFrameIn.pData = (char *)pData;
+        xDataFrameIn.uDataLen = uDataLen;
+        if (uSegmentCount > 0)
+        {
+            /* The frame is kept as it is, and start codes are replaced by AVCC lengths while it's sent. */
+            xDataFrameIn.pxSegments = xSegments;
+            xDataFrameIn.uSegmentCount = uSegmentCount;
+            xDataFrameIn.bPrefixSegmentLen = true;
+            xDataFrameIn.uDataLen = uAvccLen;
+        }
+        if (xTrackType != TRACK_VIDEO)
+        {
+            xDataFrameIn.bIsKeyFrame = false;
+        }
+        else
+        {
+            xDataFrameIn.bIsKeyFrame = xFrameInfo.bIsKeyFrame;
+        }
+        xDataFrameIn.uTimestampMs = uTimestamp;
+        xDataFrameIn.xTrackType = xTrackType;
+        xDataFrameIn.bIsDisposable = prvIsDataFrameDisposable(pKvs, &xDataFrameIn, xFrameInfo.bIsNonReference);
+        xDataFrameIn.uHeadroom = uHeadroom;
+        xUserData.uTailroom = (uDataSize > uDataLen) ? (uDataSize - uDataLen) : 0;
+        xUserData.uSegmentId = pKvs->uSegmentId;
+        xUserData.uBudgetBytes = uBufSize;
+
+        if (pCallbacks == NULL)
+        {
+            /* Assign default callbacks. */
+            xUserData.xCallbacks.onDataFrameTerminateInfo.onDataFrameTerminate = defaultOnDataFrameTerminate;
+            xUserData.xCallbacks.onDataFrameTerminateInfo.pAppData = NULL;
+            xUserData.xCallbacks.onDataFrameToBeSentInfo.onDataFrameToBeSent = NULL;
+            xUserData.xCallbacks.onDataFrameToBeSentInfo.pAppData = NULL;
+        }
+        else
+        {
+            memcpy(&(xUserData.xCallbacks), pCallbacks, sizeof(DataFrameCallbacks_t));
+        }
+
+        /* The user data is copied into the data frame by the stream, so there is no need to allocate it. */
+        xDataFrameIn.pUserData = &xUserData;
+
+#if KVS_CONFIG_AUDIO
+        if (xTrackType == TRACK_AUDIO && pKvs->uAudioLaceDurationMs > 0)
+        {
+            /* The frame is copied into the lace, so it's terminated right away. */
+            res = prvAudioLaceAdd(pKvs, pData, uDataLen, uTimestamp);
+            bIsLaced = (res == KVS_ERRNO_NONE);
+        }
+        else
+#endif /* KVS_CONFIG_AUDIO */
+        {
+#if KVS_CONFIG_AUDIO
+            prvAudioLaceFlushIfDue(pKvs, uTimestamp, false);
+#endif
+            if (pKvs->bKeyframeSnapshot && xTrackType == TRACK_VIDEO && xDataFrameIn.bIsKeyFrame)
+            {
+                /* Segments refer to the frame as it is, which is still Annex-B, or it's converted to AVCC in place. */
+                pxSnapshot = prvKeyframeSnapshotCreate(pKvs, pData, uDataLen, uSegmentCount > 0, &xDataFrameIn);
+            }
+
+            res = prvAddDataFrameInWithCluster(pKvs, &xDataFrameIn);
+
+            if (pxSnapshot != NULL)
+            {
+                if (res == KVS_ERRNO_NONE)
+                {
+                    prvKeyframeSnapshotPublish(pKvs, pxSnapshot);
+                }
+                else
+                {
+                    /* The frame is terminated below as usual. */
+                    kvsFree(pxSnapshot);
+                }
+            }
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE || bIsLaced)
+    {
+        if (pBuf != NULL)
+        {
+            if (pCallbacks != NULL && pCallbacks->onDataFrameTerminateInfo.onDataFrameTerminate != NULL)
+            {
+                retVal = pCallbacks->onDataFrameTerminateInfo.onDataFrameTerminate(pBuf, uDataLen, uTimestamp, xTrackType, pCallbacks->onDataFrameTerminateInfo.pAppData);
+            }
+            else
+            {
+                retVal = defaultOnDataFrameTerminate(pBuf, uDataLen, uTimestamp, xTrackType, NULL);
+            }
+            if (retVal != 0)
+            {
+                res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+            }
+        }
+    }
+    KVS_TRACE_END(KVS_TRACE_APP_ADD_FRAME, uDataLen);
+
+    return res;
+}
+
+int KvsApp_addFrameWithHeadroom(KvsAppHandle handle, uint8_t *pBuf, size_t uHeadroom, size_t uDataLen, size_t uBufSize, uint64_t uTimestamp, TrackType_t xTrackType, DataFrameCallbacks_t *pCallbacks)
+{
+    return prvAddFrame(handle, pBuf, uHeadroom, uDataLen, uBufSize, uTimestamp, xTrackType, NULL, pCallbacks);
+}
+
+int KvsApp_addVideoFrameWithFrameInfo(
+    KvsAppHandle handle,
+    uint8_t *pData,
+    size_t uDataLen,
+    size_t uDataSize,
+    uint64_t uTimestamp,
+    const NaluFrameInfo_t *pxFrameInfo,
+    DataFrameCallbacks_t *pCallbacks)
+{
+    return prvAddFrame(handle, pData, 0, uDataLen, uDataSize, uTimestamp, TRACK_VIDEO, pxFrameInfo, pCallbacks);
+}
+
+/**
+ * @brief Analyze a segment of a video frame and convert it to AVCC in place. Parameter sets are checked per segment,
+ * because they usually come in a segment of their own rather than the one of the key frame.
+ */
+static int prvAddVideoSegment(KvsApp_t *pKvs, DataFrameSegment_t *pxSegment, bool *pbIsKeyFrame, bool *pbIsNonReference)
+{
+    int res = KVS_ERRNO_NONE;
+    NaluFrameInfo_t xFrameInfo = {0};
+    uint32_t uAvccLen = 0;
+
+    if ((res = prvAnalyzeVideoFrame(pKvs, pxSegment->pData, pxSegment->uLen, &xFrameInfo)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to analyze video segment");
+        /* Propagate the res error */
+    }
+    else if (
+        (xFrameInfo.bIsAnnexB || pKvs->uNaluFilterMask != 0) &&
+        (res = NALU_convertAnnexBToAvccWithFrameInfo(pxSegment->pData, (uint32_t)(pxSegment->uLen), &xFrameInfo, pKvs->uNaluFilterMask, &uAvccLen)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to convert Annex-B to Avcc in place");
+        /* Propagate the res error */
+    }
+    else if ((res = checkAndBuildStream(pKvs, pxSegment->pData, &xFrameInfo, TRACK_VIDEO)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to build stream buffer");
+        /* Propagate the res error */
+    }
+    else if (pKvs->xStreamHandle != NULL && pKvs->pSps != NULL && (res = prvCheckParameterSetsChanged(pKvs, pxSegment->pData, &xFrameInfo)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        if (xFrameInfo.bIsAnnexB || pKvs->uNaluFilterMask != 0)
+        {
+            pxSegment->uLen = uAvccLen;
+        }
+        *pbIsKeyFrame = *pbIsKeyFrame || xFrameInfo.bIsKeyFrame;
+
+        /* Slices of a picture share nal_ref_idc, so a non-reference segment makes a non-reference frame. */
+        *pbIsNonReference = *pbIsNonReference || xFrameInfo.bIsNonReference;
+    }
+
+    return res;
+}
+
+static size_t prvSegmentsLen(const DataFrameSegment_t *pxSegments, size_t uSegmentCount)
+{
+    size_t uLen = 0;
+    size_t i = 0;
+
+    for (i = 0; i < uSegmentCount; i++)
+    {
+        uLen += pxSegments[i].uLen;
+    }
+
+    return uLen;
+}
+
+int KvsApp_addFrameV(KvsAppHandle handle, const DataFrameSegment_t *pxSegments, size_t uSegmentCount, uint64_t uTimestamp, TrackType_t xTrackType, DataFrameCallbacks_t *pCallbacks)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+    DataFrameIn_t xDataFrameIn = {0};
+    DataFrameUserData_t xUserData = {0};
+    DataFrameSegment_t xSegments[DATA_FRAME_MAX_SEGMENTS];
+    bool bIsKeyFrame = false;
+    bool bIsNonReference = false;
+    size_t i = 0;
+
+    if (pKvs == NULL || pxSegments == NULL || uSegmentCount == 0 || uSegmentCount > DATA_FRAME_MAX_SEGMENTS)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (!KVS_CONFIG_AUDIO && xTrackType == TRACK_AUDIO)
+    {
+        res = KVS_ERROR_FEATURE_NOT_ENABLED;
+        LogError("Audio is not enabled");
+    }
+    else if (pKvs->bAudioOnly && xTrackType == TRACK_VIDEO)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Video frames are not accepted by an audio-only stream");
+    }
+    else if (uTimestamp < prvEarliestTimestampGet(pKvs))
+    {
+        res = KVS_ERROR_ADD_FRAME_WHOSE_TIMESTAMP_GOES_BACK;
+    }
+    else
+    {
+        /* The segments may be shortened by the conversion, so the caller's list is kept as it is. */
+        memcpy(xSegments, pxSegments, uSegmentCount * sizeof(DataFrameSegment_t));
+        for (i = 0; i < uSegmentCount && res == KVS_ERRNO_NONE; i++)
+        {
+            if (xSegments[i].pData == NULL || xSegments[i].uLen == 0)
+            {
+                res = KVS_ERROR_INVALID_ARGUMENT;
+            }
+            else if (xTrackType == TRACK_VIDEO)
+            {
+                res = prvAddVideoSegment(pKvs, &(xSegments[i]), &bIsKeyFrame, &bIsNonReference);
+            }
+            else
+            {
+                /* nop */
+            }
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (xTrackType == TRACK_AUDIO && (res = checkAndBuildStream(pKvs, NULL, NULL, TRACK_AUDIO)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to build stream buffer");
+        /* Propagate the res error */
+    }
+    else if (pKvs->xStreamHandle == NULL)
+    {
+        res = KVS_ERROR_STREAM_NOT_READY;
+    }
+    else
+    {
+        xDataFrameIn.pxSegments = xSegments;
+        xDataFrameIn.uSegmentCount = uSegmentCount;
+        xDataFrameIn.uDataLen = prvSegmentsLen(xSegments, uSegmentCount);
+        xDataFrameIn.bIsKeyFrame = bIsKeyFrame;
+        xDataFrameIn.uTimestampMs = uTimestamp;
+        xDataFrameIn.xTrackType = xTrackType;
+        xDataFrameIn.bIsDisposable = prvIsDataFrameDisposable(pKvs, &xDataFrameIn, bIsNonReference);
+        xUserData.uSegmentId = pKvs->uSegmentId;
+        xUserData.uBudgetBytes = xDataFrameIn.uDataLen;
+
+        /* The segments are owned by the application, so there is no default callback that frees them. */
+        if (pCallbacks != NULL)
+        {
+            memcpy(&(xUserData.xCallbacks), pCallbacks, sizeof(DataFrameCallbacks_t));
+        }
+        xDataFrameIn.pUserData = &xUserData;
+
+#if KVS_CONFIG_AUDIO
+        /* Frames of segments are never laced, so an audio one closes the lace to keep the order. */
+        prvAudioLaceFlushIfDue(pKvs, uTimestamp, xTrackType == TRACK_AUDIO);
+#endif
+
+        res = prvAddDataFrameInWithCluster(pKvs, &xDataFrameIn);
+    }
+
+    if (res != KVS_ERRNO_NONE && pxSegments != NULL && uSegmentCount > 0 && pCallbacks != NULL && pCallbacks->onDataFrameTerminateInfo.onDataFrameTerminate != NULL)
+    {
+        retVal = pCallbacks->onDataFrameTerminateInfo.onDataFrameTerminate(pxSegments[0].pData, prvSegmentsLen(pxSegments, uSegmentCount), uTimestamp, xTrackType, pCallbacks->onDataFrameTerminateInfo.pAppData);
+        if (retVal != 0)
+        {
+            res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+        }
+    }
+
+    return res;
+}
+
+static int prvMetricsGet(KvsApp_t *pKvs, KvsAppMetrics_t *pxMetrics)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIoStats_t xStats = {0};
+    KvsAllocStats_t xAllocStats = {0};
+
+    if (Lock(pKvs->xMetricsLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        memcpy(pxMetrics, &(pKvs->xMetrics), sizeof(KvsAppMetrics_t));
+        Unlock(pKvs->xMetricsLock);
+
+        /* Records of the active connection are added on the fly, and the others are added when they're finished. The
+         * connection is swapped out under xConnLock before it's closed. */
+        if (Lock(pKvs->xConnLock) == LOCK_OK)
+        {
+            if (pKvs->xPutMediaHandle != NULL && Kvs_putMediaGetNetIoStats(pKvs->xPutMediaHandle, &xStats) == KVS_ERRNO_NONE)
+            {
+                pxMetrics->uTlsRecordCount += xStats.uTlsRecordsSent;
+            }
+            Unlock(pKvs->xConnLock);
+        }
+        if (kvsAllocTraceGetStats(&xAllocStats) == KVS_ERRNO_NONE)
+        {
+            pxMetrics->uAllocPeakBytes = xAllocStats.uPeakLiveBytes;
+        }
+    }
+
+    return res;
+}
+
+static void prvMetricsPushIfDue(KvsApp_t *pKvs)
+{
+    int retVal = 0;
+    uint64_t uNowMs = getMonotonicTimeInMs();
+    KvsAppMetrics_t xMetrics = {0};
+
+    if (pKvs->onMetricsCallbackInfo.onMetrics != NULL && uNowMs >= pKvs->uNextMetricsMs)
+    {
+        pKvs->uNextMetricsMs = uNowMs + pKvs->uMetricsIntervalMs;
+        if (prvMetricsGet(pKvs, &xMetrics) == KVS_ERRNO_NONE &&
+            (retVal = pKvs->onMetricsCallbackInfo.onMetrics(&xMetrics, pKvs->onMetricsCallbackInfo.pAppData)) != 0)
+        {
+            LogInfo("OnMetrics returned %d", retVal);
+        }
+    }
+}
+
+int KvsApp_doWork(KvsAppHandle handle)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        res = prvPutMediaDoWorkDefault(pKvs);
+        prvMetricsPushIfDue(pKvs);
+        prvCheckpointSaveIfDue(pKvs, false);
+    }
+
+    return res;
+}
+
+int KvsApp_doWorkEx(KvsAppHandle handle, DoWorkExParamter_t *pPara)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        if (pPara == NULL || pPara->eType == DO_WORK_DEFAULT)
+        {
+            res = prvPutMediaDoWorkDefault(pKvs);
+        }
+        else if (pPara->eType == DO_WORK_SEND_END_OF_FRAMES)
+        {
+            res = prvPutMediaDoWorkSendEndOfFrames(pKvs);
+        }
+        else
+        {
+            res = KVS_ERROR_KVSAPP_UNKNOWN_DO_WORK_TYPE;
+        }
+        prvMetricsPushIfDue(pKvs);
+        prvCheckpointSaveIfDue(pKvs, false);
+    }
+
+    return res;
+}
+
+int KvsApp_readFragmentAck(KvsAppHandle handle, ePutMediaFragmentAckEventType *peAckEventType, uint64_t *puFragmentTimecode, unsigned int *puErrorId)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        res = Kvs_putMediaReadFragmentAck(pKvs->xPutMediaHandle, peAckEventType, puFragmentTimecode, puErrorId);
+    }
+
+    return res;
+}
+
+size_t KvsApp_getStreamMemStatTotal(KvsAppHandle handle)
+{
+    size_t uMemTotal = 0;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs != NULL && pKvs->xStreamHandle != NULL && Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotal) == KVS_ERRNO_NONE)
+    {
+        return uMemTotal;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+int KvsApp_getStreamStats(KvsAppHandle handle, KvsAppStreamStats_t *pxStats)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL || pxStats == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        memset(pxStats, 0, sizeof(KvsAppStreamStats_t));
+        if (pKvs->xStreamHandle != NULL && (res = Kvs_streamGetStats(pKvs->xStreamHandle, &(pxStats->xStreamStats), false)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to get stream stats");
+            /* Propagate the res error */
+        }
+        else
+        {
+            pxStats->uEvictedFrameCount = __atomic_load_n(&(pKvs->uEvictedFrameCount), __ATOMIC_RELAXED);
+            pxStats->uSentFrameCount = pKvs->uSentFrameCount;
+            pxStats->uUplinkBps = pKvs->uUplinkBps;
+        }
+    }
+
+    return res;
+}
+
+int KvsApp_getLatencyStats(KvsAppHandle handle, KvsAppLatencyStats_t *pxStats)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL || pxStats == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (Lock(pKvs->xLatencyLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        memset(pxStats, 0, sizeof(KvsAppLatencyStats_t));
+        prvLatencyCopy(pKvs, LATENCY_STAGE_SENT, &(pxStats->xSent));
+        prvLatencyCopy(pKvs, LATENCY_STAGE_BUFFERING, &(pxStats->xBuffering));
+        prvLatencyCopy(pKvs, LATENCY_STAGE_RECEIVED, &(pxStats->xReceived));
+        prvLatencyCopy(pKvs, LATENCY_STAGE_PERSISTED, &(pxStats->xPersisted));
+        Unlock(pKvs->xLatencyLock);
+    }
+
+    return res;
+}
+
+int KvsApp_resetStreamStats(KvsAppHandle handle)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+    StreamStats_t xStreamStats = {0};
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        if (pKvs->xStreamHandle != NULL && (res = Kvs_streamGetStats(pKvs->xStreamHandle, &xStreamStats, true)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to reset stream stats");
+            /* Propagate the res error */
+        }
+        else
+        {
+            __atomic_store_n(&(pKvs->uEvictedFrameCount), 0, __ATOMIC_RELAXED);
+            pKvs->uSentFrameCount = 0;
+        }
+
+        if (Lock(pKvs->xLatencyLock) == LOCK_OK)
+        {
+            Kvs_latencyTrackerReset(pKvs->xLatencyTracker);
+            Unlock(pKvs->xLatencyLock);
+        }
+    }
+
+    return res;
+}
+
+int KvsApp_getMetrics(KvsAppHandle handle, KvsAppMetrics_t *pxMetrics)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL || pxMetrics == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        res = prvMetricsGet(pKvs, pxMetrics);
+    }
+
+    return res;
+}
+
+int KvsApp_acquireKeyframeSnapshot(KvsAppHandle handle, KvsAppSnapshotHandle *pxSnapshotHandle, KvsAppSnapshot_t *pxSnapshot)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+    KeyframeSnapshot_t *pxKeyframeSnapshot = NULL;
+
+    if (pKvs == NULL || pxSnapshotHandle == NULL || pxSnapshot == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (Lock(pKvs->xSnapshotLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        if ((pxKeyframeSnapshot = pKvs->pxSnapshot) != NULL)
+        {
+            __atomic_add_fetch(&(pxKeyframeSnapshot->uRefCnt), 1, __ATOMIC_RELAXED);
+        }
+        Unlock(pKvs->xSnapshotLock);
+
+        if (pxKeyframeSnapshot == NULL)
+        {
+            res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
+        }
+        else
+        {
+            memcpy(pxSnapshot, &(pxKeyframeSnapshot->xInfo), sizeof(KvsAppSnapshot_t));
+            *pxSnapshotHandle = (KvsAppSnapshotHandle)pxKeyframeSnapshot;
+        }
+    }
+
+    return res;
+}
+
+void KvsApp_releaseKeyframeSnapshot(KvsAppSnapshotHandle xSnapshotHandle)
+{
+    prvKeyframeSnapshotRelease((KeyframeSnapshot_t *)xSnapshotHandle);
+}
+
+int KvsApp_setOnMetricsCallback(KvsAppHandle handle, OnMetricsCallback_t onMetrics, unsigned int uIntervalMs, void *pAppData)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL || (onMetrics != NULL && uIntervalMs == 0))
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        pKvs->onMetricsCallbackInfo.onMetrics = onMetrics;
+        pKvs->onMetricsCallbackInfo.pAppData = pAppData;
+        pKvs->uMetricsIntervalMs = uIntervalMs;
+        pKvs->uNextMetricsMs = getMonotonicTimeInMs() + uIntervalMs;
+    }
+
+    return res;
+}
+
+int KvsApp_setOnMkvSentCallback(KvsAppHandle handle, OnMkvSentCallback_t onMkvSentCallback, void *pAppData)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        pKvs->onMkvSentCallbackInfo.onMkvSentCallback = onMkvSentCallback;
+        pKvs->onMkvSentCallbackInfo.pAppData = pAppData;
     }
 
     return res;
 }
 
-int KvsApp_open(KvsAppHandle handle)
+int KvsApp_setOnDataEndpointUpdatedCallback(KvsAppHandle handle, OnDataEndpointUpdatedCallback_t onDataEndpointUpdated, void *pAppData)
 {
     int res = KVS_ERRNO_NONE;
     KvsApp_t *pKvs = (KvsApp_t *)handle;
-    unsigned int uHttpStatusCode = 0;
 
     if (pKvs == NULL)
     {
@@ -1311,46 +6235,16 @@ int KvsApp_open(KvsAppHandle handle)
     }
     else
     {
-        updateIotCredential(pKvs);
-        if ((res = updateAndVerifyRestfulReqParameters(pKvs)) != KVS_ERRNO_NONE)
-        {
-            LogError("Failed to setup KVS");
-            /* Propagate the res error */
-        }
-        else if ((res = setupDataEndpoint(pKvs)) != KVS_ERRNO_NONE)
-        {
-            LogError("Failed to setup data endpoint");
-            /* Propagate the res error */
-        }
-        else if ((res = Kvs_putMediaStart(&(pKvs->xServicePara), &(pKvs->xPutMediaPara), &uHttpStatusCode, &(pKvs->xPutMediaHandle))) != KVS_ERRNO_NONE)
-        {
-            LogError("Failed to setup PUT MEDIA");
-            /* Propagate the res error */
-        }
-        else if (uHttpStatusCode != 200)
-        {
-            res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
-            LogError("PUT MEDIA http status code:%d\n", uHttpStatusCode);
-        }
-        else
-        {
-            if ((res = createStream(pKvs)) != KVS_ERRNO_NONE)
-            {
-                LogError("Failed to setup KVS stream");
-                /* Propagate the res error */
-            }
-        }
+        pKvs->onDataEndpointUpdatedCallbackInfo.onDataEndpointUpdated = onDataEndpointUpdated;
+        pKvs->onDataEndpointUpdatedCallbackInfo.pAppData = pAppData;
     }
 
     return res;
 }
 
-int KvsApp_close(KvsAppHandle handle)
+int KvsApp_setOnBitrateHintCallback(KvsAppHandle handle, OnBitrateHintCallback_t onBitrateHint, void *pAppData)
 {
     int res = KVS_ERRNO_NONE;
-    DataFrameHandle xDataFrameHandle = NULL;
-    DataFrameIn_t *pDataFrameIn = NULL;
-
     KvsApp_t *pKvs = (KvsApp_t *)handle;
 
     if (pKvs == NULL)
@@ -1359,131 +6253,72 @@ int KvsApp_close(KvsAppHandle handle)
     }
     else
     {
-        if (pKvs->xPutMediaHandle != NULL)
-        {
-            if (Lock(pKvs->xLock) != LOCK_OK)
-            {
-                res = KVS_ERROR_LOCK_ERROR;
-                LogError("Failed to lock");
-            }
-            else
-            {
-                Kvs_putMediaFinish(pKvs->xPutMediaHandle);
-                pKvs->xPutMediaHandle = NULL;
-                pKvs->isEbmlHeaderUpdated = false;
-                Unlock(pKvs->xLock);
-            }
-        }
+        pKvs->onBitrateHintCallbackInfo.onBitrateHint = onBitrateHint;
+        pKvs->onBitrateHintCallbackInfo.pAppData = pAppData;
     }
 
     return res;
 }
 
-int KvsApp_addFrame(KvsAppHandle handle, uint8_t *pData, size_t uDataLen, size_t uDataSize, uint64_t uTimestamp, TrackType_t xTrackType)
-{
-    return KvsApp_addFrameWithCallbacks(handle, pData, uDataLen, uDataSize, uTimestamp, xTrackType, NULL);
-}
-
-int KvsApp_addFrameWithCallbacks(KvsAppHandle handle, uint8_t *pData, size_t uDataLen, size_t uDataSize, uint64_t uTimestamp, TrackType_t xTrackType, DataFrameCallbacks_t *pCallbacks)
+int KvsApp_setOnBackpressureCallback(KvsAppHandle handle, OnBackpressureCallback_t onBackpressure, void *pAppData)
 {
     int res = KVS_ERRNO_NONE;
-    int retVal = 0;
     KvsApp_t *pKvs = (KvsApp_t *)handle;
-    DataFrameIn_t xDataFrameIn = {0};
-    DataFrameUserData_t *pUserData = NULL;
 
-    if (pKvs == NULL || pData == NULL || uDataLen == 0)
+    if (pKvs == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
     }
-    else if (uTimestamp < pKvs->uEarliestTimestamp)
-    {
-        res = KVS_ERROR_ADD_FRAME_WHOSE_TIMESTAMP_GOES_BACK;
-    }
-    else if (
-        xTrackType == TRACK_VIDEO && NALU_isAnnexBFrame(pData, uDataLen) &&
-        (res = NALU_convertAnnexBToAvccInPlace(pData, uDataLen, uDataSize, (uint32_t *)&uDataLen)) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed to convert Annex-B to Avcc in place");
-        /* Propagate the res error */
-    }
-    else if ((res = checkAndBuildStream(pKvs, pData, uDataLen, xTrackType)) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed to build stream buffer");
-        /* Propagate the res error */
-    }
-    else if (pKvs->xStreamHandle == NULL)
+    else
     {
-        res = KVS_ERROR_STREAM_NOT_READY;
+        pKvs->onBackpressureCallbackInfo.onBackpressure = onBackpressure;
+        pKvs->onBackpressureCallbackInfo.pAppData = pAppData;
     }
-    else if ((pUserData = (DataFrameUserData_t *)kvsMalloc(sizeof(DataFrameUserData_t))) == NULL)
+
+    return res;
+}
+
+int KvsApp_setOnFragmentAckCallback(KvsAppHandle handle, OnFragmentAckCallback_t onFragmentAck, void *pAppData)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
+
+    if (pKvs == NULL)
     {
-        res = KVS_ERROR_OUT_OF_MEMORY;
-        LogError("OOM: pUserData");
+        res = KVS_ERROR_INVALID_ARGUMENT;
     }
     else
     {
-        xDataFrameIn.pData = (char *)pData;
-        xDataFrameIn.uDataLen = uDataLen;
-        xDataFrameIn.bIsKeyFrame = (xTrackType == TRACK_VIDEO) ? isKeyFrame(pData, uDataLen) : false;
-        xDataFrameIn.uTimestampMs = uTimestamp;
-        xDataFrameIn.xTrackType = xTrackType;
-        xDataFrameIn.xClusterType = (xDataFrameIn.bIsKeyFrame) ? MKV_CLUSTER : MKV_SIMPLE_BLOCK;
+        pKvs->onFragmentAckCallbackInfo.onFragmentAck = onFragmentAck;
+        pKvs->onFragmentAckCallbackInfo.pAppData = pAppData;
+        pKvs->xPutMediaPara.bFragmentAckCallbackOnly = (onFragmentAck != NULL);
+    }
 
-        memset(pUserData, 0, sizeof(DataFrameUserData_t));
-        if (pCallbacks == NULL)
-        {
-            /* Assign default callbacks. */
-            pUserData->xCallbacks.onDataFrameTerminateInfo.onDataFrameTerminate = defaultOnDataFrameTerminate;
-            pUserData->xCallbacks.onDataFrameTerminateInfo.pAppData = NULL;
-            pUserData->xCallbacks.onDataFrameToBeSentInfo.onDataFrameToBeSent = NULL;
-            pUserData->xCallbacks.onDataFrameToBeSentInfo.pAppData = NULL;
-        }
-        else
-        {
-            memcpy(&(pUserData->xCallbacks), pCallbacks, sizeof(DataFrameCallbacks_t));
-        }
-        xDataFrameIn.pUserData = pUserData;
+    return res;
+}
 
-        if (pKvs->xStrategy.xPolicy == STREAM_POLICY_RING_BUFFER)
-        {
-            prvStreamFlushHeadUntilMem(pKvs, pKvs->xStrategy.xRingBufferPara.uMemLimit);
-        }
+int KvsApp_getBackpressure(KvsAppHandle handle, KvsAppBackpressure_t *pxLevel, unsigned int *puPercent)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)handle;
 
-        if (Kvs_streamAddDataFrame(pKvs->xStreamHandle, &xDataFrameIn) == NULL)
-        {
-            res = KVS_ERROR_FAIL_TO_ADD_DATA_FRAME_TO_STREAM;
-            LogError("Failed to add data frame");
-        }
+    if (pKvs == NULL || pxLevel == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
     }
-
-    if (res != KVS_ERRNO_NONE)
+    else
     {
-        if (pData != NULL)
+        *pxLevel = __atomic_load_n(&(pKvs->xBackpressure), __ATOMIC_RELAXED);
+        if (puPercent != NULL)
         {
-            if (pCallbacks != NULL && pCallbacks->onDataFrameTerminateInfo.onDataFrameTerminate != NULL)
-            {
-                retVal = pCallbacks->onDataFrameTerminateInfo.onDataFrameTerminate(pData, uDataLen, uTimestamp, xTrackType, NULL);
-            }
-            else
-            {
-                retVal = defaultOnDataFrameTerminate(pData, uDataLen, uTimestamp, xTrackType, NULL);
-            }
-            if (retVal != 0)
-            {
-                res = KVS_GENERATE_CALLBACK_ERROR(retVal);
-            }
-        }
-        if (pUserData != NULL)
-        {
-            kvsFree(pUserData);
+            *puPercent = __atomic_load_n(&(pKvs->uBackpressurePercent), __ATOMIC_RELAXED);
         }
     }
 
     return res;
 }
 
-int KvsApp_doWork(KvsAppHandle handle)
+int KvsApp_setSharedWakeEvent(KvsAppHandle handle, KvsEventHandle xWakeEvent)
 {
     int res = KVS_ERRNO_NONE;
     KvsApp_t *pKvs = (KvsApp_t *)handle;
@@ -1494,41 +6329,99 @@ int KvsApp_doWork(KvsAppHandle handle)
     }
     else
     {
-        res = prvPutMediaDoWorkDefault(pKvs);
+        pKvs->xSharedWakeEvent = xWakeEvent;
     }
 
     return res;
 }
 
-int KvsApp_doWorkEx(KvsAppHandle handle, DoWorkExParamter_t *pPara)
+static void prvWorkerRoutine(void *pArg)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsApp_t *pKvs = (KvsApp_t *)pArg;
+    unsigned int uBackoffMs = pKvs->xWorkerPara.uReconnectMinBackoffMs;
+    bool bStopping = false;
+
+    while (!bStopping)
+    {
+        if ((res = KvsApp_open(pKvs)) != KVS_ERRNO_NONE)
+        {
+            LogError("Worker failed to open, err:-%X", -res);
+        }
+        else
+        {
+            uBackoffMs = pKvs->xWorkerPara.uReconnectMinBackoffMs;
+            while (!(bStopping = kvsEventWait(pKvs->xWorkerStopEvent, 0)))
+            {
+                if ((res = KvsApp_doWork(pKvs)) != KVS_ERRNO_NONE)
+                {
+                    LogError("Worker failed to do work, err:-%X", -res);
+                    break;
+                }
+            }
+        }
+
+        KvsApp_close(pKvs);
+
+        if (!bStopping)
+        {
+            bStopping = kvsEventWait(pKvs->xWorkerStopEvent, uBackoffMs);
+            uBackoffMs = (uBackoffMs > pKvs->xWorkerPara.uReconnectMaxBackoffMs / 2) ? pKvs->xWorkerPara.uReconnectMaxBackoffMs : uBackoffMs * 2;
+        }
+    }
+}
+
+int KvsApp_startWorker(KvsAppHandle handle, KvsAppWorkerParameter_t *pxPara)
 {
     int res = KVS_ERRNO_NONE;
     KvsApp_t *pKvs = (KvsApp_t *)handle;
 
-    if (pKvs == NULL)
+    if (pKvs == NULL || (pxPara != NULL && pxPara->uReconnectMinBackoffMs > pxPara->uReconnectMaxBackoffMs))
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pKvs->xWorkerThread != NULL)
+    {
+        res = KVS_ERROR_KVSAPP_WORKER_ALREADY_STARTED;
+        LogError("Worker is already started");
     }
     else
     {
-        if (pPara == NULL || pPara->eType == DO_WORK_DEFAULT)
+        if (pxPara != NULL)
         {
-            res = prvPutMediaDoWorkDefault(pKvs);
+            memcpy(&(pKvs->xWorkerPara), pxPara, sizeof(KvsAppWorkerParameter_t));
         }
-        else if (pPara->eType == DO_WORK_SEND_END_OF_FRAMES)
+        else
         {
-            res = prvPutMediaDoWorkSendEndOfFrames(pKvs);
+            pKvs->xWorkerPara.uStackSize = 0;
+            pKvs->xWorkerPara.xCoreId = -1;
+            pKvs->xWorkerPara.uReconnectMinBackoffMs = DEFAULT_WORKER_MIN_BACKOFF_MS;
+            pKvs->xWorkerPara.uReconnectMaxBackoffMs = DEFAULT_WORKER_MAX_BACKOFF_MS;
+        }
+
+        if ((pKvs->xWorkerStopEvent = kvsEventCreate()) == NULL)
+        {
+            res = KVS_ERROR_EVENT_ERROR;
+            LogError("Failed to create event");
+        }
+        else if ((pKvs->xWorkerThread = kvsThreadCreate(prvWorkerRoutine, pKvs, pKvs->xWorkerPara.uStackSize, pKvs->xWorkerPara.xCoreId)) == NULL)
+        {
+            res = KVS_ERROR_THREAD_ERROR;
+            LogError("Failed to create worker thread");
+            kvsEventTerminate(pKvs->xWorkerStopEvent);
+            pKvs->xWorkerStopEvent = NULL;
         }
         else
         {
-            res = KVS_ERROR_KVSAPP_UNKNOWN_DO_WORK_TYPE;
+            /* nop */
         }
     }
 
     return res;
 }
 
-int KvsApp_readFragmentAck(KvsAppHandle handle, ePutMediaFragmentAckEventType *peAckEventType, uint64_t *puFragmentTimecode, unsigned int *puErrorId)
+int KvsApp_stopWorker(KvsAppHandle handle)
 {
     int res = KVS_ERRNO_NONE;
     KvsApp_t *pKvs = (KvsApp_t *)handle;
@@ -1536,44 +6429,218 @@ int KvsApp_readFragmentAck(KvsAppHandle handle, ePutMediaFragmentAckEventType *p
     if (pKvs == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pKvs->xWorkerThread != NULL)
+    {
+        kvsEventSignal(pKvs->xWorkerStopEvent);
+        /* Wake it up if it's waiting for data frames. */
+        kvsEventSignal(pKvs->xWakeEvent);
+        kvsThreadJoin(pKvs->xWorkerThread);
+        pKvs->xWorkerThread = NULL;
+        kvsEventTerminate(pKvs->xWorkerStopEvent);
+        pKvs->xWorkerStopEvent = NULL;
     }
     else
     {
-        res = Kvs_putMediaReadFragmentAck(pKvs->xPutMediaHandle, peAckEventType, puFragmentTimecode, puErrorId);
+        /* nop */
     }
 
     return res;
 }
 
-size_t KvsApp_getStreamMemStatTotal(KvsAppHandle handle)
+typedef struct UploadContext
 {
-    size_t uMemTotal = 0;
-    KvsApp_t *pKvs = (KvsApp_t *)handle;
+    KvsApp_t *pKvs;
+    uint64_t uPersistedTimecodeMs;
+} UploadContext_t;
 
-    if (pKvs != NULL && pKvs->xStreamHandle != NULL && Kvs_streamMemStatTotal(pKvs->xStreamHandle, &uMemTotal) == KVS_ERRNO_NONE)
+static void prvOnUploadFragmentAck(ePutMediaFragmentAckEventType eAckEventType, uint64_t uFragmentTimecode, unsigned int uErrorId, void *pAppData)
+{
+    UploadContext_t *pxUpload = (UploadContext_t *)pAppData;
+    KvsApp_t *pKvs = pxUpload->pKvs;
+
+    if (eAckEventType <= eIdle && Lock(pKvs->xMetricsLock) == LOCK_OK)
     {
-        return uMemTotal;
+        pKvs->xMetrics.puAckCount[eAckEventType]++;
+        Unlock(pKvs->xMetricsLock);
+    }
+
+    if (eAckEventType == ePersisted && uFragmentTimecode > pxUpload->uPersistedTimecodeMs)
+    {
+        pxUpload->uPersistedTimecodeMs = uFragmentTimecode;
+    }
+
+    if (pKvs->onFragmentAckCallbackInfo.onFragmentAck != NULL)
+    {
+        pKvs->onFragmentAckCallbackInfo.onFragmentAck(eAckEventType, uFragmentTimecode, uErrorId, pKvs->onFragmentAckCallbackInfo.pAppData);
+    }
+}
+
+/**
+ * @brief Send the clusters of an MKV file that are newer than the persisted timecode, and wait until the last one is
+ * persisted.
+ */
+static int prvUploadMkvFile(KvsApp_t *pKvs, MkvFileHandle xMkvFile, size_t uChunkSize, unsigned int uAckTimeoutMs, uint64_t uLastTimecodeMs, UploadContext_t *pxUpload)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsPutMediaParameter_t xPutMediaPara = pKvs->xPutMediaPara;
+    PutMediaHandle xPutMediaHandle = NULL;
+    unsigned int uHttpStatusCode = 0;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+    uint64_t uStartMs = 0;
+    uint64_t uNowMs = 0;
+    uint64_t uDeadlineMs = 0;
+
+    /* Clusters of recorder files have the absolute timecodes that were streamed, so they're sent as they are. */
+    xPutMediaPara.xTimecodeType = TIMECODE_TYPE_ABSOLUTE;
+    xPutMediaPara.onFragmentAck = prvOnUploadFragmentAck;
+    xPutMediaPara.pFragmentAckAppData = pxUpload;
+    xPutMediaPara.bFragmentAckCallbackOnly = true;
+
+    updateIotCredential(pKvs);
+    if ((res = updateAndVerifyRestfulReqParameters(pKvs)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to setup KVS");
+        /* Propagate the res error */
+    }
+    else if ((res = setupDataEndpoint(pKvs)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to setup data endpoint");
+        /* Propagate the res error */
     }
     else
     {
-        return 0;
+        uStartMs = getMonotonicTimeInMs();
+        res = Kvs_putMediaStart(&(pKvs->xServicePara), &xPutMediaPara, &uHttpStatusCode, &xPutMediaHandle);
+        prvMetricsAddRest(pKvs, KVS_APP_REST_PUT_MEDIA, uStartMs, res != KVS_ERRNO_NONE || uHttpStatusCode != 200);
+
+        if (res != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to setup upload PUT MEDIA");
+            /* The endpoint may be unreachable. */
+            prvDataEndpointInvalidate(pKvs);
+            /* Propagate the res error */
+        }
+        else if (uHttpStatusCode != 200)
+        {
+            res = KVS_GENERATE_RESTFUL_ERROR(uHttpStatusCode);
+            LogError("Upload PUT MEDIA http status code:%d\n", uHttpStatusCode);
+        }
+        else if ((res = Kvs_mkvFileGetEbmlSegHdr(xMkvFile, &pData, &uDataLen)) != KVS_ERRNO_NONE ||
+                 (res = Kvs_putMediaUpdateRaw(xPutMediaHandle, pData, uDataLen)) != KVS_ERRNO_NONE)
+        {
+            LogError("Failed to send MKV header of upload");
+            /* Propagate the res error */
+        }
+        else if ((res = Kvs_mkvFileSeek(xMkvFile, pxUpload->uPersistedTimecodeMs)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else
+        {
+            /* Clusters are sent in large chunks right from the file, and acks are read between them. */
+            while ((res = Kvs_mkvFileRead(xMkvFile, uChunkSize, &pData, &uDataLen)) == KVS_ERRNO_NONE)
+            {
+                if ((res = Kvs_putMediaUpdateRaw(xPutMediaHandle, pData, uDataLen)) != KVS_ERRNO_NONE ||
+                    (res = Kvs_putMediaDoWork(xPutMediaHandle)) != KVS_ERRNO_NONE)
+                {
+                    LogError("Failed to upload MKV file");
+                    break;
+                }
+            }
+
+            /* The end of the body lets the server ack the last fragment, instead of waiting for the next one. */
+            if (res == KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME)
+            {
+                res = Kvs_putMediaEnd(xPutMediaHandle);
+            }
+
+            uDeadlineMs = getMonotonicTimeInMs() + uAckTimeoutMs;
+            while (res == KVS_ERRNO_NONE && pxUpload->uPersistedTimecodeMs < uLastTimecodeMs)
+            {
+                uNowMs = getMonotonicTimeInMs();
+                if (uNowMs >= uDeadlineMs)
+                {
+                    res = KVS_ERROR_KVSAPP_UPLOAD_ACK_TIMEOUT;
+                    LogError("Timeout waiting for the last fragment of upload to be persisted");
+                }
+                else
+                {
+                    kvsEventWaitSocket(pKvs->xWakeEvent, Kvs_putMediaGetSocket(xPutMediaHandle), (uint32_t)(uDeadlineMs - uNowMs));
+                    res = Kvs_putMediaDoWork(xPutMediaHandle);
+                }
+            }
+
+            /* The server may close the connection right after the last ack. */
+            if (pxUpload->uPersistedTimecodeMs >= uLastTimecodeMs)
+            {
+                res = KVS_ERRNO_NONE;
+            }
+        }
+    }
+
+    if (xPutMediaHandle != NULL)
+    {
+        prvPutMediaFinish(pKvs, xPutMediaHandle);
     }
+
+    return res;
 }
 
-int KvsApp_setOnMkvSentCallback(KvsAppHandle handle, OnMkvSentCallback_t onMkvSentCallback, void *pAppData)
+int KvsApp_uploadMkvFile(KvsAppHandle handle, const char *pcFilename, KvsAppUploadParameter_t *pxPara)
 {
     int res = KVS_ERRNO_NONE;
     KvsApp_t *pKvs = (KvsApp_t *)handle;
-
-    if (pKvs == NULL)
+    MkvFileHandle xMkvFile = NULL;
+    UploadContext_t xUpload = {0};
+    size_t uChunkSize = DEFAULT_UPLOAD_CHUNK_SIZE;
+    unsigned int uAckTimeoutMs = DEFAULT_UPLOAD_ACK_TIMEOUT_MS;
+    uint64_t uFirstTimecodeMs = 0;
+    uint64_t uLastTimecodeMs = 0;
+
+    if (pKvs == NULL || pcFilename == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pKvs->xPutMediaHandle != NULL || pKvs->xPendingPutMediaHandle != NULL || pKvs->xWorkerThread != NULL)
+    {
+        res = KVS_ERROR_KVSAPP_UPLOAD_WHILE_OPEN;
+        LogError("Can't upload while KVS application is open");
+    }
+    else if ((xMkvFile = Kvs_mkvFileOpen(pcFilename)) == NULL)
+    {
+        res = KVS_ERROR_STREAM_MKV_FILE_IO_ERROR;
+        LogError("Failed to open MKV file to upload");
     }
     else
     {
-        pKvs->onMkvSentCallbackInfo.onMkvSentCallback = onMkvSentCallback;
-        pKvs->onMkvSentCallbackInfo.pAppData = pAppData;
+        xUpload.pKvs = pKvs;
+        if (pxPara != NULL)
+        {
+            uChunkSize = (pxPara->uChunkSize > 0) ? pxPara->uChunkSize : uChunkSize;
+            uAckTimeoutMs = (pxPara->uAckTimeoutMs > 0) ? pxPara->uAckTimeoutMs : uAckTimeoutMs;
+            xUpload.uPersistedTimecodeMs = pxPara->uPersistedTimecodeMs;
+        }
+
+        if (Kvs_mkvFileGetTimecodeRange(xMkvFile, &uFirstTimecodeMs, &uLastTimecodeMs) != KVS_ERRNO_NONE || uLastTimecodeMs <= xUpload.uPersistedTimecodeMs)
+        {
+            LogInfo("Nothing left to upload in %s", pcFilename);
+        }
+        else
+        {
+            res = prvUploadMkvFile(pKvs, xMkvFile, uChunkSize, uAckTimeoutMs, uLastTimecodeMs, &xUpload);
+        }
+
+        if (pxPara != NULL)
+        {
+            pxPara->uPersistedTimecodeMs = xUpload.uPersistedTimecodeMs;
+        }
     }
 
+    Kvs_mkvFileClose(xMkvFile);
+
     return res;
 }
@@ -0,0 +1,465 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Thirdparty headers */
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+/* Public headers */
+#include "kvs/errors.h"
+#include "kvs/port.h"
+
+#include "kvs/kvsapp.h"
+#include "kvs/kvsapp_options.h"
+#include "kvs/kvsmultiapp.h"
+
+/* Internal headers */
+#include "os/allocator.h"
+
+#ifndef KVSMULTIAPP_MAX_APPS_PER_WORKER
+#define KVSMULTIAPP_MAX_APPS_PER_WORKER (16)
+#endif
+
+#define DEFAULT_MULTIAPP_WORKER_COUNT (1)
+#define DEFAULT_MULTIAPP_MIN_BACKOFF_MS (1 * 1000)
+#define DEFAULT_MULTIAPP_MAX_BACKOFF_MS (30 * 1000)
+#define DEFAULT_MULTIAPP_WAIT_TIMEOUT_MS (50)
+
+typedef struct MultiAppSlot
+{
+    KvsAppHandle xKvsApp;
+    bool bOpened;
+
+    /* The slot is not opened again before this time. */
+    uint64_t uNextOpenMs;
+    unsigned int uBackoffMs;
+} MultiAppSlot_t;
+
+typedef struct MultiAppWorker
+{
+    struct KvsMultiApp *pxMultiApp;
+
+    /* Guards the slots. It's held by the worker thread for a whole pass over the slots. */
+    LOCK_HANDLE xLock;
+    MultiAppSlot_t pxSlots[KVSMULTIAPP_MAX_APPS_PER_WORKER];
+    size_t uAppCount;
+
+    /* Shared by all KVS applications of this worker, and signaled when a data frame is added to any of them. */
+    KvsEventHandle xWakeEvent;
+    KvsEventHandle xStopEvent;
+    KvsThreadHandle xThread;
+} MultiAppWorker_t;
+
+typedef struct KvsMultiApp
+{
+    KvsMultiAppParameter_t xPara;
+
+    /* Guards adding and removing KVS applications. */
+    LOCK_HANDLE xLock;
+
+    MultiAppWorker_t *pxWorkers;
+    size_t uWorkerCount;
+} KvsMultiApp_t;
+
+static void prvSlotBackoff(KvsMultiApp_t *pxMultiApp, MultiAppSlot_t *pxSlot)
+{
+    KvsApp_close(pxSlot->xKvsApp);
+    pxSlot->bOpened = false;
+    pxSlot->uNextOpenMs = getMonotonicTimeInMs() + pxSlot->uBackoffMs;
+    pxSlot->uBackoffMs =
+        (pxSlot->uBackoffMs > pxMultiApp->xPara.uReconnectMaxBackoffMs / 2) ? pxMultiApp->xPara.uReconnectMaxBackoffMs : pxSlot->uBackoffMs * 2;
+}
+
+static void prvWorkerServiceSlot(KvsMultiApp_t *pxMultiApp, MultiAppSlot_t *pxSlot)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (!pxSlot->bOpened)
+    {
+        if (getMonotonicTimeInMs() < pxSlot->uNextOpenMs)
+        {
+            /* nop */
+        }
+        else if ((res = KvsApp_open(pxSlot->xKvsApp)) != KVS_ERRNO_NONE)
+        {
+            LogError("Multi app worker failed to open, err:-%X", -res);
+            prvSlotBackoff(pxMultiApp, pxSlot);
+        }
+        else
+        {
+            pxSlot->bOpened = true;
+        }
+    }
+    else if ((res = KvsApp_doWork(pxSlot->xKvsApp)) != KVS_ERRNO_NONE)
+    {
+        LogError("Multi app worker failed to do work, err:-%X", -res);
+        prvSlotBackoff(pxMultiApp, pxSlot);
+    }
+    else
+    {
+        /* The connection is up, so the next failure starts over from the min backoff. */
+        pxSlot->uBackoffMs = pxMultiApp->xPara.uReconnectMinBackoffMs;
+    }
+}
+
+static void prvMultiAppWorkerRoutine(void *pArg)
+{
+    MultiAppWorker_t *pxWorker = (MultiAppWorker_t *)pArg;
+    KvsMultiApp_t *pxMultiApp = pxWorker->pxMultiApp;
+    size_t i = 0;
+
+    while (!kvsEventWait(pxWorker->xStopEvent, 0))
+    {
+        if (Lock(pxWorker->xLock) != LOCK_OK)
+        {
+            LogError("Failed to lock");
+        }
+        else
+        {
+            for (i = 0; i < KVSMULTIAPP_MAX_APPS_PER_WORKER; i++)
+            {
+                if (pxWorker->pxSlots[i].xKvsApp != NULL)
+                {
+                    prvWorkerServiceSlot(pxMultiApp, &(pxWorker->pxSlots[i]));
+                }
+            }
+            Unlock(pxWorker->xLock);
+        }
+
+        /* Fragment acks are still read at least once per timeout if no data frame is added. */
+        kvsEventWait(pxWorker->xWakeEvent, pxMultiApp->xPara.uWaitTimeoutMs);
+    }
+
+    if (Lock(pxWorker->xLock) != LOCK_OK)
+    {
+        LogError("Failed to lock");
+    }
+    else
+    {
+        for (i = 0; i < KVSMULTIAPP_MAX_APPS_PER_WORKER; i++)
+        {
+            if (pxWorker->pxSlots[i].xKvsApp != NULL && pxWorker->pxSlots[i].bOpened)
+            {
+                KvsApp_close(pxWorker->pxSlots[i].xKvsApp);
+                pxWorker->pxSlots[i].bOpened = false;
+            }
+        }
+        Unlock(pxWorker->xLock);
+    }
+}
+
+static void prvWorkerTerminate(MultiAppWorker_t *pxWorker)
+{
+    size_t i = 0;
+
+    if (pxWorker->xThread != NULL)
+    {
+        kvsEventSignal(pxWorker->xStopEvent);
+        kvsEventSignal(pxWorker->xWakeEvent);
+        kvsThreadJoin(pxWorker->xThread);
+        pxWorker->xThread = NULL;
+    }
+
+    for (i = 0; i < KVSMULTIAPP_MAX_APPS_PER_WORKER; i++)
+    {
+        if (pxWorker->pxSlots[i].xKvsApp != NULL)
+        {
+            KvsApp_setSharedWakeEvent(pxWorker->pxSlots[i].xKvsApp, NULL);
+            memset(&(pxWorker->pxSlots[i]), 0, sizeof(MultiAppSlot_t));
+        }
+    }
+    pxWorker->uAppCount = 0;
+
+    if (pxWorker->xStopEvent != NULL)
+    {
+        kvsEventTerminate(pxWorker->xStopEvent);
+        pxWorker->xStopEvent = NULL;
+    }
+
+    if (pxWorker->xWakeEvent != NULL)
+    {
+        kvsEventTerminate(pxWorker->xWakeEvent);
+        pxWorker->xWakeEvent = NULL;
+    }
+
+    if (pxWorker->xLock != NULL)
+    {
+        Lock_Deinit(pxWorker->xLock);
+        pxWorker->xLock = NULL;
+    }
+}
+
+static int prvWorkerInit(KvsMultiApp_t *pxMultiApp, MultiAppWorker_t *pxWorker)
+{
+    int res = KVS_ERRNO_NONE;
+
+    memset(pxWorker, 0, sizeof(MultiAppWorker_t));
+    pxWorker->pxMultiApp = pxMultiApp;
+
+    if ((pxWorker->xLock = Lock_Init()) == NULL)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to initialize lock");
+    }
+    else if ((pxWorker->xWakeEvent = kvsEventCreate()) == NULL || (pxWorker->xStopEvent = kvsEventCreate()) == NULL)
+    {
+        res = KVS_ERROR_EVENT_ERROR;
+        LogError("Failed to create event");
+    }
+    else if ((pxWorker->xThread = kvsThreadCreate(prvMultiAppWorkerRoutine, pxWorker, pxMultiApp->xPara.uStackSize, pxMultiApp->xPara.xCoreId)) == NULL)
+    {
+        res = KVS_ERROR_THREAD_ERROR;
+        LogError("Failed to create worker thread");
+    }
+    else
+    {
+        /* nop */
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        prvWorkerTerminate(pxWorker);
+    }
+
+    return res;
+}
+
+KvsMultiAppHandle KvsMultiApp_create(KvsMultiAppParameter_t *pxPara)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsMultiApp_t *pxMultiApp = NULL;
+    size_t i = 0;
+
+    if (pxPara != NULL && (pxPara->uWorkerCount == 0 || pxPara->uReconnectMinBackoffMs > pxPara->uReconnectMaxBackoffMs))
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((pxMultiApp = (KvsMultiApp_t *)kvsMalloc(sizeof(KvsMultiApp_t))) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pxMultiApp");
+    }
+    else
+    {
+        memset(pxMultiApp, 0, sizeof(KvsMultiApp_t));
+
+        if (pxPara != NULL)
+        {
+            memcpy(&(pxMultiApp->xPara), pxPara, sizeof(KvsMultiAppParameter_t));
+        }
+        else
+        {
+            pxMultiApp->xPara.uWorkerCount = DEFAULT_MULTIAPP_WORKER_COUNT;
+            pxMultiApp->xPara.uStackSize = 0;
+            pxMultiApp->xPara.xCoreId = -1;
+            pxMultiApp->xPara.uReconnectMinBackoffMs = DEFAULT_MULTIAPP_MIN_BACKOFF_MS;
+            pxMultiApp->xPara.uReconnectMaxBackoffMs = DEFAULT_MULTIAPP_MAX_BACKOFF_MS;
+            pxMultiApp->xPara.uWaitTimeoutMs = DEFAULT_MULTIAPP_WAIT_TIMEOUT_MS;
+        }
+
+        if ((pxMultiApp->xLock = Lock_Init()) == NULL)
+        {
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to initialize lock");
+        }
+        else if ((pxMultiApp->pxWorkers = (MultiAppWorker_t *)kvsMalloc(sizeof(MultiAppWorker_t) * pxMultiApp->xPara.uWorkerCount)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: pxWorkers");
+        }
+        else
+        {
+            for (i = 0; i < pxMultiApp->xPara.uWorkerCount; i++)
+            {
+                if ((res = prvWorkerInit(pxMultiApp, &(pxMultiApp->pxWorkers[i]))) != KVS_ERRNO_NONE)
+                {
+                    break;
+                }
+                pxMultiApp->uWorkerCount++;
+            }
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        KvsMultiApp_terminate(pxMultiApp);
+        pxMultiApp = NULL;
+    }
+
+    return pxMultiApp;
+}
+
+void KvsMultiApp_terminate(KvsMultiAppHandle handle)
+{
+    KvsMultiApp_t *pxMultiApp = (KvsMultiApp_t *)handle;
+    size_t i = 0;
+
+    if (pxMultiApp != NULL)
+    {
+        if (pxMultiApp->pxWorkers != NULL)
+        {
+            for (i = 0; i < pxMultiApp->uWorkerCount; i++)
+            {
+                prvWorkerTerminate(&(pxMultiApp->pxWorkers[i]));
+            }
+            kvsFree(pxMultiApp->pxWorkers);
+        }
+
+        if (pxMultiApp->xLock != NULL)
+        {
+            Lock_Deinit(pxMultiApp->xLock);
+        }
+
+        kvsFree(pxMultiApp);
+    }
+}
+
+int KvsMultiApp_addApp(KvsMultiAppHandle handle, KvsAppHandle xKvsAppHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsMultiApp_t *pxMultiApp = (KvsMultiApp_t *)handle;
+    MultiAppWorker_t *pxWorker = NULL;
+    bool bAsyncOpen = true;
+    size_t i = 0;
+
+    if (pxMultiApp == NULL || xKvsAppHandle == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (Lock(pxMultiApp->xLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        for (i = 0; i < pxMultiApp->uWorkerCount; i++)
+        {
+            if (pxMultiApp->pxWorkers[i].uAppCount < KVSMULTIAPP_MAX_APPS_PER_WORKER &&
+                (pxWorker == NULL || pxMultiApp->pxWorkers[i].uAppCount < pxWorker->uAppCount))
+            {
+                pxWorker = &(pxMultiApp->pxWorkers[i]);
+            }
+        }
+
+        if (pxWorker == NULL)
+        {
+            res = KVS_ERROR_KVSMULTIAPP_NO_AVAILABLE_SLOT;
+            LogError("No available slot for KVS application");
+        }
+        else if ((res = KvsApp_setoption(xKvsAppHandle, OPTION_KVS_ASYNC_OPEN, (const char *)&bAsyncOpen)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else if (Lock(pxWorker->xLock) != LOCK_OK)
+        {
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to lock");
+        }
+        else
+        {
+            for (i = 0; i < KVSMULTIAPP_MAX_APPS_PER_WORKER; i++)
+            {
+                if (pxWorker->pxSlots[i].xKvsApp == NULL)
+                {
+                    KvsApp_setSharedWakeEvent(xKvsAppHandle, pxWorker->xWakeEvent);
+                    pxWorker->pxSlots[i].xKvsApp = xKvsAppHandle;
+                    pxWorker->pxSlots[i].bOpened = false;
+                    pxWorker->pxSlots[i].uNextOpenMs = 0;
+                    pxWorker->pxSlots[i].uBackoffMs = pxMultiApp->xPara.uReconnectMinBackoffMs;
+                    pxWorker->uAppCount++;
+                    break;
+                }
+            }
+            Unlock(pxWorker->xLock);
+
+            /* Open it right away rather than after the current wait. */
+            kvsEventSignal(pxWorker->xWakeEvent);
+        }
+
+        Unlock(pxMultiApp->xLock);
+    }
+
+    return res;
+}
+
+int KvsMultiApp_removeApp(KvsMultiAppHandle handle, KvsAppHandle xKvsAppHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    KvsMultiApp_t *pxMultiApp = (KvsMultiApp_t *)handle;
+    MultiAppWorker_t *pxWorker = NULL;
+    MultiAppSlot_t *pxSlot = NULL;
+    size_t i = 0;
+    size_t j = 0;
+
+    if (pxMultiApp == NULL || xKvsAppHandle == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (Lock(pxMultiApp->xLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        /* Only add and remove change the slots, so they can be searched without the worker locks. */
+        for (i = 0; i < pxMultiApp->uWorkerCount && pxSlot == NULL; i++)
+        {
+            for (j = 0; j < KVSMULTIAPP_MAX_APPS_PER_WORKER; j++)
+            {
+                if (pxMultiApp->pxWorkers[i].pxSlots[j].xKvsApp == xKvsAppHandle)
+                {
+                    pxWorker = &(pxMultiApp->pxWorkers[i]);
+                    pxSlot = &(pxWorker->pxSlots[j]);
+                    break;
+                }
+            }
+        }
+
+        if (pxSlot == NULL)
+        {
+            res = KVS_ERROR_KVSMULTIAPP_APP_NOT_FOUND;
+            LogError("KVS application is not added");
+        }
+        else if (Lock(pxWorker->xLock) != LOCK_OK)
+        {
+            res = KVS_ERROR_LOCK_ERROR;
+            LogError("Failed to lock");
+        }
+        else
+        {
+            if (pxSlot->bOpened)
+            {
+                KvsApp_close(xKvsAppHandle);
+            }
+            KvsApp_setSharedWakeEvent(xKvsAppHandle, NULL);
+            memset(pxSlot, 0, sizeof(MultiAppSlot_t));
+            pxWorker->uAppCount--;
+            Unlock(pxWorker->xLock);
+        }
+
+        Unlock(pxMultiApp->xLock);
+    }
+
+    return res;
+}
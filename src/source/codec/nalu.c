@@ -15,6 +15,13 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /* Third party headers */
 #include "azure_c_shared_utility/xlogging.h"
@@ -27,13 +34,57 @@
 #include "codec/sps_decode.h"
 #include "os/endian.h"
 
-#define MAX_NALU_COUNT_IN_A_FRAME ( 16 )
+/* A word with 0x01 in every byte, and the check of a zero byte in a word. */
+#define NALU_WORD_LSB ( (size_t)-1 / 0xFF )
+#define NALU_WORD_HAS_ZERO_BYTE(x) ( (((x) - NALU_WORD_LSB) & ~(x) & (NALU_WORD_LSB * 0x80)) != 0 )
 
-typedef struct Nal
+/**
+ * @brief Get the index of the first zero byte from uIdx to uEnd, or uEnd if there is none. uIdx must not be greater than uEnd.
+ *
+ * A start code always begins with a zero byte, so the bytes of a NALU payload are skipped 16 bytes or a word at a time.
+ */
+static size_t prvSkipToZeroByte(const uint8_t *pBuf, size_t uIdx, size_t uEnd)
 {
-    uint32_t uNalBeginIdx;
-    uint32_t uNalLen;
-} Nal_t;
+    size_t uWord = 0;
+#if defined(__SSE2__)
+    __m128i xZero = _mm_setzero_si128();
+
+    while (uEnd - uIdx >= 16 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(pBuf + uIdx)), xZero)) == 0)
+    {
+        uIdx += 16;
+    }
+#elif defined(__ARM_NEON)
+    uint64x2_t xMask;
+
+    while (uEnd - uIdx >= 16)
+    {
+        xMask = vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(pBuf + uIdx), vdupq_n_u8(0)));
+        if ((vgetq_lane_u64(xMask, 0) | vgetq_lane_u64(xMask, 1)) != 0)
+        {
+            break;
+        }
+        uIdx += 16;
+    }
+#endif
+
+    while (uEnd - uIdx >= sizeof(size_t))
+    {
+        /* It's an unaligned load that compilers turn into a single one where the CPU supports it. */
+        memcpy(&uWord, pBuf + uIdx, sizeof(size_t));
+        if (NALU_WORD_HAS_ZERO_BYTE(uWord))
+        {
+            break;
+        }
+        uIdx += sizeof(size_t);
+    }
+
+    while (uIdx < uEnd && pBuf[uIdx] != 0x00)
+    {
+        uIdx++;
+    }
+
+    return uIdx;
+}
 
 bool isKeyFrame(uint8_t *pBuf, size_t uLen)
 {
@@ -87,12 +138,46 @@ int NALU_getNaluType(uint8_t *pBuf, size_t uLen)
     return xNaluType;
 }
 
-int NALU_getNaluFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen)
+static bool prvIsNaluTypeInRange(uint8_t uNaluHdr, bool bIsHevc, uint8_t uNaluTypeMin, uint8_t uNaluTypeMax)
+{
+    uint8_t uNaluType = bIsHevc ? ((uNaluHdr >> 1) & 0x3F) : (uNaluHdr & 0x1F);
+
+    /* The forbidden_zero_bit is the first bit of both H264 and H265 NALU header. */
+    return (uNaluHdr & 0x80) == 0 && uNaluType >= uNaluTypeMin && uNaluType <= uNaluTypeMax;
+}
+
+static int prvGetNaluFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, bool bIsHevc, uint8_t uNaluTypeMin, uint8_t uNaluTypeMax, uint8_t **ppNalu, size_t *puNaluLen)
 {
     int res = KVS_ERRNO_NONE;
     uint32_t uAvccIdx = 0;
     uint32_t uNaluLen = 0;
 
+    while (uAvccIdx < uAvccLen - 4)
+    {
+        uNaluLen = (pAvccBuf[uAvccIdx] << 24 ) | ( pAvccBuf[uAvccIdx+1] << 16 ) | (pAvccBuf[uAvccIdx+2] << 8 ) | pAvccBuf[uAvccIdx+3];
+        uAvccIdx += 4;
+
+        if (prvIsNaluTypeInRange(pAvccBuf[uAvccIdx], bIsHevc, uNaluTypeMin, uNaluTypeMax))
+        {
+            *ppNalu = pAvccBuf + uAvccIdx;
+            *puNaluLen = uNaluLen;
+            break;
+        }
+        uAvccIdx += uNaluLen;
+    }
+
+    if (uAvccIdx >= uAvccLen)
+    {
+        res = KVS_ERROR_AVCC_NALU_IS_BROKEN;
+    }
+
+    return res;
+}
+
+int NALU_getNaluFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen)
+{
+    int res = KVS_ERRNO_NONE;
+
     if (pAvccBuf == NULL || uAvccLen < 5 || uNaluType == 0 || uNaluType >= 32 || ppNalu == NULL || puNaluLen == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
@@ -100,71 +185,84 @@ int NALU_getNaluFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t uNaluT
     }
     else
     {
-        while (uAvccIdx < uAvccLen - 4)
+        res = prvGetNaluFromAvccNalus(pAvccBuf, uAvccLen, false, uNaluType, uNaluType, ppNalu, puNaluLen);
+    }
+
+    return res;
+}
+
+int NALU_getHevcNaluFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pAvccBuf == NULL || uAvccLen < 6 || uNaluType >= 64 || ppNalu == NULL || puNaluLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        res = prvGetNaluFromAvccNalus(pAvccBuf, uAvccLen, true, uNaluType, uNaluType, ppNalu, puNaluLen);
+    }
+
+    return res;
+}
+
+bool NALU_isNonReferenceFrame(uint8_t *pAvccBuf, size_t uAvccLen)
+{
+    bool bIsNonReference = false;
+    size_t uAvccIdx = 0;
+    uint32_t uNaluLen = 0;
+    uint8_t uNaluType = 0;
+
+    if (pAvccBuf != NULL)
+    {
+        while (uAvccLen >= 5 && uAvccIdx < uAvccLen - 4)
         {
             uNaluLen = (pAvccBuf[uAvccIdx] << 24 ) | ( pAvccBuf[uAvccIdx+1] << 16 ) | (pAvccBuf[uAvccIdx+2] << 8 ) | pAvccBuf[uAvccIdx+3];
             uAvccIdx += 4;
 
-            if ((pAvccBuf[uAvccIdx] & 0x80) == 0 && (pAvccBuf[uAvccIdx] & 0x1F) == uNaluType)
+            uNaluType = pAvccBuf[uAvccIdx] & 0x1F;
+            if (uNaluType >= NALU_TYPE_NON_IDR_PICTURE && uNaluType <= NALU_TYPE_IFRAME)
             {
-                *ppNalu = pAvccBuf + uAvccIdx;
-                *puNaluLen = uNaluLen;
+                if ((pAvccBuf[uAvccIdx] & 0x60) != 0)
+                {
+                    /* Any VCL NALU with non-zero nal_ref_idc makes it a reference frame. */
+                    bIsNonReference = false;
+                    break;
+                }
+                bIsNonReference = true;
+            }
+
+            if (uNaluLen > uAvccLen - uAvccIdx)
+            {
+                /* The AVCC NALU is broken. */
+                bIsNonReference = false;
                 break;
             }
             uAvccIdx += uNaluLen;
         }
-
-        if (uAvccIdx >= uAvccLen)
-        {
-            res = KVS_ERROR_AVCC_NALU_IS_BROKEN;
-        }
     }
 
-    return res;
+    return bIsNonReference;
 }
 
-int NALU_getNaluFromAnnexBNalus(uint8_t *pAnnexBBuf, size_t uAnnexBLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen)
+static int prvGetNaluFromAnnexBNalus(uint8_t *pAnnexBBuf, size_t uAnnexBLen, bool bIsHevc, uint8_t uNaluTypeMin, uint8_t uNaluTypeMax, uint8_t **ppNalu, size_t *puNaluLen)
 {
     int res = KVS_ERRNO_NONE;
     uint8_t *pIdx = pAnnexBBuf;
     uint8_t *pNalu = NULL;
     size_t uNaluLen = 0;
 
-    if (pAnnexBBuf == NULL || uAnnexBLen < 5 || uNaluType >=32 || ppNalu == NULL || puNaluLen == NULL)
+    while (pIdx - pAnnexBBuf < uAnnexBLen - 4)
     {
-        LogError("Invalid argument");
-        res = KVS_ERROR_INVALID_ARGUMENT;
-    }
-    else
-    {
-        while (pIdx - pAnnexBBuf < uAnnexBLen - 4)
+        if (pIdx[0] == 0x00)
         {
-            if (pIdx[0] == 0x00)
+            if (pIdx[1] == 0x00)
             {
-                if (pIdx[1] == 0x00)
+                if (pIdx[2] == 0x00)
                 {
-                    if (pIdx[2] == 0x00)
-                    {
-                        if (pIdx[3] == 0x01)
-                        {
-                            /* It's a valid NALU here. */
-                            if (pNalu != NULL)
-                            {
-                                uNaluLen = pIdx - pNalu;
-                                break;
-                            }
-                            else if ((pIdx[4] & 0x80) == 0 && (pIdx[4] & 0x1F) == uNaluType)
-                            {
-                                pNalu = pIdx + 4;
-                            }
-                            pIdx += 4;
-                        }
-                        else
-                        {
-                            pIdx += 4;
-                        }
-                    }
-                    else if (pIdx[2] == 0x01)
+                    if (pIdx[3] == 0x01)
                     {
                         /* It's a valid NALU here. */
                         if (pNalu != NULL)
@@ -172,44 +270,118 @@ int NALU_getNaluFromAnnexBNalus(uint8_t *pAnnexBBuf, size_t uAnnexBLen, uint8_t
                             uNaluLen = pIdx - pNalu;
                             break;
                         }
-                        else if ((pIdx[3] & 0x80) == 0 && (pIdx[3] & 0x1F) == uNaluType)
+                        else if (prvIsNaluTypeInRange(pIdx[4], bIsHevc, uNaluTypeMin, uNaluTypeMax))
                         {
-                            pNalu = pIdx + 3;
+                            pNalu = pIdx + 4;
                         }
-                        pIdx += 3;
+                        pIdx += 4;
                     }
                     else
                     {
-                        pIdx += 3;
+                        pIdx += 4;
+                    }
+                }
+                else if (pIdx[2] == 0x01)
+                {
+                    /* It's a valid NALU here. */
+                    if (pNalu != NULL)
+                    {
+                        uNaluLen = pIdx - pNalu;
+                        break;
+                    }
+                    else if (prvIsNaluTypeInRange(pIdx[3], bIsHevc, uNaluTypeMin, uNaluTypeMax))
+                    {
+                        pNalu = pIdx + 3;
                     }
+                    pIdx += 3;
                 }
                 else
                 {
-                    pIdx += 2;
+                    pIdx += 3;
                 }
             }
             else
             {
-                pIdx++;
+                pIdx += 2;
             }
         }
+        else
+        {
+            pIdx = pAnnexBBuf + prvSkipToZeroByte(pAnnexBBuf, pIdx - pAnnexBBuf + 1, uAnnexBLen - 4);
+        }
+    }
 
-        if (pNalu != NULL)
+    if (pNalu != NULL)
+    {
+        if (uNaluLen == 0)
         {
-            if (uNaluLen == 0)
-            {
-                uNaluLen = uAnnexBLen - (pNalu - pAnnexBBuf);
-            }
-            *ppNalu = pNalu;
-            *puNaluLen = uNaluLen;
+            uNaluLen = uAnnexBLen - (pNalu - pAnnexBBuf);
+        }
+        *ppNalu = pNalu;
+        *puNaluLen = uNaluLen;
+    }
+    else
+    {
+        res = KVS_ERROR_NALU_TYPE_NOT_FOUND;
+    }
+
+    return res;
+}
+
+int NALU_getNaluFromAnnexBNalus(uint8_t *pAnnexBBuf, size_t uAnnexBLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pAnnexBBuf == NULL || uAnnexBLen < 5 || uNaluType >=32 || ppNalu == NULL || puNaluLen == NULL)
+    {
+        LogError("Invalid argument");
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        res = prvGetNaluFromAnnexBNalus(pAnnexBBuf, uAnnexBLen, false, uNaluType, uNaluType, ppNalu, puNaluLen);
+    }
+
+    return res;
+}
+
+int NALU_getHevcNaluFromAnnexBNalus(uint8_t *pAnnexBBuf, size_t uAnnexBLen, uint8_t uNaluType, uint8_t **ppNalu, size_t *puNaluLen)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pAnnexBBuf == NULL || uAnnexBLen < 5 || uNaluType >= 64 || ppNalu == NULL || puNaluLen == NULL)
+    {
+        LogError("Invalid argument");
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        res = prvGetNaluFromAnnexBNalus(pAnnexBBuf, uAnnexBLen, true, uNaluType, uNaluType, ppNalu, puNaluLen);
+    }
+
+    return res;
+}
+
+bool NALU_isHevcKeyFrame(uint8_t *pBuf, size_t uLen)
+{
+    bool bIsKeyFrame = false;
+    uint8_t *pIrapNalu = NULL;
+    size_t uIrapNaluLen = 0;
+
+    /* All VCL NALUs of a picture have the same type, so a frame is IRAP if any of them is. */
+    if (pBuf != NULL && uLen >= 6)
+    {
+        if (NALU_isAnnexBFrame(pBuf, uLen))
+        {
+            bIsKeyFrame = (prvGetNaluFromAnnexBNalus(pBuf, uLen, true, NALU_TYPE_HEVC_BLA_W_LP, NALU_TYPE_HEVC_RSV_IRAP_VCL23, &pIrapNalu, &uIrapNaluLen) == KVS_ERRNO_NONE);
         }
         else
         {
-            res = KVS_ERROR_NALU_TYPE_NOT_FOUND;
+            bIsKeyFrame = (prvGetNaluFromAvccNalus(pBuf, uLen, true, NALU_TYPE_HEVC_BLA_W_LP, NALU_TYPE_HEVC_RSV_IRAP_VCL23, &pIrapNalu, &uIrapNaluLen) == KVS_ERRNO_NONE);
         }
     }
 
-    return res;
+    return bIsKeyFrame;
 }
 
 bool NALU_isAnnexBFrame(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen)
@@ -235,148 +407,453 @@ bool NALU_isAnnexBFrame(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen)
     return bRes;
 }
 
-int NALU_convertAnnexBToAvccInPlace(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen, uint32_t uAnnexbBufSize, uint32_t *pAvccLen)
+/**
+ * @brief Find the next start code of an Annex-B frame from *puIdx, and update *puIdx to where it begins.
+ *
+ * @return 0 if it's found, KVS_ERROR_MISSING_NALU if there is none, or KVS_ERROR_INVALID_NALU_FORMAT
+ */
+static int prvFindNextStartCode(const uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen, uint32_t *puIdx, uint32_t *puStartCodeLen)
 {
-    int res = KVS_ERRNO_NONE;
-    uint32_t i = 0;
-    Nal_t xNals[ MAX_NALU_COUNT_IN_A_FRAME ];
-    uint32_t uNalRbspCount = 0;
-    uint32_t uAvccTotalLen = 0;
-    uint32_t uAvccIdx = 0;
+    int res = KVS_ERROR_MISSING_NALU;
+    uint32_t i = *puIdx;
 
-    if (pAnnexbBuf == NULL || uAnnexbBufLen <= 4 || uAnnexbBufSize < uAnnexbBufLen || pAvccLen == NULL)
+    while (i < uAnnexbBufLen - 4)
     {
-        res = KVS_ERROR_INVALID_ARGUMENT;
-        LogError("Invalid argument");
-    }
-    else if (!NALU_isAnnexBFrame(pAnnexbBuf, uAnnexbBufLen))
-    {
-        LogInfo("It's not a Annex-B frame, skip convert");
-    }
-    else
-    {
-        /* Go through all Annex-B buffer and record all RBSP begin and length first. */
-        while (i < uAnnexbBufLen - 4)
+        if (pAnnexbBuf[i] == 0x00)
         {
-            if (uNalRbspCount > MAX_NALU_COUNT_IN_A_FRAME)
+            if (pAnnexbBuf[i+1] == 0x00)
             {
-                break;
-            }
-
-            if (pAnnexbBuf[i] == 0x00)
-            {
-                if (pAnnexbBuf[i+1] == 0x00)
+                if (pAnnexbBuf[i+2] == 0x00)
                 {
-                    if (pAnnexbBuf[i+2] == 0x00)
+                    if (pAnnexbBuf[i+3] == 0x01)
                     {
-                        if (pAnnexbBuf[i+3] == 0x01)
-                        {
-                            /* 0x00000001 is start code of NAL. */
-                            if (uNalRbspCount > 0)
-                            {
-                                xNals[uNalRbspCount-1].uNalLen = i - xNals[uNalRbspCount-1].uNalBeginIdx;
-                            }
-
-                            i += 4;
-                            xNals[uNalRbspCount++].uNalBeginIdx = i;
-                        }
-                        else if (pAnnexbBuf[i + 3] == 0x00)
-                        {
-                            /* 0x00000000 is not allowed. */
-                            LogInfo("Invalid NALU format");
-                            res = KVS_ERROR_INVALID_NALU_FORMAT;
-                            break;
-                        }
-                        else
-                        {
-                            /* 0x000000XX is acceptable. */
-                            i += 4;
-                        }
+                        /* 0x00000001 is start code of NAL. */
+                        *puStartCodeLen = 4;
+                        res = KVS_ERRNO_NONE;
+                        break;
                     }
-                    else if (pAnnexbBuf[i+2] == 0x01)
+                    else if (pAnnexbBuf[i + 3] == 0x00)
                     {
-                        /* 0x000001 is start code of NAL */
-                        if (uNalRbspCount > 0)
-                        {
-                            xNals[uNalRbspCount-1].uNalLen = i - xNals[uNalRbspCount-1].uNalBeginIdx;
-                        }
-
-                        i += 3;
-                        xNals[uNalRbspCount++].uNalBeginIdx = i;
+                        /* 0x00000000 is not allowed. */
+                        LogInfo("Invalid NALU format");
+                        res = KVS_ERROR_INVALID_NALU_FORMAT;
+                        break;
                     }
                     else
                     {
-                        /* 0x0000XX is acceptable. It includes EPB case and we reserve EPB byte. */
-                        i += 3;
+                        /* 0x000000XX is acceptable. */
+                        i += 4;
                     }
                 }
+                else if (pAnnexbBuf[i+2] == 0x01)
+                {
+                    /* 0x000001 is start code of NAL */
+                    *puStartCodeLen = 3;
+                    res = KVS_ERRNO_NONE;
+                    break;
+                }
                 else
                 {
-                    /* 0x00XX is acceptable. */
-                    i += 2;
+                    /* 0x0000XX is acceptable. It includes EPB case and we reserve EPB byte. */
+                    i += 3;
                 }
             }
             else
             {
-                /* 0xXX is acceptable. */
-                i++;
+                /* 0x00XX is acceptable. */
+                i += 2;
             }
         }
+        else
+        {
+            /* 0xXX is acceptable, and so are the bytes up to the next 0x00. */
+            i = prvSkipToZeroByte(pAnnexbBuf, i + 1, uAnnexbBufLen - 4);
+        }
+    }
+
+    *puIdx = i;
+
+    return res;
+}
+
+static void prvAnalyzeNalu(NaluFrameInfo_t *pxInfo, const NaluEntry_t *pxNalu, bool *pbHasReference)
+{
+    uint8_t uNaluType = pxInfo->bIsHevc ? ((pxNalu->uHdr >> 1) & 0x3F) : (pxNalu->uHdr & 0x1F);
+
+    if (pxInfo->uNaluCount < NALU_MAX_COUNT_IN_A_FRAME)
+    {
+        pxInfo->pxNalus[pxInfo->uNaluCount] = *pxNalu;
+    }
+    pxInfo->uNaluCount++;
 
-        if (uNalRbspCount == 0)
+    if (pxNalu->uLen == 0)
+    {
+        /* nop */
+    }
+    else if (pxInfo->bIsHevc)
+    {
+        if (prvIsNaluTypeInRange(pxNalu->uHdr, true, NALU_TYPE_HEVC_BLA_W_LP, NALU_TYPE_HEVC_RSV_IRAP_VCL23))
         {
-            res = KVS_ERROR_MISSING_NALU;
-            LogInfo("No NALU is found in Annex-B frame");
+            pxInfo->bIsKeyFrame = true;
         }
-        else if (uNalRbspCount > MAX_NALU_COUNT_IN_A_FRAME)
+        else if (prvIsNaluTypeInRange(pxNalu->uHdr, true, NALU_TYPE_HEVC_VPS, NALU_TYPE_HEVC_VPS) && pxInfo->xVps.uLen == 0)
         {
-            res = KVS_ERROR_EXCEED_MAX_NALU_COUNT_LIMIT;
-            LogError("NAL RBSP count exceeds max count");
+            pxInfo->xVps = *pxNalu;
         }
-        else
+        else if (prvIsNaluTypeInRange(pxNalu->uHdr, true, NALU_TYPE_HEVC_SPS, NALU_TYPE_HEVC_SPS) && pxInfo->xSps.uLen == 0)
         {
-            /* Update the last BSPS. */
-            xNals[ uNalRbspCount - 1 ].uNalLen = uAnnexbBufLen - xNals[ uNalRbspCount - 1 ].uNalBeginIdx;
-
-            /* Calculate needed size if we convert it to Avcc format. */
-            uAvccTotalLen = 4 * uNalRbspCount;
-            for (i=0; i<uNalRbspCount; i++)
+            pxInfo->xSps = *pxNalu;
+        }
+        else if (prvIsNaluTypeInRange(pxNalu->uHdr, true, NALU_TYPE_HEVC_PPS, NALU_TYPE_HEVC_PPS) && pxInfo->xPps.uLen == 0)
+        {
+            pxInfo->xPps = *pxNalu;
+        }
+    }
+    else
+    {
+        if (uNaluType >= NALU_TYPE_NON_IDR_PICTURE && uNaluType <= NALU_TYPE_IFRAME)
+        {
+            /* Any VCL NALU with non-zero nal_ref_idc makes it a reference frame. */
+            if ((pxNalu->uHdr & 0x60) != 0)
             {
-                uAvccTotalLen += xNals[i].uNalLen;
+                *pbHasReference = true;
             }
+            pxInfo->bIsNonReference = !(*pbHasReference);
+        }
 
-            if (uAvccTotalLen > uAnnexbBufSize)
-            {
-                /* We don't have enough space to convert Annex-B to Avcc in place. */
-                LogInfo("No available space to convert Annex-B inplace");
-                *pAvccLen = 0;
-                res = KVS_ERROR_NO_ENOUGH_SPACE_FOR_NALU_CONVERSION;
-            }
-            else
-            {
-               /* move RBSP from back to head */
-                i = uNalRbspCount - 1;
-                uAvccIdx = uAvccTotalLen;
-                do
-                {
-                    /* move RBSP */
-                    uAvccIdx -= xNals[i].uNalLen;
-                    memmove(pAnnexbBuf + uAvccIdx, pAnnexbBuf + xNals[i].uNalBeginIdx, xNals[i].uNalLen);
+        if (prvIsNaluTypeInRange(pxNalu->uHdr, false, NALU_TYPE_IFRAME, NALU_TYPE_IFRAME))
+        {
+            pxInfo->bIsKeyFrame = true;
+        }
+        else if (prvIsNaluTypeInRange(pxNalu->uHdr, false, NALU_TYPE_SPS, NALU_TYPE_SPS) && pxInfo->xSps.uLen == 0)
+        {
+            pxInfo->xSps = *pxNalu;
+        }
+        else if (prvIsNaluTypeInRange(pxNalu->uHdr, false, NALU_TYPE_PPS, NALU_TYPE_PPS) && pxInfo->xPps.uLen == 0)
+        {
+            pxInfo->xPps = *pxNalu;
+        }
+    }
+}
 
-                    /* fill length info */
-                    uAvccIdx -= 4;
-                    PUT_UNALIGNED_4_byte_BE(pAnnexbBuf + uAvccIdx, xNals[i].uNalLen);
+/**
+ * @brief Go through all NALUs of an Annex-B frame, and get the frame length after it's converted to AVCC.
+ *
+ * Each NALU is analyzed into pxInfo if it's not NULL.
+ */
+static int prvScanAnnexBNalus(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen, NaluFrameInfo_t *pxInfo, uint32_t *puAvccLen)
+{
+    int res = KVS_ERRNO_NONE;
+    uint32_t i = 0;
+    uint32_t uStartCodeLen = 0;
+    uint32_t uNaluCount = 0;
+    uint32_t uAvccLen = uAnnexbBufLen;
+    NaluEntry_t xNalu = {0};
+    bool bHasReference = false;
 
-                    if (i == 0)
-                    {
-                        break;
-                    }
-                    i--;
-                } while (true);
+    while ((res = prvFindNextStartCode(pAnnexbBuf, uAnnexbBufLen, &i, &uStartCodeLen)) == KVS_ERRNO_NONE)
+    {
+        if (uNaluCount > 0 && pxInfo != NULL)
+        {
+            xNalu.uLen = i - xNalu.uOffset;
+            xNalu.uHdr = (xNalu.uLen > 0) ? pAnnexbBuf[xNalu.uOffset] : 0;
+            prvAnalyzeNalu(pxInfo, &xNalu, &bHasReference);
+        }
 
-                *pAvccLen = uAvccTotalLen;
-            }
+        /* Every start code is replaced by a 4 bytes length. */
+        i += uStartCodeLen;
+        uAvccLen += 4 - uStartCodeLen;
+        xNalu.uOffset = i;
+        uNaluCount++;
+    }
+
+    if (res != KVS_ERROR_MISSING_NALU)
+    {
+        /* Propagate the res error */
+    }
+    else if (uNaluCount == 0)
+    {
+        LogInfo("No NALU is found in Annex-B frame");
+    }
+    else
+    {
+        res = KVS_ERRNO_NONE;
+        if (pxInfo != NULL)
+        {
+            xNalu.uLen = uAnnexbBufLen - xNalu.uOffset;
+            xNalu.uHdr = (xNalu.uLen > 0) ? pAnnexbBuf[xNalu.uOffset] : 0;
+            prvAnalyzeNalu(pxInfo, &xNalu, &bHasReference);
         }
+        *puAvccLen = uAvccLen;
+    }
+
+    return res;
+}
+
+bool NALU_isNaluFiltered(uint8_t uHdr, bool bIsHevc, uint64_t uFilterMask)
+{
+    uint8_t uNaluType = bIsHevc ? ((uHdr >> 1) & 0x3F) : (uHdr & 0x1F);
+
+    return (uFilterMask & NALU_FILTER_BIT(uNaluType)) != 0;
+}
+
+static bool prvHasFilteredNalu(const NaluFrameInfo_t *pxInfo, uint64_t uFilterMask)
+{
+    bool bRes = false;
+    uint32_t i = 0;
+
+    if (uFilterMask == 0)
+    {
+        /* nop */
+    }
+    else if (pxInfo->uNaluCount > NALU_MAX_COUNT_IN_A_FRAME)
+    {
+        /* Not all NALUs are recorded, so they have to be checked while the frame is compacted. */
+        bRes = true;
+    }
+    else
+    {
+        for (i = 0; i < pxInfo->uNaluCount && !bRes; i++)
+        {
+            bRes = pxInfo->pxNalus[i].uLen > 0 && NALU_isNaluFiltered(pxInfo->pxNalus[i].uHdr, pxInfo->bIsHevc, uFilterMask);
+        }
+    }
+
+    return bRes;
+}
+
+/**
+ * @brief Write a NALU with its 4 bytes length at uAvccIdx unless it's filtered. The NALU may overlap the destination.
+ *
+ * @return The index right after the written NALU
+ */
+static uint32_t prvPutAvccNalu(uint8_t *pAvccBuf, uint32_t uAvccIdx, const uint8_t *pNalu, uint32_t uNaluLen, bool bIsHevc, uint64_t uFilterMask)
+{
+    if (uNaluLen > 0 && NALU_isNaluFiltered(pNalu[0], bIsHevc, uFilterMask))
+    {
+        /* nop */
+    }
+    else
+    {
+        memmove(pAvccBuf + uAvccIdx + 4, pNalu, uNaluLen);
+        PUT_UNALIGNED_4_byte_BE(pAvccBuf + uAvccIdx, uNaluLen);
+        uAvccIdx += 4 + uNaluLen;
+    }
+
+    return uAvccIdx;
+}
+
+/**
+ * @brief Convert an Annex-B frame checked by prvScanAnnexBNalus() to AVCC in a single pass.
+ *
+ * The frame is moved to the end of the AVCC frame first. Every 3 bytes start code makes the AVCC frame 1 byte longer, so
+ * NALUs are written behind the start codes that are yet to be read, and the length of a NALU is written once its next
+ * start code is found. Filtered NALUs are skipped, so the writes stay further behind.
+ *
+ * @return The length of AVCC frame
+ */
+static uint32_t prvRewriteAnnexBToAvcc(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen, uint32_t uAvccLen, bool bIsHevc, uint64_t uFilterMask)
+{
+    uint8_t *pSrc = pAnnexbBuf + (uAvccLen - uAnnexbBufLen);
+    uint32_t i = 0;
+    uint32_t uStartCodeLen = 0;
+    uint32_t uNaluBeginIdx = 0;
+    uint32_t uAvccIdx = 0;
+
+    if (pSrc != pAnnexbBuf)
+    {
+        memmove(pSrc, pAnnexbBuf, uAnnexbBufLen);
+    }
+
+    /* The frame begins with a start code. */
+    prvFindNextStartCode(pSrc, uAnnexbBufLen, &i, &uStartCodeLen);
+    i += uStartCodeLen;
+    uNaluBeginIdx = i;
+
+    while (prvFindNextStartCode(pSrc, uAnnexbBufLen, &i, &uStartCodeLen) == KVS_ERRNO_NONE)
+    {
+        uAvccIdx = prvPutAvccNalu(pAnnexbBuf, uAvccIdx, pSrc + uNaluBeginIdx, i - uNaluBeginIdx, bIsHevc, uFilterMask);
+        i += uStartCodeLen;
+        uNaluBeginIdx = i;
+    }
+
+    return prvPutAvccNalu(pAnnexbBuf, uAvccIdx, pSrc + uNaluBeginIdx, uAnnexbBufLen - uNaluBeginIdx, bIsHevc, uFilterMask);
+}
+
+/**
+ * @brief Remove filtered NALUs from an AVCC frame checked by prvAnalyzeAvccNalus() by moving the rest forward.
+ *
+ * @return The length of AVCC frame
+ */
+static uint32_t prvFilterAvccNalus(uint8_t *pAvccBuf, uint32_t uAvccLen, bool bIsHevc, uint64_t uFilterMask)
+{
+    uint32_t uIdx = 0;
+    uint32_t uNaluLen = 0;
+    uint32_t uAvccIdx = 0;
+
+    while (uAvccLen - uIdx > 4)
+    {
+        uNaluLen = (pAvccBuf[uIdx] << 24) | (pAvccBuf[uIdx + 1] << 16) | (pAvccBuf[uIdx + 2] << 8) | pAvccBuf[uIdx + 3];
+        if (uNaluLen > uAvccLen - uIdx - 4)
+        {
+            break;
+        }
+        uAvccIdx = prvPutAvccNalu(pAvccBuf, uAvccIdx, pAvccBuf + uIdx + 4, uNaluLen, bIsHevc, uFilterMask);
+        uIdx += 4 + uNaluLen;
+    }
+
+    return uAvccIdx;
+}
+
+int NALU_convertAnnexBToAvccInPlace(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufLen, uint32_t uAnnexbBufSize, uint32_t *pAvccLen)
+{
+    int res = KVS_ERRNO_NONE;
+    uint32_t uAvccTotalLen = 0;
+
+    if (pAnnexbBuf == NULL || uAnnexbBufLen <= 4 || uAnnexbBufSize < uAnnexbBufLen || pAvccLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (!NALU_isAnnexBFrame(pAnnexbBuf, uAnnexbBufLen))
+    {
+        LogInfo("It's not a Annex-B frame, skip convert");
+    }
+    else if ((res = prvScanAnnexBNalus(pAnnexbBuf, uAnnexbBufLen, NULL, &uAvccTotalLen)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (uAvccTotalLen > uAnnexbBufSize)
+    {
+        /* We don't have enough space to convert Annex-B to Avcc in place. */
+        LogInfo("No available space to convert Annex-B inplace");
+        *pAvccLen = 0;
+        res = KVS_ERROR_NO_ENOUGH_SPACE_FOR_NALU_CONVERSION;
+    }
+    else
+    {
+        prvRewriteAnnexBToAvcc(pAnnexbBuf, uAnnexbBufLen, uAvccTotalLen, false, 0);
+        *pAvccLen = uAvccTotalLen;
+    }
+
+    return res;
+}
+
+static int prvAnalyzeAvccNalus(uint8_t *pAvccBuf, uint32_t uAvccLen, NaluFrameInfo_t *pxInfo)
+{
+    int res = KVS_ERRNO_NONE;
+    uint32_t uIdx = 0;
+    NaluEntry_t xNalu = {0};
+    bool bHasReference = false;
+
+    while (res == KVS_ERRNO_NONE && uAvccLen - uIdx > 4)
+    {
+        xNalu.uLen = (pAvccBuf[uIdx] << 24) | (pAvccBuf[uIdx + 1] << 16) | (pAvccBuf[uIdx + 2] << 8) | pAvccBuf[uIdx + 3];
+        uIdx += 4;
+
+        if (xNalu.uLen > uAvccLen - uIdx)
+        {
+            res = KVS_ERROR_AVCC_NALU_IS_BROKEN;
+            LogError("AVCC NALU is broken");
+        }
+        else
+        {
+            xNalu.uOffset = uIdx;
+            xNalu.uHdr = (xNalu.uLen > 0) ? pAvccBuf[uIdx] : 0;
+            prvAnalyzeNalu(pxInfo, &xNalu, &bHasReference);
+            uIdx += xNalu.uLen;
+        }
+    }
+
+    return res;
+}
+
+int NALU_analyzeFrame(uint8_t *pBuf, uint32_t uLen, bool bIsHevc, NaluFrameInfo_t *pxInfo)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pBuf == NULL || uLen <= 4 || pxInfo == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        res = NALU_analyzeFrameOfFormat(pBuf, uLen, bIsHevc, NALU_isAnnexBFrame(pBuf, uLen), pxInfo);
+    }
+
+    return res;
+}
+
+int NALU_analyzeFrameOfFormat(uint8_t *pBuf, uint32_t uLen, bool bIsHevc, bool bIsAnnexB, NaluFrameInfo_t *pxInfo)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pBuf == NULL || uLen <= 4 || pxInfo == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        memset(pxInfo, 0, sizeof(NaluFrameInfo_t));
+        pxInfo->bIsHevc = bIsHevc;
+        pxInfo->uLen = uLen;
+        pxInfo->uAvccLen = uLen;
+        pxInfo->bIsAnnexB = bIsAnnexB;
+
+        if (pxInfo->bIsAnnexB)
+        {
+            res = prvScanAnnexBNalus(pBuf, uLen, pxInfo, &(pxInfo->uAvccLen));
+        }
+        else
+        {
+            res = prvAnalyzeAvccNalus(pBuf, uLen, pxInfo);
+        }
+    }
+
+    return res;
+}
+
+int NALU_convertAnnexBToAvccWithFrameInfo(uint8_t *pAnnexbBuf, uint32_t uAnnexbBufSize, NaluFrameInfo_t *pxInfo, uint64_t uFilterMask, uint32_t *pAvccLen)
+{
+    int res = KVS_ERRNO_NONE;
+    bool bIsHevc = false;
+    uint32_t uAvccLen = 0;
+
+    if (pAnnexbBuf == NULL || pxInfo == NULL || uAnnexbBufSize < pxInfo->uLen || pAvccLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (!pxInfo->bIsAnnexB && !prvHasFilteredNalu(pxInfo, uFilterMask))
+    {
+        *pAvccLen = pxInfo->uLen;
+    }
+    else if (pxInfo->bIsAnnexB && pxInfo->uAvccLen > uAnnexbBufSize)
+    {
+        /* We don't have enough space to convert Annex-B to Avcc in place. */
+        LogInfo("No available space to convert Annex-B inplace");
+        *pAvccLen = 0;
+        res = KVS_ERROR_NO_ENOUGH_SPACE_FOR_NALU_CONVERSION;
+    }
+    else if ((uAvccLen = pxInfo->bIsAnnexB ? prvRewriteAnnexBToAvcc(pAnnexbBuf, pxInfo->uLen, pxInfo->uAvccLen, pxInfo->bIsHevc, uFilterMask)
+                                           : prvFilterAvccNalus(pAnnexbBuf, pxInfo->uLen, pxInfo->bIsHevc, uFilterMask)) == 0)
+    {
+        LogInfo("All NALUs are filtered");
+        *pAvccLen = 0;
+        res = KVS_ERROR_MISSING_NALU;
+    }
+    else
+    {
+        /* Offsets are taken again from the AVCC lengths, which doesn't touch the NALU payloads. */
+        bIsHevc = pxInfo->bIsHevc;
+        memset(pxInfo, 0, sizeof(NaluFrameInfo_t));
+        pxInfo->bIsHevc = bIsHevc;
+        pxInfo->uLen = uAvccLen;
+        pxInfo->uAvccLen = uAvccLen;
+        res = prvAnalyzeAvccNalus(pAnnexbBuf, uAvccLen, pxInfo);
+        *pAvccLen = uAvccLen;
     }
 
     return res;
@@ -402,4 +879,33 @@ int NALU_getH264VideoResolutionFromSps(uint8_t *pSps, size_t uSpsLen, uint16_t *
     }
 
     return res;
-}
\ No newline at end of file
+}
+
+int NALU_getHevcVideoResolutionFromSps(uint8_t *pSps, size_t uSpsLen, uint16_t *puWidth, uint16_t *puHeight)
+{
+    int res = KVS_ERRNO_NONE;
+    HevcSpsInfo_t xSpsInfo = {0};
+
+    if (pSps == NULL || uSpsLen < 3 || puWidth == NULL || puHeight == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (((pSps[0] >> 1) & 0x3F) != NALU_TYPE_HEVC_SPS)
+    {
+        res = KVS_ERROR_INVALID_NALU_FORMAT;
+        LogError("Not a SPS NALU");
+    }
+    else if ((res = getHevcSpsInfo(pSps + 2, uSpsLen - 2, &xSpsInfo)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to parse SPS");
+        /* Propagate the res error */
+    }
+    else
+    {
+        *puWidth = xSpsInfo.uWidth;
+        *puHeight = xSpsInfo.uHeight;
+    }
+
+    return res;
+}
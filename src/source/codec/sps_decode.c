@@ -17,20 +17,30 @@
 #include <stdio.h>
 #include <string.h>
 
+/* Public headers */
+#include "kvs/errors.h"
+
 /* Internal headers */
+#include "codec/sps_decode.h"
 #include "os/allocator.h"
 
 typedef struct BitStream
 {
     unsigned char *pBuf;
     int xCurrentBit;
+
+    /* Bits beyond the buffer are read as 0. */
+    int xBitLen;
 } BitStream_t;
 
 static unsigned int uReadBit(BitStream_t *pBitStream)
 {
     int nIndex = pBitStream->xCurrentBit / 8;
     int nOffset = pBitStream->xCurrentBit % 8 + 1;
-    pBitStream->xCurrentBit++;
+    if (pBitStream->xCurrentBit++ >= pBitStream->xBitLen)
+    {
+        return 0;
+    }
     return (pBitStream->pBuf[nIndex] >> (8 - nOffset)) & 0x01;
 }
 
@@ -74,7 +84,7 @@ static unsigned int uReadSE(BitStream_t *pBitStream)
 
 void getH264VideoResolution(char *pSps, size_t uSpsLen, uint16_t *puWidth, uint16_t *puHeight)
 {
-    BitStream_t xBitStream = {.pBuf = (unsigned char *)pSps, .xCurrentBit = 0};
+    BitStream_t xBitStream = {.pBuf = (unsigned char *)pSps, .xCurrentBit = 0, .xBitLen = (int)(uSpsLen * 8)};
     int frame_crop_left_offset = 0;
     int frame_crop_right_offset = 0;
     int frame_crop_top_offset = 0;
@@ -199,4 +209,123 @@ void getH264VideoResolution(char *pSps, size_t uSpsLen, uint16_t *puWidth, uint1
 
     *puWidth = (uint16_t)xWidth;
     *puHeight = (uint16_t)xHeight;
-}
\ No newline at end of file
+}
+
+int getHevcSpsInfo(const uint8_t *pSps, size_t uSpsLen, HevcSpsInfo_t *pxInfo)
+{
+    int res = KVS_ERRNO_NONE;
+    unsigned char *pRbsp = NULL;
+    size_t uRbspLen = 0;
+    size_t i = 0;
+    size_t uZeroCount = 0;
+    BitStream_t xBitStream = {0};
+    unsigned int sub_layer_profile_present_flag[8] = {0};
+    unsigned int sub_layer_level_present_flag[8] = {0};
+    unsigned int sps_max_sub_layers_minus1 = 0;
+    unsigned int chroma_format_idc = 0;
+    unsigned int pic_width_in_luma_samples = 0;
+    unsigned int pic_height_in_luma_samples = 0;
+    unsigned int conf_win_left_offset = 0;
+    unsigned int conf_win_right_offset = 0;
+    unsigned int conf_win_top_offset = 0;
+    unsigned int conf_win_bottom_offset = 0;
+    unsigned int sub_width_c = 1;
+    unsigned int sub_height_c = 1;
+
+    if (pSps == NULL || uSpsLen == 0 || pxInfo == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((pRbsp = (unsigned char *)kvsMalloc(uSpsLen)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+    }
+    else
+    {
+        /* Remove emulation prevention bytes, because the profile, tier and level is copied as is. */
+        for (i = 0; i < uSpsLen; i++)
+        {
+            if (uZeroCount >= 2 && pSps[i] == 0x03)
+            {
+                uZeroCount = 0;
+                continue;
+            }
+            uZeroCount = (pSps[i] == 0x00) ? (uZeroCount + 1) : 0;
+            pRbsp[uRbspLen++] = pSps[i];
+        }
+
+        xBitStream.pBuf = pRbsp;
+        xBitStream.xBitLen = (int)(uRbspLen * 8);
+
+        /* Please refer to https://www.itu.int/rec/T-REC-H.265/ Section 7.3.2.2 Sequence parameter set RBSP syntax */
+        uReadBits(&xBitStream, 4); /* sps_video_parameter_set_id */
+        sps_max_sub_layers_minus1 = uReadBits(&xBitStream, 3);
+        pxInfo->uMaxSubLayersMinus1 = (uint8_t)sps_max_sub_layers_minus1;
+        pxInfo->uTemporalIdNestingFlag = (uint8_t)uReadBit(&xBitStream);
+
+        if (uRbspLen < 1 + HEVC_GENERAL_PROFILE_TIER_LEVEL_LEN)
+        {
+            res = KVS_ERROR_SPS_IS_BROKEN;
+        }
+        else
+        {
+            memcpy(pxInfo->pGeneralProfileTierLevel, pRbsp + 1, HEVC_GENERAL_PROFILE_TIER_LEVEL_LEN);
+            xBitStream.xCurrentBit += HEVC_GENERAL_PROFILE_TIER_LEVEL_LEN * 8;
+
+            for (i = 0; i < sps_max_sub_layers_minus1; i++)
+            {
+                sub_layer_profile_present_flag[i] = uReadBit(&xBitStream);
+                sub_layer_level_present_flag[i] = uReadBit(&xBitStream);
+            }
+            if (sps_max_sub_layers_minus1 > 0)
+            {
+                /* reserved_zero_2bits */
+                xBitStream.xCurrentBit += (8 - sps_max_sub_layers_minus1) * 2;
+            }
+            for (i = 0; i < sps_max_sub_layers_minus1; i++)
+            {
+                /* sub_layer_profile_space to sub_layer_reserved_zero_bit, and sub_layer_level_idc */
+                xBitStream.xCurrentBit += (sub_layer_profile_present_flag[i] ? 88 : 0) + (sub_layer_level_present_flag[i] ? 8 : 0);
+            }
+
+            uReadExponentialGolombCode(&xBitStream); /* sps_seq_parameter_set_id */
+            chroma_format_idc = uReadExponentialGolombCode(&xBitStream);
+            if (chroma_format_idc == 3)
+            {
+                uReadBit(&xBitStream); /* separate_colour_plane_flag */
+            }
+            pic_width_in_luma_samples = uReadExponentialGolombCode(&xBitStream);
+            pic_height_in_luma_samples = uReadExponentialGolombCode(&xBitStream);
+            if (uReadBit(&xBitStream)) /* conformance_window_flag */
+            {
+                conf_win_left_offset = uReadExponentialGolombCode(&xBitStream);
+                conf_win_right_offset = uReadExponentialGolombCode(&xBitStream);
+                conf_win_top_offset = uReadExponentialGolombCode(&xBitStream);
+                conf_win_bottom_offset = uReadExponentialGolombCode(&xBitStream);
+            }
+            pxInfo->uBitDepthLumaMinus8 = (uint8_t)uReadExponentialGolombCode(&xBitStream);
+            pxInfo->uBitDepthChromaMinus8 = (uint8_t)uReadExponentialGolombCode(&xBitStream);
+
+            /* Please refer to Table 6-1 for SubWidthC and SubHeightC */
+            sub_width_c = (chroma_format_idc == 1 || chroma_format_idc == 2) ? 2 : 1;
+            sub_height_c = (chroma_format_idc == 1) ? 2 : 1;
+
+            if (xBitStream.xCurrentBit > xBitStream.xBitLen || chroma_format_idc > 3 ||
+                pic_width_in_luma_samples <= sub_width_c * (conf_win_left_offset + conf_win_right_offset) ||
+                pic_height_in_luma_samples <= sub_height_c * (conf_win_top_offset + conf_win_bottom_offset))
+            {
+                res = KVS_ERROR_SPS_IS_BROKEN;
+            }
+            else
+            {
+                pxInfo->uChromaFormatIdc = (uint8_t)chroma_format_idc;
+                pxInfo->uWidth = (uint16_t)(pic_width_in_luma_samples - sub_width_c * (conf_win_left_offset + conf_win_right_offset));
+                pxInfo->uHeight = (uint16_t)(pic_height_in_luma_samples - sub_height_c * (conf_win_top_offset + conf_win_bottom_offset));
+            }
+        }
+
+        kvsFree(pRbsp);
+    }
+
+    return res;
+}
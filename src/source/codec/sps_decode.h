@@ -16,6 +16,24 @@
 #ifndef SPS_DECODE_H
 #define SPS_DECODE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+/* The length of general profile, tier and level in HEVC SPS, from general_profile_space to general_level_idc */
+#define HEVC_GENERAL_PROFILE_TIER_LEVEL_LEN (12)
+
+typedef struct HevcSpsInfo
+{
+    uint8_t pGeneralProfileTierLevel[HEVC_GENERAL_PROFILE_TIER_LEVEL_LEN];
+    uint8_t uMaxSubLayersMinus1;
+    uint8_t uTemporalIdNestingFlag;
+    uint8_t uChromaFormatIdc;
+    uint8_t uBitDepthLumaMinus8;
+    uint8_t uBitDepthChromaMinus8;
+    uint16_t uWidth;
+    uint16_t uHeight;
+} HevcSpsInfo_t;
+
 /**
  * @breif Get H264 resolution from SPS
  *
@@ -26,4 +44,14 @@
  */
 void getH264VideoResolution(char *pSps, size_t uSpsLen, uint16_t *puWidth, uint16_t *puHeight);
 
+/**
+ * @brief Get H265 information from SPS
+ *
+ * @param[in] pSps The SPS buffer after the 2 bytes NALU header, with emulation prevention bytes
+ * @param[in] uSpsLen The length of SPS buffer
+ * @param[out] pxInfo The SPS information
+ * @return 0 on success, non-zero value otherwise
+ */
+int getHevcSpsInfo(const uint8_t *pSps, size_t uSpsLen, HevcSpsInfo_t *pxInfo);
+
 #endif
\ No newline at end of file
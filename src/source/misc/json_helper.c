@@ -13,11 +13,16 @@
  * permissions and limitations under the License.
  */
 
+#include <ctype.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Public headers */
+#include "kvs/errors.h"
+
 /* Internal headers */
 #include "misc/json_helper.h"
 #include "os/allocator.h"
@@ -83,4 +88,357 @@ uint64_t json_object_dotget_uint64(const JSON_Object *pxRootObject, const char *
     }
 
     return uVal;
-}
\ No newline at end of file
+}
+
+/* Containers are open while their length is unknown. */
+#define JSON_TOKEN_OPEN_LEN SIZE_MAX
+
+static JsonToken_t *prvJsonTokenAlloc(JsonToken_t *pxTokens, size_t uMaxTokens, size_t *puTokenCount, JsonTokenType_t xType, const char *pcStart, size_t uLen, int xParent)
+{
+    JsonToken_t *pxToken = NULL;
+
+    if (*puTokenCount < uMaxTokens)
+    {
+        pxToken = &(pxTokens[*puTokenCount]);
+        pxToken->xType = xType;
+        pxToken->pcStart = pcStart;
+        pxToken->uLen = uLen;
+        pxToken->uSize = 0;
+        pxToken->xParent = xParent;
+        (*puTokenCount)++;
+        if (xParent >= 0)
+        {
+            pxTokens[xParent].uSize++;
+        }
+    }
+
+    return pxToken;
+}
+
+/* A value can be put where there is no parent, in an array, or right after the colon of a key without its value. */
+static bool prvJsonIsValueExpected(const JsonToken_t *pxTokens, int xSuper)
+{
+    return xSuper < 0 || pxTokens[xSuper].xType == JSON_TOKEN_ARRAY || (pxTokens[xSuper].xType == JSON_TOKEN_STRING && pxTokens[xSuper].uSize == 0);
+}
+
+int json_tokenize(const char *pcJson, size_t uJsonLen, JsonToken_t *pxTokens, size_t uMaxTokens, size_t *puTokenCount)
+{
+    int res = KVS_ERRNO_NONE;
+    const char *pc = pcJson;
+    const char *pcEnd = pcJson + uJsonLen;
+    const char *pcTokenEnd = NULL;
+    size_t uTokenCount = 0;
+    int xSuper = -1;
+    int xOpen = -1;
+    JsonTokenType_t xType = JSON_TOKEN_UNDEFINED;
+
+    if (pcJson == NULL || pxTokens == NULL || puTokenCount == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+
+    while (res == KVS_ERRNO_NONE && pc < pcEnd)
+    {
+        if (*pc == '{' || *pc == '[')
+        {
+            xType = (*pc == '{') ? JSON_TOKEN_OBJECT : JSON_TOKEN_ARRAY;
+            if (!prvJsonIsValueExpected(pxTokens, xSuper) || (uTokenCount > 0 && xSuper < 0))
+            {
+                res = KVS_ERROR_JSON_INVALID;
+            }
+            else if (prvJsonTokenAlloc(pxTokens, uMaxTokens, &uTokenCount, xType, pc, JSON_TOKEN_OPEN_LEN, xSuper) == NULL)
+            {
+                res = KVS_ERROR_JSON_TOO_MANY_TOKENS;
+            }
+            else
+            {
+                xSuper = (int)uTokenCount - 1;
+                pc++;
+            }
+        }
+        else if (*pc == '}' || *pc == ']')
+        {
+            /* A completed key is closed together with its object. */
+            xType = (*pc == '}') ? JSON_TOKEN_OBJECT : JSON_TOKEN_ARRAY;
+            xOpen = (xSuper >= 0 && pxTokens[xSuper].xType == JSON_TOKEN_STRING && pxTokens[xSuper].uSize == 1) ? pxTokens[xSuper].xParent : xSuper;
+            if (xOpen < 0 || pxTokens[xOpen].xType != xType)
+            {
+                res = KVS_ERROR_JSON_INVALID;
+            }
+            else
+            {
+                pxTokens[xOpen].uLen = (size_t)(pc + 1 - pxTokens[xOpen].pcStart);
+                xSuper = pxTokens[xOpen].xParent;
+                pc++;
+            }
+        }
+        else if (*pc == '"')
+        {
+            for (pcTokenEnd = pc + 1; pcTokenEnd < pcEnd && *pcTokenEnd != '"'; pcTokenEnd++)
+            {
+                if (*pcTokenEnd == '\\')
+                {
+                    pcTokenEnd++;
+                }
+            }
+
+            /* A string is a key if it's a member of an object, or a value otherwise. */
+            if (pcTokenEnd >= pcEnd || (!prvJsonIsValueExpected(pxTokens, xSuper) && pxTokens[xSuper].xType != JSON_TOKEN_OBJECT) || (uTokenCount > 0 && xSuper < 0))
+            {
+                res = KVS_ERROR_JSON_INVALID;
+            }
+            else if (prvJsonTokenAlloc(pxTokens, uMaxTokens, &uTokenCount, JSON_TOKEN_STRING, pc + 1, (size_t)(pcTokenEnd - pc - 1), xSuper) == NULL)
+            {
+                res = KVS_ERROR_JSON_TOO_MANY_TOKENS;
+            }
+            else
+            {
+                pc = pcTokenEnd + 1;
+            }
+        }
+        else if (*pc == ':')
+        {
+            /* The key just scanned becomes the parent of its value. */
+            if (uTokenCount == 0 || pxTokens[uTokenCount - 1].xType != JSON_TOKEN_STRING || pxTokens[uTokenCount - 1].xParent < 0 ||
+                pxTokens[pxTokens[uTokenCount - 1].xParent].xType != JSON_TOKEN_OBJECT)
+            {
+                res = KVS_ERROR_JSON_INVALID;
+            }
+            else
+            {
+                xSuper = (int)uTokenCount - 1;
+                pc++;
+            }
+        }
+        else if (*pc == ',')
+        {
+            if (xSuper >= 0 && pxTokens[xSuper].xType == JSON_TOKEN_STRING)
+            {
+                xSuper = pxTokens[xSuper].xParent;
+            }
+            pc++;
+        }
+        else if (isspace((unsigned char)*pc))
+        {
+            pc++;
+        }
+        else
+        {
+            for (pcTokenEnd = pc; pcTokenEnd < pcEnd && strchr(",]}: \t\r\n", *pcTokenEnd) == NULL; pcTokenEnd++)
+            {
+            }
+
+            if (!prvJsonIsValueExpected(pxTokens, xSuper) || (uTokenCount > 0 && xSuper < 0))
+            {
+                res = KVS_ERROR_JSON_INVALID;
+            }
+            else if (prvJsonTokenAlloc(pxTokens, uMaxTokens, &uTokenCount, JSON_TOKEN_PRIMITIVE, pc, (size_t)(pcTokenEnd - pc), xSuper) == NULL)
+            {
+                res = KVS_ERROR_JSON_TOO_MANY_TOKENS;
+            }
+            else
+            {
+                pc = pcTokenEnd;
+            }
+        }
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        for (xOpen = 0; xOpen < (int)uTokenCount; xOpen++)
+        {
+            if (pxTokens[xOpen].uLen == JSON_TOKEN_OPEN_LEN)
+            {
+                res = KVS_ERROR_JSON_INVALID;
+            }
+        }
+        *puTokenCount = uTokenCount;
+    }
+
+    return res;
+}
+
+/* Skip a token and all of its children, since children are right after their parent. */
+static size_t prvJsonSkipToken(const JsonToken_t *pxTokens, size_t uTokenCount, size_t uIdx)
+{
+    size_t uEnd = uIdx + 1;
+
+    while (uEnd < uTokenCount && pxTokens[uEnd].xParent >= (int)uIdx)
+    {
+        uEnd++;
+    }
+
+    return uEnd;
+}
+
+const JsonToken_t *json_token_dotget(const JsonToken_t *pxTokens, size_t uTokenCount, const char *pcName)
+{
+    const JsonToken_t *pxValue = NULL;
+    const char *pcPart = pcName;
+    const char *pcDot = NULL;
+    size_t uPartLen = 0;
+    size_t uIdx = 0;
+    size_t uObjIdx = 0;
+    bool bFound = false;
+
+    if (pxTokens != NULL && uTokenCount > 0 && pcName != NULL && pxTokens[0].xType == JSON_TOKEN_OBJECT)
+    {
+        do
+        {
+            pcDot = strchr(pcPart, '.');
+            uPartLen = (pcDot != NULL) ? (size_t)(pcDot - pcPart) : strlen(pcPart);
+            bFound = false;
+
+            /* Walk keys of the object, and skip their values as a whole. */
+            uIdx = uObjIdx + 1;
+            while (uIdx + 1 < uTokenCount && pxTokens[uIdx].xParent == (int)uObjIdx && !bFound)
+            {
+                if (pxTokens[uIdx].uLen == uPartLen && strncmp(pxTokens[uIdx].pcStart, pcPart, uPartLen) == 0)
+                {
+                    bFound = true;
+                }
+                else
+                {
+                    uIdx = prvJsonSkipToken(pxTokens, uTokenCount, uIdx);
+                }
+            }
+
+            if (bFound)
+            {
+                uObjIdx = uIdx + 1;
+                pcPart = (pcDot != NULL) ? pcDot + 1 : NULL;
+            }
+        } while (bFound && pcPart != NULL && pxTokens[uObjIdx].xType == JSON_TOKEN_OBJECT);
+
+        if (bFound && pcPart == NULL)
+        {
+            pxValue = &(pxTokens[uObjIdx]);
+        }
+    }
+
+    return pxValue;
+}
+
+/* Parse 4 hex digits, or return 0 if any of them is invalid. */
+static unsigned int prvJsonHex4(const char *pc)
+{
+    unsigned int uValue = 0;
+    size_t i = 0;
+
+    for (i = 0; i < 4 && uValue != UINT_MAX; i++)
+    {
+        if (!isxdigit((unsigned char)pc[i]))
+        {
+            uValue = UINT_MAX;
+        }
+        else
+        {
+            uValue = (uValue << 4) | (unsigned int)(isdigit((unsigned char)pc[i]) ? (pc[i] - '0') : (tolower((unsigned char)pc[i]) - 'a' + 10));
+        }
+    }
+
+    return (uValue == UINT_MAX) ? 0 : uValue;
+}
+
+char *json_token_strdup(const JsonToken_t *pxToken)
+{
+    char *pcRes = NULL;
+    const char *pc = NULL;
+    const char *pcEnd = NULL;
+    size_t uLen = 0;
+    bool bFailed = false;
+    unsigned int uCodePoint = 0;
+
+    if (pxToken != NULL && (pxToken->xType == JSON_TOKEN_STRING || pxToken->xType == JSON_TOKEN_PRIMITIVE) &&
+        (pcRes = (char *)kvsMalloc(pxToken->uLen + 1)) != NULL)
+    {
+        pc = pxToken->pcStart;
+        pcEnd = pc + pxToken->uLen;
+        while (pc < pcEnd && !bFailed)
+        {
+            if (*pc != '\\' || pxToken->xType != JSON_TOKEN_STRING)
+            {
+                pcRes[uLen++] = *pc++;
+            }
+            else if (pc + 1 >= pcEnd)
+            {
+                bFailed = true;
+            }
+            else
+            {
+                pc++;
+                switch (*pc)
+                {
+                    case 'b':
+                        pcRes[uLen++] = '\b';
+                        break;
+                    case 'f':
+                        pcRes[uLen++] = '\f';
+                        break;
+                    case 'n':
+                        pcRes[uLen++] = '\n';
+                        break;
+                    case 'r':
+                        pcRes[uLen++] = '\r';
+                        break;
+                    case 't':
+                        pcRes[uLen++] = '\t';
+                        break;
+                    case 'u':
+                        /* Only ASCII is expected in the values of AWS responses. */
+                        if (pc + 4 >= pcEnd || (uCodePoint = prvJsonHex4(pc + 1)) == 0 || uCodePoint > 0x7F)
+                        {
+                            bFailed = true;
+                        }
+                        else
+                        {
+                            pcRes[uLen++] = (char)uCodePoint;
+                            pc += 4;
+                        }
+                        break;
+                    default:
+                        pcRes[uLen++] = *pc;
+                        break;
+                }
+                pc++;
+            }
+        }
+
+        if (bFailed)
+        {
+            kvsFree(pcRes);
+            pcRes = NULL;
+        }
+        else
+        {
+            pcRes[uLen] = '\0';
+        }
+    }
+
+    return pcRes;
+}
+
+uint64_t json_token_to_uint64(const JsonToken_t *pxToken)
+{
+    uint64_t uValue = 0;
+    const char *pc = NULL;
+    const char *pcEnd = NULL;
+
+    if (pxToken != NULL && (pxToken->xType == JSON_TOKEN_STRING || pxToken->xType == JSON_TOKEN_PRIMITIVE))
+    {
+        pc = pxToken->pcStart;
+        pcEnd = pc + pxToken->uLen;
+        while (pc < pcEnd && isdigit((unsigned char)*pc))
+        {
+            uValue = uValue * 10 + (uint64_t)(*pc - '0');
+            pc++;
+        }
+    }
+
+    return uValue;
+}
+
+bool json_token_equals(const JsonToken_t *pxToken, const char *pcStr)
+{
+    return pxToken != NULL && pcStr != NULL && pxToken->uLen == strlen(pcStr) && strncmp(pxToken->pcStart, pcStr, pxToken->uLen) == 0;
+}
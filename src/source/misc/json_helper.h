@@ -18,8 +18,35 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "parson.h"
 
+typedef enum JsonTokenType
+{
+    JSON_TOKEN_UNDEFINED = 0,
+    JSON_TOKEN_OBJECT,
+    JSON_TOKEN_ARRAY,
+    JSON_TOKEN_STRING,
+    JSON_TOKEN_PRIMITIVE
+} JsonTokenType_t;
+
+/**
+ * A token is a slice of the JSON text, so it's only valid as long as the text. The slice of a string excludes its
+ * quotes and it's not unescaped. A primitive is a number, true, false or null.
+ */
+typedef struct JsonToken
+{
+    JsonTokenType_t xType;
+    const char *pcStart;
+    size_t uLen;
+
+    /* Members of an object, elements of an array, or 1 for a key, which is a string followed by its value */
+    size_t uSize;
+
+    /* Index of the parent token, or -1 for the root */
+    int xParent;
+} JsonToken_t;
+
 /**
  * @brief Get string value of a JSON value
  *
@@ -37,4 +64,55 @@ char *json_object_dotget_serialize_to_string(const JSON_Object *pxRootObject, co
  */
 uint64_t json_object_dotget_uint64(const JSON_Object *pxRootObject, const char *pcName, int xBase);
 
+/**
+ * @brief Split a JSON text into tokens in place without allocation
+ *
+ * Tokens are stored in the order they appear, so the value of a key is the token right after it, and a parent is
+ * always ahead of its children.
+ *
+ * @param[in] pcJson The JSON text, which doesn't have to be NUL terminated
+ * @param[in] uJsonLen The length of the JSON text
+ * @param[out] pxTokens The tokens
+ * @param[in] uMaxTokens The max number of tokens
+ * @param[out] puTokenCount The number of tokens
+ * @return 0 on success, KVS_ERROR_JSON_TOO_MANY_TOKENS if it runs out of tokens, non-zero value otherwise
+ */
+int json_tokenize(const char *pcJson, size_t uJsonLen, JsonToken_t *pxTokens, size_t uMaxTokens, size_t *puTokenCount);
+
+/**
+ * @brief Find the value of a dotted name, e.g. "credentials.accessKeyId", in the root object of tokens
+ *
+ * @param[in] pxTokens The tokens from json_tokenize()
+ * @param[in] uTokenCount The number of tokens
+ * @param[in] pcName The dotted name
+ * @return The value token, or NULL if it's not found
+ */
+const JsonToken_t *json_token_dotget(const JsonToken_t *pxTokens, size_t uTokenCount, const char *pcName);
+
+/**
+ * @brief Copy a string or primitive token into a NUL terminated string, and the escaped characters of a string are
+ * unescaped. It's for values that outlive the JSON text.
+ *
+ * @param[in] pxToken The token
+ * @return The string, which is freed with kvsFree(), or NULL on error
+ */
+char *json_token_strdup(const JsonToken_t *pxToken);
+
+/**
+ * @brief Get UINT64 value of a token. Numbers are accepted with or without quotes.
+ *
+ * @param[in] pxToken The token
+ * @return The value, or 0 if it's not a number
+ */
+uint64_t json_token_to_uint64(const JsonToken_t *pxToken);
+
+/**
+ * @brief Check if the slice of a token equals a string
+ *
+ * @param[in] pxToken The token
+ * @param[in] pcStr The string
+ * @return true if they're equal, false otherwise
+ */
+bool json_token_equals(const JsonToken_t *pxToken, const char *pcStr);
+
 #endif
\ No newline at end of file
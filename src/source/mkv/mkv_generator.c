@@ -26,6 +26,7 @@
 #include "kvs/mkv_generator.h"
 #include "kvs/nalu.h"
 #include "kvs/port.h"
+#include "codec/sps_decode.h"
 
 /* Internal headers */
 #include "os/allocator.h"
@@ -99,21 +100,32 @@
 /* The size of simple block header */
 #define SIMPLE_BLOCK_HEADER_SIZE (4)
 
-/* The offset of frame size offset in gClusterSimpleBlock.  This field is 8 bytes long, but we only use least 4 bytes. */
+/* The offset of frame size offset in a simple block header.  This field is 8 bytes long, but we only use least 4 bytes. */
 #define MKV_CLUSTER_SIMPLE_BLOCK_FRAME_SIZE_OFFSET (5)
 
-/* The offset of track number in gClusterSimpleBlock */
+/* The offset of track number in a simple block header */
 #define MKV_CLUSTER_SIMPLE_BLOCK_TRACK_NUMBER_OFFSET (9)
 
-/* The offset of delta timestamp in gClusterSimpleBlock */
+/* The offset of delta timestamp in a simple block header */
 #define MKV_CLUSTER_SIMPLE_BLOCK_DELTA_TIMESTAMP_OFFSET (10)
 
-/* The offset of property in gClusterSimpleBlock */
+/* The offset of property in a simple block header */
 #define MKV_CLUSTER_SIMPLE_BLOCK_PROPERTY_OFFSET (12)
 
+/* The lacing bits in the property of simple block */
+#define MKV_SIMPLE_BLOCK_LACING_MASK (0x06)
+
+/* The max length of a size in an EBML lace header */
+#define MKV_EBML_LACE_SIZE_MAX_LEN (8)
+
 /* In H264 extended profile, the size except sps and pps. */
 #define MKV_VIDEO_H264_CODEC_PRIVATE_DATA_HEADER_SIZE (11)
 
+/* In H265, the size of HEVCDecoderConfigurationRecord before arrays, and the size of an array of one NALU except the
+ * NALU itself. */
+#define MKV_VIDEO_HEVC_CODEC_PRIVATE_DATA_HEADER_SIZE (23)
+#define MKV_VIDEO_HEVC_CODEC_PRIVATE_DATA_ARRAY_HEADER_SIZE (5)
+
 /* It's a pre-defined MKV header of EBML document. EBML is used for the first frame in a streaming. There is no
  * configurable field in this header. */
 static uint8_t gEbmlHeader[] = {
@@ -289,47 +301,40 @@ static uint8_t gSegmentTrackEntryCodecPrivateHeader[] = {
 };
 static const uint32_t gSegmentTrackEntryCodecPrivateHeaderSize = sizeof(gSegmentTrackEntryCodecPrivateHeader);
 
-static uint8_t gClusterHeader[] = {
-    0x1F,
-    0x43,
-    0xB6,
-    0x75, // Cluster (L1)
-    0xFF, // len = -1, unknown
-
-    0xE7, // Timestamp (L2)
-    0x88, // len = 8
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x00, // epoch time with time unit equals timescale - a placeholder
-
-    0xA7, // Position (L2)
-    0x81, // len = 1
-    0x00  // Position = 0x00
+/* It's a pre-defined MKV header of a cluster. Only the timestamp needs to be fixed up. */
+#define MKV_CLUSTER_HEADER_TEMPLATE                                                                                     \
+    0x1F, 0x43, 0xB6, 0x75,                         /* Cluster (L1) */                                                 \
+    0xFF,                                           /* len = -1, unknown */                                            \
+    0xE7,                                           /* Timestamp (L2) */                                               \
+    0x88,                                           /* len = 8 */                                                      \
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* epoch time with time unit equals timescale - a placeholder */  \
+    0xA7,                                           /* Position (L2) */                                                \
+    0x81,                                           /* len = 1 */                                                      \
+    0x00                                            /* Position = 0x00 */
+#define MKV_CLUSTER_HEADER_SIZE (18)
+
+/* It's a pre-defined MKV header of a simple block of a track. The size and delta timecode need to be fixed up. */
+#define MKV_SIMPLE_BLOCK_TEMPLATE(uTrackNumber, uFlags)                                                                 \
+    0xA3,                                           /* SimpleBlock (L2) */                                             \
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* len = SimpleBlock Header 4 bytes + raw data size */             \
+    MKV_LENGTH_INDICATOR_1_BYTE | (uTrackNumber),   /* track Number */                                                 \
+    0x00, 0x00,                                     /* timecode, relative to cluster timecode - INT16 */               \
+    (uFlags)                                        /* Flags */                                                        \
+                                                    /* Frame data follows */
+#define MKV_SIMPLE_BLOCK_SIZE (13)
+
+/* Precomputed MKV headers of each track, indexed by the track number minus 1. The first block of a cluster is marked
+ * as a key frame, and other blocks are not. */
+static const uint8_t gClusterHdrTemplates[TRACK_MAX][MKV_CLUSTER_HEADER_SIZE + MKV_SIMPLE_BLOCK_SIZE] = {
+    {MKV_CLUSTER_HEADER_TEMPLATE, MKV_SIMPLE_BLOCK_TEMPLATE(TRACK_VIDEO, 0x80)},
+    {MKV_CLUSTER_HEADER_TEMPLATE, MKV_SIMPLE_BLOCK_TEMPLATE(TRACK_AUDIO, 0x80)}
 };
-static const uint32_t gClusterHeaderSize = sizeof(gClusterHeader);
-
-static uint8_t gClusterSimpleBlock[] = {
-    0xA3, // SimpleBlock (L2)
-    0x01,
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x00, // len = SimpleBlock Header 4 bytes + raw data size - will be fixed up
-    0x81, // track Number, 0x81 is track number 1 - a placeholder
-    0x00,
-    0x00, // timecode, relative to cluster timecode - INT16 - needs to be fixed up
-    0x00  // Flags - needs to be fixed up
-          // Frame data follows
+static const uint8_t gSimpleBlockHdrTemplates[TRACK_MAX][MKV_SIMPLE_BLOCK_SIZE] = {
+    {MKV_SIMPLE_BLOCK_TEMPLATE(TRACK_VIDEO, 0x00)},
+    {MKV_SIMPLE_BLOCK_TEMPLATE(TRACK_AUDIO, 0x00)}
 };
-static const uint32_t gClusterSimpleBlockSize = sizeof(gClusterSimpleBlock);
+static const uint32_t gClusterHeaderSize = MKV_CLUSTER_HEADER_SIZE;
+static const uint32_t gClusterSimpleBlockSize = MKV_SIMPLE_BLOCK_SIZE;
 
 // Sampling Frequency in Hz
 static uint32_t gMkvAACSamplingFrequencies[] = {
@@ -544,7 +549,7 @@ int Mkv_initializeHeaders(MkvHeader_t *pMkvHeader, VideoTrackInfo_t *pVideoTrack
 
     size_t i = 0;
 
-    if (pMkvHeader == NULL || pVideoTrackInfo == NULL)
+    if (pMkvHeader == NULL || (pVideoTrackInfo == NULL && pAudioTrackInfo == NULL))
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
         LogError("Invalid argument");
@@ -560,7 +565,7 @@ int Mkv_initializeHeaders(MkvHeader_t *pMkvHeader, VideoTrackInfo_t *pVideoTrack
 
         bHasAudioTrack = (pAudioTrackInfo != NULL) ? true : false;
 
-        if ((res = prvCreateVideoTrackEntry(pVideoTrackInfo, &pSegmentVideo, &uSegmentVideoLen)) != KVS_ERRNO_NONE ||
+        if ((pVideoTrackInfo != NULL && (res = prvCreateVideoTrackEntry(pVideoTrackInfo, &pSegmentVideo, &uSegmentVideoLen)) != KVS_ERRNO_NONE) ||
             (bHasAudioTrack && (res = prvCreateAudioTrackEntry(pAudioTrackInfo, &pSegmentAudio, &uSegmentAudioLen)) != KVS_ERRNO_NONE))
         {
             LogError("Failed to create track entries");
@@ -606,8 +611,11 @@ int Mkv_initializeHeaders(MkvHeader_t *pMkvHeader, VideoTrackInfo_t *pVideoTrack
                 PUT_UNALIGNED_4_byte_BE(pIdx + MKV_SEGMENT_TRACK_LENGTH_OFFSET, MKV_LENGTH_INDICATOR_4_BYTE | uSegmentTracksLen);
                 pIdx += gSegmentTrackHeaderSize;
 
-                memcpy(pIdx, pSegmentVideo, uSegmentVideoLen);
-                pIdx += uSegmentVideoLen;
+                if (pSegmentVideo != NULL)
+                {
+                    memcpy(pIdx, pSegmentVideo, uSegmentVideoLen);
+                    pIdx += uSegmentVideoLen;
+                }
 
                 if (bHasAudioTrack)
                 {
@@ -680,7 +688,7 @@ int Mkv_initializeClusterHdr(
     uint8_t *pIdx = NULL;
     size_t uMkvHeaderLen = Mkv_getClusterHdrLen(xType);
 
-    if (pMkvHeader == NULL || uMkvHeaderLen > uMkvHeaderSize)
+    if (pMkvHeader == NULL || uMkvHeaderLen > uMkvHeaderSize || xTrackType < TRACK_VIDEO || xTrackType > TRACK_MAX)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
         LogError("Invalid argument");
@@ -688,24 +696,17 @@ int Mkv_initializeClusterHdr(
     else if (xType == MKV_CLUSTER)
     {
         pIdx = pMkvHeader;
-        memcpy(pIdx, gClusterHeader, gClusterHeaderSize);
+        memcpy(pIdx, gClusterHdrTemplates[xTrackType - 1], gClusterHeaderSize + gClusterSimpleBlockSize);
         PUT_UNALIGNED_8_byte_BE(pIdx + 7, uAbsoluteTimestamp);
         pIdx += gClusterHeaderSize;
-
-        memcpy(pIdx, gClusterSimpleBlock, gClusterSimpleBlockSize);
-        *(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_TRACK_NUMBER_OFFSET) = MKV_LENGTH_INDICATOR_1_BYTE | ((uint8_t)xTrackType & 0xFF);
         PUT_UNALIGNED_4_byte_BE(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_FRAME_SIZE_OFFSET, SIMPLE_BLOCK_HEADER_SIZE + uFrameSize);
-        *(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_PROPERTY_OFFSET) = 0x80;
-        pIdx += gClusterSimpleBlockSize;
     }
     else if (xType == MKV_SIMPLE_BLOCK)
     {
         pIdx = pMkvHeader;
-        memcpy(pIdx, gClusterSimpleBlock, gClusterSimpleBlockSize);
-        *(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_TRACK_NUMBER_OFFSET) = MKV_LENGTH_INDICATOR_1_BYTE | ((uint8_t)xTrackType & 0xFF);
+        memcpy(pIdx, gSimpleBlockHdrTemplates[xTrackType - 1], gClusterSimpleBlockSize);
         PUT_UNALIGNED_4_byte_BE(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_FRAME_SIZE_OFFSET, SIMPLE_BLOCK_HEADER_SIZE + uFrameSize);
         PUT_UNALIGNED_2_byte_BE(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_DELTA_TIMESTAMP_OFFSET, uDeltaTimestamp);
-        pIdx += gClusterSimpleBlockSize;
     }
     else
     {
@@ -716,6 +717,170 @@ int Mkv_initializeClusterHdr(
     return res;
 }
 
+int Mkv_setSimpleBlockLacing(uint8_t *pMkvHeader, size_t uMkvHeaderLen, MkvClusterType_t xType, MkvLacing_t xLacing)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pIdx = NULL;
+
+    if (pMkvHeader == NULL || Mkv_getClusterHdrLen(xType) == 0 || Mkv_getClusterHdrLen(xType) > uMkvHeaderLen ||
+        ((uint8_t)xLacing & ~MKV_SIMPLE_BLOCK_LACING_MASK) != 0)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        pIdx = (xType == MKV_CLUSTER) ? (pMkvHeader + gClusterHeaderSize) : pMkvHeader;
+        *(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_PROPERTY_OFFSET) &= ~MKV_SIMPLE_BLOCK_LACING_MASK;
+        *(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_PROPERTY_OFFSET) |= (uint8_t)xLacing;
+    }
+
+    return res;
+}
+
+int Mkv_setSimpleBlockDeltaTimestamp(uint8_t *pMkvHeader, size_t uMkvHeaderLen, MkvClusterType_t xType, uint16_t uDeltaTimestamp)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pIdx = NULL;
+
+    if (pMkvHeader == NULL || Mkv_getClusterHdrLen(xType) == 0 || Mkv_getClusterHdrLen(xType) > uMkvHeaderLen)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        pIdx = (xType == MKV_CLUSTER) ? (pMkvHeader + gClusterHeaderSize) : pMkvHeader;
+        PUT_UNALIGNED_2_byte_BE(pIdx + MKV_CLUSTER_SIMPLE_BLOCK_DELTA_TIMESTAMP_OFFSET, uDeltaTimestamp);
+    }
+
+    return res;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t prvGetEbmlLaceSizeLen(uint64_t uSize)
+{
+    size_t uLen = 1;
+
+    /* A value with all bits set is reserved, so it takes one more byte. */
+    while (uLen < MKV_EBML_LACE_SIZE_MAX_LEN && uSize >= ((uint64_t)1 << (7 * uLen)) - 1)
+    {
+        uLen++;
+    }
+
+    return uLen;
+}
+
+static size_t prvGetEbmlLaceSizeDiffLen(int64_t xDiff)
+{
+    size_t uLen = 1;
+
+    while (uLen < MKV_EBML_LACE_SIZE_MAX_LEN && (xDiff > ((int64_t)1 << (7 * uLen - 1)) - 1 || xDiff < -(((int64_t)1 << (7 * uLen - 1)) - 1)))
+    {
+        uLen++;
+    }
+
+    return uLen;
+}
+
+static uint8_t *prvPutEbmlLaceSize(uint8_t *pIdx, uint64_t uValue, size_t uLen)
+{
+    size_t i = 0;
+    uint64_t uCoded = uValue | ((uint64_t)1 << (7 * uLen));
+
+    for (i = 0; i < uLen; i++)
+    {
+        pIdx[i] = (uint8_t)(uCoded >> (8 * (uLen - 1 - i)));
+    }
+
+    return pIdx + uLen;
+}
+
+size_t Mkv_getLaceHdrLen(MkvLacing_t xLacing, const size_t *puFrameSizes, size_t uFrameCount)
+{
+    size_t uLen = 0;
+    size_t i = 0;
+
+    if (puFrameSizes == NULL || uFrameCount == 0 || uFrameCount > MKV_LACE_MAX_FRAME_COUNT)
+    {
+        /* nop */
+    }
+    else if (xLacing == MKV_LACING_FIXED_SIZE)
+    {
+        /* It's only the number of frames minus 1, and all frames have the same size. */
+        uLen = 1;
+        for (i = 1; i < uFrameCount; i++)
+        {
+            if (puFrameSizes[i] != puFrameSizes[0])
+            {
+                uLen = 0;
+                break;
+            }
+        }
+    }
+    else if (xLacing == MKV_LACING_EBML)
+    {
+        /* The number of frames minus 1, the size of the 1st frame, and differences of sizes except the last one. */
+        uLen = 1;
+        if (uFrameCount > 1)
+        {
+            uLen += prvGetEbmlLaceSizeLen(puFrameSizes[0]);
+            for (i = 1; i < uFrameCount - 1; i++)
+            {
+                uLen += prvGetEbmlLaceSizeDiffLen((int64_t)puFrameSizes[i] - (int64_t)puFrameSizes[i - 1]);
+            }
+        }
+    }
+
+    return uLen;
+}
+
+int Mkv_initializeLaceHdr(uint8_t *pLaceHeader, size_t uLaceHeaderSize, MkvLacing_t xLacing, const size_t *puFrameSizes, size_t uFrameCount)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pIdx = NULL;
+    size_t uLaceHeaderLen = Mkv_getLaceHdrLen(xLacing, puFrameSizes, uFrameCount);
+    size_t uLen = 0;
+    int64_t xDiff = 0;
+    size_t i = 0;
+
+    if (pLaceHeader == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (uLaceHeaderLen == 0)
+    {
+        res = KVS_ERROR_MKV_INVALID_LACING;
+        LogError("Invalid lacing");
+    }
+    else if (uLaceHeaderLen > uLaceHeaderSize)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        pIdx = pLaceHeader;
+        *(pIdx++) = (uint8_t)(uFrameCount - 1);
+
+        if (xLacing == MKV_LACING_EBML && uFrameCount > 1)
+        {
+            pIdx = prvPutEbmlLaceSize(pIdx, puFrameSizes[0], prvGetEbmlLaceSizeLen(puFrameSizes[0]));
+            for (i = 1; i < uFrameCount - 1; i++)
+            {
+                /* A signed difference is stored with a bias of the half range of its length. */
+                xDiff = (int64_t)puFrameSizes[i] - (int64_t)puFrameSizes[i - 1];
+                uLen = prvGetEbmlLaceSizeDiffLen(xDiff);
+                pIdx = prvPutEbmlLaceSize(pIdx, (uint64_t)(xDiff + (((int64_t)1 << (7 * uLen - 1)) - 1)), uLen);
+            }
+        }
+    }
+
+    return res;
+}
+
 /*-----------------------------------------------------------*/
 int Mkv_generateH264CodecPrivateDataFromAnnexBNalus(uint8_t *pAnnexBBuf, size_t uAnnexBLen, uint8_t **ppCodecPrivateData, size_t *puCodecPrivateDataLen)
 {
@@ -894,6 +1059,123 @@ int Mkv_generateH264CodecPrivateDataFromSpsPps(uint8_t *pSps, size_t uSpsLen, ui
 
 /*-----------------------------------------------------------*/
 
+static uint8_t *prvPutHevcNaluArray(uint8_t *pCpdIdx, uint8_t uNaluType, uint8_t *pNalu, size_t uNaluLen)
+{
+    *(pCpdIdx++) = 0x80 | uNaluType; /* '1' array_completeness + '0' reserved + NAL_unit_type */
+    PUT_UNALIGNED_2_byte_BE(pCpdIdx, 1); /* numNalus */
+    pCpdIdx += 2;
+    PUT_UNALIGNED_2_byte_BE(pCpdIdx, uNaluLen);
+    pCpdIdx += 2;
+    memcpy(pCpdIdx, pNalu, uNaluLen);
+    pCpdIdx += uNaluLen;
+
+    return pCpdIdx;
+}
+
+int Mkv_generateHevcCodecPrivateDataFromVpsSpsPps(
+    uint8_t *pVps,
+    size_t uVpsLen,
+    uint8_t *pSps,
+    size_t uSpsLen,
+    uint8_t *pPps,
+    size_t uPpsLen,
+    uint8_t **ppCodecPrivateData,
+    size_t *puCodecPrivateDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    HevcSpsInfo_t xSpsInfo = {0};
+    uint8_t *pCpdIdx = NULL;
+    uint8_t *pCodecPrivateData = NULL;
+    size_t uCodecPrivateLen = 0;
+
+    if (pVps == NULL || uVpsLen == 0 || pSps == NULL || uSpsLen < 3 || pPps == NULL || uPpsLen == 0 || ppCodecPrivateData == NULL || puCodecPrivateDataLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((res = getHevcSpsInfo(pSps + 2, uSpsLen - 2, &xSpsInfo)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to parse H265 SPS");
+        /* Propagate the res error */
+    }
+    else
+    {
+        uCodecPrivateLen = MKV_VIDEO_HEVC_CODEC_PRIVATE_DATA_HEADER_SIZE + 3 * MKV_VIDEO_HEVC_CODEC_PRIVATE_DATA_ARRAY_HEADER_SIZE + uVpsLen + uSpsLen + uPpsLen;
+
+        if ((pCodecPrivateData = (uint8_t *)kvsMalloc(uCodecPrivateLen)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: H265 codec private data");
+        }
+        else
+        {
+            pCpdIdx = pCodecPrivateData;
+            *(pCpdIdx++) = 0x01; /* configurationVersion */
+
+            /* From general_profile_space to general_level_idc, which are the same as the ones in SPS */
+            memcpy(pCpdIdx, xSpsInfo.pGeneralProfileTierLevel, HEVC_GENERAL_PROFILE_TIER_LEVEL_LEN);
+            pCpdIdx += HEVC_GENERAL_PROFILE_TIER_LEVEL_LEN;
+
+            *(pCpdIdx++) = 0xF0; /* '1111' reserved + min_spatial_segmentation_idc which is 0 */
+            *(pCpdIdx++) = 0x00;
+            *(pCpdIdx++) = 0xFC; /* '111111' reserved + '00' parallelismType which is unknown */
+            *(pCpdIdx++) = 0xFC | xSpsInfo.uChromaFormatIdc; /* '111111' reserved + chromaFormat */
+            *(pCpdIdx++) = 0xF8 | xSpsInfo.uBitDepthLumaMinus8; /* '11111' reserved + bitDepthLumaMinus8 */
+            *(pCpdIdx++) = 0xF8 | xSpsInfo.uBitDepthChromaMinus8; /* '11111' reserved + bitDepthChromaMinus8 */
+            PUT_UNALIGNED_2_byte_BE(pCpdIdx, 0); /* avgFrameRate which is unspecified */
+            pCpdIdx += 2;
+
+            /* '00' constantFrameRate + numTemporalLayers + temporalIdNested + '11' lengthSizeMinusOne which is 3 */
+            *(pCpdIdx++) = ((xSpsInfo.uMaxSubLayersMinus1 + 1) << 3) | (xSpsInfo.uTemporalIdNestingFlag << 2) | 0x03;
+
+            *(pCpdIdx++) = 0x03; /* numOfArrays of VPS, SPS and PPS */
+            pCpdIdx = prvPutHevcNaluArray(pCpdIdx, NALU_TYPE_HEVC_VPS, pVps, uVpsLen);
+            pCpdIdx = prvPutHevcNaluArray(pCpdIdx, NALU_TYPE_HEVC_SPS, pSps, uSpsLen);
+            pCpdIdx = prvPutHevcNaluArray(pCpdIdx, NALU_TYPE_HEVC_PPS, pPps, uPpsLen);
+
+            *ppCodecPrivateData = pCodecPrivateData;
+            *puCodecPrivateDataLen = uCodecPrivateLen;
+        }
+    }
+
+    return res;
+}
+
+/*-----------------------------------------------------------*/
+
+int Mkv_generateHevcCodecPrivateDataFromAvccNalus(uint8_t *pAvccBuf, size_t uAvccLen, uint8_t **ppCodecPrivateData, size_t *puCodecPrivateDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pVps = NULL;
+    size_t uVpsLen = 0;
+    uint8_t *pSps = NULL;
+    size_t uSpsLen = 0;
+    uint8_t *pPps = NULL;
+    size_t uPpsLen = 0;
+
+    if (pAvccBuf == NULL || uAvccLen == 0 || ppCodecPrivateData == NULL || puCodecPrivateDataLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (
+        (res = NALU_getHevcNaluFromAvccNalus(pAvccBuf, uAvccLen, NALU_TYPE_HEVC_VPS, &pVps, &uVpsLen)) != KVS_ERRNO_NONE ||
+        (res = NALU_getHevcNaluFromAvccNalus(pAvccBuf, uAvccLen, NALU_TYPE_HEVC_SPS, &pSps, &uSpsLen)) != KVS_ERRNO_NONE ||
+        (res = NALU_getHevcNaluFromAvccNalus(pAvccBuf, uAvccLen, NALU_TYPE_HEVC_PPS, &pPps, &uPpsLen)) != KVS_ERRNO_NONE)
+    {
+        LogInfo("Failed to get VPS, SPS and PPS from AVCC NALU");
+        /* Propagate the res error */
+    }
+    else
+    {
+        res = Mkv_generateHevcCodecPrivateDataFromVpsSpsPps(pVps, uVpsLen, pSps, uSpsLen, pPps, uPpsLen, ppCodecPrivateData, puCodecPrivateDataLen);
+    }
+
+    return res;
+}
+
+/*-----------------------------------------------------------*/
+
 int Mkv_generateAacCodecPrivateData(Mpeg4AudioObjectTypes_t objectType, uint32_t frequency, uint16_t channel, uint8_t **ppCodecPrivateData, size_t *puCodecPrivateDataLen)
 {
     int res = KVS_ERRNO_NONE;
@@ -14,12 +14,11 @@
  */
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 /* Third party headers */
-#include "azure_c_shared_utility/buffer_.h"
-#include "azure_c_shared_utility/httpheaders.h"
-#include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/xlogging.h"
 
 /* Public headers */
@@ -33,134 +32,241 @@
 
 #define DEFAULT_HTTP_RECV_BUFSIZE 2048
 
-static int prvGenerateHttpReq(const char *pcHttpMethod, const char *pcUri, HTTP_HEADERS_HANDLE xHttpReqHeaders, const char *pcBody, STRING_HANDLE *pStringHandle)
+#define HTTP_VERSION_LINE_END " HTTP/1.1\r\n"
+#define HTTP_HEADER_SEPARATOR ": "
+#define HTTP_CRLF "\r\n"
+
+typedef struct HttpRspBody
+{
+    HttpRspParserHandle xRspParser;
+    char *pBody;
+    size_t uBodyLen;
+    size_t uBodySize;
+} HttpRspBody_t;
+
+static char *prvAppendStr(char *pcDst, const char *pcSrc)
+{
+    size_t uLen = strlen(pcSrc);
+
+    memcpy(pcDst, pcSrc, uLen);
+
+    return pcDst + uLen;
+}
+
+int Http_addReqHeader(HttpReqHeaders_t *pxHttpReqHeaders, const char *pcName, const char *pcValue)
 {
     int res = KVS_ERRNO_NONE;
-    STRING_HANDLE xStHttpReq = NULL;
-    size_t uHeadersCnt = 0;
-    size_t i = 0;
-    char *pcHeader = NULL;
+    HttpHeader_t *pxHeader = NULL;
 
-    if (HTTPHeaders_GetHeaderCount(xHttpReqHeaders, &uHeadersCnt) != HTTP_HEADERS_OK)
+    if (pxHttpReqHeaders == NULL || pcName == NULL || pcValue == NULL)
     {
-        res = KVS_ERROR_UNABLE_TO_GET_HTTP_HEADER_COUNT;
+        res = KVS_ERROR_INVALID_ARGUMENT;
     }
-    else if ((xStHttpReq = STRING_new()) == NULL || STRING_sprintf(xStHttpReq, "%s %s HTTP/1.1\r\n", pcHttpMethod, pcUri) != 0)
+    else if (pxHttpReqHeaders->uHeadersCnt >= HTTP_REQ_MAX_HEADERS)
     {
-        res = KVS_ERROR_C_UTIL_STRING_ERROR;
+        res = KVS_ERROR_TOO_MANY_HTTP_HEADERS;
+        LogError("Too many HTTP headers");
     }
     else
     {
-        for (i = 0; i < uHeadersCnt && res == KVS_ERRNO_NONE; i++)
+        pxHeader = &(pxHttpReqHeaders->pxHeaders[pxHttpReqHeaders->uHeadersCnt]);
+        pxHeader->pcName = pcName;
+        pxHeader->pcValue = pcValue;
+        pxHttpReqHeaders->uHeadersCnt++;
+    }
+
+    return res;
+}
+
+const char *Http_findReqHeaderValue(const HttpReqHeaders_t *pxHttpReqHeaders, const char *pcName)
+{
+    const char *pcValue = NULL;
+    size_t i = 0;
+
+    if (pxHttpReqHeaders != NULL && pcName != NULL)
+    {
+        for (i = 0; i < pxHttpReqHeaders->uHeadersCnt && pcValue == NULL; i++)
         {
-            if (HTTPHeaders_GetHeader(xHttpReqHeaders, i, &pcHeader) != HTTP_HEADERS_OK)
+            if (strcmp(pxHttpReqHeaders->pxHeaders[i].pcName, pcName) == 0)
             {
-                res = KVS_ERROR_UNABLE_TO_GET_HTTP_HEADER;
-            }
-            else
-            {
-                if (STRING_sprintf(xStHttpReq, "%s\r\n", pcHeader) != 0)
-                {
-                    res = KVS_ERROR_C_UTIL_STRING_ERROR;
-                }
-                /* pcHeader was created by HTTPHeaders_GetHeader via malloc */
-                free(pcHeader);
+                pcValue = pxHttpReqHeaders->pxHeaders[i].pcValue;
             }
         }
+    }
+
+    return pcValue;
+}
+
+size_t Http_getHttpReqHeadLen(const char *pcHttpMethod, const char *pcUri, const HttpReqHeaders_t *pxHttpReqHeaders)
+{
+    size_t uLen = 0;
+    size_t i = 0;
 
-        if (res == KVS_ERRNO_NONE)
+    if (pcHttpMethod != NULL && pcUri != NULL && pxHttpReqHeaders != NULL)
+    {
+        uLen = strlen(pcHttpMethod) + 1 + strlen(pcUri) + sizeof(HTTP_VERSION_LINE_END) - 1;
+        for (i = 0; i < pxHttpReqHeaders->uHeadersCnt; i++)
         {
-            if (STRING_sprintf(xStHttpReq, "\r\n") != 0)
-            {
-                res = KVS_ERROR_C_UTIL_STRING_ERROR;
-            }
-            else if (strlen(pcBody) > 0 && STRING_sprintf(xStHttpReq, "%s", pcBody) != 0)
-            {
-                res = KVS_ERROR_C_UTIL_STRING_ERROR;
-            }
-            else
-            {
-                /* nop */
-            }
+            uLen += strlen(pxHttpReqHeaders->pxHeaders[i].pcName) + sizeof(HTTP_HEADER_SEPARATOR) - 1 + strlen(pxHttpReqHeaders->pxHeaders[i].pcValue) + sizeof(HTTP_CRLF) - 1;
         }
+        uLen += sizeof(HTTP_CRLF) - 1;
     }
 
-    if (res == KVS_ERRNO_NONE)
+    return uLen;
+}
+
+int Http_serializeHttpReqHead(const char *pcHttpMethod, const char *pcUri, const HttpReqHeaders_t *pxHttpReqHeaders, char *pBuf, size_t uBufSize, size_t *puHeadLen)
+{
+    int res = KVS_ERRNO_NONE;
+    size_t uHeadLen = 0;
+    char *pcPos = pBuf;
+    size_t i = 0;
+
+    if (pcHttpMethod == NULL || pcUri == NULL || pxHttpReqHeaders == NULL || pBuf == NULL || puHeadLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((uHeadLen = Http_getHttpReqHeadLen(pcHttpMethod, pcUri, pxHttpReqHeaders)) >= uBufSize)
     {
-        *pStringHandle = xStHttpReq;
+        res = KVS_ERROR_HTTP_REQ_BUFFER_TOO_SMALL;
+        LogError("HTTP request buffer is too small");
     }
     else
     {
-        STRING_delete(xStHttpReq);
-        xStHttpReq = NULL;
+        pcPos = prvAppendStr(pcPos, pcHttpMethod);
+        *pcPos++ = ' ';
+        pcPos = prvAppendStr(pcPos, pcUri);
+        pcPos = prvAppendStr(pcPos, HTTP_VERSION_LINE_END);
+        for (i = 0; i < pxHttpReqHeaders->uHeadersCnt; i++)
+        {
+            pcPos = prvAppendStr(pcPos, pxHttpReqHeaders->pxHeaders[i].pcName);
+            pcPos = prvAppendStr(pcPos, HTTP_HEADER_SEPARATOR);
+            pcPos = prvAppendStr(pcPos, pxHttpReqHeaders->pxHeaders[i].pcValue);
+            pcPos = prvAppendStr(pcPos, HTTP_CRLF);
+        }
+        pcPos = prvAppendStr(pcPos, HTTP_CRLF);
+        *pcPos = '\0';
+
+        *puHeadLen = uHeadLen;
     }
 
     return res;
 }
 
-int Http_executeHttpReq(NetIoHandle xNetIoHandle, const char *pcHttpMethod, const char *pcUri, HTTP_HEADERS_HANDLE xHttpReqHeaders, const char *pcBody)
+int Http_executeHttpReq(NetIoHandle xNetIoHandle, const char *pcHttpMethod, const char *pcUri, const HttpReqHeaders_t *pxHttpReqHeaders, const char *pcBody)
 {
     int res = KVS_ERRNO_NONE;
-    STRING_HANDLE xStHttpReq = NULL;
+    size_t uBodyLen = 0;
+    size_t uInlineBodyLen = 0;
+    size_t uHeadLen = 0;
+    size_t uBufSize = 0;
+    char *pBuf = NULL;
+    NetIoVec_t pxIov[2] = {0};
 
-    if (xNetIoHandle == NULL || pcHttpMethod == NULL || pcUri == NULL || xHttpReqHeaders == NULL || pcBody == NULL)
+    if (xNetIoHandle == NULL || pcHttpMethod == NULL || pcUri == NULL || pxHttpReqHeaders == NULL || pcBody == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
     }
-    else if ((res = prvGenerateHttpReq(pcHttpMethod, pcUri, xHttpReqHeaders, pcBody, &xStHttpReq)) != KVS_ERRNO_NONE)
+    else
     {
-        /* Propagate the res error */
+        uBodyLen = strlen(pcBody);
+        uInlineBodyLen = (uBodyLen <= HTTP_REQ_INLINE_BODY_MAX_LEN) ? uBodyLen : 0;
+        uBufSize = Http_getHttpReqHeadLen(pcHttpMethod, pcUri, pxHttpReqHeaders) + uInlineBodyLen + 1;
+
+        if ((pBuf = (char *)kvsMalloc(uBufSize)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: HTTP request");
+        }
+        else if ((res = Http_serializeHttpReqHead(pcHttpMethod, pcUri, pxHttpReqHeaders, pBuf, uBufSize, &uHeadLen)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else if (uInlineBodyLen == uBodyLen)
+        {
+            memcpy(pBuf + uHeadLen, pcBody, uBodyLen);
+            res = NetIo_send(xNetIoHandle, (const unsigned char *)pBuf, uHeadLen + uBodyLen);
+        }
+        else
+        {
+            /* The body isn't copied, and NetIo_sendv() sends the beginning of it along with the head. */
+            pxIov[0].pBase = (const unsigned char *)pBuf;
+            pxIov[0].uLen = uHeadLen;
+            pxIov[1].pBase = (const unsigned char *)pcBody;
+            pxIov[1].uLen = uBodyLen;
+            res = NetIo_sendv(xNetIoHandle, pxIov, 2);
+        }
     }
-    else if ((res = NetIo_send(xNetIoHandle, (const unsigned char *)STRING_c_str(xStHttpReq), STRING_length(xStHttpReq))) != KVS_ERRNO_NONE)
+
+    kvsFree(pBuf);
+
+    return res;
+}
+
+static int prvAppendRspBody(const char *pBodySlice, size_t uLen, void *pAppData)
+{
+    int res = KVS_ERRNO_NONE;
+    HttpRspBody_t *pxRspBody = (HttpRspBody_t *)pAppData;
+    size_t uNewSize = 0;
+    char *pNewBody = NULL;
+
+    /* The body is allocated once with the size of Content-Length. It only grows if the length isn't known. */
+    if (pxRspBody->uBodyLen + uLen + 1 > pxRspBody->uBodySize)
     {
-        /* Propagate the res error */
+        uNewSize = HttpParser_getRspContentLength(pxRspBody->xRspParser) + 1;
+        if (uNewSize < pxRspBody->uBodyLen + uLen + 1)
+        {
+            uNewSize = pxRspBody->uBodyLen + uLen + 1;
+        }
+
+        if ((pNewBody = (char *)kvsMalloc(uNewSize)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: pRspBody");
+        }
+        else
+        {
+            if (pxRspBody->pBody != NULL)
+            {
+                memcpy(pNewBody, pxRspBody->pBody, pxRspBody->uBodyLen);
+                kvsFree(pxRspBody->pBody);
+            }
+            pxRspBody->pBody = pNewBody;
+            pxRspBody->uBodySize = uNewSize;
+        }
     }
-    else
+
+    if (res == KVS_ERRNO_NONE)
     {
-        /* nop */
+        memcpy(pxRspBody->pBody + pxRspBody->uBodyLen, pBodySlice, uLen);
+        pxRspBody->uBodyLen += uLen;
+        pxRspBody->pBody[pxRspBody->uBodyLen] = '\0';
     }
 
-    STRING_delete(xStHttpReq);
-
     return res;
 }
 
-int Http_recvHttpRsp(NetIoHandle xNetIoHandle, unsigned int *puHttpStatus, char **ppRspBody, size_t *puRspBodyLen)
+static int prvRecvHttpRsp(NetIoHandle xNetIoHandle, HttpRspParserHandle xRspParser)
 {
     int res = KVS_ERRNO_NONE;
-    BUFFER_HANDLE xBufRecv = NULL;
+    unsigned char *pRecvBuf = NULL;
     size_t uBytesReceived = 0;
-    size_t uBytesTotalReceived = 0;
-    unsigned int uHttpStatusCode = 0;
-    const char *pBodyLoc = NULL;
-    size_t uBodyLen = 0;
-    char *pRspBody = NULL;
+    size_t uBytesConsumed = 0;
+    bool bComplete = false;
 
-    if (xNetIoHandle == NULL || puHttpStatus == NULL || ppRspBody == NULL || puRspBodyLen == NULL)
+    if ((pRecvBuf = (unsigned char *)kvsMalloc(DEFAULT_HTTP_RECV_BUFSIZE)) == NULL)
     {
-        res = KVS_ERROR_INVALID_ARGUMENT;
-    }
-    else if ((xBufRecv = BUFFER_create_with_size(DEFAULT_HTTP_RECV_BUFSIZE)) == NULL)
-    {
-        res = KVS_ERROR_C_UTIL_UNABLE_TO_CREATE_BUFFER;
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pRecvBuf");
     }
     else
     {
-        do
+        /* Bytes are parsed as they arrive, and it stops reading as soon as the response is complete. */
+        while (res == KVS_ERRNO_NONE && !bComplete)
         {
             /* TODO: Add timeout checking here */
 
-            if (uBytesTotalReceived == BUFFER_length(xBufRecv))
-            {
-                /* If buffer is full, then we double the size of buffer. */
-                if (BUFFER_enlarge(xBufRecv, uBytesTotalReceived) != 0)
-                {
-                    res = KVS_ERROR_C_UTIL_UNABLE_TO_ENLARGE_BUFFER;
-                    LogError("OOM: xBufRecv");
-                    break;
-                }
-            }
-            if ((res = NetIo_recv(xNetIoHandle, BUFFER_u_char(xBufRecv) + uBytesTotalReceived, BUFFER_length(xBufRecv) - uBytesTotalReceived, &uBytesReceived)) != KVS_ERRNO_NONE)
+            if ((res = NetIo_recv(xNetIoHandle, pRecvBuf, DEFAULT_HTTP_RECV_BUFSIZE, &uBytesReceived)) != KVS_ERRNO_NONE)
             {
                 /* Propagate the res error */
             }
@@ -168,43 +274,84 @@ int Http_recvHttpRsp(NetIoHandle xNetIoHandle, unsigned int *puHttpStatus, char
             else if (uBytesReceived == 0)
             {
                 res = KVS_ERROR_RECV_ZERO_SIZED_HTTP_DATA;
-                break;
+            }
+            else if ((res = HttpParser_executeRspParser(xRspParser, (const char *)pRecvBuf, uBytesReceived, &uBytesConsumed, &bComplete)) != KVS_ERRNO_NONE)
+            {
+                /* Propagate the res error */
             }
             else
             {
-                uBytesTotalReceived += uBytesReceived;
-                if ((res = HttpParser_parseHttpResponse((const char *)BUFFER_u_char(xBufRecv), uBytesTotalReceived, &uHttpStatusCode, &pBodyLoc, &uBodyLen)) != KVS_ERRNO_NONE)
-                {
-                    /* Propagate the res error */
-                }
-                /* If it's 100-continue, then we need to discard previous result and do it again. */
-                else if (uHttpStatusCode / 100 == 1)
-                {
-                    LogInfo("100-continue");
-                    uBytesTotalReceived = 0;
-                    res = KVS_ERROR_HTTP_100_CONTINUE_EXPECT_MORE;
-                }
-                else
-                {
-                    res = KVS_ERRNO_NONE;
-                    *puHttpStatus = uHttpStatusCode;
-
-                    if ((pRspBody = (char *)kvsMalloc(uBodyLen + 1)) == NULL)
-                    {
-                        res = KVS_ERROR_OUT_OF_MEMORY;
-                        LogError("OOM pRspBody");
-                        break;
-                    }
-                    memcpy(pRspBody, pBodyLoc, uBodyLen);
-                    pRspBody[uBodyLen] = '\0';
-                    *ppRspBody = pRspBody;
-                    *puRspBodyLen = uBodyLen;
-                }
+                /* nop */
             }
-        } while (res != KVS_ERRNO_NONE);
+        }
+    }
+
+    kvsFree(pRecvBuf);
+
+    return res;
+}
+
+int Http_recvHttpRspStream(NetIoHandle xNetIoHandle, unsigned int *puHttpStatus, OnHttpRspBodyCallback_t onBody, void *pAppData)
+{
+    int res = KVS_ERRNO_NONE;
+    HttpRspParserHandle xRspParser = NULL;
+
+    if (xNetIoHandle == NULL || puHttpStatus == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((xRspParser = HttpParser_createRspParser(onBody, pAppData)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: xRspParser");
+    }
+    else if ((res = prvRecvHttpRsp(xNetIoHandle, xRspParser)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        *puHttpStatus = HttpParser_getRspStatusCode(xRspParser);
     }
 
-    BUFFER_delete(xBufRecv);
+    HttpParser_terminateRspParser(xRspParser);
 
     return res;
-}
\ No newline at end of file
+}
+
+int Http_recvHttpRsp(NetIoHandle xNetIoHandle, unsigned int *puHttpStatus, char **ppRspBody, size_t *puRspBodyLen)
+{
+    int res = KVS_ERRNO_NONE;
+    HttpRspBody_t xRspBody = {0};
+
+    if (xNetIoHandle == NULL || puHttpStatus == NULL || ppRspBody == NULL || puRspBodyLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((xRspBody.xRspParser = HttpParser_createRspParser(prvAppendRspBody, &xRspBody)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: xRspParser");
+    }
+    else if ((res = prvRecvHttpRsp(xNetIoHandle, xRspBody.xRspParser)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    /* An empty body is still returned as an empty string. */
+    else if (xRspBody.pBody == NULL && (res = prvAppendRspBody("", 0, &xRspBody)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        *puHttpStatus = HttpParser_getRspStatusCode(xRspBody.xRspParser);
+        *ppRspBody = xRspBody.pBody;
+        *puRspBodyLen = xRspBody.uBodyLen;
+        xRspBody.pBody = NULL;
+    }
+
+    kvsFree(xRspBody.pBody);
+    HttpParser_terminateRspParser(xRspBody.xRspParser);
+
+    return res;
+}
@@ -16,8 +16,9 @@
 #ifndef HTTP_HELPER_H
 #define HTTP_HELPER_H
 
-#include "azure_c_shared_utility/httpheaders.h"
+#include <stddef.h>
 
+#include "http_parser_adapter.h"
 #include "netio.h"
 
 #define HTTP_METHOD_GET                 "GET"
@@ -53,17 +54,88 @@
 
 #define HTTP_BODY_EMPTY                 ""
 
+/* The max number of headers in a request */
+#ifndef HTTP_REQ_MAX_HEADERS
+#define HTTP_REQ_MAX_HEADERS            (16)
+#endif
+
+/* A body longer than this is sent from the caller's memory right after the request head instead of being copied. */
+#ifndef HTTP_REQ_INLINE_BODY_MAX_LEN
+#define HTTP_REQ_INLINE_BODY_MAX_LEN    (1024)
+#endif
+
+typedef struct HttpHeader
+{
+    const char *pcName;
+    const char *pcValue;
+} HttpHeader_t;
+
+/* The headers of a request. Names and values are referenced but not copied, so they must outlive the request. */
+typedef struct HttpReqHeaders
+{
+    HttpHeader_t pxHeaders[HTTP_REQ_MAX_HEADERS];
+    size_t uHeadersCnt;
+} HttpReqHeaders_t;
+
+/**
+ * @brief Add a header to HTTP request headers
+ *
+ * @param[in] pxHttpReqHeaders The HTTP request headers
+ * @param[in] pcName The header name
+ * @param[in] pcValue The header value
+ * @return 0 on success, non-zero value otherwise
+ */
+int Http_addReqHeader(HttpReqHeaders_t *pxHttpReqHeaders, const char *pcName, const char *pcValue);
+
+/**
+ * @brief Find the value of a header in HTTP request headers
+ *
+ * @param[in] pxHttpReqHeaders The HTTP request headers
+ * @param[in] pcName The header name
+ * @return The header value if it's found, NULL otherwise
+ */
+const char *Http_findReqHeaderValue(const HttpReqHeaders_t *pxHttpReqHeaders, const char *pcName);
+
+/**
+ * @brief Get the length of a HTTP request head, which is the request line, the headers, and the empty line.
+ *
+ * @param[in] pcHttpMethod The HTTP method. (Ex. GET, PUT, POST)
+ * @param[in] pcUri The relative path of URI
+ * @param[in] pxHttpReqHeaders The HTTP request headers
+ * @return The length of the request head, not including the null terminator
+ */
+size_t Http_getHttpReqHeadLen(const char *pcHttpMethod, const char *pcUri, const HttpReqHeaders_t *pxHttpReqHeaders);
+
+/**
+ * @brief Write a HTTP request head into a buffer in one pass
+ *
+ * The buffer is either preallocated with the length from Http_getHttpReqHeadLen() plus a null terminator, or
+ * provided by the caller. Nothing is written if it's too small.
+ *
+ * @param[in] pcHttpMethod The HTTP method. (Ex. GET, PUT, POST)
+ * @param[in] pcUri The relative path of URI
+ * @param[in] pxHttpReqHeaders The HTTP request headers
+ * @param[out] pBuf The buffer
+ * @param[in] uBufSize The size of the buffer
+ * @param[out] puHeadLen The length of the request head, not including the null terminator
+ * @return 0 on success, non-zero value otherwise
+ */
+int Http_serializeHttpReqHead(const char *pcHttpMethod, const char *pcUri, const HttpReqHeaders_t *pxHttpReqHeaders, char *pBuf, size_t uBufSize, size_t *puHeadLen);
+
 /**
  * @brief Execute HTTP request
  *
+ * The request head and a short body are written into a single buffer and sent at once. A body longer than
+ * HTTP_REQ_INLINE_BODY_MAX_LEN is sent from pcBody directly after the head.
+ *
  * @param[in] xNetIoHandle The network I/O handle
  * @param[in] pcHttpMethod The HTTP method. (Ex. GET, PUT, POST)
  * @param[in] pcUri The relative path of URI
- * @param[in] xHttpReqHeaders The HTTP headers
+ * @param[in] pxHttpReqHeaders The HTTP request headers
  * @param[in] pcBody The HTTP body
  * @return 0 on success, non-zero value otherwise
  */
-int Http_executeHttpReq(NetIoHandle xNetIoHandle, const char *pcHttpMethod, const char *pcUri, HTTP_HEADERS_HANDLE xHttpReqHeaders, const char *pcBody);
+int Http_executeHttpReq(NetIoHandle xNetIoHandle, const char *pcHttpMethod, const char *pcUri, const HttpReqHeaders_t *pxHttpReqHeaders, const char *pcBody);
 
 /**
  * @brief Receive HTTP response
@@ -76,4 +148,18 @@ int Http_executeHttpReq(NetIoHandle xNetIoHandle, const char *pcHttpMethod, cons
  */
 int Http_recvHttpRsp(NetIoHandle xNetIoHandle, unsigned int *puHttpStatus, char **ppRspBody, size_t *puRspBodyLen);
 
+/**
+ * @brief Receive HTTP response and hand its body to a callback slice by slice
+ *
+ * The response is parsed as its bytes arrive, and it returns as soon as the headers and the Content-Length body are
+ * received, so it doesn't wait for the server to close the connection. The body is not buffered.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[out] puHttpStatus The HTTP status code
+ * @param[in] onBody The callback of body slices, or NULL to ignore the body
+ * @param[in] pAppData The application data of the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int Http_recvHttpRspStream(NetIoHandle xNetIoHandle, unsigned int *puHttpStatus, OnHttpRspBodyCallback_t onBody, void *pAppData);
+
 #endif /* HTTP_HELPER_H */
\ No newline at end of file
@@ -13,6 +13,7 @@
 * permissions and limitations under the License.
 */
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /**
@@ -25,4 +26,62 @@
  * @param puBodyLen length of the body
  * @return 0 on success, non-zero value otherwise
  */
-int HttpParser_parseHttpResponse(const char *pBuf, size_t uLen, unsigned int *puStatusCode, const char **ppBodyLoc, size_t *puBodyLen);
\ No newline at end of file
+int HttpParser_parseHttpResponse(const char *pBuf, size_t uLen, unsigned int *puStatusCode, const char **ppBodyLoc, size_t *puBodyLen);
+/**
+ * Callback of each slice of a HTTP response body. The slice points into the buffer being parsed.
+ *
+ * @param pBodySlice the slice of the body
+ * @param uLen length of the slice
+ * @param pAppData the application data given to the parser
+ * @return 0 to continue, non-zero value to stop parsing with this error
+ */
+typedef int (*OnHttpRspBodyCallback_t)(const char *pBodySlice, size_t uLen, void *pAppData);
+
+typedef struct HttpRspParser *HttpRspParserHandle;
+
+/**
+ * Create a parser that parses a HTTP response incrementally as its bytes arrive.
+ *
+ * Interim (1xx) responses are skipped, and parsing completes at the end of the final response. A response without
+ * Content-Length, like a streamed chunked one, completes at the end of its headers and its body is not parsed.
+ *
+ * @param onBody the callback of body slices, or NULL to ignore the body
+ * @param pAppData the application data of the callback
+ * @return the parser handle on success, NULL otherwise
+ */
+HttpRspParserHandle HttpParser_createRspParser(OnHttpRspBodyCallback_t onBody, void *pAppData);
+
+/**
+ * Terminate a HTTP response parser.
+ *
+ * @param xRspParser the parser handle
+ */
+void HttpParser_terminateRspParser(HttpRspParserHandle xRspParser);
+
+/**
+ * Parse the next bytes of a HTTP response. Bytes after the end of the response are not consumed.
+ *
+ * @param xRspParser the parser handle
+ * @param pBuf buffer of the received bytes
+ * @param uLen length of the buffer
+ * @param puConsumed length of the bytes that belong to the response
+ * @param pbComplete true if the response is complete
+ * @return 0 on success, non-zero value otherwise
+ */
+int HttpParser_executeRspParser(HttpRspParserHandle xRspParser, const char *pBuf, size_t uLen, size_t *puConsumed, bool *pbComplete);
+
+/**
+ * Get the status code of the response. It's available once the headers are parsed.
+ *
+ * @param xRspParser the parser handle
+ * @return the HTTP status code, or 0 if it's not available
+ */
+unsigned int HttpParser_getRspStatusCode(HttpRspParserHandle xRspParser);
+
+/**
+ * Get the Content-Length of the response. It's available once the headers are parsed.
+ *
+ * @param xRspParser the parser handle
+ * @return the content length, or 0 if it's not available
+ */
+size_t HttpParser_getRspContentLength(HttpRspParserHandle xRspParser);
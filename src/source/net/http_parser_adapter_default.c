@@ -13,10 +13,13 @@
 * permissions and limitations under the License.
  */
 
+#include <string.h>
+
 /* Public headers */
 #include "kvs/errors.h"
 
 /* Internal headers */
+#include "os/allocator.h"
 #include "net/http_parser_adapter.h"
 
 #define HTTP_RSP_STATUS_HDR         "HTTP/1.1"
@@ -24,6 +27,26 @@
 
 #define TOLOWERCASE(c)              (c | 0xA0)
 
+/* Only the beginning of a header line is needed to find the status code and the content length. */
+#define HTTP_PARSER_LINE_BUFSIZE    (64)
+
+typedef struct HttpRspParser
+{
+    OnHttpRspBodyCallback_t onBody;
+    void *pAppData;
+
+    unsigned int uStatusCode;
+    size_t uContentLength;
+
+    /* The current header line. It's truncated if it's longer than the buffer, but uLineLen is the real length. */
+    char pLine[HTTP_PARSER_LINE_BUFSIZE];
+    size_t uLineLen;
+
+    bool bInBody;
+    size_t uBodyRemaining;
+    bool bComplete;
+} HttpRspParser_t;
+
 /**
  * Get the length of the first line in a string. Assume each line is separated by the EOL ('\n') character.
  *
@@ -187,4 +210,125 @@ int HttpParser_parseHttpResponse(const char *pBuf, size_t uLen, unsigned int *pu
         }
     }
     return res;
-}
\ No newline at end of file
+}
+
+HttpRspParserHandle HttpParser_createRspParser(OnHttpRspBodyCallback_t onBody, void *pAppData)
+{
+    HttpRspParser_t *pxParser = NULL;
+
+    if ((pxParser = (HttpRspParser_t *)kvsMalloc(sizeof(HttpRspParser_t))) != NULL)
+    {
+        memset(pxParser, 0, sizeof(HttpRspParser_t));
+        pxParser->onBody = onBody;
+        pxParser->pAppData = pAppData;
+    }
+
+    return pxParser;
+}
+
+void HttpParser_terminateRspParser(HttpRspParserHandle xRspParser)
+{
+    kvsFree(xRspParser);
+}
+
+/**
+ * Handle a complete header line, including the status line and the empty line at the end of the headers.
+ *
+ * @param[in] pxParser the parser
+ */
+static void prvHandleRspLine(HttpRspParser_t *pxParser)
+{
+    size_t uStoredLen = (pxParser->uLineLen < HTTP_PARSER_LINE_BUFSIZE) ? pxParser->uLineLen : HTTP_PARSER_LINE_BUFSIZE;
+
+    if (pxParser->uLineLen <= 2 && (pxParser->uLineLen == 1 || pxParser->pLine[0] == '\r'))
+    {
+        if (pxParser->uStatusCode / 100 == 1)
+        {
+            /* Skip an interim response, and the final one follows. */
+            pxParser->uStatusCode = 0;
+            pxParser->uContentLength = 0;
+        }
+        else if (pxParser->uContentLength > 0)
+        {
+            pxParser->bInBody = true;
+            pxParser->uBodyRemaining = pxParser->uContentLength;
+        }
+        else
+        {
+            pxParser->bComplete = true;
+        }
+    }
+    else if (uStoredLen >= sizeof(HTTP_RSP_STATUS_HDR) && prvStrNCmpCi(pxParser->pLine, HTTP_RSP_STATUS_HDR, sizeof(HTTP_RSP_STATUS_HDR) - 1) == 0)
+    {
+        pxParser->uStatusCode = prvStrToUInt(pxParser->pLine + sizeof(HTTP_RSP_STATUS_HDR), uStoredLen - sizeof(HTTP_RSP_STATUS_HDR));
+    }
+    else if (uStoredLen >= sizeof(HTTP_HDR_CONTENT_LENGTH) && prvStrNCmpCi(pxParser->pLine, HTTP_HDR_CONTENT_LENGTH, sizeof(HTTP_HDR_CONTENT_LENGTH) - 1) == 0)
+    {
+        pxParser->uContentLength = prvStrToUInt(pxParser->pLine + sizeof(HTTP_HDR_CONTENT_LENGTH), uStoredLen - sizeof(HTTP_HDR_CONTENT_LENGTH));
+    }
+    else
+    {
+        /* nop */
+    }
+
+    pxParser->uLineLen = 0;
+}
+
+int HttpParser_executeRspParser(HttpRspParserHandle xRspParser, const char *pBuf, size_t uLen, size_t *puConsumed, bool *pbComplete)
+{
+    int res = KVS_ERRNO_NONE;
+    HttpRspParser_t *pxParser = xRspParser;
+    size_t i = 0;
+    size_t uSliceLen = 0;
+
+    if (pxParser == NULL || (pBuf == NULL && uLen > 0) || puConsumed == NULL || pbComplete == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        while (i < uLen && !pxParser->bComplete && res == KVS_ERRNO_NONE)
+        {
+            if (pxParser->bInBody)
+            {
+                uSliceLen = (uLen - i < pxParser->uBodyRemaining) ? (uLen - i) : pxParser->uBodyRemaining;
+                if (pxParser->onBody != NULL)
+                {
+                    res = pxParser->onBody(pBuf + i, uSliceLen, pxParser->pAppData);
+                }
+                i += uSliceLen;
+                pxParser->uBodyRemaining -= uSliceLen;
+                pxParser->bComplete = (pxParser->uBodyRemaining == 0);
+            }
+            else
+            {
+                if (pxParser->uLineLen < HTTP_PARSER_LINE_BUFSIZE)
+                {
+                    pxParser->pLine[pxParser->uLineLen] = pBuf[i];
+                }
+                pxParser->uLineLen++;
+
+                if (pBuf[i] == '\n')
+                {
+                    prvHandleRspLine(pxParser);
+                }
+                i++;
+            }
+        }
+
+        *puConsumed = i;
+        *pbComplete = pxParser->bComplete;
+    }
+
+    return res;
+}
+
+unsigned int HttpParser_getRspStatusCode(HttpRspParserHandle xRspParser)
+{
+    return (xRspParser == NULL) ? 0 : xRspParser->uStatusCode;
+}
+
+size_t HttpParser_getRspContentLength(HttpRspParserHandle xRspParser)
+{
+    return (xRspParser == NULL) ? 0 : xRspParser->uContentLength;
+}
@@ -1,3 +1,5 @@
+#include <string.h>
+
 /* Third party headers */
 #include "llhttp.h"
 
@@ -5,6 +7,7 @@
 #include "kvs/errors.h"
 
 /* Internal headers */
+#include "os/allocator.h"
 #include "net/http_parser_adapter.h"
 
 typedef struct
@@ -14,6 +17,20 @@ typedef struct
     size_t uBodyLen;
 } llhttp_settings_ex_t;
 
+typedef struct HttpRspParser
+{
+    llhttp_t xHttpParser;
+    llhttp_settings_t xSettings;
+
+    OnHttpRspBodyCallback_t onBody;
+    void *pAppData;
+    int xBodyRes;
+
+    unsigned int uStatusCode;
+    size_t uContentLength;
+    bool bComplete;
+} HttpRspParser_t;
+
 static int prvHandleHttpOnBodyComplete(llhttp_t *pHttpParser, const char *at, size_t length)
 {
     llhttp_settings_ex_t *pxSettings = (llhttp_settings_ex_t *)(pHttpParser->settings);
@@ -63,4 +80,133 @@ int HttpParser_parseHttpResponse(const char *pBuf, size_t uLen, unsigned int *pu
     }
 
     return res;
-}
\ No newline at end of file
+}
+
+static int prvHandleRspOnHeadersComplete(llhttp_t *pHttpParser)
+{
+    HttpRspParser_t *pxParser = (HttpRspParser_t *)(pHttpParser->data);
+    int xRet = 0;
+
+    pxParser->uStatusCode = pHttpParser->status_code;
+    pxParser->uContentLength = (pHttpParser->flags & F_CONTENT_LENGTH) ? (size_t)(pHttpParser->content_length) : 0;
+
+    /* A final response without Content-Length ends at its headers, and the rest is left to the caller. */
+    if (pHttpParser->status_code / 100 != 1 && !(pHttpParser->flags & F_CONTENT_LENGTH))
+    {
+        pxParser->bComplete = true;
+        xRet = HPE_PAUSED;
+    }
+
+    return xRet;
+}
+
+static int prvHandleRspOnBody(llhttp_t *pHttpParser, const char *at, size_t length)
+{
+    HttpRspParser_t *pxParser = (HttpRspParser_t *)(pHttpParser->data);
+    int xRet = 0;
+
+    if (pxParser->onBody != NULL && (pxParser->xBodyRes = pxParser->onBody(at, length, pxParser->pAppData)) != KVS_ERRNO_NONE)
+    {
+        xRet = -1;
+    }
+
+    return xRet;
+}
+
+static int prvHandleRspOnMessageComplete(llhttp_t *pHttpParser)
+{
+    HttpRspParser_t *pxParser = (HttpRspParser_t *)(pHttpParser->data);
+    int xRet = 0;
+
+    /* An interim response is skipped, and the final one follows. */
+    if (pHttpParser->status_code / 100 != 1)
+    {
+        pxParser->bComplete = true;
+
+        /* Pause here so that the bytes after the response are not consumed. */
+        xRet = HPE_PAUSED;
+    }
+
+    return xRet;
+}
+
+HttpRspParserHandle HttpParser_createRspParser(OnHttpRspBodyCallback_t onBody, void *pAppData)
+{
+    HttpRspParser_t *pxParser = NULL;
+
+    if ((pxParser = (HttpRspParser_t *)kvsMalloc(sizeof(HttpRspParser_t))) != NULL)
+    {
+        memset(pxParser, 0, sizeof(HttpRspParser_t));
+        pxParser->onBody = onBody;
+        pxParser->pAppData = pAppData;
+
+        llhttp_settings_init(&(pxParser->xSettings));
+        pxParser->xSettings.on_headers_complete = prvHandleRspOnHeadersComplete;
+        pxParser->xSettings.on_body = prvHandleRspOnBody;
+        pxParser->xSettings.on_message_complete = prvHandleRspOnMessageComplete;
+        llhttp_init(&(pxParser->xHttpParser), HTTP_RESPONSE, &(pxParser->xSettings));
+        pxParser->xHttpParser.data = pxParser;
+    }
+
+    return pxParser;
+}
+
+void HttpParser_terminateRspParser(HttpRspParserHandle xRspParser)
+{
+    kvsFree(xRspParser);
+}
+
+int HttpParser_executeRspParser(HttpRspParserHandle xRspParser, const char *pBuf, size_t uLen, size_t *puConsumed, bool *pbComplete)
+{
+    int res = KVS_ERRNO_NONE;
+    HttpRspParser_t *pxParser = xRspParser;
+    enum llhttp_errno xHttpErrno = HPE_OK;
+
+    if (pxParser == NULL || (pBuf == NULL && uLen > 0) || puConsumed == NULL || pbComplete == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (pxParser->bComplete || uLen == 0)
+    {
+        *puConsumed = 0;
+        *pbComplete = pxParser->bComplete;
+    }
+    else
+    {
+        xHttpErrno = llhttp_execute(&(pxParser->xHttpParser), pBuf, uLen);
+
+        if (xHttpErrno == HPE_OK)
+        {
+            *puConsumed = uLen;
+        }
+        else if (xHttpErrno == HPE_PAUSED && pxParser->bComplete)
+        {
+            *puConsumed = (size_t)(llhttp_get_error_pos(&(pxParser->xHttpParser)) - pBuf);
+        }
+        else if (xHttpErrno == HPE_CB_BODY && pxParser->xBodyRes != KVS_ERRNO_NONE)
+        {
+            res = pxParser->xBodyRes;
+        }
+        else
+        {
+            res = KVS_ERROR_HTTP_PARSE_EXECUTE_FAIL;
+        }
+
+        if (res == KVS_ERRNO_NONE)
+        {
+            *pbComplete = pxParser->bComplete;
+        }
+    }
+
+    return res;
+}
+
+unsigned int HttpParser_getRspStatusCode(HttpRspParserHandle xRspParser)
+{
+    return (xRspParser == NULL) ? 0 : xRspParser->uStatusCode;
+}
+
+size_t HttpParser_getRspContentLength(HttpRspParserHandle xRspParser)
+{
+    return (xRspParser == NULL) ? 0 : xRspParser->uContentLength;
+}
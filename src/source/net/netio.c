@@ -13,298 +13,324 @@
  * permissions and limitations under the License.
  */
 
+#include <stdbool.h>
 #include <stddef.h>
-#include <stdint.h>
 #include <string.h>
 
-#include <sys/time.h>
-#include <sys/socket.h>
-
 /* Third party headers */
 #include "azure_c_shared_utility/xlogging.h"
-#include "mbedtls/ctr_drbg.h"
-#include "mbedtls/entropy.h"
-#include "mbedtls/net.h"
-#include "mbedtls/net_sockets.h"
 
 /* Public headers */
 #include "kvs/errors.h"
+#include "kvs/netio_transport.h"
+#include "kvs/port.h"
 
 /* Internal headers */
 #include "os/allocator.h"
 #include "net/netio.h"
-
-#define DEFAULT_CONNECTION_TIMEOUT_MS       (10 * 1000)
+#include "os/tracepoint.h"
 
 typedef struct NetIo
 {
-    /* Basic ssl connection parameters */
-    mbedtls_net_context xFd;
-    mbedtls_ssl_context xSsl;
-    mbedtls_ssl_config xConf;
-    mbedtls_ctr_drbg_context xCtrDrbg;
-    mbedtls_entropy_context xEntropy;
-
-    /* Variables for IoT credential provider. It's optional feature so we declare them as pointers. */
-    mbedtls_x509_crt *pRootCA;
-    mbedtls_x509_crt *pCert;
-    mbedtls_pk_context *pPrivKey;
-
-    /* Options */
-    uint32_t uRecvTimeoutMs;
-    uint32_t uSendTimeoutMs;
+    const NetIoTransport_t *pxTransport;
+    void *pCtx;
+
+    /* Set by NetIo_connectStart() on a transport that can only connect in a blocking call */
+    bool bConnected;
+
+    uint64_t uBytesSent;
+    uint64_t uBytesReceived;
+
+    /* If uPacingRateBps is set, data is sent in chunks of at most uPacingBurstBytes, and each chunk waits for tokens
+     * of a bucket that refills at the rate. */
+    unsigned int uPacingRateBps;
+    size_t uPacingBurstBytes;
+    int64_t xPacingTokens;
+    uint64_t uPacingRefillMs;
 } NetIo_t;
 
-static int prvCreateX509Cert(NetIo_t *pxNet)
+/* NULL selects the mbedTLS transport. */
+static const NetIoTransport_t *gpxDefaultTransport = NULL;
+
+static bool prvIsTransportValid(const NetIoTransport_t *pxTransport)
+{
+    return pxTransport != NULL && pxTransport->create != NULL && pxTransport->terminate != NULL && pxTransport->connect != NULL &&
+        pxTransport->send != NULL && pxTransport->recv != NULL && ((pxTransport->connectStart == NULL) == (pxTransport->connectPoll == NULL));
+}
+
+int NetIo_setDefaultTransport(const NetIoTransport_t *pxTransport)
 {
     int res = KVS_ERRNO_NONE;
 
-    if (pxNet == NULL)
+    if (pxTransport != NULL && !prvIsTransportValid(pxTransport))
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
-    }
-    else if ((pxNet->pRootCA = (mbedtls_x509_crt *)kvsMalloc(sizeof(mbedtls_x509_crt))) == NULL ||
-        (pxNet->pCert = (mbedtls_x509_crt *)kvsMalloc(sizeof(mbedtls_x509_crt))) == NULL ||
-        (pxNet->pPrivKey = (mbedtls_pk_context *)kvsMalloc(sizeof(mbedtls_pk_context))) == NULL)
-    {
-        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("Invalid transport");
     }
     else
     {
-        mbedtls_x509_crt_init(pxNet->pRootCA);
-        mbedtls_x509_crt_init(pxNet->pCert);
-        mbedtls_pk_init(pxNet->pPrivKey);
+        gpxDefaultTransport = pxTransport;
     }
 
     return res;
 }
 
-static int prvInitConfig(NetIo_t *pxNet, const char *pcHost, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+NetIoHandle NetIo_create(void)
 {
-    int res = KVS_ERRNO_NONE;
-    int retVal = 0;
+    return NetIo_createWithTransport((gpxDefaultTransport != NULL) ? gpxDefaultTransport : NetIo_getMbedtlsTransport());
+}
 
-    if (pxNet == NULL)
+NetIoHandle NetIo_createWithTransport(const NetIoTransport_t *pxTransport)
+{
+    NetIo_t *pxNet = NULL;
+
+    if (!prvIsTransportValid(pxTransport))
     {
-        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid transport");
+    }
+    else if ((pxNet = (NetIo_t *)kvsMalloc(sizeof(NetIo_t))) == NULL)
+    {
+        LogError("OOM: pxNet");
     }
     else
     {
-        mbedtls_ssl_set_bio(&(pxNet->xSsl), &(pxNet->xFd), mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+        memset(pxNet, 0, sizeof(NetIo_t));
+        pxNet->pxTransport = pxTransport;
 
-        if ((retVal = mbedtls_ssl_config_defaults(&(pxNet->xConf), MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) != 0)
+        if ((pxNet->pCtx = pxTransport->create()) == NULL)
         {
-            res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
-            LogError("Failed to config ssl (err:-%X)", -res);
-        }
-        else
-        {
-            mbedtls_ssl_conf_rng(&(pxNet->xConf), mbedtls_ctr_drbg_random, &(pxNet->xCtrDrbg));
-            mbedtls_ssl_set_hostname(&(pxNet->xSsl), pcHost);
-            mbedtls_ssl_conf_read_timeout(&(pxNet->xConf), pxNet->uRecvTimeoutMs);
-            NetIo_setSendTimeout(pxNet, pxNet->uSendTimeoutMs);
-
-            if (pcRootCA != NULL && pcCert != NULL && pcPrivKey != NULL)
-            {
-                if ((retVal = mbedtls_x509_crt_parse(pxNet->pRootCA, (void *)pcRootCA, strlen(pcRootCA) + 1)) != 0 ||
-                    (retVal = mbedtls_x509_crt_parse(pxNet->pCert, (void *)pcCert, strlen(pcCert) + 1)) != 0 ||
-                    (retVal = mbedtls_pk_parse_key(pxNet->pPrivKey, (void *)pcPrivKey, strlen(pcPrivKey) + 1, NULL, 0)) != 0)
-                {
-                    res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
-                    LogError("Failed to parse x509 (err:-%X)", -res);
-                }
-                else
-                {
-                    mbedtls_ssl_conf_authmode(&(pxNet->xConf), MBEDTLS_SSL_VERIFY_REQUIRED);
-                    mbedtls_ssl_conf_ca_chain(&(pxNet->xConf), pxNet->pRootCA, NULL);
-
-                    if ((retVal = mbedtls_ssl_conf_own_cert(&(pxNet->xConf), pxNet->pCert, pxNet->pPrivKey)) != 0)
-                    {
-                        res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
-                        LogError("Failed to conf own cert (err:-%X)", -res);
-                    }
-                }
-            }
-            else
-            {
-                mbedtls_ssl_conf_authmode(&(pxNet->xConf), MBEDTLS_SSL_VERIFY_OPTIONAL);
-            }
+            LogError("Failed to create transport context");
+            kvsFree(pxNet);
+            pxNet = NULL;
         }
     }
 
-    if (res == KVS_ERRNO_NONE)
+    return pxNet;
+}
+
+void NetIo_terminate(NetIoHandle xNetIoHandle)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet != NULL)
     {
-        if ((retVal = mbedtls_ssl_setup(&(pxNet->xSsl), &(pxNet->xConf))) != 0)
-        {
-            res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
-            LogError("Failed to setup ssl (err:-%X)", -res);
-        }
+        pxNet->pxTransport->terminate(pxNet->pCtx);
+        kvsFree(pxNet);
     }
+}
 
-    return res;
+int NetIo_connect(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort)
+{
+    return NetIo_connectWithX509(xNetIoHandle, pcHost, pcPort, NULL, NULL, NULL);
 }
 
-static int prvConnect(NetIo_t *pxNet, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+int NetIo_connectWithX509(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
 {
     int res = KVS_ERRNO_NONE;
-    int retVal = 0;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
 
-    if (pxNet == NULL || pcHost == NULL || pcPort == NULL)
+    if (pxNet == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
-        LogError("Invalid argument");
     }
-    else if ((pcRootCA != NULL && pcCert != NULL && pcPrivKey != NULL) && (res = prvCreateX509Cert(pxNet)) != KVS_ERRNO_NONE)
+    else
     {
-        LogError("Failed to init x509 (err:-%X)", -res);
-        /* Propagate the res error */
+        res = pxNet->pxTransport->connect(pxNet->pCtx, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey);
     }
-    else if ((retVal = mbedtls_net_connect(&(pxNet->xFd), pcHost, pcPort, MBEDTLS_NET_PROTO_TCP)) != 0)
+
+    return res;
+}
+
+int NetIo_connectStart(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort)
+{
+    return NetIo_connectStartWithX509(xNetIoHandle, pcHost, pcPort, NULL, NULL, NULL);
+}
+
+int NetIo_connectStartWithX509(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
     {
-        res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
-        LogError("Failed to connect to %s:%s (err:-%X)", pcHost, pcPort, -res);
+        res = KVS_ERROR_INVALID_ARGUMENT;
     }
-    else if ((res = prvInitConfig(pxNet, pcHost, pcRootCA, pcCert, pcPrivKey)) != KVS_ERRNO_NONE)
+    else if (pxNet->pxTransport->connectStart != NULL)
     {
-        LogError("Failed to config ssl (err:-%X)", -res);
-        /* Propagate the res error */
+        res = pxNet->pxTransport->connectStart(pxNet->pCtx, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey);
     }
-    else if ((retVal = mbedtls_ssl_handshake(&(pxNet->xSsl))) != 0)
+    else if ((res = pxNet->pxTransport->connect(pxNet->pCtx, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey)) != KVS_ERRNO_NONE)
     {
-        res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
-        LogError("ssl handshake err (-%X)", -res);
+        /* Propagate the res error */
     }
     else
     {
-        /* nop */
+        pxNet->bConnected = true;
     }
 
     return res;
 }
 
-NetIoHandle NetIo_create(void)
+int NetIo_connectPoll(NetIoHandle xNetIoHandle, bool *pbConnected)
 {
-    NetIo_t *pxNet = NULL;
+    int res = KVS_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
 
-    if ((pxNet = (NetIo_t *)kvsMalloc(sizeof(NetIo_t))) != NULL)
+    if (pxNet == NULL || pbConnected == NULL)
     {
-        memset(pxNet, 0, sizeof(NetIo_t));
-
-        mbedtls_net_init(&(pxNet->xFd));
-        mbedtls_ssl_init(&(pxNet->xSsl));
-        mbedtls_ssl_config_init(&(pxNet->xConf));
-        mbedtls_ctr_drbg_init(&(pxNet->xCtrDrbg));
-        mbedtls_entropy_init(&(pxNet->xEntropy));
-
-        pxNet->uRecvTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
-        pxNet->uSendTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
-
-        if (mbedtls_ctr_drbg_seed(&(pxNet->xCtrDrbg), mbedtls_entropy_func, &(pxNet->xEntropy), NULL, 0) != 0)
-        {
-            NetIo_terminate(pxNet);
-            pxNet = NULL;
-        }
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (pxNet->pxTransport->connectPoll != NULL)
+    {
+        res = pxNet->pxTransport->connectPoll(pxNet->pCtx, pbConnected);
+    }
+    else if (!pxNet->bConnected)
+    {
+        res = KVS_ERROR_NETIO_CONNECT_NOT_STARTED;
+        LogError("Connection is not started");
+    }
+    else
+    {
+        *pbConnected = true;
     }
 
-    return pxNet;
+    return res;
 }
 
-void NetIo_terminate(NetIoHandle xNetIoHandle)
+void NetIo_disconnect(NetIoHandle xNetIoHandle)
 {
     NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
 
-    if (pxNet != NULL)
+    if (pxNet != NULL && pxNet->pxTransport->disconnect != NULL)
     {
-        mbedtls_ctr_drbg_free(&(pxNet->xCtrDrbg));
-        mbedtls_entropy_free(&(pxNet->xEntropy));
-        mbedtls_net_free(&(pxNet->xFd));
-        mbedtls_ssl_free(&(pxNet->xSsl));
-        mbedtls_ssl_config_free(&(pxNet->xConf));
+        pxNet->pxTransport->disconnect(pxNet->pCtx);
+    }
+}
 
-        if (pxNet->pRootCA != NULL)
-        {
-            mbedtls_x509_crt_free(pxNet->pRootCA);
-            kvsFree(pxNet->pRootCA);
-            pxNet->pRootCA = NULL;
-        }
+static void prvPacingWait(NetIo_t *pxNet, size_t uLen)
+{
+    int64_t xBytesPerSec = (int64_t)(pxNet->uPacingRateBps / 8);
+    uint64_t uNowMs = getMonotonicTimeInMs();
 
-        if (pxNet->pCert != NULL)
+    if (xBytesPerSec > 0)
+    {
+        pxNet->xPacingTokens += xBytesPerSec * (int64_t)(uNowMs - pxNet->uPacingRefillMs) / 1000;
+        if (pxNet->xPacingTokens > (int64_t)pxNet->uPacingBurstBytes)
         {
-            mbedtls_x509_crt_free(pxNet->pCert);
-            kvsFree(pxNet->pCert);
-            pxNet->pCert = NULL;
+            pxNet->xPacingTokens = (int64_t)pxNet->uPacingBurstBytes;
         }
+        pxNet->uPacingRefillMs = uNowMs;
 
-        if (pxNet->pPrivKey != NULL)
+        if (pxNet->xPacingTokens < (int64_t)uLen)
         {
-            mbedtls_pk_free(pxNet->pPrivKey);
-            kvsFree(pxNet->pPrivKey);
-            pxNet->pPrivKey = NULL;
+            sleepInMs((uint32_t)(((int64_t)uLen - pxNet->xPacingTokens) * 1000 / xBytesPerSec));
+            pxNet->xPacingTokens = (int64_t)uLen;
+            pxNet->uPacingRefillMs = getMonotonicTimeInMs();
         }
-        kvsFree(pxNet);
+        pxNet->xPacingTokens -= (int64_t)uLen;
     }
 }
 
-int NetIo_connect(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort)
+static int prvPacedSend(NetIo_t *pxNet, const unsigned char *pBuffer, size_t uBytesToSend)
 {
-    return prvConnect(xNetIoHandle, pcHost, pcPort, NULL, NULL, NULL);
-}
+    int res = KVS_ERRNO_NONE;
+    size_t uChunkLen = 0;
 
-int NetIo_connectWithX509(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
-{
-    return prvConnect(xNetIoHandle, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey);
+    if (pxNet->uPacingRateBps == 0)
+    {
+        res = pxNet->pxTransport->send(pxNet->pCtx, pBuffer, uBytesToSend);
+    }
+    else
+    {
+        while (uBytesToSend > 0 && res == KVS_ERRNO_NONE)
+        {
+            uChunkLen = (uBytesToSend > pxNet->uPacingBurstBytes) ? pxNet->uPacingBurstBytes : uBytesToSend;
+            prvPacingWait(pxNet, uChunkLen);
+            res = pxNet->pxTransport->send(pxNet->pCtx, pBuffer, uChunkLen);
+            pBuffer += uChunkLen;
+            uBytesToSend -= uChunkLen;
+        }
+    }
+
+    return res;
 }
 
-void NetIo_disconnect(NetIoHandle xNetIoHandle)
+int NetIo_send(NetIoHandle xNetIoHandle, const unsigned char *pBuffer, size_t uBytesToSend)
 {
+    int res = KVS_ERRNO_NONE;
     NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
 
-    if (pxNet != NULL)
+    if (pxNet == NULL || pBuffer == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
     {
-        mbedtls_ssl_close_notify(&(pxNet->xSsl));
+        KVS_TRACE_BEGIN(KVS_TRACE_NETIO_SEND);
+        if ((res = prvPacedSend(pxNet, pBuffer, uBytesToSend)) == KVS_ERRNO_NONE)
+        {
+            pxNet->uBytesSent += uBytesToSend;
+        }
+        KVS_TRACE_END(KVS_TRACE_NETIO_SEND, uBytesToSend);
     }
+
+    return res;
 }
 
-int NetIo_send(NetIoHandle xNetIoHandle, const unsigned char *pBuffer, size_t uBytesToSend)
+int NetIo_sendv(NetIoHandle xNetIoHandle, const NetIoVec_t *pxIov, size_t uIovCnt)
 {
-    int n = 0;
     int res = KVS_ERRNO_NONE;
     NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
-    size_t uBytesRemaining = uBytesToSend;
-    char *pIndex = (char *)pBuffer;
+    size_t i = 0;
+    size_t uSentLen = 0;
 
-    if (pxNet == NULL || pBuffer == NULL)
+    KVS_TRACE_BEGIN(KVS_TRACE_NETIO_SEND);
+    if (pxIov != NULL)
+    {
+        for (i = 0; i < uIovCnt; i++)
+        {
+            if (pxIov[i].pBase != NULL)
+            {
+                uSentLen += pxIov[i].uLen;
+            }
+        }
+    }
+
+    if (pxNet == NULL || pxIov == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
     }
+    else if (pxNet->pxTransport->sendv != NULL && (pxNet->uPacingRateBps == 0 || uSentLen <= pxNet->uPacingBurstBytes))
+    {
+        /* Segments that fit in a burst are still packed together. */
+        if (pxNet->uPacingRateBps != 0)
+        {
+            prvPacingWait(pxNet, uSentLen);
+        }
+        res = pxNet->pxTransport->sendv(pxNet->pCtx, pxIov, uIovCnt);
+    }
     else
     {
-        do
+        for (i = 0; i < uIovCnt && res == KVS_ERRNO_NONE; i++)
         {
-            n = mbedtls_ssl_write(&(pxNet->xSsl), (const unsigned char *)pIndex, uBytesRemaining);
-            if (n < 0)
-            {
-                res = KVS_GENERATE_MBEDTLS_ERROR(n);
-                LogError("SSL send error -%X", -res);
-                break;
-            }
-            else if (n > uBytesRemaining)
+            if (pxIov[i].pBase != NULL && pxIov[i].uLen > 0)
             {
-                res = KVS_ERROR_NETIO_SEND_MORE_THAN_REMAINING_DATA;
-                LogError("SSL send error -%X", -res);
-                break;
+                res = prvPacedSend(pxNet, pxIov[i].pBase, pxIov[i].uLen);
             }
-            uBytesRemaining -= n;
-            pIndex += n;
-        } while (uBytesRemaining > 0);
+        }
     }
 
+    if (res == KVS_ERRNO_NONE)
+    {
+        pxNet->uBytesSent += uSentLen;
+    }
+    KVS_TRACE_END(KVS_TRACE_NETIO_SEND, uSentLen);
+
     return res;
 }
 
 int NetIo_recv(NetIoHandle xNetIoHandle, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
 {
-    int n;
     int res = KVS_ERRNO_NONE;
     NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
 
@@ -314,20 +340,9 @@ int NetIo_recv(NetIoHandle xNetIoHandle, unsigned char *pBuffer, size_t uBufferS
     }
     else
     {
-        n = mbedtls_ssl_read(&(pxNet->xSsl), pBuffer, uBufferSize);
-        if (n < 0)
-        {
-            res = KVS_GENERATE_MBEDTLS_ERROR(n);
-            LogError("SSL recv error -%X", -res);
-        }
-        else if (n > uBufferSize)
+        if ((res = pxNet->pxTransport->recv(pxNet->pCtx, pBuffer, uBufferSize, puBytesReceived)) == KVS_ERRNO_NONE)
         {
-            res = KVS_ERROR_NETIO_RECV_MORE_THAN_AVAILABLE_SPACE;
-            LogError("SSL recv error -%X", -res);
-        }
-        else
-        {
-            *puBytesReceived = n;
+            pxNet->uBytesReceived += *puBytesReceived;
         }
     }
 
@@ -338,32 +353,49 @@ bool NetIo_isDataAvailable(NetIoHandle xNetIoHandle)
 {
     NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
     bool bDataAvailable = false;
-    struct timeval tv = {0};
-    fd_set read_fds = {0};
-    int fd = 0;
 
-    if (pxNet != NULL)
+    if (pxNet != NULL && pxNet->pxTransport->isDataAvailable != NULL)
     {
-        fd = pxNet->xFd.fd;
-        if (fd >= 0)
-        {
-            FD_ZERO(&read_fds);
-            FD_SET(fd, &read_fds);
+        bDataAvailable = pxNet->pxTransport->isDataAvailable(pxNet->pCtx);
+    }
 
-            tv.tv_sec = 0;
-            tv.tv_usec = 0;
+    return bDataAvailable;
+}
 
-            if (select(fd + 1, &read_fds, NULL, NULL, &tv) >= 0)
-            {
-                if (FD_ISSET(fd, &read_fds))
-                {
-                    bDataAvailable = true;
-                }
-            }
+int NetIo_getSocket(NetIoHandle xNetIoHandle)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+    int xSocket = -1;
+
+    if (pxNet != NULL && pxNet->pxTransport->getSocket != NULL)
+    {
+        xSocket = pxNet->pxTransport->getSocket(pxNet->pCtx);
+    }
+
+    return xSocket;
+}
+
+int NetIo_getStats(NetIoHandle xNetIoHandle, NetIoStats_t *pxStats)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL || pxStats == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        memset(pxStats, 0, sizeof(NetIoStats_t));
+        if (pxNet->pxTransport->getStats != NULL)
+        {
+            res = pxNet->pxTransport->getStats(pxNet->pCtx, pxStats);
         }
+        pxStats->uBytesSent = pxNet->uBytesSent;
+        pxStats->uBytesReceived = pxNet->uBytesReceived;
     }
 
-    return bDataAvailable;
+    return res;
 }
 
 int NetIo_setRecvTimeout(NetIoHandle xNetIoHandle, unsigned int uRecvTimeoutMs)
@@ -375,10 +407,13 @@ int NetIo_setRecvTimeout(NetIoHandle xNetIoHandle, unsigned int uRecvTimeoutMs)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
     }
+    else if (pxNet->pxTransport->setRecvTimeout == NULL)
+    {
+        LogInfo("Receive timeout is not supported by the transport");
+    }
     else
     {
-        pxNet->uRecvTimeoutMs = (uint32_t)uRecvTimeoutMs;
-        mbedtls_ssl_conf_read_timeout(&(pxNet->xConf), pxNet->uRecvTimeoutMs);
+        res = pxNet->pxTransport->setRecvTimeout(pxNet->pCtx, uRecvTimeoutMs);
     }
 
     return res;
@@ -388,32 +423,103 @@ int NetIo_setSendTimeout(NetIoHandle xNetIoHandle, unsigned int uSendTimeoutMs)
 {
     int res = KVS_ERRNO_NONE;
     NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
-    int fd = 0;
-    struct timeval tv = {0};
 
     if (pxNet == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
     }
+    else if (pxNet->pxTransport->setSendTimeout == NULL)
+    {
+        LogInfo("Send timeout is not supported by the transport");
+    }
+    else
+    {
+        res = pxNet->pxTransport->setSendTimeout(pxNet->pCtx, uSendTimeoutMs);
+    }
+
+    return res;
+}
+
+static int prvSetOption(NetIo_t *pxNet, NetIoOption_t xOption, unsigned int uValue)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pxNet == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (pxNet->pxTransport->setOption == NULL)
+    {
+        /* Same as the options that the platform doesn't support, it doesn't fail the connection. */
+        LogInfo("Option %d is not supported by the transport", (int)xOption);
+    }
     else
     {
-        pxNet->uSendTimeoutMs = (uint32_t)uSendTimeoutMs;
-        fd = pxNet->xFd.fd;
-        tv.tv_sec = uSendTimeoutMs / 1000;
-        tv.tv_usec = (uSendTimeoutMs % 1000) * 1000;
+        res = pxNet->pxTransport->setOption(pxNet->pCtx, xOption, uValue);
+    }
 
-        if (fd < 0)
-        {
-            /* Do nothing when connection hasn't established. */
-        }
-        else if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof(tv)) != 0)
-        {
-            res = KVS_ERROR_NETIO_UNABLE_TO_SET_SEND_TIMEOUT;
-        }
-        else
+    return res;
+}
+
+int NetIo_setTcpNoDelay(NetIoHandle xNetIoHandle, bool bTcpNoDelay)
+{
+    return prvSetOption((NetIo_t *)xNetIoHandle, NETIO_OPTION_TCP_NODELAY, bTcpNoDelay ? 1 : 0);
+}
+
+int NetIo_setSendBufSize(NetIoHandle xNetIoHandle, unsigned int uSendBufSize)
+{
+    return prvSetOption((NetIo_t *)xNetIoHandle, NETIO_OPTION_SEND_BUF_SIZE, uSendBufSize);
+}
+
+int NetIo_setNotSentLowat(NetIoHandle xNetIoHandle, unsigned int uNotSentLowat)
+{
+    return prvSetOption((NetIo_t *)xNetIoHandle, NETIO_OPTION_NOT_SENT_LOWAT, uNotSentLowat);
+}
+
+int NetIo_setKeepAlive(NetIoHandle xNetIoHandle, unsigned int uIdleSec, unsigned int uIntervalSec, unsigned int uCount)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if ((res = prvSetOption(pxNet, NETIO_OPTION_KEEPALIVE_IDLE_SEC, uIdleSec)) != KVS_ERRNO_NONE ||
+        (res = prvSetOption(pxNet, NETIO_OPTION_KEEPALIVE_INTERVAL_SEC, uIntervalSec)) != KVS_ERRNO_NONE ||
+        (res = prvSetOption(pxNet, NETIO_OPTION_KEEPALIVE_COUNT, uCount)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+
+    return res;
+}
+
+int NetIo_setTlsMaxFragmentLength(NetIoHandle xNetIoHandle, unsigned int uMaxFragLen)
+{
+    return prvSetOption((NetIo_t *)xNetIoHandle, NETIO_OPTION_TLS_MAX_FRAG_LEN, uMaxFragLen);
+}
+
+int NetIo_setBindInterface(NetIoHandle xNetIoHandle, unsigned int uIfIndex)
+{
+    return prvSetOption((NetIo_t *)xNetIoHandle, NETIO_OPTION_BIND_IF_INDEX, uIfIndex);
+}
+
+int NetIo_setPacing(NetIoHandle xNetIoHandle, unsigned int uRateBps, size_t uBurstBytes)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        /* A rate change keeps the tokens, so a burst that is already paid for isn't delayed again. */
+        if (pxNet->uPacingRateBps == 0)
         {
-            /* nop */
+            pxNet->xPacingTokens = (int64_t)((uBurstBytes > 0) ? uBurstBytes : NETIO_PACING_DEFAULT_BURST_BYTES);
+            pxNet->uPacingRefillMs = getMonotonicTimeInMs();
         }
+        pxNet->uPacingRateBps = uRateBps;
+        pxNet->uPacingBurstBytes = (uBurstBytes > 0) ? uBurstBytes : NETIO_PACING_DEFAULT_BURST_BYTES;
     }
 
     return res;
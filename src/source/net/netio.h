@@ -17,16 +17,28 @@
 #define NETIO_H
 
 #include <stdbool.h>
+#include <stddef.h>
+
+/* Public headers */
+#include "kvs/netio_transport.h"
 
 typedef struct NetIo *NetIoHandle;
 
 /**
- * @brief Create a network I/O handle
+ * @brief Create a network I/O handle on the transport selected by NetIo_setDefaultTransport()
  *
  * @return The network I/O handle
  */
 NetIoHandle NetIo_create(void);
 
+/**
+ * @brief Create a network I/O handle on a transport
+ *
+ * @param[in] pxTransport The transport, which must outlive the handle
+ * @return The network I/O handle, or NULL if the transport misses any required function
+ */
+NetIoHandle NetIo_createWithTransport(const NetIoTransport_t *pxTransport);
+
 /**
  * @brief Terminate a network I/O handle
  *
@@ -57,6 +69,42 @@ int NetIo_connect(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPo
  */
 int NetIo_connectWithX509(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey);
 
+/**
+ * @brief Start connecting to a host with port without blocking
+ *
+ * The hostname is resolved before it returns, and the TCP connection and TLS handshake are left to
+ * NetIo_connectPoll(). The connection timeout is the receive timeout. On failure, the handle should be terminated.
+ * If the transport can't connect without blocking, it connects here and NetIo_connectPoll() reports it's connected.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] pcHost The hostname
+ * @param[in] pcPort The port
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_connectStart(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort);
+
+/**
+ * @brief Start connecting to a host with port and X509 certificates without blocking
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] pcHost The hostname
+ * @param[in] pcPort The port
+ * @param[in] pcRootCA The X509 root CA
+ * @param[in] pcCert The X509 client certificate
+ * @param[in] pcPrivKey The x509 client private key
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_connectStartWithX509(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey);
+
+/**
+ * @brief Make progress on a connection started by NetIo_connectStart() without blocking
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[out] pbConnected true if the connection is established, false if it's still in progress
+ * @return 0 on success, KVS_ERROR_NETIO_CONNECT_TIMEOUT on timeout, non-zero value otherwise
+ */
+int NetIo_connectPoll(NetIoHandle xNetIoHandle, bool *pbConnected);
+
 /**
  * @breif Disconnect from a host
  *
@@ -74,6 +122,19 @@ void NetIo_disconnect(NetIoHandle xNetIoHandle);
  */
 int NetIo_send(NetIoHandle xNetIoHandle, const unsigned char *pBuffer, size_t uBytesToSend);
 
+/**
+ * @brief Send data segments in order
+ *
+ * The mbedTLS transport packs adjacent small segments together before they're written, so they go out in one TLS
+ * record instead of one record for each segment. Segments with NULL base or zero length are skipped.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] pxIov The data segments
+ * @param[in] uIovCnt The number of data segments
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_sendv(NetIoHandle xNetIoHandle, const NetIoVec_t *pxIov, size_t uIovCnt);
+
 /**
  * @brief Receive data
  *
@@ -93,6 +154,23 @@ int NetIo_recv(NetIoHandle xNetIoHandle, unsigned char *pBuffer, size_t uBufferS
  */
 bool NetIo_isDataAvailable(NetIoHandle xNetIoHandle);
 
+/**
+ * @brief Get the socket of the connection, e.g. to wait for data with kvsEventWaitSocket()
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @return The socket descriptor, or -1 if it's not connected or the transport has no socket
+ */
+int NetIo_getSocket(NetIoHandle xNetIoHandle);
+
+/**
+ * @brief Get the bytes and TLS records that are sent and received since the handle is created
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param pxStats The statistics
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_getStats(NetIoHandle xNetIoHandle, NetIoStats_t *pxStats);
+
 /**
  * @brief Configure receive timeout.
  *
@@ -111,4 +189,91 @@ int NetIo_setRecvTimeout(NetIoHandle xNetIoHandle, unsigned int uRecvTimeoutMs);
  */
 int NetIo_setSendTimeout(NetIoHandle xNetIoHandle, unsigned int uSendTimeoutMs);
 
+/**
+ * @brief Configure TCP_NODELAY.
+ *
+ * Socket options are applied when the socket is created, or right away if it's connected. Options that the platform
+ * or the transport doesn't support are logged and ignored.
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param bTcpNoDelay true to disable Nagle's algorithm
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setTcpNoDelay(NetIoHandle xNetIoHandle, bool bTcpNoDelay);
+
+/**
+ * @brief Configure socket send buffer size (SO_SNDBUF).
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param uSendBufSize Send buffer size in bytes, or 0 for the OS default
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setSendBufSize(NetIoHandle xNetIoHandle, unsigned int uSendBufSize);
+
+/**
+ * @brief Configure the limit of unsent bytes in the socket (TCP_NOTSENT_LOWAT).
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param uNotSentLowat The limit in bytes, or 0 for the OS default
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setNotSentLowat(NetIoHandle xNetIoHandle, unsigned int uNotSentLowat);
+
+/**
+ * @brief Configure TCP keepalive. Keepalive is enabled if any of the values is non-zero.
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param uIdleSec Idle time before the first probe in seconds, or 0 for the OS default
+ * @param uIntervalSec Interval between probes in seconds, or 0 for the OS default
+ * @param uCount Number of unanswered probes before the connection is dropped, or 0 for the OS default
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setKeepAlive(NetIoHandle xNetIoHandle, unsigned int uIdleSec, unsigned int uIntervalSec, unsigned int uCount);
+
+/**
+ * @brief Configure the TLS max_fragment_length extension to negotiate on the next connection.
+ *
+ * The extension limits the size of TLS records in both directions. mbedTLS sizes the record buffers with
+ * MBEDTLS_SSL_IN_CONTENT_LEN and MBEDTLS_SSL_OUT_CONTENT_LEN at build time, and it shrinks them to the negotiated
+ * length after the handshake only if it's built with MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH (CONFIG_MBEDTLS_DYNAMIC_BUFFER
+ * on ESP-IDF). A server that doesn't support the extension keeps using full size records.
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param uMaxFragLen 512, 1024, 2048 or 4096 bytes, or 0 not to negotiate it
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setTlsMaxFragmentLength(NetIoHandle xNetIoHandle, unsigned int uMaxFragLen);
+
+/**
+ * @brief Bind the socket of the next connection to a network interface, e.g. to keep a connection on Wi-Fi or LTE
+ * regardless of the default route.
+ *
+ * It's applied when the socket is created, so it doesn't move a connection that is already made. Only the connection
+ * is bound, and the hostname is still resolved on the default route. Linux binds with SO_BINDTODEVICE, which needs
+ * CAP_NET_RAW on kernels before 5.7, and other platforms log and ignore it.
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param uIfIndex The interface index, e.g. from if_nametoindex(), or 0 for the default route
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setBindInterface(NetIoHandle xNetIoHandle, unsigned int uIfIndex);
+
+/* The burst size of paced sends if it's not given */
+#define NETIO_PACING_DEFAULT_BURST_BYTES (16 * 1024)
+
+/**
+ * @brief Pace sends with a token bucket, so a large frame is spread over time instead of overflowing the buffers of
+ * the modem.
+ *
+ * Data is sent in chunks of at most the burst size, and a chunk waits until the bucket, which refills at the rate and
+ * holds at most the burst size, has enough tokens. It can be changed at any time, e.g. when the uplink throughput is
+ * estimated again.
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param uRateBps The rate in bits per second, or 0 to disable pacing
+ * @param uBurstBytes The burst size in bytes, or 0 for NETIO_PACING_DEFAULT_BURST_BYTES
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setPacing(NetIoHandle xNetIoHandle, unsigned int uRateBps, size_t uBurstBytes);
+
 #endif /* NETIO_H */
\ No newline at end of file
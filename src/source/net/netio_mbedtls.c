@@ -0,0 +1,1922 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+/* lwIP declares TCP level options in its socket header, and some of its ports have no netinet/tcp.h. */
+#ifndef TCP_NODELAY
+#include <netinet/tcp.h>
+#endif
+
+#if defined(__linux__)
+#include <net/if.h>
+#endif
+
+/* Third party headers */
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net.h"
+#include "mbedtls/net_sockets.h"
+#if defined(KVS_USE_KTLS)
+#include <linux/tls.h>
+#include "mbedtls/platform_util.h"
+#include "mbedtls/ssl_ciphersuites.h"
+#endif
+
+/* Public headers */
+#include "kvs/errors.h"
+#include "kvs/netio_transport.h"
+
+/* Platform dependent headers */
+#include "kvs/port.h"
+
+/* Internal headers */
+#include "os/allocator.h"
+
+#define DEFAULT_CONNECTION_TIMEOUT_MS       (10 * 1000)
+
+/* Segments of prvMbedtlsSendv() are packed into this buffer, so adjacent small segments go out in one TLS record. */
+#define NETIO_SENDV_BUF_SIZE                (1024)
+
+/* TLS sessions of the most recently used hosts are kept to resume later connections. Set it to 0 to disable. */
+#ifndef NETIO_SESSION_CACHE_SIZE
+#define NETIO_SESSION_CACHE_SIZE            (4)
+#endif
+#define NETIO_SESSION_KEY_MAX_LEN           (128)
+
+/* Resolved addresses of the most recently used hosts are kept for this long, so a connection doesn't wait for DNS
+ * again, and NetIo_prefetchHosts() can resolve them ahead. Set the size to 0 to disable. */
+#ifndef NETIO_DNS_CACHE_SIZE
+#define NETIO_DNS_CACHE_SIZE                (4)
+#endif
+#ifndef NETIO_DNS_CACHE_TTL_MS
+#define NETIO_DNS_CACHE_TTL_MS              (60 * 1000)
+#endif
+/* A host that is connected to within this long before its entry expires is resolved again in the background. */
+#ifndef NETIO_DNS_CACHE_REFRESH_MS
+#define NETIO_DNS_CACHE_REFRESH_MS          (15 * 1000)
+#endif
+/* An expired entry is still used for this long if the host can't be resolved, e.g. the resolver is down. */
+#ifndef NETIO_DNS_CACHE_STALE_MS
+#define NETIO_DNS_CACHE_STALE_MS            (60 * 60 * 1000)
+#endif
+#ifndef NETIO_DNS_RESOLVE_STACK_SIZE
+#define NETIO_DNS_RESOLVE_STACK_SIZE        (4 * 1024)
+#endif
+
+#if defined(KVS_USE_KTLS)
+/* Older libc headers don't have these Linux options, or hide them behind _GNU_SOURCE. */
+#ifndef TCP_ULP
+#define TCP_ULP                             (31)
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS                             (282)
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE                            (0x8000)
+#endif
+
+#define KTLS_MAX_KEY_LEN                    (32)
+#define KTLS_SALT_LEN                       (4)
+#define KTLS_RECORD_TYPE_ALERT              (21)
+#define KTLS_MAX_RECORD_LEN                 (16384)
+#endif
+
+typedef enum NetIoConnState
+{
+    NETIO_CONN_IDLE = 0,
+    NETIO_CONN_TCP_CONNECTING,
+    NETIO_CONN_TLS_HANDSHAKING,
+    NETIO_CONN_CONNECTED
+} NetIoConnState_t;
+
+typedef struct NetIoMbedtls
+{
+    /* Basic ssl connection parameters */
+    mbedtls_net_context xFd;
+    mbedtls_ssl_context xSsl;
+    mbedtls_ssl_config xConf;
+    mbedtls_ctr_drbg_context xCtrDrbg;
+    mbedtls_entropy_context xEntropy;
+
+    /* Variables for IoT credential provider. It's optional feature so we declare them as pointers. */
+    mbedtls_x509_crt *pRootCA;
+    mbedtls_x509_crt *pCert;
+    mbedtls_pk_context *pPrivKey;
+
+    /* mbedTLS writes at most one record in each mbedtls_ssl_write(). */
+    uint64_t uTlsRecordsSent;
+
+    /* Options */
+    uint32_t uRecvTimeoutMs;
+    uint32_t uSendTimeoutMs;
+
+    /* Socket options. They're applied once the socket is created, and 0 or false keeps the OS default. */
+    bool bTcpNoDelay;
+    uint32_t uSendBufSize;
+    uint32_t uNotSentLowat;
+    uint32_t uKeepAliveIdleSec;
+    uint32_t uKeepAliveIntervalSec;
+    uint32_t uKeepAliveCount;
+
+    /* The interface that the socket is bound to before it connects, or 0 for the default route */
+    uint32_t uBindIfIndex;
+
+    /* One of MBEDTLS_SSL_MAX_FRAG_LEN_* to negotiate in the handshake */
+    unsigned char uMaxFragLenCode;
+
+    uint8_t pSendvBuf[NETIO_SENDV_BUF_SIZE];
+
+    /* States of the connection. A connection started by prvMbedtlsConnectStart() walks through them in prvMbedtlsConnectPoll(). */
+    NetIoConnState_t xConnState;
+    uint64_t uConnectDeadlineMs;
+    struct addrinfo *pxAddrList;
+    struct addrinfo *pxAddrNext;
+    bool bWithX509;
+#if NETIO_SESSION_CACHE_SIZE > 0
+    char pcSessionKey[NETIO_SESSION_KEY_MAX_LEN];
+#endif
+#if NETIO_DNS_CACHE_SIZE > 0
+    /* A cached address is the only one to try, and pxAddrList is NULL then. */
+    char pcDnsKey[NETIO_SESSION_KEY_MAX_LEN];
+    bool bDnsCached;
+    struct addrinfo xCachedAddr;
+    struct sockaddr_storage xCachedSockAddr;
+#endif
+
+#if defined(KVS_USE_KTLS)
+    /* The client write key and salt are captured in the handshake, and they're installed into the kernel after it. */
+    bool bKtls;
+    bool bKtlsTx;
+
+    /* The kernel packs the data sent with MSG_MORE into full records, so they're counted when it's flushed. */
+    size_t uKtlsUnflushedLen;
+    unsigned char pKtlsKey[KTLS_MAX_KEY_LEN];
+    unsigned char pKtlsSalt[KTLS_SALT_LEN];
+    size_t uKtlsKeyLen;
+#endif
+} NetIoMbedtls_t;
+
+#if NETIO_SESSION_CACHE_SIZE > 0
+typedef struct NetIoSessionEntry
+{
+    /* "host:port", and sessions with and without client certificate are kept apart. */
+    char pcKey[NETIO_SESSION_KEY_MAX_LEN];
+    bool bWithX509;
+    uint32_t uLastUsed;
+    mbedtls_ssl_session xSession;
+} NetIoSessionEntry_t;
+
+static NetIoSessionEntry_t gxSessionCache[NETIO_SESSION_CACHE_SIZE];
+static uint32_t guSessionUseCount = 0;
+static LOCK_HANDLE gxSessionCacheLock = NULL;
+
+static bool prvSessionCacheLock(void)
+{
+    LOCK_HANDLE xLock = __atomic_load_n(&gxSessionCacheLock, __ATOMIC_ACQUIRE);
+    LOCK_HANDLE xPublished = NULL;
+
+    /* The lock is created on the first connection and never released, so it's shared by all connections. Connections
+     * that race to create it all use the one that is published first. */
+    if (xLock == NULL && (xLock = Lock_Init()) != NULL && !__atomic_compare_exchange_n(&gxSessionCacheLock, &xPublished, xLock, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        /* Another thread created it first. */
+        Lock_Deinit(xLock);
+        xLock = xPublished;
+    }
+
+    return (xLock != NULL && Lock(xLock) == LOCK_OK);
+}
+
+static NetIoSessionEntry_t *prvSessionCacheFind(const char *pcKey, bool bWithX509)
+{
+    NetIoSessionEntry_t *pxEntry = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < NETIO_SESSION_CACHE_SIZE; i++)
+    {
+        if (gxSessionCache[i].uLastUsed > 0 && gxSessionCache[i].bWithX509 == bWithX509 && strcmp(gxSessionCache[i].pcKey, pcKey) == 0)
+        {
+            pxEntry = &(gxSessionCache[i]);
+            break;
+        }
+    }
+
+    return pxEntry;
+}
+
+static void prvSessionCacheMakeKey(NetIoMbedtls_t *pxNet, const char *pcHost, const char *pcPort)
+{
+    snprintf(pxNet->pcSessionKey, NETIO_SESSION_KEY_MAX_LEN, "%s:%s", pcHost, pcPort);
+}
+
+static void prvSessionCacheLoad(NetIoMbedtls_t *pxNet)
+{
+    NetIoSessionEntry_t *pxEntry = NULL;
+
+    if (prvSessionCacheLock())
+    {
+        if ((pxEntry = prvSessionCacheFind(pxNet->pcSessionKey, pxNet->bWithX509)) != NULL)
+        {
+            /* If the server refuses to resume, the handshake falls back to a full one. */
+            if (mbedtls_ssl_set_session(&(pxNet->xSsl), &(pxEntry->xSession)) == 0)
+            {
+                pxEntry->uLastUsed = ++guSessionUseCount;
+            }
+        }
+        Unlock(gxSessionCacheLock);
+    }
+}
+
+static void prvSessionCacheSave(NetIoMbedtls_t *pxNet)
+{
+    NetIoSessionEntry_t *pxEntry = NULL;
+    size_t i = 0;
+
+    if (prvSessionCacheLock())
+    {
+        if ((pxEntry = prvSessionCacheFind(pxNet->pcSessionKey, pxNet->bWithX509)) == NULL)
+        {
+            /* Replace the least recently used entry. Unused entries have the smallest value 0. */
+            pxEntry = &(gxSessionCache[0]);
+            for (i = 1; i < NETIO_SESSION_CACHE_SIZE; i++)
+            {
+                if (gxSessionCache[i].uLastUsed < pxEntry->uLastUsed)
+                {
+                    pxEntry = &(gxSessionCache[i]);
+                }
+            }
+        }
+
+        mbedtls_ssl_session_free(&(pxEntry->xSession));
+        mbedtls_ssl_session_init(&(pxEntry->xSession));
+        if (mbedtls_ssl_get_session(&(pxNet->xSsl), &(pxEntry->xSession)) == 0)
+        {
+            memcpy(pxEntry->pcKey, pxNet->pcSessionKey, sizeof(pxEntry->pcKey));
+            pxEntry->bWithX509 = pxNet->bWithX509;
+            pxEntry->uLastUsed = ++guSessionUseCount;
+        }
+        else
+        {
+            pxEntry->uLastUsed = 0;
+        }
+        Unlock(gxSessionCacheLock);
+    }
+}
+
+static void prvSessionCacheRemove(NetIoMbedtls_t *pxNet)
+{
+    NetIoSessionEntry_t *pxEntry = NULL;
+
+    if (prvSessionCacheLock())
+    {
+        if ((pxEntry = prvSessionCacheFind(pxNet->pcSessionKey, pxNet->bWithX509)) != NULL)
+        {
+            mbedtls_ssl_session_free(&(pxEntry->xSession));
+            pxEntry->uLastUsed = 0;
+        }
+        Unlock(gxSessionCacheLock);
+    }
+}
+#endif /* NETIO_SESSION_CACHE_SIZE > 0 */
+
+#if NETIO_DNS_CACHE_SIZE > 0
+typedef struct NetIoDnsEntry
+{
+    /* "host:port", and the entry is unused if uExpirationMs is 0. */
+    char pcKey[NETIO_SESSION_KEY_MAX_LEN];
+    uint64_t uExpirationMs;
+    int xFamily;
+    int xSockType;
+    int xProtocol;
+    socklen_t uAddrLen;
+    struct sockaddr_storage xAddr;
+} NetIoDnsEntry_t;
+
+typedef struct NetIoResolveTask
+{
+    const char *pcHost;
+    const char *pcPort;
+    KvsThreadHandle xThread;
+    int res;
+} NetIoResolveTask_t;
+
+typedef struct NetIoDnsRefresh
+{
+    char pcHost[NETIO_SESSION_KEY_MAX_LEN];
+    char pcPort[8];
+    KvsThreadHandle xThread;
+    bool bDone;
+} NetIoDnsRefresh_t;
+
+static NetIoDnsEntry_t gxDnsCache[NETIO_DNS_CACHE_SIZE];
+static LOCK_HANDLE gxDnsCacheLock = NULL;
+
+/* One background refresh runs at a time, and it's protected by gxDnsCacheLock. */
+static NetIoDnsRefresh_t gxDnsRefresh;
+
+static bool prvDnsCacheLock(void)
+{
+    LOCK_HANDLE xLock = __atomic_load_n(&gxDnsCacheLock, __ATOMIC_ACQUIRE);
+    LOCK_HANDLE xPublished = NULL;
+
+    /* Like the session cache lock, it's created on first use, published once and never released. */
+    if (xLock == NULL && (xLock = Lock_Init()) != NULL && !__atomic_compare_exchange_n(&gxDnsCacheLock, &xPublished, xLock, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        /* Another thread created it first. */
+        Lock_Deinit(xLock);
+        xLock = xPublished;
+    }
+
+    return (xLock != NULL && Lock(xLock) == LOCK_OK);
+}
+
+/* It should be called with gxDnsCacheLock locked. Entries that expired less than uStaleMs ago are found as well. */
+static NetIoDnsEntry_t *prvDnsCacheFind(const char *pcKey, uint64_t uStaleMs)
+{
+    NetIoDnsEntry_t *pxEntry = NULL;
+    uint64_t uNowMs = getMonotonicTimeInMs();
+    size_t i = 0;
+
+    for (i = 0; i < NETIO_DNS_CACHE_SIZE; i++)
+    {
+        if (gxDnsCache[i].uExpirationMs != 0 && gxDnsCache[i].uExpirationMs + uStaleMs > uNowMs && strcmp(gxDnsCache[i].pcKey, pcKey) == 0)
+        {
+            pxEntry = &(gxDnsCache[i]);
+            break;
+        }
+    }
+
+    return pxEntry;
+}
+
+static bool prvDnsCacheGet(const char *pcKey, uint64_t uStaleMs, struct addrinfo *pxAddr, struct sockaddr_storage *pxSockAddr, uint64_t *puExpirationMs)
+{
+    NetIoDnsEntry_t *pxEntry = NULL;
+    bool bFound = false;
+
+    if (prvDnsCacheLock())
+    {
+        if ((pxEntry = prvDnsCacheFind(pcKey, uStaleMs)) != NULL)
+        {
+            *puExpirationMs = pxEntry->uExpirationMs;
+            memset(pxAddr, 0, sizeof(struct addrinfo));
+            memcpy(pxSockAddr, &(pxEntry->xAddr), sizeof(struct sockaddr_storage));
+            pxAddr->ai_family = pxEntry->xFamily;
+            pxAddr->ai_socktype = pxEntry->xSockType;
+            pxAddr->ai_protocol = pxEntry->xProtocol;
+            pxAddr->ai_addrlen = pxEntry->uAddrLen;
+            pxAddr->ai_addr = (struct sockaddr *)pxSockAddr;
+            bFound = true;
+        }
+        Unlock(gxDnsCacheLock);
+    }
+
+    return bFound;
+}
+
+static void prvDnsCachePut(const char *pcKey, const struct addrinfo *pxAddr)
+{
+    NetIoDnsEntry_t *pxEntry = NULL;
+    size_t i = 0;
+
+    if (strlen(pcKey) < NETIO_SESSION_KEY_MAX_LEN && pxAddr->ai_addrlen <= sizeof(struct sockaddr_storage) && prvDnsCacheLock())
+    {
+        /* A stale entry of the host is refreshed in place. */
+        if ((pxEntry = prvDnsCacheFind(pcKey, NETIO_DNS_CACHE_STALE_MS)) == NULL)
+        {
+            /* Replace the entry that expires first. Unused entries have the smallest value 0. */
+            pxEntry = &(gxDnsCache[0]);
+            for (i = 1; i < NETIO_DNS_CACHE_SIZE; i++)
+            {
+                if (gxDnsCache[i].uExpirationMs < pxEntry->uExpirationMs)
+                {
+                    pxEntry = &(gxDnsCache[i]);
+                }
+            }
+        }
+
+        /* Only the first address is kept, which is the one that getaddrinfo() prefers. */
+        snprintf(pxEntry->pcKey, sizeof(pxEntry->pcKey), "%s", pcKey);
+        pxEntry->xFamily = pxAddr->ai_family;
+        pxEntry->xSockType = pxAddr->ai_socktype;
+        pxEntry->xProtocol = pxAddr->ai_protocol;
+        pxEntry->uAddrLen = pxAddr->ai_addrlen;
+        memcpy(&(pxEntry->xAddr), pxAddr->ai_addr, pxAddr->ai_addrlen);
+        pxEntry->uExpirationMs = getMonotonicTimeInMs() + NETIO_DNS_CACHE_TTL_MS;
+        Unlock(gxDnsCacheLock);
+    }
+}
+
+static bool prvDnsCacheHas(const char *pcKey)
+{
+    bool bFound = false;
+
+    if (prvDnsCacheLock())
+    {
+        bFound = (prvDnsCacheFind(pcKey, 0) != NULL);
+        Unlock(gxDnsCacheLock);
+    }
+
+    return bFound;
+}
+
+static void prvDnsCacheRemove(const char *pcKey)
+{
+    NetIoDnsEntry_t *pxEntry = NULL;
+
+    /* The entry isn't kept as a fallback either, since its address doesn't work. */
+    if (prvDnsCacheLock())
+    {
+        if ((pxEntry = prvDnsCacheFind(pcKey, NETIO_DNS_CACHE_STALE_MS)) != NULL)
+        {
+            pxEntry->uExpirationMs = 0;
+        }
+        Unlock(gxDnsCacheLock);
+    }
+}
+#endif /* NETIO_DNS_CACHE_SIZE > 0 */
+
+static int prvGetAddrInfo(const char *pcHost, const char *pcPort, struct addrinfo **ppxAddrList)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+    struct addrinfo xHints = {0};
+#if NETIO_DNS_CACHE_SIZE > 0
+    char pcKey[NETIO_SESSION_KEY_MAX_LEN];
+#endif
+
+    xHints.ai_family = AF_UNSPEC;
+    xHints.ai_socktype = SOCK_STREAM;
+    xHints.ai_protocol = IPPROTO_TCP;
+
+    if ((retVal = getaddrinfo(pcHost, pcPort, &xHints, ppxAddrList)) != 0 || *ppxAddrList == NULL)
+    {
+        res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_UNKNOWN_HOST);
+        LogError("Failed to resolve %s (err:%d)", pcHost, retVal);
+    }
+    else
+    {
+#if NETIO_DNS_CACHE_SIZE > 0
+        snprintf(pcKey, sizeof(pcKey), "%s:%s", pcHost, pcPort);
+        prvDnsCachePut(pcKey, *ppxAddrList);
+#endif
+    }
+
+    return res;
+}
+
+#if NETIO_DNS_CACHE_SIZE > 0
+static void prvDnsRefreshRoutine(void *pArg)
+{
+    NetIoDnsRefresh_t *pxRefresh = (NetIoDnsRefresh_t *)pArg;
+    struct addrinfo *pxAddrList = NULL;
+
+    /* The cache is updated by prvGetAddrInfo(), and the entry is kept as it is if it fails. */
+    if (prvGetAddrInfo(pxRefresh->pcHost, pxRefresh->pcPort, &pxAddrList) == KVS_ERRNO_NONE)
+    {
+        freeaddrinfo(pxAddrList);
+    }
+
+    __atomic_store_n(&(pxRefresh->bDone), true, __ATOMIC_RELEASE);
+}
+
+/* Resolve a host again in a thread before its entry expires, so connections keep using the cache instead of waiting
+ * for the resolver. It's skipped if another refresh is still running, and a finished one is joined here. */
+static void prvDnsRefreshAsync(const char *pcHost, const char *pcPort)
+{
+    if (strlen(pcHost) < sizeof(gxDnsRefresh.pcHost) && strlen(pcPort) < sizeof(gxDnsRefresh.pcPort) && prvDnsCacheLock())
+    {
+        if (gxDnsRefresh.xThread != NULL && __atomic_load_n(&(gxDnsRefresh.bDone), __ATOMIC_ACQUIRE))
+        {
+            kvsThreadJoin(gxDnsRefresh.xThread);
+            gxDnsRefresh.xThread = NULL;
+        }
+
+        if (gxDnsRefresh.xThread == NULL)
+        {
+            snprintf(gxDnsRefresh.pcHost, sizeof(gxDnsRefresh.pcHost), "%s", pcHost);
+            snprintf(gxDnsRefresh.pcPort, sizeof(gxDnsRefresh.pcPort), "%s", pcPort);
+            gxDnsRefresh.bDone = false;
+            gxDnsRefresh.xThread = kvsThreadCreate(prvDnsRefreshRoutine, &gxDnsRefresh, NETIO_DNS_RESOLVE_STACK_SIZE, -1);
+        }
+        Unlock(gxDnsCacheLock);
+    }
+}
+#endif /* NETIO_DNS_CACHE_SIZE > 0 */
+
+/* Resolve the host into pxAddrNext, either from the DNS cache or by getaddrinfo(). Name resolution is the only step
+ * that may block, because there is no portable asynchronous resolver. If the host can't be resolved, the last known
+ * address of it is used. */
+static int prvResolve(NetIoMbedtls_t *pxNet, const char *pcHost, const char *pcPort)
+{
+    int res = KVS_ERRNO_NONE;
+    bool bCached = false;
+#if NETIO_DNS_CACHE_SIZE > 0
+    uint64_t uExpirationMs = 0;
+#endif
+
+#if NETIO_DNS_CACHE_SIZE > 0
+    snprintf(pxNet->pcDnsKey, sizeof(pxNet->pcDnsKey), "%s:%s", pcHost, pcPort);
+    if ((bCached = prvDnsCacheGet(pxNet->pcDnsKey, 0, &(pxNet->xCachedAddr), &(pxNet->xCachedSockAddr), &uExpirationMs)))
+    {
+        pxNet->pxAddrNext = &(pxNet->xCachedAddr);
+        if (uExpirationMs < getMonotonicTimeInMs() + NETIO_DNS_CACHE_REFRESH_MS)
+        {
+            prvDnsRefreshAsync(pcHost, pcPort);
+        }
+    }
+#endif
+
+    if (!bCached && (res = prvGetAddrInfo(pcHost, pcPort, &(pxNet->pxAddrList))) == KVS_ERRNO_NONE)
+    {
+        pxNet->pxAddrNext = pxNet->pxAddrList;
+    }
+
+#if NETIO_DNS_CACHE_SIZE > 0
+    if (res != KVS_ERRNO_NONE &&
+        (bCached = prvDnsCacheGet(pxNet->pcDnsKey, NETIO_DNS_CACHE_STALE_MS, &(pxNet->xCachedAddr), &(pxNet->xCachedSockAddr), &uExpirationMs)))
+    {
+        LogInfo("Use the last known address of %s", pcHost);
+        pxNet->pxAddrNext = &(pxNet->xCachedAddr);
+        res = KVS_ERRNO_NONE;
+    }
+    pxNet->bDnsCached = bCached;
+#endif
+
+    return res;
+}
+
+static void prvResolveDone(NetIoMbedtls_t *pxNet, bool bConnected)
+{
+    if (pxNet->pxAddrList != NULL)
+    {
+        freeaddrinfo(pxNet->pxAddrList);
+        pxNet->pxAddrList = NULL;
+    }
+    pxNet->pxAddrNext = NULL;
+
+#if NETIO_DNS_CACHE_SIZE > 0
+    /* The host may have moved, so it's resolved again next time. */
+    if (pxNet->bDnsCached && !bConnected)
+    {
+        prvDnsCacheRemove(pxNet->pcDnsKey);
+    }
+    pxNet->bDnsCached = false;
+#else
+    (void)bConnected;
+#endif
+}
+
+/* Connect to the resolved addresses in order with blocking sockets, like mbedtls_net_connect(). */
+static int prvTcpConnect(NetIoMbedtls_t *pxNet, const char *pcHost, const char *pcPort)
+{
+    int res = KVS_ERRNO_NONE;
+    struct addrinfo *pxAddr = NULL;
+
+    if ((res = prvResolve(pxNet, pcHost, pcPort)) == KVS_ERRNO_NONE)
+    {
+        res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_CONNECT_FAILED);
+        while (res != KVS_ERRNO_NONE && (pxAddr = pxNet->pxAddrNext) != NULL)
+        {
+            pxNet->pxAddrNext = pxAddr->ai_next;
+
+            if ((pxNet->xFd.fd = socket(pxAddr->ai_family, pxAddr->ai_socktype, pxAddr->ai_protocol)) < 0)
+            {
+                res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_SOCKET_FAILED);
+            }
+            else
+            {
+                prvBindInterface(pxNet);
+                if (connect(pxNet->xFd.fd, pxAddr->ai_addr, pxAddr->ai_addrlen) == 0)
+                {
+                    res = KVS_ERRNO_NONE;
+                }
+                else
+                {
+                    mbedtls_net_free(&(pxNet->xFd));
+                    res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_CONNECT_FAILED);
+                }
+            }
+        }
+        prvResolveDone(pxNet, res == KVS_ERRNO_NONE);
+    }
+
+    return res;
+}
+
+static int prvCreateX509Cert(NetIoMbedtls_t *pxNet)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pxNet == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((pxNet->pRootCA = (mbedtls_x509_crt *)kvsMallocClass(sizeof(mbedtls_x509_crt), KVS_ALLOC_CLASS_CRYPTO)) == NULL ||
+        (pxNet->pCert = (mbedtls_x509_crt *)kvsMallocClass(sizeof(mbedtls_x509_crt), KVS_ALLOC_CLASS_CRYPTO)) == NULL ||
+        (pxNet->pPrivKey = (mbedtls_pk_context *)kvsMallocClass(sizeof(mbedtls_pk_context), KVS_ALLOC_CLASS_CRYPTO)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+    }
+    else
+    {
+        mbedtls_x509_crt_init(pxNet->pRootCA);
+        mbedtls_x509_crt_init(pxNet->pCert);
+        mbedtls_pk_init(pxNet->pPrivKey);
+    }
+
+    return res;
+}
+
+static int prvMbedtlsSetSendTimeout(void *pCtx, unsigned int uSendTimeoutMs);
+
+#if defined(KVS_USE_KTLS)
+static int prvKtlsExportKeys(void *pCtx, const unsigned char *pMasterSecret, const unsigned char *pKeyBlock, size_t uMacLen, size_t uKeyLen, size_t uIvLen)
+{
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    /* The key block is the client and server MAC keys, the client and server write keys, then the client and server IVs. */
+    pxNet->uKtlsKeyLen = 0;
+    if (uKeyLen <= KTLS_MAX_KEY_LEN && uIvLen == KTLS_SALT_LEN)
+    {
+        memcpy(pxNet->pKtlsKey, pKeyBlock + uMacLen * 2, uKeyLen);
+        memcpy(pxNet->pKtlsSalt, pKeyBlock + uMacLen * 2 + uKeyLen * 2, KTLS_SALT_LEN);
+        pxNet->uKtlsKeyLen = uKeyLen;
+    }
+
+    return 0;
+}
+
+static int prvKtlsInstallTx(NetIoMbedtls_t *pxNet, mbedtls_cipher_type_t xCipher)
+{
+    int res = KVS_ERRNO_NONE;
+    int fd = pxNet->xFd.fd;
+    struct tls12_crypto_info_aes_gcm_128 xInfo128 = {0};
+    struct tls12_crypto_info_aes_gcm_256 xInfo256 = {0};
+    void *pInfo = NULL;
+    socklen_t uInfoLen = 0;
+
+    /* mbedTLS uses the record sequence number as the explicit nonce, and so does the kernel. */
+    if (xCipher == MBEDTLS_CIPHER_AES_128_GCM && pxNet->uKtlsKeyLen == TLS_CIPHER_AES_GCM_128_KEY_SIZE)
+    {
+        xInfo128.info.version = TLS_1_2_VERSION;
+        xInfo128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        memcpy(xInfo128.key, pxNet->pKtlsKey, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+        memcpy(xInfo128.salt, pxNet->pKtlsSalt, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+        memcpy(xInfo128.iv, pxNet->xSsl.out_ctr, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+        memcpy(xInfo128.rec_seq, pxNet->xSsl.out_ctr, TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+        pInfo = &xInfo128;
+        uInfoLen = sizeof(xInfo128);
+    }
+    else if (xCipher == MBEDTLS_CIPHER_AES_256_GCM && pxNet->uKtlsKeyLen == TLS_CIPHER_AES_GCM_256_KEY_SIZE)
+    {
+        xInfo256.info.version = TLS_1_2_VERSION;
+        xInfo256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        memcpy(xInfo256.key, pxNet->pKtlsKey, TLS_CIPHER_AES_GCM_256_KEY_SIZE);
+        memcpy(xInfo256.salt, pxNet->pKtlsSalt, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+        memcpy(xInfo256.iv, pxNet->xSsl.out_ctr, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+        memcpy(xInfo256.rec_seq, pxNet->xSsl.out_ctr, TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+        pInfo = &xInfo256;
+        uInfoLen = sizeof(xInfo256);
+    }
+    else
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogInfo("kTLS doesn't support cipher suite %s", mbedtls_ssl_get_ciphersuite(&(pxNet->xSsl)));
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0 || setsockopt(fd, SOL_TLS, TLS_TX, pInfo, uInfoLen) != 0)
+    {
+        /* The tls module may not be loaded. The ULP passes data through as it is until TLS_TX is set. */
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogInfo("Unable to enable kTLS (errno:%d)", errno);
+    }
+    else
+    {
+        /* nop */
+    }
+
+    mbedtls_platform_zeroize(&xInfo128, sizeof(xInfo128));
+    mbedtls_platform_zeroize(&xInfo256, sizeof(xInfo256));
+
+    return res;
+}
+
+static void prvKtlsEnable(NetIoMbedtls_t *pxNet)
+{
+    const mbedtls_ssl_ciphersuite_t *pxSuite = NULL;
+
+    pxNet->bKtlsTx = false;
+    if (!pxNet->bKtls)
+    {
+        /* Do nothing when it's the mbedTLS transport. */
+    }
+    else if (strcmp(mbedtls_ssl_get_version(&(pxNet->xSsl)), "TLSv1.2") != 0 ||
+             (pxSuite = mbedtls_ssl_ciphersuite_from_id(mbedtls_ssl_get_ciphersuite_id(mbedtls_ssl_get_ciphersuite(&(pxNet->xSsl))))) == NULL)
+    {
+        LogInfo("kTLS supports TLS 1.2 only");
+    }
+    else if (prvKtlsInstallTx(pxNet, pxSuite->cipher) == KVS_ERRNO_NONE)
+    {
+        /* Received data is still decrypted by mbedTLS. */
+        pxNet->bKtlsTx = true;
+    }
+    else
+    {
+        /* Sent data is encrypted by mbedTLS as usual. */
+    }
+
+    mbedtls_platform_zeroize(pxNet->pKtlsKey, sizeof(pxNet->pKtlsKey));
+    mbedtls_platform_zeroize(pxNet->pKtlsSalt, sizeof(pxNet->pKtlsSalt));
+    pxNet->uKtlsKeyLen = 0;
+}
+#endif /* KVS_USE_KTLS */
+
+static int prvInitConfig(NetIoMbedtls_t *pxNet, const char *pcHost, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+
+    if (pxNet == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        mbedtls_ssl_set_bio(&(pxNet->xSsl), &(pxNet->xFd), mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+
+        if ((retVal = mbedtls_ssl_config_defaults(&(pxNet->xConf), MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) != 0)
+        {
+            res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+            LogError("Failed to config ssl (err:-%X)", -res);
+        }
+        else
+        {
+            mbedtls_ssl_conf_rng(&(pxNet->xConf), mbedtls_ctr_drbg_random, &(pxNet->xCtrDrbg));
+            mbedtls_ssl_set_hostname(&(pxNet->xSsl), pcHost);
+            mbedtls_ssl_conf_read_timeout(&(pxNet->xConf), pxNet->uRecvTimeoutMs);
+            prvMbedtlsSetSendTimeout(pxNet, pxNet->uSendTimeoutMs);
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+            mbedtls_ssl_conf_max_frag_len(&(pxNet->xConf), pxNet->uMaxFragLenCode);
+#endif
+#if defined(KVS_USE_KTLS)
+            if (pxNet->bKtls)
+            {
+                mbedtls_ssl_conf_export_keys_cb(&(pxNet->xConf), prvKtlsExportKeys, pxNet);
+            }
+#endif
+
+            if (pcRootCA != NULL && pcCert != NULL && pcPrivKey != NULL)
+            {
+                if ((retVal = mbedtls_x509_crt_parse(pxNet->pRootCA, (void *)pcRootCA, strlen(pcRootCA) + 1)) != 0 ||
+                    (retVal = mbedtls_x509_crt_parse(pxNet->pCert, (void *)pcCert, strlen(pcCert) + 1)) != 0 ||
+                    (retVal = mbedtls_pk_parse_key(pxNet->pPrivKey, (void *)pcPrivKey, strlen(pcPrivKey) + 1, NULL, 0)) != 0)
+                {
+                    res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+                    LogError("Failed to parse x509 (err:-%X)", -res);
+                }
+                else
+                {
+                    mbedtls_ssl_conf_authmode(&(pxNet->xConf), MBEDTLS_SSL_VERIFY_REQUIRED);
+                    mbedtls_ssl_conf_ca_chain(&(pxNet->xConf), pxNet->pRootCA, NULL);
+
+                    if ((retVal = mbedtls_ssl_conf_own_cert(&(pxNet->xConf), pxNet->pCert, pxNet->pPrivKey)) != 0)
+                    {
+                        res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+                        LogError("Failed to conf own cert (err:-%X)", -res);
+                    }
+                }
+            }
+            else
+            {
+                mbedtls_ssl_conf_authmode(&(pxNet->xConf), MBEDTLS_SSL_VERIFY_OPTIONAL);
+            }
+        }
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        if ((retVal = mbedtls_ssl_setup(&(pxNet->xSsl), &(pxNet->xConf))) != 0)
+        {
+            res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+            LogError("Failed to setup ssl (err:-%X)", -res);
+        }
+    }
+
+    return res;
+}
+
+static void prvSetSockOpt(int fd, int xLevel, int xOptName, int xValue, const char *pcOptName)
+{
+    if (setsockopt(fd, xLevel, xOptName, (void *)&xValue, sizeof(xValue)) != 0)
+    {
+        /* Not all of the options are supported on every platform, so it doesn't fail the connection. */
+        LogInfo("Unable to set socket option %s (errno:%d)", pcOptName, errno);
+    }
+}
+
+/**
+ * @brief Bind a new socket to the interface. A socket that can't be bound still connects on the default route.
+ */
+static void prvBindInterface(NetIoMbedtls_t *pxNet)
+{
+#if defined(SO_BINDTODEVICE) && defined(__linux__)
+    char pcIfName[IF_NAMESIZE] = {0};
+
+    if (pxNet->uBindIfIndex == 0)
+    {
+        /* nop */
+    }
+    else if (if_indextoname(pxNet->uBindIfIndex, pcIfName) == NULL)
+    {
+        LogInfo("Unknown interface index %u (errno:%d)", (unsigned int)pxNet->uBindIfIndex, errno);
+    }
+    else if (setsockopt(pxNet->xFd.fd, SOL_SOCKET, SO_BINDTODEVICE, pcIfName, (socklen_t)strlen(pcIfName)) != 0)
+    {
+        LogInfo("Unable to bind socket to %s (errno:%d)", pcIfName, errno);
+    }
+    else
+    {
+        /* nop */
+    }
+#else
+    if (pxNet->uBindIfIndex != 0)
+    {
+        LogInfo("Binding to an interface is not supported on this platform");
+    }
+#endif
+}
+
+static void prvApplySocketOptions(NetIoMbedtls_t *pxNet)
+{
+    int fd = pxNet->xFd.fd;
+
+    if (fd < 0)
+    {
+        /* Do nothing when the socket hasn't been created. */
+    }
+    else
+    {
+        if (pxNet->bTcpNoDelay)
+        {
+            prvSetSockOpt(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+        }
+
+        if (pxNet->uSendBufSize > 0)
+        {
+#if defined(LWIP_HDR_SOCKETS_H)
+            /* lwIP sizes the TCP send buffer with TCP_SND_BUF at build time. */
+            LogInfo("SO_SNDBUF is not supported by lwIP, set TCP_SND_BUF instead");
+#else
+            prvSetSockOpt(fd, SOL_SOCKET, SO_SNDBUF, (int)pxNet->uSendBufSize, "SO_SNDBUF");
+#endif
+        }
+
+        if (pxNet->uNotSentLowat > 0)
+        {
+#if defined(TCP_NOTSENT_LOWAT)
+            prvSetSockOpt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, (int)pxNet->uNotSentLowat, "TCP_NOTSENT_LOWAT");
+#else
+            LogInfo("TCP_NOTSENT_LOWAT is not supported on this platform");
+#endif
+        }
+
+        if (pxNet->uKeepAliveIdleSec > 0 || pxNet->uKeepAliveIntervalSec > 0 || pxNet->uKeepAliveCount > 0)
+        {
+            /* lwIP supports these only if it's built with LWIP_TCP_KEEPALIVE. */
+            prvSetSockOpt(fd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+            if (pxNet->uKeepAliveIdleSec > 0)
+            {
+                prvSetSockOpt(fd, IPPROTO_TCP, TCP_KEEPIDLE, (int)pxNet->uKeepAliveIdleSec, "TCP_KEEPIDLE");
+            }
+            if (pxNet->uKeepAliveIntervalSec > 0)
+            {
+                prvSetSockOpt(fd, IPPROTO_TCP, TCP_KEEPINTVL, (int)pxNet->uKeepAliveIntervalSec, "TCP_KEEPINTVL");
+            }
+            if (pxNet->uKeepAliveCount > 0)
+            {
+                prvSetSockOpt(fd, IPPROTO_TCP, TCP_KEEPCNT, (int)pxNet->uKeepAliveCount, "TCP_KEEPCNT");
+            }
+#endif
+        }
+    }
+}
+
+static int prvPrepareConnect(NetIoMbedtls_t *pxNet, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    int res = KVS_ERRNO_NONE;
+
+    pxNet->bWithX509 = (pcRootCA != NULL && pcCert != NULL && pcPrivKey != NULL);
+#if NETIO_SESSION_CACHE_SIZE > 0
+    prvSessionCacheMakeKey(pxNet, pcHost, pcPort);
+#endif
+
+    if (pxNet->bWithX509 && (res = prvCreateX509Cert(pxNet)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to init x509 (err:-%X)", -res);
+        /* Propagate the res error */
+    }
+
+    return res;
+}
+
+static int prvConnect(NetIoMbedtls_t *pxNet, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+
+    if (pxNet == NULL || pcHost == NULL || pcPort == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((res = prvPrepareConnect(pxNet, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if ((res = prvTcpConnect(pxNet, pcHost, pcPort)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to connect to %s:%s (err:-%X)", pcHost, pcPort, -res);
+    }
+    else if ((res = prvInitConfig(pxNet, pcHost, pcRootCA, pcCert, pcPrivKey)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to config ssl (err:-%X)", -res);
+        /* Propagate the res error */
+    }
+    else
+    {
+        prvApplySocketOptions(pxNet);
+#if NETIO_SESSION_CACHE_SIZE > 0
+        prvSessionCacheLoad(pxNet);
+#endif
+        if ((retVal = mbedtls_ssl_handshake(&(pxNet->xSsl))) != 0)
+        {
+            res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+            LogError("ssl handshake err (-%X)", -res);
+#if NETIO_SESSION_CACHE_SIZE > 0
+            prvSessionCacheRemove(pxNet);
+#endif
+        }
+        else
+        {
+#if NETIO_SESSION_CACHE_SIZE > 0
+            prvSessionCacheSave(pxNet);
+#endif
+#if defined(KVS_USE_KTLS)
+            prvKtlsEnable(pxNet);
+#endif
+            pxNet->xConnState = NETIO_CONN_CONNECTED;
+        }
+    }
+
+    return res;
+}
+
+static void prvConnectAbort(NetIoMbedtls_t *pxNet)
+{
+    mbedtls_net_free(&(pxNet->xFd));
+    /* A failed TLS handshake means the address is reachable. */
+    prvResolveDone(pxNet, pxNet->xConnState == NETIO_CONN_TLS_HANDSHAKING);
+    pxNet->xConnState = NETIO_CONN_IDLE;
+}
+
+static int prvTcpConnectNextAddr(NetIoMbedtls_t *pxNet)
+{
+    int res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_CONNECT_FAILED);
+    struct addrinfo *pxAddr = NULL;
+
+    /* Try the resolved addresses in order until one of them is connecting. */
+    while (res != KVS_ERRNO_NONE && (pxAddr = pxNet->pxAddrNext) != NULL)
+    {
+        pxNet->pxAddrNext = pxAddr->ai_next;
+
+        if ((pxNet->xFd.fd = socket(pxAddr->ai_family, pxAddr->ai_socktype, pxAddr->ai_protocol)) < 0)
+        {
+            res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_SOCKET_FAILED);
+        }
+        else
+        {
+            /* Options are applied before connect, so the buffer sizes are already in place for the TCP handshake. */
+            prvBindInterface(pxNet);
+            prvApplySocketOptions(pxNet);
+
+            if (mbedtls_net_set_nonblock(&(pxNet->xFd)) == 0 &&
+                (connect(pxNet->xFd.fd, pxAddr->ai_addr, pxAddr->ai_addrlen) == 0 || errno == EINPROGRESS))
+            {
+                res = KVS_ERRNO_NONE;
+            }
+            else
+            {
+                mbedtls_net_free(&(pxNet->xFd));
+                res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_CONNECT_FAILED);
+            }
+        }
+    }
+
+    return res;
+}
+
+static int prvTcpConnectPoll(NetIoMbedtls_t *pxNet, bool *pbConnected)
+{
+    int res = KVS_ERRNO_NONE;
+    struct timeval tv = {0};
+    fd_set write_fds = {0};
+    int fd = pxNet->xFd.fd;
+    int xSockErr = 0;
+    socklen_t uSockErrLen = sizeof(xSockErr);
+
+    FD_ZERO(&write_fds);
+    FD_SET(fd, &write_fds);
+
+    *pbConnected = false;
+    if (select(fd + 1, NULL, &write_fds, NULL, &tv) < 0)
+    {
+        res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_CONNECT_FAILED);
+    }
+    else if (!FD_ISSET(fd, &write_fds))
+    {
+        /* Still connecting */
+    }
+    else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&xSockErr, &uSockErrLen) != 0 || xSockErr != 0)
+    {
+        mbedtls_net_free(&(pxNet->xFd));
+        res = prvTcpConnectNextAddr(pxNet);
+    }
+    else
+    {
+        *pbConnected = true;
+    }
+
+    return res;
+}
+
+static int prvTcpConnectStart(NetIoMbedtls_t *pxNet, const char *pcHost, const char *pcPort)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if ((res = prvResolve(pxNet, pcHost, pcPort)) == KVS_ERRNO_NONE)
+    {
+        res = prvTcpConnectNextAddr(pxNet);
+    }
+
+    return res;
+}
+
+static int prvConnectStart(NetIoMbedtls_t *pxNet, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pxNet == NULL || pcHost == NULL || pcPort == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pxNet->xConnState == NETIO_CONN_TCP_CONNECTING || pxNet->xConnState == NETIO_CONN_TLS_HANDSHAKING)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Connection is in progress");
+    }
+    else if ((res = prvPrepareConnect(pxNet, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if ((res = prvTcpConnectStart(pxNet, pcHost, pcPort)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to connect to %s:%s (err:-%X)", pcHost, pcPort, -res);
+        prvConnectAbort(pxNet);
+        /* Propagate the res error */
+    }
+    else if ((res = prvInitConfig(pxNet, pcHost, pcRootCA, pcCert, pcPrivKey)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to config ssl (err:-%X)", -res);
+        prvConnectAbort(pxNet);
+        /* Propagate the res error */
+    }
+    else
+    {
+        /* The handshake reads without timeout, and WANT_READ is returned instead of blocking. */
+        mbedtls_ssl_set_bio(&(pxNet->xSsl), &(pxNet->xFd), mbedtls_net_send, mbedtls_net_recv, NULL);
+#if NETIO_SESSION_CACHE_SIZE > 0
+        prvSessionCacheLoad(pxNet);
+#endif
+        pxNet->uConnectDeadlineMs = getMonotonicTimeInMs() + pxNet->uRecvTimeoutMs;
+        pxNet->xConnState = NETIO_CONN_TCP_CONNECTING;
+    }
+
+    return res;
+}
+
+static void prvMbedtlsTerminate(void *pCtx);
+
+static void *prvMbedtlsCreate(void)
+{
+    NetIoMbedtls_t *pxNet = NULL;
+
+    if ((pxNet = (NetIoMbedtls_t *)kvsMallocClass(sizeof(NetIoMbedtls_t), KVS_ALLOC_CLASS_CRYPTO)) != NULL)
+    {
+        memset(pxNet, 0, sizeof(NetIoMbedtls_t));
+
+        mbedtls_net_init(&(pxNet->xFd));
+        mbedtls_ssl_init(&(pxNet->xSsl));
+        mbedtls_ssl_config_init(&(pxNet->xConf));
+        mbedtls_ctr_drbg_init(&(pxNet->xCtrDrbg));
+        mbedtls_entropy_init(&(pxNet->xEntropy));
+
+        pxNet->uRecvTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
+        pxNet->uSendTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
+
+        if (mbedtls_ctr_drbg_seed(&(pxNet->xCtrDrbg), mbedtls_entropy_func, &(pxNet->xEntropy), NULL, 0) != 0)
+        {
+            prvMbedtlsTerminate(pxNet);
+            pxNet = NULL;
+        }
+    }
+
+    return pxNet;
+}
+
+static void prvMbedtlsTerminate(void *pCtx)
+{
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    if (pxNet != NULL)
+    {
+        mbedtls_ctr_drbg_free(&(pxNet->xCtrDrbg));
+        mbedtls_entropy_free(&(pxNet->xEntropy));
+        mbedtls_net_free(&(pxNet->xFd));
+        mbedtls_ssl_free(&(pxNet->xSsl));
+        mbedtls_ssl_config_free(&(pxNet->xConf));
+
+        if (pxNet->pxAddrList != NULL)
+        {
+            freeaddrinfo(pxNet->pxAddrList);
+            pxNet->pxAddrList = NULL;
+        }
+
+        if (pxNet->pRootCA != NULL)
+        {
+            mbedtls_x509_crt_free(pxNet->pRootCA);
+            kvsFree(pxNet->pRootCA);
+            pxNet->pRootCA = NULL;
+        }
+
+        if (pxNet->pCert != NULL)
+        {
+            mbedtls_x509_crt_free(pxNet->pCert);
+            kvsFree(pxNet->pCert);
+            pxNet->pCert = NULL;
+        }
+
+        if (pxNet->pPrivKey != NULL)
+        {
+            mbedtls_pk_free(pxNet->pPrivKey);
+            kvsFree(pxNet->pPrivKey);
+            pxNet->pPrivKey = NULL;
+        }
+#if defined(KVS_USE_KTLS)
+        mbedtls_platform_zeroize(pxNet->pKtlsKey, sizeof(pxNet->pKtlsKey));
+#endif
+        kvsFree(pxNet);
+    }
+}
+
+static int prvMbedtlsConnect(void *pCtx, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    return prvConnect((NetIoMbedtls_t *)pCtx, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey);
+}
+
+static int prvMbedtlsConnectStart(void *pCtx, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    return prvConnectStart((NetIoMbedtls_t *)pCtx, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey);
+}
+
+static int prvMbedtlsConnectPoll(void *pCtx, bool *pbConnected)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+    bool bTcpConnected = false;
+
+    if (pxNet == NULL || pbConnected == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pxNet->xConnState == NETIO_CONN_IDLE)
+    {
+        res = KVS_ERROR_NETIO_CONNECT_NOT_STARTED;
+        LogError("Connection is not started");
+    }
+    else
+    {
+        if (pxNet->xConnState == NETIO_CONN_TCP_CONNECTING)
+        {
+            if ((res = prvTcpConnectPoll(pxNet, &bTcpConnected)) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed to connect (err:-%X)", -res);
+            }
+            else if (bTcpConnected)
+            {
+                pxNet->xConnState = NETIO_CONN_TLS_HANDSHAKING;
+            }
+            else
+            {
+                /* nop */
+            }
+        }
+
+        if (res == KVS_ERRNO_NONE && pxNet->xConnState == NETIO_CONN_TLS_HANDSHAKING)
+        {
+            if ((retVal = mbedtls_ssl_handshake(&(pxNet->xSsl))) == MBEDTLS_ERR_SSL_WANT_READ || retVal == MBEDTLS_ERR_SSL_WANT_WRITE)
+            {
+                /* Wait for the server */
+            }
+            else if (retVal != 0)
+            {
+                res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+                LogError("ssl handshake err (-%X)", -res);
+#if NETIO_SESSION_CACHE_SIZE > 0
+                prvSessionCacheRemove(pxNet);
+#endif
+            }
+            else
+            {
+                /* Go back to the blocking I/O with timeouts that the rest of NetIo expects. */
+                mbedtls_net_set_block(&(pxNet->xFd));
+                mbedtls_ssl_set_bio(&(pxNet->xSsl), &(pxNet->xFd), mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+#if NETIO_SESSION_CACHE_SIZE > 0
+                prvSessionCacheSave(pxNet);
+#endif
+#if defined(KVS_USE_KTLS)
+                prvKtlsEnable(pxNet);
+#endif
+                prvResolveDone(pxNet, true);
+                pxNet->xConnState = NETIO_CONN_CONNECTED;
+            }
+        }
+
+        if (res == KVS_ERRNO_NONE && pxNet->xConnState != NETIO_CONN_CONNECTED && getMonotonicTimeInMs() >= pxNet->uConnectDeadlineMs)
+        {
+            res = KVS_ERROR_NETIO_CONNECT_TIMEOUT;
+            LogError("Connection timeout");
+        }
+
+        if (res != KVS_ERRNO_NONE)
+        {
+            prvConnectAbort(pxNet);
+        }
+        *pbConnected = (pxNet->xConnState == NETIO_CONN_CONNECTED);
+    }
+
+    return res;
+}
+
+static void prvMbedtlsDisconnect(void *pCtx)
+{
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    if (pxNet != NULL)
+    {
+        mbedtls_ssl_close_notify(&(pxNet->xSsl));
+    }
+}
+
+static int prvNetIoSend(NetIoMbedtls_t *pxNet, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    int n = 0;
+    int res = KVS_ERRNO_NONE;
+    size_t uBytesRemaining = uBytesToSend;
+    char *pIndex = (char *)pBuffer;
+
+    while (uBytesRemaining > 0)
+    {
+        n = mbedtls_ssl_write(&(pxNet->xSsl), (const unsigned char *)pIndex, uBytesRemaining);
+        if (n < 0)
+        {
+            res = KVS_GENERATE_MBEDTLS_ERROR(n);
+            LogError("SSL send error -%X", -res);
+            break;
+        }
+        else if (n > uBytesRemaining)
+        {
+            res = KVS_ERROR_NETIO_SEND_MORE_THAN_REMAINING_DATA;
+            LogError("SSL send error -%X", -res);
+            break;
+        }
+        uBytesRemaining -= n;
+        pIndex += n;
+        pxNet->uTlsRecordsSent++;
+    }
+
+    return res;
+}
+
+static int prvMbedtlsSend(void *pCtx, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    if (pxNet == NULL || pBuffer == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        res = prvNetIoSend(pxNet, pBuffer, uBytesToSend);
+    }
+
+    return res;
+}
+
+static int prvMbedtlsSendv(void *pCtx, const NetIoVec_t *pxIov, size_t uIovCnt)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+    size_t i = 0;
+    size_t uBufLen = 0;
+    size_t uCopyLen = 0;
+
+    if (pxNet == NULL || pxIov == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        for (i = 0; i < uIovCnt && res == KVS_ERRNO_NONE; i++)
+        {
+            if (pxIov[i].pBase == NULL || pxIov[i].uLen == 0)
+            {
+                continue;
+            }
+
+            if (pxIov[i].uLen <= NETIO_SENDV_BUF_SIZE - uBufLen)
+            {
+                memcpy(pxNet->pSendvBuf + uBufLen, pxIov[i].pBase, pxIov[i].uLen);
+                uBufLen += pxIov[i].uLen;
+            }
+            else
+            {
+                /* Fill up the buffer with the beginning of a large segment, then send the rest of it directly. */
+                uCopyLen = NETIO_SENDV_BUF_SIZE - uBufLen;
+                memcpy(pxNet->pSendvBuf + uBufLen, pxIov[i].pBase, uCopyLen);
+                if ((res = prvNetIoSend(pxNet, pxNet->pSendvBuf, NETIO_SENDV_BUF_SIZE)) == KVS_ERRNO_NONE)
+                {
+                    res = prvNetIoSend(pxNet, pxIov[i].pBase + uCopyLen, pxIov[i].uLen - uCopyLen);
+                }
+                uBufLen = 0;
+            }
+        }
+
+        if (res == KVS_ERRNO_NONE && uBufLen > 0)
+        {
+            res = prvNetIoSend(pxNet, pxNet->pSendvBuf, uBufLen);
+        }
+    }
+
+    return res;
+}
+
+static int prvMbedtlsRecv(void *pCtx, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    int n;
+    int res = KVS_ERRNO_NONE;
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    if (pxNet == NULL || pBuffer == NULL || puBytesReceived == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        n = mbedtls_ssl_read(&(pxNet->xSsl), pBuffer, uBufferSize);
+        if (n < 0)
+        {
+            res = KVS_GENERATE_MBEDTLS_ERROR(n);
+            LogError("SSL recv error -%X", -res);
+        }
+        else if (n > uBufferSize)
+        {
+            res = KVS_ERROR_NETIO_RECV_MORE_THAN_AVAILABLE_SPACE;
+            LogError("SSL recv error -%X", -res);
+        }
+        else
+        {
+            *puBytesReceived = n;
+        }
+    }
+
+    return res;
+}
+
+static bool prvMbedtlsIsDataAvailable(void *pCtx)
+{
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+    bool bDataAvailable = false;
+    struct timeval tv = {0};
+    fd_set read_fds = {0};
+    int fd = 0;
+
+    if (pxNet != NULL)
+    {
+        fd = pxNet->xFd.fd;
+        if (fd >= 0)
+        {
+            FD_ZERO(&read_fds);
+            FD_SET(fd, &read_fds);
+
+            tv.tv_sec = 0;
+            tv.tv_usec = 0;
+
+            if (select(fd + 1, &read_fds, NULL, NULL, &tv) >= 0)
+            {
+                if (FD_ISSET(fd, &read_fds))
+                {
+                    bDataAvailable = true;
+                }
+            }
+        }
+    }
+
+    return bDataAvailable;
+}
+
+static int prvMbedtlsGetSocket(void *pCtx)
+{
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    return (pxNet != NULL && pxNet->xConnState == NETIO_CONN_CONNECTED) ? pxNet->xFd.fd : -1;
+}
+
+static int prvMbedtlsGetStats(void *pCtx, NetIoStats_t *pxStats)
+{
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    pxStats->uTlsRecordsSent = pxNet->uTlsRecordsSent;
+
+    return KVS_ERRNO_NONE;
+}
+
+static int prvMbedtlsSetRecvTimeout(void *pCtx, unsigned int uRecvTimeoutMs)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    if (pxNet == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        pxNet->uRecvTimeoutMs = (uint32_t)uRecvTimeoutMs;
+        mbedtls_ssl_conf_read_timeout(&(pxNet->xConf), pxNet->uRecvTimeoutMs);
+    }
+
+    return res;
+}
+
+static int prvMbedtlsSetSendTimeout(void *pCtx, unsigned int uSendTimeoutMs)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+    int fd = 0;
+    struct timeval tv = {0};
+
+    if (pxNet == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        pxNet->uSendTimeoutMs = (uint32_t)uSendTimeoutMs;
+        fd = pxNet->xFd.fd;
+        tv.tv_sec = uSendTimeoutMs / 1000;
+        tv.tv_usec = (uSendTimeoutMs % 1000) * 1000;
+
+        if (fd < 0)
+        {
+            /* Do nothing when connection hasn't established. */
+        }
+        else if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof(tv)) != 0)
+        {
+            res = KVS_ERROR_NETIO_UNABLE_TO_SET_SEND_TIMEOUT;
+        }
+        else
+        {
+            /* nop */
+        }
+    }
+
+    return res;
+}
+
+static int prvSetTlsMaxFragmentLength(NetIoMbedtls_t *pxNet, unsigned int uMaxFragLen)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pxNet == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    else if (uMaxFragLen == 0)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+    }
+    else if (uMaxFragLen == 512)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_512;
+    }
+    else if (uMaxFragLen == 1024)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+    }
+    else if (uMaxFragLen == 2048)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+    }
+    else if (uMaxFragLen == 4096)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+    }
+    else
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid max fragment length %u", uMaxFragLen);
+    }
+#else
+    else if (uMaxFragLen != 0)
+    {
+        /* Connections still work with full size records, so it's not an error. */
+        LogInfo("Max fragment length is not supported, enable MBEDTLS_SSL_MAX_FRAGMENT_LENGTH");
+    }
+    else
+    {
+        /* nop */
+    }
+#endif
+
+    return res;
+}
+
+static int prvMbedtlsSetOption(void *pCtx, NetIoOption_t xOption, unsigned int uValue)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    if (pxNet == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (xOption == NETIO_OPTION_TLS_MAX_FRAG_LEN)
+    {
+        res = prvSetTlsMaxFragmentLength(pxNet, uValue);
+    }
+    else
+    {
+        if (xOption == NETIO_OPTION_TCP_NODELAY)
+        {
+            pxNet->bTcpNoDelay = (uValue != 0);
+        }
+        else if (xOption == NETIO_OPTION_SEND_BUF_SIZE)
+        {
+            pxNet->uSendBufSize = (uint32_t)uValue;
+        }
+        else if (xOption == NETIO_OPTION_NOT_SENT_LOWAT)
+        {
+            pxNet->uNotSentLowat = (uint32_t)uValue;
+        }
+        else if (xOption == NETIO_OPTION_KEEPALIVE_IDLE_SEC)
+        {
+            pxNet->uKeepAliveIdleSec = (uint32_t)uValue;
+        }
+        else if (xOption == NETIO_OPTION_KEEPALIVE_INTERVAL_SEC)
+        {
+            pxNet->uKeepAliveIntervalSec = (uint32_t)uValue;
+        }
+        else if (xOption == NETIO_OPTION_KEEPALIVE_COUNT)
+        {
+            pxNet->uKeepAliveCount = (uint32_t)uValue;
+        }
+        else if (xOption == NETIO_OPTION_BIND_IF_INDEX)
+        {
+            pxNet->uBindIfIndex = (uint32_t)uValue;
+        }
+        else
+        {
+            res = KVS_ERROR_INVALID_ARGUMENT;
+            LogError("Unknown option %d", (int)xOption);
+        }
+
+        if (res == KVS_ERRNO_NONE)
+        {
+            prvApplySocketOptions(pxNet);
+        }
+    }
+
+    return res;
+}
+
+#if defined(KVS_USE_KTLS)
+static void *prvKtlsCreate(void)
+{
+    NetIoMbedtls_t *pxNet = NULL;
+
+    if ((pxNet = (NetIoMbedtls_t *)prvMbedtlsCreate()) != NULL)
+    {
+        pxNet->bKtls = true;
+    }
+
+    return pxNet;
+}
+
+static int prvKtlsWrite(NetIoMbedtls_t *pxNet, const unsigned char *pBuffer, size_t uBytesToSend, int xFlags)
+{
+    int res = KVS_ERRNO_NONE;
+    ssize_t n = 0;
+    size_t uBytesRemaining = uBytesToSend;
+
+    /* The kernel splits the data into records and encrypts them. */
+    while (uBytesRemaining > 0)
+    {
+        if ((n = send(pxNet->xFd.fd, pBuffer, uBytesRemaining, xFlags)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            res = KVS_GENERATE_MBEDTLS_ERROR(MBEDTLS_ERR_NET_SEND_FAILED);
+            LogError("kTLS send error (errno:%d)", errno);
+            break;
+        }
+        uBytesRemaining -= (size_t)n;
+        pBuffer += n;
+    }
+
+    pxNet->uKtlsUnflushedLen += uBytesToSend - uBytesRemaining;
+    if ((xFlags & MSG_MORE) == 0)
+    {
+        pxNet->uTlsRecordsSent += (pxNet->uKtlsUnflushedLen + KTLS_MAX_RECORD_LEN - 1) / KTLS_MAX_RECORD_LEN;
+        pxNet->uKtlsUnflushedLen = 0;
+    }
+
+    return res;
+}
+
+static int prvKtlsSend(void *pCtx, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+
+    return (pxNet != NULL && pxNet->bKtlsTx) ? prvKtlsWrite(pxNet, pBuffer, uBytesToSend, 0) : prvMbedtlsSend(pCtx, pBuffer, uBytesToSend);
+}
+
+static int prvKtlsSendv(void *pCtx, const NetIoVec_t *pxIov, size_t uIovCnt)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+    size_t i = 0;
+    size_t uLast = 0;
+
+    if (pxNet == NULL || pxIov == NULL || !pxNet->bKtlsTx)
+    {
+        res = prvMbedtlsSendv(pCtx, pxIov, uIovCnt);
+    }
+    else
+    {
+        for (i = 0; i < uIovCnt; i++)
+        {
+            if (pxIov[i].pBase != NULL && pxIov[i].uLen > 0)
+            {
+                uLast = i;
+            }
+        }
+
+        /* Segments are sent without copy, and MSG_MORE lets the kernel pack them into full records. */
+        for (i = 0; i < uIovCnt && res == KVS_ERRNO_NONE; i++)
+        {
+            if (pxIov[i].pBase != NULL && pxIov[i].uLen > 0)
+            {
+                res = prvKtlsWrite(pxNet, pxIov[i].pBase, pxIov[i].uLen, (i < uLast) ? MSG_MORE : 0);
+            }
+        }
+    }
+
+    return res;
+}
+
+static void prvKtlsDisconnect(void *pCtx)
+{
+    NetIoMbedtls_t *pxNet = (NetIoMbedtls_t *)pCtx;
+    unsigned char pAlert[2] = {MBEDTLS_SSL_ALERT_LEVEL_WARNING, MBEDTLS_SSL_ALERT_MSG_CLOSE_NOTIFY};
+    unsigned char pCmsgBuf[CMSG_SPACE(sizeof(unsigned char))] = {0};
+    struct iovec xIov = {0};
+    struct msghdr xMsg = {0};
+    struct cmsghdr *pxCmsg = NULL;
+
+    if (pxNet == NULL || !pxNet->bKtlsTx)
+    {
+        prvMbedtlsDisconnect(pCtx);
+    }
+    else
+    {
+        /* mbedTLS doesn't know the record sequence number any more, so the kernel sends the close_notify alert. */
+        xIov.iov_base = pAlert;
+        xIov.iov_len = sizeof(pAlert);
+        xMsg.msg_iov = &xIov;
+        xMsg.msg_iovlen = 1;
+        xMsg.msg_control = pCmsgBuf;
+        xMsg.msg_controllen = sizeof(pCmsgBuf);
+
+        pxCmsg = CMSG_FIRSTHDR(&xMsg);
+        pxCmsg->cmsg_level = SOL_TLS;
+        pxCmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+        pxCmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+        *CMSG_DATA(pxCmsg) = KTLS_RECORD_TYPE_ALERT;
+
+        if (sendmsg(pxNet->xFd.fd, &xMsg, 0) < 0)
+        {
+            LogInfo("Unable to send close_notify (errno:%d)", errno);
+        }
+    }
+}
+
+/* Same as the mbedTLS transport, except that sent data is encrypted by the kernel once the handshake is done. */
+static const NetIoTransport_t gxKtlsTransport = {
+    .create = prvKtlsCreate,
+    .terminate = prvMbedtlsTerminate,
+    .connect = prvMbedtlsConnect,
+    .connectStart = prvMbedtlsConnectStart,
+    .connectPoll = prvMbedtlsConnectPoll,
+    .disconnect = prvKtlsDisconnect,
+    .send = prvKtlsSend,
+    .sendv = prvKtlsSendv,
+    .recv = prvMbedtlsRecv,
+    .isDataAvailable = prvMbedtlsIsDataAvailable,
+    .getSocket = prvMbedtlsGetSocket,
+    .getStats = prvMbedtlsGetStats,
+    .setRecvTimeout = prvMbedtlsSetRecvTimeout,
+    .setSendTimeout = prvMbedtlsSetSendTimeout,
+    .setOption = prvMbedtlsSetOption,
+};
+#endif /* KVS_USE_KTLS */
+
+static const NetIoTransport_t gxMbedtlsTransport = {
+    .create = prvMbedtlsCreate,
+    .terminate = prvMbedtlsTerminate,
+    .connect = prvMbedtlsConnect,
+    .connectStart = prvMbedtlsConnectStart,
+    .connectPoll = prvMbedtlsConnectPoll,
+    .disconnect = prvMbedtlsDisconnect,
+    .send = prvMbedtlsSend,
+    .sendv = prvMbedtlsSendv,
+    .recv = prvMbedtlsRecv,
+    .isDataAvailable = prvMbedtlsIsDataAvailable,
+    .getSocket = prvMbedtlsGetSocket,
+    .getStats = prvMbedtlsGetStats,
+    .setRecvTimeout = prvMbedtlsSetRecvTimeout,
+    .setSendTimeout = prvMbedtlsSetSendTimeout,
+    .setOption = prvMbedtlsSetOption,
+};
+
+const NetIoTransport_t *NetIo_getMbedtlsTransport(void)
+{
+    return &gxMbedtlsTransport;
+}
+
+const NetIoTransport_t *NetIo_getKtlsTransport(void)
+{
+#if defined(KVS_USE_KTLS)
+    return &gxKtlsTransport;
+#else
+    return NULL;
+#endif
+}
+
+#if NETIO_DNS_CACHE_SIZE > 0
+static void prvResolveRoutine(void *pArg)
+{
+    NetIoResolveTask_t *pxTask = (NetIoResolveTask_t *)pArg;
+    struct addrinfo *pxAddrList = NULL;
+
+    if ((pxTask->res = prvGetAddrInfo(pxTask->pcHost, pxTask->pcPort, &pxAddrList)) == KVS_ERRNO_NONE)
+    {
+        freeaddrinfo(pxAddrList);
+    }
+}
+
+static int prvResolveInParallel(NetIoResolveTask_t *pxTasks, size_t uTaskCount)
+{
+    int res = KVS_ERRNO_NONE;
+    char pcKey[NETIO_SESSION_KEY_MAX_LEN];
+    size_t i = 0;
+
+    /* Hosts that are cached are skipped. The first host, and the ones that can't get a thread, are resolved in this
+     * thread while the others run. */
+    for (i = 0; i < uTaskCount; i++)
+    {
+        snprintf(pcKey, sizeof(pcKey), "%s:%s", pxTasks[i].pcHost, pxTasks[i].pcPort);
+        if (prvDnsCacheHas(pcKey))
+        {
+            pxTasks[i].pcHost = NULL;
+        }
+        else if (i > 0)
+        {
+            pxTasks[i].xThread = kvsThreadCreate(prvResolveRoutine, &(pxTasks[i]), NETIO_DNS_RESOLVE_STACK_SIZE, -1);
+        }
+    }
+
+    for (i = 0; i < uTaskCount; i++)
+    {
+        if (pxTasks[i].pcHost != NULL && pxTasks[i].xThread == NULL)
+        {
+            prvResolveRoutine(&(pxTasks[i]));
+        }
+    }
+
+    for (i = 0; i < uTaskCount; i++)
+    {
+        if (pxTasks[i].xThread != NULL)
+        {
+            kvsThreadJoin(pxTasks[i].xThread);
+        }
+        if (res == KVS_ERRNO_NONE)
+        {
+            res = pxTasks[i].res;
+        }
+    }
+
+    return res;
+}
+#endif /* NETIO_DNS_CACHE_SIZE > 0 */
+
+int NetIo_prefetchHosts(const char *const *ppcHosts, size_t uHostCount, const char *pcPort)
+{
+    int res = KVS_ERRNO_NONE;
+#if NETIO_DNS_CACHE_SIZE > 0
+    NetIoResolveTask_t *pxTasks = NULL;
+    size_t uTaskCount = 0;
+    size_t i = 0;
+#endif
+
+    if ((ppcHosts == NULL && uHostCount > 0) || pcPort == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+#if NETIO_DNS_CACHE_SIZE > 0
+    else if (uHostCount == 0)
+    {
+        /* nop */
+    }
+    else if ((pxTasks = (NetIoResolveTask_t *)kvsMalloc(sizeof(NetIoResolveTask_t) * uHostCount)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+    }
+    else
+    {
+        memset(pxTasks, 0, sizeof(NetIoResolveTask_t) * uHostCount);
+        for (i = 0; i < uHostCount; i++)
+        {
+            if (ppcHosts[i] != NULL)
+            {
+                pxTasks[uTaskCount].pcHost = ppcHosts[i];
+                pxTasks[uTaskCount].pcPort = pcPort;
+                uTaskCount++;
+            }
+        }
+
+        res = prvResolveInParallel(pxTasks, uTaskCount);
+        kvsFree(pxTasks);
+    }
+#endif /* NETIO_DNS_CACHE_SIZE > 0 */
+
+    return res;
+}
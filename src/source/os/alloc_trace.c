@@ -0,0 +1,382 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Thirdparty headers */
+#include "azure_c_shared_utility/xlogging.h"
+
+/* Public headers */
+#include "kvs/alloc_trace.h"
+#include "kvs/errors.h"
+
+/* Internal headers */
+#define KVS_ALLOC_TRACE_IMPL
+#include "os/allocator.h"
+
+static const char *const pcComponentNames[KVS_ALLOC_COMPONENT_COUNT] = {"stream", "netio", "rest", "credential", "mkv", "app", "other"};
+
+const char *kvsAllocTraceComponentName(KvsAllocComponent_t xComponent)
+{
+    return ((unsigned)xComponent < KVS_ALLOC_COMPONENT_COUNT) ? pcComponentNames[xComponent] : "unknown";
+}
+
+#ifdef KVS_USE_ALLOC_TRACE
+
+#if KVS_ALLOC_TRACE_MAX_SITES > UINT16_MAX
+#error "KVS_ALLOC_TRACE_MAX_SITES should fit in the 16 bits of the block header"
+#endif
+
+/* Every traced block is prefixed by this header. The union keeps the alignment that malloc returns. */
+typedef union AllocTraceHdr
+{
+    struct
+    {
+        size_t uSize;
+        uint16_t uSite;
+        uint16_t uComponent;
+    } x;
+    long double ld;
+} AllocTraceHdr_t;
+
+typedef struct ComponentPath
+{
+    const char *pcPath;
+    KvsAllocComponent_t xComponent;
+} ComponentPath_t;
+
+/* The first match wins, so a sub-directory goes before its parent. */
+static const ComponentPath_t pxComponentPaths[] = {
+    {"source/stream/", KVS_ALLOC_COMPONENT_STREAM},
+    {"source/net/netio", KVS_ALLOC_COMPONENT_NETIO},
+    {"source/net/", KVS_ALLOC_COMPONENT_REST},
+    {"source/restful/iot/", KVS_ALLOC_COMPONENT_CREDENTIAL},
+    {"source/restful/", KVS_ALLOC_COMPONENT_REST},
+    {"source/mkv/", KVS_ALLOC_COMPONENT_MKV},
+    {"source/app/", KVS_ALLOC_COMPONENT_APP},
+};
+
+static pthread_mutex_t xTraceMutex = PTHREAD_MUTEX_INITIALIZER;
+static KvsAllocStats_t xTraceStats = {0};
+static KvsAllocSite_t pxTraceSites[KVS_ALLOC_TRACE_MAX_SITES] = {0};
+static KvsAllocFootprint_t xTraceFootprint = {0};
+
+static KvsAllocComponent_t prvComponentOf(const char *pcFile)
+{
+    KvsAllocComponent_t xComponent = KVS_ALLOC_COMPONENT_OTHER;
+    size_t i = 0;
+
+    for (i = 0; i < sizeof(pxComponentPaths) / sizeof(pxComponentPaths[0]); i++)
+    {
+        if (strstr(pcFile, pxComponentPaths[i].pcPath) != NULL)
+        {
+            xComponent = pxComponentPaths[i].xComponent;
+            break;
+        }
+    }
+
+    return xComponent;
+}
+
+/* It should be called with xTraceMutex locked. */
+static size_t prvSiteOf(const char *pcFile, int line, KvsAllocComponent_t *pxComponent)
+{
+    size_t uSite = 0;
+
+    /* Sites are compared by the address of __FILE__, since compilers merge the identical literals of a file. */
+    while (uSite < xTraceStats.uSites && !(pxTraceSites[uSite].pcFile == pcFile && pxTraceSites[uSite].line == line))
+    {
+        uSite++;
+    }
+
+    if (uSite < xTraceStats.uSites)
+    {
+        *pxComponent = pxTraceSites[uSite].xComponent;
+    }
+    else if (uSite < KVS_ALLOC_TRACE_MAX_SITES - 1)
+    {
+        pxTraceSites[uSite].pcFile = pcFile;
+        pxTraceSites[uSite].line = line;
+        pxTraceSites[uSite].xComponent = prvComponentOf(pcFile);
+        *pxComponent = pxTraceSites[uSite].xComponent;
+        xTraceStats.uSites++;
+    }
+    else
+    {
+        /* The last site sums up all call sites that don't fit, and it never matches a call site. Its blocks still keep
+         * their own components. */
+        uSite = KVS_ALLOC_TRACE_MAX_SITES - 1;
+        pxTraceSites[uSite].pcFile = NULL;
+        pxTraceSites[uSite].line = 0;
+        pxTraceSites[uSite].xComponent = KVS_ALLOC_COMPONENT_OTHER;
+        *pxComponent = prvComponentOf(pcFile);
+        xTraceStats.uSites = KVS_ALLOC_TRACE_MAX_SITES;
+    }
+
+    return uSite;
+}
+
+static void *prvTraceAlloc(AllocTraceHdr_t *pxHdr, size_t bytes, const char *pcFile, int line)
+{
+    KvsAllocSite_t *pxSite = NULL;
+    KvsAllocComponent_t xComponent = KVS_ALLOC_COMPONENT_OTHER;
+    void *ptr = NULL;
+
+    if (pxHdr != NULL)
+    {
+        pthread_mutex_lock(&xTraceMutex);
+        pxHdr->x.uSize = bytes;
+        pxHdr->x.uSite = (uint16_t)prvSiteOf(pcFile, line, &xComponent);
+        pxHdr->x.uComponent = (uint16_t)xComponent;
+        pxSite = &(pxTraceSites[pxHdr->x.uSite]);
+
+        pxSite->uAllocs++;
+        pxSite->uBytes += bytes;
+        pxSite->uLiveBytes += bytes;
+        if (pxSite->uLiveBytes > pxSite->uPeakLiveBytes)
+        {
+            pxSite->uPeakLiveBytes = pxSite->uLiveBytes;
+        }
+
+        xTraceStats.uAllocs++;
+        xTraceStats.uLiveBlocks++;
+        xTraceStats.uLiveBytes += bytes;
+        if (xTraceStats.uLiveBytes > xTraceStats.uPeakLiveBytes)
+        {
+            xTraceStats.uPeakLiveBytes = xTraceStats.uLiveBytes;
+        }
+
+        xTraceFootprint.uLiveBytes[xComponent] += bytes;
+        if (xTraceFootprint.uLiveBytes[xComponent] > xTraceFootprint.uPeakLiveBytes[xComponent])
+        {
+            xTraceFootprint.uPeakLiveBytes[xComponent] = xTraceFootprint.uLiveBytes[xComponent];
+        }
+        pthread_mutex_unlock(&xTraceMutex);
+
+        ptr = pxHdr + 1;
+    }
+
+    return ptr;
+}
+
+static void prvTraceFree(AllocTraceHdr_t *pxHdr)
+{
+    KvsAllocSite_t *pxSite = NULL;
+
+    pthread_mutex_lock(&xTraceMutex);
+    pxSite = &(pxTraceSites[pxHdr->x.uSite]);
+    pxSite->uFrees++;
+    pxSite->uLiveBytes -= pxHdr->x.uSize;
+
+    xTraceStats.uFrees++;
+    xTraceStats.uLiveBlocks--;
+    xTraceStats.uLiveBytes -= pxHdr->x.uSize;
+
+    xTraceFootprint.uLiveBytes[pxHdr->x.uComponent] -= pxHdr->x.uSize;
+    pthread_mutex_unlock(&xTraceMutex);
+}
+
+void *kvsTraceMalloc(size_t bytes, const char *pcFile, int line)
+{
+    void *ptr = NULL;
+
+    if (bytes <= SIZE_MAX - sizeof(AllocTraceHdr_t))
+    {
+        ptr = prvTraceAlloc((AllocTraceHdr_t *)kvsMalloc(sizeof(AllocTraceHdr_t) + bytes), bytes, pcFile, line);
+    }
+
+    return ptr;
+}
+
+#ifdef KVS_USE_PORT_ALLOC_CLASS
+void *kvsTraceMallocClass(size_t bytes, KvsAllocClass_t xClass, const char *pcFile, int line)
+{
+    void *ptr = NULL;
+
+    if (bytes <= SIZE_MAX - sizeof(AllocTraceHdr_t))
+    {
+        ptr = prvTraceAlloc((AllocTraceHdr_t *)kvsMallocClass(sizeof(AllocTraceHdr_t) + bytes, xClass), bytes, pcFile, line);
+    }
+
+    return ptr;
+}
+#endif /* KVS_USE_PORT_ALLOC_CLASS */
+
+void *kvsTraceRealloc(void *ptr, size_t bytes, const char *pcFile, int line)
+{
+    AllocTraceHdr_t *pxHdr = NULL;
+    AllocTraceHdr_t xOldHdr;
+    void *pNewPtr = NULL;
+
+    if (ptr == NULL)
+    {
+        pNewPtr = kvsTraceMalloc(bytes, pcFile, line);
+    }
+    else if (bytes == 0)
+    {
+        kvsTraceFree(ptr);
+    }
+    else if (bytes <= SIZE_MAX - sizeof(AllocTraceHdr_t))
+    {
+        xOldHdr = *((AllocTraceHdr_t *)ptr - 1);
+        if ((pxHdr = (AllocTraceHdr_t *)kvsRealloc((AllocTraceHdr_t *)ptr - 1, sizeof(AllocTraceHdr_t) + bytes)) != NULL)
+        {
+            /* The new block is counted to the call site of the re-allocation. */
+            prvTraceFree(&xOldHdr);
+            pNewPtr = prvTraceAlloc(pxHdr, bytes, pcFile, line);
+        }
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return pNewPtr;
+}
+
+void *kvsTraceCalloc(size_t num, size_t bytes, const char *pcFile, int line)
+{
+    void *ptr = NULL;
+
+    if (bytes == 0 || num <= (SIZE_MAX - sizeof(AllocTraceHdr_t)) / bytes)
+    {
+        ptr = prvTraceAlloc((AllocTraceHdr_t *)kvsCalloc(1, sizeof(AllocTraceHdr_t) + num * bytes), num * bytes, pcFile, line);
+    }
+
+    return ptr;
+}
+
+void kvsTraceFree(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        prvTraceFree((AllocTraceHdr_t *)ptr - 1);
+        kvsFree((AllocTraceHdr_t *)ptr - 1);
+    }
+}
+
+int kvsAllocTraceGetStats(KvsAllocStats_t *pxStats)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pxStats == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        pthread_mutex_lock(&xTraceMutex);
+        *pxStats = xTraceStats;
+        pthread_mutex_unlock(&xTraceMutex);
+    }
+
+    return res;
+}
+
+int kvsAllocTraceGetFootprint(KvsAllocFootprint_t *pxFootprint)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pxFootprint == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        pthread_mutex_lock(&xTraceMutex);
+        *pxFootprint = xTraceFootprint;
+        pthread_mutex_unlock(&xTraceMutex);
+    }
+
+    return res;
+}
+
+int kvsAllocTraceGetSite(size_t uIdx, KvsAllocSite_t *pxSite)
+{
+    int res = KVS_ERRNO_NONE;
+
+    pthread_mutex_lock(&xTraceMutex);
+    if (pxSite == NULL || uIdx >= xTraceStats.uSites)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        *pxSite = pxTraceSites[uIdx];
+    }
+    pthread_mutex_unlock(&xTraceMutex);
+
+    return res;
+}
+
+void kvsAllocTraceDump(void)
+{
+    KvsAllocStats_t xStats = {0};
+    KvsAllocFootprint_t xFootprint = {0};
+    KvsAllocSite_t xSite = {0};
+    size_t i = 0;
+
+    /* Not every libc of embedded targets supports %zu, so sizes are printed as unsigned long. */
+    kvsAllocTraceGetStats(&xStats);
+    LogInfo("Allocations: %lu, frees: %lu, live: %lu blocks %lu bytes, peak: %lu bytes", (unsigned long)xStats.uAllocs, (unsigned long)xStats.uFrees,
+            (unsigned long)xStats.uLiveBlocks, (unsigned long)xStats.uLiveBytes, (unsigned long)xStats.uPeakLiveBytes);
+
+    kvsAllocTraceGetFootprint(&xFootprint);
+    for (i = 0; i < KVS_ALLOC_COMPONENT_COUNT; i++)
+    {
+        LogInfo("  [%s] live: %lu, peak: %lu", kvsAllocTraceComponentName((KvsAllocComponent_t)i), (unsigned long)xFootprint.uLiveBytes[i],
+                (unsigned long)xFootprint.uPeakLiveBytes[i]);
+    }
+
+    for (i = 0; kvsAllocTraceGetSite(i, &xSite) == KVS_ERRNO_NONE; i++)
+    {
+        LogInfo("  %s:%d [%s] allocs: %lu, frees: %lu, bytes: %lu, live: %lu, peak: %lu", (xSite.pcFile != NULL) ? xSite.pcFile : "(other)", xSite.line, kvsAllocTraceComponentName(xSite.xComponent),
+                (unsigned long)xSite.uAllocs, (unsigned long)xSite.uFrees, (unsigned long)xSite.uBytes, (unsigned long)xSite.uLiveBytes,
+                (unsigned long)xSite.uPeakLiveBytes);
+    }
+}
+
+#else
+
+int kvsAllocTraceGetStats(KvsAllocStats_t *pxStats)
+{
+    (void)pxStats;
+
+    return KVS_ERROR_ALLOC_TRACE_NOT_ENABLED;
+}
+
+int kvsAllocTraceGetSite(size_t uIdx, KvsAllocSite_t *pxSite)
+{
+    (void)uIdx;
+    (void)pxSite;
+
+    return KVS_ERROR_ALLOC_TRACE_NOT_ENABLED;
+}
+
+int kvsAllocTraceGetFootprint(KvsAllocFootprint_t *pxFootprint)
+{
+    (void)pxFootprint;
+
+    return KVS_ERROR_ALLOC_TRACE_NOT_ENABLED;
+}
+
+void kvsAllocTraceDump(void)
+{
+    LogInfo("Allocation trace is not enabled");
+}
+
+#endif /* KVS_USE_ALLOC_TRACE */
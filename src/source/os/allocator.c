@@ -13,32 +13,318 @@
  * permissions and limitations under the License.
  */
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /* Public headers */
+#include "kvs/errors.h"
+#include "kvs/kvs_config.h"
+#include "kvs/mem_budget.h"
 #include "kvs/pool_allocator.h"
 
 /* Internal headers */
+#define KVS_ALLOC_TRACE_IMPL
 #include "allocator.h"
 
+typedef void *(*MallocFunc_t)(size_t bytes);
+typedef void *(*ReallocFunc_t)(void *ptr, size_t bytes);
+typedef void *(*CallocFunc_t)(size_t num, size_t bytes);
+typedef void (*FreeFunc_t)(void *ptr);
+
+#if KVS_CONFIG_MEM_BUDGET
+
+#ifdef KVS_USE_PORT_ALLOC_CLASS
+#error "The memory budget can't count the allocations of kvsMallocClass() that the port provides"
+#endif
+
+/* Every block is prefixed by its size, so it can be uncharged when it's freed. The union keeps the alignment that
+ * malloc returns. */
+typedef union MemBudgetHdr
+{
+    size_t uSize;
+    long double ld;
+} MemBudgetHdr_t;
+
+/* Counters are updated by any thread that allocates, so they're word sized atomics that 32-bit targets support. */
+#define BUDGET_LOAD(x)          __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define BUDGET_STORE(x, v)      __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define BUDGET_ADD(x, v)        __atomic_add_fetch(&(x), (v), __ATOMIC_RELAXED)
+#define BUDGET_SUB(x, v)        __atomic_sub_fetch(&(x), (v), __ATOMIC_RELAXED)
+
+static size_t uBudgetLimit = 0;
+static size_t uBudgetReserved = 0;
+static size_t uUsedBytes = 0;
+static size_t uMediaBytes = 0;
+static size_t uPeakUsedBytes = 0;
+static size_t uAllocRejects = 0;
+static size_t uMediaRejects = 0;
+
+/**
+ * Charge bytes to the budget if they leave at least uKeep bytes of it unused.
+ */
+static bool prvBudgetCharge(size_t bytes, size_t uKeep)
+{
+    size_t uLimit = BUDGET_LOAD(uBudgetLimit);
+    size_t uUsed = BUDGET_LOAD(uUsedBytes);
+    size_t uPeak = 0;
+    bool bFits = false;
+
+    do
+    {
+        bFits = (uLimit == 0 || (uKeep <= uLimit && bytes <= uLimit - uKeep && uUsed <= uLimit - uKeep - bytes));
+    } while (bFits && !__atomic_compare_exchange_n(&uUsedBytes, &uUsed, uUsed + bytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if (bFits)
+    {
+        uPeak = BUDGET_LOAD(uPeakUsedBytes);
+        while (uUsed + bytes > uPeak && !__atomic_compare_exchange_n(&uPeakUsedBytes, &uPeak, uUsed + bytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            /* uPeak is reloaded by the failed exchange. */
+        }
+    }
+
+    return bFits;
+}
+
+static bool prvBudgetChargeAlloc(size_t bytes)
+{
+    bool bCharged = prvBudgetCharge(bytes, 0);
+
+    if (!bCharged)
+    {
+        BUDGET_ADD(uAllocRejects, 1);
+    }
+
+    return bCharged;
+}
+
+static void *prvBudgetAttach(MemBudgetHdr_t *pxHdr, size_t bytes)
+{
+    void *ptr = NULL;
+
+    if (pxHdr == NULL)
+    {
+        BUDGET_SUB(uUsedBytes, bytes);
+    }
+    else
+    {
+        pxHdr->uSize = bytes;
+        ptr = pxHdr + 1;
+    }
+
+    return ptr;
+}
+
+static void *prvMalloc(MallocFunc_t pfMalloc, size_t bytes)
+{
+    void *ptr = NULL;
+
+    if (bytes <= SIZE_MAX - sizeof(MemBudgetHdr_t) && prvBudgetChargeAlloc(bytes))
+    {
+        ptr = prvBudgetAttach((MemBudgetHdr_t *)pfMalloc(sizeof(MemBudgetHdr_t) + bytes), bytes);
+    }
+
+    return ptr;
+}
+
+static void prvFree(FreeFunc_t pfFree, void *ptr)
+{
+    MemBudgetHdr_t *pxHdr = NULL;
+
+    if (ptr != NULL)
+    {
+        pxHdr = (MemBudgetHdr_t *)ptr - 1;
+        BUDGET_SUB(uUsedBytes, pxHdr->uSize);
+        pfFree(pxHdr);
+    }
+}
+
+static void *prvRealloc(ReallocFunc_t pfRealloc, FreeFunc_t pfFree, void *ptr, size_t bytes)
+{
+    MemBudgetHdr_t *pxHdr = NULL;
+    size_t uOldSize = 0;
+    void *pNewPtr = NULL;
+
+    if (ptr == NULL)
+    {
+        if (bytes <= SIZE_MAX - sizeof(MemBudgetHdr_t) && prvBudgetChargeAlloc(bytes))
+        {
+            pNewPtr = prvBudgetAttach((MemBudgetHdr_t *)pfRealloc(NULL, sizeof(MemBudgetHdr_t) + bytes), bytes);
+        }
+    }
+    else if (bytes == 0)
+    {
+        prvFree(pfFree, ptr);
+    }
+    else if (bytes <= SIZE_MAX - sizeof(MemBudgetHdr_t))
+    {
+        uOldSize = ((MemBudgetHdr_t *)ptr - 1)->uSize;
+
+        /* Only the growth is charged, so a block can always shrink. */
+        if (bytes <= uOldSize || prvBudgetChargeAlloc(bytes - uOldSize))
+        {
+            if ((pxHdr = (MemBudgetHdr_t *)pfRealloc((MemBudgetHdr_t *)ptr - 1, sizeof(MemBudgetHdr_t) + bytes)) == NULL)
+            {
+                if (bytes > uOldSize)
+                {
+                    BUDGET_SUB(uUsedBytes, bytes - uOldSize);
+                }
+            }
+            else
+            {
+                if (bytes < uOldSize)
+                {
+                    BUDGET_SUB(uUsedBytes, uOldSize - bytes);
+                }
+                pxHdr->uSize = bytes;
+                pNewPtr = pxHdr + 1;
+            }
+        }
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return pNewPtr;
+}
+
+static void *prvCalloc(CallocFunc_t pfCalloc, size_t num, size_t bytes)
+{
+    void *ptr = NULL;
+
+    if ((bytes == 0 || num <= (SIZE_MAX - sizeof(MemBudgetHdr_t)) / bytes) && prvBudgetChargeAlloc(num * bytes))
+    {
+        ptr = prvBudgetAttach((MemBudgetHdr_t *)pfCalloc(1, sizeof(MemBudgetHdr_t) + num * bytes), num * bytes);
+    }
+
+    return ptr;
+}
+
+int kvsMemBudgetSet(size_t uLimit, size_t uReserved)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (uLimit > 0 && uReserved >= uLimit)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        /* The reserve is set first, so a charge never sees a new limit with an old reserve that is larger than it. */
+        BUDGET_STORE(uBudgetReserved, uReserved);
+        BUDGET_STORE(uBudgetLimit, uLimit);
+    }
+
+    return res;
+}
+
+int kvsMemBudgetGetStats(KvsMemBudgetStats_t *pxStats)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pxStats == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        pxStats->uLimit = BUDGET_LOAD(uBudgetLimit);
+        pxStats->uReserved = BUDGET_LOAD(uBudgetReserved);
+        pxStats->uUsedBytes = BUDGET_LOAD(uUsedBytes);
+        pxStats->uMediaBytes = BUDGET_LOAD(uMediaBytes);
+        pxStats->uPeakUsedBytes = BUDGET_LOAD(uPeakUsedBytes);
+        pxStats->uAllocRejects = BUDGET_LOAD(uAllocRejects);
+        pxStats->uMediaRejects = BUDGET_LOAD(uMediaRejects);
+    }
+
+    return res;
+}
+
+bool kvsMemBudgetChargeMedia(size_t bytes)
+{
+    bool bCharged = prvBudgetCharge(bytes, BUDGET_LOAD(uBudgetReserved));
+
+    if (bCharged)
+    {
+        BUDGET_ADD(uMediaBytes, bytes);
+    }
+    else
+    {
+        BUDGET_ADD(uMediaRejects, 1);
+    }
+
+    return bCharged;
+}
+
+void kvsMemBudgetReleaseMedia(size_t bytes)
+{
+    BUDGET_SUB(uMediaBytes, bytes);
+    BUDGET_SUB(uUsedBytes, bytes);
+}
+
+#else
+
+static void *prvMalloc(MallocFunc_t pfMalloc, size_t bytes)
+{
+    return pfMalloc(bytes);
+}
+
+static void prvFree(FreeFunc_t pfFree, void *ptr)
+{
+    pfFree(ptr);
+}
+
+static void *prvRealloc(ReallocFunc_t pfRealloc, FreeFunc_t pfFree, void *ptr, size_t bytes)
+{
+    return pfRealloc(ptr, bytes);
+}
+
+static void *prvCalloc(CallocFunc_t pfCalloc, size_t num, size_t bytes)
+{
+    return pfCalloc(num, bytes);
+}
+
+int kvsMemBudgetSet(size_t uLimit, size_t uReserved)
+{
+    return KVS_ERROR_FEATURE_NOT_ENABLED;
+}
+
+int kvsMemBudgetGetStats(KvsMemBudgetStats_t *pxStats)
+{
+    return KVS_ERROR_FEATURE_NOT_ENABLED;
+}
+
+bool kvsMemBudgetChargeMedia(size_t bytes)
+{
+    return true;
+}
+
+void kvsMemBudgetReleaseMedia(size_t bytes)
+{
+}
+
+#endif /* KVS_CONFIG_MEM_BUDGET */
+
 void *kvsMalloc(size_t bytes)
 {
-    return malloc(bytes);
+    return prvMalloc(malloc, bytes);
 }
 
 void *kvsRealloc(void *ptr, size_t bytes)
 {
-    return realloc(ptr, bytes);
+    return prvRealloc(realloc, free, ptr, bytes);
 }
 
 void *kvsCalloc(size_t num, size_t bytes)
 {
-    return calloc(num, bytes);
+    return prvCalloc(calloc, num, bytes);
 }
 
 void kvsFree(void *ptr)
 {
-    free(ptr);
+    prvFree(free, ptr);
 }
 
 /**
@@ -49,7 +335,7 @@ void kvsFree(void *ptr)
  */
 void *__wrap_kvsMalloc(size_t bytes)
 {
-    return poolAllocatorMalloc(bytes);
+    return prvMalloc(poolAllocatorMalloc, bytes);
 }
 
 /**
@@ -61,7 +347,7 @@ void *__wrap_kvsMalloc(size_t bytes)
  */
 void *__wrap_kvsRealloc(void *ptr, size_t bytes)
 {
-    return poolAllocatorRealloc(ptr, bytes);
+    return prvRealloc(poolAllocatorRealloc, poolAllocatorFree, ptr, bytes);
 }
 
 /**
@@ -73,7 +359,7 @@ void *__wrap_kvsRealloc(void *ptr, size_t bytes)
  */
 void *__wrap_kvsCalloc(size_t num, size_t bytes)
 {
-    return poolAllocatorCalloc(num, bytes);
+    return prvCalloc(poolAllocatorCalloc, num, bytes);
 }
 
 /**
@@ -83,5 +369,5 @@ void *__wrap_kvsCalloc(size_t num, size_t bytes)
  */
 void __wrap_kvsFree(void *ptr)
 {
-    poolAllocatorFree(ptr);
+    prvFree(poolAllocatorFree, ptr);
 }
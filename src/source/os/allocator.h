@@ -16,6 +16,8 @@
 #ifndef ALLOCATOR_H
 #define ALLOCATOR_H
 
+#include "kvs/port.h"
+
 /**
  * KVS memory allocation.
  *
@@ -49,4 +51,31 @@ void *kvsCalloc(size_t num, size_t bytes);
  */
 void kvsFree(void *ptr);
 
+#ifndef KVS_USE_PORT_ALLOC_CLASS
+/* The class is only a hint, so it's dropped if the port doesn't place allocations itself. */
+#define kvsMallocClass(bytes, xClass)   kvsMalloc(bytes)
+#endif
+
+#ifdef KVS_USE_ALLOC_TRACE
+/* Traced allocations record their call sites for kvs/alloc_trace.h. They're built on the functions above, so the linker
+ * wrappers of the pool allocator still apply. */
+void *kvsTraceMalloc(size_t bytes, const char *pcFile, int line);
+void *kvsTraceRealloc(void *ptr, size_t bytes, const char *pcFile, int line);
+void *kvsTraceCalloc(size_t num, size_t bytes, const char *pcFile, int line);
+void kvsTraceFree(void *ptr);
+#ifdef KVS_USE_PORT_ALLOC_CLASS
+void *kvsTraceMallocClass(size_t bytes, KvsAllocClass_t xClass, const char *pcFile, int line);
+#endif
+
+#ifndef KVS_ALLOC_TRACE_IMPL
+#define kvsMalloc(bytes)            kvsTraceMalloc((bytes), __FILE__, __LINE__)
+#define kvsRealloc(ptr, bytes)      kvsTraceRealloc((ptr), (bytes), __FILE__, __LINE__)
+#define kvsCalloc(num, bytes)       kvsTraceCalloc((num), (bytes), __FILE__, __LINE__)
+#define kvsFree(ptr)                kvsTraceFree(ptr)
+#ifdef KVS_USE_PORT_ALLOC_CLASS
+#define kvsMallocClass(bytes, xClass)   kvsTraceMallocClass((bytes), (xClass), __FILE__, __LINE__)
+#endif
+#endif /* KVS_ALLOC_TRACE_IMPL */
+#endif /* KVS_USE_ALLOC_TRACE */
+
 #endif /* ALLOCATOR_H */
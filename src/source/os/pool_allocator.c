@@ -14,6 +14,8 @@
  */
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 /* Third party headers */
@@ -23,9 +25,251 @@
 #include "kvs/errors.h"
 #include "kvs/pool_allocator.h"
 
+/* The pool handle is kept at the beginning of the memory pool, and TLSF pool follows it with this alignment. */
+#define POOL_ALLOCATOR_ALIGNMENT    (16)
+
+/* Small blocks freed to the pool of poolAllocatorInit() are kept in a free list of the thread, up to this many blocks of
+ * each size class, and they're allocated again by the same thread without taking memPoolMutex. Set it to 0 to disable
+ * the thread cache. */
+#ifndef POOL_ALLOCATOR_CACHE_BLOCKS
+#define POOL_ALLOCATOR_CACHE_BLOCKS     (8)
+#endif
+
+/* Size classes of the thread cache are powers of 2 from the min size, i.e. 16, 32, 64, 128 and 256 bytes. */
+#define POOL_ALLOCATOR_CACHE_MIN_SIZE   (16)
+#define POOL_ALLOCATOR_CACHE_CLASSES    (5)
+
+#ifndef POOL_ALLOCATOR_THREAD_LOCAL
+#define POOL_ALLOCATOR_THREAD_LOCAL     __thread
+#endif
+
+typedef struct PoolAllocator
+{
+    pthread_mutex_t xMutex;
+    tlsf_t tlsf;
+} PoolAllocator_t;
+
+/* The pool of poolAllocatorInit(). It's guarded by memPoolMutex instead of its own mutex, since it can be initialized
+ * and deinitialized while it's used. */
 static pthread_mutex_t memPoolMutex = PTHREAD_MUTEX_INITIALIZER;
-static tlsf_t tlsf = NULL;
-static void *pMem = NULL;
+static PoolAllocator_t *pxDefaultPool = NULL;
+
+#if POOL_ALLOCATOR_CACHE_BLOCKS > 0
+typedef struct PoolThreadCache
+{
+    /* Blocks cached before the default pool is deinitialized belong to the old pool, so they're dropped. */
+    unsigned int uGeneration;
+    bool bRegistered;
+
+    /* Cached blocks are linked through their first bytes. */
+    void *pFreeList[POOL_ALLOCATOR_CACHE_CLASSES];
+    size_t uBlocks[POOL_ALLOCATOR_CACHE_CLASSES];
+} PoolThreadCache_t;
+
+static POOL_ALLOCATOR_THREAD_LOCAL PoolThreadCache_t xThreadCache;
+
+/* The key is only used to flush the cache of a thread when it exits. */
+static pthread_once_t xCacheKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t xCacheKey;
+static bool bCacheKeyCreated = false;
+
+/* It's increased under memPoolMutex every time the default pool is deinitialized. */
+static unsigned int uPoolGeneration = 0;
+#endif /* POOL_ALLOCATOR_CACHE_BLOCKS > 0 */
+
+static size_t prvPoolHdrSize(void)
+{
+    return (sizeof(PoolAllocator_t) + POOL_ALLOCATOR_ALIGNMENT - 1) & ~((size_t)POOL_ALLOCATOR_ALIGNMENT - 1);
+}
+
+static PoolAllocator_t *prvPoolCreate(void *pMemPool, size_t bytes)
+{
+    PoolAllocator_t *pxPool = (PoolAllocator_t *)pMemPool;
+
+    if (pMemPool == NULL || bytes <= prvPoolHdrSize())
+    {
+        pxPool = NULL;
+    }
+    else
+    {
+        memset(pxPool, 0, sizeof(PoolAllocator_t));
+        if ((pxPool->tlsf = tlsf_create_with_pool((uint8_t *)pMemPool + prvPoolHdrSize(), bytes - prvPoolHdrSize())) == NULL)
+        {
+            pxPool = NULL;
+        }
+    }
+
+    return pxPool;
+}
+
+static void *prvPoolCalloc(PoolAllocator_t *pxPool, size_t num, size_t bytes)
+{
+    void *pNewPtr = NULL;
+
+    if (bytes == 0 || num <= ((size_t)-1) / bytes)
+    {
+        pNewPtr = tlsf_malloc(pxPool->tlsf, num * bytes);
+        if (pNewPtr != NULL)
+        {
+            memset(pNewPtr, 0, num * bytes);
+        }
+    }
+
+    return pNewPtr;
+}
+
+static void prvTlsfPoolWalker(void *ptr, size_t size, int used, void *pUser)
+{
+    PoolStats_t *pStats = (PoolStats_t *)pUser;
+    if (used)
+    {
+        pStats->uNumberOfUsedBlocks++;
+        pStats->uSumOfUsedMemory += size;
+        if (size > pStats->uSizeOfLargestUsedBlock)
+        {
+            pStats->uSizeOfLargestUsedBlock = size;
+        }
+    }
+    else
+    {
+        pStats->uNumberOfFreeBlocks++;
+        pStats->uSumOfFreeMemory += size;
+        if (size > pStats->uSizeOfLargestFreeBlock)
+        {
+            pStats->uSizeOfLargestFreeBlock = size;
+        }
+    }
+}
+
+static void prvPoolGetStats(PoolAllocator_t *pxPool, PoolStats_t *pPoolStats)
+{
+    memset(pPoolStats, 0, sizeof(PoolStats_t));
+    tlsf_walk_pool(tlsf_get_pool(pxPool->tlsf), prvTlsfPoolWalker, pPoolStats);
+}
+
+#if POOL_ALLOCATOR_CACHE_BLOCKS > 0
+static void prvThreadCacheFlush(void *pArg)
+{
+    PoolThreadCache_t *pxCache = (PoolThreadCache_t *)pArg;
+    void *ptr = NULL;
+    size_t i = 0;
+
+    pthread_mutex_lock(&memPoolMutex);
+    if (pxDefaultPool != NULL && pxCache->uGeneration == uPoolGeneration)
+    {
+        for (i = 0; i < POOL_ALLOCATOR_CACHE_CLASSES; i++)
+        {
+            while ((ptr = pxCache->pFreeList[i]) != NULL)
+            {
+                pxCache->pFreeList[i] = *(void **)ptr;
+                tlsf_free(pxDefaultPool->tlsf, ptr);
+            }
+        }
+    }
+    pthread_mutex_unlock(&memPoolMutex);
+
+    memset(pxCache->pFreeList, 0, sizeof(pxCache->pFreeList));
+    memset(pxCache->uBlocks, 0, sizeof(pxCache->uBlocks));
+}
+
+static void prvThreadCacheCreateKey(void)
+{
+    bCacheKeyCreated = (pthread_key_create(&xCacheKey, prvThreadCacheFlush) == 0);
+}
+
+static PoolThreadCache_t *prvThreadCacheGet(void)
+{
+    PoolThreadCache_t *pxCache = &xThreadCache;
+
+    if (pxCache->uGeneration != uPoolGeneration)
+    {
+        memset(pxCache->pFreeList, 0, sizeof(pxCache->pFreeList));
+        memset(pxCache->uBlocks, 0, sizeof(pxCache->uBlocks));
+        pxCache->uGeneration = uPoolGeneration;
+    }
+
+    return pxCache;
+}
+
+/* Return the smallest class that fits the size, or POOL_ALLOCATOR_CACHE_CLASSES if none does. */
+static size_t prvThreadCacheClassOfSize(size_t bytes)
+{
+    size_t uClass = 0;
+
+    while (uClass < POOL_ALLOCATOR_CACHE_CLASSES && ((size_t)POOL_ALLOCATOR_CACHE_MIN_SIZE << uClass) < bytes)
+    {
+        uClass++;
+    }
+
+    return uClass;
+}
+
+/* Return the largest class that a block of the size can serve, or POOL_ALLOCATOR_CACHE_CLASSES if the block is too
+ * small, or too large to be worth caching. */
+static size_t prvThreadCacheClassOfBlock(size_t uBlockSize)
+{
+    size_t uClass = POOL_ALLOCATOR_CACHE_CLASSES;
+
+    if (uBlockSize >= POOL_ALLOCATOR_CACHE_MIN_SIZE && uBlockSize < ((size_t)POOL_ALLOCATOR_CACHE_MIN_SIZE << POOL_ALLOCATOR_CACHE_CLASSES))
+    {
+        uClass = 0;
+        while (((size_t)POOL_ALLOCATOR_CACHE_MIN_SIZE << (uClass + 1)) <= uBlockSize)
+        {
+            uClass++;
+        }
+    }
+
+    return uClass;
+}
+
+static void *prvThreadCacheMalloc(size_t bytes, size_t *puAllocSize)
+{
+    PoolThreadCache_t *pxCache = prvThreadCacheGet();
+    size_t uClass = prvThreadCacheClassOfSize(bytes);
+    void *ptr = NULL;
+
+    *puAllocSize = bytes;
+    if (bytes > 0 && uClass < POOL_ALLOCATOR_CACHE_CLASSES)
+    {
+        /* Blocks are allocated in the size of their class, so they can serve any size of the class once cached. */
+        *puAllocSize = (size_t)POOL_ALLOCATOR_CACHE_MIN_SIZE << uClass;
+        if ((ptr = pxCache->pFreeList[uClass]) != NULL)
+        {
+            pxCache->pFreeList[uClass] = *(void **)ptr;
+            pxCache->uBlocks[uClass]--;
+        }
+    }
+
+    return ptr;
+}
+
+static bool prvThreadCacheFree(void *ptr)
+{
+    PoolThreadCache_t *pxCache = prvThreadCacheGet();
+    size_t uClass = prvThreadCacheClassOfBlock(tlsf_block_size(ptr));
+    bool bCached = false;
+
+    if (uClass < POOL_ALLOCATOR_CACHE_CLASSES && pxCache->uBlocks[uClass] < POOL_ALLOCATOR_CACHE_BLOCKS)
+    {
+        if (!pxCache->bRegistered)
+        {
+            pthread_once(&xCacheKeyOnce, prvThreadCacheCreateKey);
+            pxCache->bRegistered = bCacheKeyCreated && pthread_setspecific(xCacheKey, pxCache) == 0;
+        }
+
+        /* A thread that can't flush its cache when it exits doesn't cache blocks, or they'd never be freed. */
+        if (pxCache->bRegistered)
+        {
+            *(void **)ptr = pxCache->pFreeList[uClass];
+            pxCache->pFreeList[uClass] = ptr;
+            pxCache->uBlocks[uClass]++;
+            bCached = true;
+        }
+    }
+
+    return bCached;
+}
+#endif /* POOL_ALLOCATOR_CACHE_BLOCKS > 0 */
 
 int poolAllocatorInit(void *pMemPool, size_t bytes)
 {
@@ -38,15 +282,9 @@ int poolAllocatorInit(void *pMemPool, size_t bytes)
     else
     {
         pthread_mutex_lock(&memPoolMutex);
-        if (pMem == NULL)
+        if (pxDefaultPool == NULL && (pxDefaultPool = prvPoolCreate(pMemPool, bytes)) == NULL)
         {
-            pMem = pMemPool;
-            tlsf = tlsf_create_with_pool(pMem, bytes);
-            if (tlsf == NULL)
-            {
-                pMem = NULL;
-                res = KVS_ERROR_TLSF_FAILED_TO_CREATE_POOL;
-            }
+            res = KVS_ERROR_TLSF_FAILED_TO_CREATE_POOL;
         }
         pthread_mutex_unlock(&memPoolMutex);
     }
@@ -57,13 +295,21 @@ int poolAllocatorInit(void *pMemPool, size_t bytes)
 void *poolAllocatorMalloc(size_t bytes)
 {
     void *pNewPtr = NULL;
+    size_t uAllocSize = bytes;
 
-    pthread_mutex_lock(&memPoolMutex);
-    if (tlsf != NULL)
+#if POOL_ALLOCATOR_CACHE_BLOCKS > 0
+    pNewPtr = prvThreadCacheMalloc(bytes, &uAllocSize);
+#endif
+
+    if (pNewPtr == NULL)
     {
-        pNewPtr = tlsf_malloc(tlsf, bytes);
+        pthread_mutex_lock(&memPoolMutex);
+        if (pxDefaultPool != NULL)
+        {
+            pNewPtr = tlsf_malloc(pxDefaultPool->tlsf, uAllocSize);
+        }
+        pthread_mutex_unlock(&memPoolMutex);
     }
-    pthread_mutex_unlock(&memPoolMutex);
 
     return pNewPtr;
 }
@@ -73,9 +319,9 @@ void *poolAllocatorRealloc(void *ptr, size_t bytes)
     void *pNewPtr = NULL;
 
     pthread_mutex_lock(&memPoolMutex);
-    if (tlsf != NULL)
+    if (pxDefaultPool != NULL)
     {
-        pNewPtr = tlsf_realloc(tlsf, ptr, bytes);
+        pNewPtr = tlsf_realloc(pxDefaultPool->tlsf, ptr, bytes);
     }
     pthread_mutex_unlock(&memPoolMutex);
 
@@ -86,21 +332,35 @@ void *poolAllocatorCalloc(size_t num, size_t bytes)
 {
     void *pNewPtr = NULL;
 
-    pNewPtr = poolAllocatorMalloc(num * bytes);
-    if (pNewPtr != NULL)
+    pthread_mutex_lock(&memPoolMutex);
+    if (pxDefaultPool != NULL)
     {
-        memset(pNewPtr, 0, num * bytes);
+        pNewPtr = prvPoolCalloc(pxDefaultPool, num, bytes);
     }
+    pthread_mutex_unlock(&memPoolMutex);
 
     return pNewPtr;
 }
 
 void poolAllocatorFree(void *ptr)
 {
-    if (ptr != NULL && tlsf != NULL)
+    if (ptr == NULL)
+    {
+        /* nop */
+    }
+#if POOL_ALLOCATOR_CACHE_BLOCKS > 0
+    else if (pxDefaultPool != NULL && prvThreadCacheFree(ptr))
+    {
+        /* nop */
+    }
+#endif
+    else
     {
         pthread_mutex_lock(&memPoolMutex);
-        tlsf_free(tlsf, ptr);
+        if (pxDefaultPool != NULL)
+        {
+            tlsf_free(pxDefaultPool->tlsf, ptr);
+        }
         pthread_mutex_unlock(&memPoolMutex);
     }
 }
@@ -108,48 +368,125 @@ void poolAllocatorFree(void *ptr)
 void poolAllocatorDeinit(void)
 {
     pthread_mutex_lock(&memPoolMutex);
-    if (tlsf != NULL)
+    if (pxDefaultPool != NULL)
     {
-        tlsf_destroy(tlsf);
-        tlsf = NULL;
+        tlsf_destroy(pxDefaultPool->tlsf);
+        pxDefaultPool = NULL;
+#if POOL_ALLOCATOR_CACHE_BLOCKS > 0
+        uPoolGeneration++;
+#endif
     }
-    if (pMem != NULL)
+    pthread_mutex_unlock(&memPoolMutex);
+}
+
+void poolAllocatorGetStats(PoolStats_t *pPoolStats)
+{
+#if POOL_ALLOCATOR_CACHE_BLOCKS > 0
+    /* Blocks cached by the calling thread are counted as free. Those of other threads are still counted as used. */
+    prvThreadCacheFlush(prvThreadCacheGet());
+#endif
+
+    pthread_mutex_lock(&memPoolMutex);
+    if (pxDefaultPool != NULL && pPoolStats != NULL)
     {
-        pMem = NULL;
+        prvPoolGetStats(pxDefaultPool, pPoolStats);
     }
     pthread_mutex_unlock(&memPoolMutex);
 }
 
-static void prvTlsfPoolWalker(void *ptr, size_t size, int used, void *pUser)
+PoolAllocatorHandle poolAllocatorCreate(void *pMemPool, size_t bytes)
 {
-    PoolStats_t *pStats = (PoolStats_t *)pUser;
-    if (used)
+    PoolAllocator_t *pxPool = NULL;
+
+    if ((pxPool = prvPoolCreate(pMemPool, bytes)) == NULL)
     {
-        pStats->uNumberOfUsedBlocks++;
-        pStats->uSumOfUsedMemory += size;
-        if (size > pStats->uSizeOfLargestUsedBlock)
-        {
-            pStats->uSizeOfLargestUsedBlock = size;
-        }
+        /* nop */
     }
-    else
+    else if (pthread_mutex_init(&(pxPool->xMutex), NULL) != 0)
     {
-        pStats->uNumberOfFreeBlocks++;
-        pStats->uSumOfFreeMemory += size;
-        if (size > pStats->uSizeOfLargestFreeBlock)
-        {
-            pStats->uSizeOfLargestFreeBlock = size;
-        }
+        tlsf_destroy(pxPool->tlsf);
+        pxPool = NULL;
     }
+
+    return pxPool;
 }
 
-void poolAllocatorGetStats(PoolStats_t *pPoolStats)
+void poolAllocatorTerminate(PoolAllocatorHandle xPool)
 {
-    pthread_mutex_lock(&memPoolMutex);
-    if (tlsf != NULL && pMem != NULL)
+    PoolAllocator_t *pxPool = xPool;
+
+    if (pxPool != NULL)
     {
-        tlsf_walk_pool(tlsf_get_pool(tlsf), prvTlsfPoolWalker, pPoolStats);
+        tlsf_destroy(pxPool->tlsf);
+        pthread_mutex_destroy(&(pxPool->xMutex));
     }
-    pthread_mutex_unlock(&memPoolMutex);
 }
 
+void *poolAllocatorMallocFrom(PoolAllocatorHandle xPool, size_t bytes)
+{
+    PoolAllocator_t *pxPool = xPool;
+    void *pNewPtr = NULL;
+
+    if (pxPool != NULL)
+    {
+        pthread_mutex_lock(&(pxPool->xMutex));
+        pNewPtr = tlsf_malloc(pxPool->tlsf, bytes);
+        pthread_mutex_unlock(&(pxPool->xMutex));
+    }
+
+    return pNewPtr;
+}
+
+void *poolAllocatorReallocFrom(PoolAllocatorHandle xPool, void *ptr, size_t bytes)
+{
+    PoolAllocator_t *pxPool = xPool;
+    void *pNewPtr = NULL;
+
+    if (pxPool != NULL)
+    {
+        pthread_mutex_lock(&(pxPool->xMutex));
+        pNewPtr = tlsf_realloc(pxPool->tlsf, ptr, bytes);
+        pthread_mutex_unlock(&(pxPool->xMutex));
+    }
+
+    return pNewPtr;
+}
+
+void *poolAllocatorCallocFrom(PoolAllocatorHandle xPool, size_t num, size_t bytes)
+{
+    PoolAllocator_t *pxPool = xPool;
+    void *pNewPtr = NULL;
+
+    if (pxPool != NULL)
+    {
+        pthread_mutex_lock(&(pxPool->xMutex));
+        pNewPtr = prvPoolCalloc(pxPool, num, bytes);
+        pthread_mutex_unlock(&(pxPool->xMutex));
+    }
+
+    return pNewPtr;
+}
+
+void poolAllocatorFreeFrom(PoolAllocatorHandle xPool, void *ptr)
+{
+    PoolAllocator_t *pxPool = xPool;
+
+    if (pxPool != NULL && ptr != NULL)
+    {
+        pthread_mutex_lock(&(pxPool->xMutex));
+        tlsf_free(pxPool->tlsf, ptr);
+        pthread_mutex_unlock(&(pxPool->xMutex));
+    }
+}
+
+void poolAllocatorGetStatsFrom(PoolAllocatorHandle xPool, PoolStats_t *pPoolStats)
+{
+    PoolAllocator_t *pxPool = xPool;
+
+    if (pxPool != NULL && pPoolStats != NULL)
+    {
+        pthread_mutex_lock(&(pxPool->xMutex));
+        prvPoolGetStats(pxPool, pPoolStats);
+        pthread_mutex_unlock(&(pxPool->xMutex));
+    }
+}
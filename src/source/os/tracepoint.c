@@ -0,0 +1,176 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Public headers */
+#include "kvs/errors.h"
+#include "kvs/port.h"
+#include "kvs/tracepoint.h"
+
+/* Internal headers */
+#include "os/tracepoint.h"
+
+#ifdef KVS_USE_TRACEPOINTS
+
+#define TRACE_ATOMIC_LOAD(p)            __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define TRACE_ATOMIC_STORE(p, v)        __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define TRACE_ATOMIC_FETCH_ADD(p, v)    __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+
+#define TRACE_JSON_EVENT_MAX_LEN        (192)
+
+#if (KVS_TRACE_RING_SIZE & (KVS_TRACE_RING_SIZE - 1)) != 0
+#error "KVS_TRACE_RING_SIZE must be a power of 2"
+#endif
+
+typedef struct TraceEvent
+{
+    /* Sequence number of the event plus 1. It's 0 while the event is written, so a dump skips the torn ones. */
+    uint32_t uSeq;
+    uint32_t uTid;
+    uint64_t uTimestampUs;
+    uint32_t uArg;
+    uint16_t uId;
+    char cPhase;
+} TraceEvent_t;
+
+static TraceEvent_t gpxTraceRing[KVS_TRACE_RING_SIZE] = {0};
+
+/* Sequence number of the next event. Events before guTraceFloor are dropped by kvsTraceClear(). */
+static uint32_t guTraceHead = 0;
+static uint32_t guTraceFloor = 0;
+
+static const char *gpcTraceEventNames[KVS_TRACE_EVENT_COUNT] = {
+    "KvsApp_addFrame",
+    "Kvs_streamAddDataFrame",
+    "KvsApp_sendData",
+    "NetIo_send",
+};
+
+void kvsTraceRecord(KvsTraceEventId_t xId, char cPhase, uint32_t uArg)
+{
+    uint32_t uSeq = TRACE_ATOMIC_FETCH_ADD(&guTraceHead, 1);
+    TraceEvent_t *pxEvent = &(gpxTraceRing[uSeq & (KVS_TRACE_RING_SIZE - 1)]);
+
+    __atomic_store_n(&(pxEvent->uSeq), 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    pxEvent->uTid = kvsThreadGetCurrentId();
+    pxEvent->uTimestampUs = getMonotonicTimeInUs();
+    pxEvent->uArg = uArg;
+    pxEvent->uId = (uint16_t)xId;
+    pxEvent->cPhase = cPhase;
+    TRACE_ATOMIC_STORE(&(pxEvent->uSeq), uSeq + 1);
+}
+
+/* Copy an event, or return false if it's being written or it has been overwritten. */
+static bool prvTraceRead(uint32_t uSeq, TraceEvent_t *pxEvent)
+{
+    TraceEvent_t *pxSlot = &(gpxTraceRing[uSeq & (KVS_TRACE_RING_SIZE - 1)]);
+    bool bValid = false;
+
+    if (TRACE_ATOMIC_LOAD(&(pxSlot->uSeq)) == uSeq + 1)
+    {
+        memcpy(pxEvent, pxSlot, sizeof(TraceEvent_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        bValid = (__atomic_load_n(&(pxSlot->uSeq), __ATOMIC_RELAXED) == uSeq + 1 && pxEvent->uId < KVS_TRACE_EVENT_COUNT);
+    }
+
+    return bValid;
+}
+
+int kvsTraceDump(KvsTraceWrite_t write, void *pAppData)
+{
+    int res = KVS_ERRNO_NONE;
+    int retVal = 0;
+    uint32_t uHead = TRACE_ATOMIC_LOAD(&guTraceHead);
+    uint32_t uSeq = TRACE_ATOMIC_LOAD(&guTraceFloor);
+    TraceEvent_t xEvent = {0};
+    char pcJson[TRACE_JSON_EVENT_MAX_LEN];
+    int xLen = 0;
+    bool bFirst = true;
+
+    if (uHead - uSeq > KVS_TRACE_RING_SIZE)
+    {
+        uSeq = uHead - KVS_TRACE_RING_SIZE;
+    }
+
+    if (write == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((retVal = write("{\"traceEvents\":[", strlen("{\"traceEvents\":["), pAppData)) != 0)
+    {
+        res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+    }
+    else
+    {
+        for (; uSeq != uHead && res == KVS_ERRNO_NONE; uSeq++)
+        {
+            if (!prvTraceRead(uSeq, &xEvent))
+            {
+                /* It's being written or it has been overwritten. */
+            }
+            else if ((xLen = snprintf(pcJson, sizeof(pcJson), "%s{\"name\":\"%s\",\"cat\":\"kvs\",\"ph\":\"%c\",\"ts\":%" PRIu64 ",\"pid\":1,\"tid\":%" PRIu32 ",\"args\":{\"v\":%" PRIu32 "}}",
+                                      bFirst ? "" : ",", gpcTraceEventNames[xEvent.uId], xEvent.cPhase, xEvent.uTimestampUs, xEvent.uTid, xEvent.uArg)) < 0 ||
+                     (size_t)xLen >= sizeof(pcJson))
+            {
+                res = KVS_ERROR_C_UTIL_STRING_ERROR;
+            }
+            else if ((retVal = write(pcJson, (size_t)xLen, pAppData)) != 0)
+            {
+                res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+            }
+            else
+            {
+                bFirst = false;
+            }
+        }
+
+        if (res == KVS_ERRNO_NONE && (retVal = write("]}", strlen("]}"), pAppData)) != 0)
+        {
+            res = KVS_GENERATE_CALLBACK_ERROR(retVal);
+        }
+    }
+
+    return res;
+}
+
+int kvsTraceClear(void)
+{
+    TRACE_ATOMIC_STORE(&guTraceFloor, TRACE_ATOMIC_LOAD(&guTraceHead));
+
+    return KVS_ERRNO_NONE;
+}
+
+#else
+
+int kvsTraceDump(KvsTraceWrite_t write, void *pAppData)
+{
+    (void)write;
+    (void)pAppData;
+
+    return KVS_ERROR_TRACEPOINTS_NOT_ENABLED;
+}
+
+int kvsTraceClear(void)
+{
+    return KVS_ERROR_TRACEPOINTS_NOT_ENABLED;
+}
+
+#endif /* KVS_USE_TRACEPOINTS */
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef TRACEPOINT_H
+#define TRACEPOINT_H
+
+#include <stdint.h>
+
+#include "kvs/tracepoint.h"
+
+#ifdef KVS_USE_TRACEPOINTS
+/**
+ * Record an event into the ring. It's lock-free, so it can be called in any hot path.
+ *
+ * @param[in] xId The event
+ * @param[in] cPhase 'B' when the slice begins, and 'E' when it ends
+ * @param[in] uArg A value shown with the event, e.g. the size of the data
+ */
+void kvsTraceRecord(KvsTraceEventId_t xId, char cPhase, uint32_t uArg);
+
+#define KVS_TRACE_BEGIN(xId)            kvsTraceRecord((xId), 'B', 0)
+#define KVS_TRACE_END(xId, uArg)        kvsTraceRecord((xId), 'E', (uint32_t)(uArg))
+#else
+#define KVS_TRACE_BEGIN(xId)            ((void)0)
+#define KVS_TRACE_END(xId, uArg)        ((void)0)
+#endif /* KVS_USE_TRACEPOINTS */
+
+#endif /* TRACEPOINT_H */
@@ -13,16 +13,20 @@
  * permissions and limitations under the License.
  */
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 /* Third party headers */
+#include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/xlogging.h"
-#include "mbedtls/md.h"
-#include "mbedtls/sha256.h"
 
 /* Public headers */
 #include "kvs/errors.h"
+#include "kvs/port.h"
 
 /* Internal headers */
 #include "os/allocator.h"
@@ -33,7 +37,7 @@
 #define HTTP_METHOD_POST "POST"
 
 /* The buffer length used for doing SHA256 hash check. */
-#define SHA256_DIGEST_LENGTH 32
+#define SHA256_DIGEST_LENGTH KVS_SHA256_DIGEST_LENGTH
 
 /* The buffer length used for ASCII Hex encoded SHA256 result. */
 #define HEX_ENCODED_SHA_256_STRING_SIZE 65
@@ -61,6 +65,15 @@
 
 #define TEMPLATE_SIGNATURE_START "%s%s"
 
+/* The number of derived signing keys that are cached. A signing key only depends on the secret key, date, region and
+ * service, so it's reused until the date changes or the credentials rotate. 0 disables the cache. */
+#ifndef AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE
+#define AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE (2)
+#endif
+
+/* The max length of cached scopes, and a longer scope is not cached. */
+#define AWS_SIG_V4_CACHED_SCOPE_MAX_LEN (96)
+
 typedef struct AwsSigV4
 {
     STRING_HANDLE xStCanonicalRequest;
@@ -70,6 +83,21 @@ typedef struct AwsSigV4
     STRING_HANDLE xStAuthorization;
 } AwsSigV4_t;
 
+#if AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE > 0
+typedef struct SigningKeyEntry
+{
+    /* The secret key is kept as its hash, and the scope contains the date, region and service. */
+    unsigned char pSecretKeyHash[SHA256_DIGEST_LENGTH];
+    char pcScope[AWS_SIG_V4_CACHED_SCOPE_MAX_LEN];
+    uint32_t uLastUsed;
+    unsigned char pSigningKey[SHA256_DIGEST_LENGTH];
+} SigningKeyEntry_t;
+
+static SigningKeyEntry_t gxSigningKeyCache[AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE];
+static uint32_t guSigningKeyUseCount = 0;
+static LOCK_HANDLE gxSigningKeyCacheLock = NULL;
+#endif
+
 static int prvValidateHttpMethod(const char *pcHttpMethod)
 {
     if (pcHttpMethod == NULL)
@@ -117,7 +145,6 @@ static int prvValidateHttpHeader(const char *pcHeader, const char *pcValue)
 static int prvHexEncodedSha256(const unsigned char *pMsg, size_t uMsgLen, char pcHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE])
 {
     int res = KVS_ERRNO_NONE;
-    int retVal = 0;
     int i = 0;
     char *p = NULL;
     unsigned char pHashBuf[SHA256_DIGEST_LENGTH] = {0};
@@ -126,9 +153,9 @@ static int prvHexEncodedSha256(const unsigned char *pMsg, size_t uMsgLen, char p
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
     }
-    else if ((retVal = mbedtls_sha256_ret(pMsg, uMsgLen, pHashBuf, 0)) != 0)
+    else if ((res = kvsSha256(pMsg, uMsgLen, pHashBuf)) != KVS_ERRNO_NONE)
     {
-        res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+        /* Propagate the res error */
     }
     else
     {
@@ -142,6 +169,155 @@ static int prvHexEncodedSha256(const unsigned char *pMsg, size_t uMsgLen, char p
     return res;
 }
 
+static int prvDeriveSigningKey(
+    const char *pcSecretKey,
+    const char *pcRegion,
+    const char *pcService,
+    const char *pcXAmzDate,
+    unsigned char pSigningKey[SHA256_DIGEST_LENGTH])
+{
+    int res = KVS_ERRNO_NONE;
+    char pcKeyStart[AWS_SIG_V4_MAX_HMAC_SIZE] = {0};
+
+    /* Generate the beginning of the signature. */
+    if (snprintf(pcKeyStart, AWS_SIG_V4_MAX_HMAC_SIZE, TEMPLATE_SIGNATURE_START, AWS_SIG_V4_SIGNATURE_START, pcSecretKey) == 0)
+    {
+        res = KVS_ERROR_C_UTIL_STRING_ERROR;
+    }
+    /* Calculate the HMAC of date, region, service and signature end. */
+    else if (
+        (res = kvsHmacSha256((const unsigned char *)pcKeyStart, strlen(pcKeyStart), (const unsigned char *)pcXAmzDate, SIGNATURE_DATE_STRING_LEN, pSigningKey)) != KVS_ERRNO_NONE ||
+        (res = kvsHmacSha256(pSigningKey, SHA256_DIGEST_LENGTH, (const unsigned char *)pcRegion, strlen(pcRegion), pSigningKey)) != KVS_ERRNO_NONE ||
+        (res = kvsHmacSha256(pSigningKey, SHA256_DIGEST_LENGTH, (const unsigned char *)pcService, strlen(pcService), pSigningKey)) != KVS_ERRNO_NONE ||
+        (res = kvsHmacSha256(pSigningKey, SHA256_DIGEST_LENGTH, (const unsigned char *)AWS_SIG_V4_SIGNATURE_END, sizeof(AWS_SIG_V4_SIGNATURE_END) - 1, pSigningKey)) !=
+            KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        /* nop */
+    }
+
+    memset(pcKeyStart, 0, sizeof(pcKeyStart));
+
+    return res;
+}
+
+#if AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE > 0
+static bool prvSigningKeyCacheLock(void)
+{
+    LOCK_HANDLE xLock = __atomic_load_n(&gxSigningKeyCacheLock, __ATOMIC_ACQUIRE);
+    LOCK_HANDLE xPublished = NULL;
+
+    /* The lock is created on the first signing and never released, so it's shared by all requests. Requests that race
+     * to create it all use the one that is published first. */
+    if (xLock == NULL && (xLock = Lock_Init()) != NULL && !__atomic_compare_exchange_n(&gxSigningKeyCacheLock, &xPublished, xLock, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        /* Another thread created it first. */
+        Lock_Deinit(xLock);
+        xLock = xPublished;
+    }
+
+    return (xLock != NULL && Lock(xLock) == LOCK_OK);
+}
+
+static SigningKeyEntry_t *prvSigningKeyCacheFind(const unsigned char *pSecretKeyHash, const char *pcScope)
+{
+    SigningKeyEntry_t *pxEntry = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE; i++)
+    {
+        if (gxSigningKeyCache[i].uLastUsed > 0 && memcmp(gxSigningKeyCache[i].pSecretKeyHash, pSecretKeyHash, SHA256_DIGEST_LENGTH) == 0 &&
+            strcmp(gxSigningKeyCache[i].pcScope, pcScope) == 0)
+        {
+            pxEntry = &(gxSigningKeyCache[i]);
+            break;
+        }
+    }
+
+    return pxEntry;
+}
+
+static void prvSigningKeyCacheSave(const unsigned char *pSecretKeyHash, const char *pcScope, const unsigned char *pSigningKey)
+{
+    SigningKeyEntry_t *pxEntry = NULL;
+    size_t i = 0;
+
+    if (prvSigningKeyCacheLock())
+    {
+        /* Replace the least recently used one. */
+        pxEntry = &(gxSigningKeyCache[0]);
+        for (i = 1; i < AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE; i++)
+        {
+            if (gxSigningKeyCache[i].uLastUsed < pxEntry->uLastUsed)
+            {
+                pxEntry = &(gxSigningKeyCache[i]);
+            }
+        }
+
+        memcpy(pxEntry->pSecretKeyHash, pSecretKeyHash, SHA256_DIGEST_LENGTH);
+        snprintf(pxEntry->pcScope, AWS_SIG_V4_CACHED_SCOPE_MAX_LEN, "%s", pcScope);
+        memcpy(pxEntry->pSigningKey, pSigningKey, SHA256_DIGEST_LENGTH);
+        pxEntry->uLastUsed = ++guSigningKeyUseCount;
+
+        Unlock(gxSigningKeyCacheLock);
+    }
+}
+#endif /* AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE > 0 */
+
+static int prvGetSigningKey(
+    const char *pcSecretKey,
+    const char *pcRegion,
+    const char *pcService,
+    const char *pcXAmzDate,
+    unsigned char pSigningKey[SHA256_DIGEST_LENGTH])
+{
+    int res = KVS_ERRNO_NONE;
+#if AWS_SIG_V4_SIGNING_KEY_CACHE_SIZE > 0
+    unsigned char pSecretKeyHash[SHA256_DIGEST_LENGTH] = {0};
+    char pcScope[AWS_SIG_V4_CACHED_SCOPE_MAX_LEN] = {0};
+    int xScopeLen = 0;
+    SigningKeyEntry_t *pxEntry = NULL;
+    bool bFound = false;
+
+    if ((res = kvsSha256((const unsigned char *)pcSecretKey, strlen(pcSecretKey), pSecretKeyHash)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (
+        (xScopeLen = snprintf(pcScope, sizeof(pcScope), TEMPLATE_CANONICAL_SCOPE, SIGNATURE_DATE_STRING_LEN, pcXAmzDate, pcRegion, pcService, AWS_SIG_V4_SIGNATURE_END)) <= 0 ||
+        xScopeLen >= (int)sizeof(pcScope))
+    {
+        /* The scope is too long to be cached. */
+        res = prvDeriveSigningKey(pcSecretKey, pcRegion, pcService, pcXAmzDate, pSigningKey);
+    }
+    else
+    {
+        if (prvSigningKeyCacheLock())
+        {
+            if ((pxEntry = prvSigningKeyCacheFind(pSecretKeyHash, pcScope)) != NULL)
+            {
+                memcpy(pSigningKey, pxEntry->pSigningKey, SHA256_DIGEST_LENGTH);
+                pxEntry->uLastUsed = ++guSigningKeyUseCount;
+                bFound = true;
+            }
+            Unlock(gxSigningKeyCacheLock);
+        }
+
+        if (!bFound && (res = prvDeriveSigningKey(pcSecretKey, pcRegion, pcService, pcXAmzDate, pSigningKey)) == KVS_ERRNO_NONE)
+        {
+            prvSigningKeyCacheSave(pSecretKeyHash, pcScope, pSigningKey);
+        }
+    }
+#else
+    res = prvDeriveSigningKey(pcSecretKey, pcRegion, pcService, pcXAmzDate, pSigningKey);
+#endif
+
+    return res;
+}
+
 AwsSigV4Handle AwsSigV4_Create(char *pcHttpMethod, char *pcUri, char *pcQuery)
 {
     int res = KVS_ERRNO_NONE;
@@ -151,7 +327,7 @@ AwsSigV4Handle AwsSigV4_Create(char *pcHttpMethod, char *pcUri, char *pcQuery)
     {
         do
         {
-            pxAwsSigV4 = (AwsSigV4_t *)kvsMalloc(sizeof(AwsSigV4_t));
+            pxAwsSigV4 = (AwsSigV4_t *)kvsMallocClass(sizeof(AwsSigV4_t), KVS_ALLOC_CLASS_CRYPTO);
             if (pxAwsSigV4 == NULL)
             {
                 res = KVS_ERROR_OUT_OF_MEMORY;
@@ -261,15 +437,35 @@ int AwsSigV4_AddCanonicalBody(AwsSigV4Handle xSigV4Handle, const char *pBody, si
     return res;
 }
 
+int AwsSigV4_SetCanonicalRequest(AwsSigV4Handle xSigV4Handle, const char *pcCanonicalRequest, const char *pcSignedHeaders)
+{
+    int res = KVS_ERRNO_NONE;
+    AwsSigV4_t *pxAwsSigV4 = (AwsSigV4_t *)xSigV4Handle;
+
+    if (pxAwsSigV4 == NULL || pcCanonicalRequest == NULL || pcSignedHeaders == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if (
+        STRING_copy(pxAwsSigV4->xStCanonicalRequest, pcCanonicalRequest) != 0 || STRING_copy(pxAwsSigV4->xStSignedHeaders, pcSignedHeaders) != 0 ||
+        STRING_empty(pxAwsSigV4->xStScope) != 0 || STRING_empty(pxAwsSigV4->xStHmacHexEncoded) != 0 || STRING_empty(pxAwsSigV4->xStAuthorization) != 0)
+    {
+        res = KVS_ERROR_C_UTIL_STRING_ERROR;
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return res;
+}
+
 int AwsSigV4_Sign(AwsSigV4Handle xSigV4Handle, char *pcAccessKey, char *pcSecretKey, char *pcRegion, char *pcService, const char *pcXAmzDate)
 {
     int res = KVS_ERRNO_NONE;
-    int retVal = 0;
     AwsSigV4_t *pxAwsSigV4 = (AwsSigV4_t *)xSigV4Handle;
     char pcCanonicalReqHexEncSha256[HEX_ENCODED_SHA_256_STRING_SIZE] = {0};
-    const mbedtls_md_info_t *pxMdInfo = NULL;
     STRING_HANDLE xStSignedStr = NULL;
-    size_t uHmacSize = 0;
     char pHmac[AWS_SIG_V4_MAX_HMAC_SIZE] = {0};
     int i = 0;
 
@@ -284,15 +480,6 @@ int AwsSigV4_Sign(AwsSigV4Handle xSigV4Handle, char *pcAccessKey, char *pcSecret
     {
         /* Propagate the res error */
     }
-    else if ((pxMdInfo = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256)) == NULL)
-    {
-        res = KVS_ERROR_UNKNOWN_MBEDTLS_MESSAGE_DIGEST;
-    }
-    /* HMAC size of SHA256 should be 32. */
-    else if ((uHmacSize = mbedtls_md_get_size(pxMdInfo)) == 0)
-    {
-        res = KVS_ERROR_INVALID_MBEDTLS_MESSAGE_DIGEST_SIZE;
-    }
     /* Generate the scope string. */
     else if (STRING_sprintf(pxAwsSigV4->xStScope, TEMPLATE_CANONICAL_SCOPE, SIGNATURE_DATE_STRING_LEN, pcXAmzDate, pcRegion, pcService, AWS_SIG_V4_SIGNATURE_END) != 0)
     {
@@ -305,24 +492,22 @@ int AwsSigV4_Sign(AwsSigV4Handle xSigV4Handle, char *pcAccessKey, char *pcSecret
     {
         res = KVS_ERROR_C_UTIL_STRING_ERROR;
     }
-    /* Generate the beginning of the signature. */
-    else if (snprintf(pHmac, AWS_SIG_V4_MAX_HMAC_SIZE, TEMPLATE_SIGNATURE_START, AWS_SIG_V4_SIGNATURE_START, pcSecretKey) == 0)
+    /* Get the signing key derived from date, region, service and signature end. */
+    else if ((res = prvGetSigningKey(pcSecretKey, pcRegion, pcService, pcXAmzDate, (unsigned char *)pHmac)) != KVS_ERRNO_NONE)
     {
-        res = KVS_ERROR_C_UTIL_STRING_ERROR;
+        /* Propagate the res error */
     }
-    /* Calculate the HMAC of date, region, service, signature end, and signed string*/
+    /* Calculate the HMAC of signed string */
     else if (
-        (retVal = mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, strlen(pHmac), (const unsigned char *)pcXAmzDate, SIGNATURE_DATE_STRING_LEN, (unsigned char *)pHmac)) != 0 ||
-        (retVal = mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)pcRegion, strlen(pcRegion), (unsigned char *)pHmac)) != 0 ||
-        (retVal = mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)pcService, strlen(pcService), (unsigned char *)pHmac)) != 0 ||
-        (retVal = mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)AWS_SIG_V4_SIGNATURE_END, sizeof(AWS_SIG_V4_SIGNATURE_END) - 1, (unsigned char *)pHmac)) != 0 ||
-        (retVal = mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)STRING_c_str(xStSignedStr), STRING_length(xStSignedStr), (unsigned char *)pHmac)) != 0)
+        (res = kvsHmacSha256(
+             (const unsigned char *)pHmac, SHA256_DIGEST_LENGTH, (const unsigned char *)STRING_c_str(xStSignedStr), STRING_length(xStSignedStr), (unsigned char *)pHmac)) !=
+        KVS_ERRNO_NONE)
     {
-        res = KVS_GENERATE_MBEDTLS_ERROR(retVal);
+        /* Propagate the res error */
     }
     else
     {
-        for (i = 0; i < uHmacSize; i++)
+        for (i = 0; i < SHA256_DIGEST_LENGTH; i++)
         {
             if (STRING_sprintf(pxAwsSigV4->xStHmacHexEncoded, "%02x", pHmac[i] & 0xFF) != 0)
             {
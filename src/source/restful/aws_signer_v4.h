@@ -62,6 +62,19 @@ int AwsSigV4_AddCanonicalHeader(AwsSigV4Handle xSigV4Handle, const char *pcHeade
  */
 int AwsSigV4_AddCanonicalBody(AwsSigV4Handle xSigV4Handle, const char *pBody, size_t uBodyLen);
 
+/**
+ * @brief Replace the canonical request with a prebuilt one
+ *
+ * It's for requests whose canonical request is assembled by the caller, so one handle can sign many of them. The
+ * result of the previous sign is cleared.
+ *
+ * @param[in] xSigV4Handle The AWS Signature V4 handle
+ * @param[in] pcCanonicalRequest The whole canonical request including the hex encoded SHA256 of the body
+ * @param[in] pcSignedHeaders The names of signed headers separated by ';'
+ * @return 0 on success, non-zero value otherwise
+ */
+int AwsSigV4_SetCanonicalRequest(AwsSigV4Handle xSigV4Handle, const char *pcCanonicalRequest, const char *pcSignedHeaders);
+
 /**
  * @brief Sign the canonical request with key and other information
  *
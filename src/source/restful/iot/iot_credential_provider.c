@@ -14,17 +14,17 @@
  */
 
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 
 /* Thirdparty headers */
-#include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/xlogging.h"
-#include "parson.h"
 
 /* Public headers */
 #include "kvs/errors.h"
 #include "kvs/iot_credential_provider.h"
+#include "kvs/kvs_config.h"
 
 /* Internal headers */
 #include "os/allocator.h"
@@ -32,49 +32,70 @@
 #include "misc/json_helper.h"
 #include "net/netio.h"
 
+#if KVS_CONFIG_IOT_CREDENTIAL
+
 #define IOT_URI_ROLE_ALIASES_BEGIN  "/role-aliases"
 #define IOT_URI_ROLE_ALIASES_END    "/credentials"
 
+/* Tokens of a credential response, which is an object of 4 keys in "credentials" */
+#define IOT_CREDENTIAL_MAX_JSON_TOKENS  (16)
+#define IOT_EXPIRATION_MAX_LEN          (32)
+
+/* Convert "YYYY-MM-DDTHH:MM:SSZ" to epoch time in milliseconds, or return 0 if it's invalid. */
+static uint64_t prvIso8601ToEpochMs(const char *pcTime)
+{
+    uint64_t uEpochMs = 0;
+    int xYear = 0, xMonth = 0, xDay = 0, xHour = 0, xMin = 0, xSec = 0;
+    int64_t xDays = 0;
+
+    if (pcTime != NULL && sscanf(pcTime, "%4d-%2d-%2dT%2d:%2d:%2d", &xYear, &xMonth, &xDay, &xHour, &xMin, &xSec) == 6 &&
+        xYear >= 1970 && xMonth >= 1 && xMonth <= 12 && xDay >= 1 && xDay <= 31)
+    {
+        /* Days since 1970-01-01 of the proleptic Gregorian calendar, with years starting from March. */
+        if (xMonth <= 2)
+        {
+            xYear--;
+            xMonth += 12;
+        }
+        xDays = 365 * (int64_t)xYear + xYear / 4 - xYear / 100 + xYear / 400 + (153 * (xMonth - 3) + 2) / 5 + xDay - 719469;
+        uEpochMs = (uint64_t)(((xDays * 24 + xHour) * 60 + xMin) * 60 + xSec) * 1000;
+    }
+
+    return uEpochMs;
+}
+
 static int parseIoTCredential(const char *pcJsonSrc, size_t uJsonSrcLen, IotCredentialToken_t *pToken)
 {
     int res = KVS_ERRNO_NONE;
-    STRING_HANDLE xStJson = NULL;
-    JSON_Value *pxRootValue = NULL;
-    JSON_Object *pxRootObject = NULL;
-
-    json_set_escape_slashes(0);
+    JsonToken_t xTokens[IOT_CREDENTIAL_MAX_JSON_TOKENS];
+    size_t uTokenCount = 0;
+    const JsonToken_t *pxExpiration = NULL;
+    char pcExpiration[IOT_EXPIRATION_MAX_LEN + 1] = {0};
 
     if (pcJsonSrc == NULL || uJsonSrcLen == 0 || pToken == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
         LogError("Invalid argument");
     }
-    else if ((xStJson = STRING_construct_n(pcJsonSrc, uJsonSrcLen)) == NULL)
-    {
-        res = KVS_ERROR_OUT_OF_MEMORY;
-        LogError("OOM: parse IoT credential");
-    }
     else if (
-        (pxRootValue = json_parse_string(STRING_c_str(xStJson))) == NULL || (pxRootObject = json_value_get_object(pxRootValue)) == NULL ||
-        (pToken->pAccessKeyId = json_object_dotget_serialize_to_string(pxRootObject, "credentials.accessKeyId", true)) == NULL ||
-        (pToken->pSecretAccessKey = json_object_dotget_serialize_to_string(pxRootObject, "credentials.secretAccessKey", true)) == NULL ||
-        (pToken->pSessionToken = json_object_dotget_serialize_to_string(pxRootObject, "credentials.sessionToken", true)) == NULL)
+        json_tokenize(pcJsonSrc, uJsonSrcLen, xTokens, IOT_CREDENTIAL_MAX_JSON_TOKENS, &uTokenCount) != KVS_ERRNO_NONE ||
+        (pToken->pAccessKeyId = json_token_strdup(json_token_dotget(xTokens, uTokenCount, "credentials.accessKeyId"))) == NULL ||
+        (pToken->pSecretAccessKey = json_token_strdup(json_token_dotget(xTokens, uTokenCount, "credentials.secretAccessKey"))) == NULL ||
+        (pToken->pSessionToken = json_token_strdup(json_token_dotget(xTokens, uTokenCount, "credentials.sessionToken"))) == NULL)
     {
         res = KVS_ERROR_FAIL_TO_PARSE_JSON_OF_IOT_CREDENTIAL;
         LogError("Failed to parse IoT credential");
     }
     else
     {
-        /* nop */
-    }
-
-    if (pxRootValue != NULL)
-    {
-        json_value_free(pxRootValue);
+        /* The expiration doesn't outlive the response, so it's copied into a small buffer to be NUL terminated. */
+        if ((pxExpiration = json_token_dotget(xTokens, uTokenCount, "credentials.expiration")) != NULL && pxExpiration->uLen <= IOT_EXPIRATION_MAX_LEN)
+        {
+            memcpy(pcExpiration, pxExpiration->pcStart, pxExpiration->uLen);
+        }
+        pToken->uExpirationMs = prvIso8601ToEpochMs(pcExpiration);
     }
 
-    STRING_delete(xStJson);
-
     return res;
 }
 
@@ -86,7 +107,7 @@ IotCredentialToken_t *Iot_getCredential(IotCredentialRequest_t *pReq)
     STRING_HANDLE xStUri = NULL;
 
     unsigned int uHttpStatusCode = 0;
-    HTTP_HEADERS_HANDLE xHttpReqHeaders = NULL;
+    HttpReqHeaders_t xHttpReqHeaders = {0};
     char *pRspBody = NULL;
     size_t uRspBodyLen = 0;
 
@@ -104,9 +125,8 @@ IotCredentialToken_t *Iot_getCredential(IotCredentialRequest_t *pReq)
         LogError("OOM: Failed to allocate IoT URI");
     }
     else if (
-        (xHttpReqHeaders = HTTPHeaders_Alloc()) == NULL || HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_HOST, pReq->pCredentialHost) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, "accept", "*/*") != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZN_IOT_THINGNAME, pReq->pThingName) != HTTP_HEADERS_OK)
+        Http_addReqHeader(&xHttpReqHeaders, HDR_HOST, pReq->pCredentialHost) != KVS_ERRNO_NONE || Http_addReqHeader(&xHttpReqHeaders, "accept", "*/*") != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZN_IOT_THINGNAME, pReq->pThingName) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_GENERATE_HTTP_HEADERS;
         LogError("Failed to generate HTTP headers");
@@ -116,12 +136,14 @@ IotCredentialToken_t *Iot_getCredential(IotCredentialRequest_t *pReq)
         res = KVS_ERROR_FAIL_TO_CREATE_NETIO_HANDLE;
         LogError("Failed to create netio handle");
     }
-    else if ((res = NetIo_connectWithX509(xNetIoHandle, pReq->pCredentialHost, "443", pReq->pRootCA, pReq->pCertificate, pReq->pPrivateKey)) != KVS_ERRNO_NONE)
+    else if (
+        (res = NetIo_setTlsMaxFragmentLength(xNetIoHandle, pReq->uTlsMaxFragLen)) != KVS_ERRNO_NONE ||
+        (res = NetIo_connectWithX509(xNetIoHandle, pReq->pCredentialHost, "443", pReq->pRootCA, pReq->pCertificate, pReq->pPrivateKey)) != KVS_ERRNO_NONE)
     {
         LogError("Failed to connect to %s\r\n", pReq->pCredentialHost);
         /* Propagate the res error */
     }
-    else if ((res = Http_executeHttpReq(xNetIoHandle, HTTP_METHOD_GET, STRING_c_str(xStUri), xHttpReqHeaders, HTTP_BODY_EMPTY)) != KVS_ERRNO_NONE)
+    else if ((res = Http_executeHttpReq(xNetIoHandle, HTTP_METHOD_GET, STRING_c_str(xStUri), &xHttpReqHeaders, HTTP_BODY_EMPTY)) != KVS_ERRNO_NONE)
     {
         LogError("Failed send http request to %s", pReq->pCredentialHost);
         /* Propagate the res error */
@@ -170,7 +192,6 @@ IotCredentialToken_t *Iot_getCredential(IotCredentialRequest_t *pReq)
 
     NetIo_disconnect(xNetIoHandle);
     NetIo_terminate(xNetIoHandle);
-    HTTPHeaders_Free(xHttpReqHeaders);
     STRING_delete(xStUri);
 
     return pToken;
@@ -194,4 +215,6 @@ void Iot_credentialTerminate(IotCredentialToken_t *pToken)
         }
         kvsFree(pToken);
     }
-}
\ No newline at end of file
+}
+
+#endif /* KVS_CONFIG_IOT_CREDENTIAL */
@@ -15,16 +15,15 @@
 
 #include <ctype.h>
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 
 /* Thirdparty headers */
-#include "azure_c_shared_utility/buffer_.h"
-#include "azure_c_shared_utility/doublylinkedlist.h"
-#include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/xlogging.h"
-#include "parson.h"
 
 /* Public headers */
 #include "kvs/errors.h"
@@ -35,6 +34,7 @@
 
 /* Internal headers */
 #include "os/allocator.h"
+#include "os/endian.h"
 #include "restful/aws_signer_v4.h"
 #include "misc/json_helper.h"
 #include "net/http_helper.h"
@@ -51,7 +51,26 @@
 
 #define DEFAULT_RECV_BUFSIZE (1024)
 
+/* Fragment acks that haven't been read are kept in a ring of this size, and the oldest one is overwritten if it's full. */
+#ifndef PUT_MEDIA_FRAGMENT_ACK_RING_SIZE
+#define PUT_MEDIA_FRAGMENT_ACK_RING_SIZE (16)
+#endif
+
 #define PORT_HTTPS "443"
+#define SERVICE_PORT(pServPara) (((pServPara)->pcPort != NULL) ? (pServPara)->pcPort : PORT_HTTPS)
+
+/* Connections to control plane hosts are kept after a request, so back-to-back calls like describe stream, create
+ * stream and get data endpoint share one TLS session. Set it to 0 to disable. */
+#ifndef KVS_CONTROL_CONN_CACHE_SIZE
+#define KVS_CONTROL_CONN_CACHE_SIZE (2)
+#endif
+
+/* A cached connection that has been idle longer than this is not reused, because the server may have closed it. */
+#ifndef KVS_CONTROL_CONN_IDLE_TIMEOUT_MS
+#define KVS_CONTROL_CONN_IDLE_TIMEOUT_MS (30 * 1000)
+#endif
+
+#define KVS_CONTROL_CONN_HOST_MAX_LEN (128)
 
 /*-----------------------------------------------------------*/
 
@@ -70,32 +89,159 @@
 
 /*-----------------------------------------------------------*/
 
+/* The hex encoded SHA256 of an empty body, which is the body of PUT MEDIA requests. */
+#define EMPTY_BODY_HEX_ENCODED_SHA256 "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+
+#define PRODUCER_START_TIMESTAMP_STRING_SIZE (32)
+
+/* Template of the PUT MEDIA request line and the headers that don't change: <HOST>, <TIMECODE_TYPE>, <STREAM_NAME> */
+#define PUT_MEDIA_REQ_HEADERS_TEMPLATE                                                \
+    HTTP_METHOD_POST " " KVS_URI_PUT_MEDIA " HTTP/1.1\r\n"                          \
+    HDR_HOST ": %s\r\n"                                                             \
+    HDR_ACCEPT ": " VAL_ACCEPT_ANY "\r\n"                                           \
+    HDR_CONNECTION ": " VAL_KEEP_ALIVE "\r\n"                                       \
+    HDR_CONTENT_TYPE ": " VAL_CONTENT_TYPE_APPLICATION_jSON "\r\n"                  \
+    HDR_TRANSFER_ENCODING ": " VAL_TRANSFER_ENCODING_CHUNKED "\r\n"                 \
+    HDR_USER_AGENT ": " VAL_USER_AGENT "\r\n"                                       \
+    HDR_X_AMZN_FRAG_ACK_REQUIRED ": " VAL_FRAGMENT_ACK_REQUIRED_TRUE "\r\n"         \
+    HDR_X_AMZN_FRAG_T_TYPE ": %s\r\n"                                               \
+    HDR_X_AMZN_STREAM_NAME ": %s\r\n"                                               \
+    "expect: 100-continue\r\n"
+
+/* Template of the rest of the PUT MEDIA request: <HEADERS>, <DATE>, <TOKEN_HEADER>, <TOKEN>, <TOKEN_END>,
+ * <PRODUCER_START_TIMESTAMP>, <AUTHORIZATION> */
+#define PUT_MEDIA_REQ_TEMPLATE                                                        \
+    "%s"                                                                            \
+    HDR_X_AMZ_DATE ": %s\r\n"                                                       \
+    "%s%s%s"                                                                        \
+    HDR_X_AMZN_PRODUCER_START_T ": %s\r\n"                                          \
+    HDR_AUTHORIZATION ": %s\r\n"                                                    \
+    "\r\n"
+
+/* The canonical request of PUT MEDIA is split where the date, the security token and the producer start timestamp
+ * go, and the headers are in the same order as prvSign(). */
+#define PUT_MEDIA_CANONICAL_PREFIX_TEMPLATE                                           \
+    HTTP_METHOD_POST "\n" KVS_URI_PUT_MEDIA "\n" URI_QUERY_EMPTY "\n"                \
+    HDR_CONNECTION ":" VAL_KEEP_ALIVE "\n"                                           \
+    HDR_HOST ":%s\n"                                                                 \
+    HDR_TRANSFER_ENCODING ":" VAL_TRANSFER_ENCODING_CHUNKED "\n"                     \
+    HDR_USER_AGENT ":" VAL_USER_AGENT "\n"                                           \
+    HDR_X_AMZ_DATE ":"
+
+#define PUT_MEDIA_CANONICAL_TOKEN_HEADER "\n" HDR_X_AMZ_SECURITY_TOKEN ":"
+
+#define PUT_MEDIA_CANONICAL_MIDDLE_TEMPLATE                                           \
+    "\n" HDR_X_AMZN_FRAG_ACK_REQUIRED ":" VAL_FRAGMENT_ACK_REQUIRED_TRUE             \
+    "\n" HDR_X_AMZN_FRAG_T_TYPE ":%s"                                                \
+    "\n" HDR_X_AMZN_PRODUCER_START_T ":"
+
+#define PUT_MEDIA_CANONICAL_SUFFIX_TEMPLATE                                           \
+    "\n" HDR_X_AMZN_STREAM_NAME ":%s\n"                                             \
+    "\n%s\n" EMPTY_BODY_HEX_ENCODED_SHA256
+
+/* Template of PUT MEDIA signed headers: <TOKEN_HEADER_NAME> */
+#define PUT_MEDIA_SIGNED_HEADERS_TEMPLATE                                             \
+    HDR_CONNECTION ";" HDR_HOST ";" HDR_TRANSFER_ENCODING ";" HDR_USER_AGENT ";"    \
+    HDR_X_AMZ_DATE "%s;" HDR_X_AMZN_FRAG_ACK_REQUIRED ";" HDR_X_AMZN_FRAG_T_TYPE ";" \
+    HDR_X_AMZN_PRODUCER_START_T ";" HDR_X_AMZN_STREAM_NAME
+
+/*-----------------------------------------------------------*/
+
 typedef struct
 {
     ePutMediaFragmentAckEventType eventType;
     uint64_t uFragmentTimecode;
     unsigned int uErrorId;
-
-    DLIST_ENTRY xAckEntry;
 } FragmentAck_t;
 
+typedef enum PutMediaStartState
+{
+    PUT_MEDIA_STARTED = 0,
+    PUT_MEDIA_CONNECTING,
+    PUT_MEDIA_CONNECTED, /* Connected, and waiting for Kvs_putMediaStartRequest() */
+    PUT_MEDIA_WAIT_RESPONSE
+} PutMediaStartState_t;
+
 typedef struct PutMedia
 {
     LOCK_HANDLE xLock;
 
     NetIoHandle xNetIoHandle;
-    DLIST_ENTRY xPendingFragmentAcks;
+
+    /* Ring of fragment acks that haven't been read. It's guarded by xLock. */
+    FragmentAck_t pxFragmentAcks[PUT_MEDIA_FRAGMENT_ACK_RING_SIZE];
+    size_t uFragmentAckHead;
+    size_t uFragmentAckCount;
+
+    /* Invoked for every parsed fragment ack, and acks are not queued if it's the only consumer */
+    OnPutMediaFragmentAckCallback_t onFragmentAck;
+    void *pFragmentAckAppData;
+    bool bFragmentAckCallbackOnly;
+
+    /* Received bytes that haven't been parsed into fragment acks yet. A partial ack at the end is carried over to the
+     * next call of Kvs_putMediaDoWork. */
+    uint8_t pRecvBuf[DEFAULT_RECV_BUFSIZE];
+    size_t uRecvLen;
+
+    /* States of a handle from Kvs_putMediaStartAsync() before the HTTP response is received. The timeouts are
+     * applied to streaming once it's started. */
+    PutMediaStartState_t xStartState;
+    char *pcHttpReq;
+    size_t uHttpReqLen;
+    unsigned int uConnTimeoutMs;
+    unsigned int uRecvTimeoutMs;
+    unsigned int uSendTimeoutMs;
+    uint64_t uRspDeadlineMs;
 } PutMedia_t;
 
+typedef struct PutMediaTemplate
+{
+    /* The parameters that the template is built from. It's rebuilt if any of them changes. */
+    STRING_HANDLE xStHost;
+    STRING_HANDLE xStStreamName;
+    FragmentTimecodeType_t xTimecodeType;
+    bool bHasToken;
+
+    STRING_HANDLE xStReqHeaders;
+    STRING_HANDLE xStCanonicalPrefix;
+    STRING_HANDLE xStCanonicalMiddle;
+    STRING_HANDLE xStCanonicalSuffix;
+    STRING_HANDLE xStSignedHeaders;
+
+    /* The canonical request buffer and the SigV4 handle are reused by every start. */
+    char *pcCanonicalBuf;
+    size_t uCanonicalBufSize;
+    AwsSigV4Handle xAwsSigV4Handle;
+} PutMediaTemplate_t;
+
+#if KVS_CONTROL_CONN_CACHE_SIZE > 0
+typedef struct ControlConnEntry
+{
+    char pcHost[KVS_CONTROL_CONN_HOST_MAX_LEN];
+    NetIoHandle xNetIoHandle;
+    uint64_t uLastUsedMs;
+} ControlConnEntry_t;
+
+static ControlConnEntry_t gxControlConnCache[KVS_CONTROL_CONN_CACHE_SIZE];
+static LOCK_HANDLE gxControlConnCacheLock = NULL;
+#endif /* KVS_CONTROL_CONN_CACHE_SIZE > 0 */
+
 #define JSON_KEY_EVENT_TYPE "EventType"
 #define JSON_KEY_FRAGMENT_TIMECODE "FragmentTimecode"
 #define JSON_KEY_ERROR_ID "ErrorId"
 
-#define EVENT_TYPE_BUFFERING "\"BUFFERING\""
-#define EVENT_TYPE_RECEIVED "\"RECEIVED\""
-#define EVENT_TYPE_PERSISTED "\"PERSISTED\""
-#define EVENT_TYPE_ERROR "\"ERROR\""
-#define EVENT_TYPE_IDLE "\"IDLE\""
+/* Tokens of a fragment ack, which has 5 keys at most, so there are some left for keys that may be added later. */
+#define FRAGMENT_ACK_MAX_JSON_TOKENS (24)
+
+/* Tokens of a GetDataEndpoint response */
+#define DATA_ENDPOINT_MAX_JSON_TOKENS (8)
+#define DATA_ENDPOINT_SCHEME "https://"
+
+#define EVENT_TYPE_BUFFERING "BUFFERING"
+#define EVENT_TYPE_RECEIVED "RECEIVED"
+#define EVENT_TYPE_PERSISTED "PERSISTED"
+#define EVENT_TYPE_ERROR "ERROR"
+#define EVENT_TYPE_IDLE "IDLE"
 
 /*-----------------------------------------------------------*/
 
@@ -160,7 +306,7 @@ static int prvValidatePutMediaParameter(KvsPutMediaParameter_t *pPutMediaPara)
     }
 }
 
-static AwsSigV4Handle prvSign(KvsServiceParameter_t *pServPara, char *pcUri, char *pcQuery, HTTP_HEADERS_HANDLE xHeadersToSign, const char *pcHttpBody)
+static AwsSigV4Handle prvSign(KvsServiceParameter_t *pServPara, char *pcUri, char *pcQuery, const HttpReqHeaders_t *pxHeadersToSign, const char *pcHttpBody)
 {
     int res = KVS_ERRNO_NONE;
 
@@ -172,56 +318,56 @@ static AwsSigV4Handle prvSign(KvsServiceParameter_t *pServPara, char *pcUri, cha
     {
         res = KVS_ERROR_FAIL_TO_CREATE_SIGV4_HANDLE;
     }
-    else if ((pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_CONNECTION)) != NULL && AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_CONNECTION, pcVal) != KVS_ERRNO_NONE)
+    else if ((pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_CONNECTION)) != NULL && AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_CONNECTION, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
-    else if ((pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_HOST)) != NULL && AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_HOST, pcVal) != KVS_ERRNO_NONE)
+    else if ((pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_HOST)) != NULL && AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_HOST, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
     else if (
-        (pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_TRANSFER_ENCODING)) != NULL &&
+        (pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_TRANSFER_ENCODING)) != NULL &&
         AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_TRANSFER_ENCODING, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
-    else if ((pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_USER_AGENT)) != NULL && AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_USER_AGENT, pcVal) != KVS_ERRNO_NONE)
+    else if ((pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_USER_AGENT)) != NULL && AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_USER_AGENT, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
     else if (
-        (pcXAmzDate = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_X_AMZ_DATE)) != NULL &&
+        (pcXAmzDate = Http_findReqHeaderValue(pxHeadersToSign, HDR_X_AMZ_DATE)) != NULL &&
         AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_X_AMZ_DATE, pcXAmzDate) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
     else if (
-        (pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_X_AMZ_SECURITY_TOKEN)) != NULL &&
+        (pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_X_AMZ_SECURITY_TOKEN)) != NULL &&
         AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_X_AMZ_SECURITY_TOKEN, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
     else if (
-        (pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_X_AMZN_FRAG_ACK_REQUIRED)) != NULL &&
+        (pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_X_AMZN_FRAG_ACK_REQUIRED)) != NULL &&
         AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_X_AMZN_FRAG_ACK_REQUIRED, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
     else if (
-        (pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_X_AMZN_FRAG_T_TYPE)) != NULL &&
+        (pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_X_AMZN_FRAG_T_TYPE)) != NULL &&
         AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_X_AMZN_FRAG_T_TYPE, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
     else if (
-        (pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_X_AMZN_PRODUCER_START_T)) != NULL &&
+        (pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_X_AMZN_PRODUCER_START_T)) != NULL &&
         AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_X_AMZN_PRODUCER_START_T, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
     }
     else if (
-        (pcVal = HTTPHeaders_FindHeaderValue(xHeadersToSign, HDR_X_AMZN_STREAM_NAME)) != NULL &&
+        (pcVal = Http_findReqHeaderValue(pxHeadersToSign, HDR_X_AMZN_STREAM_NAME)) != NULL &&
         AwsSigV4_AddCanonicalHeader(xAwsSigV4Handle, HDR_X_AMZN_STREAM_NAME, pcVal) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_ADD_CANONICAL_HEADER;
@@ -251,55 +397,44 @@ static AwsSigV4Handle prvSign(KvsServiceParameter_t *pServPara, char *pcUri, cha
 static int prvParseDataEndpoint(const char *pcJsonSrc, size_t uJsonSrcLen, char **ppcEndpoint)
 {
     int res = KVS_ERRNO_NONE;
-    STRING_HANDLE xStJson = NULL;
-    JSON_Value *pxRootValue = NULL;
-    JSON_Object *pxRootObject = NULL;
+    JsonToken_t xTokens[DATA_ENDPOINT_MAX_JSON_TOKENS];
+    size_t uTokenCount = 0;
+    const JsonToken_t *pxDataEndpoint = NULL;
     char *pcDataEndpoint = NULL;
     size_t uEndpointLen = 0;
 
-    json_set_escape_slashes(0);
-
     if (pcJsonSrc == NULL || uJsonSrcLen == 0 || ppcEndpoint == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
         LogError("Invalid argument");
     }
-    else if ((xStJson = STRING_construct_n(pcJsonSrc, uJsonSrcLen)) == NULL)
-    {
-        res = KVS_ERROR_OUT_OF_MEMORY;
-        LogError("OOM: parse data endpoint");
-    }
     else if (
-        (pxRootValue = json_parse_string(STRING_c_str(xStJson))) == NULL || (pxRootObject = json_value_get_object(pxRootValue)) == NULL ||
-        (pcDataEndpoint = json_object_dotget_serialize_to_string(pxRootObject, "DataEndpoint", true)) == NULL)
+        json_tokenize(pcJsonSrc, uJsonSrcLen, xTokens, DATA_ENDPOINT_MAX_JSON_TOKENS, &uTokenCount) != KVS_ERRNO_NONE ||
+        (pxDataEndpoint = json_token_dotget(xTokens, uTokenCount, "DataEndpoint")) == NULL || pxDataEndpoint->xType != JSON_TOKEN_STRING)
     {
         res = KVS_ERROR_FAIL_TO_PARSE_DATA_ENDPOINT;
         LogError("Failed to parse data endpoint");
     }
+    else if ((pcDataEndpoint = json_token_strdup(pxDataEndpoint)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: parse data endpoint");
+    }
     else
     {
-        /* Please note that the memory of pcDataEndpoint is from malloc and we tranfer the ownership to caller here. */
+        /* The scheme is removed in place, and the ownership of pcDataEndpoint is transferred to caller. */
         uEndpointLen = strlen(pcDataEndpoint);
-        if (uEndpointLen > 8)
+        if (uEndpointLen > sizeof(DATA_ENDPOINT_SCHEME) - 1)
         {
-            uEndpointLen -= 8;
-            *ppcEndpoint = (char *)kvsMalloc(uEndpointLen + 1);
-            if (*ppcEndpoint != NULL)
-            {
-                memcpy(*ppcEndpoint, pcDataEndpoint + 8, uEndpointLen);
-                (*ppcEndpoint)[uEndpointLen] = '\0';
-            }
+            memmove(pcDataEndpoint, pcDataEndpoint + sizeof(DATA_ENDPOINT_SCHEME) - 1, uEndpointLen - (sizeof(DATA_ENDPOINT_SCHEME) - 1) + 1);
+            *ppcEndpoint = pcDataEndpoint;
+        }
+        else
+        {
+            kvsFree(pcDataEndpoint);
         }
-        kvsFree(pcDataEndpoint);
-    }
-
-    if (pxRootValue != NULL)
-    {
-        json_value_free(pxRootValue);
     }
 
-    STRING_delete(xStJson);
-
     return res;
 }
 
@@ -320,23 +455,19 @@ static char *prvGetTimecodeValue(FragmentTimecodeType_t xTimecodeType)
     }
 }
 
-static int prvGetEpochTimestampInStr(uint64_t uProducerStartTimestampMs, STRING_HANDLE *pxStProducerStartTimestamp)
+static int prvGetEpochTimestampInBuf(uint64_t uProducerStartTimestampMs, char *pcBuf, size_t uBufSize)
 {
     int res = KVS_ERRNO_NONE;
     uint64_t uProducerStartTimestamp = 0;
-    STRING_HANDLE xStProducerStartTimestamp = NULL;
+    int xLen = 0;
 
     uProducerStartTimestamp = (uProducerStartTimestampMs == 0) ? getEpochTimestampInMs() : uProducerStartTimestampMs;
-    xStProducerStartTimestamp = STRING_construct_sprintf("%." PRIu64 ".%03d", uProducerStartTimestamp / 1000, uProducerStartTimestamp % 1000);
+    xLen = snprintf(pcBuf, uBufSize, "%." PRIu64 ".%03d", uProducerStartTimestamp / 1000, (int)(uProducerStartTimestamp % 1000));
 
-    if (xStProducerStartTimestamp == NULL)
+    if (xLen <= 0 || xLen >= (int)uBufSize)
     {
         res = KVS_ERROR_C_UTIL_STRING_ERROR;
     }
-    else
-    {
-        *pxStProducerStartTimestamp = xStProducerStartTimestamp;
-    }
 
     return res;
 }
@@ -380,13 +511,20 @@ static int prvParseFragmentAckLength(char *pcSrc, size_t uLen, size_t *puMsgLen,
             else
             {
                 res = KVS_ERROR_FAIL_TO_PARSE_FRAGMENT_ACK_LENGTH;
+                break;
             }
         }
     }
 
     if (res == KVS_ERRNO_NONE)
     {
-        if (uBytesRead < 3 || (uBytesRead + uMsgLen + 2) > uLen || pcSrc[uBytesRead + uMsgLen] != '\r' || pcSrc[uBytesRead + uMsgLen + 1] != '\n')
+        /* It's compared without adding uMsgLen, so a huge length can't wrap around. */
+        if (uBytesRead == 0 || uBytesRead + 2 > uLen || uMsgLen > uLen - uBytesRead - 2)
+        {
+            /* The rest of the ack hasn't been received yet. */
+            res = KVS_ERROR_INCOMPLETE_FRAGMENT_ACK;
+        }
+        else if (uBytesRead < 3 || pcSrc[uBytesRead + uMsgLen] != '\r' || pcSrc[uBytesRead + uMsgLen + 1] != '\n')
         {
             res = KVS_ERROR_FAIL_TO_PARSE_FRAGMENT_ACK_LENGTH;
         }
@@ -400,29 +538,29 @@ static int prvParseFragmentAckLength(char *pcSrc, size_t uLen, size_t *puMsgLen,
     return res;
 }
 
-static ePutMediaFragmentAckEventType prvGetEventType(char *pcEventType)
+static ePutMediaFragmentAckEventType prvGetEventType(const JsonToken_t *pxEventType)
 {
     ePutMediaFragmentAckEventType ev = eUnknown;
 
-    if (pcEventType != NULL)
+    if (pxEventType != NULL && pxEventType->xType == JSON_TOKEN_STRING)
     {
-        if (strncmp(pcEventType, EVENT_TYPE_BUFFERING, sizeof(EVENT_TYPE_BUFFERING) - 1) == 0)
+        if (json_token_equals(pxEventType, EVENT_TYPE_BUFFERING))
         {
             ev = eBuffering;
         }
-        else if (strncmp(pcEventType, EVENT_TYPE_RECEIVED, sizeof(EVENT_TYPE_RECEIVED) - 1) == 0)
+        else if (json_token_equals(pxEventType, EVENT_TYPE_RECEIVED))
         {
             ev = eReceived;
         }
-        else if (strncmp(pcEventType, EVENT_TYPE_PERSISTED, sizeof(EVENT_TYPE_PERSISTED) - 1) == 0)
+        else if (json_token_equals(pxEventType, EVENT_TYPE_PERSISTED))
         {
             ev = ePersisted;
         }
-        else if (strncmp(pcEventType, EVENT_TYPE_ERROR, sizeof(EVENT_TYPE_ERROR) - 1) == 0)
+        else if (json_token_equals(pxEventType, EVENT_TYPE_ERROR))
         {
             ev = eError;
         }
-        else if (strncmp(pcEventType, EVENT_TYPE_IDLE, sizeof(EVENT_TYPE_IDLE) - 1) == 0)
+        else if (json_token_equals(pxEventType, EVENT_TYPE_IDLE))
         {
             ev = eIdle;
         }
@@ -431,51 +569,44 @@ static ePutMediaFragmentAckEventType prvGetEventType(char *pcEventType)
     return ev;
 }
 
-static int parseFragmentMsg(const char *pcFragmentMsg, FragmentAck_t *pxFragmentAck)
+/**
+ * Parse a fragment ack message in place without allocation. Fragment acks are small objects with a fixed schema, e.g.
+ * {"EventType":"PERSISTED","FragmentTimecode":1234,"FragmentNumber":"9123..."}, so unknown keys are skipped and only
+ * the fields of FragmentAck_t are picked up.
+ */
+static int prvParseFragmentMsg(const char *pcMsg, size_t uMsgLen, FragmentAck_t *pxFragmentAck)
 {
     int res = KVS_ERRNO_NONE;
-    JSON_Value *pxRootValue = NULL;
-    JSON_Object *pxRootObject = NULL;
-    char *pcEventType = NULL;
+    JsonToken_t xTokens[FRAGMENT_ACK_MAX_JSON_TOKENS];
+    size_t uTokenCount = 0;
+    const JsonToken_t *pxEventType = NULL;
 
-    json_set_escape_slashes(0);
-
-    if (pcFragmentMsg == NULL || pxFragmentAck == NULL)
-    {
-        res = KVS_ERROR_INVALID_ARGUMENT;
-        LogError("Invalid argument");
-    }
-    else if ((pxRootValue = json_parse_string(pcFragmentMsg)) == NULL || (pxRootObject = json_value_get_object(pxRootValue)) == NULL)
+    if (json_tokenize(pcMsg, uMsgLen, xTokens, FRAGMENT_ACK_MAX_JSON_TOKENS, &uTokenCount) != KVS_ERRNO_NONE || uTokenCount == 0 ||
+        xTokens[0].xType != JSON_TOKEN_OBJECT)
     {
         res = KVS_ERROR_FAIL_TO_PARSE_FRAGMENT_ACK_MSG;
-        LogInfo("Failed to parse fragment msg:%s", pcFragmentMsg);
+        LogInfo("Failed to parse fragment msg:%.*s", (int)uMsgLen, pcMsg);
     }
-    else if ((pcEventType = json_object_dotget_serialize_to_string(pxRootObject, JSON_KEY_EVENT_TYPE, false)) == NULL)
+    else if ((pxEventType = json_token_dotget(xTokens, uTokenCount, JSON_KEY_EVENT_TYPE)) == NULL)
     {
         res = KVS_ERROR_UNKNOWN_FRAGMENT_ACK_TYPE;
-        LogInfo("Unknown fragment ack:%s", pcFragmentMsg);
+        LogInfo("Unknown fragment ack:%.*s", (int)uMsgLen, pcMsg);
     }
     else
     {
-        pxFragmentAck->eventType = prvGetEventType(pcEventType);
-        kvsFree(pcEventType);
+        pxFragmentAck->eventType = prvGetEventType(pxEventType);
 
         if (pxFragmentAck->eventType == eBuffering || pxFragmentAck->eventType == eReceived || pxFragmentAck->eventType == ePersisted ||
             pxFragmentAck->eventType == eError)
         {
-            pxFragmentAck->uFragmentTimecode = json_object_dotget_uint64(pxRootObject, JSON_KEY_FRAGMENT_TIMECODE, 10);
+            pxFragmentAck->uFragmentTimecode = json_token_to_uint64(json_token_dotget(xTokens, uTokenCount, JSON_KEY_FRAGMENT_TIMECODE));
             if (pxFragmentAck->eventType == eError)
             {
-                pxFragmentAck->uErrorId = (unsigned int)json_object_dotget_uint64(pxRootObject, JSON_KEY_ERROR_ID, 10);
+                pxFragmentAck->uErrorId = (unsigned int)json_token_to_uint64(json_token_dotget(xTokens, uTokenCount, JSON_KEY_ERROR_ID));
             }
         }
     }
 
-    if (pxRootValue != NULL)
-    {
-        json_value_free(pxRootValue);
-    }
-
     return res;
 }
 
@@ -484,7 +615,6 @@ static int prvParseFragmentAck(char *pcSrc, size_t uLen, FragmentAck_t *pxFragAc
     int res = KVS_ERRNO_NONE;
     size_t uMsgLen = 0;
     size_t uBytesRead = 0;
-    STRING_HANDLE xStFragMsg = NULL;
 
     if (pcSrc == NULL || uLen == 0 || pxFragAck == NULL || puFragAckLen == NULL)
     {
@@ -493,11 +623,13 @@ static int prvParseFragmentAck(char *pcSrc, size_t uLen, FragmentAck_t *pxFragAc
     }
     else if ((res = prvParseFragmentAckLength(pcSrc, uLen, &uMsgLen, &uBytesRead)) != KVS_ERRNO_NONE)
     {
-        LogInfo("Unknown fragment ack:%.*s", (int)uLen, pcSrc);
+        if (res != KVS_ERROR_INCOMPLETE_FRAGMENT_ACK)
+        {
+            LogInfo("Unknown fragment ack:%.*s", (int)uLen, pcSrc);
+        }
         /* Propagate the res error */
     }
-    else if ((xStFragMsg = STRING_construct_n(pcSrc + uBytesRead, uMsgLen)) == NULL ||
-             parseFragmentMsg(STRING_c_str(xStFragMsg), pxFragAck) != KVS_ERRNO_NONE)
+    else if (prvParseFragmentMsg(pcSrc + uBytesRead, uMsgLen, pxFragAck) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_PARSE_FRAGMENT_ACK_MSG;
         LogInfo("Failed to parse fragment ack");
@@ -507,7 +639,29 @@ static int prvParseFragmentAck(char *pcSrc, size_t uLen, FragmentAck_t *pxFragAc
         *puFragAckLen = uBytesRead + uMsgLen + 2;
     }
 
-    STRING_delete(xStFragMsg);
+    return res;
+}
+
+int Kvs_parseFragmentAck(const char *pcSrc, size_t uLen, ePutMediaFragmentAckEventType *peAckEventType, uint64_t *puFragmentTimecode, unsigned int *puErrorId, size_t *puFragAckLen)
+{
+    int res = KVS_ERRNO_NONE;
+    FragmentAck_t xFragmentAck = {0};
+
+    if (peAckEventType == NULL || puFragmentTimecode == NULL || puErrorId == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((res = prvParseFragmentAck((char *)pcSrc, uLen, &xFragmentAck, puFragAckLen)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        *peAckEventType = xFragmentAck.eventType;
+        *puFragmentTimecode = xFragmentAck.uFragmentTimecode;
+        *puErrorId = xFragmentAck.uErrorId;
+    }
 
     return res;
 }
@@ -545,20 +699,13 @@ static void prvLogFragmentAck(FragmentAck_t *pFragmentAck)
 
 static void prvLogPendingFragmentAcks(PutMedia_t *pPutMedia)
 {
-    PDLIST_ENTRY pxListHead = NULL;
-    PDLIST_ENTRY pxListItem = NULL;
-    FragmentAck_t *pFragmentAck = NULL;
+    size_t i = 0;
 
     if (pPutMedia != NULL && Lock(pPutMedia->xLock) == LOCK_OK)
     {
-        pxListHead = &(pPutMedia->xPendingFragmentAcks);
-        pxListItem = pxListHead->Flink;
-        while (pxListItem != pxListHead)
+        for (i = 0; i < pPutMedia->uFragmentAckCount; i++)
         {
-            pFragmentAck = containingRecord(pxListItem, FragmentAck_t, xAckEntry);
-            prvLogFragmentAck(pFragmentAck);
-
-            pxListItem = pxListItem->Flink;
+            prvLogFragmentAck(&(pPutMedia->pxFragmentAcks[(pPutMedia->uFragmentAckHead + i) % PUT_MEDIA_FRAGMENT_ACK_RING_SIZE]));
         }
 
         Unlock(pPutMedia->xLock);
@@ -568,39 +715,30 @@ static void prvLogPendingFragmentAcks(PutMedia_t *pPutMedia)
 static int prvPushFragmentAck(PutMedia_t *pPutMedia, FragmentAck_t *pFragmentAckSrc)
 {
     int res = KVS_ERRNO_NONE;
-    FragmentAck_t *pFragmentAck = NULL;
+    size_t uTail = 0;
 
     if (pPutMedia == NULL || pFragmentAckSrc == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
     }
-    else if ((pFragmentAck = (FragmentAck_t *)kvsMalloc(sizeof(FragmentAck_t))) == NULL)
+    else if (Lock(pPutMedia->xLock) != LOCK_OK)
     {
-        res = KVS_ERROR_OUT_OF_MEMORY;
+        res = KVS_ERROR_LOCK_ERROR;
     }
     else
     {
-        memcpy(pFragmentAck, pFragmentAckSrc, sizeof(FragmentAck_t));
-        DList_InitializeListHead(&(pFragmentAck->xAckEntry));
-
-        if (Lock(pPutMedia->xLock) != LOCK_OK)
+        if (pPutMedia->uFragmentAckCount == PUT_MEDIA_FRAGMENT_ACK_RING_SIZE)
         {
-            res = KVS_ERROR_LOCK_ERROR;
+            /* Overwrite the oldest one if nobody reads them. */
+            pPutMedia->uFragmentAckHead = (pPutMedia->uFragmentAckHead + 1) % PUT_MEDIA_FRAGMENT_ACK_RING_SIZE;
+            pPutMedia->uFragmentAckCount--;
         }
-        else
-        {
-            DList_InsertTailList(&(pPutMedia->xPendingFragmentAcks), &(pFragmentAck->xAckEntry));
 
-            Unlock(pPutMedia->xLock);
-        }
-    }
+        uTail = (pPutMedia->uFragmentAckHead + pPutMedia->uFragmentAckCount) % PUT_MEDIA_FRAGMENT_ACK_RING_SIZE;
+        memcpy(&(pPutMedia->pxFragmentAcks[uTail]), pFragmentAckSrc, sizeof(FragmentAck_t));
+        pPutMedia->uFragmentAckCount++;
 
-    if (res != KVS_ERRNO_NONE)
-    {
-        if (pFragmentAck != NULL)
-        {
-            kvsFree(pFragmentAck);
-        }
+        Unlock(pPutMedia->xLock);
     }
 
     return res;
@@ -611,7 +749,7 @@ static PutMedia_t *prvCreateDefaultPutMediaHandle()
     int res = KVS_ERRNO_NONE;
     PutMedia_t *pPutMedia = NULL;
 
-    if ((pPutMedia = (PutMedia_t *)kvsMalloc(sizeof(PutMedia_t))) == NULL)
+    if ((pPutMedia = (PutMedia_t *)kvsMallocClass(sizeof(PutMedia_t), KVS_ALLOC_CLASS_METADATA)) == NULL)
     {
         res = KVS_ERROR_OUT_OF_MEMORY;
         LogError("OOM: pPutMedia");
@@ -627,7 +765,7 @@ static PutMedia_t *prvCreateDefaultPutMediaHandle()
         }
         else
         {
-            DList_InitializeListHead(&(pPutMedia->xPendingFragmentAcks));
+            /* nop */
         }
     }
 
@@ -647,34 +785,236 @@ static PutMedia_t *prvCreateDefaultPutMediaHandle()
     return pPutMedia;
 }
 
-static FragmentAck_t *prvReadFragmentAck(PutMedia_t *pPutMedia)
+static bool prvReadFragmentAck(PutMedia_t *pPutMedia, FragmentAck_t *pxFragmentAck)
 {
-    int res = KVS_ERRNO_NONE;
-    PDLIST_ENTRY pxListHead = NULL;
-    PDLIST_ENTRY pxListItem = NULL;
-    FragmentAck_t *pFragmentAck = NULL;
+    bool bRead = false;
 
     if (Lock(pPutMedia->xLock) == LOCK_OK)
     {
-        if (!DList_IsListEmpty(&(pPutMedia->xPendingFragmentAcks)))
+        if (pPutMedia->uFragmentAckCount > 0)
         {
-            pxListHead = &(pPutMedia->xPendingFragmentAcks);
-            pxListItem = DList_RemoveHeadList(pxListHead);
-            pFragmentAck = containingRecord(pxListItem, FragmentAck_t, xAckEntry);
+            memcpy(pxFragmentAck, &(pPutMedia->pxFragmentAcks[pPutMedia->uFragmentAckHead]), sizeof(FragmentAck_t));
+            pPutMedia->uFragmentAckHead = (pPutMedia->uFragmentAckHead + 1) % PUT_MEDIA_FRAGMENT_ACK_RING_SIZE;
+            pPutMedia->uFragmentAckCount--;
+            bRead = true;
         }
         Unlock(pPutMedia->xLock);
     }
 
-    return pFragmentAck;
+    return bRead;
 }
 
 static void prvFlushFragmentAck(PutMedia_t *pPutMedia)
 {
-    FragmentAck_t *pFragmentAck = NULL;
-    while ((pFragmentAck = prvReadFragmentAck(pPutMedia)) != NULL)
+    if (Lock(pPutMedia->xLock) == LOCK_OK)
+    {
+        pPutMedia->uFragmentAckHead = 0;
+        pPutMedia->uFragmentAckCount = 0;
+        Unlock(pPutMedia->xLock);
+    }
+}
+
+#if KVS_CONTROL_CONN_CACHE_SIZE > 0
+static bool prvControlConnCacheLock(void)
+{
+    LOCK_HANDLE xLock = __atomic_load_n(&gxControlConnCacheLock, __ATOMIC_ACQUIRE);
+    LOCK_HANDLE xPublished = NULL;
+
+    /* The lock is created on the first request and never released, so it's shared by all requests. Requests that race
+     * to create it all use the one that is published first. */
+    if (xLock == NULL && (xLock = Lock_Init()) != NULL && !__atomic_compare_exchange_n(&gxControlConnCacheLock, &xPublished, xLock, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        /* Another thread created it first. */
+        Lock_Deinit(xLock);
+        xLock = xPublished;
+    }
+
+    return (xLock != NULL && Lock(xLock) == LOCK_OK);
+}
+
+static void prvControlConnClose(NetIoHandle xNetIoHandle)
+{
+    NetIo_disconnect(xNetIoHandle);
+    NetIo_terminate(xNetIoHandle);
+}
+
+/* Take a cached connection of the host out of the cache, so no other request uses it at the same time. */
+static NetIoHandle prvControlConnTake(const char *pcHost)
+{
+    NetIoHandle xNetIoHandle = NULL;
+    NetIoHandle xExpiredHandle = NULL;
+    size_t i = 0;
+
+    if (prvControlConnCacheLock())
+    {
+        for (i = 0; i < KVS_CONTROL_CONN_CACHE_SIZE; i++)
+        {
+            if (gxControlConnCache[i].xNetIoHandle != NULL && strcmp(gxControlConnCache[i].pcHost, pcHost) == 0)
+            {
+                if (getMonotonicTimeInMs() - gxControlConnCache[i].uLastUsedMs < KVS_CONTROL_CONN_IDLE_TIMEOUT_MS)
+                {
+                    xNetIoHandle = gxControlConnCache[i].xNetIoHandle;
+                }
+                else
+                {
+                    xExpiredHandle = gxControlConnCache[i].xNetIoHandle;
+                }
+                gxControlConnCache[i].xNetIoHandle = NULL;
+                break;
+            }
+        }
+        Unlock(gxControlConnCacheLock);
+    }
+
+    if (xExpiredHandle != NULL)
+    {
+        prvControlConnClose(xExpiredHandle);
+    }
+
+    return xNetIoHandle;
+}
+
+/* Put a connection back to the cache. It replaces the least recently used one if the cache is full. */
+static void prvControlConnPut(const char *pcHost, NetIoHandle xNetIoHandle)
+{
+    ControlConnEntry_t *pxEntry = NULL;
+    NetIoHandle xEvictedHandle = xNetIoHandle;
+    size_t i = 0;
+
+    if (strlen(pcHost) < KVS_CONTROL_CONN_HOST_MAX_LEN && prvControlConnCacheLock())
+    {
+        pxEntry = &(gxControlConnCache[0]);
+        for (i = 0; i < KVS_CONTROL_CONN_CACHE_SIZE; i++)
+        {
+            if (gxControlConnCache[i].xNetIoHandle == NULL)
+            {
+                pxEntry = &(gxControlConnCache[i]);
+                break;
+            }
+            else if (gxControlConnCache[i].uLastUsedMs < pxEntry->uLastUsedMs)
+            {
+                pxEntry = &(gxControlConnCache[i]);
+            }
+        }
+
+        xEvictedHandle = pxEntry->xNetIoHandle;
+        snprintf(pxEntry->pcHost, KVS_CONTROL_CONN_HOST_MAX_LEN, "%s", pcHost);
+        pxEntry->xNetIoHandle = xNetIoHandle;
+        pxEntry->uLastUsedMs = getMonotonicTimeInMs();
+        Unlock(gxControlConnCacheLock);
+    }
+
+    if (xEvictedHandle != NULL)
+    {
+        prvControlConnClose(xEvictedHandle);
+    }
+}
+#endif /* KVS_CONTROL_CONN_CACHE_SIZE > 0 */
+
+static int prvSendControlReq(KvsServiceParameter_t *pServPara, NetIoHandle *pxNetIoHandle, const char *pcUri, const HttpReqHeaders_t *pxHttpReqHeaders, const char *pcBody, unsigned int *puHttpStatusCode, char **ppRspBody, size_t *puRspBodyLen)
+{
+    int res = KVS_ERRNO_NONE;
+    bool bConnected = (*pxNetIoHandle != NULL);
+
+    if (!bConnected && (*pxNetIoHandle = NetIo_create()) == NULL)
+    {
+        res = KVS_ERROR_FAIL_TO_CREATE_NETIO_HANDLE;
+        LogError("Failed to create NetIo handle");
+    }
+    else if (
+        (res = NetIo_setRecvTimeout(*pxNetIoHandle, pServPara->uRecvTimeoutMs)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setSendTimeout(*pxNetIoHandle, pServPara->uSendTimeoutMs)) != KVS_ERRNO_NONE ||
+        (!bConnected && (res = NetIo_setTlsMaxFragmentLength(*pxNetIoHandle, pServPara->uTlsMaxFragLen)) != KVS_ERRNO_NONE) ||
+        (!bConnected && (res = NetIo_connect(*pxNetIoHandle, pServPara->pcHost, SERVICE_PORT(pServPara))) != KVS_ERRNO_NONE))
+    {
+        LogError("Failed to connect to %s", pServPara->pcHost);
+        /* Propagate the res error */
+    }
+    else if ((res = Http_executeHttpReq(*pxNetIoHandle, HTTP_METHOD_POST, pcUri, pxHttpReqHeaders, pcBody)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed send http request to %s", pServPara->pcHost);
+        /* Propagate the res error */
+    }
+    else if ((res = Http_recvHttpRsp(*pxNetIoHandle, puHttpStatusCode, ppRspBody, puRspBodyLen)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed recv http response from %s", pServPara->pcHost);
+        /* Propagate the res error */
+    }
+    else
+    {
+        /* nop */
+    }
+
+    if (res != KVS_ERRNO_NONE && *pxNetIoHandle != NULL)
+    {
+        NetIo_disconnect(*pxNetIoHandle);
+        NetIo_terminate(*pxNetIoHandle);
+        *pxNetIoHandle = NULL;
+    }
+
+    return res;
+}
+
+/**
+ * Send a control plane request and receive its response. A cached connection to the host is used if there is one, and
+ * the request is sent again on a new connection if the server has closed the cached one.
+ */
+static int prvExecuteControlReq(KvsServiceParameter_t *pServPara, const char *pcUri, const HttpReqHeaders_t *pxHttpReqHeaders, const char *pcBody, unsigned int *puHttpStatusCode, char **ppRspBody, size_t *puRspBodyLen)
+{
+    int res = KVS_ERRNO_NONE;
+    NetIoHandle xNetIoHandle = NULL;
+
+#if KVS_CONTROL_CONN_CACHE_SIZE > 0
+    if ((xNetIoHandle = prvControlConnTake(pServPara->pcHost)) != NULL &&
+        prvSendControlReq(pServPara, &xNetIoHandle, pcUri, pxHttpReqHeaders, pcBody, puHttpStatusCode, ppRspBody, puRspBodyLen) != KVS_ERRNO_NONE)
+    {
+        LogInfo("Cached connection to %s is not usable, try a new one", pServPara->pcHost);
+    }
+#endif
+
+    /* The handle is released on failure, so it's NULL if there is no cached connection or it failed. */
+    if (xNetIoHandle == NULL)
+    {
+        res = prvSendControlReq(pServPara, &xNetIoHandle, pcUri, pxHttpReqHeaders, pcBody, puHttpStatusCode, ppRspBody, puRspBodyLen);
+    }
+
+    if (xNetIoHandle != NULL)
+    {
+#if KVS_CONTROL_CONN_CACHE_SIZE > 0
+        prvControlConnPut(pServPara->pcHost, xNetIoHandle);
+#else
+        NetIo_disconnect(xNetIoHandle);
+        NetIo_terminate(xNetIoHandle);
+#endif
+    }
+
+    return res;
+}
+
+void Kvs_closeControlConnections(void)
+{
+#if KVS_CONTROL_CONN_CACHE_SIZE > 0
+    NetIoHandle pxHandles[KVS_CONTROL_CONN_CACHE_SIZE] = {0};
+    size_t i = 0;
+
+    if (prvControlConnCacheLock())
+    {
+        for (i = 0; i < KVS_CONTROL_CONN_CACHE_SIZE; i++)
+        {
+            pxHandles[i] = gxControlConnCache[i].xNetIoHandle;
+            gxControlConnCache[i].xNetIoHandle = NULL;
+        }
+        Unlock(gxControlConnCacheLock);
+    }
+
+    for (i = 0; i < KVS_CONTROL_CONN_CACHE_SIZE; i++)
     {
-        kvsFree(pFragmentAck);
+        if (pxHandles[i] != NULL)
+        {
+            prvControlConnClose(pxHandles[i]);
+        }
     }
+#endif /* KVS_CONTROL_CONN_CACHE_SIZE > 0 */
 }
 
 int Kvs_describeStream(KvsServiceParameter_t *pServPara, KvsDescribeStreamParameter_t *pDescPara, unsigned int *puHttpStatusCode)
@@ -688,12 +1028,10 @@ int Kvs_describeStream(KvsServiceParameter_t *pServPara, KvsDescribeStreamParame
     AwsSigV4Handle xAwsSigV4Handle = NULL;
 
     unsigned int uHttpStatusCode = 0;
-    HTTP_HEADERS_HANDLE xHttpReqHeaders = NULL;
+    HttpReqHeaders_t xHttpReqHeaders = {0};
     char *pRspBody = NULL;
     size_t uRspBodyLen = 0;
 
-    NetIoHandle xNetIoHandle = NULL;
-
     if (puHttpStatusCode != NULL)
     {
         *puHttpStatusCode = 0; /* Set to zero to avoid misuse from the previous value. */
@@ -718,46 +1056,27 @@ int Kvs_describeStream(KvsServiceParameter_t *pServPara, KvsDescribeStreamParame
         LogError("Failed to allocate HTTP body");
     }
     else if (
-        (xHttpReqHeaders = HTTPHeaders_Alloc()) == NULL ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_HOST, pServPara->pcHost) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_CONTENT_LENGTH, STRING_c_str(xStContentLength)) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_CONTENT_TYPE, VAL_CONTENT_TYPE_APPLICATION_jSON) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZ_DATE, pcXAmzDate) != HTTP_HEADERS_OK ||
-        (pServPara->pcToken != NULL && (HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZ_SECURITY_TOKEN, pServPara->pcToken) != HTTP_HEADERS_OK)))
+        Http_addReqHeader(&xHttpReqHeaders, HDR_HOST, pServPara->pcHost) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONNECTION, VAL_KEEP_ALIVE) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONTENT_LENGTH, STRING_c_str(xStContentLength)) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONTENT_TYPE, VAL_CONTENT_TYPE_APPLICATION_jSON) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZ_DATE, pcXAmzDate) != KVS_ERRNO_NONE ||
+        (pServPara->pcToken != NULL && Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZ_SECURITY_TOKEN, pServPara->pcToken) != KVS_ERRNO_NONE))
     {
         res = KVS_ERROR_UNABLE_TO_GENERATE_HTTP_HEADER;
         LogError("Failed to generate HTTP headers");
     }
     else if (
-        (xAwsSigV4Handle = prvSign(pServPara, KVS_URI_DESCRIBE_STREAM, URI_QUERY_EMPTY, xHttpReqHeaders, STRING_c_str(xStHttpBody))) == NULL ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_AUTHORIZATION, AwsSigV4_GetAuthorization(xAwsSigV4Handle)) != HTTP_HEADERS_OK)
+        (xAwsSigV4Handle = prvSign(pServPara, KVS_URI_DESCRIBE_STREAM, URI_QUERY_EMPTY, &xHttpReqHeaders, STRING_c_str(xStHttpBody))) == NULL ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_AUTHORIZATION, AwsSigV4_GetAuthorization(xAwsSigV4Handle)) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_SIGN_HTTP_REQ;
         LogError("Failed to sign");
     }
-    else if ((xNetIoHandle = NetIo_create()) == NULL)
-    {
-        res = KVS_ERROR_FAIL_TO_CREATE_NETIO_HANDLE;
-        LogError("Failed to create NetIo handle");
-    }
-    else if (
-        (res = NetIo_setRecvTimeout(xNetIoHandle, pServPara->uRecvTimeoutMs)) != KVS_ERRNO_NONE ||
-        (res = NetIo_setSendTimeout(xNetIoHandle, pServPara->uSendTimeoutMs)) != KVS_ERRNO_NONE ||
-        (res = NetIo_connect(xNetIoHandle, pServPara->pcHost, PORT_HTTPS)) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed to connect to %s", pServPara->pcHost);
-        /* Propagate the res error */
-    }
-    else if ((res = Http_executeHttpReq(xNetIoHandle, HTTP_METHOD_POST, KVS_URI_DESCRIBE_STREAM, xHttpReqHeaders, STRING_c_str(xStHttpBody))) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed send http request to %s", pServPara->pcHost);
-        /* Propagate the res error */
-    }
-    else if ((res = Http_recvHttpRsp(xNetIoHandle, &uHttpStatusCode, &pRspBody, &uRspBodyLen)) != KVS_ERRNO_NONE)
+    else if ((res = prvExecuteControlReq(pServPara, KVS_URI_DESCRIBE_STREAM, &xHttpReqHeaders, STRING_c_str(xStHttpBody), &uHttpStatusCode, &pRspBody, &uRspBodyLen)) != KVS_ERRNO_NONE)
     {
-        LogError("Failed recv http response from %s", pServPara->pcHost);
         /* Propagate the res error */
     }
     else
@@ -774,10 +1093,7 @@ int Kvs_describeStream(KvsServiceParameter_t *pServPara, KvsDescribeStreamParame
         }
     }
 
-    NetIo_disconnect(xNetIoHandle);
-    NetIo_terminate(xNetIoHandle);
     SAFE_FREE(pRspBody);
-    HTTPHeaders_Free(xHttpReqHeaders);
     AwsSigV4_Terminate(xAwsSigV4Handle);
     STRING_delete(xStContentLength);
     STRING_delete(xStHttpBody);
@@ -796,12 +1112,10 @@ int Kvs_createStream(KvsServiceParameter_t *pServPara, KvsCreateStreamParameter_
     AwsSigV4Handle xAwsSigV4Handle = NULL;
 
     unsigned int uHttpStatusCode = 0;
-    HTTP_HEADERS_HANDLE xHttpReqHeaders = NULL;
+    HttpReqHeaders_t xHttpReqHeaders = {0};
     char *pRspBody = NULL;
     size_t uRspBodyLen = 0;
 
-    NetIoHandle xNetIoHandle = NULL;
-
     if (puHttpStatusCode != NULL)
     {
         *puHttpStatusCode = 0; /* Set to zero to avoid misuse from previous value. */
@@ -826,46 +1140,27 @@ int Kvs_createStream(KvsServiceParameter_t *pServPara, KvsCreateStreamParameter_
         LogError("Failed to allocate HTTP body");
     }
     else if (
-        (xHttpReqHeaders = HTTPHeaders_Alloc()) == NULL ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_HOST, pServPara->pcHost) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_CONTENT_LENGTH, STRING_c_str(xStContentLength)) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_CONTENT_TYPE, VAL_CONTENT_TYPE_APPLICATION_jSON) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZ_DATE, pcXAmzDate) != HTTP_HEADERS_OK ||
-        (pServPara->pcToken != NULL && (HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZ_SECURITY_TOKEN, pServPara->pcToken) != HTTP_HEADERS_OK)))
+        Http_addReqHeader(&xHttpReqHeaders, HDR_HOST, pServPara->pcHost) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONNECTION, VAL_KEEP_ALIVE) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONTENT_LENGTH, STRING_c_str(xStContentLength)) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONTENT_TYPE, VAL_CONTENT_TYPE_APPLICATION_jSON) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZ_DATE, pcXAmzDate) != KVS_ERRNO_NONE ||
+        (pServPara->pcToken != NULL && Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZ_SECURITY_TOKEN, pServPara->pcToken) != KVS_ERRNO_NONE))
     {
         res = KVS_ERROR_UNABLE_TO_GENERATE_HTTP_HEADER;
         LogError("Failed to generate HTTP headers");
     }
     else if (
-        (xAwsSigV4Handle = prvSign(pServPara, KVS_URI_CREATE_STREAM, URI_QUERY_EMPTY, xHttpReqHeaders, STRING_c_str(xStHttpBody))) == NULL ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_AUTHORIZATION, AwsSigV4_GetAuthorization(xAwsSigV4Handle)) != HTTP_HEADERS_OK)
+        (xAwsSigV4Handle = prvSign(pServPara, KVS_URI_CREATE_STREAM, URI_QUERY_EMPTY, &xHttpReqHeaders, STRING_c_str(xStHttpBody))) == NULL ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_AUTHORIZATION, AwsSigV4_GetAuthorization(xAwsSigV4Handle)) != KVS_ERRNO_NONE)
     {
         LogError("Failed to sign");
         res = KVS_ERROR_FAIL_TO_SIGN_HTTP_REQ;
     }
-    else if ((xNetIoHandle = NetIo_create()) == NULL)
-    {
-        res = KVS_ERROR_FAIL_TO_CREATE_NETIO_HANDLE;
-        LogError("Failed to create NetIo handle");
-    }
-    else if (
-        (res = NetIo_setRecvTimeout(xNetIoHandle, pServPara->uRecvTimeoutMs)) != KVS_ERRNO_NONE ||
-        (res = NetIo_setSendTimeout(xNetIoHandle, pServPara->uSendTimeoutMs)) != KVS_ERRNO_NONE ||
-        (res = NetIo_connect(xNetIoHandle, pServPara->pcHost, PORT_HTTPS)) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed to connect to %s", pServPara->pcHost);
-        /* Propagate the res error */
-    }
-    else if ((res = Http_executeHttpReq(xNetIoHandle, HTTP_METHOD_POST, KVS_URI_CREATE_STREAM, xHttpReqHeaders, STRING_c_str(xStHttpBody))) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed send http request to %s", pServPara->pcHost);
-        /* Propagate the res error */
-    }
-    else if ((res = Http_recvHttpRsp(xNetIoHandle, &uHttpStatusCode, &pRspBody, &uRspBodyLen)) != KVS_ERRNO_NONE)
+    else if ((res = prvExecuteControlReq(pServPara, KVS_URI_CREATE_STREAM, &xHttpReqHeaders, STRING_c_str(xStHttpBody), &uHttpStatusCode, &pRspBody, &uRspBodyLen)) != KVS_ERRNO_NONE)
     {
-        LogError("Failed recv http response from %s", pServPara->pcHost);
         /* Propagate the res error */
     }
     else
@@ -882,10 +1177,7 @@ int Kvs_createStream(KvsServiceParameter_t *pServPara, KvsCreateStreamParameter_
         }
     }
 
-    NetIo_disconnect(xNetIoHandle);
-    NetIo_terminate(xNetIoHandle);
     SAFE_FREE(pRspBody);
-    HTTPHeaders_Free(xHttpReqHeaders);
     AwsSigV4_Terminate(xAwsSigV4Handle);
     STRING_delete(xStContentLength);
     STRING_delete(xStHttpBody);
@@ -904,12 +1196,10 @@ int Kvs_getDataEndpoint(KvsServiceParameter_t *pServPara, KvsGetDataEndpointPara
     AwsSigV4Handle xAwsSigV4Handle = NULL;
 
     unsigned int uHttpStatusCode = 0;
-    HTTP_HEADERS_HANDLE xHttpReqHeaders = NULL;
+    HttpReqHeaders_t xHttpReqHeaders = {0};
     char *pRspBody = NULL;
     size_t uRspBodyLen = 0;
 
-    NetIoHandle xNetIoHandle = NULL;
-
     if (puHttpStatusCode != NULL)
     {
         *puHttpStatusCode = 0; /* Set to zero to avoid misuse from previous value. */
@@ -934,49 +1224,30 @@ int Kvs_getDataEndpoint(KvsServiceParameter_t *pServPara, KvsGetDataEndpointPara
         LogError("Failed to allocate HTTP body");
     }
     else if (
-        (xHttpReqHeaders = HTTPHeaders_Alloc()) == NULL ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_HOST, pServPara->pcHost) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_CONTENT_LENGTH, STRING_c_str(xStContentLength)) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_CONTENT_TYPE, VAL_CONTENT_TYPE_APPLICATION_jSON) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZ_DATE, pcXAmzDate) != HTTP_HEADERS_OK ||
-        (pServPara->pcToken != NULL && (HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZ_SECURITY_TOKEN, pServPara->pcToken) != HTTP_HEADERS_OK)))
+        Http_addReqHeader(&xHttpReqHeaders, HDR_HOST, pServPara->pcHost) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONNECTION, VAL_KEEP_ALIVE) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONTENT_LENGTH, STRING_c_str(xStContentLength)) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONTENT_TYPE, VAL_CONTENT_TYPE_APPLICATION_jSON) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZ_DATE, pcXAmzDate) != KVS_ERRNO_NONE ||
+        (pServPara->pcToken != NULL && Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZ_SECURITY_TOKEN, pServPara->pcToken) != KVS_ERRNO_NONE))
     {
         res = KVS_ERROR_UNABLE_TO_GENERATE_HTTP_HEADER;
         LogError("Failed to generate HTTP headers");
     }
     else if (
-        (xAwsSigV4Handle = prvSign(pServPara, KVS_URI_GET_DATA_ENDPOINT, URI_QUERY_EMPTY, xHttpReqHeaders, STRING_c_str(xStHttpBody))) == NULL ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_AUTHORIZATION, AwsSigV4_GetAuthorization(xAwsSigV4Handle)) != HTTP_HEADERS_OK)
+        (xAwsSigV4Handle = prvSign(pServPara, KVS_URI_GET_DATA_ENDPOINT, URI_QUERY_EMPTY, &xHttpReqHeaders, STRING_c_str(xStHttpBody))) == NULL ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_AUTHORIZATION, AwsSigV4_GetAuthorization(xAwsSigV4Handle)) != KVS_ERRNO_NONE)
     {
         res = KVS_ERROR_FAIL_TO_SIGN_HTTP_REQ;
         LogError("Failed to sign");
     }
-    else if ((xNetIoHandle = NetIo_create()) == NULL)
-    {
-        res = KVS_ERROR_FAIL_TO_CREATE_NETIO_HANDLE;
-        LogError("Failed to create NetIo handle");
-    }
-    else if (
-        (res = NetIo_setRecvTimeout(xNetIoHandle, pServPara->uRecvTimeoutMs)) != KVS_ERRNO_NONE ||
-        (res = NetIo_setSendTimeout(xNetIoHandle, pServPara->uSendTimeoutMs)) != KVS_ERRNO_NONE ||
-        (res = NetIo_connect(xNetIoHandle, pServPara->pcHost, PORT_HTTPS)) != KVS_ERRNO_NONE)
+    else if ((res = prvExecuteControlReq(pServPara, KVS_URI_GET_DATA_ENDPOINT, &xHttpReqHeaders, STRING_c_str(xStHttpBody), &uHttpStatusCode, &pRspBody, &uRspBodyLen)) != KVS_ERRNO_NONE)
     {
-        LogError("Failed to connect to %s", pServPara->pcHost);
         /* Propagate the res error */
     }
-    else if ((res = Http_executeHttpReq(xNetIoHandle, HTTP_METHOD_POST, KVS_URI_GET_DATA_ENDPOINT, xHttpReqHeaders, STRING_c_str(xStHttpBody))) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed send http request to %s", pServPara->pcHost);
-        /* Propagate the res error */
-    }
-    else if ((res = Http_recvHttpRsp(xNetIoHandle, &uHttpStatusCode, &pRspBody, &uRspBodyLen)) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed recv http response from %s", pServPara->pcHost);
-        /* Propagate the res error */
-    }
-    else
+    else
     {
         if (puHttpStatusCode != NULL)
         {
@@ -998,10 +1269,7 @@ int Kvs_getDataEndpoint(KvsServiceParameter_t *pServPara, KvsGetDataEndpointPara
         }
     }
 
-    NetIo_disconnect(xNetIoHandle);
-    NetIo_terminate(xNetIoHandle);
     SAFE_FREE(pRspBody);
-    HTTPHeaders_Free(xHttpReqHeaders);
     AwsSigV4_Terminate(xAwsSigV4Handle);
     STRING_delete(xStContentLength);
     STRING_delete(xStHttpBody);
@@ -1009,19 +1277,339 @@ int Kvs_getDataEndpoint(KvsServiceParameter_t *pServPara, KvsGetDataEndpointPara
     return res;
 }
 
-int Kvs_putMediaStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, unsigned int *puHttpStatusCode, PutMediaHandle *pPutMediaHandle)
+static int prvPutMediaGenerateReqFromHeaders(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, char **ppcHttpReq, size_t *puHttpReqLen)
 {
     int res = KVS_ERRNO_NONE;
-    PutMedia_t *pPutMedia = NULL;
 
     char pcXAmzDate[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE] = {0};
-    STRING_HANDLE xStProducerStartTimestamp = NULL;
-
+    char pcProducerStartTimestamp[PRODUCER_START_TIMESTAMP_STRING_SIZE] = {0};
 
     AwsSigV4Handle xAwsSigV4Handle = NULL;
 
+    HttpReqHeaders_t xHttpReqHeaders = {0};
+    char *pcHttpReq = NULL;
+    size_t uHttpReqSize = 0;
+
+    if ((res = getTimeInIso8601(pcXAmzDate, sizeof(pcXAmzDate))) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to get time");
+        /* Propagate the res error */
+    }
+    else if ((res = prvGetEpochTimestampInBuf(pPutMediaPara->uProducerStartTimestampMs, pcProducerStartTimestamp, sizeof(pcProducerStartTimestamp))) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to get epoch time");
+        /* Propagate the res error */
+    }
+    else if (
+        Http_addReqHeader(&xHttpReqHeaders, HDR_HOST, pServPara->pcPutMediaEndpoint) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONNECTION, VAL_KEEP_ALIVE) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_CONTENT_TYPE, VAL_CONTENT_TYPE_APPLICATION_jSON) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_TRANSFER_ENCODING, VAL_TRANSFER_ENCODING_CHUNKED) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZ_DATE, pcXAmzDate) != KVS_ERRNO_NONE ||
+        (pServPara->pcToken != NULL && Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZ_SECURITY_TOKEN, pServPara->pcToken) != KVS_ERRNO_NONE) ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZN_FRAG_ACK_REQUIRED, VAL_FRAGMENT_ACK_REQUIRED_TRUE) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZN_FRAG_T_TYPE, prvGetTimecodeValue(pPutMediaPara->xTimecodeType)) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZN_PRODUCER_START_T, pcProducerStartTimestamp) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_X_AMZN_STREAM_NAME, pPutMediaPara->pcStreamName) != KVS_ERRNO_NONE ||
+        Http_addReqHeader(&xHttpReqHeaders, "expect", "100-continue") != KVS_ERRNO_NONE)
+    {
+        res = KVS_ERROR_UNABLE_TO_GENERATE_HTTP_HEADER;
+        LogError("Failed to generate HTTP headers");
+    }
+    else if (
+        (xAwsSigV4Handle = prvSign(pServPara, KVS_URI_PUT_MEDIA, URI_QUERY_EMPTY, &xHttpReqHeaders, HTTP_BODY_EMPTY)) == NULL ||
+        Http_addReqHeader(&xHttpReqHeaders, HDR_AUTHORIZATION, AwsSigV4_GetAuthorization(xAwsSigV4Handle)) != KVS_ERRNO_NONE)
+    {
+        res = KVS_ERROR_FAIL_TO_SIGN_HTTP_REQ;
+        LogError("Failed to sign");
+    }
+    else
+    {
+        /* The headers reference stack buffers and the signer, so the request is serialized before they go away. */
+        uHttpReqSize = Http_getHttpReqHeadLen(HTTP_METHOD_POST, KVS_URI_PUT_MEDIA, &xHttpReqHeaders) + 1;
+
+        if ((pcHttpReq = (char *)kvsMalloc(uHttpReqSize)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: pcHttpReq");
+        }
+        else if ((res = Http_serializeHttpReqHead(HTTP_METHOD_POST, KVS_URI_PUT_MEDIA, &xHttpReqHeaders, pcHttpReq, uHttpReqSize, puHttpReqLen)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else
+        {
+            *ppcHttpReq = pcHttpReq;
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        kvsFree(pcHttpReq);
+    }
+    AwsSigV4_Terminate(xAwsSigV4Handle);
+
+    return res;
+}
+
+static int prvSprintfToBuf(char **ppcBuf, size_t *puBufSize, size_t *puLen, const char *pcFmt, ...)
+{
+    int res = KVS_ERRNO_NONE;
+    va_list xArgs;
+    int xLen = 0;
+    char *pcBuf = NULL;
+
+    va_start(xArgs, pcFmt);
+    xLen = vsnprintf(NULL, 0, pcFmt, xArgs);
+    va_end(xArgs);
+
+    if (xLen < 0)
+    {
+        res = KVS_ERROR_C_UTIL_STRING_ERROR;
+    }
+    else
+    {
+        /* The buffer is only enlarged, so a reused buffer stops allocating once it's large enough. */
+        if ((size_t)xLen + 1 > *puBufSize)
+        {
+            if ((pcBuf = (char *)kvsMalloc((size_t)xLen + 1)) == NULL)
+            {
+                res = KVS_ERROR_OUT_OF_MEMORY;
+                LogError("OOM: string buffer");
+            }
+            else
+            {
+                kvsFree(*ppcBuf);
+                *ppcBuf = pcBuf;
+                *puBufSize = (size_t)xLen + 1;
+            }
+        }
+
+        if (res == KVS_ERRNO_NONE)
+        {
+            va_start(xArgs, pcFmt);
+            vsnprintf(*ppcBuf, *puBufSize, pcFmt, xArgs);
+            va_end(xArgs);
+            *puLen = (size_t)xLen;
+        }
+    }
+
+    return res;
+}
+
+static void prvPutMediaTemplateClear(PutMediaTemplate_t *pTemplate)
+{
+    STRING_delete(pTemplate->xStHost);
+    STRING_delete(pTemplate->xStStreamName);
+    STRING_delete(pTemplate->xStReqHeaders);
+    STRING_delete(pTemplate->xStCanonicalPrefix);
+    STRING_delete(pTemplate->xStCanonicalMiddle);
+    STRING_delete(pTemplate->xStCanonicalSuffix);
+    STRING_delete(pTemplate->xStSignedHeaders);
+    pTemplate->xStHost = NULL;
+    pTemplate->xStStreamName = NULL;
+    pTemplate->xStReqHeaders = NULL;
+    pTemplate->xStCanonicalPrefix = NULL;
+    pTemplate->xStCanonicalMiddle = NULL;
+    pTemplate->xStCanonicalSuffix = NULL;
+    pTemplate->xStSignedHeaders = NULL;
+}
+
+static bool prvPutMediaTemplateMatch(PutMediaTemplate_t *pTemplate, KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara)
+{
+    return pTemplate->xStHost != NULL && strcmp(STRING_c_str(pTemplate->xStHost), pServPara->pcPutMediaEndpoint) == 0 &&
+           strcmp(STRING_c_str(pTemplate->xStStreamName), pPutMediaPara->pcStreamName) == 0 && pTemplate->xTimecodeType == pPutMediaPara->xTimecodeType &&
+           pTemplate->bHasToken == (pServPara->pcToken != NULL);
+}
+
+static int prvPutMediaTemplateBuild(PutMediaTemplate_t *pTemplate, KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara)
+{
+    int res = KVS_ERRNO_NONE;
+    char *pcTimecodeType = prvGetTimecodeValue(pPutMediaPara->xTimecodeType);
+
+    prvPutMediaTemplateClear(pTemplate);
+
+    if (pTemplate->xAwsSigV4Handle == NULL && (pTemplate->xAwsSigV4Handle = AwsSigV4_Create(HTTP_METHOD_POST, KVS_URI_PUT_MEDIA, URI_QUERY_EMPTY)) == NULL)
+    {
+        res = KVS_ERROR_FAIL_TO_CREATE_SIGV4_HANDLE;
+    }
+    else if (
+        (pTemplate->xStHost = STRING_construct(pServPara->pcPutMediaEndpoint)) == NULL ||
+        (pTemplate->xStStreamName = STRING_construct(pPutMediaPara->pcStreamName)) == NULL ||
+        (pTemplate->xStReqHeaders = STRING_construct_sprintf(PUT_MEDIA_REQ_HEADERS_TEMPLATE, pServPara->pcPutMediaEndpoint, pcTimecodeType, pPutMediaPara->pcStreamName)) == NULL ||
+        (pTemplate->xStCanonicalPrefix = STRING_construct_sprintf(PUT_MEDIA_CANONICAL_PREFIX_TEMPLATE, pServPara->pcPutMediaEndpoint)) == NULL ||
+        (pTemplate->xStCanonicalMiddle = STRING_construct_sprintf(PUT_MEDIA_CANONICAL_MIDDLE_TEMPLATE, pcTimecodeType)) == NULL ||
+        (pTemplate->xStSignedHeaders = STRING_construct_sprintf(PUT_MEDIA_SIGNED_HEADERS_TEMPLATE, (pServPara->pcToken != NULL) ? ";" HDR_X_AMZ_SECURITY_TOKEN : "")) == NULL ||
+        (pTemplate->xStCanonicalSuffix = STRING_construct_sprintf(PUT_MEDIA_CANONICAL_SUFFIX_TEMPLATE, pPutMediaPara->pcStreamName, STRING_c_str(pTemplate->xStSignedHeaders))) == NULL)
+    {
+        res = KVS_ERROR_C_UTIL_STRING_ERROR;
+    }
+    else
+    {
+        pTemplate->xTimecodeType = pPutMediaPara->xTimecodeType;
+        pTemplate->bHasToken = (pServPara->pcToken != NULL);
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        prvPutMediaTemplateClear(pTemplate);
+    }
+
+    return res;
+}
+
+static int prvPutMediaGenerateReqFromTemplate(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, char **ppcHttpReq, size_t *puHttpReqLen)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMediaTemplate_t *pTemplate = pPutMediaPara->xReqTemplate;
+    bool bHasToken = (pServPara->pcToken != NULL);
+
+    char pcXAmzDate[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE] = {0};
+    char pcProducerStartTimestamp[PRODUCER_START_TIMESTAMP_STRING_SIZE] = {0};
+    size_t uCanonicalLen = 0;
+
+    char *pcHttpReq = NULL;
+    size_t uHttpReqSize = 0;
+    size_t uHttpReqLen = 0;
+
+    if ((res = getTimeInIso8601(pcXAmzDate, sizeof(pcXAmzDate))) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to get time");
+        /* Propagate the res error */
+    }
+    else if ((res = prvGetEpochTimestampInBuf(pPutMediaPara->uProducerStartTimestampMs, pcProducerStartTimestamp, sizeof(pcProducerStartTimestamp))) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to get epoch time");
+        /* Propagate the res error */
+    }
+    else if (!prvPutMediaTemplateMatch(pTemplate, pServPara, pPutMediaPara) && (res = prvPutMediaTemplateBuild(pTemplate, pServPara, pPutMediaPara)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to build PUT MEDIA request template");
+        /* Propagate the res error */
+    }
+    else if (
+        prvSprintfToBuf(
+            &(pTemplate->pcCanonicalBuf),
+            &(pTemplate->uCanonicalBufSize),
+            &uCanonicalLen,
+            "%s%s%s%s%s%s%s",
+            STRING_c_str(pTemplate->xStCanonicalPrefix),
+            pcXAmzDate,
+            bHasToken ? PUT_MEDIA_CANONICAL_TOKEN_HEADER : "",
+            bHasToken ? pServPara->pcToken : "",
+            STRING_c_str(pTemplate->xStCanonicalMiddle),
+            pcProducerStartTimestamp,
+            STRING_c_str(pTemplate->xStCanonicalSuffix)) != KVS_ERRNO_NONE ||
+        AwsSigV4_SetCanonicalRequest(pTemplate->xAwsSigV4Handle, pTemplate->pcCanonicalBuf, STRING_c_str(pTemplate->xStSignedHeaders)) != KVS_ERRNO_NONE ||
+        AwsSigV4_Sign(pTemplate->xAwsSigV4Handle, pServPara->pcAccessKey, pServPara->pcSecretKey, pServPara->pcRegion, pServPara->pcService, pcXAmzDate) != KVS_ERRNO_NONE)
+    {
+        res = KVS_ERROR_FAIL_TO_SIGN_HTTP_REQ;
+        LogError("Failed to sign");
+    }
+    else if (
+        prvSprintfToBuf(
+            &pcHttpReq,
+            &uHttpReqSize,
+            &uHttpReqLen,
+            PUT_MEDIA_REQ_TEMPLATE,
+            STRING_c_str(pTemplate->xStReqHeaders),
+            pcXAmzDate,
+            bHasToken ? HDR_X_AMZ_SECURITY_TOKEN ": " : "",
+            bHasToken ? pServPara->pcToken : "",
+            bHasToken ? "\r\n" : "",
+            pcProducerStartTimestamp,
+            AwsSigV4_GetAuthorization(pTemplate->xAwsSigV4Handle)) != KVS_ERRNO_NONE)
+    {
+        res = KVS_ERROR_UNABLE_TO_GENERATE_HTTP_HEADER;
+        LogError("Failed to generate HTTP headers");
+    }
+    else
+    {
+        *ppcHttpReq = pcHttpReq;
+        *puHttpReqLen = uHttpReqLen;
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        kvsFree(pcHttpReq);
+    }
+
+    return res;
+}
+
+static int prvPutMediaGenerateReq(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, char **ppcHttpReq, size_t *puHttpReqLen)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pPutMediaPara->xReqTemplate != NULL)
+    {
+        res = prvPutMediaGenerateReqFromTemplate(pServPara, pPutMediaPara, ppcHttpReq, puHttpReqLen);
+    }
+    else
+    {
+        res = prvPutMediaGenerateReqFromHeaders(pServPara, pPutMediaPara, ppcHttpReq, puHttpReqLen);
+    }
+
+    return res;
+}
+
+PutMediaTemplateHandle Kvs_putMediaTemplateCreate(void)
+{
+    PutMediaTemplate_t *pTemplate = NULL;
+
+    if ((pTemplate = (PutMediaTemplate_t *)kvsMalloc(sizeof(PutMediaTemplate_t))) == NULL)
+    {
+        LogError("OOM: pTemplate");
+    }
+    else
+    {
+        memset(pTemplate, 0, sizeof(PutMediaTemplate_t));
+    }
+
+    return pTemplate;
+}
+
+void Kvs_putMediaTemplateTerminate(PutMediaTemplateHandle xReqTemplate)
+{
+    PutMediaTemplate_t *pTemplate = xReqTemplate;
+
+    if (pTemplate != NULL)
+    {
+        prvPutMediaTemplateClear(pTemplate);
+        AwsSigV4_Terminate(pTemplate->xAwsSigV4Handle);
+        kvsFree(pTemplate->pcCanonicalBuf);
+        kvsFree(pTemplate);
+    }
+}
+
+static int prvPutMediaSetSocketOptions(NetIoHandle xNetIoHandle, KvsPutMediaParameter_t *pPutMediaPara)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if ((res = NetIo_setTcpNoDelay(xNetIoHandle, pPutMediaPara->bTcpNoDelay)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setSendBufSize(xNetIoHandle, pPutMediaPara->uSendBufSize)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setNotSentLowat(xNetIoHandle, pPutMediaPara->uNotSentLowat)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setKeepAlive(xNetIoHandle, pPutMediaPara->uKeepAliveIdleSec, pPutMediaPara->uKeepAliveIntervalSec, pPutMediaPara->uKeepAliveCount)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setBindInterface(xNetIoHandle, pPutMediaPara->uBindIfIndex)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setPacing(xNetIoHandle, pPutMediaPara->uPacingRateBps, pPutMediaPara->uPacingBurstBytes)) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to set socket options");
+        /* Propagate the res error */
+    }
+
+    return res;
+}
+
+int Kvs_putMediaStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, unsigned int *puHttpStatusCode, PutMediaHandle *pPutMediaHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMedia_t *pPutMedia = NULL;
+
     unsigned int uHttpStatusCode = 0;
-    HTTP_HEADERS_HANDLE xHttpReqHeaders = NULL;
+    char *pcHttpReq = NULL;
+    size_t uHttpReqLen = 0;
     char *pRspBody = NULL;
     size_t uRspBodyLen = 0;
 
@@ -1044,42 +1632,10 @@ int Kvs_putMediaStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *
         res = KVS_ERROR_INVALID_ARGUMENT;
         LogError("Invalid argument");
     }
-    else if ((res = getTimeInIso8601(pcXAmzDate, sizeof(pcXAmzDate))) != KVS_ERRNO_NONE)
-    {
-        LogError("Failed to get time");
-        /* Propagate the res error */
-    }
-    else if ((res = prvGetEpochTimestampInStr(pPutMediaPara->uProducerStartTimestampMs, &xStProducerStartTimestamp)) != KVS_ERRNO_NONE)
+    else if ((res = prvPutMediaGenerateReq(pServPara, pPutMediaPara, &pcHttpReq, &uHttpReqLen)) != KVS_ERRNO_NONE)
     {
-        LogError("Failed to get epoch time");
         /* Propagate the res error */
     }
-    else if (
-        (xHttpReqHeaders = HTTPHeaders_Alloc()) == NULL ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_HOST, pServPara->pcPutMediaEndpoint) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_CONNECTION, VAL_KEEP_ALIVE) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_CONTENT_TYPE, VAL_CONTENT_TYPE_APPLICATION_jSON) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_TRANSFER_ENCODING, VAL_TRANSFER_ENCODING_CHUNKED) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZ_DATE, pcXAmzDate) != HTTP_HEADERS_OK ||
-        (pServPara->pcToken != NULL && (HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZ_SECURITY_TOKEN, pServPara->pcToken) != HTTP_HEADERS_OK)) ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZN_FRAG_ACK_REQUIRED, VAL_FRAGMENT_ACK_REQUIRED_TRUE) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZN_FRAG_T_TYPE, prvGetTimecodeValue(pPutMediaPara->xTimecodeType)) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZN_PRODUCER_START_T, STRING_c_str(xStProducerStartTimestamp)) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_X_AMZN_STREAM_NAME, pPutMediaPara->pcStreamName) != HTTP_HEADERS_OK ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, "expect", "100-continue") != HTTP_HEADERS_OK)
-    {
-        res = KVS_ERROR_UNABLE_TO_GENERATE_HTTP_HEADER;
-        LogError("Failed to generate HTTP headers");
-    }
-    else if (
-        (xAwsSigV4Handle = prvSign(pServPara, KVS_URI_PUT_MEDIA, URI_QUERY_EMPTY, xHttpReqHeaders, HTTP_BODY_EMPTY)) == NULL ||
-        HTTPHeaders_AddHeaderNameValuePair(xHttpReqHeaders, HDR_AUTHORIZATION, AwsSigV4_GetAuthorization(xAwsSigV4Handle)) != HTTP_HEADERS_OK)
-    {
-        res = KVS_ERROR_FAIL_TO_SIGN_HTTP_REQ;
-        LogError("Failed to sign");
-    }
     else if ((xNetIoHandle = NetIo_create()) == NULL)
     {
         res = KVS_ERROR_FAIL_TO_CREATE_NETIO_HANDLE;
@@ -1088,12 +1644,14 @@ int Kvs_putMediaStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *
     else if (
         (res = NetIo_setRecvTimeout(xNetIoHandle, pServPara->uRecvTimeoutMs)) != KVS_ERRNO_NONE ||
         (res = NetIo_setSendTimeout(xNetIoHandle, pServPara->uSendTimeoutMs)) != KVS_ERRNO_NONE ||
-        (res = NetIo_connect(xNetIoHandle, pServPara->pcPutMediaEndpoint, PORT_HTTPS)) != KVS_ERRNO_NONE)
+        (res = prvPutMediaSetSocketOptions(xNetIoHandle, pPutMediaPara)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setTlsMaxFragmentLength(xNetIoHandle, pServPara->uTlsMaxFragLen)) != KVS_ERRNO_NONE ||
+        (res = NetIo_connect(xNetIoHandle, pServPara->pcPutMediaEndpoint, SERVICE_PORT(pServPara))) != KVS_ERRNO_NONE)
     {
         LogError("Failed to connect to %s", pServPara->pcPutMediaEndpoint);
         /* Propagate the res error */
     }
-    else if ((res = Http_executeHttpReq(xNetIoHandle, HTTP_METHOD_POST, KVS_URI_PUT_MEDIA, xHttpReqHeaders, HTTP_BODY_EMPTY)) != KVS_ERRNO_NONE)
+    else if ((res = NetIo_send(xNetIoHandle, (const unsigned char *)pcHttpReq, uHttpReqLen)) != KVS_ERRNO_NONE)
     {
         LogError("Failed send http request to %s", pServPara->pcHost);
         /* Propagate the res error */
@@ -1129,6 +1687,9 @@ int Kvs_putMediaStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *
                 NetIo_setSendTimeout(xNetIoHandle, pPutMediaPara->uSendTimeoutMs);
 
                 pPutMedia->xNetIoHandle = xNetIoHandle;
+                pPutMedia->onFragmentAck = pPutMediaPara->onFragmentAck;
+                pPutMedia->pFragmentAckAppData = pPutMediaPara->pFragmentAckAppData;
+                pPutMedia->bFragmentAckCallbackOnly = (pPutMediaPara->onFragmentAck != NULL && pPutMediaPara->bFragmentAckCallbackOnly);
                 *pPutMediaHandle = pPutMedia;
                 bKeepNetIo = true;
             }
@@ -1141,9 +1702,204 @@ int Kvs_putMediaStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *
         NetIo_terminate(xNetIoHandle);
     }
     SAFE_FREE(pRspBody);
-    HTTPHeaders_Free(xHttpReqHeaders);
-    AwsSigV4_Terminate(xAwsSigV4Handle);
-    STRING_delete(xStProducerStartTimestamp);
+    kvsFree(pcHttpReq);
+
+    return res;
+}
+
+int Kvs_putMediaConnectStart(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, PutMediaHandle *pPutMediaHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMedia_t *pPutMedia = NULL;
+
+    /* Credentials aren't needed until the request is signed. */
+    if (pServPara == NULL || pServPara->pcPutMediaEndpoint == NULL || (res = prvValidatePutMediaParameter(pPutMediaPara)) != KVS_ERRNO_NONE ||
+        pPutMediaHandle == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((pPutMedia = prvCreateDefaultPutMediaHandle()) == NULL)
+    {
+        res = KVS_ERROR_FAIL_TO_CREATE_PUT_MEDIA_HANDLE;
+        LogError("Failed to create pPutMedia");
+    }
+    else if ((pPutMedia->xNetIoHandle = NetIo_create()) == NULL)
+    {
+        res = KVS_ERROR_FAIL_TO_CREATE_NETIO_HANDLE;
+        LogError("Failed to create NetIo handle");
+    }
+    else if (
+        (res = NetIo_setRecvTimeout(pPutMedia->xNetIoHandle, pServPara->uRecvTimeoutMs)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setSendTimeout(pPutMedia->xNetIoHandle, pServPara->uSendTimeoutMs)) != KVS_ERRNO_NONE ||
+        (res = prvPutMediaSetSocketOptions(pPutMedia->xNetIoHandle, pPutMediaPara)) != KVS_ERRNO_NONE ||
+        (res = NetIo_setTlsMaxFragmentLength(pPutMedia->xNetIoHandle, pServPara->uTlsMaxFragLen)) != KVS_ERRNO_NONE ||
+        (res = NetIo_connectStart(pPutMedia->xNetIoHandle, pServPara->pcPutMediaEndpoint, SERVICE_PORT(pServPara))) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to connect to %s", pServPara->pcPutMediaEndpoint);
+        /* Propagate the res error */
+    }
+    else
+    {
+        pPutMedia->uConnTimeoutMs = pServPara->uRecvTimeoutMs;
+        pPutMedia->uRecvTimeoutMs = pPutMediaPara->uRecvTimeoutMs;
+        pPutMedia->uSendTimeoutMs = pPutMediaPara->uSendTimeoutMs;
+        pPutMedia->onFragmentAck = pPutMediaPara->onFragmentAck;
+        pPutMedia->pFragmentAckAppData = pPutMediaPara->pFragmentAckAppData;
+        pPutMedia->bFragmentAckCallbackOnly = (pPutMediaPara->onFragmentAck != NULL && pPutMediaPara->bFragmentAckCallbackOnly);
+        pPutMedia->xStartState = PUT_MEDIA_CONNECTING;
+        *pPutMediaHandle = pPutMedia;
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        Kvs_putMediaFinish(pPutMedia);
+    }
+
+    return res;
+}
+
+int Kvs_putMediaStartRequest(PutMediaHandle xPutMediaHandle, KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMedia_t *pPutMedia = xPutMediaHandle;
+
+    if (pPutMedia == NULL || (res = prvValidateServiceParameter(pServPara)) != KVS_ERRNO_NONE ||
+        (res = prvValidatePutMediaParameter(pPutMediaPara)) != KVS_ERRNO_NONE)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((pPutMedia->xStartState != PUT_MEDIA_CONNECTING && pPutMedia->xStartState != PUT_MEDIA_CONNECTED) || pPutMedia->pcHttpReq != NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("PUT MEDIA request is already started");
+    }
+    else if ((res = prvPutMediaGenerateReq(pServPara, pPutMediaPara, &(pPutMedia->pcHttpReq), &(pPutMedia->uHttpReqLen))) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        /* The request is sent by Kvs_putMediaStartPoll() once the connection is established. */
+    }
+
+    return res;
+}
+
+int Kvs_putMediaStartAsync(KvsServiceParameter_t *pServPara, KvsPutMediaParameter_t *pPutMediaPara, PutMediaHandle *pPutMediaHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMediaHandle xPutMediaHandle = NULL;
+
+    if ((res = prvValidateServiceParameter(pServPara)) != KVS_ERRNO_NONE ||
+        (res = prvValidatePutMediaParameter(pPutMediaPara)) != KVS_ERRNO_NONE)
+    {
+        LogError("Invalid argument");
+        /* Propagate the res error */
+    }
+    else if ((res = Kvs_putMediaConnectStart(pServPara, pPutMediaPara, &xPutMediaHandle)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if ((res = Kvs_putMediaStartRequest(xPutMediaHandle, pServPara, pPutMediaPara)) != KVS_ERRNO_NONE)
+    {
+        Kvs_putMediaFinish(xPutMediaHandle);
+        /* Propagate the res error */
+    }
+    else
+    {
+        *pPutMediaHandle = xPutMediaHandle;
+    }
+
+    return res;
+}
+
+int Kvs_putMediaStartPoll(PutMediaHandle xPutMediaHandle, unsigned int *puHttpStatusCode, bool *pbDone)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMedia_t *pPutMedia = xPutMediaHandle;
+    bool bConnected = false;
+    unsigned int uHttpStatusCode = 0;
+    char *pRspBody = NULL;
+    size_t uRspBodyLen = 0;
+
+    if (pPutMedia == NULL || pbDone == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        *pbDone = false;
+
+        if (pPutMedia->xStartState == PUT_MEDIA_CONNECTING)
+        {
+            if ((res = NetIo_connectPoll(pPutMedia->xNetIoHandle, &bConnected)) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed to connect");
+                /* Propagate the res error */
+            }
+            else if (bConnected)
+            {
+                pPutMedia->xStartState = PUT_MEDIA_CONNECTED;
+            }
+            else
+            {
+                /* nop */
+            }
+        }
+
+        if (res == KVS_ERRNO_NONE && pPutMedia->xStartState == PUT_MEDIA_CONNECTED && pPutMedia->pcHttpReq != NULL)
+        {
+            if ((res = NetIo_send(pPutMedia->xNetIoHandle, (const unsigned char *)pPutMedia->pcHttpReq, pPutMedia->uHttpReqLen)) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed send http request");
+                /* Propagate the res error */
+            }
+            else
+            {
+                SAFE_FREE(pPutMedia->pcHttpReq);
+                pPutMedia->uRspDeadlineMs = getMonotonicTimeInMs() + pPutMedia->uConnTimeoutMs;
+                pPutMedia->xStartState = PUT_MEDIA_WAIT_RESPONSE;
+            }
+        }
+
+        /* Once the response starts to arrive, the rest of it is received with the receive timeout. A response that
+         * never starts fails in the same way after the deadline. */
+        if (res == KVS_ERRNO_NONE && pPutMedia->xStartState == PUT_MEDIA_WAIT_RESPONSE &&
+            (NetIo_isDataAvailable(pPutMedia->xNetIoHandle) || getMonotonicTimeInMs() >= pPutMedia->uRspDeadlineMs))
+        {
+            if ((res = Http_recvHttpRsp(pPutMedia->xNetIoHandle, &uHttpStatusCode, &pRspBody, &uRspBodyLen)) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed recv http response");
+                /* Propagate the res error */
+            }
+            else
+            {
+                if (puHttpStatusCode != NULL)
+                {
+                    *puHttpStatusCode = uHttpStatusCode;
+                }
+
+                if (uHttpStatusCode != 200)
+                {
+                    LogInfo("Put Media failed, HTTP status code: %u", uHttpStatusCode);
+                    LogInfo("HTTP response message:%.*s", (int)uRspBodyLen, pRspBody);
+                }
+                else
+                {
+                    /* Change network I/O receiving timeout for streaming purpose. */
+                    NetIo_setRecvTimeout(pPutMedia->xNetIoHandle, pPutMedia->uRecvTimeoutMs);
+                    NetIo_setSendTimeout(pPutMedia->xNetIoHandle, pPutMedia->uSendTimeoutMs);
+                }
+                pPutMedia->xStartState = PUT_MEDIA_STARTED;
+            }
+            SAFE_FREE(pRspBody);
+        }
+
+        *pbDone = (res == KVS_ERRNO_NONE && pPutMedia->xStartState == PUT_MEDIA_STARTED);
+    }
 
     return res;
 }
@@ -1155,6 +1911,7 @@ int Kvs_putMediaUpdate(PutMediaHandle xPutMediaHandle, uint8_t *pMkvHeader, size
     int xChunkedHeaderLen = 0;
     char pcChunkedHeader[sizeof(size_t) * 2 + 3];
     const char *pcChunkedEnd = "\r\n";
+    NetIoVec_t xIov[4];
 
     if (pData == NULL)
     {
@@ -1176,10 +1933,83 @@ int Kvs_putMediaUpdate(PutMediaHandle xPutMediaHandle, uint8_t *pMkvHeader, size
         }
         else
         {
-            if ((res = NetIo_send(pPutMedia->xNetIoHandle, (const unsigned char *)pcChunkedHeader, (size_t)xChunkedHeaderLen)) != KVS_ERRNO_NONE ||
-                (res = NetIo_send(pPutMedia->xNetIoHandle, pMkvHeader, uMkvHeaderLen)) != KVS_ERRNO_NONE ||
-                (pData != NULL && uDataLen > 0 && (res = NetIo_send(pPutMedia->xNetIoHandle, pData, uDataLen)) != KVS_ERRNO_NONE) ||
-                (res = NetIo_send(pPutMedia->xNetIoHandle, (const unsigned char *)pcChunkedEnd, strlen(pcChunkedEnd))) != KVS_ERRNO_NONE)
+            xIov[0].pBase = (const unsigned char *)pcChunkedHeader;
+            xIov[0].uLen = (size_t)xChunkedHeaderLen;
+            xIov[1].pBase = pMkvHeader;
+            xIov[1].uLen = uMkvHeaderLen;
+            xIov[2].pBase = pData;
+            xIov[2].uLen = uDataLen;
+            xIov[3].pBase = (const unsigned char *)pcChunkedEnd;
+            xIov[3].uLen = strlen(pcChunkedEnd);
+
+            if ((res = NetIo_sendv(pPutMedia->xNetIoHandle, xIov, sizeof(xIov) / sizeof(xIov[0]))) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed to send data frame");
+                /* Propagate the res error */
+            }
+            else
+            {
+                /* nop */
+            }
+        }
+    }
+
+    return res;
+}
+
+int Kvs_putMediaUpdateV(PutMediaHandle xPutMediaHandle, uint8_t *pMkvHeader, size_t uMkvHeaderLen, const DataFrameSegment_t *pxSegments, size_t uSegmentCount, bool bPrefixSegmentLen)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMedia_t *pPutMedia = xPutMediaHandle;
+    int xChunkedHeaderLen = 0;
+    char pcChunkedHeader[sizeof(size_t) * 2 + 3];
+    const char *pcChunkedEnd = "\r\n";
+    NetIoVec_t xIov[DATA_FRAME_MAX_SEGMENTS * 2 + 3];
+    uint8_t pLenPrefixes[DATA_FRAME_MAX_SEGMENTS][DATA_FRAME_SEGMENT_LEN_PREFIX];
+    size_t uIovCnt = 2;
+    size_t uDataLen = 0;
+    size_t i = 0;
+
+    if (pPutMedia == NULL || pMkvHeader == NULL || uMkvHeaderLen == 0 || (pxSegments == NULL && uSegmentCount > 0) || uSegmentCount > DATA_FRAME_MAX_SEGMENTS)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        for (i = 0; i < uSegmentCount; i++)
+        {
+            if (bPrefixSegmentLen)
+            {
+                PUT_UNALIGNED_4_byte_BE(pLenPrefixes[i], pxSegments[i].uLen);
+                xIov[uIovCnt].pBase = pLenPrefixes[i];
+                xIov[uIovCnt].uLen = DATA_FRAME_SEGMENT_LEN_PREFIX;
+                uIovCnt++;
+                uDataLen += DATA_FRAME_SEGMENT_LEN_PREFIX;
+            }
+            xIov[uIovCnt].pBase = pxSegments[i].pData;
+            xIov[uIovCnt].uLen = pxSegments[i].uLen;
+            uIovCnt++;
+            uDataLen += pxSegments[i].uLen;
+        }
+
+        xChunkedHeaderLen = snprintf(pcChunkedHeader, sizeof(pcChunkedHeader), "%lx\r\n", (unsigned long)(uMkvHeaderLen + uDataLen));
+        if (xChunkedHeaderLen <= 0)
+        {
+            res = KVS_ERROR_C_UTIL_STRING_ERROR;
+            LogError("Failed to init chunk size");
+        }
+        else
+        {
+            xIov[0].pBase = (const unsigned char *)pcChunkedHeader;
+            xIov[0].uLen = (size_t)xChunkedHeaderLen;
+            xIov[1].pBase = pMkvHeader;
+            xIov[1].uLen = uMkvHeaderLen;
+            xIov[uIovCnt].pBase = (const unsigned char *)pcChunkedEnd;
+            xIov[uIovCnt].uLen = strlen(pcChunkedEnd);
+            uIovCnt++;
+
+            if ((res = NetIo_sendv(pPutMedia->xNetIoHandle, xIov, uIovCnt)) != KVS_ERRNO_NONE)
             {
                 LogError("Failed to send data frame");
                 /* Propagate the res error */
@@ -1201,6 +2031,7 @@ int Kvs_putMediaUpdateRaw(PutMediaHandle xPutMediaHandle, uint8_t *pBuf, size_t
     int xChunkedHeaderLen = 0;
     char pcChunkedHeader[sizeof(size_t) * 2 + 3];
     const char *pcChunkedEnd = "\r\n";
+    NetIoVec_t xIov[3];
 
     if (pPutMedia == NULL || pBuf == NULL || uLen == 0)
     {
@@ -1217,9 +2048,14 @@ int Kvs_putMediaUpdateRaw(PutMediaHandle xPutMediaHandle, uint8_t *pBuf, size_t
         }
         else
         {
-            if ((res = NetIo_send(pPutMedia->xNetIoHandle, (const unsigned char *)pcChunkedHeader, (size_t)xChunkedHeaderLen)) != KVS_ERRNO_NONE ||
-                (res = NetIo_send(pPutMedia->xNetIoHandle, pBuf, uLen)) != KVS_ERRNO_NONE ||
-                (res = NetIo_send(pPutMedia->xNetIoHandle, (const unsigned char *)pcChunkedEnd, strlen(pcChunkedEnd))) != KVS_ERRNO_NONE)
+            xIov[0].pBase = (const unsigned char *)pcChunkedHeader;
+            xIov[0].uLen = (size_t)xChunkedHeaderLen;
+            xIov[1].pBase = pBuf;
+            xIov[1].uLen = uLen;
+            xIov[2].pBase = (const unsigned char *)pcChunkedEnd;
+            xIov[2].uLen = strlen(pcChunkedEnd);
+
+            if ((res = NetIo_sendv(pPutMedia->xNetIoHandle, xIov, sizeof(xIov) / sizeof(xIov[0]))) != KVS_ERRNO_NONE)
             {
                 LogError("Failed to send data frame");
                 /* Propagate the res error */
@@ -1234,15 +2070,135 @@ int Kvs_putMediaUpdateRaw(PutMediaHandle xPutMediaHandle, uint8_t *pBuf, size_t
     return res;
 }
 
-int Kvs_putMediaDoWork(PutMediaHandle xPutMediaHandle)
+int Kvs_putMediaUpdateInPlace(PutMediaHandle xPutMediaHandle, uint8_t *pBuf, size_t uLen, size_t uHeadroom, size_t uTailroom)
 {
     int res = KVS_ERRNO_NONE;
     PutMedia_t *pPutMedia = xPutMediaHandle;
-    BUFFER_HANDLE xBufRecv = NULL;
-    size_t uBytesTotalReceived = 0;
-    size_t uBytesReceived = 0;
+    int xChunkedHeaderLen = 0;
+    char pcChunkedHeader[PUT_MEDIA_CHUNK_SIZE_LINE_MAX_LEN + 1];
+    const char *pcChunkedEnd = "\r\n";
+    uint8_t *pChunk = NULL;
+
+    if (pPutMedia == NULL || pBuf == NULL || uLen == 0)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (uHeadroom < PUT_MEDIA_CHUNK_SIZE_LINE_MAX_LEN || uTailroom < strlen(pcChunkedEnd))
+    {
+        res = Kvs_putMediaUpdateRaw(pPutMedia, pBuf, uLen);
+    }
+    else
+    {
+        xChunkedHeaderLen = snprintf(pcChunkedHeader, sizeof(pcChunkedHeader), "%lx\r\n", (unsigned long)uLen);
+        if (xChunkedHeaderLen <= 0)
+        {
+            res = KVS_ERROR_C_UTIL_STRING_ERROR;
+            LogError("Failed to init chunk size");
+        }
+        else
+        {
+            /* The chunk size line is right-aligned to the data, so the chunk starts somewhere in the headroom. */
+            pChunk = pBuf - xChunkedHeaderLen;
+            memcpy(pChunk, pcChunkedHeader, (size_t)xChunkedHeaderLen);
+            memcpy(pBuf + uLen, pcChunkedEnd, strlen(pcChunkedEnd));
+
+            if ((res = NetIo_send(pPutMedia->xNetIoHandle, pChunk, (size_t)xChunkedHeaderLen + uLen + strlen(pcChunkedEnd))) != KVS_ERRNO_NONE)
+            {
+                LogError("Failed to send data frame");
+                /* Propagate the res error */
+            }
+            else
+            {
+                /* nop */
+            }
+        }
+    }
+
+    return res;
+}
+
+int Kvs_putMediaEnd(PutMediaHandle xPutMediaHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMedia_t *pPutMedia = xPutMediaHandle;
+    const char *pcLastChunk = "0\r\n\r\n";
+
+    if (pPutMedia == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((res = NetIo_send(pPutMedia->xNetIoHandle, (const unsigned char *)pcLastChunk, strlen(pcLastChunk))) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to send the last chunk");
+        /* Propagate the res error */
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return res;
+}
+
+static int prvParseRecvBuf(PutMedia_t *pPutMedia)
+{
+    int res = KVS_ERRNO_NONE;
+    int xParseRes = KVS_ERRNO_NONE;
     FragmentAck_t xFragmentAck = {0};
     size_t uFragAckLen = 0;
+    size_t uOffset = 0;
+
+    while (uOffset < pPutMedia->uRecvLen)
+    {
+        memset(&xFragmentAck, 0, sizeof(FragmentAck_t));
+        xParseRes = prvParseFragmentAck((char *)pPutMedia->pRecvBuf + uOffset, pPutMedia->uRecvLen - uOffset, &xFragmentAck, &uFragAckLen);
+        if (xParseRes == KVS_ERROR_INCOMPLETE_FRAGMENT_ACK)
+        {
+            /* Keep the partial ack until the rest of it is received. */
+            break;
+        }
+        else if (xParseRes != KVS_ERRNO_NONE || uFragAckLen == 0)
+        {
+            /* There is no way to find the next ack in the malformed data, so drop all of it. */
+            uOffset = pPutMedia->uRecvLen;
+            break;
+        }
+        else
+        {
+            prvLogFragmentAck(&xFragmentAck);
+            if (pPutMedia->onFragmentAck != NULL)
+            {
+                pPutMedia->onFragmentAck(xFragmentAck.eventType, xFragmentAck.uFragmentTimecode, xFragmentAck.uErrorId, pPutMedia->pFragmentAckAppData);
+            }
+            if (!(pPutMedia->bFragmentAckCallbackOnly))
+            {
+                prvPushFragmentAck(pPutMedia, &xFragmentAck);
+            }
+            uOffset += uFragAckLen;
+            if (xFragmentAck.eventType == eError)
+            {
+                res = KVS_GENERATE_PUTMEDIA_ERROR(xFragmentAck.uErrorId);
+                break;
+            }
+        }
+    }
+
+    if (uOffset > 0)
+    {
+        memmove(pPutMedia->pRecvBuf, pPutMedia->pRecvBuf + uOffset, pPutMedia->uRecvLen - uOffset);
+        pPutMedia->uRecvLen -= uOffset;
+    }
+
+    return res;
+}
+
+int Kvs_putMediaDoWork(PutMediaHandle xPutMediaHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMedia_t *pPutMedia = xPutMediaHandle;
+    size_t uBytesReceived = 0;
 
     if (pPutMedia == NULL)
     {
@@ -1253,67 +2209,52 @@ int Kvs_putMediaDoWork(PutMediaHandle xPutMediaHandle)
     {
         if (NetIo_isDataAvailable(pPutMedia->xNetIoHandle))
         {
-            if ((xBufRecv = BUFFER_create_with_size(DEFAULT_RECV_BUFSIZE)) == NULL)
+            prvFlushFragmentAck(pPutMedia);
+            while (NetIo_isDataAvailable(pPutMedia->xNetIoHandle))
             {
-                res = KVS_ERROR_C_UTIL_UNABLE_TO_CREATE_BUFFER;
-                LogError("OOM: xBufRecv");
-            }
-            else
-            {
-                prvFlushFragmentAck(pPutMedia);
-                while (NetIo_isDataAvailable(pPutMedia->xNetIoHandle))
+                if (pPutMedia->uRecvLen == sizeof(pPutMedia->pRecvBuf))
                 {
-                    if (BUFFER_length(xBufRecv) == uBytesTotalReceived && BUFFER_enlarge(xBufRecv, BUFFER_length(xBufRecv) * 2) != 0)
-                    {
-                        res = KVS_ERROR_C_UTIL_UNABLE_TO_ENLARGE_BUFFER;
-                        LogError("OOM: xBufRecv");
-                        break;
-                    }
-
-                    if ((res = NetIo_recv(pPutMedia->xNetIoHandle, BUFFER_u_char(xBufRecv) + uBytesTotalReceived, BUFFER_length(xBufRecv) - uBytesTotalReceived, &uBytesReceived)) !=KVS_ERRNO_NONE)
-                    {
-                        LogError("Failed to receive");
-                        /* Propagate the res error */
-                        break;
-                    }
-
-                    uBytesTotalReceived += uBytesReceived;
+                    /* An ack never gets this long, so the buffered data can't be parsed. */
+                    LogError("Drop unparsed fragment ack data");
+                    pPutMedia->uRecvLen = 0;
                 }
 
-                if (res == KVS_ERRNO_NONE && uBytesTotalReceived > 0)
+                if ((res = NetIo_recv(pPutMedia->xNetIoHandle, pPutMedia->pRecvBuf + pPutMedia->uRecvLen, sizeof(pPutMedia->pRecvBuf) - pPutMedia->uRecvLen, &uBytesReceived)) != KVS_ERRNO_NONE)
                 {
-                    uBytesReceived = 0;
-                    while (uBytesReceived < uBytesTotalReceived)
-                    {
-                        memset(&xFragmentAck, 0, sizeof(FragmentAck_t));
-                        if (prvParseFragmentAck((char *)BUFFER_u_char(xBufRecv) + uBytesReceived, uBytesTotalReceived - uBytesReceived, &xFragmentAck, &uFragAckLen) != KVS_ERRNO_NONE ||
-                            uFragAckLen == 0)
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            prvLogFragmentAck(&xFragmentAck);
-                            prvPushFragmentAck(pPutMedia, &xFragmentAck);
-                            if (xFragmentAck.eventType == eError)
-                            {
-                                res = KVS_GENERATE_PUTMEDIA_ERROR(xFragmentAck.uErrorId);
-                                break;
-                            }
-                        }
-                        uBytesReceived += uFragAckLen;
-                    }
-                    // prvLogPendingFragmentAcks(pPutMedia);
+                    LogError("Failed to receive");
+                    /* Propagate the res error */
+                    break;
+                }
+
+                pPutMedia->uRecvLen += uBytesReceived;
+
+                if ((res = prvParseRecvBuf(pPutMedia)) != KVS_ERRNO_NONE)
+                {
+                    /* Propagate the res error */
+                    break;
                 }
             }
+            // prvLogPendingFragmentAcks(pPutMedia);
         }
     }
 
-    BUFFER_delete(xBufRecv);
-
     return res;
 }
 
+int Kvs_putMediaGetSocket(PutMediaHandle xPutMediaHandle)
+{
+    PutMedia_t *pPutMedia = xPutMediaHandle;
+
+    return (pPutMedia == NULL) ? -1 : NetIo_getSocket(pPutMedia->xNetIoHandle);
+}
+
+int Kvs_putMediaGetNetIoStats(PutMediaHandle xPutMediaHandle, NetIoStats_t *pxStats)
+{
+    PutMedia_t *pPutMedia = xPutMediaHandle;
+
+    return (pPutMedia == NULL) ? KVS_ERROR_INVALID_ARGUMENT : NetIo_getStats(pPutMedia->xNetIoHandle, pxStats);
+}
+
 void Kvs_putMediaFinish(PutMediaHandle xPutMediaHandle)
 {
     PutMedia_t *pPutMedia = xPutMediaHandle;
@@ -1322,6 +2263,7 @@ void Kvs_putMediaFinish(PutMediaHandle xPutMediaHandle)
     {
         prvFlushFragmentAck(pPutMedia);
         Lock_Deinit(pPutMedia->xLock);
+        kvsFree(pPutMedia->pcHttpReq);
         if (pPutMedia->xNetIoHandle != NULL)
         {
             NetIo_disconnect(pPutMedia->xNetIoHandle);
@@ -1373,17 +2315,38 @@ int Kvs_putMediaUpdateSendTimeout(PutMediaHandle xPutMediaHandle, unsigned int u
     return res;
 }
 
+int Kvs_putMediaUpdatePacing(PutMediaHandle xPutMediaHandle, unsigned int uRateBps, unsigned int uBurstBytes)
+{
+    int res = KVS_ERRNO_NONE;
+    PutMedia_t *pPutMedia = xPutMediaHandle;
+
+    if (pPutMedia == NULL || pPutMedia->xNetIoHandle == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+    }
+    else if ((res = NetIo_setPacing(pPutMedia->xNetIoHandle, uRateBps, uBurstBytes)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        /* nop */
+    }
+
+    return res;
+}
+
 int Kvs_putMediaReadFragmentAck(PutMediaHandle xPutMediaHandle, ePutMediaFragmentAckEventType *peAckEventType, uint64_t *puFragmentTimecode, unsigned int *puErrorId)
 {
     int res = KVS_ERRNO_NONE;
     PutMedia_t *pPutMedia = xPutMediaHandle;
-    FragmentAck_t *pFragmentAck = NULL;
+    FragmentAck_t xFragmentAck = {0};
 
     if (pPutMedia == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
     }
-    else if ((pFragmentAck = prvReadFragmentAck(pPutMedia)) == NULL)
+    else if (!prvReadFragmentAck(pPutMedia, &xFragmentAck))
     {
         res = KVS_ERROR_NO_PUTMEDIA_FRAGMENT_ACK_AVAILABLE;
     }
@@ -1391,17 +2354,16 @@ int Kvs_putMediaReadFragmentAck(PutMediaHandle xPutMediaHandle, ePutMediaFragmen
     {
         if (peAckEventType != NULL)
         {
-            *peAckEventType = pFragmentAck->eventType;
+            *peAckEventType = xFragmentAck.eventType;
         }
         if (puFragmentTimecode != NULL)
         {
-            *puFragmentTimecode = pFragmentAck->uFragmentTimecode;
+            *puFragmentTimecode = xFragmentAck.uFragmentTimecode;
         }
         if (puErrorId != NULL)
         {
-            *puErrorId = pFragmentAck->uErrorId;
+            *puErrorId = xFragmentAck.uErrorId;
         }
-        kvsFree(pFragmentAck);
     }
 
     return res;
@@ -0,0 +1,263 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Thirdparty headers */
+#include "azure_c_shared_utility/xlogging.h"
+
+/* Public headers */
+#include "kvs/errors.h"
+
+/* Internal headers */
+#include "os/allocator.h"
+#include "stream/latency_tracker.h"
+
+#define LATENCY_STAGE_BIT(xStage) ((uint8_t)(1 << (xStage)))
+
+typedef struct TrackedCluster
+{
+    bool bInUse;
+    uint64_t uTimecodeMs;
+    uint64_t uAddedMs;
+
+    /* The time the last frame of the cluster was sent. It's recorded as a sample once the cluster is complete. */
+    uint64_t uLastSentMs;
+
+    /* Stages that have been recorded */
+    uint8_t uStageMask;
+} TrackedCluster_t;
+
+typedef struct LatencyWindow
+{
+    uint32_t puSamples[LATENCY_TRACKER_WINDOW_SIZE];
+    size_t uHead;
+    size_t uLen;
+    uint32_t uCount;
+    uint32_t uMaxMs;
+} LatencyWindow_t;
+
+typedef struct LatencyTracker
+{
+    /* Clusters in the order they are added, and the oldest one is overwritten when it's full. */
+    TrackedCluster_t pxClusters[LATENCY_TRACKER_MAX_CLUSTERS];
+    size_t uNextCluster;
+
+    /* The cluster that frames are being sent from */
+    TrackedCluster_t *pxSendingCluster;
+
+    LatencyWindow_t pxWindows[LATENCY_STAGE_MAX];
+} LatencyTracker_t;
+
+static TrackedCluster_t *prvFindCluster(LatencyTracker_t *pxTracker, uint64_t uTimecodeMs)
+{
+    TrackedCluster_t *pxCluster = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < LATENCY_TRACKER_MAX_CLUSTERS; i++)
+    {
+        if (pxTracker->pxClusters[i].bInUse && pxTracker->pxClusters[i].uTimecodeMs == uTimecodeMs)
+        {
+            pxCluster = &(pxTracker->pxClusters[i]);
+            break;
+        }
+    }
+
+    return pxCluster;
+}
+
+static void prvAddSample(LatencyTracker_t *pxTracker, LatencyStage_t xStage, TrackedCluster_t *pxCluster, uint64_t uTimeMs)
+{
+    LatencyWindow_t *pxWindow = &(pxTracker->pxWindows[xStage]);
+    uint64_t uLatencyMs = (uTimeMs > pxCluster->uAddedMs) ? (uTimeMs - pxCluster->uAddedMs) : 0;
+    uint32_t uSampleMs = (uLatencyMs > UINT32_MAX) ? UINT32_MAX : (uint32_t)uLatencyMs;
+
+    pxCluster->uStageMask |= LATENCY_STAGE_BIT(xStage);
+
+    pxWindow->puSamples[pxWindow->uHead] = uSampleMs;
+    pxWindow->uHead = (pxWindow->uHead + 1) % LATENCY_TRACKER_WINDOW_SIZE;
+    if (pxWindow->uLen < LATENCY_TRACKER_WINDOW_SIZE)
+    {
+        pxWindow->uLen++;
+    }
+    pxWindow->uCount++;
+    if (uSampleMs > pxWindow->uMaxMs)
+    {
+        pxWindow->uMaxMs = uSampleMs;
+    }
+}
+
+static void prvFinishSent(LatencyTracker_t *pxTracker, TrackedCluster_t *pxCluster)
+{
+    if (pxCluster->uLastSentMs != 0 && (pxCluster->uStageMask & LATENCY_STAGE_BIT(LATENCY_STAGE_SENT)) == 0)
+    {
+        prvAddSample(pxTracker, LATENCY_STAGE_SENT, pxCluster, pxCluster->uLastSentMs);
+    }
+}
+
+static void prvRemoveCluster(LatencyTracker_t *pxTracker, TrackedCluster_t *pxCluster)
+{
+    if (pxTracker->pxSendingCluster == pxCluster)
+    {
+        pxTracker->pxSendingCluster = NULL;
+    }
+    memset(pxCluster, 0, sizeof(TrackedCluster_t));
+}
+
+static uint32_t prvPercentile(uint32_t *puSorted, size_t uLen, unsigned int uPercent)
+{
+    /* Nearest-rank method */
+    size_t uRank = (uLen * uPercent + 99) / 100;
+
+    return puSorted[(uRank > 0) ? (uRank - 1) : 0];
+}
+
+LatencyTrackerHandle Kvs_latencyTrackerCreate(void)
+{
+    LatencyTracker_t *pxTracker = NULL;
+
+    if ((pxTracker = (LatencyTracker_t *)kvsMalloc(sizeof(LatencyTracker_t))) == NULL)
+    {
+        LogError("OOM: pxTracker");
+    }
+    else
+    {
+        memset(pxTracker, 0, sizeof(LatencyTracker_t));
+    }
+
+    return pxTracker;
+}
+
+void Kvs_latencyTrackerTerminate(LatencyTrackerHandle xLatencyTrackerHandle)
+{
+    if (xLatencyTrackerHandle != NULL)
+    {
+        kvsFree(xLatencyTrackerHandle);
+    }
+}
+
+void Kvs_latencyTrackerAddCluster(LatencyTrackerHandle xLatencyTrackerHandle, uint64_t uTimecodeMs, uint64_t uNowMs)
+{
+    LatencyTracker_t *pxTracker = xLatencyTrackerHandle;
+    TrackedCluster_t *pxCluster = NULL;
+
+    if (pxTracker != NULL)
+    {
+        pxCluster = &(pxTracker->pxClusters[pxTracker->uNextCluster]);
+        prvRemoveCluster(pxTracker, pxCluster);
+        pxCluster->bInUse = true;
+        pxCluster->uTimecodeMs = uTimecodeMs;
+        pxCluster->uAddedMs = uNowMs;
+        pxTracker->uNextCluster = (pxTracker->uNextCluster + 1) % LATENCY_TRACKER_MAX_CLUSTERS;
+    }
+}
+
+void Kvs_latencyTrackerMark(LatencyTrackerHandle xLatencyTrackerHandle, uint64_t uTimecodeMs, LatencyStage_t xStage, uint64_t uNowMs)
+{
+    LatencyTracker_t *pxTracker = xLatencyTrackerHandle;
+    TrackedCluster_t *pxCluster = NULL;
+
+    if (pxTracker == NULL || xStage >= LATENCY_STAGE_MAX)
+    {
+        /* nop */
+    }
+    else if ((pxCluster = prvFindCluster(pxTracker, uTimecodeMs)) == NULL)
+    {
+        /* The cluster is unknown or it has been dropped. */
+    }
+    else if (xStage == LATENCY_STAGE_SENT)
+    {
+        /* A cluster is sent completely when frames of the next one start to be sent. */
+        if (pxTracker->pxSendingCluster != NULL && pxTracker->pxSendingCluster != pxCluster)
+        {
+            prvFinishSent(pxTracker, pxTracker->pxSendingCluster);
+        }
+        pxTracker->pxSendingCluster = pxCluster;
+        pxCluster->uLastSentMs = uNowMs;
+    }
+    else
+    {
+        if (xStage != LATENCY_STAGE_BUFFERING)
+        {
+            /* The whole fragment has been received, so all of its frames are sent. */
+            prvFinishSent(pxTracker, pxCluster);
+        }
+
+        if ((pxCluster->uStageMask & LATENCY_STAGE_BIT(xStage)) == 0)
+        {
+            prvAddSample(pxTracker, xStage, pxCluster, uNowMs);
+        }
+
+        if (xStage == LATENCY_STAGE_PERSISTED)
+        {
+            prvRemoveCluster(pxTracker, pxCluster);
+        }
+    }
+}
+
+int Kvs_latencyTrackerGetSummary(LatencyTrackerHandle xLatencyTrackerHandle, LatencyStage_t xStage, LatencySummary_t *pxSummary)
+{
+    int res = KVS_ERRNO_NONE;
+    LatencyTracker_t *pxTracker = xLatencyTrackerHandle;
+    LatencyWindow_t *pxWindow = NULL;
+    uint32_t puSorted[LATENCY_TRACKER_WINDOW_SIZE];
+    uint32_t uSample = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+    if (pxTracker == NULL || xStage >= LATENCY_STAGE_MAX || pxSummary == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        pxWindow = &(pxTracker->pxWindows[xStage]);
+        memset(pxSummary, 0, sizeof(LatencySummary_t));
+        pxSummary->uCount = pxWindow->uCount;
+        pxSummary->uMaxMs = pxWindow->uMaxMs;
+
+        if (pxWindow->uLen > 0)
+        {
+            /* The window is small, so an insertion sort on a copy is good enough. */
+            for (i = 0; i < pxWindow->uLen; i++)
+            {
+                uSample = pxWindow->puSamples[i];
+                for (j = i; j > 0 && puSorted[j - 1] > uSample; j--)
+                {
+                    puSorted[j] = puSorted[j - 1];
+                }
+                puSorted[j] = uSample;
+            }
+
+            pxSummary->uP50Ms = prvPercentile(puSorted, pxWindow->uLen, 50);
+            pxSummary->uP95Ms = prvPercentile(puSorted, pxWindow->uLen, 95);
+        }
+    }
+
+    return res;
+}
+
+void Kvs_latencyTrackerReset(LatencyTrackerHandle xLatencyTrackerHandle)
+{
+    LatencyTracker_t *pxTracker = xLatencyTrackerHandle;
+
+    if (pxTracker != NULL)
+    {
+        memset(pxTracker->pxWindows, 0, sizeof(pxTracker->pxWindows));
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVS_LATENCY_TRACKER_H
+#define KVS_LATENCY_TRACKER_H
+
+#include <stdint.h>
+
+/* The number of clusters that are tracked at the same time. The oldest one is dropped if there are more. */
+#ifndef LATENCY_TRACKER_MAX_CLUSTERS
+#define LATENCY_TRACKER_MAX_CLUSTERS (32)
+#endif
+
+/* The number of latest samples of each stage that percentiles are computed from */
+#ifndef LATENCY_TRACKER_WINDOW_SIZE
+#define LATENCY_TRACKER_WINDOW_SIZE (64)
+#endif
+
+typedef enum LatencyStage
+{
+    LATENCY_STAGE_SENT = 0,
+    LATENCY_STAGE_BUFFERING,
+    LATENCY_STAGE_RECEIVED,
+    LATENCY_STAGE_PERSISTED,
+    LATENCY_STAGE_MAX
+} LatencyStage_t;
+
+typedef struct LatencySummary
+{
+    /* The number of samples since the creation or the last reset */
+    uint32_t uCount;
+
+    /* Percentiles of the latest samples, and the max of all samples */
+    uint32_t uP50Ms;
+    uint32_t uP95Ms;
+    uint32_t uMaxMs;
+} LatencySummary_t;
+
+typedef struct LatencyTracker *LatencyTrackerHandle;
+
+/**
+ * @brief Create a latency tracker
+ *
+ * Clusters are identified by their timecode in milliseconds, which is the fragment timecode of fragment acks when
+ * the timecode type is absolute. The latency of each stage is measured from the time the cluster is added. The tracker
+ * isn't thread safe.
+ *
+ * @return The latency tracker handle on success, NULL otherwise
+ */
+LatencyTrackerHandle Kvs_latencyTrackerCreate(void);
+
+/**
+ * @brief Terminate a latency tracker
+ *
+ * @param[in] xLatencyTrackerHandle The latency tracker handle
+ */
+void Kvs_latencyTrackerTerminate(LatencyTrackerHandle xLatencyTrackerHandle);
+
+/**
+ * @brief Start tracking a cluster
+ *
+ * @param[in] xLatencyTrackerHandle The latency tracker handle
+ * @param[in] uTimecodeMs The cluster timecode
+ * @param[in] uNowMs The current time
+ */
+void Kvs_latencyTrackerAddCluster(LatencyTrackerHandle xLatencyTrackerHandle, uint64_t uTimecodeMs, uint64_t uNowMs);
+
+/**
+ * @brief Record that a cluster has reached a stage. The first time of each ack stage is kept, and the cluster is no
+ * longer tracked once it's persisted. Unknown clusters are ignored.
+ *
+ * LATENCY_STAGE_SENT is marked on every frame sent, and the time of the last one is taken once the next cluster starts
+ * to be sent or the fragment is received.
+ *
+ * @param[in] xLatencyTrackerHandle The latency tracker handle
+ * @param[in] uTimecodeMs The cluster timecode
+ * @param[in] xStage The stage
+ * @param[in] uNowMs The current time
+ */
+void Kvs_latencyTrackerMark(LatencyTrackerHandle xLatencyTrackerHandle, uint64_t uTimecodeMs, LatencyStage_t xStage, uint64_t uNowMs);
+
+/**
+ * @brief Get the latency summary of a stage
+ *
+ * @param[in] xLatencyTrackerHandle The latency tracker handle
+ * @param[in] xStage The stage
+ * @param[out] pxSummary The latency summary
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_latencyTrackerGetSummary(LatencyTrackerHandle xLatencyTrackerHandle, LatencyStage_t xStage, LatencySummary_t *pxSummary);
+
+/**
+ * @brief Drop all samples. Clusters in flight are still tracked.
+ *
+ * @param[in] xLatencyTrackerHandle The latency tracker handle
+ */
+void Kvs_latencyTrackerReset(LatencyTrackerHandle xLatencyTrackerHandle);
+
+#endif /* KVS_LATENCY_TRACKER_H */
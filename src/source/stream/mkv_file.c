@@ -0,0 +1,531 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/* Thirdparty headers */
+#include "azure_c_shared_utility/xlogging.h"
+
+/* Public headers */
+#include "kvs/errors.h"
+
+/* Internal headers */
+#include "os/allocator.h"
+#include "stream/mkv_file.h"
+
+#define MKV_FILE_SEGMENT_ID (0x18538067)
+#define MKV_FILE_CLUSTER_ID (0x1F43B675)
+#define MKV_FILE_CLUSTER_TIMECODE_ID (0xE7)
+
+/* The max length of an element ID and its size */
+#define MKV_FILE_ELEMENT_HEADER_MAX_LEN (12)
+
+/* The number of clusters that the index is allocated with at first, and it's doubled whenever it's full. */
+#define MKV_FILE_INITIAL_CLUSTER_CAPACITY (16)
+
+typedef struct MkvFileElement
+{
+    uint32_t uId;
+    uint64_t uDataOffset;
+    uint64_t uSize;
+    bool bUnknownSize;
+} MkvFileElement_t;
+
+typedef struct MkvFileCluster
+{
+    uint64_t uTimecodeMs;
+    uint64_t uOffset;
+    uint64_t uLen;
+} MkvFileCluster_t;
+
+typedef struct MkvFile
+{
+    FILE *fp;
+    uint64_t uFileLen;
+
+    /* The mapping of the whole file, or NULL if it's read into the read buffer. */
+    uint8_t *pMap;
+    uint8_t *pReadBuf;
+    size_t uReadBufSize;
+
+    uint64_t uMkvHeaderLen;
+
+    MkvFileCluster_t *pxClusters;
+    size_t uClusterCount;
+    size_t uClusterCapacity;
+
+    /* The cluster of the next byte to read, and the offset of that byte in the file. */
+    size_t uReadCluster;
+    uint64_t uReadOffset;
+} MkvFile_t;
+
+static int prvMkvFileReadAt(MkvFile_t *pxFile, uint64_t uOffset, size_t uLen, uint8_t **ppData)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pReadBuf = NULL;
+
+    if (uOffset > pxFile->uFileLen || uLen > pxFile->uFileLen - uOffset)
+    {
+        res = KVS_ERROR_STREAM_MKV_FILE_IO_ERROR;
+        LogError("Read beyond the end of MKV file");
+    }
+    else if (pxFile->pMap != NULL)
+    {
+        *ppData = pxFile->pMap + uOffset;
+    }
+    else
+    {
+        if (uLen > pxFile->uReadBufSize)
+        {
+            if ((pReadBuf = (uint8_t *)kvsRealloc(pxFile->pReadBuf, uLen)) == NULL)
+            {
+                res = KVS_ERROR_OUT_OF_MEMORY;
+                LogError("OOM: MKV file read buffer");
+            }
+            else
+            {
+                pxFile->pReadBuf = pReadBuf;
+                pxFile->uReadBufSize = uLen;
+            }
+        }
+
+        if (res == KVS_ERRNO_NONE)
+        {
+            if (fseek(pxFile->fp, (long)uOffset, SEEK_SET) != 0 || (uLen > 0 && fread(pxFile->pReadBuf, uLen, 1, pxFile->fp) != 1))
+            {
+                res = KVS_ERROR_STREAM_MKV_FILE_IO_ERROR;
+                LogError("Failed to read MKV file");
+            }
+            else
+            {
+                *ppData = pxFile->pReadBuf;
+            }
+        }
+    }
+
+    return res;
+}
+
+/**
+ * @brief Read the ID and the size of an element. The lengths of both are told by the leading zero bits of their first
+ * byte, and a size whose bits are all ones is unknown.
+ */
+static int prvMkvFileReadElement(MkvFile_t *pxFile, uint64_t uOffset, MkvFileElement_t *pxElement)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t *pHdr = NULL;
+    size_t uHdrLen = 0;
+    size_t uIdLen = 1;
+    size_t uSizeLen = 1;
+    size_t i = 0;
+
+    if (uOffset >= pxFile->uFileLen)
+    {
+        res = KVS_ERROR_STREAM_MKV_FILE_IS_BROKEN;
+    }
+    else
+    {
+        uHdrLen = (pxFile->uFileLen - uOffset < MKV_FILE_ELEMENT_HEADER_MAX_LEN) ? (size_t)(pxFile->uFileLen - uOffset) : MKV_FILE_ELEMENT_HEADER_MAX_LEN;
+        res = prvMkvFileReadAt(pxFile, uOffset, uHdrLen, &pHdr);
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        while (uIdLen <= 4 && (pHdr[0] & (0x80 >> (uIdLen - 1))) == 0)
+        {
+            uIdLen++;
+        }
+        if (uIdLen < uHdrLen)
+        {
+            while (uSizeLen <= 8 && (pHdr[uIdLen] & (0x80 >> (uSizeLen - 1))) == 0)
+            {
+                uSizeLen++;
+            }
+        }
+
+        if (uIdLen > 4 || uSizeLen > 8 || uIdLen + uSizeLen > uHdrLen)
+        {
+            res = KVS_ERROR_STREAM_MKV_FILE_IS_BROKEN;
+        }
+        else
+        {
+            pxElement->uId = 0;
+            for (i = 0; i < uIdLen; i++)
+            {
+                pxElement->uId = (pxElement->uId << 8) | pHdr[i];
+            }
+
+            /* The length marker is cleared from the first byte of the size. */
+            pxElement->uSize = pHdr[uIdLen] & (0xFF >> uSizeLen);
+            pxElement->bUnknownSize = (pxElement->uSize == (uint64_t)(0xFF >> uSizeLen));
+            for (i = 1; i < uSizeLen; i++)
+            {
+                pxElement->uSize = (pxElement->uSize << 8) | pHdr[uIdLen + i];
+                pxElement->bUnknownSize = pxElement->bUnknownSize && (pHdr[uIdLen + i] == 0xFF);
+            }
+            pxElement->uDataOffset = uOffset + uIdLen + uSizeLen;
+        }
+    }
+
+    return res;
+}
+
+static bool prvMkvFileIsLevelOneId(uint32_t uId)
+{
+    /* Elements right under the segment, like clusters and Cues, have 4 bytes IDs that start with 0x1. */
+    return (uId >> 28) == 0x1;
+}
+
+static int prvMkvFileAddCluster(MkvFile_t *pxFile, uint64_t uTimecodeMs, uint64_t uOffset, uint64_t uLen)
+{
+    int res = KVS_ERRNO_NONE;
+    MkvFileCluster_t *pxClusters = NULL;
+    size_t uCapacity = (pxFile->uClusterCapacity == 0) ? MKV_FILE_INITIAL_CLUSTER_CAPACITY : (pxFile->uClusterCapacity * 2);
+
+    if (pxFile->uClusterCount == pxFile->uClusterCapacity)
+    {
+        if ((pxClusters = (MkvFileCluster_t *)kvsRealloc(pxFile->pxClusters, uCapacity * sizeof(MkvFileCluster_t))) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: MKV file clusters");
+        }
+        else
+        {
+            pxFile->pxClusters = pxClusters;
+            pxFile->uClusterCapacity = uCapacity;
+        }
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        pxFile->pxClusters[pxFile->uClusterCount].uTimecodeMs = uTimecodeMs;
+        pxFile->pxClusters[pxFile->uClusterCount].uOffset = uOffset;
+        pxFile->pxClusters[pxFile->uClusterCount].uLen = uLen;
+        pxFile->uClusterCount++;
+    }
+
+    return res;
+}
+
+/**
+ * @brief Index a cluster, which ends at the next element right under the segment if its size is unknown, or at its
+ * last complete child if the file is cut short.
+ */
+static int prvMkvFileIndexCluster(MkvFile_t *pxFile, uint64_t uOffset, const MkvFileElement_t *pxCluster, uint64_t *puEnd)
+{
+    int res = KVS_ERRNO_NONE;
+    MkvFileElement_t xChild = {0};
+    uint64_t uEnd = pxFile->uFileLen;
+    uint64_t uChildOffset = pxCluster->uDataOffset;
+    uint64_t uTimecodeMs = 0;
+    bool bHasTimecode = false;
+    uint8_t *pValue = NULL;
+    size_t i = 0;
+
+    if (!pxCluster->bUnknownSize && pxCluster->uSize <= pxFile->uFileLen - pxCluster->uDataOffset)
+    {
+        uEnd = pxCluster->uDataOffset + pxCluster->uSize;
+    }
+
+    while (res == KVS_ERRNO_NONE && uChildOffset < uEnd && prvMkvFileReadElement(pxFile, uChildOffset, &xChild) == KVS_ERRNO_NONE)
+    {
+        if (prvMkvFileIsLevelOneId(xChild.uId) || xChild.bUnknownSize || xChild.uSize > uEnd - xChild.uDataOffset)
+        {
+            break;
+        }
+
+        if (xChild.uId == MKV_FILE_CLUSTER_TIMECODE_ID && xChild.uSize > 0 && xChild.uSize <= 8 &&
+            (res = prvMkvFileReadAt(pxFile, xChild.uDataOffset, (size_t)xChild.uSize, &pValue)) == KVS_ERRNO_NONE)
+        {
+            uTimecodeMs = 0;
+            for (i = 0; i < (size_t)xChild.uSize; i++)
+            {
+                uTimecodeMs = (uTimecodeMs << 8) | pValue[i];
+            }
+            bHasTimecode = true;
+        }
+        uChildOffset = xChild.uDataOffset + xChild.uSize;
+    }
+
+    if (res == KVS_ERRNO_NONE)
+    {
+        *puEnd = uChildOffset;
+        if (!bHasTimecode)
+        {
+            LogInfo("Skip a cluster without timecode");
+        }
+        else
+        {
+            res = prvMkvFileAddCluster(pxFile, uTimecodeMs, uOffset, uChildOffset - uOffset);
+        }
+    }
+
+    return res;
+}
+
+static int prvMkvFileIndex(MkvFile_t *pxFile)
+{
+    int res = KVS_ERRNO_NONE;
+    MkvFileElement_t xElement = {0};
+    uint64_t uOffset = 0;
+    uint64_t uEnd = 0;
+    bool bHasSegment = false;
+
+    while (res == KVS_ERRNO_NONE && prvMkvFileReadElement(pxFile, uOffset, &xElement) == KVS_ERRNO_NONE)
+    {
+        if (xElement.uId == MKV_FILE_SEGMENT_ID)
+        {
+            /* Step into the segment, whose size is unknown if it's written as a stream. */
+            bHasSegment = true;
+            uOffset = xElement.uDataOffset;
+        }
+        else if (xElement.uId == MKV_FILE_CLUSTER_ID)
+        {
+            if (pxFile->uClusterCount == 0)
+            {
+                pxFile->uMkvHeaderLen = uOffset;
+            }
+            res = prvMkvFileIndexCluster(pxFile, uOffset, &xElement, &uEnd);
+            uOffset = uEnd;
+        }
+        else if (xElement.bUnknownSize || xElement.uSize > pxFile->uFileLen - xElement.uDataOffset)
+        {
+            break;
+        }
+        else
+        {
+            /* Other elements, like Cues at the end of recorder files, are not read. */
+            uOffset = xElement.uDataOffset + xElement.uSize;
+        }
+    }
+
+    if (res == KVS_ERRNO_NONE && !bHasSegment)
+    {
+        res = KVS_ERROR_STREAM_MKV_FILE_IS_BROKEN;
+        LogError("No segment in MKV file");
+    }
+
+    return res;
+}
+
+MkvFileHandle Kvs_mkvFileOpen(const char *pcFilename)
+{
+    int res = KVS_ERRNO_NONE;
+    MkvFile_t *pxFile = NULL;
+    long xFileLen = 0;
+
+    if (pcFilename == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((pxFile = (MkvFile_t *)kvsMalloc(sizeof(MkvFile_t))) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pxFile");
+    }
+    else
+    {
+        memset(pxFile, 0, sizeof(MkvFile_t));
+
+        if ((pxFile->fp = fopen(pcFilename, "rb")) == NULL || fseek(pxFile->fp, 0, SEEK_END) != 0 || (xFileLen = ftell(pxFile->fp)) < 0)
+        {
+            res = KVS_ERROR_STREAM_MKV_FILE_IO_ERROR;
+            LogError("Failed to open MKV file %s", pcFilename);
+        }
+        else
+        {
+            pxFile->uFileLen = (uint64_t)xFileLen;
+#if defined(__linux__)
+            /* Pages of the mapping are read ahead as they're sent, and nothing is copied in user space. */
+            if (xFileLen > 0)
+            {
+                pxFile->pMap = (uint8_t *)mmap(NULL, (size_t)xFileLen, PROT_READ, MAP_PRIVATE, fileno(pxFile->fp), 0);
+                if ((void *)(pxFile->pMap) == MAP_FAILED)
+                {
+                    LogInfo("Failed to map MKV file, read it instead");
+                    pxFile->pMap = NULL;
+                }
+                else
+                {
+                    posix_madvise(pxFile->pMap, (size_t)xFileLen, POSIX_MADV_SEQUENTIAL);
+                }
+            }
+#endif
+            if ((res = prvMkvFileIndex(pxFile)) == KVS_ERRNO_NONE)
+            {
+                pxFile->uReadOffset = (pxFile->uClusterCount > 0) ? pxFile->pxClusters[0].uOffset : pxFile->uFileLen;
+            }
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        Kvs_mkvFileClose(pxFile);
+        pxFile = NULL;
+    }
+
+    return pxFile;
+}
+
+void Kvs_mkvFileClose(MkvFileHandle xMkvFileHandle)
+{
+    MkvFile_t *pxFile = xMkvFileHandle;
+
+    if (pxFile != NULL)
+    {
+#if defined(__linux__)
+        if (pxFile->pMap != NULL)
+        {
+            munmap(pxFile->pMap, (size_t)pxFile->uFileLen);
+        }
+#endif
+        if (pxFile->fp != NULL)
+        {
+            fclose(pxFile->fp);
+        }
+        kvsFree(pxFile->pReadBuf);
+        kvsFree(pxFile->pxClusters);
+        kvsFree(pxFile);
+    }
+}
+
+int Kvs_mkvFileGetEbmlSegHdr(MkvFileHandle xMkvFileHandle, uint8_t **ppMkvHeader, size_t *puMkvHeaderLen)
+{
+    int res = KVS_ERRNO_NONE;
+    MkvFile_t *pxFile = xMkvFileHandle;
+
+    if (pxFile == NULL || ppMkvHeader == NULL || puMkvHeaderLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pxFile->uClusterCount == 0)
+    {
+        res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
+    }
+    else if ((res = prvMkvFileReadAt(pxFile, 0, (size_t)pxFile->uMkvHeaderLen, ppMkvHeader)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        *puMkvHeaderLen = (size_t)pxFile->uMkvHeaderLen;
+    }
+
+    return res;
+}
+
+int Kvs_mkvFileGetTimecodeRange(MkvFileHandle xMkvFileHandle, uint64_t *puFirstTimecodeMs, uint64_t *puLastTimecodeMs)
+{
+    int res = KVS_ERRNO_NONE;
+    MkvFile_t *pxFile = xMkvFileHandle;
+
+    if (pxFile == NULL || puFirstTimecodeMs == NULL || puLastTimecodeMs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pxFile->uClusterCount == 0)
+    {
+        res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
+    }
+    else
+    {
+        *puFirstTimecodeMs = pxFile->pxClusters[0].uTimecodeMs;
+        *puLastTimecodeMs = pxFile->pxClusters[pxFile->uClusterCount - 1].uTimecodeMs;
+    }
+
+    return res;
+}
+
+int Kvs_mkvFileSeek(MkvFileHandle xMkvFileHandle, uint64_t uTimecodeMs)
+{
+    int res = KVS_ERRNO_NONE;
+    MkvFile_t *pxFile = xMkvFileHandle;
+    size_t i = 0;
+
+    if (pxFile == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        while (i < pxFile->uClusterCount && pxFile->pxClusters[i].uTimecodeMs <= uTimecodeMs)
+        {
+            i++;
+        }
+        pxFile->uReadCluster = i;
+        pxFile->uReadOffset = (i < pxFile->uClusterCount) ? pxFile->pxClusters[i].uOffset : pxFile->uFileLen;
+    }
+
+    return res;
+}
+
+int Kvs_mkvFileRead(MkvFileHandle xMkvFileHandle, size_t uMaxLen, uint8_t **ppData, size_t *puDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    MkvFile_t *pxFile = xMkvFileHandle;
+    MkvFileCluster_t *pxCluster = NULL;
+    size_t uNext = 0;
+    uint64_t uEnd = 0;
+    size_t uLen = 0;
+
+    if (pxFile == NULL || uMaxLen == 0 || ppData == NULL || puDataLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pxFile->uReadCluster >= pxFile->uClusterCount)
+    {
+        res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
+    }
+    else
+    {
+        /* Find the end of the clusters that follow each other without a gap. */
+        pxCluster = &(pxFile->pxClusters[pxFile->uReadCluster]);
+        uEnd = pxCluster->uOffset + pxCluster->uLen;
+        for (uNext = pxFile->uReadCluster + 1; uNext < pxFile->uClusterCount && pxFile->pxClusters[uNext].uOffset == uEnd; uNext++)
+        {
+            uEnd += pxFile->pxClusters[uNext].uLen;
+        }
+
+        uLen = (uEnd - pxFile->uReadOffset < (uint64_t)uMaxLen) ? (size_t)(uEnd - pxFile->uReadOffset) : uMaxLen;
+        if ((res = prvMkvFileReadAt(pxFile, pxFile->uReadOffset, uLen, ppData)) == KVS_ERRNO_NONE)
+        {
+            *puDataLen = uLen;
+            pxFile->uReadOffset += uLen;
+
+            while (pxFile->uReadCluster < pxFile->uClusterCount &&
+                   pxFile->uReadOffset >= pxFile->pxClusters[pxFile->uReadCluster].uOffset + pxFile->pxClusters[pxFile->uReadCluster].uLen)
+            {
+                pxFile->uReadCluster++;
+            }
+            if (pxFile->uReadCluster < pxFile->uClusterCount && pxFile->uReadOffset < pxFile->pxClusters[pxFile->uReadCluster].uOffset)
+            {
+                pxFile->uReadOffset = pxFile->pxClusters[pxFile->uReadCluster].uOffset;
+            }
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVS_MKV_FILE_H
+#define KVS_MKV_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct MkvFile *MkvFileHandle;
+
+/**
+ * @brief Open an MKV file, e.g. one written by the recorder, to be read cluster by cluster
+ *
+ * The clusters are indexed when the file is opened by walking the EBML elements, so the Cues at the end of the file
+ * are not needed. A file that is cut short, e.g. by a power loss, ends at the last complete element of its last
+ * cluster. It's read from the first cluster until it's seeked. On Linux the file is mapped into memory, and data is
+ * read without being copied. Otherwise it's read into a buffer of the largest read length.
+ *
+ * @param[in] pcFilename The file name
+ * @return The MKV file handle on success, NULL otherwise
+ */
+MkvFileHandle Kvs_mkvFileOpen(const char *pcFilename);
+
+/**
+ * @brief Close an MKV file
+ *
+ * @param[in] xMkvFileHandle The MKV file handle
+ */
+void Kvs_mkvFileClose(MkvFileHandle xMkvFileHandle);
+
+/**
+ * @brief Get the MKV EBML and segment header, i.e. all bytes before the first cluster
+ *
+ * The header stays valid until the next read or the file is closed.
+ *
+ * @param[in] xMkvFileHandle The MKV file handle
+ * @param[out] ppMkvHeader The pointer to the header
+ * @param[out] puMkvHeaderLen The length of the header
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_mkvFileGetEbmlSegHdr(MkvFileHandle xMkvFileHandle, uint8_t **ppMkvHeader, size_t *puMkvHeaderLen);
+
+/**
+ * @brief Get the timecodes of the first and the last cluster
+ *
+ * @param[in] xMkvFileHandle The MKV file handle
+ * @param[out] puFirstTimecodeMs The timecode of the first cluster
+ * @param[out] puLastTimecodeMs The timecode of the last cluster
+ * @return 0 on success, KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME if there is no cluster, non-zero value otherwise
+ */
+int Kvs_mkvFileGetTimecodeRange(MkvFileHandle xMkvFileHandle, uint64_t *puFirstTimecodeMs, uint64_t *puLastTimecodeMs);
+
+/**
+ * @brief Start reading from the first byte of the first cluster whose timecode is newer than a timecode
+ *
+ * @param[in] xMkvFileHandle The MKV file handle
+ * @param[in] uTimecodeMs The timecode, e.g. of the last persisted fragment, or 0 to read all clusters
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_mkvFileSeek(MkvFileHandle xMkvFileHandle, uint64_t uTimecodeMs);
+
+/**
+ * @brief Read the next bytes of clusters. Adjacent clusters are read together, and bytes between clusters are skipped.
+ *
+ * @param[in] xMkvFileHandle The MKV file handle
+ * @param[in] uMaxLen The max length to read
+ * @param[out] ppData The pointer to the data, which stays valid until the next read or the file is closed
+ * @param[out] puDataLen The length of the data
+ * @return 0 on success, KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME if nothing is left, non-zero value otherwise
+ */
+int Kvs_mkvFileRead(MkvFileHandle xMkvFileHandle, size_t uMaxLen, uint8_t **ppData, size_t *puDataLen);
+
+#endif /* KVS_MKV_FILE_H */
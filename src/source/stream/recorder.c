@@ -0,0 +1,370 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Thirdparty headers */
+#include "azure_c_shared_utility/xlogging.h"
+
+/* Public headers */
+#include "kvs/errors.h"
+
+/* Internal headers */
+#include "os/allocator.h"
+#include "os/endian.h"
+#include "stream/recorder.h"
+
+#define RECORDER_FILE_EXTENSION ".mkv"
+
+/* The max length of a timestamp of uint64_t in decimal */
+#define RECORDER_TIMESTAMP_MAX_LEN (20)
+
+/* The length of Cues ID and its 8 bytes size */
+#define RECORDER_CUES_HEADER_LEN (12)
+
+/* The length of a CuePoint, including CueTime and CueTrackPositions of CueTrack and CueClusterPosition */
+#define RECORDER_CUE_POINT_LEN (27)
+
+/* Clusters start with key frames of the video track, whose track number is 1. */
+#define RECORDER_CUE_TRACK_NUMBER (1)
+
+static const uint8_t gSegmentId[] = {0x18, 0x53, 0x80, 0x67};
+static const uint8_t gCuesId[] = {0x1C, 0x53, 0xBB, 0x6B};
+
+typedef struct RecorderCuePoint
+{
+    uint64_t uTimestampMs;
+
+    /* The position of the cluster relative to the start of segment data */
+    uint64_t uClusterPos;
+} RecorderCuePoint_t;
+
+typedef struct Recorder
+{
+    char *pcFilePrefix;
+    uint64_t uFileDurationMs;
+
+    uint8_t *pMkvEbmlSegHdr;
+    size_t uMkvEbmlSegHdrLen;
+
+    /* The offset of segment data in the MKV header, which cluster positions in Cues are relative to. */
+    size_t uSegmentDataOffset;
+
+    /* The current file, and its length including the bytes in the write buffer. */
+    FILE *fp;
+    uint64_t uFileStartMs;
+    size_t uFileLen;
+
+    uint8_t *pWriteBuf;
+    size_t uWriteBufSize;
+    size_t uWriteBufLen;
+
+    RecorderCuePoint_t pxCuePoints[RECORDER_MAX_CUE_POINTS];
+    size_t uCuePointCount;
+} Recorder_t;
+
+static int prvRecorderFlush(Recorder_t *pxRecorder)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (pxRecorder->uWriteBufLen > 0 && fwrite(pxRecorder->pWriteBuf, pxRecorder->uWriteBufLen, 1, pxRecorder->fp) != 1)
+    {
+        res = KVS_ERROR_STREAM_RECORDER_IO_ERROR;
+        LogError("Failed to write recorder file");
+    }
+    pxRecorder->uWriteBufLen = 0;
+
+    return res;
+}
+
+static int prvRecorderWrite(Recorder_t *pxRecorder, const uint8_t *pData, size_t uDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    size_t uLen = 0;
+
+    while (res == KVS_ERRNO_NONE && uDataLen > 0)
+    {
+        uLen = pxRecorder->uWriteBufSize - pxRecorder->uWriteBufLen;
+        if (uLen > uDataLen)
+        {
+            uLen = uDataLen;
+        }
+        memcpy(pxRecorder->pWriteBuf + pxRecorder->uWriteBufLen, pData, uLen);
+        pxRecorder->uWriteBufLen += uLen;
+        pxRecorder->uFileLen += uLen;
+        pData += uLen;
+        uDataLen -= uLen;
+
+        /* Only whole buffers are written, so writes before the last one are aligned to blocks. */
+        if (pxRecorder->uWriteBufLen == pxRecorder->uWriteBufSize)
+        {
+            res = prvRecorderFlush(pxRecorder);
+        }
+    }
+
+    return res;
+}
+
+static int prvRecorderWriteCues(Recorder_t *pxRecorder)
+{
+    int res = KVS_ERRNO_NONE;
+    uint8_t pCuesHdr[RECORDER_CUES_HEADER_LEN] = {0};
+    uint8_t pCuePoint[RECORDER_CUE_POINT_LEN] = {
+        0xBB, 0x99,                                           // CuePoint, len = 25
+        0xB3, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // CueTime, len = 8
+        0xB7, 0x8D,                                           // CueTrackPositions, len = 13
+        0xF7, 0x81, RECORDER_CUE_TRACK_NUMBER,                // CueTrack, len = 1
+        0xF1, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00  // CueClusterPosition, len = 8
+    };
+    size_t i = 0;
+
+    memcpy(pCuesHdr, gCuesId, sizeof(gCuesId));
+    PUT_UNALIGNED_8_byte_BE(pCuesHdr + sizeof(gCuesId), (uint64_t)(pxRecorder->uCuePointCount * RECORDER_CUE_POINT_LEN));
+    /* The size takes 8 bytes, and its first byte is the length indicator. */
+    pCuesHdr[sizeof(gCuesId)] = 0x01;
+
+    if (pxRecorder->uCuePointCount > 0)
+    {
+        res = prvRecorderWrite(pxRecorder, pCuesHdr, sizeof(pCuesHdr));
+        for (i = 0; i < pxRecorder->uCuePointCount && res == KVS_ERRNO_NONE; i++)
+        {
+            PUT_UNALIGNED_8_byte_BE(pCuePoint + 4, pxRecorder->pxCuePoints[i].uTimestampMs);
+            PUT_UNALIGNED_8_byte_BE(pCuePoint + 19, pxRecorder->pxCuePoints[i].uClusterPos);
+            res = prvRecorderWrite(pxRecorder, pCuePoint, sizeof(pCuePoint));
+        }
+    }
+
+    return res;
+}
+
+static void prvRecorderCloseFile(Recorder_t *pxRecorder, bool bWriteCues)
+{
+    if (pxRecorder->fp != NULL)
+    {
+        if (bWriteCues && (prvRecorderWriteCues(pxRecorder) != KVS_ERRNO_NONE || prvRecorderFlush(pxRecorder) != KVS_ERRNO_NONE))
+        {
+            LogError("Failed to complete recorder file");
+        }
+        fclose(pxRecorder->fp);
+        pxRecorder->fp = NULL;
+    }
+    pxRecorder->uFileLen = 0;
+    pxRecorder->uWriteBufLen = 0;
+    pxRecorder->uCuePointCount = 0;
+}
+
+static int prvRecorderOpenFile(Recorder_t *pxRecorder, uint64_t uTimestampMs)
+{
+    int res = KVS_ERRNO_NONE;
+    size_t uFilenameSize = strlen(pxRecorder->pcFilePrefix) + RECORDER_TIMESTAMP_MAX_LEN + sizeof(RECORDER_FILE_EXTENSION);
+    char *pcFilename = NULL;
+
+    if ((pcFilename = (char *)kvsMalloc(uFilenameSize)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pcFilename");
+    }
+    else if (snprintf(pcFilename, uFilenameSize, "%s%" PRIu64 RECORDER_FILE_EXTENSION, pxRecorder->pcFilePrefix, uTimestampMs) <= 0)
+    {
+        res = KVS_ERROR_C_UTIL_STRING_ERROR;
+        LogError("Failed to print recorder file name");
+    }
+    else if ((pxRecorder->fp = fopen(pcFilename, "wb")) == NULL)
+    {
+        res = KVS_ERROR_STREAM_RECORDER_IO_ERROR;
+        LogError("Failed to open recorder file %s", pcFilename);
+    }
+    else
+    {
+        /* Bytes are buffered by the recorder, so the stream doesn't need to buffer them again. */
+        setvbuf(pxRecorder->fp, NULL, _IONBF, 0);
+        pxRecorder->uFileStartMs = uTimestampMs;
+
+        if ((res = prvRecorderWrite(pxRecorder, pxRecorder->pMkvEbmlSegHdr, pxRecorder->uMkvEbmlSegHdrLen)) != KVS_ERRNO_NONE)
+        {
+            prvRecorderCloseFile(pxRecorder, false);
+        }
+        else
+        {
+            LogInfo("Recording to %s", pcFilename);
+        }
+    }
+
+    kvsFree(pcFilename);
+
+    return res;
+}
+
+RecorderHandle Kvs_recorderCreate(const char *pcFilePrefix, uint64_t uFileDurationMs, size_t uWriteBufSize)
+{
+    int res = KVS_ERRNO_NONE;
+    Recorder_t *pxRecorder = NULL;
+    size_t uPrefixLen = 0;
+
+    if (pcFilePrefix == NULL || uWriteBufSize == 0)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((pxRecorder = (Recorder_t *)kvsMalloc(sizeof(Recorder_t))) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pxRecorder");
+    }
+    else
+    {
+        memset(pxRecorder, 0, sizeof(Recorder_t));
+        uPrefixLen = strlen(pcFilePrefix);
+        pxRecorder->uFileDurationMs = uFileDurationMs;
+        pxRecorder->uWriteBufSize = (uWriteBufSize + RECORDER_WRITE_BLOCK_SIZE - 1) / RECORDER_WRITE_BLOCK_SIZE * RECORDER_WRITE_BLOCK_SIZE;
+
+        if ((pxRecorder->pcFilePrefix = (char *)kvsMalloc(uPrefixLen + 1)) == NULL ||
+            (pxRecorder->pWriteBuf = (uint8_t *)kvsMallocClass(pxRecorder->uWriteBufSize, KVS_ALLOC_CLASS_MEDIA)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: recorder buffers");
+        }
+        else
+        {
+            memcpy(pxRecorder->pcFilePrefix, pcFilePrefix, uPrefixLen + 1);
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        Kvs_recorderTerminate(pxRecorder);
+        pxRecorder = NULL;
+    }
+
+    return pxRecorder;
+}
+
+void Kvs_recorderTerminate(RecorderHandle xRecorderHandle)
+{
+    Recorder_t *pxRecorder = xRecorderHandle;
+
+    if (pxRecorder != NULL)
+    {
+        prvRecorderCloseFile(pxRecorder, true);
+        kvsFree(pxRecorder->pcFilePrefix);
+        kvsFree(pxRecorder->pMkvEbmlSegHdr);
+        kvsFree(pxRecorder->pWriteBuf);
+        kvsFree(pxRecorder);
+    }
+}
+
+int Kvs_recorderSetMkvEbmlSegHdr(RecorderHandle xRecorderHandle, const uint8_t *pMkvHeader, size_t uMkvHeaderLen)
+{
+    int res = KVS_ERRNO_NONE;
+    Recorder_t *pxRecorder = xRecorderHandle;
+    uint8_t *pMkvEbmlSegHdr = NULL;
+    size_t uOffset = 0;
+    size_t uSizeLen = 0;
+
+    if (pxRecorder == NULL || pMkvHeader == NULL || uMkvHeaderLen == 0)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        /* Find the segment, and skip its ID and size whose length is told by the leading zero bits. */
+        while (uOffset + sizeof(gSegmentId) < uMkvHeaderLen && memcmp(pMkvHeader + uOffset, gSegmentId, sizeof(gSegmentId)) != 0)
+        {
+            uOffset++;
+        }
+        uOffset += sizeof(gSegmentId);
+        if (uOffset < uMkvHeaderLen)
+        {
+            uSizeLen = 1;
+            while (uSizeLen <= 8 && (pMkvHeader[uOffset] & (0x80 >> (uSizeLen - 1))) == 0)
+            {
+                uSizeLen++;
+            }
+        }
+
+        if (uOffset >= uMkvHeaderLen || uSizeLen > 8 || uOffset + uSizeLen > uMkvHeaderLen)
+        {
+            res = KVS_ERROR_INVALID_ARGUMENT;
+            LogError("No segment in MKV header");
+        }
+        else if ((pMkvEbmlSegHdr = (uint8_t *)kvsMalloc(uMkvHeaderLen)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: pMkvEbmlSegHdr");
+        }
+        else
+        {
+            /* The current file has the old header, so the next cluster starts a new file. */
+            prvRecorderCloseFile(pxRecorder, true);
+
+            memcpy(pMkvEbmlSegHdr, pMkvHeader, uMkvHeaderLen);
+            kvsFree(pxRecorder->pMkvEbmlSegHdr);
+            pxRecorder->pMkvEbmlSegHdr = pMkvEbmlSegHdr;
+            pxRecorder->uMkvEbmlSegHdrLen = uMkvHeaderLen;
+            pxRecorder->uSegmentDataOffset = uOffset + uSizeLen;
+        }
+    }
+
+    return res;
+}
+
+int Kvs_recorderWriteDataFrame(RecorderHandle xRecorderHandle, uint64_t uTimestampMs, bool bIsCluster, const uint8_t *pMkvHeader, size_t uMkvHeaderLen, const uint8_t *pData, size_t uDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    Recorder_t *pxRecorder = xRecorderHandle;
+    RecorderCuePoint_t *pxCuePoint = NULL;
+
+    if (pxRecorder == NULL || (pMkvHeader == NULL && uMkvHeaderLen > 0) || (pData == NULL && uDataLen > 0))
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        if (bIsCluster && pxRecorder->fp != NULL &&
+            (uTimestampMs >= pxRecorder->uFileStartMs + pxRecorder->uFileDurationMs || pxRecorder->uCuePointCount == RECORDER_MAX_CUE_POINTS))
+        {
+            prvRecorderCloseFile(pxRecorder, true);
+        }
+
+        if (bIsCluster && pxRecorder->fp == NULL && pxRecorder->pMkvEbmlSegHdr != NULL)
+        {
+            res = prvRecorderOpenFile(pxRecorder, uTimestampMs);
+        }
+
+        if (res == KVS_ERRNO_NONE && pxRecorder->fp != NULL)
+        {
+            if (bIsCluster)
+            {
+                pxCuePoint = &(pxRecorder->pxCuePoints[pxRecorder->uCuePointCount]);
+                pxCuePoint->uTimestampMs = uTimestampMs;
+                pxCuePoint->uClusterPos = (uint64_t)(pxRecorder->uFileLen - pxRecorder->uSegmentDataOffset);
+                pxRecorder->uCuePointCount++;
+            }
+
+            if ((res = prvRecorderWrite(pxRecorder, pMkvHeader, uMkvHeaderLen)) != KVS_ERRNO_NONE ||
+                (res = prvRecorderWrite(pxRecorder, pData, uDataLen)) != KVS_ERRNO_NONE)
+            {
+                /* The file is broken, so it's closed without Cues. */
+                prvRecorderCloseFile(pxRecorder, false);
+            }
+        }
+    }
+
+    return res;
+}
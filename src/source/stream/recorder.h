@@ -0,0 +1,88 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVS_RECORDER_H
+#define KVS_RECORDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The number of clusters indexed in the Cues of a file. A new file is started if there are more. */
+#ifndef RECORDER_MAX_CUE_POINTS
+#define RECORDER_MAX_CUE_POINTS (256)
+#endif
+
+/* Files are written in multiples of this size, except the last write of a file. */
+#ifndef RECORDER_WRITE_BLOCK_SIZE
+#define RECORDER_WRITE_BLOCK_SIZE (4 * 1024)
+#endif
+
+typedef struct Recorder *RecorderHandle;
+
+/**
+ * @brief Create a recorder that writes MKV into rotating files
+ *
+ * Each file starts with the MKV EBML and segment header and the first cluster of its duration. The bytes of data
+ * frames are the same as the ones sent to the stream. At the end of a file, Cues of its clusters are appended, so the
+ * file can be seeked by players. Bytes are collected in a write buffer and written to the file in whole blocks, so
+ * the file system sees a few large aligned writes instead of one small write per data frame.
+ *
+ * A file is named after the prefix and the timestamp of its first cluster, e.g. "/sdcard/kvs_1700000000000.mkv".
+ *
+ * @param[in] pcFilePrefix The prefix of file names, including the directory
+ * @param[in] uFileDurationMs The duration of a file. A new file is started from the first cluster after it.
+ * @param[in] uWriteBufSize The size of the write buffer. It's rounded up to a multiple of RECORDER_WRITE_BLOCK_SIZE.
+ * @return The recorder handle on success, NULL otherwise
+ */
+RecorderHandle Kvs_recorderCreate(const char *pcFilePrefix, uint64_t uFileDurationMs, size_t uWriteBufSize);
+
+/**
+ * @brief Terminate a recorder. The current file is completed with its Cues.
+ *
+ * @param[in] xRecorderHandle The recorder handle
+ */
+void Kvs_recorderTerminate(RecorderHandle xRecorderHandle);
+
+/**
+ * @brief Set the MKV EBML and segment header that each file starts with
+ *
+ * The current file is completed, and the next file starts from the next cluster with the new header.
+ *
+ * @param[in] xRecorderHandle The recorder handle
+ * @param[in] pMkvHeader The MKV EBML and segment header
+ * @param[in] uMkvHeaderLen The length of MKV header
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_recorderSetMkvEbmlSegHdr(RecorderHandle xRecorderHandle, const uint8_t *pMkvHeader, size_t uMkvHeaderLen);
+
+/**
+ * @brief Write a data frame to a recorder
+ *
+ * Data frames before the first cluster of a file are ignored. If a write fails, the file is closed and the rest of
+ * data frames are ignored until the next cluster starts a new file.
+ *
+ * @param[in] xRecorderHandle The recorder handle
+ * @param[in] uTimestampMs The timestamp of the data frame
+ * @param[in] bIsCluster true if the data frame starts a cluster, false otherwise
+ * @param[in] pMkvHeader The MKV header of the data frame
+ * @param[in] uMkvHeaderLen The MKV header length
+ * @param[in] pData The data
+ * @param[in] uDataLen The data length
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_recorderWriteDataFrame(RecorderHandle xRecorderHandle, uint64_t uTimestampMs, bool bIsCluster, const uint8_t *pMkvHeader, size_t uMkvHeaderLen, const uint8_t *pData, size_t uDataLen);
+
+#endif /* KVS_RECORDER_H */
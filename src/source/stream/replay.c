@@ -0,0 +1,258 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <string.h>
+
+/* Thirdparty headers */
+#include "azure_c_shared_utility/xlogging.h"
+
+/* Public headers */
+#include "kvs/errors.h"
+
+/* Internal headers */
+#include "os/allocator.h"
+#include "stream/replay.h"
+
+typedef struct ReplayCluster
+{
+    uint64_t uTimecodeMs;
+    size_t uLen;
+} ReplayCluster_t;
+
+typedef struct Replay
+{
+    uint8_t *pBuf;
+    size_t uBufSize;
+
+    /* Offset of the first byte of the oldest cluster, and the length of all clusters. */
+    size_t uHead;
+    size_t uLen;
+
+    /* Clusters in the order they are sent. Bytes of a cluster are contiguous in the ring, and the last cluster is the
+     * one that bytes are appended to. */
+    ReplayCluster_t pxClusters[REPLAY_MAX_CLUSTERS];
+    size_t uFirstCluster;
+    size_t uClusterCount;
+
+    /* The current cluster doesn't fit, so the rest of it is ignored until the next cluster begins. */
+    bool bSkipToCluster;
+
+    /* Offset from uHead of the next byte to read since the last rewind. */
+    bool bReading;
+    size_t uReadOffset;
+} Replay_t;
+
+static void prvReplayDropOldest(Replay_t *pxReplay)
+{
+    ReplayCluster_t *pxCluster = &(pxReplay->pxClusters[pxReplay->uFirstCluster]);
+
+    pxReplay->uHead = (pxReplay->uHead + pxCluster->uLen) % pxReplay->uBufSize;
+    pxReplay->uLen -= pxCluster->uLen;
+    pxReplay->uReadOffset = (pxReplay->uReadOffset > pxCluster->uLen) ? (pxReplay->uReadOffset - pxCluster->uLen) : 0;
+
+    pxReplay->uFirstCluster = (pxReplay->uFirstCluster + 1) % REPLAY_MAX_CLUSTERS;
+    pxReplay->uClusterCount--;
+}
+
+ReplayHandle Kvs_replayCreate(size_t uBufSize)
+{
+    int res = KVS_ERRNO_NONE;
+    Replay_t *pxReplay = NULL;
+
+    if (uBufSize == 0)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((pxReplay = (Replay_t *)kvsMalloc(sizeof(Replay_t))) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pxReplay");
+    }
+    else
+    {
+        memset(pxReplay, 0, sizeof(Replay_t));
+
+        if ((pxReplay->pBuf = (uint8_t *)kvsMallocClass(uBufSize, KVS_ALLOC_CLASS_MEDIA)) == NULL)
+        {
+            res = KVS_ERROR_OUT_OF_MEMORY;
+            LogError("OOM: replay buffer");
+        }
+        else
+        {
+            pxReplay->uBufSize = uBufSize;
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        Kvs_replayTerminate(pxReplay);
+        pxReplay = NULL;
+    }
+
+    return pxReplay;
+}
+
+void Kvs_replayTerminate(ReplayHandle xReplayHandle)
+{
+    Replay_t *pxReplay = xReplayHandle;
+
+    if (pxReplay != NULL)
+    {
+        if (pxReplay->pBuf != NULL)
+        {
+            kvsFree(pxReplay->pBuf);
+        }
+        kvsFree(pxReplay);
+    }
+}
+
+void Kvs_replayBeginCluster(ReplayHandle xReplayHandle, uint64_t uTimecodeMs)
+{
+    Replay_t *pxReplay = xReplayHandle;
+    ReplayCluster_t *pxCluster = NULL;
+
+    if (pxReplay != NULL)
+    {
+        if (pxReplay->uClusterCount == REPLAY_MAX_CLUSTERS)
+        {
+            prvReplayDropOldest(pxReplay);
+        }
+
+        pxCluster = &(pxReplay->pxClusters[(pxReplay->uFirstCluster + pxReplay->uClusterCount) % REPLAY_MAX_CLUSTERS]);
+        pxCluster->uTimecodeMs = uTimecodeMs;
+        pxCluster->uLen = 0;
+        pxReplay->uClusterCount++;
+        pxReplay->bSkipToCluster = false;
+    }
+}
+
+void Kvs_replayAppend(ReplayHandle xReplayHandle, const uint8_t *pData, size_t uDataLen)
+{
+    Replay_t *pxReplay = xReplayHandle;
+    ReplayCluster_t *pxCluster = NULL;
+    size_t uTail = 0;
+    size_t uFirstPartLen = 0;
+
+    if (pxReplay == NULL || pData == NULL || uDataLen == 0 || pxReplay->uClusterCount == 0 || pxReplay->bSkipToCluster)
+    {
+        /* nop */
+    }
+    else
+    {
+        /* Make room by dropping older clusters, but never the current one. */
+        while (pxReplay->uBufSize - pxReplay->uLen < uDataLen && pxReplay->uClusterCount > 1)
+        {
+            prvReplayDropOldest(pxReplay);
+        }
+
+        if (pxReplay->uBufSize - pxReplay->uLen < uDataLen)
+        {
+            LogInfo("Cluster is too large to be replayed");
+            prvReplayDropOldest(pxReplay);
+            pxReplay->bSkipToCluster = true;
+        }
+        else
+        {
+            pxCluster = &(pxReplay->pxClusters[(pxReplay->uFirstCluster + pxReplay->uClusterCount - 1) % REPLAY_MAX_CLUSTERS]);
+            uTail = (pxReplay->uHead + pxReplay->uLen) % pxReplay->uBufSize;
+            uFirstPartLen = (uDataLen < pxReplay->uBufSize - uTail) ? uDataLen : (pxReplay->uBufSize - uTail);
+
+            memcpy(pxReplay->pBuf + uTail, pData, uFirstPartLen);
+            if (uFirstPartLen < uDataLen)
+            {
+                memcpy(pxReplay->pBuf, pData + uFirstPartLen, uDataLen - uFirstPartLen);
+            }
+
+            pxReplay->uLen += uDataLen;
+            pxCluster->uLen += uDataLen;
+        }
+    }
+}
+
+void Kvs_replayAck(ReplayHandle xReplayHandle, uint64_t uTimecodeMs)
+{
+    Replay_t *pxReplay = xReplayHandle;
+
+    if (pxReplay != NULL)
+    {
+        while (pxReplay->uClusterCount > 0 && pxReplay->pxClusters[pxReplay->uFirstCluster].uTimecodeMs <= uTimecodeMs)
+        {
+            prvReplayDropOldest(pxReplay);
+        }
+    }
+}
+
+void Kvs_replayRewind(ReplayHandle xReplayHandle)
+{
+    Replay_t *pxReplay = xReplayHandle;
+
+    if (pxReplay != NULL)
+    {
+        pxReplay->bReading = (pxReplay->uLen > 0);
+        pxReplay->uReadOffset = 0;
+    }
+}
+
+bool Kvs_replayIsPending(ReplayHandle xReplayHandle)
+{
+    Replay_t *pxReplay = xReplayHandle;
+
+    return pxReplay != NULL && pxReplay->bReading && pxReplay->uReadOffset < pxReplay->uLen;
+}
+
+int Kvs_replayRead(ReplayHandle xReplayHandle, size_t uMaxLen, uint8_t **ppData, size_t *puDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    Replay_t *pxReplay = xReplayHandle;
+    size_t uPos = 0;
+    size_t uLen = 0;
+
+    if (pxReplay == NULL || uMaxLen == 0 || ppData == NULL || puDataLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (!Kvs_replayIsPending(pxReplay))
+    {
+        pxReplay->bReading = false;
+        res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
+    }
+    else
+    {
+        uPos = (pxReplay->uHead + pxReplay->uReadOffset) % pxReplay->uBufSize;
+        uLen = pxReplay->uLen - pxReplay->uReadOffset;
+        if (uLen > pxReplay->uBufSize - uPos)
+        {
+            uLen = pxReplay->uBufSize - uPos;
+        }
+        if (uLen > uMaxLen)
+        {
+            uLen = uMaxLen;
+        }
+
+        *ppData = pxReplay->pBuf + uPos;
+        *puDataLen = uLen;
+        pxReplay->uReadOffset += uLen;
+
+        /* Bytes appended later are sent on the connection directly, so they're not read again. */
+        if (pxReplay->uReadOffset == pxReplay->uLen)
+        {
+            pxReplay->bReading = false;
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVS_REPLAY_H
+#define KVS_REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The number of clusters that can be kept at the same time. The oldest one is dropped if there are more. */
+#ifndef REPLAY_MAX_CLUSTERS
+#define REPLAY_MAX_CLUSTERS (16)
+#endif
+
+typedef struct Replay *ReplayHandle;
+
+/**
+ * @brief Create a replay buffer
+ *
+ * The replay buffer is a ring of the MKV bytes of clusters that have been sent but not persisted yet. Bytes of a
+ * cluster are appended as they are sent, and the cluster is removed once it's acknowledged. After reconnection, the
+ * clusters that are left can be read again from the first byte of the oldest one. The oldest clusters are dropped
+ * when it's full, and a cluster that doesn't fit at all is not kept.
+ *
+ * @param[in] uBufSize The size of the ring buffer
+ * @return The replay handle on success, NULL otherwise
+ */
+ReplayHandle Kvs_replayCreate(size_t uBufSize);
+
+/**
+ * @brief Terminate a replay buffer
+ *
+ * @param[in] xReplayHandle The replay handle
+ */
+void Kvs_replayTerminate(ReplayHandle xReplayHandle);
+
+/**
+ * @brief Start a new cluster in a replay buffer. The bytes appended afterwards belong to it.
+ *
+ * @param[in] xReplayHandle The replay handle
+ * @param[in] uTimecodeMs The cluster timecode
+ */
+void Kvs_replayBeginCluster(ReplayHandle xReplayHandle, uint64_t uTimecodeMs);
+
+/**
+ * @brief Append bytes of the current cluster to a replay buffer. They're ignored if there is no current cluster or
+ * the current cluster doesn't fit.
+ *
+ * @param[in] xReplayHandle The replay handle
+ * @param[in] pData The data
+ * @param[in] uDataLen The data length
+ */
+void Kvs_replayAppend(ReplayHandle xReplayHandle, const uint8_t *pData, size_t uDataLen);
+
+/**
+ * @brief Remove all clusters whose timecode is not newer than an acknowledged one
+ *
+ * @param[in] xReplayHandle The replay handle
+ * @param[in] uTimecodeMs The acknowledged cluster timecode
+ */
+void Kvs_replayAck(ReplayHandle xReplayHandle, uint64_t uTimecodeMs);
+
+/**
+ * @brief Start reading the clusters in a replay buffer from the first byte of the oldest one
+ *
+ * @param[in] xReplayHandle The replay handle
+ */
+void Kvs_replayRewind(ReplayHandle xReplayHandle);
+
+/**
+ * @brief Check if there are bytes left to be read since the last rewind
+ *
+ * If it's true, the last cluster in the buffer is the one that was being sent, so the stream can continue right after
+ * the replayed bytes.
+ *
+ * @param[in] xReplayHandle The replay handle
+ * @return true if there are bytes to be read, false otherwise
+ */
+bool Kvs_replayIsPending(ReplayHandle xReplayHandle);
+
+/**
+ * @brief Read the next bytes since the last rewind. The data stays in the buffer until it's acknowledged.
+ *
+ * @param[in] xReplayHandle The replay handle
+ * @param[in] uMaxLen The max length to read
+ * @param[out] ppData The pointer to the data in the buffer
+ * @param[out] puDataLen The length of the data
+ * @return 0 on success, KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME if nothing is left, non-zero value otherwise
+ */
+int Kvs_replayRead(ReplayHandle xReplayHandle, size_t uMaxLen, uint8_t **ppData, size_t *puDataLen);
+
+#endif /* KVS_REPLAY_H */
@@ -0,0 +1,499 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* Thirdparty headers */
+#include "azure_c_shared_utility/xlogging.h"
+
+/* Public headers */
+#include "kvs/errors.h"
+
+/* Internal headers */
+#include "os/allocator.h"
+#include "stream/spill.h"
+
+/* Records start with this magic, so the records left in the file by the previous boot can be found again. A record
+ * is followed by a zero header that ends the log, which keeps older records behind it from being recovered. */
+#define SPILL_RECORD_MAGIC 0x4C53
+#define SPILL_CHECKPOINT_MAGIC 0x4B56534350543031ULL /* "KVSCPT01" */
+
+typedef struct SpillRecordHdr
+{
+    uint64_t uTimestampMs;
+    uint32_t uLen;
+    uint8_t uTrackType;
+    uint8_t uClusterType;
+    uint16_t uMagic;
+} SpillRecordHdr_t;
+
+typedef struct SpillCheckpoint
+{
+    uint64_t uMagic;
+    uint64_t uTimecodeMs;
+
+    /* The complement of the timecode, so a torn write is not taken as a checkpoint. */
+    uint64_t uTimecodeCheck;
+} SpillCheckpoint_t;
+
+typedef struct Spill
+{
+    FILE *fp;
+    size_t uFileSize;
+
+    /* Offset of the first record, and offset to append the next record. */
+    size_t uReadOffset;
+    size_t uWriteOffset;
+    size_t uRecordCount;
+
+    /* The info of the first record is loaded on first access. */
+    bool bHeadLoaded;
+    SpillRecordInfo_t xHeadInfo;
+} Spill_t;
+
+static int prvSpillSeek(Spill_t *pxSpill, size_t uOffset)
+{
+    int res = KVS_ERRNO_NONE;
+
+    if (fseek(pxSpill->fp, (long)uOffset, SEEK_SET) != 0)
+    {
+        res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+        LogError("Failed to seek spill file");
+    }
+
+    return res;
+}
+
+static int prvSpillLoadHead(Spill_t *pxSpill)
+{
+    int res = KVS_ERRNO_NONE;
+    SpillRecordHdr_t xHdr = {0};
+
+    if (pxSpill->uRecordCount == 0)
+    {
+        res = KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME;
+    }
+    else if (pxSpill->bHeadLoaded)
+    {
+        /* nop */
+    }
+    else if ((res = prvSpillSeek(pxSpill, pxSpill->uReadOffset)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (fread(&xHdr, sizeof(SpillRecordHdr_t), 1, pxSpill->fp) != 1)
+    {
+        res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+        LogError("Failed to read spill record header");
+    }
+    else
+    {
+        pxSpill->xHeadInfo.uTimestampMs = xHdr.uTimestampMs;
+        pxSpill->xHeadInfo.xTrackType = (TrackType_t)xHdr.uTrackType;
+        pxSpill->xHeadInfo.xClusterType = (MkvClusterType_t)xHdr.uClusterType;
+        pxSpill->xHeadInfo.uLen = xHdr.uLen;
+        pxSpill->xHeadInfo.uRemainingLen = xHdr.uLen;
+        pxSpill->bHeadLoaded = true;
+    }
+
+    return res;
+}
+
+static void prvSpillRemoveHead(Spill_t *pxSpill)
+{
+    pxSpill->uReadOffset += sizeof(SpillRecordHdr_t) + pxSpill->xHeadInfo.uLen;
+    pxSpill->uRecordCount--;
+    pxSpill->bHeadLoaded = false;
+
+    if (pxSpill->uRecordCount == 0)
+    {
+        /* Start over from the beginning of the file. */
+        pxSpill->uReadOffset = 0;
+        pxSpill->uWriteOffset = 0;
+    }
+}
+
+static int prvSpillScan(Spill_t *pxSpill, uint64_t uPersistedTimecodeMs)
+{
+    int res = KVS_ERRNO_NONE;
+    SpillRecordHdr_t xHdr = {0};
+    size_t uOffset = 0;
+    bool bKeep = false;
+
+    while (res == KVS_ERRNO_NONE && pxSpill->uFileSize - uOffset >= sizeof(SpillRecordHdr_t))
+    {
+        if ((res = prvSpillSeek(pxSpill, uOffset)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else if (fread(&xHdr, sizeof(SpillRecordHdr_t), 1, pxSpill->fp) != 1 || xHdr.uMagic != SPILL_RECORD_MAGIC ||
+                 xHdr.uLen > pxSpill->uFileSize - uOffset - sizeof(SpillRecordHdr_t))
+        {
+            /* The end of the log */
+            break;
+        }
+        else
+        {
+            /* Records are kept from the first cluster that is not persisted, so the rest of a persisted fragment is
+             * skipped as well. */
+            if (!bKeep && xHdr.uClusterType == MKV_CLUSTER && xHdr.uTimestampMs > uPersistedTimecodeMs)
+            {
+                bKeep = true;
+                pxSpill->uReadOffset = uOffset;
+            }
+            uOffset += sizeof(SpillRecordHdr_t) + xHdr.uLen;
+            if (bKeep)
+            {
+                pxSpill->uRecordCount++;
+            }
+        }
+    }
+
+    if (pxSpill->uRecordCount > 0)
+    {
+        pxSpill->uWriteOffset = uOffset;
+    }
+
+    return res;
+}
+
+SpillHandle Kvs_spillCreate(const char *pcFilename, size_t uFileSize)
+{
+    int res = KVS_ERRNO_NONE;
+    Spill_t *pxSpill = NULL;
+
+    if (pcFilename == NULL || uFileSize <= sizeof(SpillRecordHdr_t))
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((pxSpill = (Spill_t *)kvsMalloc(sizeof(Spill_t))) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pxSpill");
+    }
+    else
+    {
+        memset(pxSpill, 0, sizeof(Spill_t));
+        pxSpill->uFileSize = uFileSize;
+
+        if ((pxSpill->fp = fopen(pcFilename, "w+b")) == NULL)
+        {
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Failed to open spill file %s", pcFilename);
+        }
+        else if ((res = prvSpillSeek(pxSpill, uFileSize - 1)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else if (fputc(0, pxSpill->fp) == EOF || fflush(pxSpill->fp) != 0)
+        {
+            /* Writing the last byte makes the file system allocate the whole file. */
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Failed to preallocate spill file");
+        }
+        else
+        {
+            /* nop */
+        }
+    }
+
+    if (res != KVS_ERRNO_NONE)
+    {
+        Kvs_spillTerminate(pxSpill);
+        pxSpill = NULL;
+    }
+
+    return pxSpill;
+}
+
+void Kvs_spillTerminate(SpillHandle xSpillHandle)
+{
+    Spill_t *pxSpill = xSpillHandle;
+
+    if (pxSpill != NULL)
+    {
+        if (pxSpill->fp != NULL)
+        {
+            fclose(pxSpill->fp);
+        }
+        kvsFree(pxSpill);
+    }
+}
+
+SpillHandle Kvs_spillRecover(const char *pcFilename, size_t uFileSize, uint64_t uPersistedTimecodeMs)
+{
+    int res = KVS_ERRNO_NONE;
+    Spill_t *pxSpill = NULL;
+    FILE *fp = NULL;
+    long lFileSize = 0;
+
+    if (pcFilename == NULL || uFileSize <= sizeof(SpillRecordHdr_t))
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((fp = fopen(pcFilename, "r+b")) == NULL || fseek(fp, 0, SEEK_END) != 0 || (lFileSize = ftell(fp)) < 0 || (size_t)lFileSize != uFileSize)
+    {
+        /* There is nothing to recover, e.g. on the first boot or after the file size is changed. */
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        pxSpill = Kvs_spillCreate(pcFilename, uFileSize);
+    }
+    else if ((pxSpill = (Spill_t *)kvsMalloc(sizeof(Spill_t))) == NULL)
+    {
+        fclose(fp);
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        LogError("OOM: pxSpill");
+    }
+    else
+    {
+        memset(pxSpill, 0, sizeof(Spill_t));
+        pxSpill->fp = fp;
+        pxSpill->uFileSize = uFileSize;
+
+        if ((res = prvSpillScan(pxSpill, uPersistedTimecodeMs)) != KVS_ERRNO_NONE)
+        {
+            Kvs_spillTerminate(pxSpill);
+            pxSpill = NULL;
+        }
+        else
+        {
+            LogInfo("Recovered %u spill records", (unsigned int)pxSpill->uRecordCount);
+        }
+    }
+
+    return pxSpill;
+}
+
+int Kvs_spillAppend(SpillHandle xSpillHandle, SpillRecordInfo_t *pxInfo, uint8_t *pMkvHeader, size_t uMkvHeaderLen, uint8_t *pData, size_t uDataLen)
+{
+    int res = KVS_ERRNO_NONE;
+    Spill_t *pxSpill = xSpillHandle;
+    SpillRecordHdr_t xHdr = {0};
+    SpillRecordHdr_t xEndHdr;
+    size_t uEndOffset = 0;
+
+    if (pxSpill == NULL || pxInfo == NULL || (pMkvHeader == NULL && uMkvHeaderLen > 0) || (pData == NULL && uDataLen > 0))
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (uMkvHeaderLen + uDataLen > UINT32_MAX ||
+             pxSpill->uFileSize - pxSpill->uWriteOffset < sizeof(SpillRecordHdr_t) + uMkvHeaderLen + uDataLen)
+    {
+        res = KVS_ERROR_STREAM_SPILL_FULL;
+    }
+    else if ((res = prvSpillSeek(pxSpill, pxSpill->uWriteOffset)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        xHdr.uTimestampMs = pxInfo->uTimestampMs;
+        xHdr.uLen = (uint32_t)(uMkvHeaderLen + uDataLen);
+        xHdr.uTrackType = (uint8_t)pxInfo->xTrackType;
+        xHdr.uClusterType = (uint8_t)pxInfo->xClusterType;
+        xHdr.uMagic = SPILL_RECORD_MAGIC;
+        uEndOffset = pxSpill->uWriteOffset + sizeof(SpillRecordHdr_t) + xHdr.uLen;
+        memset(&xEndHdr, 0, sizeof(SpillRecordHdr_t));
+
+        if (fwrite(&xHdr, sizeof(SpillRecordHdr_t), 1, pxSpill->fp) != 1 ||
+            (uMkvHeaderLen > 0 && fwrite(pMkvHeader, uMkvHeaderLen, 1, pxSpill->fp) != 1) ||
+            (uDataLen > 0 && fwrite(pData, uDataLen, 1, pxSpill->fp) != 1) ||
+            (pxSpill->uFileSize - uEndOffset >= sizeof(SpillRecordHdr_t) && fwrite(&xEndHdr, sizeof(SpillRecordHdr_t), 1, pxSpill->fp) != 1) ||
+            fflush(pxSpill->fp) != 0)
+        {
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Failed to write spill record");
+        }
+        else
+        {
+            pxSpill->uWriteOffset = uEndOffset;
+            pxSpill->uRecordCount++;
+        }
+    }
+
+    return res;
+}
+
+bool Kvs_spillIsEmpty(SpillHandle xSpillHandle)
+{
+    Spill_t *pxSpill = xSpillHandle;
+
+    return (pxSpill == NULL || pxSpill->uRecordCount == 0);
+}
+
+int Kvs_spillPeekRecord(SpillHandle xSpillHandle, SpillRecordInfo_t *pxInfo)
+{
+    int res = KVS_ERRNO_NONE;
+    Spill_t *pxSpill = xSpillHandle;
+
+    if (pxSpill == NULL || pxInfo == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((res = prvSpillLoadHead(pxSpill)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        memcpy(pxInfo, &(pxSpill->xHeadInfo), sizeof(SpillRecordInfo_t));
+    }
+
+    return res;
+}
+
+int Kvs_spillReadRecord(SpillHandle xSpillHandle, uint8_t *pBuf, size_t uBufSize, size_t *puReadLen)
+{
+    int res = KVS_ERRNO_NONE;
+    Spill_t *pxSpill = xSpillHandle;
+    SpillRecordInfo_t *pxHeadInfo = NULL;
+    size_t uReadLen = 0;
+
+    if (pxSpill == NULL || pBuf == NULL || uBufSize == 0 || puReadLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((res = prvSpillLoadHead(pxSpill)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        pxHeadInfo = &(pxSpill->xHeadInfo);
+        uReadLen = (pxHeadInfo->uRemainingLen < uBufSize) ? pxHeadInfo->uRemainingLen : uBufSize;
+
+        if ((res = prvSpillSeek(pxSpill, pxSpill->uReadOffset + sizeof(SpillRecordHdr_t) + pxHeadInfo->uLen - pxHeadInfo->uRemainingLen)) != KVS_ERRNO_NONE)
+        {
+            /* Propagate the res error */
+        }
+        else if (uReadLen > 0 && fread(pBuf, uReadLen, 1, pxSpill->fp) != 1)
+        {
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Failed to read spill record");
+        }
+        else
+        {
+            pxHeadInfo->uRemainingLen -= uReadLen;
+            *puReadLen = uReadLen;
+
+            if (pxHeadInfo->uRemainingLen == 0)
+            {
+                prvSpillRemoveHead(pxSpill);
+            }
+        }
+    }
+
+    return res;
+}
+
+int Kvs_spillSkipRecord(SpillHandle xSpillHandle)
+{
+    int res = KVS_ERRNO_NONE;
+    Spill_t *pxSpill = xSpillHandle;
+
+    if (pxSpill == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((res = prvSpillLoadHead(pxSpill)) != KVS_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        prvSpillRemoveHead(pxSpill);
+    }
+
+    return res;
+}
+
+int Kvs_spillSaveCheckpoint(const char *pcFilename, uint64_t uPersistedTimecodeMs)
+{
+    int res = KVS_ERRNO_NONE;
+    FILE *fp = NULL;
+    SpillCheckpoint_t xCheckpoint = {0};
+
+    if (pcFilename == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((fp = fopen(pcFilename, "wb")) == NULL)
+    {
+        res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+        LogError("Failed to open checkpoint file %s", pcFilename);
+    }
+    else
+    {
+        xCheckpoint.uMagic = SPILL_CHECKPOINT_MAGIC;
+        xCheckpoint.uTimecodeMs = uPersistedTimecodeMs;
+        xCheckpoint.uTimecodeCheck = ~uPersistedTimecodeMs;
+
+        if (fwrite(&xCheckpoint, sizeof(SpillCheckpoint_t), 1, fp) != 1)
+        {
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Failed to write checkpoint file");
+        }
+        if (fclose(fp) != 0 && res == KVS_ERRNO_NONE)
+        {
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Failed to close checkpoint file");
+        }
+    }
+
+    return res;
+}
+
+int Kvs_spillLoadCheckpoint(const char *pcFilename, uint64_t *puPersistedTimecodeMs)
+{
+    int res = KVS_ERRNO_NONE;
+    FILE *fp = NULL;
+    SpillCheckpoint_t xCheckpoint = {0};
+
+    if (pcFilename == NULL || puPersistedTimecodeMs == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if ((fp = fopen(pcFilename, "rb")) == NULL)
+    {
+        res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+    }
+    else
+    {
+        if (fread(&xCheckpoint, sizeof(SpillCheckpoint_t), 1, fp) != 1 || xCheckpoint.uMagic != SPILL_CHECKPOINT_MAGIC ||
+            xCheckpoint.uTimecodeCheck != ~xCheckpoint.uTimecodeMs)
+        {
+            res = KVS_ERROR_STREAM_SPILL_IO_ERROR;
+            LogError("Invalid checkpoint file");
+        }
+        else
+        {
+            *puPersistedTimecodeMs = xCheckpoint.uTimecodeMs;
+        }
+        fclose(fp);
+    }
+
+    return res;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifndef KVS_SPILL_H
+#define KVS_SPILL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kvs/mkv_generator.h"
+
+typedef struct SpillRecordInfo
+{
+    uint64_t uTimestampMs;
+    TrackType_t xTrackType;
+    MkvClusterType_t xClusterType;
+
+    /* The length of MKV header and data of the record. */
+    size_t uLen;
+
+    /* The length that hasn't been read yet. */
+    size_t uRemainingLen;
+} SpillRecordInfo_t;
+
+typedef struct Spill *SpillHandle;
+
+/**
+ * @brief Create a spill buffer on a preallocated file
+ *
+ * The spill buffer is an append-only log of records, and each record is the MKV header and data of a data frame that
+ * has been popped from a stream. Records are read back sequentially in the order they are appended, so the backlog
+ * never needs to be brought back into memory. When all records are read, the log starts over from the beginning of
+ * the file.
+ *
+ * Records are indexed in memory, and the file is created again, so its content is not recovered. Use
+ * Kvs_spillRecover() to recover it after reboot.
+ *
+ * @param[in] pcFilename The file name
+ * @param[in] uFileSize The size of the file to be preallocated
+ * @return The spill handle on success, NULL otherwise
+ */
+SpillHandle Kvs_spillCreate(const char *pcFilename, size_t uFileSize);
+
+/**
+ * @brief Open a spill buffer on the file that is left by the previous boot, e.g. after a watchdog reset
+ *
+ * Records are recovered from the first cluster that is newer than the persisted timecode, so the fragments that are
+ * already persisted are not sent again. Records are flushed as they're appended, but a file system that doesn't keep
+ * writes in order can still lose the last ones at power loss. If the file doesn't exist or its size is different, it's
+ * created as Kvs_spillCreate() does.
+ *
+ * @param[in] pcFilename The file name
+ * @param[in] uFileSize The size of the file
+ * @param[in] uPersistedTimecodeMs The fragment timecode of the last PERSISTED ack, e.g. from
+ * Kvs_spillLoadCheckpoint(), or 0 to recover all records
+ * @return The spill handle on success, NULL otherwise
+ */
+SpillHandle Kvs_spillRecover(const char *pcFilename, size_t uFileSize, uint64_t uPersistedTimecodeMs);
+
+/**
+ * @brief Terminate a spill buffer. The file is kept.
+ *
+ * @param[in] xSpillHandle The spill handle
+ */
+void Kvs_spillTerminate(SpillHandle xSpillHandle);
+
+/**
+ * @brief Append a record to a spill buffer
+ *
+ * @param[in] xSpillHandle The spill handle
+ * @param[in] pxInfo The record info, and uLen is ignored
+ * @param[in] pMkvHeader The MKV header
+ * @param[in] uMkvHeaderLen The MKV header length
+ * @param[in] pData The data
+ * @param[in] uDataLen The data length
+ * @return 0 on success, KVS_ERROR_STREAM_SPILL_FULL if there is no enough space, non-zero value otherwise
+ */
+int Kvs_spillAppend(SpillHandle xSpillHandle, SpillRecordInfo_t *pxInfo, uint8_t *pMkvHeader, size_t uMkvHeaderLen, uint8_t *pData, size_t uDataLen);
+
+/**
+ * @brief Check if there is any record in a spill buffer
+ *
+ * @param[in] xSpillHandle The spill handle
+ * @return true if there is no record, false otherwise
+ */
+bool Kvs_spillIsEmpty(SpillHandle xSpillHandle);
+
+/**
+ * @brief Get the info of the first record in a spill buffer
+ *
+ * @param[in] xSpillHandle The spill handle
+ * @param[out] pxInfo The record info
+ * @return 0 on success, KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME if there is no record, non-zero value otherwise
+ */
+int Kvs_spillPeekRecord(SpillHandle xSpillHandle, SpillRecordInfo_t *pxInfo);
+
+/**
+ * @brief Read the next part of the first record in a spill buffer
+ *
+ * Once a record is read to the end, it's removed and the next record becomes the first one.
+ *
+ * @param[in] xSpillHandle The spill handle
+ * @param[out] pBuf The buffer to store the read data
+ * @param[in] uBufSize The buffer size
+ * @param[out] puReadLen The length of read data
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_spillReadRecord(SpillHandle xSpillHandle, uint8_t *pBuf, size_t uBufSize, size_t *puReadLen);
+
+/**
+ * @brief Remove the first record in a spill buffer without reading the rest of it
+ *
+ * @param[in] xSpillHandle The spill handle
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_spillSkipRecord(SpillHandle xSpillHandle);
+
+/**
+ * @brief Save the fragment timecode of the last PERSISTED ack to a checkpoint file
+ *
+ * The file is rewritten on each call, so the caller should batch the acks to limit the wear of flash. A checkpoint that
+ * is torn by power loss is invalid, and all spilled records are sent again.
+ *
+ * @param[in] pcFilename The checkpoint file name
+ * @param[in] uPersistedTimecodeMs The fragment timecode
+ * @return 0 on success, non-zero value otherwise
+ */
+int Kvs_spillSaveCheckpoint(const char *pcFilename, uint64_t uPersistedTimecodeMs);
+
+/**
+ * @brief Load the fragment timecode that is saved by Kvs_spillSaveCheckpoint()
+ *
+ * @param[in] pcFilename The checkpoint file name
+ * @param[out] puPersistedTimecodeMs The fragment timecode
+ * @return 0 on success, KVS_ERROR_STREAM_SPILL_IO_ERROR if there is no valid checkpoint, non-zero value otherwise
+ */
+int Kvs_spillLoadCheckpoint(const char *pcFilename, uint64_t *puPersistedTimecodeMs);
+
+#endif /* KVS_SPILL_H */
@@ -28,6 +28,28 @@
 
 /* Internal headers */
 #include "os/allocator.h"
+#include "os/tracepoint.h"
+
+/* Alignment of user data that is stored right after the MKV header of a data frame. */
+#define STREAM_MEM_ALIGN (8)
+#define STREAM_MEM_ALIGN_SIZE(x) (((x) + STREAM_MEM_ALIGN - 1) & ~((size_t)STREAM_MEM_ALIGN - 1))
+
+/* Indexes of the ingest ring are shared between the producer and the consumer without lock. */
+#define STREAM_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STREAM_ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+#define FNV1A_64_OFFSET_BASIS (0xCBF29CE484222325ULL)
+#define FNV1A_64_PRIME (0x100000001B3ULL)
+
+/* An immutable EBML and segment header of a track configuration. The stream and each sender of the header hold a
+ * reference, so a new segment never frees a header that is still being sent. */
+typedef struct MkvEbmlSegHdr
+{
+    size_t uRefCnt;
+    uint64_t uTrackHash;
+    uint8_t *pHeader;
+    size_t uHeaderLen;
+} MkvEbmlSegHdr_t;
 
 typedef struct DataFrame
 {
@@ -38,186 +60,1063 @@ typedef struct DataFrame
 
     size_t uMkvHdrLen;
     char *pMkvHdr;
+
+    /* Insertion sequence that keeps the order of data frames with the same timestamp on the same track. */
+    uint64_t uSequence;
+
+    /* For a cluster, the memory of data frames of the GOP that it leads, including itself. */
+    size_t uGopMemTotal;
+
+    /* The stream which owns the frame slab slot of this data frame, or NULL if it's allocated from heap. */
+    struct Stream *pxSlabOwner;
 } DataFrame_t;
 
+typedef struct StreamTrack
+{
+    /* Pending data frames of this track in timestamp order. */
+    DLIST_ENTRY xDataFramePending;
+
+    /* Running counters of pending data frames on this track. */
+    size_t uFrameCount;
+    size_t uMemTotal;
+} StreamTrack_t;
+
 typedef struct Stream
 {
     LOCK_HANDLE xLock;
 
-    char *pMkvEbmlSeg;
-    size_t uMkvEbmlSegLen;
+    MkvEbmlSegHdr_t *pxMkvEbmlSegHdr;
 
     uint64_t uEarliestClusterTimestamp;
+    uint64_t uNextSequence;
+
+    /* Pending clusters in the order they go out. Data frames ahead of the first pending cluster belong to no pending
+     * cluster, and their memory is counted in uOrphanMemTotal. */
     DLIST_ENTRY xClusterPending;
-    DLIST_ENTRY xDataFramePending;
+    size_t uOrphanMemTotal;
+
+    /* Each track has its own queue, and they are merged by timestamp on pop. */
+    StreamTrack_t xVideoTrack;
+    StreamTrack_t xAudioTrack;
+
+    /* Size of user data that is copied into each data frame, and the aligned size that is reserved for it. */
+    size_t uUserDataSize;
+    size_t uUserDataSlotSize;
+
+    /* Fixed size slots of data frame handle, MKV header and user data. */
+    uint8_t *pFrameSlab;
+    size_t uFrameSlabSlotSize;
+    DLIST_ENTRY xFrameSlabFree;
+
+    /* Single-producer/single-consumer ring of DataFrameIn_t and user data in front of track queues. The producer only
+     * updates uIngestTail, and the consumer only updates uIngestHead while holding the lock. */
+    uint8_t *pIngestRing;
+    size_t uIngestRingSize;
+    size_t uIngestSlotSize;
+    size_t uIngestHead;
+    size_t uIngestTail;
+
+    /* The max number of data frames queued since the creation or the last reset. */
+    size_t uMaxFrameCount;
+
+    bool bHasVideoTrack;
+    bool bHasAudioTrack;
+} Stream_t;
+
+static StreamTrack_t *prvStreamGetTrack(Stream_t *pxStream, TrackType_t xTrackType)
+{
+    return (xTrackType == TRACK_VIDEO) ? &(pxStream->xVideoTrack) : &(pxStream->xAudioTrack);
+}
+
+static size_t prvDataFrameMemSize(DataFrame_t *pxDataFrame)
+{
+    return pxDataFrame->xDataFrameIn.uDataLen + sizeof(DataFrame_t) + pxDataFrame->uMkvHdrLen + pxDataFrame->xDataFrameIn.uSegmentCount * sizeof(DataFrameSegment_t);
+}
+
+static DataFrame_t *prvStreamTrackTail(StreamTrack_t *pxTrack)
+{
+    DataFrame_t *pxDataFrame = NULL;
+
+    if (!DList_IsListEmpty(&(pxTrack->xDataFramePending)))
+    {
+        pxDataFrame = containingRecord(pxTrack->xDataFramePending.Blink, DataFrame_t, xDataFrameEntry);
+    }
+
+    return pxDataFrame;
+}
+
+static DataFrame_t *prvStreamTrackHead(StreamTrack_t *pxTrack)
+{
+    DataFrame_t *pxDataFrame = NULL;
+
+    if (!DList_IsListEmpty(&(pxTrack->xDataFramePending)))
+    {
+        pxDataFrame = containingRecord(pxTrack->xDataFramePending.Flink, DataFrame_t, xDataFrameEntry);
+    }
+
+    return pxDataFrame;
+}
+
+/* Track queues are sorted by timestamp, so the oldest and the newest data frames are at both ends. */
+static DataFrame_t *prvStreamOldest(Stream_t *pxStream)
+{
+    DataFrame_t *pxVideoFrame = prvStreamTrackHead(&(pxStream->xVideoTrack));
+    DataFrame_t *pxAudioFrame = prvStreamTrackHead(&(pxStream->xAudioTrack));
+
+    return (pxVideoFrame != NULL && (pxAudioFrame == NULL || pxVideoFrame->xDataFrameIn.uTimestampMs <= pxAudioFrame->xDataFrameIn.uTimestampMs)) ? pxVideoFrame : pxAudioFrame;
+}
+
+static DataFrame_t *prvStreamNewest(Stream_t *pxStream)
+{
+    DataFrame_t *pxVideoFrame = prvStreamTrackTail(&(pxStream->xVideoTrack));
+    DataFrame_t *pxAudioFrame = prvStreamTrackTail(&(pxStream->xAudioTrack));
+
+    return (pxVideoFrame != NULL && (pxAudioFrame == NULL || pxVideoFrame->xDataFrameIn.uTimestampMs >= pxAudioFrame->xDataFrameIn.uTimestampMs)) ? pxVideoFrame : pxAudioFrame;
+}
+
+/**
+ * @brief Check if a data frame goes out before another one
+ *
+ * Data frames go out in timestamp order. If timestamps are the same, video frame goes first, and data frames on the
+ * same track keep the order they are added.
+ */
+static bool prvIsDataFrameBefore(DataFrame_t *pxDataFrame, DataFrame_t *pxDataFrameOther)
+{
+    bool bRes = false;
+
+    if (pxDataFrame->xDataFrameIn.uTimestampMs != pxDataFrameOther->xDataFrameIn.uTimestampMs)
+    {
+        bRes = (pxDataFrame->xDataFrameIn.uTimestampMs < pxDataFrameOther->xDataFrameIn.uTimestampMs);
+    }
+    else if (pxDataFrame->xDataFrameIn.xTrackType != pxDataFrameOther->xDataFrameIn.xTrackType)
+    {
+        bRes = (pxDataFrame->xDataFrameIn.xTrackType == TRACK_VIDEO);
+    }
+    else
+    {
+        bRes = (pxDataFrame->uSequence < pxDataFrameOther->uSequence);
+    }
+
+    return bRes;
+}
+
+static DataFrame_t *prvClusterFromEntry(Stream_t *pxStream, PDLIST_ENTRY pxClusterEntry)
+{
+    return (pxClusterEntry == &(pxStream->xClusterPending)) ? NULL : containingRecord(pxClusterEntry, DataFrame_t, xClusterEntry);
+}
+
+/**
+ * @brief Get the memory counter of the GOP that a data frame belongs to
+ */
+static size_t *prvStreamGetGopMemTotal(Stream_t *pxStream, DataFrame_t *pxDataFrame)
+{
+    PDLIST_ENTRY pxListHead = &(pxStream->xClusterPending);
+    PDLIST_ENTRY pxListItem = pxListHead->Blink;
+    DataFrame_t *pxCluster = NULL;
+
+    /* It's almost always the last cluster. */
+    while ((pxCluster = prvClusterFromEntry(pxStream, pxListItem)) != NULL && prvIsDataFrameBefore(pxDataFrame, pxCluster))
+    {
+        pxListItem = pxListItem->Blink;
+    }
+
+    return (pxCluster == NULL) ? &(pxStream->uOrphanMemTotal) : &(pxCluster->uGopMemTotal);
+}
+
+/**
+ * @brief Sum the memory of data frames on a track that go out after a cluster and before the next cluster
+ */
+static size_t prvStreamTrackMemInGop(StreamTrack_t *pxTrack, DataFrame_t *pxCluster, DataFrame_t *pxNextCluster)
+{
+    size_t uMemTotal = 0;
+    PDLIST_ENTRY pxListHead = &(pxTrack->xDataFramePending);
+    PDLIST_ENTRY pxListItem = pxListHead->Blink;
+    DataFrame_t *pxDataFrame = NULL;
+
+    while (pxListItem != pxListHead)
+    {
+        pxDataFrame = containingRecord(pxListItem, DataFrame_t, xDataFrameEntry);
+        if (pxDataFrame != pxCluster)
+        {
+            if (prvIsDataFrameBefore(pxDataFrame, pxCluster))
+            {
+                break;
+            }
+            else if (pxNextCluster == NULL || prvIsDataFrameBefore(pxDataFrame, pxNextCluster))
+            {
+                uMemTotal += prvDataFrameMemSize(pxDataFrame);
+            }
+        }
+        pxListItem = pxListItem->Blink;
+    }
+
+    return uMemTotal;
+}
+
+/**
+ * @brief Add a cluster into the cluster index, and move data frames that go out after it from the previous GOP
+ */
+static void prvStreamAddCluster(Stream_t *pxStream, DataFrame_t *pxCluster)
+{
+    PDLIST_ENTRY pxListHead = &(pxStream->xClusterPending);
+    PDLIST_ENTRY pxListItem = pxListHead->Blink;
+    DataFrame_t *pxPrevCluster = NULL;
+    DataFrame_t *pxNextCluster = NULL;
+    size_t uMovedMem = 0;
+
+    while ((pxPrevCluster = prvClusterFromEntry(pxStream, pxListItem)) != NULL && prvIsDataFrameBefore(pxCluster, pxPrevCluster))
+    {
+        pxListItem = pxListItem->Blink;
+    }
+    DList_InsertTailList(pxListItem->Flink, &(pxCluster->xClusterEntry));
+    pxNextCluster = prvClusterFromEntry(pxStream, pxCluster->xClusterEntry.Flink);
+
+    /* Usually only a few audio frames that run ahead of video need to be moved. */
+    uMovedMem += prvStreamTrackMemInGop(&(pxStream->xVideoTrack), pxCluster, pxNextCluster);
+    uMovedMem += prvStreamTrackMemInGop(&(pxStream->xAudioTrack), pxCluster, pxNextCluster);
+    if (pxPrevCluster == NULL)
+    {
+        pxStream->uOrphanMemTotal -= uMovedMem;
+    }
+    else
+    {
+        pxPrevCluster->uGopMemTotal -= uMovedMem;
+    }
+    pxCluster->uGopMemTotal = prvDataFrameMemSize(pxCluster) + uMovedMem;
+}
+
+/**
+ * @brief Build the MKV header of a data frame once it's added. The delta timestamp is fixed up when it's popped.
+ */
+static void prvInitializeClusterHdr(DataFrame_t *pxDataFrame)
+{
+    Mkv_initializeClusterHdr(
+        (uint8_t *)(pxDataFrame->pMkvHdr),
+        pxDataFrame->uMkvHdrLen,
+        pxDataFrame->xDataFrameIn.xClusterType,
+        pxDataFrame->xDataFrameIn.uDataLen,
+        pxDataFrame->xDataFrameIn.xTrackType,
+        pxDataFrame->xDataFrameIn.bIsKeyFrame,
+        pxDataFrame->xDataFrameIn.uTimestampMs,
+        0);
+
+    if (pxDataFrame->xDataFrameIn.xLacing != MKV_LACING_NONE)
+    {
+        Mkv_setSimpleBlockLacing((uint8_t *)(pxDataFrame->pMkvHdr), pxDataFrame->uMkvHdrLen, pxDataFrame->xDataFrameIn.xClusterType, pxDataFrame->xDataFrameIn.xLacing);
+    }
+}
+
+static DataFrame_t *prvDataFrameAlloc(Stream_t *pxStream, size_t uMkvHdrLen)
+{
+    DataFrame_t *pxDataFrame = NULL;
+    PDLIST_ENTRY pxListItem = NULL;
+
+    if (!DList_IsListEmpty(&(pxStream->xFrameSlabFree)))
+    {
+        pxListItem = DList_RemoveHeadList(&(pxStream->xFrameSlabFree));
+        pxDataFrame = containingRecord(pxListItem, DataFrame_t, xDataFrameEntry);
+        memset(pxDataFrame, 0, sizeof(DataFrame_t));
+        pxDataFrame->pxSlabOwner = pxStream;
+    }
+    else if ((pxDataFrame = (DataFrame_t *)kvsMallocClass(sizeof(DataFrame_t) + STREAM_MEM_ALIGN_SIZE(uMkvHdrLen) + pxStream->uUserDataSlotSize, KVS_ALLOC_CLASS_METADATA)) == NULL)
+    {
+        /* Out of slab slots and out of memory. */
+    }
+    else
+    {
+        memset(pxDataFrame, 0, sizeof(DataFrame_t));
+    }
+
+    return pxDataFrame;
+}
+
+/**
+ * @brief Add a data frame into its track queue. The stream lock must be held by the caller.
+ */
+static DataFrame_t *prvStreamAddDataFrame(Stream_t *pxStream, DataFrameIn_t *pxDataFrameIn)
+{
+    DataFrame_t *pxDataFrame = NULL;
+    size_t uMkvHdrLen = Mkv_getClusterHdrLen(pxDataFrameIn->xClusterType);
+    size_t uInlineMkvHdrLen = (pxDataFrameIn->uHeadroom >= uMkvHdrLen) ? 0 : uMkvHdrLen;
+    StreamTrack_t *pxTrack = NULL;
+    PDLIST_ENTRY pxListHead = NULL;
+    PDLIST_ENTRY pxListItem = NULL;
+    DataFrameSegment_t *pxSegments = NULL;
+
+    if (pxDataFrameIn->uSegmentCount > 0 &&
+        (pxSegments = (DataFrameSegment_t *)kvsMallocClass(pxDataFrameIn->uSegmentCount * sizeof(DataFrameSegment_t), KVS_ALLOC_CLASS_METADATA)) == NULL)
+    {
+        LogError("OOM: pxSegments");
+    }
+    else if ((pxDataFrame = prvDataFrameAlloc(pxStream, uInlineMkvHdrLen)) == NULL)
+    {
+        LogError("OOM: pxDataFrame");
+        if (pxSegments != NULL)
+        {
+            kvsFree(pxSegments);
+        }
+    }
+    else
+    {
+        memcpy(pxDataFrame, pxDataFrameIn, sizeof(DataFrameIn_t));
+        if (pxSegments != NULL)
+        {
+            /* The segment list of the application may be on its stack, so the data frame keeps a copy. */
+            memcpy(pxSegments, pxDataFrameIn->pxSegments, pxDataFrameIn->uSegmentCount * sizeof(DataFrameSegment_t));
+            pxDataFrame->xDataFrameIn.pxSegments = pxSegments;
+            if (pxDataFrame->xDataFrameIn.pData == NULL)
+            {
+                pxDataFrame->xDataFrameIn.pData = (char *)(pxSegments[0].pData);
+            }
+        }
+        DList_InitializeListHead(&(pxDataFrame->xClusterEntry));
+        DList_InitializeListHead(&(pxDataFrame->xDataFrameEntry));
+        pxDataFrame->uMkvHdrLen = uMkvHdrLen;
+        if (uInlineMkvHdrLen == 0)
+        {
+            /* The MKV header is written into the headroom of the data, so it's sent along with the data. */
+            pxDataFrame->pMkvHdr = pxDataFrame->xDataFrameIn.pData - uMkvHdrLen;
+        }
+        else
+        {
+            pxDataFrame->pMkvHdr = (char *)pxDataFrame + sizeof(DataFrame_t);
+        }
+        if (pxStream->uUserDataSize > 0 && pxDataFrameIn->pUserData != NULL)
+        {
+            /* User data is stored right after the MKV header, and it's released along with the data frame. */
+            pxDataFrame->xDataFrameIn.pUserData = (char *)pxDataFrame + sizeof(DataFrame_t) + STREAM_MEM_ALIGN_SIZE(uInlineMkvHdrLen);
+            memcpy(pxDataFrame->xDataFrameIn.pUserData, pxDataFrameIn->pUserData, pxStream->uUserDataSize);
+        }
+        prvInitializeClusterHdr(pxDataFrame);
+
+        pxTrack = prvStreamGetTrack(pxStream, pxDataFrame->xDataFrameIn.xTrackType);
+        pxListHead = &(pxTrack->xDataFramePending);
+
+        /* Data frames almost always come in timestamp order, so search backward from the tail of its track. */
+        pxListItem = pxListHead->Blink;
+        while (pxListItem != pxListHead && pxDataFrame->xDataFrameIn.uTimestampMs < containingRecord(pxListItem, DataFrame_t, xDataFrameEntry)->xDataFrameIn.uTimestampMs)
+        {
+            pxListItem = pxListItem->Blink;
+        }
+
+        /* Inserting to the tail of a list item's next entry is the same as inserting after the list item. */
+        DList_InsertTailList(pxListItem->Flink, &(pxDataFrame->xDataFrameEntry));
+        pxDataFrame->uSequence = pxStream->uNextSequence++;
+        pxTrack->uFrameCount++;
+        pxTrack->uMemTotal += prvDataFrameMemSize(pxDataFrame);
+        if (pxStream->xVideoTrack.uFrameCount + pxStream->xAudioTrack.uFrameCount > pxStream->uMaxFrameCount)
+        {
+            pxStream->uMaxFrameCount = pxStream->xVideoTrack.uFrameCount + pxStream->xAudioTrack.uFrameCount;
+        }
+
+        if (pxDataFrame->xDataFrameIn.xClusterType == MKV_CLUSTER)
+        {
+            prvStreamAddCluster(pxStream, pxDataFrame);
+        }
+        else
+        {
+            *prvStreamGetGopMemTotal(pxStream, pxDataFrame) += prvDataFrameMemSize(pxDataFrame);
+        }
+    }
+
+    return pxDataFrame;
+}
+
+/**
+ * @brief Move data frames from the ingest ring into track queues. The stream lock must be held by the caller.
+ */
+static void prvStreamDrainIngestRing(Stream_t *pxStream)
+{
+    size_t uHead = 0;
+    size_t uTail = 0;
+    DataFrameIn_t *pxSlot = NULL;
+
+    if (pxStream->pIngestRing != NULL)
+    {
+        uHead = pxStream->uIngestHead;
+        uTail = STREAM_ATOMIC_LOAD(&(pxStream->uIngestTail));
+        while (uHead != uTail)
+        {
+            pxSlot = (DataFrameIn_t *)(pxStream->pIngestRing + (uHead % pxStream->uIngestRingSize) * pxStream->uIngestSlotSize);
+            if (prvStreamAddDataFrame(pxStream, pxSlot) == NULL)
+            {
+                /* Keep it in the ring and try again next time. */
+                break;
+            }
+            uHead++;
+
+            /* Give the slot back to the producer. */
+            STREAM_ATOMIC_STORE(&(pxStream->uIngestHead), uHead);
+        }
+    }
+}
+
+/**
+ * @brief Pop or peek the data frame that goes out first. The stream lock must be held by the caller.
+ */
+static DataFrame_t *prvStreamPopLocked(Stream_t *pxStream, bool bPeek)
+{
+    DataFrame_t *pxDataFrame = NULL;
+    DataFrame_t *pxVideoHead = NULL;
+    DataFrame_t *pxAudioHead = NULL;
+    StreamTrack_t *pxTrack = NULL;
+
+    /* Merge track queues by timestamp. If timestamps are the same, video frame goes first. */
+    pxVideoHead = prvStreamTrackHead(&(pxStream->xVideoTrack));
+    pxAudioHead = prvStreamTrackHead(&(pxStream->xAudioTrack));
+    if (pxVideoHead != NULL && (pxAudioHead == NULL || pxVideoHead->xDataFrameIn.uTimestampMs <= pxAudioHead->xDataFrameIn.uTimestampMs))
+    {
+        pxDataFrame = pxVideoHead;
+        pxTrack = &(pxStream->xVideoTrack);
+    }
+    else if (pxAudioHead != NULL)
+    {
+        pxDataFrame = pxAudioHead;
+        pxTrack = &(pxStream->xAudioTrack);
+    }
+    else
+    {
+        /* LogInfo("No data frame to pop"); */
+    }
+
+    if (pxDataFrame != NULL)
+    {
+        /* Delta timestamp is relative to the last cluster that goes out before this data frame. */
+        if (pxDataFrame->xDataFrameIn.xClusterType != MKV_CLUSTER)
+        {
+            Mkv_setSimpleBlockDeltaTimestamp(
+                (uint8_t *)(pxDataFrame->pMkvHdr),
+                pxDataFrame->uMkvHdrLen,
+                pxDataFrame->xDataFrameIn.xClusterType,
+                (uint16_t)(pxDataFrame->xDataFrameIn.uTimestampMs - pxStream->uEarliestClusterTimestamp));
+        }
+
+        if (!bPeek)
+        {
+            DList_RemoveEntryList(&(pxDataFrame->xDataFrameEntry));
+            pxTrack->uFrameCount--;
+            pxTrack->uMemTotal -= prvDataFrameMemSize(pxDataFrame);
+
+            if (pxDataFrame->xDataFrameIn.xClusterType == MKV_CLUSTER)
+            {
+                pxStream->uEarliestClusterTimestamp = pxDataFrame->xDataFrameIn.uTimestampMs;
+
+                /* The rest of its GOP are now ahead of all pending clusters. */
+                DList_RemoveEntryList(&(pxDataFrame->xClusterEntry));
+                pxStream->uOrphanMemTotal += pxDataFrame->uGopMemTotal - prvDataFrameMemSize(pxDataFrame);
+            }
+            else
+            {
+                pxStream->uOrphanMemTotal -= prvDataFrameMemSize(pxDataFrame);
+            }
+        }
+    }
+
+    return pxDataFrame;
+}
+
+static DataFrameHandle prvStreamPop(StreamHandle xStreamHandle, bool bPeek)
+{
+    Stream_t *pxStream = xStreamHandle;
+    DataFrame_t *pxDataFrame = NULL;
+
+    if (pxStream == NULL)
+    {
+        LogError("invalid argument");
+    }
+    else
+    {
+        if (Lock(pxStream->xLock) != LOCK_OK)
+        {
+            LogError("Failed to Lock");
+        }
+        else
+        {
+            prvStreamDrainIngestRing(pxStream);
+            pxDataFrame = prvStreamPopLocked(pxStream, bPeek);
+
+            Unlock(pxStream->xLock);
+        }
+    }
+
+    return pxDataFrame;
+}
+
+static uint64_t prvHashBytes(uint64_t uHash, const void *pBuf, size_t uLen)
+{
+    const uint8_t *pIdx = (const uint8_t *)pBuf;
+    size_t i = 0;
+
+    for (i = 0; i < uLen; i++)
+    {
+        uHash = (uHash ^ pIdx[i]) * FNV1A_64_PRIME;
+    }
+
+    return uHash;
+}
+
+static uint64_t prvHashString(uint64_t uHash, const char *pcStr)
+{
+    /* The terminating null keeps adjacent strings apart. */
+    return (pcStr == NULL) ? prvHashBytes(uHash, "", 1) : prvHashBytes(uHash, pcStr, strlen(pcStr) + 1);
+}
+
+static uint64_t prvTrackInfoHash(VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo)
+{
+    uint64_t uHash = FNV1A_64_OFFSET_BASIS;
+    uint64_t uLen = 0;
+
+    if (pVideoTrackInfo != NULL)
+    {
+        uHash = prvHashString(uHash, pVideoTrackInfo->pTrackName);
+        uHash = prvHashString(uHash, pVideoTrackInfo->pCodecName);
+        uHash = prvHashBytes(uHash, &(pVideoTrackInfo->uWidth), sizeof(pVideoTrackInfo->uWidth));
+        uHash = prvHashBytes(uHash, &(pVideoTrackInfo->uHeight), sizeof(pVideoTrackInfo->uHeight));
+        uLen = pVideoTrackInfo->uCodecPrivateLen;
+        uHash = prvHashBytes(uHash, &uLen, sizeof(uLen));
+        if (pVideoTrackInfo->pCodecPrivate != NULL)
+        {
+            uHash = prvHashBytes(uHash, pVideoTrackInfo->pCodecPrivate, pVideoTrackInfo->uCodecPrivateLen);
+        }
+    }
+
+    if (pAudioTrackInfo != NULL)
+    {
+        uHash = prvHashString(uHash, pAudioTrackInfo->pTrackName);
+        uHash = prvHashString(uHash, pAudioTrackInfo->pCodecName);
+        uHash = prvHashBytes(uHash, &(pAudioTrackInfo->uFrequency), sizeof(pAudioTrackInfo->uFrequency));
+        uHash = prvHashBytes(uHash, &(pAudioTrackInfo->uChannelNumber), sizeof(pAudioTrackInfo->uChannelNumber));
+        uHash = prvHashBytes(uHash, &(pAudioTrackInfo->uBitsPerSample), sizeof(pAudioTrackInfo->uBitsPerSample));
+        uLen = pAudioTrackInfo->uCodecPrivateLen;
+        uHash = prvHashBytes(uHash, &uLen, sizeof(uLen));
+        if (pAudioTrackInfo->pCodecPrivate != NULL)
+        {
+            uHash = prvHashBytes(uHash, pAudioTrackInfo->pCodecPrivate, pAudioTrackInfo->uCodecPrivateLen);
+        }
+    }
+
+    return uHash;
+}
+
+static MkvEbmlSegHdr_t *prvMkvEbmlSegHdrCreate(VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo)
+{
+    MkvEbmlSegHdr_t *pxHdr = NULL;
+    MkvHeader_t xMkvHeader = {0};
+
+    if ((pxHdr = (MkvEbmlSegHdr_t *)kvsMallocClass(sizeof(MkvEbmlSegHdr_t), KVS_ALLOC_CLASS_METADATA)) == NULL)
+    {
+        LogError("OOM: pxHdr");
+    }
+    else if (Mkv_initializeHeaders(&xMkvHeader, pVideoTrackInfo, pAudioTrackInfo) != KVS_ERRNO_NONE)
+    {
+        LogError("Failed to initialize mkv headers");
+        kvsFree(pxHdr);
+        pxHdr = NULL;
+    }
+    else
+    {
+        pxHdr->uRefCnt = 1;
+        pxHdr->uTrackHash = prvTrackInfoHash(pVideoTrackInfo, pAudioTrackInfo);
+        pxHdr->pHeader = xMkvHeader.pHeader;
+        pxHdr->uHeaderLen = (size_t)(xMkvHeader.uHeaderLen);
+    }
+
+    return pxHdr;
+}
+
+StreamHandle Kvs_streamCreate(VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo)
+{
+    return Kvs_streamCreateEx(pVideoTrackInfo, pAudioTrackInfo, NULL);
+}
+
+StreamHandle Kvs_streamCreateEx(VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo, StreamConfig_t *pxConfig)
+{
+    Stream_t *pxStream = NULL;
+    DataFrame_t *pxDataFrame = NULL;
+    StreamConfig_t xConfig = {0};
+    size_t i = 0;
+
+    if (pVideoTrackInfo == NULL && pAudioTrackInfo == NULL)
+    {
+        LogError("Invalid argument");
+    }
+    else if ((pxStream = (Stream_t *)kvsMallocClass(sizeof(Stream_t), KVS_ALLOC_CLASS_METADATA)) == NULL)
+    {
+        LogError("OOM: pxStream");
+    }
+    else
+    {
+        memset(pxStream, 0, sizeof(Stream_t));
+        if (pxConfig != NULL)
+        {
+            memcpy(&xConfig, pxConfig, sizeof(StreamConfig_t));
+        }
+
+        DList_InitializeListHead(&(pxStream->xClusterPending));
+        DList_InitializeListHead(&(pxStream->xVideoTrack.xDataFramePending));
+        DList_InitializeListHead(&(pxStream->xAudioTrack.xDataFramePending));
+        DList_InitializeListHead(&(pxStream->xFrameSlabFree));
+        pxStream->uUserDataSize = xConfig.uUserDataSize;
+        pxStream->uUserDataSlotSize = STREAM_MEM_ALIGN_SIZE(xConfig.uUserDataSize);
+        pxStream->uFrameSlabSlotSize = sizeof(DataFrame_t) + STREAM_MEM_ALIGN_SIZE(Mkv_getClusterHdrLen(MKV_CLUSTER)) + pxStream->uUserDataSlotSize;
+        pxStream->uIngestRingSize = xConfig.uIngestRingSize;
+        pxStream->uIngestSlotSize = STREAM_MEM_ALIGN_SIZE(sizeof(DataFrameIn_t)) + pxStream->uUserDataSlotSize;
+
+        if (xConfig.uFrameSlabSize > 0 && (pxStream->pFrameSlab = (uint8_t *)kvsMallocClass(pxStream->uFrameSlabSlotSize * xConfig.uFrameSlabSize, KVS_ALLOC_CLASS_METADATA)) == NULL)
+        {
+            LogError("OOM: pFrameSlab");
+            kvsFree(pxStream);
+            pxStream = NULL;
+        }
+        else if (xConfig.uIngestRingSize > 0 && (pxStream->pIngestRing = (uint8_t *)kvsMallocClass(pxStream->uIngestSlotSize * xConfig.uIngestRingSize, KVS_ALLOC_CLASS_METADATA)) == NULL)
+        {
+            LogError("OOM: pIngestRing");
+            kvsFree(pxStream->pFrameSlab);
+            kvsFree(pxStream);
+            pxStream = NULL;
+        }
+        else if ((pxStream->pxMkvEbmlSegHdr = prvMkvEbmlSegHdrCreate(pVideoTrackInfo, pAudioTrackInfo)) == NULL)
+        {
+            kvsFree(pxStream->pIngestRing);
+            kvsFree(pxStream->pFrameSlab);
+            kvsFree(pxStream);
+            pxStream = NULL;
+        }
+        else if ((pxStream->xLock = Lock_Init()) == NULL)
+        {
+            LogError("Failed to initialize lock");
+            Kvs_streamReleaseMkvEbmlSegHdr(pxStream->pxMkvEbmlSegHdr);
+            kvsFree(pxStream->pIngestRing);
+            kvsFree(pxStream->pFrameSlab);
+            kvsFree(pxStream);
+            pxStream = NULL;
+        }
+        else
+        {
+            pxStream->bHasVideoTrack = (pVideoTrackInfo == NULL) ? false : true;
+            pxStream->bHasAudioTrack = (pAudioTrackInfo == NULL) ? false : true;
+
+            for (i = 0; i < xConfig.uFrameSlabSize; i++)
+            {
+                pxDataFrame = (DataFrame_t *)(pxStream->pFrameSlab + i * pxStream->uFrameSlabSlotSize);
+                DList_InsertTailList(&(pxStream->xFrameSlabFree), &(pxDataFrame->xDataFrameEntry));
+            }
+        }
+    }
+
+    return pxStream;
+}
+
+void Kvs_streamTermintate(StreamHandle xStreamHandle)
+{
+    Stream_t *pxStream = xStreamHandle;
+
+    if (pxStream != NULL)
+    {
+        Kvs_streamReleaseMkvEbmlSegHdr(pxStream->pxMkvEbmlSegHdr);
+        if (pxStream->pFrameSlab != NULL)
+        {
+            kvsFree(pxStream->pFrameSlab);
+        }
+        if (pxStream->pIngestRing != NULL)
+        {
+            kvsFree(pxStream->pIngestRing);
+        }
+        Lock_Deinit(pxStream->xLock);
+        kvsFree(pxStream);
+    }
+}
+
+int Kvs_streamGetMkvEbmlSegHdr(StreamHandle xStreamHandle, uint8_t **ppMkvHeader, size_t *puMkvHeaderLen)
+{
+    int res = KVS_ERRNO_NONE;
+    Stream_t *pxStream = xStreamHandle;
+
+    if (pxStream == NULL || ppMkvHeader == NULL || puMkvHeaderLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pxStream->pxMkvEbmlSegHdr == NULL || pxStream->pxMkvEbmlSegHdr->uHeaderLen == 0)
+    {
+        res = KVS_ERROR_STREAM_MKV_IS_NOT_INITIALIZED;
+        LogError("Mkv EBML and segment are not initialized");
+    }
+    else
+    {
+        *ppMkvHeader = pxStream->pxMkvEbmlSegHdr->pHeader;
+        *puMkvHeaderLen = pxStream->pxMkvEbmlSegHdr->uHeaderLen;
+    }
+
+    return res;
+}
+
+int Kvs_streamAcquireMkvEbmlSegHdr(StreamHandle xStreamHandle, MkvEbmlSegHdrHandle *pxMkvEbmlSegHdrHandle, uint8_t **ppMkvHeader, size_t *puMkvHeaderLen)
+{
+    int res = KVS_ERRNO_NONE;
+    Stream_t *pxStream = xStreamHandle;
+    MkvEbmlSegHdr_t *pxHdr = NULL;
+
+    if (pxStream == NULL || pxMkvEbmlSegHdrHandle == NULL || ppMkvHeader == NULL || puMkvHeaderLen == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (Lock(pxStream->xLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        if ((pxHdr = pxStream->pxMkvEbmlSegHdr) == NULL || pxHdr->uHeaderLen == 0)
+        {
+            res = KVS_ERROR_STREAM_MKV_IS_NOT_INITIALIZED;
+            LogError("Mkv EBML and segment are not initialized");
+        }
+        else
+        {
+            __atomic_add_fetch(&(pxHdr->uRefCnt), 1, __ATOMIC_RELAXED);
+            *pxMkvEbmlSegHdrHandle = pxHdr;
+            *ppMkvHeader = pxHdr->pHeader;
+            *puMkvHeaderLen = pxHdr->uHeaderLen;
+        }
+        Unlock(pxStream->xLock);
+    }
+
+    return res;
+}
+
+void Kvs_streamReleaseMkvEbmlSegHdr(MkvEbmlSegHdrHandle xMkvEbmlSegHdrHandle)
+{
+    MkvEbmlSegHdr_t *pxHdr = xMkvEbmlSegHdrHandle;
+    MkvHeader_t xMkvHeader = {0};
+
+    if (pxHdr != NULL && __atomic_sub_fetch(&(pxHdr->uRefCnt), 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        xMkvHeader.pHeader = pxHdr->pHeader;
+        xMkvHeader.uHeaderLen = (uint32_t)(pxHdr->uHeaderLen);
+        Mkv_terminateHeaders(&xMkvHeader);
+        kvsFree(pxHdr);
+    }
+}
+
+int Kvs_streamUpdateMkvEbmlSegHdr(StreamHandle xStreamHandle, VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo)
+{
+    int res = KVS_ERRNO_NONE;
+    Stream_t *pxStream = xStreamHandle;
+    MkvEbmlSegHdr_t *pxHdr = NULL;
+    MkvEbmlSegHdr_t *pxOldHdr = NULL;
+
+    if (pxStream == NULL || (pxStream->bHasVideoTrack && pVideoTrackInfo == NULL) || (pxStream->bHasAudioTrack && pAudioTrackInfo == NULL))
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (pxStream->pxMkvEbmlSegHdr->uTrackHash ==
+             prvTrackInfoHash(pxStream->bHasVideoTrack ? pVideoTrackInfo : NULL, pxStream->bHasAudioTrack ? pAudioTrackInfo : NULL))
+    {
+        /* The header only changes with the track info, so it's kept along with its segment UID. */
+    }
+    else if ((pxHdr = prvMkvEbmlSegHdrCreate(pxStream->bHasVideoTrack ? pVideoTrackInfo : NULL, pxStream->bHasAudioTrack ? pAudioTrackInfo : NULL)) == NULL)
+    {
+        res = KVS_ERROR_OUT_OF_MEMORY;
+        /* Propagate the res error */
+    }
+    else if (Lock(pxStream->xLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to lock");
+    }
+    else
+    {
+        pxOldHdr = pxStream->pxMkvEbmlSegHdr;
+        pxStream->pxMkvEbmlSegHdr = pxHdr;
+        Unlock(pxStream->xLock);
+
+        /* The reference of the stream to the old header is released below, and senders may still hold theirs. */
+        pxHdr = pxOldHdr;
+    }
+
+    Kvs_streamReleaseMkvEbmlSegHdr(pxHdr);
+
+    return res;
+}
+
+static bool prvIsDataFrameSegmentsValid(DataFrameIn_t *pxDataFrameIn)
+{
+    bool bIsValid = (pxDataFrameIn->uSegmentCount <= DATA_FRAME_MAX_SEGMENTS) && (pxDataFrameIn->uSegmentCount == 0 || pxDataFrameIn->pxSegments != NULL);
+    size_t uDataLen = 0;
+    size_t i = 0;
+
+    for (i = 0; bIsValid && i < pxDataFrameIn->uSegmentCount; i++)
+    {
+        bIsValid = (pxDataFrameIn->pxSegments[i].pData != NULL);
+        uDataLen += pxDataFrameIn->pxSegments[i].uLen + (pxDataFrameIn->bPrefixSegmentLen ? DATA_FRAME_SEGMENT_LEN_PREFIX : 0);
+    }
+
+    return bIsValid && (pxDataFrameIn->uSegmentCount == 0 || uDataLen == pxDataFrameIn->uDataLen);
+}
+
+DataFrameHandle Kvs_streamAddDataFrame(StreamHandle xStreamHandle, DataFrameIn_t *pxDataFrameIn)
+{
+    Stream_t *pxStream = xStreamHandle;
+    DataFrame_t *pxDataFrame = NULL;
+
+    KVS_TRACE_BEGIN(KVS_TRACE_STREAM_ADD_FRAME);
+    if (pxStream == NULL || pxDataFrameIn == NULL)
+    {
+        LogError("Invalid argument");
+    }
+    else if (Mkv_getClusterHdrLen(pxDataFrameIn->xClusterType) == 0)
+    {
+        LogError("Invalid cluster len");
+    }
+    else if (!prvIsDataFrameSegmentsValid(pxDataFrameIn))
+    {
+        LogError("Invalid segments");
+    }
+    else if (Lock(pxStream->xLock) != LOCK_OK)
+    {
+        LogError("Failed to Lock");
+    }
+    else
+    {
+        /* Data frames in the ingest ring go first to keep the order. */
+        prvStreamDrainIngestRing(pxStream);
+
+        pxDataFrame = prvStreamAddDataFrame(pxStream, pxDataFrameIn);
 
-    bool bHasVideoTrack;
-    bool bHasAudioTrack;
-} Stream_t;
+        Unlock(pxStream->xLock);
+    }
+    KVS_TRACE_END(KVS_TRACE_STREAM_ADD_FRAME, (pxDataFrameIn != NULL) ? pxDataFrameIn->uDataLen : 0);
 
-static DataFrameHandle prvStreamPop(StreamHandle xStreamHandle, bool bPeek)
+    return pxDataFrame;
+}
+
+int Kvs_streamIngestDataFrame(StreamHandle xStreamHandle, DataFrameIn_t *pxDataFrameIn)
 {
+    int res = KVS_ERRNO_NONE;
     Stream_t *pxStream = xStreamHandle;
-    DataFrame_t *pxDataFrame = NULL;
-    PDLIST_ENTRY pxListHead = NULL;
-    PDLIST_ENTRY pxListItem = NULL;
+    DataFrameIn_t *pxSlot = NULL;
+    size_t uTail = 0;
 
-    if (pxStream == NULL)
+    KVS_TRACE_BEGIN(KVS_TRACE_STREAM_ADD_FRAME);
+    if (pxStream == NULL || pxDataFrameIn == NULL || pxStream->pIngestRing == NULL || pxDataFrameIn->uSegmentCount > 0)
     {
-        LogError("invalid argument");
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (Mkv_getClusterHdrLen(pxDataFrameIn->xClusterType) == 0)
+    {
+        res = KVS_ERROR_INVALID_CLUSTER_HDR_LEN;
+        LogError("Invalid cluster len");
     }
     else
     {
-        if (Lock(pxStream->xLock) != LOCK_OK)
+        uTail = pxStream->uIngestTail;
+        if (uTail - STREAM_ATOMIC_LOAD(&(pxStream->uIngestHead)) >= pxStream->uIngestRingSize)
         {
-            LogError("Failed to Lock");
+            res = KVS_ERROR_STREAM_INGEST_RING_FULL;
         }
         else
         {
-            if (DList_IsListEmpty(&(pxStream->xDataFramePending)))
-            {
-                /* LogInfo("No data frame to pop"); */
-            }
-            else
+            pxSlot = (DataFrameIn_t *)(pxStream->pIngestRing + (uTail % pxStream->uIngestRingSize) * pxStream->uIngestSlotSize);
+            memcpy(pxSlot, pxDataFrameIn, sizeof(DataFrameIn_t));
+            if (pxStream->uUserDataSize > 0 && pxDataFrameIn->pUserData != NULL)
             {
-                pxListHead = &(pxStream->xDataFramePending);
-
-                if (!bPeek)
-                {
-                    pxListItem = DList_RemoveHeadList(pxListHead);
-                }
-                else
-                {
-                    pxListItem = pxListHead->Flink;
-                }
-                pxDataFrame = containingRecord(pxListItem, DataFrame_t, xDataFrameEntry);
-
-                if (!bPeek)
-                {
-                    if (pxDataFrame->xDataFrameIn.xClusterType == MKV_CLUSTER)
-                    {
-                        pxStream->uEarliestClusterTimestamp = pxDataFrame->xDataFrameIn.uTimestampMs;
-                    }
-                }
+                pxSlot->pUserData = (uint8_t *)pxSlot + STREAM_MEM_ALIGN_SIZE(sizeof(DataFrameIn_t));
+                memcpy(pxSlot->pUserData, pxDataFrameIn->pUserData, pxStream->uUserDataSize);
             }
 
-            Unlock(pxStream->xLock);
+            /* Publish the slot to the consumer. */
+            STREAM_ATOMIC_STORE(&(pxStream->uIngestTail), uTail + 1);
         }
     }
+    KVS_TRACE_END(KVS_TRACE_STREAM_ADD_FRAME, (pxDataFrameIn != NULL) ? pxDataFrameIn->uDataLen : 0);
 
-    return pxDataFrame;
+    return res;
 }
 
-StreamHandle Kvs_streamCreate(VideoTrackInfo_t *pVideoTrackInfo, AudioTrackInfo_t *pAudioTrackInfo)
+DataFrameHandle Kvs_streamPop(StreamHandle xStreamHandle)
 {
-    Stream_t *pxStream = NULL;
-    MkvHeader_t xMkvHeader = {0};
+    return prvStreamPop(xStreamHandle, false);
+}
+
+DataFrameHandle Kvs_streamPeek(StreamHandle xStreamHandle)
+{
+    return prvStreamPop(xStreamHandle, true);
+}
+
+/**
+ * @brief Pass evicted data frames to the callback. Callbacks are invoked without lock, so they can terminate the data
+ * frames.
+ */
+static void prvCallOnDataFrameEvicted(PDLIST_ENTRY pxEvicted, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData)
+{
+    PDLIST_ENTRY pxListItem = NULL;
+
+    while (!DList_IsListEmpty(pxEvicted))
+    {
+        pxListItem = DList_RemoveHeadList(pxEvicted);
+        onDataFrameEvicted(containingRecord(pxListItem, DataFrame_t, xDataFrameEntry), pAppData);
+    }
+}
 
-    if (pVideoTrackInfo == NULL)
+/**
+ * @brief Check if the memory total or the time window between the first and the last pending cluster would exceed
+ * the limits, if data frames ahead of a cluster are evicted.
+ */
+static bool prvStreamIsOverLimit(Stream_t *pxStream, DataFrame_t *pxCluster, size_t uMemTotal, size_t uMemLimit, uint64_t uTimeWindowMs)
+{
+    DataFrame_t *pxLastCluster = prvClusterFromEntry(pxStream, pxStream->xClusterPending.Blink);
+
+    return (uMemTotal > uMemLimit) ||
+           (pxCluster != NULL && pxLastCluster->xDataFrameIn.uTimestampMs - pxCluster->xDataFrameIn.uTimestampMs > uTimeWindowMs);
+}
+
+static int prvStreamEvictGops(Stream_t *pxStream, size_t uMemLimit, uint64_t uTimeWindowMs, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData)
+{
+    int res = KVS_ERRNO_NONE;
+    DLIST_ENTRY xEvicted;
+    DataFrame_t *pxDataFrame = NULL;
+    DataFrame_t *pxBoundary = NULL;
+    size_t uMemTotal = 0;
+
+    DList_InitializeListHead(&xEvicted);
+
+    if (pxStream == NULL || onDataFrameEvicted == NULL)
     {
+        res = KVS_ERROR_INVALID_ARGUMENT;
         LogError("Invalid argument");
     }
-    else if ((pxStream = (Stream_t *)kvsMalloc(sizeof(Stream_t))) == NULL)
+    else if (Lock(pxStream->xLock) != LOCK_OK)
     {
-        LogError("OOM: pxStream");
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to Lock");
     }
     else
     {
-        memset(pxStream, 0, sizeof(Stream_t));
-
-        DList_InitializeListHead(&(pxStream->xClusterPending));
-        DList_InitializeListHead(&(pxStream->xDataFramePending));
+        prvStreamDrainIngestRing(pxStream);
+        uMemTotal = sizeof(Stream_t) + pxStream->pxMkvEbmlSegHdr->uHeaderLen + pxStream->xVideoTrack.uMemTotal + pxStream->xAudioTrack.uMemTotal;
+        pxBoundary = prvClusterFromEntry(pxStream, pxStream->xClusterPending.Flink);
 
-        if (Mkv_initializeHeaders(&xMkvHeader, pVideoTrackInfo, pAudioTrackInfo) != KVS_ERRNO_NONE)
-        {
-            LogError("Failed to initialize mkv headers");
-            kvsFree(pxStream);
-            pxStream = NULL;
-        }
-        else if ((pxStream->xLock = Lock_Init()) == NULL)
+        if (prvStreamIsOverLimit(pxStream, pxBoundary, uMemTotal, uMemLimit, uTimeWindowMs))
         {
-            LogError("Failed to initialize lock");
-            kvsFree(pxStream);
-            pxStream = NULL;
-        }
-        else
-        {
-            pxStream->pMkvEbmlSeg = (char *)(xMkvHeader.pHeader);
-            pxStream->uMkvEbmlSegLen = (size_t)(xMkvHeader.uHeaderLen);
-            pxStream->bHasVideoTrack = true;
-            pxStream->bHasAudioTrack = (pAudioTrackInfo == NULL) ? false : true;
+            /* Find the first cluster to keep by the memory of each GOP, and the GOP of the last cluster is always kept. */
+            uMemTotal -= pxStream->uOrphanMemTotal;
+            while (pxBoundary != NULL && pxBoundary->xClusterEntry.Flink != &(pxStream->xClusterPending) &&
+                   prvStreamIsOverLimit(pxStream, pxBoundary, uMemTotal, uMemLimit, uTimeWindowMs))
+            {
+                uMemTotal -= pxBoundary->uGopMemTotal;
+                pxBoundary = prvClusterFromEntry(pxStream, pxBoundary->xClusterEntry.Flink);
+            }
+
+            while ((pxDataFrame = prvStreamPopLocked(pxStream, true)) != NULL && pxDataFrame != pxBoundary)
+            {
+                prvStreamPopLocked(pxStream, false);
+                DList_InsertTailList(&xEvicted, &(pxDataFrame->xDataFrameEntry));
+            }
         }
+
+        Unlock(pxStream->xLock);
     }
 
-    return pxStream;
+    prvCallOnDataFrameEvicted(&xEvicted, onDataFrameEvicted, pAppData);
+
+    return res;
 }
 
-void Kvs_streamTermintate(StreamHandle xStreamHandle)
+int Kvs_streamEvictGopsUntilMem(StreamHandle xStreamHandle, size_t uMemLimit, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData)
 {
-    Stream_t *pxStream = xStreamHandle;
+    return prvStreamEvictGops(xStreamHandle, uMemLimit, UINT64_MAX, onDataFrameEvicted, pAppData);
+}
 
-    if (pxStream != NULL)
-    {
-        kvsFree(pxStream->pMkvEbmlSeg);
-        Lock_Deinit(pxStream->xLock);
-        kvsFree(pxStream);
-    }
+int Kvs_streamEvictGopsUntilTimeWindow(StreamHandle xStreamHandle, uint64_t uTimeWindowMs, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData)
+{
+    return prvStreamEvictGops(xStreamHandle, SIZE_MAX, uTimeWindowMs, onDataFrameEvicted, pAppData);
 }
 
-int Kvs_streamGetMkvEbmlSegHdr(StreamHandle xStreamHandle, uint8_t **ppMkvHeader, size_t *puMkvHeaderLen)
+int Kvs_streamEvictGopsUntilLatency(StreamHandle xStreamHandle, uint64_t uLatencyMs, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData)
 {
     int res = KVS_ERRNO_NONE;
     Stream_t *pxStream = xStreamHandle;
+    DLIST_ENTRY xEvicted;
+    DataFrame_t *pxDataFrame = NULL;
+    DataFrame_t *pxOldest = NULL;
+    DataFrame_t *pxBoundary = NULL;
+    uint64_t uNewestTimestampMs = 0;
 
-    if (pxStream == NULL || ppMkvHeader == NULL || puMkvHeaderLen == NULL)
+    DList_InitializeListHead(&xEvicted);
+
+    if (pxStream == NULL || onDataFrameEvicted == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
         LogError("Invalid argument");
     }
-    else if (pxStream->pMkvEbmlSeg == NULL || pxStream->uMkvEbmlSegLen == 0)
+    else if (Lock(pxStream->xLock) != LOCK_OK)
     {
-        res = KVS_ERROR_STREAM_MKV_IS_NOT_INITIALIZED;
-        LogError("Mkv EBML and segment are not initialized");
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to Lock");
     }
     else
     {
-        *ppMkvHeader = (uint8_t *)(pxStream->pMkvEbmlSeg);
-        *puMkvHeaderLen = pxStream->uMkvEbmlSegLen;
+        prvStreamDrainIngestRing(pxStream);
+        pxOldest = prvStreamOldest(pxStream);
+
+        /* The first cluster to skip to is the first one after the oldest data frame. Without one, the stream waits for
+         * the next keyframe. */
+        pxBoundary = prvClusterFromEntry(pxStream, pxStream->xClusterPending.Flink);
+        if (pxBoundary != NULL && pxBoundary == pxOldest)
+        {
+            pxBoundary = prvClusterFromEntry(pxStream, pxBoundary->xClusterEntry.Flink);
+        }
+
+        if (pxOldest != NULL && pxBoundary != NULL &&
+            (uNewestTimestampMs = prvStreamNewest(pxStream)->xDataFrameIn.uTimestampMs) - pxOldest->xDataFrameIn.uTimestampMs > uLatencyMs)
+        {
+            /* Skip as many GOPs as it takes to get within the latency, but never past the newest cluster. */
+            while (pxBoundary->xClusterEntry.Flink != &(pxStream->xClusterPending) && uNewestTimestampMs - pxBoundary->xDataFrameIn.uTimestampMs > uLatencyMs)
+            {
+                pxBoundary = prvClusterFromEntry(pxStream, pxBoundary->xClusterEntry.Flink);
+            }
+
+            while ((pxDataFrame = prvStreamPopLocked(pxStream, true)) != NULL && pxDataFrame != pxBoundary)
+            {
+                prvStreamPopLocked(pxStream, false);
+                DList_InsertTailList(&xEvicted, &(pxDataFrame->xDataFrameEntry));
+            }
+        }
+
+        Unlock(pxStream->xLock);
     }
 
+    prvCallOnDataFrameEvicted(&xEvicted, onDataFrameEvicted, pAppData);
+
     return res;
 }
 
-DataFrameHandle Kvs_streamAddDataFrame(StreamHandle xStreamHandle, DataFrameIn_t *pxDataFrameIn)
+int Kvs_streamDropDisposableUntilMem(StreamHandle xStreamHandle, size_t uMemLimit, OnDataFrameEvicted_t onDataFrameEvicted, void *pAppData)
 {
     int res = KVS_ERRNO_NONE;
     Stream_t *pxStream = xStreamHandle;
+    DLIST_ENTRY xDropped;
+    PDLIST_ENTRY pxVideoItem = NULL;
+    PDLIST_ENTRY pxAudioItem = NULL;
+    DataFrame_t *pxVideoFrame = NULL;
+    DataFrame_t *pxAudioFrame = NULL;
     DataFrame_t *pxDataFrame = NULL;
-    size_t uMkvHdrLen = 0;
-    DataFrame_t *pxDataFrameCurrent = NULL;
-    PDLIST_ENTRY pxListHead = NULL;
-    PDLIST_ENTRY pxListItem = NULL;
-    bool bListAdded = false;
-    bool bNeedCorrectDeltaTimestamp = false;
-    bool bCorrectDeltaTimestampStarted = false;
-    uint64_t uClusterTimestamp = 0;
-    uint16_t uDeltaTimestampMs = 0;
+    StreamTrack_t *pxTrack = NULL;
+    size_t *puGopMemTotal = NULL;
+    size_t uMemTotal = 0;
 
-    if (pxStream == NULL || pxDataFrameIn == NULL)
+    DList_InitializeListHead(&xDropped);
+
+    if (pxStream == NULL || onDataFrameEvicted == NULL)
     {
         res = KVS_ERROR_INVALID_ARGUMENT;
         LogError("Invalid argument");
     }
-    else if ((uMkvHdrLen = Mkv_getClusterHdrLen(pxDataFrameIn->xClusterType)) == 0)
-    {
-        res = KVS_ERROR_INVALID_CLUSTER_HDR_LEN;
-        LogError("Invalid cluster len");
-    }
-    else if ((pxDataFrame = (DataFrame_t *)kvsMalloc(sizeof(DataFrame_t) + uMkvHdrLen)) == NULL)
-    {
-        res = KVS_ERROR_OUT_OF_MEMORY;
-        LogError("OOM: pxDataFrame");
-    }
     else if (Lock(pxStream->xLock) != LOCK_OK)
     {
         res = KVS_ERROR_LOCK_ERROR;
@@ -225,110 +1124,60 @@ DataFrameHandle Kvs_streamAddDataFrame(StreamHandle xStreamHandle, DataFrameIn_t
     }
     else
     {
-        memset(pxDataFrame, 0, sizeof(DataFrame_t));
-        memcpy(pxDataFrame, pxDataFrameIn, sizeof(DataFrameIn_t));
-        DList_InitializeListHead(&(pxDataFrame->xClusterEntry));
-        DList_InitializeListHead(&(pxDataFrame->xDataFrameEntry));
-        pxDataFrame->uMkvHdrLen = uMkvHdrLen;
-        pxDataFrame->pMkvHdr = (char *)pxDataFrame + sizeof(DataFrame_t);
-        uClusterTimestamp = pxStream->uEarliestClusterTimestamp;
+        prvStreamDrainIngestRing(pxStream);
+        uMemTotal = sizeof(Stream_t) + pxStream->pxMkvEbmlSegHdr->uHeaderLen + pxStream->xVideoTrack.uMemTotal + pxStream->xAudioTrack.uMemTotal;
 
-        pxListHead = &(pxStream->xDataFramePending);
-        pxListItem = pxListHead->Flink;
-        while (pxListItem != pxListHead)
+        /* Walk data frames in the order they go out, so the oldest disposable data frames are dropped first, and
+         * the GOP that a data frame belongs to is known without lookup. */
+        puGopMemTotal = &(pxStream->uOrphanMemTotal);
+        pxVideoItem = pxStream->xVideoTrack.xDataFramePending.Flink;
+        pxAudioItem = pxStream->xAudioTrack.xDataFramePending.Flink;
+        while (uMemTotal > uMemLimit)
         {
-            pxDataFrameCurrent = containingRecord(pxListItem, DataFrame_t, xDataFrameEntry);
-            if (pxDataFrame->xDataFrameIn.uTimestampMs < pxDataFrameCurrent->xDataFrameIn.uTimestampMs ||
-                ((pxDataFrame->xDataFrameIn.uTimestampMs == pxDataFrameCurrent->xDataFrameIn.uTimestampMs) && (pxDataFrame->xDataFrameIn.xTrackType == TRACK_VIDEO)))
+            pxVideoFrame = (pxVideoItem == &(pxStream->xVideoTrack.xDataFramePending)) ? NULL : containingRecord(pxVideoItem, DataFrame_t, xDataFrameEntry);
+            pxAudioFrame = (pxAudioItem == &(pxStream->xAudioTrack.xDataFramePending)) ? NULL : containingRecord(pxAudioItem, DataFrame_t, xDataFrameEntry);
+            if (pxVideoFrame != NULL && (pxAudioFrame == NULL || prvIsDataFrameBefore(pxVideoFrame, pxAudioFrame)))
             {
-                DList_InsertTailList(pxListItem, &(pxDataFrame->xDataFrameEntry));
-                uDeltaTimestampMs = (uint16_t)(pxDataFrame->xDataFrameIn.uTimestampMs - uClusterTimestamp);
-                if (pxDataFrame->xDataFrameIn.xClusterType == MKV_CLUSTER)
-                {
-                    uDeltaTimestampMs = 0;
-
-                    /* If we insert a cluster head, then the following frames's delta timestamp needs updates. */
-                    bNeedCorrectDeltaTimestamp = true;
-                }
-                bListAdded = true;
-                break;
+                pxDataFrame = pxVideoFrame;
+                pxTrack = &(pxStream->xVideoTrack);
+                pxVideoItem = pxVideoItem->Flink;
             }
-            if (pxDataFrameCurrent->xDataFrameIn.xClusterType == MKV_CLUSTER)
+            else if (pxAudioFrame != NULL)
             {
-                uClusterTimestamp = pxDataFrameCurrent->xDataFrameIn.uTimestampMs;
+                pxDataFrame = pxAudioFrame;
+                pxTrack = &(pxStream->xAudioTrack);
+                pxAudioItem = pxAudioItem->Flink;
+            }
+            else
+            {
+                break;
             }
-            pxListItem = pxListItem->Flink;
-        }
-        if (!bListAdded)
-        {
-            uDeltaTimestampMs = (uint16_t)(pxDataFrame->xDataFrameIn.uTimestampMs - uClusterTimestamp);
-            DList_InsertTailList(&(pxStream->xDataFramePending), &(pxDataFrame->xDataFrameEntry));
-            bListAdded = true;
-        }
-
-        Mkv_initializeClusterHdr(
-            (uint8_t *)(pxDataFrame->pMkvHdr),
-            pxDataFrame->uMkvHdrLen,
-            pxDataFrameIn->xClusterType,
-            pxDataFrameIn->uDataLen,
-            pxDataFrameIn->xTrackType,
-            pxDataFrameIn->bIsKeyFrame,
-            pxDataFrameIn->uTimestampMs,
-            uDeltaTimestampMs);
 
-        if (bNeedCorrectDeltaTimestamp)
-        {
-            bCorrectDeltaTimestampStarted = false;
-            pxListHead = &(pxStream->xDataFramePending);
-            pxListItem = pxListHead->Flink;
-            while (pxListItem != pxListHead)
+            if (pxDataFrame->xDataFrameIn.xClusterType == MKV_CLUSTER)
+            {
+                puGopMemTotal = &(pxDataFrame->uGopMemTotal);
+            }
+            else if (pxDataFrame->xDataFrameIn.bIsDisposable)
             {
-                pxDataFrameCurrent = containingRecord(pxListItem, DataFrame_t, xDataFrameEntry);
-                if (pxDataFrameCurrent->xDataFrameIn.xClusterType == MKV_CLUSTER)
-                {
-                    uClusterTimestamp = pxDataFrameCurrent->xDataFrameIn.uTimestampMs;
-                    bCorrectDeltaTimestampStarted = true;
-                }
-                if (bCorrectDeltaTimestampStarted)
-                {
-                    uDeltaTimestampMs = (uint16_t)(pxDataFrameCurrent->xDataFrameIn.uTimestampMs - uClusterTimestamp);
-                    Mkv_initializeClusterHdr(
-                        (uint8_t *)(pxDataFrameCurrent->pMkvHdr),
-                        pxDataFrameCurrent->uMkvHdrLen,
-                        pxDataFrameCurrent->xDataFrameIn.xClusterType,
-                        pxDataFrameCurrent->xDataFrameIn.uDataLen,
-                        pxDataFrameCurrent->xDataFrameIn.xTrackType,
-                        pxDataFrameCurrent->xDataFrameIn.bIsKeyFrame,
-                        pxDataFrameCurrent->xDataFrameIn.uTimestampMs,
-                        uDeltaTimestampMs);
-                }
-                pxListItem = pxListItem->Flink;
+                DList_RemoveEntryList(&(pxDataFrame->xDataFrameEntry));
+                pxTrack->uFrameCount--;
+                pxTrack->uMemTotal -= prvDataFrameMemSize(pxDataFrame);
+                *puGopMemTotal -= prvDataFrameMemSize(pxDataFrame);
+                uMemTotal -= prvDataFrameMemSize(pxDataFrame);
+                DList_InsertTailList(&xDropped, &(pxDataFrame->xDataFrameEntry));
+            }
+            else
+            {
+                /* Keep it */
             }
         }
 
         Unlock(pxStream->xLock);
     }
 
-    if (res != KVS_ERRNO_NONE)
-    {
-        if (pxDataFrame != NULL)
-        {
-            kvsFree(pxDataFrame);
-            pxDataFrame = NULL;
-        }
-    }
-
-    return pxDataFrame;
-}
-
-DataFrameHandle Kvs_streamPop(StreamHandle xStreamHandle)
-{
-    return prvStreamPop(xStreamHandle, false);
-}
+    prvCallOnDataFrameEvicted(&xDropped, onDataFrameEvicted, pAppData);
 
-DataFrameHandle Kvs_streamPeek(StreamHandle xStreamHandle)
-{
-    return prvStreamPop(xStreamHandle, true);
+    return res;
 }
 
 bool Kvs_streamIsEmpty(StreamHandle xStreamHandle)
@@ -344,7 +1193,8 @@ bool Kvs_streamIsEmpty(StreamHandle xStreamHandle)
         }
         else
         {
-            if (!DList_IsListEmpty(&(pxStream->xDataFramePending)))
+            prvStreamDrainIngestRing(pxStream);
+            if (pxStream->xVideoTrack.uFrameCount > 0 || pxStream->xAudioTrack.uFrameCount > 0)
             {
                 bRes = false;
             }
@@ -359,9 +1209,6 @@ bool Kvs_streamAvailOnTrack(StreamHandle xStreamHandle, TrackType_t xTrackType)
 {
     bool bRes = false;
     Stream_t *pxStream = xStreamHandle;
-    PDLIST_ENTRY pxListHead = NULL;
-    PDLIST_ENTRY pxListItem = NULL;
-    DataFrame_t *pxDataFrame = NULL;
 
     if (pxStream != NULL)
     {
@@ -371,18 +1218,10 @@ bool Kvs_streamAvailOnTrack(StreamHandle xStreamHandle, TrackType_t xTrackType)
         }
         else
         {
-            pxListHead = &(pxStream->xDataFramePending);
-            pxListItem = pxListHead->Flink;
-            while (pxListItem != pxListHead)
+            prvStreamDrainIngestRing(pxStream);
+            if (prvStreamGetTrack(pxStream, xTrackType)->uFrameCount > 0)
             {
-                pxDataFrame = containingRecord(pxListItem, DataFrame_t, xDataFrameEntry);
-                if (pxDataFrame->xDataFrameIn.xTrackType == xTrackType)
-                {
-                    bRes = true;
-                    break;
-                }
-
-                pxListItem = pxListItem->Flink;
+                bRes = true;
             }
 
             Unlock(pxStream->xLock);
@@ -396,10 +1235,6 @@ int Kvs_streamMemStatTotal(StreamHandle xStreamHandle, size_t *puMemTotal)
 {
     int res = KVS_ERRNO_NONE;
     Stream_t *pxStream = xStreamHandle;
-    DataFrame_t *pxDataFrame = NULL;
-    PDLIST_ENTRY pxListHead = NULL;
-    PDLIST_ENTRY pxListItem = NULL;
-    size_t uMemTotal = 0;
 
     if (pxStream == NULL || puMemTotal == NULL)
     {
@@ -413,19 +1248,82 @@ int Kvs_streamMemStatTotal(StreamHandle xStreamHandle, size_t *puMemTotal)
     }
     else
     {
-        uMemTotal += sizeof(Stream_t) + pxStream->uMkvEbmlSegLen;
+        prvStreamDrainIngestRing(pxStream);
+        *puMemTotal = sizeof(Stream_t) + pxStream->pxMkvEbmlSegHdr->uHeaderLen + pxStream->xVideoTrack.uMemTotal + pxStream->xAudioTrack.uMemTotal;
+        Unlock(pxStream->xLock);
+    }
+
+    return res;
+}
+
+int Kvs_streamMemStatOnTrack(StreamHandle xStreamHandle, TrackType_t xTrackType, size_t *puMemTotal, size_t *puFrameCount)
+{
+    int res = KVS_ERRNO_NONE;
+    Stream_t *pxStream = xStreamHandle;
+    StreamTrack_t *pxTrack = NULL;
+
+    if (pxStream == NULL || puMemTotal == NULL || puFrameCount == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (Lock(pxStream->xLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to Lock");
+    }
+    else
+    {
+        prvStreamDrainIngestRing(pxStream);
+        pxTrack = prvStreamGetTrack(pxStream, xTrackType);
+        *puMemTotal = pxTrack->uMemTotal;
+        *puFrameCount = pxTrack->uFrameCount;
+        Unlock(pxStream->xLock);
+    }
+
+    return res;
+}
+
+int Kvs_streamGetStats(StreamHandle xStreamHandle, StreamStats_t *pxStats, bool bResetMaxFrameCount)
+{
+    int res = KVS_ERRNO_NONE;
+    Stream_t *pxStream = xStreamHandle;
+    DataFrame_t *pxDataFrame = NULL;
+
+    if (pxStream == NULL || pxStats == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else if (Lock(pxStream->xLock) != LOCK_OK)
+    {
+        res = KVS_ERROR_LOCK_ERROR;
+        LogError("Failed to Lock");
+    }
+    else
+    {
+        prvStreamDrainIngestRing(pxStream);
+        memset(pxStats, 0, sizeof(StreamStats_t));
+        pxStats->uVideoFrameCount = pxStream->xVideoTrack.uFrameCount;
+        pxStats->uVideoMemTotal = pxStream->xVideoTrack.uMemTotal;
+        pxStats->uAudioFrameCount = pxStream->xAudioTrack.uFrameCount;
+        pxStats->uAudioMemTotal = pxStream->xAudioTrack.uMemTotal;
+        pxStats->uMaxFrameCount = pxStream->uMaxFrameCount;
+
+        if ((pxDataFrame = prvStreamOldest(pxStream)) != NULL)
+        {
+            pxStats->uOldestTimestampMs = pxDataFrame->xDataFrameIn.uTimestampMs;
+        }
+        if ((pxDataFrame = prvStreamNewest(pxStream)) != NULL)
+        {
+            pxStats->uNewestTimestampMs = pxDataFrame->xDataFrameIn.uTimestampMs;
+        }
 
-        pxListHead = &(pxStream->xDataFramePending);
-        pxListItem = pxListHead->Flink;
-        while (pxListItem != pxListHead)
+        if (bResetMaxFrameCount)
         {
-            pxDataFrame = containingRecord(pxListItem, DataFrame_t, xDataFrameEntry);
-            uMemTotal += pxDataFrame->xDataFrameIn.uDataLen;
-            uMemTotal += sizeof(DataFrame_t) + pxDataFrame->uMkvHdrLen;
-            pxListItem = pxListItem->Flink;
+            pxStream->uMaxFrameCount = pxStream->xVideoTrack.uFrameCount + pxStream->xAudioTrack.uFrameCount;
         }
 
-        *puMemTotal = uMemTotal;
         Unlock(pxStream->xLock);
     }
 
@@ -446,19 +1344,58 @@ int Kvs_dataFrameGetContent(DataFrameHandle xDataFrameHandle, uint8_t **ppMkvHea
     {
         *ppMkvHeader = (uint8_t *)(pxDataFrame->pMkvHdr);
         *puMkvHeaderLen = pxDataFrame->uMkvHdrLen;
-        *ppData = (uint8_t *)(pxDataFrame->xDataFrameIn.pData);
+        *ppData = (pxDataFrame->xDataFrameIn.uSegmentCount > 0) ? NULL : (uint8_t *)(pxDataFrame->xDataFrameIn.pData);
         *puDataLen = pxDataFrame->xDataFrameIn.uDataLen;
     }
 
     return res;
 }
 
+int Kvs_dataFrameGetSegments(DataFrameHandle xDataFrameHandle, const DataFrameSegment_t **ppxSegments, size_t *puSegmentCount)
+{
+    int res = KVS_ERRNO_NONE;
+    DataFrame_t *pxDataFrame = xDataFrameHandle;
+
+    if (pxDataFrame == NULL || ppxSegments == NULL || puSegmentCount == NULL)
+    {
+        res = KVS_ERROR_INVALID_ARGUMENT;
+        LogError("Invalid argument");
+    }
+    else
+    {
+        *ppxSegments = pxDataFrame->xDataFrameIn.pxSegments;
+        *puSegmentCount = pxDataFrame->xDataFrameIn.uSegmentCount;
+    }
+
+    return res;
+}
+
 void Kvs_dataFrameTerminate(DataFrameHandle xDataFrameHandle)
 {
     DataFrame_t *pxDataFrame = xDataFrameHandle;
+    Stream_t *pxStream = NULL;
 
     if (pxDataFrame != NULL)
     {
-        kvsFree(pxDataFrame);
+        if (pxDataFrame->xDataFrameIn.pxSegments != NULL)
+        {
+            kvsFree(pxDataFrame->xDataFrameIn.pxSegments);
+            pxDataFrame->xDataFrameIn.pxSegments = NULL;
+        }
+
+        pxStream = pxDataFrame->pxSlabOwner;
+        if (pxStream == NULL)
+        {
+            kvsFree(pxDataFrame);
+        }
+        else if (Lock(pxStream->xLock) != LOCK_OK)
+        {
+            LogError("Failed to Lock");
+        }
+        else
+        {
+            DList_InsertHeadList(&(pxStream->xFrameSlabFree), &(pxDataFrame->xDataFrameEntry));
+            Unlock(pxStream->xLock);
+        }
     }
 }
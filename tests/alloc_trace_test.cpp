@@ -0,0 +1,140 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/alloc_trace.h"
+#include "kvs/errors.h"
+#include "kvs/stream.h"
+#include "os/allocator.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#ifdef KVS_USE_ALLOC_TRACE
+
+static bool prvFindSite(int line, KvsAllocSite_t *pxSite)
+{
+    for (size_t i = 0; kvsAllocTraceGetSite(i, pxSite) == KVS_ERRNO_NONE; i++)
+    {
+        if (pxSite->pcFile != NULL && strstr(pxSite->pcFile, "alloc_trace_test.cpp") != NULL && pxSite->line == line)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+TEST(kvsAllocTraceGetStats, count_call_sites)
+{
+    KvsAllocStats_t xBefore = {0};
+    KvsAllocStats_t xAfter = {0};
+    KvsAllocSite_t xSite = {0};
+    void *ptrs[3] = {NULL};
+    int lines[2] = {0};
+    uint8_t *pBytes = NULL;
+
+    EXPECT_NE(KVS_ERRNO_NONE, kvsAllocTraceGetStats(NULL));
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsAllocTraceGetStats(&xBefore));
+
+    for (int i = 0; i < 3; i++)
+    {
+        lines[0] = __LINE__ + 1;
+        ptrs[i] = kvsMalloc(100);
+        ASSERT_NE(nullptr, ptrs[i]);
+    }
+    kvsFree(ptrs[0]);
+
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsAllocTraceGetStats(&xAfter));
+    EXPECT_EQ(xBefore.uLiveBytes + 200, xAfter.uLiveBytes);
+    EXPECT_LE(xBefore.uLiveBytes + 300, xAfter.uPeakLiveBytes);
+
+    ASSERT_TRUE(prvFindSite(lines[0], &xSite));
+    EXPECT_EQ(3, xSite.uAllocs);
+    EXPECT_EQ(1, xSite.uFrees);
+    EXPECT_EQ(300, xSite.uBytes);
+    EXPECT_EQ(200, xSite.uLiveBytes);
+    EXPECT_EQ(300, xSite.uPeakLiveBytes);
+
+    /* A re-allocated block is moved to the call site of the re-allocation, and its content is kept. */
+    memset(ptrs[1], 0xAB, 100);
+    lines[1] = __LINE__ + 1;
+    pBytes = (uint8_t *)kvsRealloc(ptrs[1], 200);
+    ASSERT_NE(nullptr, pBytes);
+    EXPECT_EQ(0xAB, pBytes[99]);
+    ASSERT_TRUE(prvFindSite(lines[0], &xSite));
+    EXPECT_EQ(100, xSite.uLiveBytes);
+    ASSERT_TRUE(prvFindSite(lines[1], &xSite));
+    EXPECT_EQ(200, xSite.uLiveBytes);
+
+    kvsFree(pBytes);
+    kvsFree(ptrs[2]);
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsAllocTraceGetStats(&xAfter));
+    EXPECT_EQ(xBefore.uLiveBytes, xAfter.uLiveBytes);
+    EXPECT_EQ(xBefore.uLiveBlocks, xAfter.uLiveBlocks);
+
+    EXPECT_EQ(nullptr, kvsCalloc(SIZE_MAX, 2));
+    kvsAllocTraceDump();
+}
+
+TEST(kvsAllocTraceGetFootprint, count_by_component)
+{
+    uint8_t pCodecPrivate[] = {0x01, 0x64, 0x00, 0x0A, 0xFF, 0xE1, 0x00, 0x00, 0x01, 0x00, 0x00};
+    VideoTrackInfo_t xVideoTrackInfo = {0};
+    KvsAllocFootprint_t xBefore = {0};
+    KvsAllocFootprint_t xAfter = {0};
+    StreamHandle xStreamHandle = NULL;
+    KvsAllocSite_t xSite = {0};
+    void *ptr = NULL;
+
+    EXPECT_NE(KVS_ERRNO_NONE, kvsAllocTraceGetFootprint(NULL));
+    EXPECT_STREQ("stream", kvsAllocTraceComponentName(KVS_ALLOC_COMPONENT_STREAM));
+    EXPECT_STREQ("unknown", kvsAllocTraceComponentName(KVS_ALLOC_COMPONENT_COUNT));
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsAllocTraceGetFootprint(&xBefore));
+
+    /* The allocations of tests belong to no component of KVS lib. */
+    int line = __LINE__ + 1;
+    ptr = kvsMalloc(100);
+    ASSERT_NE(nullptr, ptr);
+    ASSERT_TRUE(prvFindSite(line, &xSite));
+    EXPECT_EQ(KVS_ALLOC_COMPONENT_OTHER, xSite.xComponent);
+
+    xVideoTrackInfo.pTrackName = (char *)"kvs video track";
+    xVideoTrackInfo.pCodecName = (char *)"V_MPEG4/ISO/AVC";
+    xVideoTrackInfo.uWidth = 640;
+    xVideoTrackInfo.uHeight = 480;
+    xVideoTrackInfo.pCodecPrivate = pCodecPrivate;
+    xVideoTrackInfo.uCodecPrivateLen = sizeof(pCodecPrivate);
+    xStreamHandle = Kvs_streamCreate(&xVideoTrackInfo, NULL);
+    ASSERT_NE(nullptr, xStreamHandle);
+
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsAllocTraceGetFootprint(&xAfter));
+    EXPECT_EQ(xBefore.uLiveBytes[KVS_ALLOC_COMPONENT_OTHER] + 100, xAfter.uLiveBytes[KVS_ALLOC_COMPONENT_OTHER]);
+    EXPECT_LT(xBefore.uLiveBytes[KVS_ALLOC_COMPONENT_STREAM], xAfter.uLiveBytes[KVS_ALLOC_COMPONENT_STREAM]);
+    EXPECT_LT(xBefore.uLiveBytes[KVS_ALLOC_COMPONENT_MKV], xAfter.uLiveBytes[KVS_ALLOC_COMPONENT_MKV]);
+    EXPECT_EQ(xBefore.uLiveBytes[KVS_ALLOC_COMPONENT_NETIO], xAfter.uLiveBytes[KVS_ALLOC_COMPONENT_NETIO]);
+
+    Kvs_streamTermintate(xStreamHandle);
+    kvsFree(ptr);
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsAllocTraceGetFootprint(&xAfter));
+    for (int i = 0; i < KVS_ALLOC_COMPONENT_COUNT; i++)
+    {
+        EXPECT_EQ(xBefore.uLiveBytes[i], xAfter.uLiveBytes[i]);
+        EXPECT_LE(xAfter.uLiveBytes[i], xAfter.uPeakLiveBytes[i]);
+    }
+}
+
+#else
+
+TEST(kvsAllocTraceGetStats, not_enabled)
+{
+    KvsAllocStats_t xStats = {0};
+    KvsAllocSite_t xSite = {0};
+    KvsAllocFootprint_t xFootprint = {0};
+
+    EXPECT_EQ(KVS_ERROR_ALLOC_TRACE_NOT_ENABLED, kvsAllocTraceGetStats(&xStats));
+    EXPECT_EQ(KVS_ERROR_ALLOC_TRACE_NOT_ENABLED, kvsAllocTraceGetSite(0, &xSite));
+    EXPECT_EQ(KVS_ERROR_ALLOC_TRACE_NOT_ENABLED, kvsAllocTraceGetFootprint(&xFootprint));
+}
+
+#endif /* KVS_USE_ALLOC_TRACE */
@@ -0,0 +1,278 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/mkv_generator.h"
+#include "kvs/nalu.h"
+#include "kvs/restapi.h"
+#include "net/http_parser_adapter.h"
+}
+#endif
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+/* Every benchmark runs whole passes of its corpus for at least this long. */
+#define BENCH_MIN_DURATION_NS   (500ULL * 1000 * 1000)
+
+/* The AVCC frame may be longer than the Annex-B one, so the work buffer of each frame has this headroom. */
+#define BENCH_FRAME_HEADROOM    (1024)
+
+typedef std::vector<std::string> Corpus_t;
+
+static Corpus_t prvLoadCorpus(const std::string &xDir)
+{
+    Corpus_t xCorpus;
+    std::vector<std::string> xNames;
+    DIR *pxDir = opendir(xDir.c_str());
+    struct dirent *pxEntry = NULL;
+
+    if (pxDir != NULL)
+    {
+        while ((pxEntry = readdir(pxDir)) != NULL)
+        {
+            if (pxEntry->d_name[0] != '.')
+            {
+                xNames.push_back(pxEntry->d_name);
+            }
+        }
+        closedir(pxDir);
+    }
+
+    /* Frames are named by their order in the recorded stream. */
+    std::sort(xNames.begin(), xNames.end());
+    for (const std::string &xName : xNames)
+    {
+        std::ifstream xFile(xDir + "/" + xName, std::ios::binary);
+        xCorpus.push_back(std::string(std::istreambuf_iterator<char>(xFile), std::istreambuf_iterator<char>()));
+    }
+
+    return xCorpus;
+}
+
+static size_t prvCorpusBytes(const Corpus_t &xCorpus)
+{
+    size_t uBytes = 0;
+
+    for (const std::string &xEntry : xCorpus)
+    {
+        uBytes += xEntry.size();
+    }
+
+    return uBytes;
+}
+
+static uint64_t prvNowNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Run passes of a corpus until the min duration is reached, and report the throughput of the corpus bytes and the time
+ * of each frame. A pass returns how many frames it parses, where a frame is the unit of the parser, i.e. a video frame,
+ * a fragment ack or a HTTP response. The setup of each pass, e.g. restoring buffers parsed in place, is not timed.
+ */
+template <typename Setup, typename Pass> static void prvBench(const char *pcName, const Corpus_t &xCorpus, Setup setup, Pass pass)
+{
+    uint64_t uElapsedNs = 0;
+    uint64_t uPasses = 0;
+    uint64_t uFrames = 0;
+    uint64_t uStartNs = 0;
+    double dBytes = 0;
+
+    if (xCorpus.empty())
+    {
+        printf("%-28s no corpus\n", pcName);
+        return;
+    }
+
+    while (uElapsedNs < BENCH_MIN_DURATION_NS)
+    {
+        setup();
+        uStartNs = prvNowNs();
+        uFrames += pass();
+        uElapsedNs += prvNowNs() - uStartNs;
+        uPasses++;
+    }
+
+    dBytes = (double)prvCorpusBytes(xCorpus) * uPasses;
+    printf("%-28s %10.1f MB/s %10.1f ns/frame\n", pcName, dBytes / ((double)uElapsedNs / 1e9) / 1e6, (double)uElapsedNs / (double)(uFrames > 0 ? uFrames : 1));
+}
+
+static void prvBenchNalu(const Corpus_t &xFrames)
+{
+    std::vector<std::vector<uint8_t>> xWorkFrames;
+    NaluFrameInfo_t xInfo = {0};
+    uint32_t uAvccLen = 0;
+    volatile uint32_t uSink = 0;
+
+    for (const std::string &xFrame : xFrames)
+    {
+        xWorkFrames.push_back(std::vector<uint8_t>(xFrame.size() + BENCH_FRAME_HEADROOM));
+    }
+
+    prvBench(
+        "NALU_analyzeFrame", xFrames, [] {},
+        [&] {
+            for (const std::string &xFrame : xFrames)
+            {
+                NALU_analyzeFrame((uint8_t *)xFrame.data(), (uint32_t)xFrame.size(), false, &xInfo);
+                uSink += xInfo.uAvccLen;
+            }
+            return xFrames.size();
+        });
+
+    prvBench(
+        "NALU_analyze+convert", xFrames,
+        [&] {
+            for (size_t i = 0; i < xFrames.size(); i++)
+            {
+                std::copy(xFrames[i].begin(), xFrames[i].end(), xWorkFrames[i].begin());
+            }
+        },
+        [&] {
+            for (size_t i = 0; i < xFrames.size(); i++)
+            {
+                uint8_t *pFrame = xWorkFrames[i].data();
+
+                if (NALU_analyzeFrame(pFrame, (uint32_t)xFrames[i].size(), false, &xInfo) == KVS_ERRNO_NONE &&
+                    NALU_convertAnnexBToAvccWithFrameInfo(pFrame, (uint32_t)xWorkFrames[i].size(), &xInfo, 0, &uAvccLen) == KVS_ERRNO_NONE)
+                {
+                    uSink += uAvccLen;
+                }
+            }
+            return xFrames.size();
+        });
+}
+
+static void prvBenchMkvClusterHdr(const Corpus_t &xFrames)
+{
+    std::vector<uint8_t> xMkvHeader(Mkv_getClusterHdrLen(MKV_CLUSTER));
+    std::vector<bool> xIsKeyFrame;
+    uint8_t *pMkvHeader = xMkvHeader.data();
+    uint64_t uTimestampMs = 0;
+    uint64_t uClusterTimestampMs = 0;
+    volatile uint8_t uSink = 0;
+
+    /* Frames are framed as they are by the stream, i.e. a cluster starts at every key frame, and the delta timestamp of
+     * a simple block is patched when it's sent. */
+    for (const std::string &xFrame : xFrames)
+    {
+        xIsKeyFrame.push_back(isKeyFrame((uint8_t *)xFrame.data(), xFrame.size()));
+    }
+
+    prvBench(
+        "Mkv_initializeClusterHdr", xFrames, [] {},
+        [&] {
+            uTimestampMs = 0;
+            for (size_t i = 0; i < xFrames.size(); i++)
+            {
+                bool bIsKeyFrame = xIsKeyFrame[i];
+                MkvClusterType_t xType = bIsKeyFrame ? MKV_CLUSTER : MKV_SIMPLE_BLOCK;
+
+                if (bIsKeyFrame)
+                {
+                    uClusterTimestampMs = uTimestampMs;
+                }
+                Mkv_initializeClusterHdr(pMkvHeader, xMkvHeader.size(), xType, xFrames[i].size(), TRACK_VIDEO, bIsKeyFrame, uTimestampMs, 0);
+                if (!bIsKeyFrame)
+                {
+                    Mkv_setSimpleBlockDeltaTimestamp(pMkvHeader, Mkv_getClusterHdrLen(xType), xType, (uint16_t)(uTimestampMs - uClusterTimestampMs));
+                }
+                uSink += pMkvHeader[0];
+                uTimestampMs += 33;
+            }
+            return xFrames.size();
+        });
+}
+
+static void prvBenchFragmentAck(const Corpus_t &xResponses)
+{
+    ePutMediaFragmentAckEventType eAckEventType = eUnknown;
+    uint64_t uFragmentTimecode = 0;
+    unsigned int uErrorId = 0;
+    size_t uFragAckLen = 0;
+    volatile uint64_t uSink = 0;
+
+    /* Each entry is a response body of several acks in a row, as they're received. */
+    prvBench(
+        "Kvs_parseFragmentAck", xResponses, [] {},
+        [&] {
+            size_t uAcks = 0;
+
+            for (const std::string &xResponse : xResponses)
+            {
+                for (size_t uIdx = 0; uIdx < xResponse.size(); uIdx += uFragAckLen)
+                {
+                    if (Kvs_parseFragmentAck(
+                            xResponse.data() + uIdx, xResponse.size() - uIdx, &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen) !=
+                        KVS_ERRNO_NONE)
+                    {
+                        break;
+                    }
+                    uSink += uFragmentTimecode;
+                    uAcks++;
+                }
+            }
+            return uAcks;
+        });
+}
+
+static void prvBenchHttpResponse(const Corpus_t &xResponses)
+{
+    unsigned int uStatusCode = 0;
+    const char *pBodyLoc = NULL;
+    size_t uBodyLen = 0;
+    size_t uConsumed = 0;
+    bool bComplete = false;
+    HttpRspParserHandle xRspParser = NULL;
+    volatile size_t uSink = 0;
+
+    prvBench(
+        "HttpParser_parseHttpResponse", xResponses, [] {},
+        [&] {
+            for (const std::string &xResponse : xResponses)
+            {
+                HttpParser_parseHttpResponse(xResponse.data(), xResponse.size(), &uStatusCode, &pBodyLoc, &uBodyLen);
+                uSink += uBodyLen;
+            }
+            return xResponses.size();
+        });
+
+    prvBench(
+        "HttpParser_executeRspParser", xResponses, [] {},
+        [&] {
+            for (const std::string &xResponse : xResponses)
+            {
+                if ((xRspParser = HttpParser_createRspParser(NULL, NULL)) != NULL)
+                {
+                    HttpParser_executeRspParser(xRspParser, xResponse.data(), xResponse.size(), &uConsumed, &bComplete);
+                    uSink += uConsumed;
+                    HttpParser_terminateRspParser(xRspParser);
+                }
+            }
+            return xResponses.size();
+        });
+}
+
+int main(int argc, char *argv[])
+{
+    std::string xMediaDir = (argc > 1) ? argv[1] : BENCH_MEDIA_DIR;
+    std::string xCorpusDir = (argc > 2) ? argv[2] : BENCH_CORPUS_DIR;
+    Corpus_t xFrames = prvLoadCorpus(xMediaDir);
+
+    printf("%zu frames of %zu bytes from %s\n", xFrames.size(), prvCorpusBytes(xFrames), xMediaDir.c_str());
+
+    prvBenchNalu(xFrames);
+    prvBenchMkvClusterHdr(xFrames);
+    prvBenchFragmentAck(prvLoadCorpus(xCorpusDir + "/fragment_ack"));
+    prvBenchHttpResponse(prvLoadCorpus(xCorpusDir + "/http_response"));
+
+    return 0;
+}
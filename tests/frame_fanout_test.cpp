@@ -0,0 +1,193 @@
+#ifdef __cplusplus
+extern "C" {
+#include "frame_fanout/frame_fanout.h"
+#include "kvs/port.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static uint8_t pKeyFrame[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+static uint8_t pDeltaFrame[] = {0x00, 0x00, 0x00, 0x01, 0x41, 0x9a, 0x02};
+
+static void prvCountDestructor(uint8_t *pData, size_t uLen, void *pAppData)
+{
+    (*(int *)pAppData)++;
+    free(pData);
+}
+
+static SharedFrameHandle prvCreateFrame(const uint8_t *pFrame, size_t uLen, int *pDestructed)
+{
+    SharedFrameDestructorInfo_t xDestructorInfo = {prvCountDestructor, pDestructed};
+    uint8_t *pData = (uint8_t *)malloc(uLen);
+
+    memcpy(pData, pFrame, uLen);
+    return SharedFrame_create(pData, uLen, false, &xDestructorInfo);
+}
+
+static void prvPublish(FrameFanoutHandle xFanout, const uint8_t *pFrame, size_t uLen, uint64_t uTimestampMs, int *pDestructed)
+{
+    SharedFrameHandle xFrame = prvCreateFrame(pFrame, uLen, pDestructed);
+
+    ASSERT_NE(nullptr, xFrame);
+    EXPECT_EQ(0, FrameFanout_publish(xFanout, xFrame, uTimestampMs));
+    SharedFrame_release(xFrame);
+}
+
+static void prvReceiveAll(FrameFanoutHandle xFanout, FrameFanoutSinkHandle xSink, std::vector<uint64_t> &xTimestamps)
+{
+    FrameFanoutFrame_t xFrame = {0};
+
+    while (FrameFanout_receive(xFanout, xSink, &xFrame) == 0)
+    {
+        xTimestamps.push_back(xFrame.uTimestampMs);
+        SharedFrame_release(xFrame.xFrame);
+    }
+}
+
+TEST(FrameFanout, sinks_share_one_analyzed_frame)
+{
+    FrameFanoutHandle xFanout = FrameFanout_create();
+    FrameFanoutSinkParameter_t xParameter = {4, eFanoutDropNewest, NULL};
+    FrameFanoutSinkHandle xSink1 = NULL;
+    FrameFanoutSinkHandle xSink2 = NULL;
+    FrameFanoutFrame_t xFrame1 = {0};
+    FrameFanoutFrame_t xFrame2 = {0};
+    uint8_t pExpected[] = {0x00, 0x00, 0x00, 0x02, 0x67, 0x64, 0x00, 0x00, 0x00, 0x03, 0x65, 0x88, 0x84};
+    int destructed = 0;
+
+    ASSERT_NE(nullptr, xFanout);
+    ASSERT_NE(nullptr, xSink1 = FrameFanout_addSink(xFanout, &xParameter));
+    ASSERT_NE(nullptr, xSink2 = FrameFanout_addSink(xFanout, &xParameter));
+    prvPublish(xFanout, pKeyFrame, sizeof(pKeyFrame), 100, &destructed);
+
+    ASSERT_EQ(0, FrameFanout_receive(xFanout, xSink1, &xFrame1));
+    ASSERT_EQ(0, FrameFanout_receive(xFanout, xSink2, &xFrame2));
+    EXPECT_NE(0, FrameFanout_receive(xFanout, xSink1, &xFrame1));
+
+    /* Both sinks see the same AVCC view and info, which are derived once. */
+    EXPECT_EQ(xFrame1.xFrame, xFrame2.xFrame);
+    EXPECT_EQ(xFrame1.pAvcc, xFrame2.pAvcc);
+    EXPECT_EQ(xFrame1.pxFrameInfo, xFrame2.pxFrameInfo);
+    EXPECT_EQ(100u, xFrame1.uTimestampMs);
+    EXPECT_TRUE(xFrame1.bIsKeyFrame);
+    ASSERT_EQ(sizeof(pExpected), xFrame1.uAvccLen);
+    EXPECT_EQ(0, memcmp(pExpected, xFrame1.pAvcc, xFrame1.uAvccLen));
+    EXPECT_EQ(xFrame1.uAvccLen, xFrame1.pxFrameInfo->uLen);
+
+    /* The frame is alive until every sink releases it. */
+    SharedFrame_release(xFrame1.xFrame);
+    EXPECT_EQ(0, destructed);
+    SharedFrame_release(xFrame2.xFrame);
+    EXPECT_EQ(1, destructed);
+
+    FrameFanout_terminate(xFanout);
+}
+
+TEST(FrameFanout, backpressure_per_sink)
+{
+    FrameFanoutHandle xFanout = FrameFanout_create();
+    FrameFanoutSinkParameter_t xDropNewest = {2, eFanoutDropNewest, NULL};
+    FrameFanoutSinkParameter_t xDropOldest = {2, eFanoutDropOldest, NULL};
+    FrameFanoutSinkHandle xSinkNewest = FrameFanout_addSink(xFanout, &xDropNewest);
+    FrameFanoutSinkHandle xSinkOldest = FrameFanout_addSink(xFanout, &xDropOldest);
+    FrameFanoutSinkStat_t xStat = {0};
+    std::vector<uint64_t> xTimestamps;
+    int destructed = 0;
+
+    ASSERT_NE(nullptr, xSinkNewest);
+    ASSERT_NE(nullptr, xSinkOldest);
+    prvPublish(xFanout, pKeyFrame, sizeof(pKeyFrame), 0, &destructed);
+    prvPublish(xFanout, pDeltaFrame, sizeof(pDeltaFrame), 33, &destructed);
+    prvPublish(xFanout, pDeltaFrame, sizeof(pDeltaFrame), 66, &destructed);
+
+    ASSERT_EQ(0, FrameFanout_getSinkStat(xFanout, xSinkNewest, &xStat));
+    EXPECT_EQ(2u, xStat.uQueuedCount);
+    EXPECT_EQ(1u, xStat.uDroppedCount);
+
+    prvReceiveAll(xFanout, xSinkNewest, xTimestamps);
+    EXPECT_EQ(std::vector<uint64_t>({0, 33}), xTimestamps);
+    xTimestamps.clear();
+    prvReceiveAll(xFanout, xSinkOldest, xTimestamps);
+    EXPECT_EQ(std::vector<uint64_t>({33, 66}), xTimestamps);
+
+    ASSERT_EQ(0, FrameFanout_getSinkStat(xFanout, xSinkOldest, &xStat));
+    EXPECT_EQ(0u, xStat.uQueuedCount);
+    EXPECT_EQ(2u, xStat.uDeliveredCount);
+    EXPECT_EQ(1u, xStat.uDroppedCount);
+    EXPECT_EQ(3, destructed);
+
+    FrameFanout_terminate(xFanout);
+}
+
+TEST(FrameFanout, drop_oldest_gop_keeps_key_frame_first)
+{
+    FrameFanoutHandle xFanout = FrameFanout_create();
+    FrameFanoutSinkParameter_t xParameter = {3, eFanoutDropOldestGop, NULL};
+    FrameFanoutSinkHandle xSink = FrameFanout_addSink(xFanout, &xParameter);
+    std::vector<uint64_t> xTimestamps;
+    int destructed = 0;
+
+    ASSERT_NE(nullptr, xSink);
+
+    /* The sink starts from a key frame. */
+    prvPublish(xFanout, pDeltaFrame, sizeof(pDeltaFrame), 0, &destructed);
+    prvPublish(xFanout, pKeyFrame, sizeof(pKeyFrame), 10, &destructed);
+    prvPublish(xFanout, pDeltaFrame, sizeof(pDeltaFrame), 20, &destructed);
+    prvPublish(xFanout, pKeyFrame, sizeof(pKeyFrame), 30, &destructed);
+
+    /* The queue is full, so the first GOP is dropped as a whole. */
+    prvPublish(xFanout, pDeltaFrame, sizeof(pDeltaFrame), 40, &destructed);
+    prvReceiveAll(xFanout, xSink, xTimestamps);
+    EXPECT_EQ(std::vector<uint64_t>({30, 40}), xTimestamps);
+
+    /* The whole queue is one GOP, so it waits for the next key frame after it's dropped. */
+    xTimestamps.clear();
+    prvPublish(xFanout, pKeyFrame, sizeof(pKeyFrame), 50, &destructed);
+    prvPublish(xFanout, pDeltaFrame, sizeof(pDeltaFrame), 60, &destructed);
+    prvPublish(xFanout, pDeltaFrame, sizeof(pDeltaFrame), 70, &destructed);
+    prvPublish(xFanout, pDeltaFrame, sizeof(pDeltaFrame), 80, &destructed);
+    prvPublish(xFanout, pKeyFrame, sizeof(pKeyFrame), 90, &destructed);
+    prvReceiveAll(xFanout, xSink, xTimestamps);
+    EXPECT_EQ(std::vector<uint64_t>({90}), xTimestamps);
+    EXPECT_EQ(10, destructed);
+
+    FrameFanout_terminate(xFanout);
+}
+
+TEST(FrameFanout, wake_event_and_remove_sink)
+{
+    FrameFanoutHandle xFanout = FrameFanout_create();
+    KvsEventHandle xWakeEvent = kvsEventCreate();
+    FrameFanoutSinkParameter_t xParameter = {4, eFanoutDropNewest, xWakeEvent};
+    FrameFanoutSinkParameter_t xInvalid = {0, eFanoutDropNewest, NULL};
+    FrameFanoutSinkHandle xSink = NULL;
+    int destructed = 0;
+    int i = 0;
+
+    ASSERT_NE(nullptr, xWakeEvent);
+    EXPECT_EQ(nullptr, FrameFanout_addSink(xFanout, &xInvalid));
+    ASSERT_NE(nullptr, xSink = FrameFanout_addSink(xFanout, &xParameter));
+    EXPECT_FALSE(kvsEventWait(xWakeEvent, 0));
+    prvPublish(xFanout, pKeyFrame, sizeof(pKeyFrame), 0, &destructed);
+    EXPECT_TRUE(kvsEventWait(xWakeEvent, 0));
+
+    /* Queued frames are released when the sink is removed, and the slot can be used by another sink. */
+    FrameFanout_removeSink(xFanout, xSink);
+    EXPECT_EQ(1, destructed);
+    for (i = 0; i < FRAME_FANOUT_MAX_SINKS; i++)
+    {
+        EXPECT_NE(nullptr, FrameFanout_addSink(xFanout, &xParameter));
+    }
+    EXPECT_EQ(nullptr, FrameFanout_addSink(xFanout, &xParameter));
+
+    /* Queued frames of remaining sinks are released when the fan-out is terminated. */
+    prvPublish(xFanout, pKeyFrame, sizeof(pKeyFrame), 33, &destructed);
+    EXPECT_EQ(1, destructed);
+    FrameFanout_terminate(xFanout);
+    EXPECT_EQ(2, destructed);
+    kvsEventTerminate(xWakeEvent);
+}
@@ -0,0 +1,425 @@
+#ifdef __cplusplus
+extern "C" {
+#include "frame_ring_buffer/frame_ring_buffer.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+static uint8_t pFrames[4][4] = {{0x00}, {0x01}, {0x02}, {0x03}};
+
+static int prvCountDestructor(uint8_t *pData, size_t uLen, FrameKeyHandle keyHandle, void *pAppData)
+{
+    (*(int *)pAppData)++;
+    return 0;
+}
+
+TEST(FrameRingBuffer, enqueue_and_get_frame)
+{
+    FrameRingBufferHandle xRing = FrameRingBuffer_create(2);
+    FrameKeyHandle xKey = NULL;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+
+    ASSERT_NE(nullptr, xRing);
+    ASSERT_NE(nullptr, xKey = FrameRingBuffer_enqueue(xRing, pFrames[0], sizeof(pFrames[0]), NULL));
+    EXPECT_EQ(0, FrameRingBuffer_getFrame(xKey, &pData, &uLen));
+    EXPECT_EQ(pFrames[0], pData);
+    EXPECT_EQ(sizeof(pFrames[0]), uLen);
+
+    EXPECT_EQ(0, FrameRingBuffer_dequeue(xRing));
+    EXPECT_NE(0, FrameRingBuffer_getFrame(xKey, &pData, &uLen));
+    EXPECT_NE(0, FrameRingBuffer_dequeue(xRing));
+
+    FrameRingBuffer_terminate(xRing);
+}
+
+TEST(FrameRingBuffer, stale_key_of_reused_element)
+{
+    FrameRingBufferHandle xRing = FrameRingBuffer_create(2);
+    FrameKeyHandle xKey = NULL;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    FrameDestructorInfo_t xDestructor = {0};
+    int destructed = 0;
+
+    xDestructor.frameDestructor = prvCountDestructor;
+    xDestructor.pAppData = &destructed;
+
+    ASSERT_NE(nullptr, xRing);
+    ASSERT_NE(nullptr, xKey = FrameRingBuffer_enqueue(xRing, pFrames[0], sizeof(pFrames[0]), &xDestructor));
+    ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, pFrames[1], sizeof(pFrames[1]), &xDestructor));
+
+    /* The buffer is full, so the oldest frame is dropped, and its element is reused by the new frame. */
+    ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, pFrames[2], sizeof(pFrames[2]), &xDestructor));
+    EXPECT_EQ(1, destructed);
+    EXPECT_NE(0, FrameRingBuffer_getFrame(xKey, &pData, &uLen));
+
+    FrameRingBuffer_terminate(xRing);
+    EXPECT_EQ(3, destructed);
+}
+
+TEST(FrameRingBuffer, reader_skips_dropped_frames)
+{
+    FrameRingBufferHandle xRing = FrameRingBuffer_create(2);
+    FrameRingBufferReaderHandle xReader = NULL;
+    FrameKeyHandle xKey = NULL;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    size_t i = 0;
+
+    ASSERT_NE(nullptr, xRing);
+    ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, pFrames[0], sizeof(pFrames[0]), NULL));
+
+    /* A reader starts from the next enqueued frame. */
+    ASSERT_NE(nullptr, xReader = FrameRingBuffer_createReader(xRing));
+    EXPECT_NE(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+
+    for (i = 1; i < 4; i++)
+    {
+        ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, pFrames[i], sizeof(pFrames[i]), NULL));
+    }
+
+    /* Frame 1 is dropped by the full buffer, and frame 2 is dequeued manually. */
+    EXPECT_EQ(0, FrameRingBuffer_dequeue(xRing));
+    ASSERT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, &xKey));
+    EXPECT_EQ(pFrames[3], pData);
+    EXPECT_EQ(0, FrameRingBuffer_getFrame(xKey, &pData, &uLen));
+    EXPECT_EQ(pFrames[3], pData);
+    EXPECT_NE(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+
+    FrameRingBuffer_terminateReader(xReader);
+    FrameRingBuffer_terminate(xRing);
+}
+
+TEST(FrameRingBuffer, seek_latest_key_frame)
+{
+    FrameRingBufferHandle xRing = FrameRingBuffer_create(4);
+    FrameRingBufferReaderHandle xReader = NULL;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    size_t i = 0;
+
+    ASSERT_NE(nullptr, xRing);
+    ASSERT_NE(nullptr, xReader = FrameRingBuffer_createReader(xRing));
+    EXPECT_NE(0, FrameRingBuffer_seekLatestKeyFrame(xReader));
+
+    ASSERT_NE(nullptr, FrameRingBuffer_enqueueEx(xRing, pFrames[0], sizeof(pFrames[0]), FRAME_RING_BUFFER_FLAG_KEY_FRAME, NULL));
+    ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, pFrames[1], sizeof(pFrames[1]), NULL));
+    ASSERT_NE(nullptr, FrameRingBuffer_enqueueEx(xRing, pFrames[2], sizeof(pFrames[2]), FRAME_RING_BUFFER_FLAG_KEY_FRAME, NULL));
+    ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, pFrames[3], sizeof(pFrames[3]), NULL));
+
+    /* A reader reads through the buffered frames, and then it goes back to the newest key frame. */
+    for (i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+    }
+    ASSERT_EQ(0, FrameRingBuffer_seekLatestKeyFrame(xReader));
+    ASSERT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+    EXPECT_EQ(pFrames[2], pData);
+    ASSERT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+    EXPECT_EQ(pFrames[3], pData);
+    EXPECT_NE(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+
+    /* Key frames that are dropped are not found. */
+    EXPECT_EQ(0, FrameRingBuffer_dequeue(xRing));
+    EXPECT_EQ(0, FrameRingBuffer_dequeue(xRing));
+    EXPECT_EQ(0, FrameRingBuffer_dequeue(xRing));
+    EXPECT_NE(0, FrameRingBuffer_seekLatestKeyFrame(xReader));
+
+    FrameRingBuffer_terminateReader(xReader);
+    FrameRingBuffer_terminate(xRing);
+}
+
+TEST(FrameRingBuffer, reserve_and_commit_into_storage)
+{
+    FrameRingBufferHandle xRing = FrameRingBuffer_createWithStorage(8, 64);
+    FrameKeyHandle xKeys[3] = {NULL};
+    uint8_t *pReserved[3] = {NULL};
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    FrameRingBufferStat_t xStat = {0};
+    size_t i = 0;
+
+    ASSERT_NE(nullptr, xRing);
+    EXPECT_EQ(nullptr, FrameRingBuffer_reserve(xRing, 65));
+
+    for (i = 0; i < 3; i++)
+    {
+        ASSERT_NE(nullptr, pReserved[i] = FrameRingBuffer_reserve(xRing, 20));
+        EXPECT_EQ(nullptr, FrameRingBuffer_reserve(xRing, 1));
+        memset(pReserved[i], (int)i, 20);
+        ASSERT_NE(nullptr, xKeys[i] = FrameRingBuffer_commit(xRing, 20, 0, NULL));
+    }
+
+    /* Frames are written in order. */
+    EXPECT_EQ(pReserved[0] + 20, pReserved[1]);
+    EXPECT_EQ(pReserved[1] + 20, pReserved[2]);
+    ASSERT_EQ(0, FrameRingBuffer_getFrame(xKeys[0], &pData, &uLen));
+    EXPECT_EQ(20, uLen);
+    EXPECT_EQ(0, pData[19]);
+
+    /* There's no room at the end, so the oldest frame is dropped and the storage wraps around. */
+    ASSERT_NE(nullptr, pReserved[0] = FrameRingBuffer_reserve(xRing, 20));
+    EXPECT_NE(0, FrameRingBuffer_getFrame(xKeys[0], &pData, &uLen));
+    ASSERT_EQ(0, FrameRingBuffer_getFrame(xKeys[1], &pData, &uLen));
+    EXPECT_EQ(pReserved[1], pData);
+    EXPECT_EQ(1, pData[19]);
+
+    /* Committing nothing cancels the reservation. */
+    EXPECT_EQ(nullptr, FrameRingBuffer_commit(xRing, 0, 0, NULL));
+    EXPECT_EQ(nullptr, FrameRingBuffer_commit(xRing, 1, 0, NULL));
+
+    /* Enqueue copies the frame into the storage. */
+    ASSERT_NE(nullptr, xKeys[0] = FrameRingBuffer_enqueue(xRing, pFrames[3], sizeof(pFrames[3]), NULL));
+    ASSERT_EQ(0, FrameRingBuffer_getFrame(xKeys[0], &pData, &uLen));
+    EXPECT_NE(pFrames[3], pData);
+    EXPECT_EQ(0, memcmp(pFrames[3], pData, sizeof(pFrames[3])));
+
+    ASSERT_EQ(0, FrameRingBuffer_getMemoryStat(xRing, &xStat));
+    EXPECT_EQ(3, xStat.uFrameUsedCount);
+    EXPECT_EQ(20 + 20 + sizeof(pFrames[3]), xStat.uSumOfFrameMemory);
+
+    FrameRingBuffer_terminate(xRing);
+}
+
+TEST(FrameRingBuffer, drop_oldest_by_bytes)
+{
+    FrameRingBufferHandle xRing = FrameRingBuffer_create(8);
+    DropFramePolicy_t xPolicy = {};
+    FrameRingBufferStat_t xStat = {0};
+    static uint8_t pFrame[100] = {0};
+    size_t i = 0;
+
+    ASSERT_NE(nullptr, xRing);
+    xPolicy.type = eDropOldest;
+    xPolicy.u.xDropOldestPolicyParameter.uMaxMem = 250;
+    ASSERT_EQ(0, FrameRingBuffer_setDropFramePolicy(xRing, &xPolicy));
+
+    for (i = 0; i < 4; i++)
+    {
+        ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, pFrame, sizeof(pFrame), NULL));
+    }
+
+    ASSERT_EQ(0, FrameRingBuffer_getMemoryStat(xRing, &xStat));
+    EXPECT_EQ(2, xStat.uFrameUsedCount);
+    EXPECT_EQ(200, xStat.uSumOfFrameMemory);
+    EXPECT_GT(xStat.uBufferMemory, 0);
+
+    FrameRingBuffer_terminate(xRing);
+}
+
+TEST(FrameRingBuffer, drop_oldest_gop)
+{
+    FrameRingBufferHandle xRing = FrameRingBuffer_create(8);
+    FrameRingBufferReaderHandle xReader = NULL;
+    DropFramePolicy_t xPolicy = {};
+    FrameRingBufferStat_t xStat = {0};
+    static uint8_t pFrame[100] = {0};
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    size_t i = 0;
+
+    ASSERT_NE(nullptr, xRing);
+    xPolicy.type = eDropOldestGop;
+    xPolicy.u.xDropOldestPolicyParameter.uMaxMem = 500;
+    ASSERT_EQ(0, FrameRingBuffer_setDropFramePolicy(xRing, &xPolicy));
+
+    /* Two GOPs of 3 frames, where the key frame starts each GOP. */
+    for (i = 0; i < 6; i++)
+    {
+        ASSERT_NE(nullptr, FrameRingBuffer_enqueueEx(xRing, pFrame, sizeof(pFrame), (i % 3 == 0) ? FRAME_RING_BUFFER_FLAG_KEY_FRAME : 0, NULL));
+    }
+
+    /* The 6th frame exceeds the budget, so the whole first GOP is dropped instead of its key frame only. */
+    ASSERT_EQ(0, FrameRingBuffer_getMemoryStat(xRing, &xStat));
+    EXPECT_EQ(3, xStat.uFrameUsedCount);
+    EXPECT_EQ(300, xStat.uSumOfFrameMemory);
+
+    ASSERT_NE(nullptr, xReader = FrameRingBuffer_createReader(xRing));
+    ASSERT_EQ(0, FrameRingBuffer_seekLatestKeyFrame(xReader));
+    EXPECT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+    EXPECT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+    EXPECT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+    EXPECT_NE(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+    FrameRingBuffer_terminateReader(xReader);
+
+    /* Frames without any key frame are dropped one by one. */
+    ASSERT_EQ(0, FrameRingBuffer_dequeue(xRing));
+    for (i = 0; i < 6; i++)
+    {
+        ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, pFrame, sizeof(pFrame), NULL));
+    }
+    ASSERT_EQ(0, FrameRingBuffer_getMemoryStat(xRing, &xStat));
+    EXPECT_EQ(5, xStat.uFrameUsedCount);
+
+    FrameRingBuffer_terminate(xRing);
+}
+
+TEST(FrameRingBuffer, concurrent_readers)
+{
+    const size_t uFrameCount = 10000;
+    FrameRingBufferHandle xRing = FrameRingBuffer_create(8);
+    std::vector<FrameRingBufferReaderHandle> xReaders;
+    std::vector<std::thread> xThreads;
+    std::atomic<bool> bDone(false);
+    std::atomic<int> errors(0);
+    std::vector<uint8_t> xData(uFrameCount);
+    size_t i = 0;
+
+    ASSERT_NE(nullptr, xRing);
+    for (i = 0; i < uFrameCount; i++)
+    {
+        xData[i] = (uint8_t)i;
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        xReaders.push_back(FrameRingBuffer_createReader(xRing));
+        ASSERT_NE(nullptr, xReaders.back());
+        xThreads.emplace_back([&, xReader = xReaders.back()] {
+            uint8_t *pData = NULL;
+            size_t uLen = 0;
+            uint8_t *pLast = NULL;
+            bool bWasDone = false;
+
+            /* Frames are read in order, and each frame is consistent even if some are skipped. */
+            while (true)
+            {
+                bWasDone = bDone.load();
+                if (FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL) == 0)
+                {
+                    if (uLen != 1 || pData < xData.data() || pData >= xData.data() + uFrameCount || (pLast != NULL && pData <= pLast) ||
+                        *pData != (uint8_t)(pData - xData.data()))
+                    {
+                        errors++;
+                    }
+                    pLast = pData;
+                }
+                else if (bWasDone)
+                {
+                    break;
+                }
+            }
+        });
+    }
+
+    for (i = 0; i < uFrameCount; i++)
+    {
+        ASSERT_NE(nullptr, FrameRingBuffer_enqueue(xRing, &xData[i], 1, NULL));
+    }
+    bDone = true;
+
+    for (std::thread &xThread : xThreads)
+    {
+        xThread.join();
+    }
+    EXPECT_EQ(0, errors.load());
+
+    for (FrameRingBufferReaderHandle xReader : xReaders)
+    {
+        FrameRingBuffer_terminateReader(xReader);
+    }
+    FrameRingBuffer_terminate(xRing);
+}
+
+#ifdef __linux__
+TEST(FrameRingBuffer, shared_memory_key_across_handles)
+{
+    std::string xName = "/frb-test-" + std::to_string(getpid());
+    FrameRingBufferHandle xOwner = FrameRingBuffer_createShared(xName.c_str(), 4, 64);
+    FrameRingBufferHandle xPeer = NULL;
+    FrameRingBufferReaderHandle xReader = NULL;
+    FrameKeyHandle xKey = NULL;
+    FrameKeyHandle xPeerKey = NULL;
+    FrameDestructorInfo_t xDestructor = {0};
+    int destructed = 0;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    size_t uSerialNumber = 0;
+
+    ASSERT_NE(nullptr, xOwner);
+
+    /* The second mapping is at another address, like the mapping of another process. */
+    ASSERT_NE(nullptr, xPeer = FrameRingBuffer_openShared(xName.c_str()));
+    ASSERT_NE(nullptr, xReader = FrameRingBuffer_createReader(xPeer));
+
+    ASSERT_NE(nullptr, xKey = FrameRingBuffer_enqueueEx(xOwner, pFrames[1], sizeof(pFrames[1]), FRAME_RING_BUFFER_FLAG_KEY_FRAME, NULL));
+    ASSERT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, &xPeerKey));
+    EXPECT_EQ(sizeof(pFrames[1]), uLen);
+    EXPECT_EQ(0, memcmp(pData, pFrames[1], uLen));
+
+    /* A key is passed by its serial number. */
+    ASSERT_EQ(0, FrameRingBuffer_getKeySerialNumber(xKey, &uSerialNumber));
+    EXPECT_EQ(xPeerKey, FrameRingBuffer_getKeyBySerialNumber(xPeer, uSerialNumber));
+    ASSERT_EQ(0, FrameRingBuffer_getFrame(xPeerKey, &pData, &uLen));
+    EXPECT_EQ(0, memcmp(pData, pFrames[1], uLen));
+
+    /* Frames are dropped by either side, and destructors are rejected. */
+    EXPECT_EQ(0, FrameRingBuffer_dequeue(xPeer));
+    EXPECT_NE(0, FrameRingBuffer_getFrame(xKey, &pData, &uLen));
+    xDestructor.frameDestructor = prvCountDestructor;
+    xDestructor.pAppData = &destructed;
+    EXPECT_EQ(nullptr, FrameRingBuffer_enqueue(xOwner, pFrames[2], sizeof(pFrames[2]), &xDestructor));
+
+    FrameRingBuffer_terminateReader(xReader);
+    FrameRingBuffer_terminate(xPeer);
+    FrameRingBuffer_terminate(xOwner);
+
+    /* The segment is unlinked by its creator. */
+    EXPECT_EQ(nullptr, FrameRingBuffer_openShared(xName.c_str()));
+}
+
+TEST(FrameRingBuffer, shared_memory_across_processes)
+{
+    std::string xName = "/frb-test-" + std::to_string(getpid());
+    FrameRingBufferHandle xOwner = FrameRingBuffer_createShared(xName.c_str(), 8, 256);
+    FrameRingBufferReaderHandle xReader = NULL;
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    int status = 0;
+    pid_t pid = 0;
+    size_t i = 0;
+
+    ASSERT_NE(nullptr, xOwner);
+    ASSERT_NE(nullptr, xReader = FrameRingBuffer_createReader(xOwner));
+
+    ASSERT_GE(pid = fork(), 0);
+    if (pid == 0)
+    {
+        FrameRingBufferHandle xPeer = FrameRingBuffer_openShared(xName.c_str());
+        bool bOk = (xPeer != NULL);
+
+        for (i = 0; bOk && i < 4; i++)
+        {
+            bOk = (FrameRingBuffer_enqueue(xPeer, pFrames[i], sizeof(pFrames[i]), NULL) != NULL);
+        }
+        FrameRingBuffer_terminate(xPeer);
+        _exit(bOk ? 0 : 1);
+    }
+
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+
+    for (i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+        EXPECT_EQ(0, memcmp(pData, pFrames[i], sizeof(pFrames[i])));
+    }
+    EXPECT_NE(0, FrameRingBuffer_readFrame(xReader, &pData, &uLen, NULL));
+
+    FrameRingBuffer_terminateReader(xReader);
+    FrameRingBuffer_terminate(xOwner);
+}
+#endif /* __linux__ */
@@ -0,0 +1,32 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/restapi.h"
+}
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * The input is a PUT MEDIA response body of fragment acks, like the ones in tests/corpus/fragment_ack. Acks are parsed
+ * one after another until the parser stops.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t uSize)
+{
+    std::vector<char> xBody(pData, pData + uSize);
+    ePutMediaFragmentAckEventType eAckEventType = eUnknown;
+    uint64_t uFragmentTimecode = 0;
+    unsigned int uErrorId = 0;
+    size_t uFragAckLen = 0;
+    size_t uIdx = 0;
+
+    while (uIdx < xBody.size() &&
+           Kvs_parseFragmentAck(xBody.data() + uIdx, xBody.size() - uIdx, &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen) == KVS_ERRNO_NONE)
+    {
+        uIdx += uFragAckLen;
+    }
+
+    return 0;
+}
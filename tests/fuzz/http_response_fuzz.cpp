@@ -0,0 +1,61 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "net/http_parser_adapter.h"
+}
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+static int prvOnBody(const char *pBodySlice, size_t uLen, void *pAppData)
+{
+    size_t *puBodyLen = (size_t *)pAppData;
+
+    *puBodyLen += uLen;
+
+    return 0;
+}
+
+/**
+ * The input is a HTTP response, like the ones in tests/corpus/http_response. It's parsed at once, and then again by the
+ * incremental parser in slices whose size is taken from the first byte.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t uSize)
+{
+    std::vector<char> xRsp(pData, pData + uSize);
+    unsigned int uStatusCode = 0;
+    const char *pBodyLoc = NULL;
+    size_t uBodyLen = 0;
+    HttpRspParserHandle xRspParser = NULL;
+    size_t uSliceLen = (uSize > 0) ? ((size_t)pData[0] % 64) + 1 : 1;
+    size_t uIdx = 0;
+    size_t uConsumed = 0;
+    bool bComplete = false;
+
+    if (uSize > 0)
+    {
+        HttpParser_parseHttpResponse(xRsp.data(), xRsp.size(), &uStatusCode, &pBodyLoc, &uBodyLen);
+    }
+
+    if ((xRspParser = HttpParser_createRspParser(prvOnBody, &uBodyLen)) != NULL)
+    {
+        while (uIdx < xRsp.size() && !bComplete)
+        {
+            /* Every slice is copied into a buffer of its exact size, so reads beyond it are caught. */
+            std::vector<char> xSlice(xRsp.begin() + uIdx, xRsp.begin() + uIdx + (uSliceLen < xRsp.size() - uIdx ? uSliceLen : xRsp.size() - uIdx));
+
+            if (HttpParser_executeRspParser(xRspParser, xSlice.data(), xSlice.size(), &uConsumed, &bComplete) != KVS_ERRNO_NONE || uConsumed == 0)
+            {
+                break;
+            }
+            uIdx += uConsumed;
+        }
+        HttpParser_getRspStatusCode(xRspParser);
+        HttpParser_getRspContentLength(xRspParser);
+        HttpParser_terminateRspParser(xRspParser);
+    }
+
+    return 0;
+}
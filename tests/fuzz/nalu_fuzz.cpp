@@ -0,0 +1,60 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/nalu.h"
+}
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * The first byte selects the codec and the NALU filter, and the rest is the frame. The recorded frames in
+ * res/media/h264_annexb are the corpus as they are, since they begin with the zero byte of a 4 bytes start code.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t uSize)
+{
+    NaluFrameInfo_t xInfo = {0};
+    uint32_t uAvccLen = 0;
+    uint16_t uWidth = 0;
+    uint16_t uHeight = 0;
+    bool bIsHevc = false;
+    uint64_t uFilterMask = 0;
+
+    if (uSize < 1 || uSize > UINT32_MAX / 2)
+    {
+        return 0;
+    }
+
+    bIsHevc = (pData[0] & 0x01) != 0;
+    if ((pData[0] & 0x02) != 0)
+    {
+        uFilterMask = bIsHevc ? (NALU_FILTER_BIT(NALU_TYPE_HEVC_PREFIX_SEI) | NALU_FILTER_BIT(NALU_TYPE_HEVC_AUD))
+                              : (NALU_FILTER_BIT(NALU_TYPE_SEI) | NALU_FILTER_BIT(NALU_TYPE_AUD));
+    }
+
+    /* The frame is copied into a buffer of its exact size, so reads beyond it are caught. */
+    std::vector<uint8_t> xFrame(pData + 1, pData + uSize);
+
+    if (NALU_analyzeFrame(xFrame.data(), (uint32_t)xFrame.size(), bIsHevc, &xInfo) == KVS_ERRNO_NONE)
+    {
+        if (xInfo.xSps.uLen > 0)
+        {
+            if (bIsHevc)
+            {
+                NALU_getHevcVideoResolutionFromSps(xFrame.data() + xInfo.xSps.uOffset, xInfo.xSps.uLen, &uWidth, &uHeight);
+            }
+            else
+            {
+                NALU_getH264VideoResolutionFromSps(xFrame.data() + xInfo.xSps.uOffset, xInfo.xSps.uLen, &uWidth, &uHeight);
+            }
+        }
+
+        xFrame.resize(xInfo.uAvccLen > xFrame.size() ? xInfo.uAvccLen : xFrame.size());
+        NALU_convertAnnexBToAvccWithFrameInfo(xFrame.data(), (uint32_t)xFrame.size(), &xInfo, uFilterMask, &uAvccLen);
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "net/http_helper.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+TEST(Http_addReqHeader, invalid_parameter)
+{
+    HttpReqHeaders_t xHttpReqHeaders = {};
+
+    EXPECT_NE(0, Http_addReqHeader(NULL, HDR_HOST, "example.com"));
+    EXPECT_NE(0, Http_addReqHeader(&xHttpReqHeaders, NULL, "example.com"));
+    EXPECT_NE(0, Http_addReqHeader(&xHttpReqHeaders, HDR_HOST, NULL));
+    EXPECT_EQ(0, xHttpReqHeaders.uHeadersCnt);
+}
+
+TEST(Http_addReqHeader, too_many_headers)
+{
+    HttpReqHeaders_t xHttpReqHeaders = {};
+
+    for (size_t i = 0; i < HTTP_REQ_MAX_HEADERS; i++)
+    {
+        ASSERT_EQ(0, Http_addReqHeader(&xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY));
+    }
+    EXPECT_EQ(KVS_ERROR_TOO_MANY_HTTP_HEADERS, Http_addReqHeader(&xHttpReqHeaders, HDR_ACCEPT, VAL_ACCEPT_ANY));
+}
+
+TEST(Http_findReqHeaderValue, find_by_name)
+{
+    HttpReqHeaders_t xHttpReqHeaders = {};
+
+    ASSERT_EQ(0, Http_addReqHeader(&xHttpReqHeaders, HDR_HOST, "example.com"));
+    ASSERT_EQ(0, Http_addReqHeader(&xHttpReqHeaders, HDR_USER_AGENT, VAL_USER_AGENT));
+
+    EXPECT_STREQ("example.com", Http_findReqHeaderValue(&xHttpReqHeaders, HDR_HOST));
+    EXPECT_STREQ(VAL_USER_AGENT, Http_findReqHeaderValue(&xHttpReqHeaders, HDR_USER_AGENT));
+    EXPECT_EQ(nullptr, Http_findReqHeaderValue(&xHttpReqHeaders, HDR_CONNECTION));
+    EXPECT_EQ(nullptr, Http_findReqHeaderValue(NULL, HDR_HOST));
+}
+
+TEST(Http_serializeHttpReqHead, serialize_in_one_pass)
+{
+    const char *pcExpected = "POST /describeStream HTTP/1.1\r\nhost: example.com\r\nconnection: keep-alive\r\n\r\n";
+    HttpReqHeaders_t xHttpReqHeaders = {};
+    char pBuf[128] = {0};
+    size_t uHeadLen = 0;
+
+    ASSERT_EQ(0, Http_addReqHeader(&xHttpReqHeaders, HDR_HOST, "example.com"));
+    ASSERT_EQ(0, Http_addReqHeader(&xHttpReqHeaders, HDR_CONNECTION, VAL_KEEP_ALIVE));
+
+    EXPECT_EQ(strlen(pcExpected), Http_getHttpReqHeadLen(HTTP_METHOD_POST, "/describeStream", &xHttpReqHeaders));
+
+    /* The null terminator has to fit as well. */
+    EXPECT_EQ(KVS_ERROR_HTTP_REQ_BUFFER_TOO_SMALL, Http_serializeHttpReqHead(HTTP_METHOD_POST, "/describeStream", &xHttpReqHeaders, pBuf, strlen(pcExpected), &uHeadLen));
+    EXPECT_EQ(0, uHeadLen);
+
+    ASSERT_EQ(0, Http_serializeHttpReqHead(HTTP_METHOD_POST, "/describeStream", &xHttpReqHeaders, pBuf, strlen(pcExpected) + 1, &uHeadLen));
+    EXPECT_EQ(strlen(pcExpected), uHeadLen);
+    EXPECT_STREQ(pcExpected, pBuf);
+}
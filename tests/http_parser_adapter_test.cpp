@@ -5,6 +5,7 @@ extern "C" {
 #endif
 
 #include <gtest/gtest.h>
+#include <string>
 
 TEST(HttpParser_parseHttpResponse, invalid_parameter)
 {
@@ -65,4 +66,87 @@ TEST(HttpParser_parseHttpResponse, valid_parameter_without_body)
     EXPECT_EQ(200, uStatusCode);
     EXPECT_EQ(0, uBodyLen);
     EXPECT_EQ(NULL, pBodyLoc);
-}
\ No newline at end of file
+}
+static int prvAppendBody(const char *pBodySlice, size_t uLen, void *pAppData)
+{
+    ((std::string *)pAppData)->append(pBodySlice, uLen);
+    return 0;
+}
+
+TEST(HttpParser_executeRspParser, invalid_parameter)
+{
+    HttpRspParserHandle xRspParser = HttpParser_createRspParser(NULL, NULL);
+    size_t uConsumed = 0;
+    bool bComplete = false;
+
+    ASSERT_NE(nullptr, xRspParser);
+    EXPECT_NE(0, HttpParser_executeRspParser(NULL, "HTTP", 4, &uConsumed, &bComplete));
+    EXPECT_NE(0, HttpParser_executeRspParser(xRspParser, "HTTP", 4, NULL, &bComplete));
+    EXPECT_NE(0, HttpParser_executeRspParser(xRspParser, "HTTP", 4, &uConsumed, NULL));
+
+    HttpParser_terminateRspParser(xRspParser);
+}
+
+TEST(HttpParser_executeRspParser, parse_byte_by_byte)
+{
+    std::string xHttp = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 13\r\n\r\n{\"Key\": \"1\"}\nHTTP";
+    std::string xBody;
+    HttpRspParserHandle xRspParser = HttpParser_createRspParser(prvAppendBody, &xBody);
+    size_t uConsumed = 0;
+    size_t uTotalConsumed = 0;
+    bool bComplete = false;
+
+    ASSERT_NE(nullptr, xRspParser);
+
+    for (size_t i = 0; i < xHttp.length() && !bComplete; i++)
+    {
+        ASSERT_EQ(0, HttpParser_executeRspParser(xRspParser, xHttp.c_str() + i, 1, &uConsumed, &bComplete));
+        uTotalConsumed += uConsumed;
+    }
+
+    /* The bytes after the response are not consumed. */
+    EXPECT_TRUE(bComplete);
+    EXPECT_EQ(xHttp.length() - 4, uTotalConsumed);
+    EXPECT_EQ(200, HttpParser_getRspStatusCode(xRspParser));
+    EXPECT_EQ(13, HttpParser_getRspContentLength(xRspParser));
+    EXPECT_EQ("{\"Key\": \"1\"}\n", xBody);
+
+    HttpParser_terminateRspParser(xRspParser);
+}
+
+TEST(HttpParser_executeRspParser, skip_interim_response)
+{
+    std::string xHttp = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 403 Forbidden\r\nContent-Length: 2\r\n\r\n{}";
+    std::string xBody;
+    HttpRspParserHandle xRspParser = HttpParser_createRspParser(prvAppendBody, &xBody);
+    size_t uConsumed = 0;
+    bool bComplete = false;
+
+    ASSERT_NE(nullptr, xRspParser);
+    ASSERT_EQ(0, HttpParser_executeRspParser(xRspParser, xHttp.c_str(), xHttp.length(), &uConsumed, &bComplete));
+    EXPECT_TRUE(bComplete);
+    EXPECT_EQ(xHttp.length(), uConsumed);
+    EXPECT_EQ(403, HttpParser_getRspStatusCode(xRspParser));
+    EXPECT_EQ("{}", xBody);
+
+    HttpParser_terminateRspParser(xRspParser);
+}
+
+TEST(HttpParser_executeRspParser, complete_at_headers_without_content_length)
+{
+    std::string xHeaders = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+    std::string xHttp = xHeaders + "5\r\nhello\r\n";
+    std::string xBody;
+    HttpRspParserHandle xRspParser = HttpParser_createRspParser(prvAppendBody, &xBody);
+    size_t uConsumed = 0;
+    bool bComplete = false;
+
+    ASSERT_NE(nullptr, xRspParser);
+    ASSERT_EQ(0, HttpParser_executeRspParser(xRspParser, xHttp.c_str(), xHttp.length(), &uConsumed, &bComplete));
+    EXPECT_TRUE(bComplete);
+    EXPECT_EQ(xHeaders.length(), uConsumed);
+    EXPECT_EQ(200, HttpParser_getRspStatusCode(xRspParser));
+    EXPECT_EQ("", xBody);
+
+    HttpParser_terminateRspParser(xRspParser);
+}
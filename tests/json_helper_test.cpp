@@ -0,0 +1,106 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "misc/json_helper.h"
+#include "os/allocator.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#define TEST_MAX_TOKENS (16)
+
+TEST(json_tokenize, invalid_parameter)
+{
+    JsonToken_t xTokens[TEST_MAX_TOKENS];
+    size_t uTokenCount = 0;
+
+    EXPECT_NE(0, json_tokenize(NULL, 0, xTokens, TEST_MAX_TOKENS, &uTokenCount));
+    EXPECT_NE(0, json_tokenize("{}", 2, NULL, TEST_MAX_TOKENS, &uTokenCount));
+    EXPECT_NE(0, json_tokenize("{}", 2, xTokens, TEST_MAX_TOKENS, NULL));
+}
+
+TEST(json_tokenize, slices_of_nested_object)
+{
+    const char *pcJson = "{\"a\": {\"b\": \"x\\\"y\", \"c\": [1, true]}, \"d\": -2}";
+    JsonToken_t xTokens[TEST_MAX_TOKENS];
+    size_t uTokenCount = 0;
+
+    ASSERT_EQ(0, json_tokenize(pcJson, strlen(pcJson), xTokens, TEST_MAX_TOKENS, &uTokenCount));
+    ASSERT_EQ(11, uTokenCount);
+    EXPECT_EQ(JSON_TOKEN_OBJECT, xTokens[0].xType);
+    EXPECT_EQ(strlen(pcJson), xTokens[0].uLen);
+    EXPECT_EQ(2, xTokens[0].uSize);
+    EXPECT_TRUE(json_token_equals(&xTokens[1], "a"));
+    EXPECT_EQ(1, xTokens[1].uSize);
+    EXPECT_TRUE(json_token_equals(&xTokens[4], "x\\\"y"));
+    EXPECT_EQ(JSON_TOKEN_ARRAY, xTokens[6].xType);
+    EXPECT_TRUE(json_token_equals(&xTokens[6], "[1, true]"));
+    EXPECT_EQ(2, xTokens[6].uSize);
+    EXPECT_EQ(JSON_TOKEN_PRIMITIVE, xTokens[8].xType);
+    EXPECT_TRUE(json_token_equals(&xTokens[8], "true"));
+    EXPECT_EQ(6, xTokens[8].xParent);
+    EXPECT_TRUE(json_token_equals(&xTokens[10], "-2"));
+    EXPECT_EQ(-1, xTokens[0].xParent);
+}
+
+TEST(json_tokenize, malformed)
+{
+    const char *pcJsons[] = {"{", "{\"a\":1", "{\"a\" 1}", "{\"a\":}", "[}", "{\"a\":1}}", "\"abc", "{\"a\":\"b\":1}", "{} {}"};
+    JsonToken_t xTokens[TEST_MAX_TOKENS];
+    size_t uTokenCount = 0;
+
+    for (size_t i = 0; i < sizeof(pcJsons) / sizeof(pcJsons[0]); i++)
+    {
+        EXPECT_EQ(KVS_ERROR_JSON_INVALID, json_tokenize(pcJsons[i], strlen(pcJsons[i]), xTokens, TEST_MAX_TOKENS, &uTokenCount)) << pcJsons[i];
+    }
+}
+
+TEST(json_tokenize, too_many_tokens)
+{
+    const char *pcJson = "[1, 2, 3]";
+    JsonToken_t xTokens[3];
+    size_t uTokenCount = 0;
+
+    EXPECT_EQ(KVS_ERROR_JSON_TOO_MANY_TOKENS, json_tokenize(pcJson, strlen(pcJson), xTokens, 3, &uTokenCount));
+}
+
+TEST(json_token_dotget, find_nested_value)
+{
+    const char *pcJson = "{\"skip\": {\"accessKeyId\": \"no\"}, \"credentials\": {\"list\": [{}, 2], \"accessKeyId\": \"AKID\", \"n\": \"42\"}}";
+    JsonToken_t xTokens[TEST_MAX_TOKENS];
+    size_t uTokenCount = 0;
+    const JsonToken_t *pxValue = NULL;
+
+    ASSERT_EQ(0, json_tokenize(pcJson, strlen(pcJson), xTokens, TEST_MAX_TOKENS, &uTokenCount));
+
+    pxValue = json_token_dotget(xTokens, uTokenCount, "credentials.accessKeyId");
+    ASSERT_NE(nullptr, pxValue);
+    EXPECT_TRUE(json_token_equals(pxValue, "AKID"));
+    EXPECT_EQ(42, json_token_to_uint64(json_token_dotget(xTokens, uTokenCount, "credentials.n")));
+
+    EXPECT_EQ(nullptr, json_token_dotget(xTokens, uTokenCount, "accessKeyId"));
+    EXPECT_EQ(nullptr, json_token_dotget(xTokens, uTokenCount, "credentials.accessKeyId.x"));
+    EXPECT_EQ(nullptr, json_token_dotget(xTokens, uTokenCount, "credentials.missing"));
+}
+
+TEST(json_token_strdup, unescape)
+{
+    const char *pcJson = "[\"a\\/b\\\"c\\\\d\\u0041\\n\", \"\\u00e9\"]";
+    JsonToken_t xTokens[TEST_MAX_TOKENS];
+    size_t uTokenCount = 0;
+    char *pcValue = NULL;
+
+    ASSERT_EQ(0, json_tokenize(pcJson, strlen(pcJson), xTokens, TEST_MAX_TOKENS, &uTokenCount));
+    ASSERT_EQ(3, uTokenCount);
+
+    pcValue = json_token_strdup(&xTokens[1]);
+    ASSERT_NE(nullptr, pcValue);
+    EXPECT_STREQ("a/b\"c\\dA\n", pcValue);
+    kvsFree(pcValue);
+
+    /* Only ASCII is accepted. */
+    EXPECT_EQ(nullptr, json_token_strdup(&xTokens[2]));
+    EXPECT_EQ(nullptr, json_token_strdup(&xTokens[0]));
+}
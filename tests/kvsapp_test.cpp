@@ -0,0 +1,183 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/kvsapp.h"
+#include "kvs/kvsapp_options.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define TEST_HOST "kinesisvideo.us-east-1.amazonaws.com"
+
+/* SPS and PPS of a 1920x1080 H.264 high profile stream. They're only parsed to build the video track info. */
+static const uint8_t gSps[] = {0x67, 0x64, 0x00, 0x28, 0xAC, 0xB2, 0x00, 0xF0, 0x04, 0x4F, 0xCB, 0x80, 0xB5, 0x01,
+                               0x01, 0x01, 0x40, 0x00, 0x00, 0xFA, 0x40, 0x00, 0x3A, 0x98, 0x23, 0xC6, 0x0C, 0x92};
+static const uint8_t gPps[] = {0x68, 0xEB, 0xCC, 0xB2, 0x2C};
+
+/* AudioSpecificConfig of AAC LC, 48 kHz, mono. */
+static uint8_t gAacCodecPrivate[] = {0x11, 0x88};
+
+typedef struct FrameCounter
+{
+    std::atomic<size_t> uTerminated{0};
+} FrameCounter_t;
+
+static int prvOnFrameTerminate(uint8_t *pData, size_t uDataLen, uint64_t uTimestamp, TrackType_t xTrackType, void *pAppData)
+{
+    free(pData);
+    ((FrameCounter_t *)pAppData)->uTerminated++;
+
+    return 0;
+}
+
+static void prvAppendNalu(std::vector<uint8_t> &xFrame, const uint8_t *pNalu, size_t uLen)
+{
+    static const uint8_t pStartCode[] = {0x00, 0x00, 0x00, 0x01};
+
+    xFrame.insert(xFrame.end(), pStartCode, pStartCode + sizeof(pStartCode));
+    xFrame.insert(xFrame.end(), pNalu, pNalu + uLen);
+}
+
+static std::vector<uint8_t> prvVideoFrame(bool bIsKeyFrame)
+{
+    std::vector<uint8_t> xFrame;
+    std::vector<uint8_t> xSlice(200, 0xAA);
+
+    if (bIsKeyFrame)
+    {
+        prvAppendNalu(xFrame, gSps, sizeof(gSps));
+        prvAppendNalu(xFrame, gPps, sizeof(gPps));
+    }
+    xSlice[0] = bIsKeyFrame ? 0x65 : 0x41;
+    prvAppendNalu(xFrame, xSlice.data(), xSlice.size());
+
+    return xFrame;
+}
+
+static int prvAddFrame(KvsAppHandle kvsAppHandle, const std::vector<uint8_t> &xFrame, uint64_t uTimestamp, TrackType_t xTrackType, FrameCounter_t *pxCounter)
+{
+    DataFrameCallbacks_t xCallbacks = {0};
+    uint8_t *pData = (uint8_t *)malloc(xFrame.size());
+
+    memcpy(pData, xFrame.data(), xFrame.size());
+    xCallbacks.onDataFrameTerminateInfo.onDataFrameTerminate = prvOnFrameTerminate;
+    xCallbacks.onDataFrameTerminateInfo.pAppData = pxCounter;
+
+    return KvsApp_addFrameWithCallbacks(kvsAppHandle, pData, xFrame.size(), xFrame.size(), uTimestamp, xTrackType, &xCallbacks);
+}
+
+/* Video frames flush the lace while audio frames are appended to it, like the samples that add them in two threads. */
+static size_t prvAddFramesFromTwoThreads(KvsAppHandle kvsAppHandle, size_t uVideoFrameCount, size_t uAudioFrameCount, FrameCounter_t *pxVideoCounter, FrameCounter_t *pxAudioCounter)
+{
+    std::atomic<size_t> uFailed{0};
+
+    std::thread xVideoThread([&]() {
+        std::vector<uint8_t> xKeyFrame = prvVideoFrame(true);
+        std::vector<uint8_t> xDeltaFrame = prvVideoFrame(false);
+
+        for (size_t i = 1; i < uVideoFrameCount; i++)
+        {
+            if (prvAddFrame(kvsAppHandle, (i % 30 == 0) ? xKeyFrame : xDeltaFrame, 1000 + i * 33, TRACK_VIDEO, pxVideoCounter) != 0)
+            {
+                uFailed++;
+            }
+        }
+    });
+    std::thread xAudioThread([&]() {
+        std::vector<uint8_t> xAudioFrame(160, 0x5A);
+
+        for (size_t i = 0; i < uAudioFrameCount; i++)
+        {
+            xAudioFrame[0] = (uint8_t)i;
+            if (prvAddFrame(kvsAppHandle, xAudioFrame, 1000 + i * 20, TRACK_AUDIO, pxAudioCounter) != 0)
+            {
+                uFailed++;
+            }
+        }
+    });
+    xVideoThread.join();
+    xAudioThread.join();
+
+    return uFailed.load();
+}
+
+static KvsAppHandle prvCreateWithAudioLace(unsigned int uLaceDurationMs)
+{
+    KvsAppHandle kvsAppHandle = KvsApp_create(TEST_HOST, "us-east-1", "kinesisvideo", "kvsapp-test");
+    AudioTrackInfo_t xAudioTrackInfo = {0};
+
+    xAudioTrackInfo.pTrackName = (char *)"kvs audio track";
+    xAudioTrackInfo.pCodecName = (char *)"A_AAC";
+    xAudioTrackInfo.uFrequency = 48000;
+    xAudioTrackInfo.uChannelNumber = 1;
+    xAudioTrackInfo.pCodecPrivate = gAacCodecPrivate;
+    xAudioTrackInfo.uCodecPrivateLen = sizeof(gAacCodecPrivate);
+
+    if (kvsAppHandle != NULL &&
+        (KvsApp_setoption(kvsAppHandle, OPTION_KVS_AUDIO_TRACK_INFO, (const char *)&xAudioTrackInfo) != 0 ||
+         KvsApp_setoption(kvsAppHandle, OPTION_STREAM_AUDIO_LACE_DURATION_MS, (const char *)&uLaceDurationMs) != 0))
+    {
+        KvsApp_terminate(kvsAppHandle);
+        kvsAppHandle = NULL;
+    }
+
+    return kvsAppHandle;
+}
+
+TEST(KvsApp_addFrame, audio_lace_with_video_from_another_thread)
+{
+    const size_t uVideoFrameCount = 300;
+    const size_t uAudioFrameCount = 500;
+    KvsAppHandle kvsAppHandle = prvCreateWithAudioLace(100);
+    FrameCounter_t xVideoCounter;
+    FrameCounter_t xAudioCounter;
+    KvsAppStreamStats_t xStats = {0};
+
+    ASSERT_NE(nullptr, kvsAppHandle);
+
+    /* The stream is built on the first keyframe, so audio frames aren't rejected before it. */
+    ASSERT_EQ(0, prvAddFrame(kvsAppHandle, prvVideoFrame(true), 1000, TRACK_VIDEO, &xVideoCounter));
+    EXPECT_EQ(0, prvAddFramesFromTwoThreads(kvsAppHandle, uVideoFrameCount, uAudioFrameCount, &xVideoCounter, &xAudioCounter));
+
+    ASSERT_EQ(0, KvsApp_getStreamStats(kvsAppHandle, &xStats));
+    EXPECT_EQ(uVideoFrameCount, xStats.xStreamStats.uVideoFrameCount);
+    EXPECT_GT(xStats.xStreamStats.uAudioFrameCount, 0);
+    EXPECT_LT(xStats.xStreamStats.uAudioFrameCount, uAudioFrameCount / 2);
+
+    /* Laced audio frames are terminated once they're copied, and the rest when the stream is terminated. */
+    EXPECT_EQ(uAudioFrameCount, xAudioCounter.uTerminated.load());
+    KvsApp_terminate(kvsAppHandle);
+    EXPECT_EQ(uVideoFrameCount, xVideoCounter.uTerminated.load());
+}
+
+TEST(KvsApp_addFrame, audio_lace_clusters_with_video_from_another_thread)
+{
+    const size_t uVideoFrameCount = 300;
+    const size_t uAudioFrameCount = 500;
+    const unsigned int uAudioMaxLatencyMs = 500;
+    KvsAppHandle kvsAppHandle = prvCreateWithAudioLace(100);
+    FrameCounter_t xVideoCounter;
+    FrameCounter_t xAudioCounter;
+    KvsAppStreamStats_t xStats = {0};
+
+    ASSERT_NE(nullptr, kvsAppHandle);
+
+    /* Audio laces may start clusters of their own, so they check the last cluster that video frames start. */
+    ASSERT_EQ(0, KvsApp_setoption(kvsAppHandle, OPTION_STREAM_AUDIO_MAX_LATENCY_MS, (const char *)&uAudioMaxLatencyMs));
+    ASSERT_EQ(0, prvAddFrame(kvsAppHandle, prvVideoFrame(true), 1000, TRACK_VIDEO, &xVideoCounter));
+    EXPECT_EQ(0, prvAddFramesFromTwoThreads(kvsAppHandle, uVideoFrameCount, uAudioFrameCount, &xVideoCounter, &xAudioCounter));
+
+    ASSERT_EQ(0, KvsApp_getStreamStats(kvsAppHandle, &xStats));
+    EXPECT_EQ(uVideoFrameCount, xStats.xStreamStats.uVideoFrameCount);
+    EXPECT_GT(xStats.xStreamStats.uAudioFrameCount, 0);
+
+    EXPECT_EQ(uAudioFrameCount, xAudioCounter.uTerminated.load());
+    KvsApp_terminate(kvsAppHandle);
+    EXPECT_EQ(uVideoFrameCount, xVideoCounter.uTerminated.load());
+}
@@ -0,0 +1,126 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "stream/latency_tracker.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+
+TEST(Kvs_latencyTrackerGetSummary, invalid_parameter)
+{
+    LatencyTrackerHandle xLatencyTrackerHandle = Kvs_latencyTrackerCreate();
+    LatencySummary_t xSummary = {};
+
+    ASSERT_NE(nullptr, xLatencyTrackerHandle);
+    EXPECT_NE(0, Kvs_latencyTrackerGetSummary(NULL, LATENCY_STAGE_SENT, &xSummary));
+    EXPECT_NE(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_MAX, &xSummary));
+    EXPECT_NE(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_SENT, NULL));
+
+    ASSERT_EQ(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_PERSISTED, &xSummary));
+    EXPECT_EQ(0, xSummary.uCount);
+    EXPECT_EQ(0, xSummary.uMaxMs);
+
+    Kvs_latencyTrackerTerminate(xLatencyTrackerHandle);
+}
+
+TEST(Kvs_latencyTrackerMark, match_acks_by_timecode)
+{
+    LatencyTrackerHandle xLatencyTrackerHandle = Kvs_latencyTrackerCreate();
+    LatencySummary_t xSummary = {};
+
+    ASSERT_NE(nullptr, xLatencyTrackerHandle);
+
+    Kvs_latencyTrackerAddCluster(xLatencyTrackerHandle, 1000, 10000);
+    Kvs_latencyTrackerAddCluster(xLatencyTrackerHandle, 3000, 12000);
+
+    /* Frames of the 1st cluster are sent, then the 2nd cluster starts and completes the 1st one. */
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 1000, LATENCY_STAGE_SENT, 10010);
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 1000, LATENCY_STAGE_SENT, 11950);
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 3000, LATENCY_STAGE_SENT, 12010);
+
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 1000, LATENCY_STAGE_BUFFERING, 10100);
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 1000, LATENCY_STAGE_RECEIVED, 12100);
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 1000, LATENCY_STAGE_PERSISTED, 12500);
+
+    /* Duplicated and unknown acks are ignored. */
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 1000, LATENCY_STAGE_PERSISTED, 13000);
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 2000, LATENCY_STAGE_BUFFERING, 13000);
+
+    /* The 2nd cluster is sent completely once its fragment is received. */
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 3000, LATENCY_STAGE_SENT, 13900);
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 3000, LATENCY_STAGE_RECEIVED, 14000);
+
+    ASSERT_EQ(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_SENT, &xSummary));
+    EXPECT_EQ(2, xSummary.uCount);
+    EXPECT_EQ(1950, xSummary.uMaxMs);
+
+    ASSERT_EQ(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_BUFFERING, &xSummary));
+    EXPECT_EQ(1, xSummary.uCount);
+    EXPECT_EQ(100, xSummary.uP50Ms);
+
+    ASSERT_EQ(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_RECEIVED, &xSummary));
+    EXPECT_EQ(2, xSummary.uCount);
+    EXPECT_EQ(2100, xSummary.uMaxMs);
+
+    ASSERT_EQ(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_PERSISTED, &xSummary));
+    EXPECT_EQ(1, xSummary.uCount);
+    EXPECT_EQ(2500, xSummary.uP95Ms);
+
+    Kvs_latencyTrackerTerminate(xLatencyTrackerHandle);
+}
+
+TEST(Kvs_latencyTrackerGetSummary, percentiles_of_window)
+{
+    LatencyTrackerHandle xLatencyTrackerHandle = Kvs_latencyTrackerCreate();
+    LatencySummary_t xSummary = {};
+    uint64_t uTimecodeMs = 0;
+
+    ASSERT_NE(nullptr, xLatencyTrackerHandle);
+
+    /* Latencies are 1 to 100 ms in reverse order, and only the latest ones are in the window. */
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        uTimecodeMs = 1000 * i;
+        Kvs_latencyTrackerAddCluster(xLatencyTrackerHandle, uTimecodeMs, uTimecodeMs);
+        Kvs_latencyTrackerMark(xLatencyTrackerHandle, uTimecodeMs, LATENCY_STAGE_PERSISTED, uTimecodeMs + 100 - i);
+    }
+
+    ASSERT_EQ(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_PERSISTED, &xSummary));
+    EXPECT_EQ(100, xSummary.uCount);
+    EXPECT_EQ(100, xSummary.uMaxMs);
+    if (LATENCY_TRACKER_WINDOW_SIZE == 64)
+    {
+        EXPECT_EQ(32, xSummary.uP50Ms);
+        EXPECT_EQ(61, xSummary.uP95Ms);
+    }
+
+    Kvs_latencyTrackerReset(xLatencyTrackerHandle);
+    ASSERT_EQ(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_PERSISTED, &xSummary));
+    EXPECT_EQ(0, xSummary.uCount);
+    EXPECT_EQ(0, xSummary.uP50Ms);
+    EXPECT_EQ(0, xSummary.uMaxMs);
+
+    Kvs_latencyTrackerTerminate(xLatencyTrackerHandle);
+}
+
+TEST(Kvs_latencyTrackerAddCluster, oldest_cluster_is_dropped)
+{
+    LatencyTrackerHandle xLatencyTrackerHandle = Kvs_latencyTrackerCreate();
+    LatencySummary_t xSummary = {};
+
+    ASSERT_NE(nullptr, xLatencyTrackerHandle);
+
+    for (uint64_t i = 0; i <= LATENCY_TRACKER_MAX_CLUSTERS; i++)
+    {
+        Kvs_latencyTrackerAddCluster(xLatencyTrackerHandle, i, 0);
+    }
+
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 0, LATENCY_STAGE_BUFFERING, 10);
+    Kvs_latencyTrackerMark(xLatencyTrackerHandle, 1, LATENCY_STAGE_BUFFERING, 10);
+
+    ASSERT_EQ(0, Kvs_latencyTrackerGetSummary(xLatencyTrackerHandle, LATENCY_STAGE_BUFFERING, &xSummary));
+    EXPECT_EQ(1, xSummary.uCount);
+
+    Kvs_latencyTrackerTerminate(xLatencyTrackerHandle);
+}
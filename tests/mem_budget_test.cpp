@@ -0,0 +1,81 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/kvs_config.h"
+#include "kvs/mem_budget.h"
+#include "os/allocator.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+
+#if KVS_CONFIG_MEM_BUDGET
+
+TEST(kvsMemBudgetSet, invalid_parameter)
+{
+    EXPECT_NE(KVS_ERRNO_NONE, kvsMemBudgetSet(1024, 1024));
+    EXPECT_NE(KVS_ERRNO_NONE, kvsMemBudgetSet(1024, 2048));
+    EXPECT_NE(KVS_ERRNO_NONE, kvsMemBudgetGetStats(NULL));
+    EXPECT_EQ(KVS_ERRNO_NONE, kvsMemBudgetSet(0, 0));
+}
+
+TEST(kvsMemBudgetChargeMedia, keep_reserve_for_allocations)
+{
+    KvsMemBudgetStats_t xBefore = {0};
+    KvsMemBudgetStats_t xAfter = {0};
+    void *ptr = NULL;
+
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsMemBudgetGetStats(&xBefore));
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsMemBudgetSet(xBefore.uUsedBytes + 4096, 1024));
+
+    /* Media can't use the reserve. */
+    EXPECT_TRUE(kvsMemBudgetChargeMedia(2048));
+    EXPECT_FALSE(kvsMemBudgetChargeMedia(2048));
+    EXPECT_TRUE(kvsMemBudgetChargeMedia(1024));
+
+    /* Other allocations can. */
+    ptr = kvsMalloc(512);
+    EXPECT_NE(nullptr, ptr);
+    EXPECT_EQ(nullptr, kvsMalloc(1024));
+    EXPECT_EQ(nullptr, kvsRealloc(ptr, 2048));
+
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsMemBudgetGetStats(&xAfter));
+    EXPECT_EQ(xBefore.uMediaBytes + 3072, xAfter.uMediaBytes);
+    EXPECT_EQ(xBefore.uUsedBytes + 3584, xAfter.uUsedBytes);
+    EXPECT_EQ(xBefore.uMediaRejects + 1, xAfter.uMediaRejects);
+    EXPECT_EQ(xBefore.uAllocRejects + 2, xAfter.uAllocRejects);
+    EXPECT_LE(xAfter.uUsedBytes, xAfter.uPeakUsedBytes);
+
+    /* A block can always shrink. */
+    ptr = kvsRealloc(ptr, 256);
+    EXPECT_NE(nullptr, ptr);
+
+    kvsMemBudgetReleaseMedia(3072);
+    kvsFree(ptr);
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsMemBudgetGetStats(&xAfter));
+    EXPECT_EQ(xBefore.uUsedBytes, xAfter.uUsedBytes);
+    EXPECT_EQ(xBefore.uMediaBytes, xAfter.uMediaBytes);
+
+    EXPECT_EQ(KVS_ERRNO_NONE, kvsMemBudgetSet(0, 0));
+}
+
+TEST(kvsMemBudgetChargeMedia, unlimited)
+{
+    EXPECT_EQ(KVS_ERRNO_NONE, kvsMemBudgetSet(0, 0));
+    EXPECT_TRUE(kvsMemBudgetChargeMedia(1024 * 1024));
+    kvsMemBudgetReleaseMedia(1024 * 1024);
+}
+
+#else
+
+TEST(kvsMemBudgetSet, not_enabled)
+{
+    KvsMemBudgetStats_t xStats = {0};
+
+    EXPECT_EQ(KVS_ERROR_FEATURE_NOT_ENABLED, kvsMemBudgetSet(4096, 1024));
+    EXPECT_EQ(KVS_ERROR_FEATURE_NOT_ENABLED, kvsMemBudgetGetStats(&xStats));
+    EXPECT_TRUE(kvsMemBudgetChargeMedia(1024 * 1024));
+    kvsMemBudgetReleaseMedia(1024 * 1024);
+}
+
+#endif /* KVS_CONFIG_MEM_BUDGET */
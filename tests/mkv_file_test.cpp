@@ -0,0 +1,168 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "stream/mkv_file.h"
+#include "stream/recorder.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#define TEST_MKV_FILE_PREFIX "/tmp/kvs_mkv_file_test_"
+
+/* EBML header, a segment of unknown size, and an empty segment info */
+static const std::string gMkvEbmlSegHdr("\x1A\x45\xDF\xA3\x80\x18\x53\x80\x67\xFF\x15\x49\xA9\x66\x80", 15);
+
+/* Clusters of unknown size with an 8 bytes timecode and a position, like the ones of the MKV generator */
+static std::string prvClusterHdr(uint64_t uTimecodeMs)
+{
+    std::string xHdr("\x1F\x43\xB6\x75\xFF\xE7\x88", 7);
+
+    for (int i = 7; i >= 0; i--)
+    {
+        xHdr.push_back((char)((uTimecodeMs >> (i * 8)) & 0xFF));
+    }
+    xHdr.append("\xA7\x81\x00", 3);
+
+    return xHdr;
+}
+
+static std::string prvSimpleBlock(const std::string &xData)
+{
+    return std::string(1, '\xA3') + (char)(0x80 | xData.size()) + xData;
+}
+
+static std::string prvWriteFile(const std::string &xContent)
+{
+    std::string xFilename = TEST_MKV_FILE_PREFIX "raw.mkv";
+    FILE *fp = fopen(xFilename.c_str(), "wb");
+
+    if (fp != NULL)
+    {
+        fwrite(xContent.data(), 1, xContent.size(), fp);
+        fclose(fp);
+    }
+
+    return xFilename;
+}
+
+static std::string prvReadAll(MkvFileHandle xMkvFile, size_t uMaxLen)
+{
+    std::string xOut;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+
+    while (Kvs_mkvFileRead(xMkvFile, uMaxLen, &pData, &uDataLen) == KVS_ERRNO_NONE)
+    {
+        EXPECT_LE(uDataLen, uMaxLen);
+        xOut.append((const char *)pData, uDataLen);
+    }
+
+    return xOut;
+}
+
+TEST(Kvs_mkvFileOpen, invalid_parameter)
+{
+    std::string xFilename;
+
+    EXPECT_EQ(nullptr, Kvs_mkvFileOpen(NULL));
+    EXPECT_EQ(nullptr, Kvs_mkvFileOpen(TEST_MKV_FILE_PREFIX "missing.mkv"));
+
+    /* There is no segment. */
+    xFilename = prvWriteFile(std::string("\x1A\x45\xDF\xA3\x80", 5));
+    EXPECT_EQ(nullptr, Kvs_mkvFileOpen(xFilename.c_str()));
+    remove(xFilename.c_str());
+
+    EXPECT_NE(0, Kvs_mkvFileRead(NULL, 1, NULL, NULL));
+    EXPECT_NE(0, Kvs_mkvFileSeek(NULL, 0));
+}
+
+TEST(Kvs_mkvFileRead, recorder_file_without_cues)
+{
+    RecorderHandle xRecorderHandle = Kvs_recorderCreate(TEST_MKV_FILE_PREFIX, 60 * 1000, 4096);
+    std::string xFilename = TEST_MKV_FILE_PREFIX + std::to_string(1000) + ".mkv";
+    std::string xCluster1 = prvClusterHdr(1000) + prvSimpleBlock("AAAA");
+    std::string xCluster2 = prvClusterHdr(3000) + prvSimpleBlock("BB");
+    std::string xCluster3 = prvClusterHdr(5000) + prvSimpleBlock("CCC");
+    std::string xBlock = prvSimpleBlock("DDDDD");
+    MkvFileHandle xMkvFile = NULL;
+    uint8_t *pHdr = NULL;
+    size_t uHdrLen = 0;
+    uint64_t uFirstTimecodeMs = 0;
+    uint64_t uLastTimecodeMs = 0;
+
+    ASSERT_NE(nullptr, xRecorderHandle);
+    ASSERT_EQ(0, Kvs_recorderSetMkvEbmlSegHdr(xRecorderHandle, (const uint8_t *)gMkvEbmlSegHdr.data(), gMkvEbmlSegHdr.size()));
+    EXPECT_EQ(0, Kvs_recorderWriteDataFrame(xRecorderHandle, 1000, true, (const uint8_t *)xCluster1.data(), xCluster1.size() - 4, (const uint8_t *)"AAAA", 4));
+    EXPECT_EQ(0, Kvs_recorderWriteDataFrame(xRecorderHandle, 1500, false, (const uint8_t *)xBlock.data(), 2, (const uint8_t *)"DDDDD", 5));
+    EXPECT_EQ(0, Kvs_recorderWriteDataFrame(xRecorderHandle, 3000, true, (const uint8_t *)xCluster2.data(), xCluster2.size(), NULL, 0));
+    EXPECT_EQ(0, Kvs_recorderWriteDataFrame(xRecorderHandle, 5000, true, (const uint8_t *)xCluster3.data(), xCluster3.size(), NULL, 0));
+    Kvs_recorderTerminate(xRecorderHandle);
+
+    xMkvFile = Kvs_mkvFileOpen(xFilename.c_str());
+    ASSERT_NE(nullptr, xMkvFile);
+
+    ASSERT_EQ(0, Kvs_mkvFileGetEbmlSegHdr(xMkvFile, &pHdr, &uHdrLen));
+    EXPECT_EQ(gMkvEbmlSegHdr, std::string((const char *)pHdr, uHdrLen));
+    ASSERT_EQ(0, Kvs_mkvFileGetTimecodeRange(xMkvFile, &uFirstTimecodeMs, &uLastTimecodeMs));
+    EXPECT_EQ(1000, uFirstTimecodeMs);
+    EXPECT_EQ(5000, uLastTimecodeMs);
+
+    /* The Cues at the end are not read. */
+    EXPECT_EQ(0, Kvs_mkvFileSeek(xMkvFile, 0));
+    EXPECT_EQ(xCluster1 + xBlock + xCluster2 + xCluster3, prvReadAll(xMkvFile, 64 * 1024));
+    EXPECT_EQ(0, Kvs_mkvFileSeek(xMkvFile, 0));
+    EXPECT_EQ(xCluster1 + xBlock + xCluster2 + xCluster3, prvReadAll(xMkvFile, 7));
+
+    /* Clusters that are persisted are skipped. */
+    EXPECT_EQ(0, Kvs_mkvFileSeek(xMkvFile, 1000));
+    EXPECT_EQ(xCluster2 + xCluster3, prvReadAll(xMkvFile, 64 * 1024));
+    EXPECT_EQ(0, Kvs_mkvFileSeek(xMkvFile, 5000));
+    EXPECT_EQ("", prvReadAll(xMkvFile, 64 * 1024));
+
+    Kvs_mkvFileClose(xMkvFile);
+    remove(xFilename.c_str());
+}
+
+TEST(Kvs_mkvFileRead, file_cut_short)
+{
+    std::string xCluster1 = prvClusterHdr(1000) + prvSimpleBlock("AAAA");
+    std::string xCluster2 = prvClusterHdr(3000) + prvSimpleBlock("BB");
+    std::string xBrokenBlock = prvSimpleBlock("CCCCCC").substr(0, 5);
+    std::string xFilename = prvWriteFile(gMkvEbmlSegHdr + xCluster1 + xCluster2 + xBrokenBlock);
+    MkvFileHandle xMkvFile = Kvs_mkvFileOpen(xFilename.c_str());
+    uint64_t uFirstTimecodeMs = 0;
+    uint64_t uLastTimecodeMs = 0;
+
+    ASSERT_NE(nullptr, xMkvFile);
+    ASSERT_EQ(0, Kvs_mkvFileGetTimecodeRange(xMkvFile, &uFirstTimecodeMs, &uLastTimecodeMs));
+    EXPECT_EQ(1000, uFirstTimecodeMs);
+    EXPECT_EQ(3000, uLastTimecodeMs);
+
+    /* The last cluster ends at its last complete block. */
+    EXPECT_EQ(xCluster1 + xCluster2, prvReadAll(xMkvFile, 64 * 1024));
+
+    Kvs_mkvFileClose(xMkvFile);
+    remove(xFilename.c_str());
+}
+
+TEST(Kvs_mkvFileRead, no_cluster)
+{
+    std::string xFilename = prvWriteFile(gMkvEbmlSegHdr + prvClusterHdr(1000).substr(0, 10));
+    MkvFileHandle xMkvFile = Kvs_mkvFileOpen(xFilename.c_str());
+    uint8_t *pHdr = NULL;
+    size_t uHdrLen = 0;
+    uint64_t uFirstTimecodeMs = 0;
+    uint64_t uLastTimecodeMs = 0;
+
+    ASSERT_NE(nullptr, xMkvFile);
+    EXPECT_EQ(KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME, Kvs_mkvFileGetEbmlSegHdr(xMkvFile, &pHdr, &uHdrLen));
+    EXPECT_EQ(KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME, Kvs_mkvFileGetTimecodeRange(xMkvFile, &uFirstTimecodeMs, &uLastTimecodeMs));
+    EXPECT_EQ("", prvReadAll(xMkvFile, 64 * 1024));
+
+    Kvs_mkvFileClose(xMkvFile);
+    remove(xFilename.c_str());
+}
@@ -0,0 +1,160 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/mkv_generator.h"
+#include "os/allocator.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+TEST(Mkv_getLaceHdrLen, invalid_parameter)
+{
+    size_t puFrameSizes[] = {160, 160, 170};
+
+    EXPECT_EQ(0, Mkv_getLaceHdrLen(MKV_LACING_EBML, NULL, 3));
+    EXPECT_EQ(0, Mkv_getLaceHdrLen(MKV_LACING_EBML, puFrameSizes, 0));
+    EXPECT_EQ(0, Mkv_getLaceHdrLen(MKV_LACING_EBML, puFrameSizes, MKV_LACE_MAX_FRAME_COUNT + 1));
+    EXPECT_EQ(0, Mkv_getLaceHdrLen(MKV_LACING_NONE, puFrameSizes, 3));
+
+    /* Fixed-size lacing needs frames of the same size. */
+    EXPECT_EQ(0, Mkv_getLaceHdrLen(MKV_LACING_FIXED_SIZE, puFrameSizes, 3));
+    EXPECT_EQ(1, Mkv_getLaceHdrLen(MKV_LACING_FIXED_SIZE, puFrameSizes, 2));
+}
+
+TEST(Mkv_initializeLaceHdr, fixed_size_lacing)
+{
+    size_t puFrameSizes[] = {160, 160, 160, 160, 160};
+    uint8_t pLaceHdr[8] = {0};
+
+    EXPECT_EQ(KVS_ERROR_MKV_INVALID_LACING, Mkv_initializeLaceHdr(pLaceHdr, sizeof(pLaceHdr), MKV_LACING_FIXED_SIZE, puFrameSizes, 0));
+    ASSERT_EQ(KVS_ERRNO_NONE, Mkv_initializeLaceHdr(pLaceHdr, 1, MKV_LACING_FIXED_SIZE, puFrameSizes, 5));
+    EXPECT_EQ(4, pLaceHdr[0]);
+}
+
+TEST(Mkv_initializeLaceHdr, ebml_lacing)
+{
+    /* Example of EBML lacing in the Matroska specification */
+    size_t puFrameSizes[] = {800, 500, 1000};
+    uint8_t pExpected[] = {0x02, 0x43, 0x20, 0x5E, 0xD3};
+    uint8_t pLaceHdr[16] = {0};
+
+    ASSERT_EQ(sizeof(pExpected), Mkv_getLaceHdrLen(MKV_LACING_EBML, puFrameSizes, 3));
+    EXPECT_NE(KVS_ERRNO_NONE, Mkv_initializeLaceHdr(pLaceHdr, sizeof(pExpected) - 1, MKV_LACING_EBML, puFrameSizes, 3));
+    ASSERT_EQ(KVS_ERRNO_NONE, Mkv_initializeLaceHdr(pLaceHdr, sizeof(pLaceHdr), MKV_LACING_EBML, puFrameSizes, 3));
+    EXPECT_EQ(0, memcmp(pExpected, pLaceHdr, sizeof(pExpected)));
+
+    /* The size of the only frame is implied by the block size. */
+    ASSERT_EQ(1, Mkv_getLaceHdrLen(MKV_LACING_EBML, puFrameSizes, 1));
+
+    /* Values with all bits set are reserved, so 127 takes 2 bytes, and so does a difference of -64. */
+    size_t puEdgeSizes[] = {127, 63, 1};
+    uint8_t pEdgeExpected[] = {0x02, 0x40, 0x7F, 0x5F, 0xBF};
+    ASSERT_EQ(sizeof(pEdgeExpected), Mkv_getLaceHdrLen(MKV_LACING_EBML, puEdgeSizes, 3));
+    ASSERT_EQ(KVS_ERRNO_NONE, Mkv_initializeLaceHdr(pLaceHdr, sizeof(pLaceHdr), MKV_LACING_EBML, puEdgeSizes, 3));
+    EXPECT_EQ(0, memcmp(pEdgeExpected, pLaceHdr, sizeof(pEdgeExpected)));
+}
+
+TEST(Mkv_setSimpleBlockLacing, lacing_bits)
+{
+    uint8_t pMkvHdr[64] = {0};
+    size_t uMkvHdrLen = Mkv_getClusterHdrLen(MKV_SIMPLE_BLOCK);
+
+    ASSERT_TRUE(uMkvHdrLen <= sizeof(pMkvHdr));
+    ASSERT_EQ(KVS_ERRNO_NONE, Mkv_initializeClusterHdr(pMkvHdr, sizeof(pMkvHdr), MKV_SIMPLE_BLOCK, 100, TRACK_AUDIO, false, 1000, 20));
+
+    EXPECT_NE(KVS_ERRNO_NONE, Mkv_setSimpleBlockLacing(pMkvHdr, uMkvHdrLen - 1, MKV_SIMPLE_BLOCK, MKV_LACING_EBML));
+    ASSERT_EQ(KVS_ERRNO_NONE, Mkv_setSimpleBlockLacing(pMkvHdr, uMkvHdrLen, MKV_SIMPLE_BLOCK, MKV_LACING_EBML));
+    EXPECT_EQ(0x06, pMkvHdr[uMkvHdrLen - 1]);
+    ASSERT_EQ(KVS_ERRNO_NONE, Mkv_setSimpleBlockLacing(pMkvHdr, uMkvHdrLen, MKV_SIMPLE_BLOCK, MKV_LACING_FIXED_SIZE));
+    EXPECT_EQ(0x04, pMkvHdr[uMkvHdrLen - 1]);
+
+    /* The key frame flag of a cluster is kept. */
+    uMkvHdrLen = Mkv_getClusterHdrLen(MKV_CLUSTER);
+    ASSERT_TRUE(uMkvHdrLen <= sizeof(pMkvHdr));
+    ASSERT_EQ(KVS_ERRNO_NONE, Mkv_initializeClusterHdr(pMkvHdr, sizeof(pMkvHdr), MKV_CLUSTER, 100, TRACK_AUDIO, true, 1000, 0));
+    ASSERT_EQ(KVS_ERRNO_NONE, Mkv_setSimpleBlockLacing(pMkvHdr, uMkvHdrLen, MKV_CLUSTER, MKV_LACING_EBML));
+    EXPECT_EQ(0x86, pMkvHdr[uMkvHdrLen - 1]);
+}
+
+TEST(Mkv_generateHevcCodecPrivateDataFromAvccNalus, hvcc)
+{
+    uint8_t pFrame[] = {
+        /* VPS */
+        0x00, 0x00, 0x00, 0x03, 0x40, 0x01, 0x0C,
+        /* SPS of main profile, level 4.1 and 1920x1080 */
+        0x00, 0x00, 0x00, 0x1A,
+        0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03,
+        0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03,
+        0x00, 0x7B, 0xA0, 0x03, 0xC0, 0x80, 0x11, 0x07,
+        0xCB, 0xC0,
+        /* PPS */
+        0x00, 0x00, 0x00, 0x04, 0x44, 0x01, 0xC1, 0x72
+    };
+    uint8_t pExpectedHdr[] = {
+        0x01,
+        /* general profile, tier and level without emulation prevention bytes */
+        0x01, 0x60, 0x00, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7B,
+        0xF0, 0x00, 0xFC, 0xFD, 0xF8, 0xF8, 0x00, 0x00,
+        /* 1 temporal layer, temporal ID nested and 4 bytes NALU length */
+        0x0F,
+        0x03
+    };
+    uint8_t *pCodecPrivateData = NULL;
+    size_t uCodecPrivateDataLen = 0;
+
+    ASSERT_EQ(0, Mkv_generateHevcCodecPrivateDataFromAvccNalus(pFrame, sizeof(pFrame), &pCodecPrivateData, &uCodecPrivateDataLen));
+    ASSERT_EQ(sizeof(pExpectedHdr) + 3 * 5 + 3 + 26 + 4, uCodecPrivateDataLen);
+    EXPECT_EQ(0, memcmp(pExpectedHdr, pCodecPrivateData, sizeof(pExpectedHdr)));
+
+    /* Arrays of VPS, SPS and PPS */
+    EXPECT_EQ(0, memcmp("\xA0\x00\x01\x00\x03\x40\x01\x0C", pCodecPrivateData + sizeof(pExpectedHdr), 8));
+    EXPECT_EQ(0, memcmp("\xA1\x00\x01\x00\x1A\x42\x01", pCodecPrivateData + sizeof(pExpectedHdr) + 8, 7));
+    EXPECT_EQ(0, memcmp("\xA2\x00\x01\x00\x04\x44\x01\xC1\x72", pCodecPrivateData + uCodecPrivateDataLen - 9, 9));
+
+    kvsFree(pCodecPrivateData);
+
+    /* There is no VPS. */
+    EXPECT_NE(0, Mkv_generateHevcCodecPrivateDataFromAvccNalus(pFrame + 7, sizeof(pFrame) - 7, &pCodecPrivateData, &uCodecPrivateDataLen));
+}
+
+TEST(Mkv_initializeClusterHdr, track_templates)
+{
+    uint8_t pHdr[64] = {0};
+    uint8_t pExpectedCluster[] = {
+        0x1F, 0x43, 0xB6, 0x75, 0xFF, 0xE7, 0x88, 0x00, 0x00, 0x01, 0x7A, 0x2B, 0x3C, 0x4D, 0x5E, 0xA7, 0x81, 0x00,
+        0xA3, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xEC, 0x82, 0x00, 0x00, 0x80
+    };
+    uint8_t pExpectedSimpleBlock[] = {0xA3, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0x81, 0x01, 0x2C, 0x00};
+
+    EXPECT_NE(0, Mkv_initializeClusterHdr(pHdr, sizeof(pHdr), MKV_CLUSTER, 1000, (TrackType_t)0, false, 0, 0));
+    EXPECT_NE(0, Mkv_initializeClusterHdr(pHdr, sizeof(pHdr), MKV_CLUSTER, 1000, (TrackType_t)(TRACK_MAX + 1), false, 0, 0));
+
+    ASSERT_EQ(0, Mkv_initializeClusterHdr(pHdr, sizeof(pHdr), MKV_CLUSTER, 1000, TRACK_AUDIO, false, 0x17A2B3C4D5EULL, 0));
+    ASSERT_EQ(sizeof(pExpectedCluster), Mkv_getClusterHdrLen(MKV_CLUSTER));
+    EXPECT_EQ(0, memcmp(pExpectedCluster, pHdr, sizeof(pExpectedCluster)));
+
+    ASSERT_EQ(0, Mkv_initializeClusterHdr(pHdr, sizeof(pHdr), MKV_SIMPLE_BLOCK, 32, TRACK_VIDEO, false, 0, 0));
+    ASSERT_EQ(0, Mkv_setSimpleBlockDeltaTimestamp(pHdr, sizeof(pHdr), MKV_SIMPLE_BLOCK, 300));
+    ASSERT_EQ(sizeof(pExpectedSimpleBlock), Mkv_getClusterHdrLen(MKV_SIMPLE_BLOCK));
+    EXPECT_EQ(0, memcmp(pExpectedSimpleBlock, pHdr, sizeof(pExpectedSimpleBlock)));
+
+    EXPECT_NE(0, Mkv_setSimpleBlockDeltaTimestamp(NULL, sizeof(pHdr), MKV_SIMPLE_BLOCK, 300));
+    EXPECT_NE(0, Mkv_setSimpleBlockDeltaTimestamp(pHdr, sizeof(pExpectedSimpleBlock) - 1, MKV_SIMPLE_BLOCK, 300));
+}
+
+TEST(Mkv_setSimpleBlockDeltaTimestamp, same_as_rebuild)
+{
+    uint8_t pRebuilt[64] = {0};
+    uint8_t pPatched[64] = {0};
+
+    /* The header is built once when the data frame is added, and only the delta timestamp is patched at pop. */
+    ASSERT_EQ(0, Mkv_initializeClusterHdr(pPatched, sizeof(pPatched), MKV_SIMPLE_BLOCK, 4096, TRACK_VIDEO, false, 0, 0));
+    for (uint32_t uDeltaMs = 0; uDeltaMs <= 0xFFFF; uDeltaMs += 0x1111)
+    {
+        ASSERT_EQ(0, Mkv_initializeClusterHdr(pRebuilt, sizeof(pRebuilt), MKV_SIMPLE_BLOCK, 4096, TRACK_VIDEO, false, 0, (uint16_t)uDeltaMs));
+        ASSERT_EQ(0, Mkv_setSimpleBlockDeltaTimestamp(pPatched, sizeof(pPatched), MKV_SIMPLE_BLOCK, (uint16_t)uDeltaMs));
+        EXPECT_EQ(0, memcmp(pRebuilt, pPatched, Mkv_getClusterHdrLen(MKV_SIMPLE_BLOCK)));
+    }
+}
@@ -1,10 +1,12 @@
 #ifdef __cplusplus
 extern "C" {
+#include "kvs/errors.h"
 #include "kvs/nalu.h"
 }
 #endif
 
 #include <gtest/gtest.h>
+#include <string.h>
 
 TEST(isKeyFrame, invalid_parameter)
 {
@@ -142,6 +144,39 @@ TEST(NALU_getNaluFromAvccNalus, invalid_parameter)
     EXPECT_NE(0, NALU_getNaluFromAvccNalus(pAvccBuf, uAvccLen, uNaluType, &pNalu, NULL));
 }
 
+TEST(NALU_isNonReferenceFrame, nal_ref_idc)
+{
+    uint8_t pNonRefPframe[] = {
+        /* SEI */
+        0x00, 0x00, 0x00, 0x02, 0x06, 0xFF,
+        /* P-frame with nal_ref_idc 0 */
+        0x00, 0x00, 0x00, 0x02, 0x01, 0xFF
+    };
+    uint8_t pRefPframe[] = {
+        /* P-frame with nal_ref_idc 2 */
+        0x00, 0x00, 0x00, 0x02, 0x41, 0xFF
+    };
+    uint8_t pIframe[] = {
+        0x00, 0x00, 0x00, 0x02, 0x65, 0xFF
+    };
+    uint8_t pSei[] = {
+        0x00, 0x00, 0x00, 0x02, 0x06, 0xFF
+    };
+    uint8_t pBrokenPframe[] = {
+        0x00, 0x00, 0x00, 0x10, 0x01, 0xFF
+    };
+
+    EXPECT_TRUE(NALU_isNonReferenceFrame(pNonRefPframe, sizeof(pNonRefPframe)));
+    EXPECT_FALSE(NALU_isNonReferenceFrame(pRefPframe, sizeof(pRefPframe)));
+    EXPECT_FALSE(NALU_isNonReferenceFrame(pIframe, sizeof(pIframe)));
+
+    /* A frame without VCL NALU is not a non-reference frame. */
+    EXPECT_FALSE(NALU_isNonReferenceFrame(pSei, sizeof(pSei)));
+    EXPECT_FALSE(NALU_isNonReferenceFrame(pBrokenPframe, sizeof(pBrokenPframe)));
+    EXPECT_FALSE(NALU_isNonReferenceFrame(NULL, sizeof(pNonRefPframe)));
+    EXPECT_FALSE(NALU_isNonReferenceFrame(pNonRefPframe, 0));
+}
+
 TEST(NALU_getNaluFromAnnexBNalus, valid_nalus_with_3bytes_header)
 {
     int res = 0;
@@ -399,6 +434,66 @@ TEST(NALU_convertAnnexBToAvccInPlace, more_than_one_annexb)
     EXPECT_TRUE(uAnnexbLen + 1 == uAvccLen);
 }
 
+TEST(NALU_convertAnnexBToAvccInPlace, long_nalus_at_any_alignment)
+{
+    /* It's more NALUs than the ones that NALU_analyzeFrame() can record. */
+    const uint32_t TEST_NALU_COUNT = 2 * NALU_MAX_COUNT_IN_A_FRAME + 5;
+    uint8_t pAnnexbBuf[4096] = {0};
+    uint32_t uAnnexbLen = 0;
+    uint32_t uAvccLen = 0;
+    uint32_t pNaluLens[TEST_NALU_COUNT] = {0};
+    uint32_t uNaluCount = 0;
+    uint32_t uAvccIdx = 0;
+    uint32_t uNaluLen = 0;
+    uint8_t *pNalu = NULL;
+    size_t uFoundLen = 0;
+    NaluFrameInfo_t xInfo = {0};
+
+    /* NALUs of different lengths make start codes land on every offset of a word. Small zero runs in the payload are
+     * not start codes. */
+    for (uNaluCount = 0; uNaluCount < TEST_NALU_COUNT; uNaluCount++)
+    {
+        if (uNaluCount % 2 == 0)
+        {
+            pAnnexbBuf[uAnnexbLen + 3] = 0x01;
+            uAnnexbLen += 4;
+        }
+        else
+        {
+            pAnnexbBuf[uAnnexbLen + 2] = 0x01;
+            uAnnexbLen += 3;
+        }
+        pNaluLens[uNaluCount] = 37 + 13 * (uNaluCount % 8);
+        pAnnexbBuf[uAnnexbLen] = (uNaluCount == TEST_NALU_COUNT - 1) ? 0x65 : 0x41;
+        for (uint32_t i = 1; i < pNaluLens[uNaluCount]; i++)
+        {
+            pAnnexbBuf[uAnnexbLen + i] = ((i % 29 == 0 || i % 29 == 1) && i + 2 < pNaluLens[uNaluCount]) ? 0x00 : (uint8_t)(i % 255 + 1);
+        }
+        uAnnexbLen += pNaluLens[uNaluCount];
+    }
+
+    ASSERT_EQ(0, NALU_getNaluFromAnnexBNalus(pAnnexbBuf, uAnnexbLen, NALU_TYPE_IFRAME, &pNalu, &uFoundLen));
+    EXPECT_EQ(pAnnexbBuf + uAnnexbLen - pNaluLens[TEST_NALU_COUNT - 1], pNalu);
+    EXPECT_EQ(pNaluLens[TEST_NALU_COUNT - 1], uFoundLen);
+
+    /* The I-frame is the last NALU, which is analyzed but not recorded. */
+    ASSERT_EQ(0, NALU_analyzeFrame(pAnnexbBuf, uAnnexbLen, false, &xInfo));
+    EXPECT_EQ(TEST_NALU_COUNT, xInfo.uNaluCount);
+    EXPECT_TRUE(xInfo.bIsKeyFrame);
+    EXPECT_EQ(uAnnexbLen + TEST_NALU_COUNT / 2, xInfo.uAvccLen);
+
+    ASSERT_EQ(0, NALU_convertAnnexBToAvccInPlace(pAnnexbBuf, uAnnexbLen, sizeof(pAnnexbBuf), &uAvccLen));
+    EXPECT_EQ(uAnnexbLen + TEST_NALU_COUNT / 2, uAvccLen);
+    for (uint32_t i = 0; i < TEST_NALU_COUNT; i++)
+    {
+        ASSERT_LT(uAvccIdx + 4, uAvccLen);
+        uNaluLen = (pAnnexbBuf[uAvccIdx] << 24) | (pAnnexbBuf[uAvccIdx + 1] << 16) | (pAnnexbBuf[uAvccIdx + 2] << 8) | pAnnexbBuf[uAvccIdx + 3];
+        EXPECT_EQ(pNaluLens[i], uNaluLen);
+        uAvccIdx += 4 + uNaluLen;
+    }
+    EXPECT_EQ(uAvccIdx, uAvccLen);
+}
+
 TEST(NALU_convertAnnexBToAvccInPlace, invalid_parameter)
 {
     uint8_t pFrame[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0xFF};
@@ -457,4 +552,218 @@ TEST(NALU_getH264VideoResolutionFromSps, invalid_parameter)
     EXPECT_NE(0, NALU_getH264VideoResolutionFromSps(pSps, uSpsLen, NULL, &uHeight));
 
     EXPECT_NE(0, NALU_getH264VideoResolutionFromSps(pSps, uSpsLen, &uWidth, NULL));
-}
\ No newline at end of file
+}
+TEST(NALU_isHevcKeyFrame, irap_frames)
+{
+    /* IDR_W_RADL after VPS in AVCC */
+    uint8_t pIdrFrame[] = {0x00, 0x00, 0x00, 0x03, 0x40, 0x01, 0x0C, 0x00, 0x00, 0x00, 0x03, 0x26, 0x01, 0xAF};
+    /* CRA in Annex-B */
+    uint8_t pCraFrame[] = {0x00, 0x00, 0x00, 0x01, 0x2A, 0x01, 0xAF, 0x00, 0x00, 0x01, 0x2A, 0x01, 0xBF};
+    /* TRAIL_R in AVCC, whose H264 NALU type would be an IDR slice */
+    uint8_t pTrailFrame[] = {0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0xD0};
+    /* H264 IDR slice in AVCC */
+    uint8_t pH264IdrFrame[] = {0x00, 0x00, 0x00, 0x02, 0x65, 0xFF};
+
+    EXPECT_TRUE(NALU_isHevcKeyFrame(pIdrFrame, sizeof(pIdrFrame)));
+    EXPECT_TRUE(NALU_isHevcKeyFrame(pCraFrame, sizeof(pCraFrame)));
+    EXPECT_FALSE(NALU_isHevcKeyFrame(pTrailFrame, sizeof(pTrailFrame)));
+    EXPECT_FALSE(NALU_isHevcKeyFrame(pH264IdrFrame, sizeof(pH264IdrFrame)));
+    EXPECT_FALSE(NALU_isHevcKeyFrame(NULL, sizeof(pIdrFrame)));
+}
+
+TEST(NALU_getHevcNaluFromAvccNalus, valid_nalus)
+{
+    uint8_t pFrame[] = {
+        0x00, 0x00, 0x00, 0x03, 0x40, 0x01, 0x0C,
+        0x00, 0x00, 0x00, 0x03, 0x42, 0x01, 0x01,
+        0x00, 0x00, 0x00, 0x04, 0x44, 0x01, 0xC1, 0x72
+    };
+    uint8_t *pNalu = NULL;
+    size_t uNaluLen = 0;
+
+    ASSERT_EQ(0, NALU_getHevcNaluFromAvccNalus(pFrame, sizeof(pFrame), NALU_TYPE_HEVC_VPS, &pNalu, &uNaluLen));
+    EXPECT_EQ(pFrame + 4, pNalu);
+    EXPECT_EQ(3, uNaluLen);
+
+    ASSERT_EQ(0, NALU_getHevcNaluFromAvccNalus(pFrame, sizeof(pFrame), NALU_TYPE_HEVC_PPS, &pNalu, &uNaluLen));
+    EXPECT_EQ(pFrame + 18, pNalu);
+    EXPECT_EQ(4, uNaluLen);
+
+    ASSERT_EQ(0, NALU_getHevcNaluFromAnnexBNalus((uint8_t *)"\x00\x00\x01\x40\x01\x0C\x00\x00\x01\x42\x01\x01", 12, NALU_TYPE_HEVC_SPS, &pNalu, &uNaluLen));
+    EXPECT_EQ(3, uNaluLen);
+
+    EXPECT_NE(0, NALU_getHevcNaluFromAvccNalus(pFrame, sizeof(pFrame), NALU_TYPE_HEVC_BLA_W_LP, &pNalu, &uNaluLen));
+    EXPECT_NE(0, NALU_getHevcNaluFromAvccNalus(pFrame, sizeof(pFrame), 64, &pNalu, &uNaluLen));
+}
+
+TEST(NALU_getHevcVideoResolutionFromSps, valid_sps)
+{
+    /* Main profile, level 4.1, 1920x1088 with conformance window of 8 lines at the bottom, and emulation prevention
+     * bytes in the profile, tier and level. */
+    uint8_t pSps[] = {
+        0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03,
+        0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03,
+        0x00, 0x7B, 0xA0, 0x03, 0xC0, 0x80, 0x11, 0x07,
+        0xCB, 0xC0
+    };
+    uint16_t uWidth = 0;
+    uint16_t uHeight = 0;
+
+    ASSERT_EQ(0, NALU_getHevcVideoResolutionFromSps(pSps, sizeof(pSps), &uWidth, &uHeight));
+    EXPECT_EQ(1920, uWidth);
+    EXPECT_EQ(1080, uHeight);
+
+    /* It's not a H265 SPS. */
+    EXPECT_NE(0, NALU_getHevcVideoResolutionFromSps(pSps + 2, sizeof(pSps) - 2, &uWidth, &uHeight));
+
+    /* It's truncated. */
+    EXPECT_NE(0, NALU_getHevcVideoResolutionFromSps(pSps, 16, &uWidth, &uHeight));
+}
+
+TEST(NALU_analyzeFrame, annexb_h264_frame)
+{
+    uint8_t pFrame[64] = {
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x1F,
+        0x00, 0x00, 0x01, 0x68, 0xCE, 0x3C, 0x80,
+        0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00, 0x33
+    };
+    uint32_t uFrameLen = 24;
+    uint32_t uAvccLen = 0;
+    NaluFrameInfo_t xInfo = {0};
+
+    EXPECT_NE(0, NALU_analyzeFrame(NULL, uFrameLen, false, &xInfo));
+    EXPECT_NE(0, NALU_analyzeFrame(pFrame, 4, false, &xInfo));
+    EXPECT_NE(0, NALU_analyzeFrame(pFrame, uFrameLen, false, NULL));
+
+    ASSERT_EQ(0, NALU_analyzeFrame(pFrame, uFrameLen, false, &xInfo));
+    EXPECT_TRUE(xInfo.bIsAnnexB);
+    EXPECT_TRUE(xInfo.bIsKeyFrame);
+    EXPECT_FALSE(xInfo.bIsNonReference);
+    ASSERT_EQ(3, xInfo.uNaluCount);
+    EXPECT_EQ(4, xInfo.xSps.uOffset);
+    EXPECT_EQ(4, xInfo.xSps.uLen);
+    EXPECT_EQ(11, xInfo.xPps.uOffset);
+    EXPECT_EQ(4, xInfo.xPps.uLen);
+    EXPECT_EQ(0, xInfo.xVps.uLen);
+    EXPECT_EQ(0x65, xInfo.pxNalus[2].uHdr);
+
+    /* Offsets still point to the same NALUs after conversion. */
+    ASSERT_EQ(0, NALU_convertAnnexBToAvccWithFrameInfo(pFrame, sizeof(pFrame), &xInfo, 0, &uAvccLen));
+    EXPECT_EQ(uFrameLen + 1, uAvccLen);
+    EXPECT_EQ(uAvccLen, xInfo.uLen);
+    EXPECT_FALSE(xInfo.bIsAnnexB);
+    EXPECT_EQ(0, memcmp("\x00\x00\x00\x04\x67\x42\x00\x1F", pFrame, 8));
+    EXPECT_EQ(0, memcmp("\x67\x42\x00\x1F", pFrame + xInfo.xSps.uOffset, 4));
+    EXPECT_EQ(0, memcmp("\x68\xCE\x3C\x80", pFrame + xInfo.xPps.uOffset, 4));
+    EXPECT_EQ(0, memcmp("\x65\x88\x84\x00\x33", pFrame + xInfo.pxNalus[2].uOffset, 5));
+
+    /* It's an AVCC frame now, so nothing is changed. */
+    ASSERT_EQ(0, NALU_analyzeFrame(pFrame, uAvccLen, false, &xInfo));
+    EXPECT_FALSE(xInfo.bIsAnnexB);
+    EXPECT_TRUE(xInfo.bIsKeyFrame);
+    EXPECT_EQ(0, NALU_convertAnnexBToAvccWithFrameInfo(pFrame, sizeof(pFrame), &xInfo, 0, &uAvccLen));
+    EXPECT_EQ(uFrameLen + 1, uAvccLen);
+}
+
+TEST(NALU_convertAnnexBToAvccWithFrameInfo, filter_nalus)
+{
+    uint8_t pFrame[64] = {
+        0x00, 0x00, 0x00, 0x01, 0x09, 0xF0,
+        0x00, 0x00, 0x01, 0x06, 0x05, 0x11, 0x22,
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x1F,
+        0x00, 0x00, 0x01, 0x65, 0x88, 0x84,
+        0x00, 0x00, 0x01, 0x0C, 0xFF, 0xFF, 0x80
+    };
+    uint8_t pHevcFrame[] = {
+        0x00, 0x00, 0x00, 0x03, 0x4E, 0x01, 0x05,
+        0x00, 0x00, 0x00, 0x03, 0x26, 0x01, 0xAF,
+        0x00, 0x00, 0x00, 0x03, 0x50, 0x01, 0x05
+    };
+    uint8_t pSeiFrame[] = {0x00, 0x00, 0x00, 0x01, 0x06, 0x05, 0x11, 0x22};
+    uint64_t uH264Mask = NALU_FILTER_BIT(NALU_TYPE_SEI) | NALU_FILTER_BIT(NALU_TYPE_AUD) | NALU_FILTER_BIT(NALU_TYPE_FILLER);
+    uint64_t uHevcMask = NALU_FILTER_BIT(NALU_TYPE_HEVC_PREFIX_SEI) | NALU_FILTER_BIT(NALU_TYPE_HEVC_SUFFIX_SEI);
+    uint32_t uAvccLen = 0;
+    NaluFrameInfo_t xInfo = {0};
+
+    /* AUD, SEI and filler data are removed while the frame is converted. */
+    ASSERT_EQ(0, NALU_analyzeFrame(pFrame, 34, false, &xInfo));
+    EXPECT_EQ(5, xInfo.uNaluCount);
+    ASSERT_EQ(0, NALU_convertAnnexBToAvccWithFrameInfo(pFrame, sizeof(pFrame), &xInfo, uH264Mask, &uAvccLen));
+    ASSERT_EQ(15, uAvccLen);
+    EXPECT_EQ(0, memcmp("\x00\x00\x00\x04\x67\x42\x00\x1F\x00\x00\x00\x03\x65\x88\x84", pFrame, 15));
+    EXPECT_EQ(2, xInfo.uNaluCount);
+    EXPECT_TRUE(xInfo.bIsKeyFrame);
+    EXPECT_EQ(4, xInfo.xSps.uOffset);
+
+    /* Filtered NALUs are removed from an AVCC frame too. */
+    ASSERT_EQ(0, NALU_analyzeFrame(pHevcFrame, sizeof(pHevcFrame), true, &xInfo));
+    ASSERT_EQ(0, NALU_convertAnnexBToAvccWithFrameInfo(pHevcFrame, sizeof(pHevcFrame), &xInfo, uHevcMask, &uAvccLen));
+    ASSERT_EQ(7, uAvccLen);
+    EXPECT_EQ(0, memcmp("\x00\x00\x00\x03\x26\x01\xAF", pHevcFrame, 7));
+    EXPECT_EQ(1, xInfo.uNaluCount);
+
+    /* The mask is by the codec of the frame, so H264 types are not H265 ones. */
+    ASSERT_EQ(0, NALU_analyzeFrame(pHevcFrame, uAvccLen, true, &xInfo));
+    ASSERT_EQ(0, NALU_convertAnnexBToAvccWithFrameInfo(pHevcFrame, sizeof(pHevcFrame), &xInfo, uH264Mask, &uAvccLen));
+    EXPECT_EQ(7, uAvccLen);
+
+    ASSERT_EQ(0, NALU_analyzeFrame(pSeiFrame, sizeof(pSeiFrame), false, &xInfo));
+    EXPECT_EQ(KVS_ERROR_MISSING_NALU, NALU_convertAnnexBToAvccWithFrameInfo(pSeiFrame, sizeof(pSeiFrame), &xInfo, uH264Mask, &uAvccLen));
+}
+
+TEST(NALU_analyzeFrame, avcc_frames)
+{
+    uint8_t pNonRefFrame[] = {0x00, 0x00, 0x00, 0x02, 0x06, 0x05, 0x00, 0x00, 0x00, 0x02, 0x01, 0xAA};
+    uint8_t pRefFrame[] = {0x00, 0x00, 0x00, 0x02, 0x01, 0xAA, 0x00, 0x00, 0x00, 0x02, 0x21, 0xAA};
+    uint8_t pBrokenFrame[] = {0x00, 0x00, 0x00, 0x02, 0x21, 0xAA, 0x00, 0x00, 0x00, 0x09, 0x21, 0xAA};
+    uint8_t pHevcFrame[] = {
+        0x00, 0x00, 0x00, 0x03, 0x40, 0x01, 0x0C,
+        0x00, 0x00, 0x00, 0x03, 0x42, 0x01, 0x01,
+        0x00, 0x00, 0x00, 0x03, 0x44, 0x01, 0xC1,
+        0x00, 0x00, 0x00, 0x03, 0x26, 0x01, 0xAF
+    };
+    NaluFrameInfo_t xInfo = {0};
+
+    ASSERT_EQ(0, NALU_analyzeFrame(pNonRefFrame, sizeof(pNonRefFrame), false, &xInfo));
+    EXPECT_FALSE(xInfo.bIsKeyFrame);
+    EXPECT_TRUE(xInfo.bIsNonReference);
+    EXPECT_EQ(2, xInfo.uNaluCount);
+    EXPECT_EQ(NALU_isNonReferenceFrame(pNonRefFrame, sizeof(pNonRefFrame)), xInfo.bIsNonReference);
+
+    ASSERT_EQ(0, NALU_analyzeFrame(pRefFrame, sizeof(pRefFrame), false, &xInfo));
+    EXPECT_FALSE(xInfo.bIsNonReference);
+    EXPECT_EQ(NALU_isNonReferenceFrame(pRefFrame, sizeof(pRefFrame)), xInfo.bIsNonReference);
+
+    EXPECT_EQ(KVS_ERROR_AVCC_NALU_IS_BROKEN, NALU_analyzeFrame(pBrokenFrame, sizeof(pBrokenFrame), false, &xInfo));
+
+    ASSERT_EQ(0, NALU_analyzeFrame(pHevcFrame, sizeof(pHevcFrame), true, &xInfo));
+    EXPECT_TRUE(xInfo.bIsKeyFrame);
+    EXPECT_FALSE(xInfo.bIsNonReference);
+    EXPECT_EQ(4, xInfo.xVps.uOffset);
+    EXPECT_EQ(11, xInfo.xSps.uOffset);
+    EXPECT_EQ(18, xInfo.xPps.uOffset);
+    EXPECT_EQ(3, xInfo.xPps.uLen);
+}
+
+TEST(NALU_analyzeFrameOfFormat, declared_format)
+{
+    uint8_t pAvccFrame[4 + 0x100] = {0x00, 0x00, 0x01, 0x00, 0x65};
+    uint8_t pAnnexBFrame[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+    NaluFrameInfo_t xInfo = {0};
+
+    /* The length of the AVCC NALU looks like a start code, so only a declared format tells it apart. */
+    ASSERT_EQ(0, NALU_analyzeFrameOfFormat(pAvccFrame, sizeof(pAvccFrame), false, false, &xInfo));
+    EXPECT_FALSE(xInfo.bIsAnnexB);
+    EXPECT_TRUE(xInfo.bIsKeyFrame);
+    ASSERT_EQ(1, xInfo.uNaluCount);
+    EXPECT_EQ(4, xInfo.pxNalus[0].uOffset);
+    EXPECT_EQ(0x100, xInfo.pxNalus[0].uLen);
+
+    ASSERT_EQ(0, NALU_analyzeFrameOfFormat(pAnnexBFrame, sizeof(pAnnexBFrame), false, true, &xInfo));
+    EXPECT_TRUE(xInfo.bIsAnnexB);
+    ASSERT_EQ(2, xInfo.uNaluCount);
+    EXPECT_EQ(9, xInfo.pxNalus[1].uOffset);
+    EXPECT_EQ(3, xInfo.pxNalus[1].uLen);
+
+    EXPECT_NE(0, NALU_analyzeFrameOfFormat(NULL, sizeof(pAnnexBFrame), false, true, &xInfo));
+}
@@ -0,0 +1,320 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/port.h"
+#include "net/netio.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+/* An in-memory transport that echoes the data sent back to the receiver. */
+typedef struct LoopbackTransport
+{
+    std::string xData;
+    size_t uSendCount;
+    bool bConnected;
+    unsigned int uOptions[NETIO_OPTION_BIND_IF_INDEX + 1];
+} LoopbackTransport_t;
+
+/* The context of the most recently created handle */
+static LoopbackTransport_t *gpxLoopback = NULL;
+
+static void *loopbackCreate(void)
+{
+    gpxLoopback = new LoopbackTransport_t();
+    return gpxLoopback;
+}
+
+static void loopbackTerminate(void *pCtx)
+{
+    delete (LoopbackTransport_t *)pCtx;
+}
+
+static int loopbackConnect(void *pCtx, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    ((LoopbackTransport_t *)pCtx)->bConnected = true;
+    return 0;
+}
+
+static int loopbackSend(void *pCtx, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    LoopbackTransport_t *pxLoopback = (LoopbackTransport_t *)pCtx;
+
+    pxLoopback->xData.append((const char *)pBuffer, uBytesToSend);
+    pxLoopback->uSendCount++;
+    return 0;
+}
+
+static int loopbackRecv(void *pCtx, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    LoopbackTransport_t *pxLoopback = (LoopbackTransport_t *)pCtx;
+    size_t uLen = std::min(uBufferSize, pxLoopback->xData.size());
+
+    memcpy(pBuffer, pxLoopback->xData.data(), uLen);
+    pxLoopback->xData.erase(0, uLen);
+    *puBytesReceived = uLen;
+    return 0;
+}
+
+static bool loopbackIsDataAvailable(void *pCtx)
+{
+    return !((LoopbackTransport_t *)pCtx)->xData.empty();
+}
+
+static int loopbackGetSocket(void *pCtx)
+{
+    return ((LoopbackTransport_t *)pCtx)->bConnected ? 42 : -1;
+}
+
+static int loopbackGetStats(void *pCtx, NetIoStats_t *pxStats)
+{
+    /* One record per send, like mbedTLS without kTLS */
+    pxStats->uTlsRecordsSent = ((LoopbackTransport_t *)pCtx)->uSendCount;
+    return 0;
+}
+
+static int loopbackSetOption(void *pCtx, NetIoOption_t xOption, unsigned int uValue)
+{
+    ((LoopbackTransport_t *)pCtx)->uOptions[xOption] = uValue;
+    return 0;
+}
+
+static NetIoTransport_t getLoopbackTransport(void)
+{
+    NetIoTransport_t xTransport = {0};
+
+    xTransport.create = loopbackCreate;
+    xTransport.terminate = loopbackTerminate;
+    xTransport.connect = loopbackConnect;
+    xTransport.send = loopbackSend;
+    xTransport.recv = loopbackRecv;
+
+    return xTransport;
+}
+
+TEST(NetIo_createWithTransport, invalid_transport)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+
+    EXPECT_EQ(NULL, NetIo_createWithTransport(NULL));
+
+    xTransport.recv = NULL;
+    EXPECT_EQ(NULL, NetIo_createWithTransport(&xTransport));
+
+    /* connectStart without connectPoll */
+    xTransport = getLoopbackTransport();
+    xTransport.connectStart = loopbackConnect;
+    EXPECT_EQ(NULL, NetIo_createWithTransport(&xTransport));
+    EXPECT_NE(0, NetIo_setDefaultTransport(&xTransport));
+}
+
+TEST(NetIo_createWithTransport, send_and_recv)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+    NetIoHandle xNetIo = NetIo_createWithTransport(&xTransport);
+    const unsigned char pHello[] = "hello";
+    unsigned char pBuf[16] = {0};
+    size_t uLen = 0;
+
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(0, NetIo_connect(xNetIo, "localhost", "443"));
+    EXPECT_TRUE(gpxLoopback->bConnected);
+
+    /* Without isDataAvailable, data is never reported available. */
+    EXPECT_EQ(0, NetIo_send(xNetIo, pHello, 5));
+    EXPECT_FALSE(NetIo_isDataAvailable(xNetIo));
+
+    EXPECT_EQ(0, NetIo_recv(xNetIo, pBuf, sizeof(pBuf), &uLen));
+    EXPECT_EQ(5, uLen);
+    EXPECT_EQ(0, memcmp(pBuf, pHello, 5));
+
+    NetIo_disconnect(xNetIo);
+    NetIo_terminate(xNetIo);
+}
+
+TEST(NetIo_sendv, send_segments_one_by_one)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+    NetIoHandle xNetIo = NULL;
+    const unsigned char pA[] = "abc";
+    const unsigned char pB[] = "de";
+    NetIoVec_t xIov[4] = {{pA, 3}, {NULL, 4}, {pB, 0}, {pB, 2}};
+
+    xTransport.isDataAvailable = loopbackIsDataAvailable;
+    xNetIo = NetIo_createWithTransport(&xTransport);
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+
+    EXPECT_EQ(0, NetIo_sendv(xNetIo, xIov, 4));
+    EXPECT_EQ(2, gpxLoopback->uSendCount);
+    EXPECT_EQ(std::string("abcde"), gpxLoopback->xData);
+    EXPECT_TRUE(NetIo_isDataAvailable(xNetIo));
+
+    NetIo_terminate(xNetIo);
+}
+
+TEST(NetIo_setPacing, invalid_parameter)
+{
+    EXPECT_NE(0, NetIo_setPacing(NULL, 8000, 0));
+}
+
+TEST(NetIo_setPacing, send_in_bursts_at_rate)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+    NetIoHandle xNetIo = NetIo_createWithTransport(&xTransport);
+    std::string xPayload(3000, 'x');
+    uint64_t uStartMs = 0;
+
+    /* 10000 bytes per second with 1000 byte bursts: the first burst goes out at once, and the other two wait 100 ms each. */
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(0, NetIo_setPacing(xNetIo, 80000, 1000));
+    uStartMs = getMonotonicTimeInMs();
+    EXPECT_EQ(0, NetIo_send(xNetIo, (const unsigned char *)xPayload.data(), xPayload.size()));
+    EXPECT_GE(getMonotonicTimeInMs() - uStartMs, 180);
+    EXPECT_EQ(3, gpxLoopback->uSendCount);
+    EXPECT_EQ(xPayload, gpxLoopback->xData);
+
+    /* No pacing sends it in one call. */
+    EXPECT_EQ(0, NetIo_setPacing(xNetIo, 0, 0));
+    EXPECT_EQ(0, NetIo_send(xNetIo, (const unsigned char *)xPayload.data(), xPayload.size()));
+    EXPECT_EQ(4, gpxLoopback->uSendCount);
+
+    NetIo_terminate(xNetIo);
+}
+
+TEST(NetIo_connectStart, fall_back_to_blocking_connect)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+    NetIoHandle xNetIo = NetIo_createWithTransport(&xTransport);
+    bool bConnected = false;
+
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(KVS_ERROR_NETIO_CONNECT_NOT_STARTED, NetIo_connectPoll(xNetIo, &bConnected));
+
+    EXPECT_EQ(0, NetIo_connectStart(xNetIo, "localhost", "443"));
+    EXPECT_EQ(0, NetIo_connectPoll(xNetIo, &bConnected));
+    EXPECT_TRUE(bConnected);
+
+    NetIo_terminate(xNetIo);
+}
+
+TEST(NetIo_setOption, forward_or_ignore)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+    NetIoHandle xNetIo = NetIo_createWithTransport(&xTransport);
+
+    /* Options and timeouts that the transport doesn't support are ignored. */
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(0, NetIo_setTcpNoDelay(xNetIo, true));
+    EXPECT_EQ(0, NetIo_setRecvTimeout(xNetIo, 1000));
+    EXPECT_EQ(0, NetIo_setSendTimeout(xNetIo, 1000));
+    NetIo_terminate(xNetIo);
+
+    xTransport.setOption = loopbackSetOption;
+    xNetIo = NetIo_createWithTransport(&xTransport);
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(0, NetIo_setTcpNoDelay(xNetIo, true));
+    EXPECT_EQ(0, NetIo_setKeepAlive(xNetIo, 10, 5, 3));
+    EXPECT_EQ(0, NetIo_setTlsMaxFragmentLength(xNetIo, 4096));
+    EXPECT_EQ(0, NetIo_setBindInterface(xNetIo, 2));
+    EXPECT_EQ(1, gpxLoopback->uOptions[NETIO_OPTION_TCP_NODELAY]);
+    EXPECT_EQ(10, gpxLoopback->uOptions[NETIO_OPTION_KEEPALIVE_IDLE_SEC]);
+    EXPECT_EQ(5, gpxLoopback->uOptions[NETIO_OPTION_KEEPALIVE_INTERVAL_SEC]);
+    EXPECT_EQ(3, gpxLoopback->uOptions[NETIO_OPTION_KEEPALIVE_COUNT]);
+    EXPECT_EQ(4096, gpxLoopback->uOptions[NETIO_OPTION_TLS_MAX_FRAG_LEN]);
+    EXPECT_EQ(2, gpxLoopback->uOptions[NETIO_OPTION_BIND_IF_INDEX]);
+    NetIo_terminate(xNetIo);
+}
+
+TEST(NetIo_getSocket, forward_or_none)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+    NetIoHandle xNetIo = NetIo_createWithTransport(&xTransport);
+
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(-1, NetIo_getSocket(NULL));
+    EXPECT_EQ(0, NetIo_connect(xNetIo, "localhost", "443"));
+    EXPECT_EQ(-1, NetIo_getSocket(xNetIo));
+    NetIo_terminate(xNetIo);
+
+    xTransport.getSocket = loopbackGetSocket;
+    xNetIo = NetIo_createWithTransport(&xTransport);
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(-1, NetIo_getSocket(xNetIo));
+    EXPECT_EQ(0, NetIo_connect(xNetIo, "localhost", "443"));
+    EXPECT_EQ(42, NetIo_getSocket(xNetIo));
+    NetIo_terminate(xNetIo);
+}
+
+TEST(NetIo_getStats, count_bytes_and_forward_records)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+    NetIoHandle xNetIo = NetIo_createWithTransport(&xTransport);
+    const unsigned char pA[] = "abc";
+    const unsigned char pB[] = "de";
+    NetIoVec_t xIov[2] = {{pA, 3}, {pB, 2}};
+    NetIoStats_t xStats = {0};
+    unsigned char pBuf[16] = {0};
+    size_t uLen = 0;
+
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_NE(0, NetIo_getStats(NULL, &xStats));
+    EXPECT_NE(0, NetIo_getStats(xNetIo, NULL));
+
+    /* Without getStats, bytes are counted but records are not. */
+    EXPECT_EQ(0, NetIo_send(xNetIo, pA, 3));
+    EXPECT_EQ(0, NetIo_sendv(xNetIo, xIov, 2));
+    EXPECT_EQ(0, NetIo_recv(xNetIo, pBuf, 4, &uLen));
+    EXPECT_EQ(0, NetIo_getStats(xNetIo, &xStats));
+    EXPECT_EQ(8, xStats.uBytesSent);
+    EXPECT_EQ(4, xStats.uBytesReceived);
+    EXPECT_EQ(0, xStats.uTlsRecordsSent);
+    NetIo_terminate(xNetIo);
+
+    xTransport.getStats = loopbackGetStats;
+    xNetIo = NetIo_createWithTransport(&xTransport);
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(0, NetIo_sendv(xNetIo, xIov, 2));
+    EXPECT_EQ(0, NetIo_getStats(xNetIo, &xStats));
+    EXPECT_EQ(5, xStats.uBytesSent);
+    EXPECT_EQ(0, xStats.uBytesReceived);
+    EXPECT_EQ(2, xStats.uTlsRecordsSent);
+    NetIo_terminate(xNetIo);
+}
+
+TEST(NetIo_setDefaultTransport, create_on_default_transport)
+{
+    NetIoTransport_t xTransport = getLoopbackTransport();
+    NetIoHandle xNetIo = NULL;
+    const unsigned char pHello[] = "hello";
+
+    ASSERT_EQ(0, NetIo_setDefaultTransport(&xTransport));
+    xNetIo = NetIo_create();
+    EXPECT_EQ(0, NetIo_setDefaultTransport(NULL));
+
+    ASSERT_NE((NetIoHandle)NULL, xNetIo);
+    EXPECT_EQ(0, NetIo_send(xNetIo, pHello, 5));
+    EXPECT_EQ(std::string("hello"), gpxLoopback->xData);
+    NetIo_terminate(xNetIo);
+}
+
+TEST(NetIo_prefetchHosts, invalid_parameter)
+{
+    const char *ppcHosts[] = {"127.0.0.1"};
+
+    EXPECT_NE(0, NetIo_prefetchHosts(NULL, 1, "443"));
+    EXPECT_NE(0, NetIo_prefetchHosts(ppcHosts, 1, NULL));
+    EXPECT_EQ(0, NetIo_prefetchHosts(NULL, 0, "443"));
+}
+
+TEST(NetIo_prefetchHosts, resolve_and_skip_null_hosts)
+{
+    const char *ppcHosts[] = {"127.0.0.1", NULL, "127.0.0.2"};
+
+    EXPECT_EQ(0, NetIo_prefetchHosts(ppcHosts, sizeof(ppcHosts) / sizeof(ppcHosts[0]), "443"));
+    /* They're cached now. */
+    EXPECT_EQ(0, NetIo_prefetchHosts(ppcHosts, 1, "443"));
+}
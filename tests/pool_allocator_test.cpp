@@ -0,0 +1,154 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/pool_allocator.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#define POOL_SIZE   (16 * 1024)
+
+alignas(16) static uint8_t pMemPoolA[POOL_SIZE];
+alignas(16) static uint8_t pMemPoolB[POOL_SIZE];
+
+static bool prvIsInPool(const uint8_t *pMemPool, void *ptr)
+{
+    return (uint8_t *)ptr >= pMemPool && (uint8_t *)ptr < pMemPool + POOL_SIZE;
+}
+
+TEST(poolAllocatorCreate, invalid_parameter)
+{
+    EXPECT_EQ(nullptr, poolAllocatorCreate(NULL, POOL_SIZE));
+    EXPECT_EQ(nullptr, poolAllocatorCreate(pMemPoolA, 0));
+    EXPECT_EQ(nullptr, poolAllocatorCreate(pMemPoolA, 16));
+
+    EXPECT_EQ(nullptr, poolAllocatorMallocFrom(NULL, 16));
+    EXPECT_EQ(nullptr, poolAllocatorCallocFrom(NULL, 1, 16));
+    EXPECT_EQ(nullptr, poolAllocatorReallocFrom(NULL, NULL, 16));
+    poolAllocatorFreeFrom(NULL, NULL);
+    poolAllocatorTerminate(NULL);
+}
+
+TEST(poolAllocatorMallocFrom, independent_pools)
+{
+    PoolAllocatorHandle xPoolA = poolAllocatorCreate(pMemPoolA, POOL_SIZE);
+    PoolAllocatorHandle xPoolB = poolAllocatorCreate(pMemPoolB, POOL_SIZE);
+    PoolStats_t xStats = {0};
+    void *ptr = NULL;
+    uint8_t *pBytes = NULL;
+
+    ASSERT_NE(nullptr, xPoolA);
+    ASSERT_NE(nullptr, xPoolB);
+
+    ptr = poolAllocatorMallocFrom(xPoolA, 100);
+    EXPECT_TRUE(prvIsInPool(pMemPoolA, ptr));
+    poolAllocatorFreeFrom(xPoolA, ptr);
+    ptr = poolAllocatorMallocFrom(xPoolB, 100);
+    EXPECT_TRUE(prvIsInPool(pMemPoolB, ptr));
+
+    /* A pool that is used up doesn't affect the other one. */
+    while (poolAllocatorMallocFrom(xPoolA, 1024) != NULL)
+    {
+    }
+    EXPECT_EQ(nullptr, poolAllocatorMallocFrom(xPoolA, 1024));
+    EXPECT_NE(nullptr, poolAllocatorMallocFrom(xPoolB, 1024));
+
+    pBytes = (uint8_t *)poolAllocatorCallocFrom(xPoolB, 4, 8);
+    ASSERT_TRUE(prvIsInPool(pMemPoolB, pBytes));
+    for (int i = 0; i < 32; i++)
+    {
+        EXPECT_EQ(0, pBytes[i]);
+    }
+    EXPECT_EQ(nullptr, poolAllocatorCallocFrom(xPoolB, SIZE_MAX, 2));
+
+    memcpy(pBytes, "kvs", 4);
+    pBytes = (uint8_t *)poolAllocatorReallocFrom(xPoolB, pBytes, 64);
+    ASSERT_TRUE(prvIsInPool(pMemPoolB, pBytes));
+    EXPECT_STREQ("kvs", (const char *)pBytes);
+
+    poolAllocatorGetStatsFrom(xPoolB, &xStats);
+    EXPECT_LE(3, xStats.uNumberOfUsedBlocks);
+    EXPECT_GE(POOL_SIZE, xStats.uSumOfUsedMemory + xStats.uSumOfFreeMemory);
+
+    poolAllocatorTerminate(xPoolA);
+    poolAllocatorTerminate(xPoolB);
+}
+
+TEST(poolAllocatorMalloc, default_pool)
+{
+    PoolStats_t xStats = {0};
+    void *ptr = NULL;
+
+    EXPECT_EQ(nullptr, poolAllocatorMalloc(16));
+    EXPECT_NE(0, poolAllocatorInit(NULL, POOL_SIZE));
+
+    ASSERT_EQ(0, poolAllocatorInit(pMemPoolA, POOL_SIZE));
+    ptr = poolAllocatorMalloc(16);
+    EXPECT_TRUE(prvIsInPool(pMemPoolA, ptr));
+    poolAllocatorGetStats(&xStats);
+    EXPECT_LE(1, xStats.uNumberOfUsedBlocks);
+    poolAllocatorFree(ptr);
+    poolAllocatorDeinit();
+
+    EXPECT_EQ(nullptr, poolAllocatorMalloc(16));
+}
+
+static void *prvAllocateAndFree(void *pArg)
+{
+    uintptr_t uSeed = (uintptr_t)pArg;
+    uint8_t *pBlocks[4] = {NULL};
+
+    for (int i = 0; i < 1000; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            size_t uSize = 1 + (uSeed + i * 7 + j * 61) % 256;
+
+            if ((pBlocks[j] = (uint8_t *)poolAllocatorMalloc(uSize)) != NULL)
+            {
+                memset(pBlocks[j], (int)uSeed, uSize);
+            }
+        }
+        for (int j = 0; j < 4; j++)
+        {
+            poolAllocatorFree(pBlocks[j]);
+        }
+    }
+
+    return NULL;
+}
+
+TEST(poolAllocatorMalloc, thread_cache)
+{
+    PoolStats_t xStats = {0};
+    pthread_t pxThreads[4];
+    void *ptr = NULL;
+
+    ASSERT_EQ(0, poolAllocatorInit(pMemPoolA, POOL_SIZE));
+
+    /* A freed block serves the next allocation of its size class. */
+    ptr = poolAllocatorMalloc(20);
+    ASSERT_NE(nullptr, ptr);
+    poolAllocatorFree(ptr);
+    EXPECT_EQ(ptr, poolAllocatorMalloc(30));
+    poolAllocatorFree(ptr);
+
+    for (uintptr_t i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(0, pthread_create(&pxThreads[i], NULL, prvAllocateAndFree, (void *)i));
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(pxThreads[i], NULL);
+    }
+
+    /* Caches of threads are freed when they exit, and the cache of this thread when stats are taken. */
+    poolAllocatorGetStats(&xStats);
+    EXPECT_EQ(0, xStats.uNumberOfUsedBlocks);
+
+    poolAllocatorDeinit();
+}
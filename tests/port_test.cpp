@@ -0,0 +1,76 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/port.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void signalEvent(void *pArg)
+{
+    sleepInMs(20);
+    kvsEventSignal((KvsEventHandle)pArg);
+}
+
+TEST(kvsEventWait, signal_before_and_during_wait)
+{
+    KvsEventHandle xEvent = kvsEventCreate();
+    KvsThreadHandle xThread = NULL;
+
+    ASSERT_NE((KvsEventHandle)NULL, xEvent);
+    EXPECT_FALSE(kvsEventWait(xEvent, 0));
+
+    /* A signal is kept until the next wait, which resets it. */
+    kvsEventSignal(xEvent);
+    EXPECT_TRUE(kvsEventWait(xEvent, 0));
+    EXPECT_FALSE(kvsEventWait(xEvent, 0));
+
+    xThread = kvsThreadCreate(signalEvent, xEvent, 0, -1);
+    ASSERT_NE((KvsThreadHandle)NULL, xThread);
+    EXPECT_TRUE(kvsEventWait(xEvent, 5000));
+    kvsThreadJoin(xThread);
+
+    kvsEventTerminate(xEvent);
+}
+
+TEST(kvsEventWaitSocket, wake_on_signal_or_socket)
+{
+    KvsEventHandle xEvent = kvsEventCreate();
+    KvsThreadHandle xThread = NULL;
+    int xSockets[2] = {-1, -1};
+    char c = 0;
+    uint64_t uStartMs = 0;
+
+    ASSERT_NE((KvsEventHandle)NULL, xEvent);
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, xSockets));
+
+    /* Timeout */
+    uStartMs = getMonotonicTimeInMs();
+    EXPECT_EQ(0, kvsEventWaitSocket(xEvent, xSockets[0], 20));
+    EXPECT_LE(uStartMs + 20, getMonotonicTimeInMs());
+
+    /* Signaled while it's waiting, and the signal is reset */
+    xThread = kvsThreadCreate(signalEvent, xEvent, 0, -1);
+    ASSERT_NE((KvsThreadHandle)NULL, xThread);
+    EXPECT_EQ(KVS_EVENT_SIGNALED, kvsEventWaitSocket(xEvent, xSockets[0], 5000));
+    kvsThreadJoin(xThread);
+    EXPECT_EQ(0, kvsEventWaitSocket(xEvent, xSockets[0], 0));
+
+    /* The socket stays readable until it's read. */
+    ASSERT_EQ(1, write(xSockets[1], "a", 1));
+    EXPECT_EQ(KVS_EVENT_SOCKET_READABLE, kvsEventWaitSocket(xEvent, xSockets[0], 5000));
+    kvsEventSignal(xEvent);
+    EXPECT_EQ(KVS_EVENT_SIGNALED | KVS_EVENT_SOCKET_READABLE, kvsEventWaitSocket(xEvent, xSockets[0], 5000));
+    ASSERT_EQ(1, read(xSockets[0], &c, 1));
+    EXPECT_EQ(0, kvsEventWaitSocket(xEvent, xSockets[0], 0));
+
+    /* Without a socket, it's the same as kvsEventWait(). */
+    kvsEventSignal(xEvent);
+    EXPECT_EQ(KVS_EVENT_SIGNALED, kvsEventWaitSocket(xEvent, -1, 0));
+
+    close(xSockets[0]);
+    close(xSockets[1]);
+    kvsEventTerminate(xEvent);
+}
@@ -0,0 +1,137 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "stream/recorder.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#define TEST_RECORDER_PREFIX "/tmp/kvs_recorder_test_"
+
+/* EBML header, and a segment of unknown size followed by 4 bytes of segment info */
+static const uint8_t gMkvEbmlSegHdr[] = {0x1A, 0x45, 0xDF, 0xA3, 0x80, 0x18, 0x53, 0x80, 0x67, 0xFF, 0x15, 0x49, 0xA9, 0x66};
+static const size_t gSegmentDataOffset = 10;
+
+static std::string prvReadFile(uint64_t uTimestampMs)
+{
+    std::string xOut;
+    std::string xFilename = TEST_RECORDER_PREFIX + std::to_string(uTimestampMs) + ".mkv";
+    FILE *fp = fopen(xFilename.c_str(), "rb");
+    char pBuf[256];
+    size_t uLen = 0;
+
+    if (fp != NULL)
+    {
+        while ((uLen = fread(pBuf, 1, sizeof(pBuf), fp)) > 0)
+        {
+            xOut.append(pBuf, uLen);
+        }
+        fclose(fp);
+        remove(xFilename.c_str());
+    }
+
+    return xOut;
+}
+
+static void prvWriteCluster(RecorderHandle xRecorderHandle, uint64_t uTimestampMs, const char *pcHdr, const char *pcData)
+{
+    EXPECT_EQ(0, Kvs_recorderWriteDataFrame(xRecorderHandle, uTimestampMs, true, (const uint8_t *)pcHdr, strlen(pcHdr), (const uint8_t *)pcData, strlen(pcData)));
+}
+
+static uint64_t prvGetBE64(const std::string &xStr, size_t uOffset)
+{
+    uint64_t uVal = 0;
+
+    for (size_t i = 0; i < 8; i++)
+    {
+        uVal = (uVal << 8) | (uint8_t)xStr[uOffset + i];
+    }
+
+    return uVal;
+}
+
+TEST(Kvs_recorderCreate, invalid_parameter)
+{
+    RecorderHandle xRecorderHandle = NULL;
+
+    EXPECT_EQ(nullptr, Kvs_recorderCreate(NULL, 1000, 4096));
+    EXPECT_EQ(nullptr, Kvs_recorderCreate(TEST_RECORDER_PREFIX, 1000, 0));
+
+    xRecorderHandle = Kvs_recorderCreate(TEST_RECORDER_PREFIX, 1000, 4096);
+    ASSERT_NE(nullptr, xRecorderHandle);
+
+    /* There is no segment in the header. */
+    EXPECT_NE(0, Kvs_recorderSetMkvEbmlSegHdr(xRecorderHandle, gMkvEbmlSegHdr, 5));
+    EXPECT_NE(0, Kvs_recorderWriteDataFrame(NULL, 0, true, NULL, 0, NULL, 0));
+
+    Kvs_recorderTerminate(xRecorderHandle);
+}
+
+TEST(Kvs_recorderWriteDataFrame, rotate_files_with_cues)
+{
+    RecorderHandle xRecorderHandle = Kvs_recorderCreate(TEST_RECORDER_PREFIX, 1000, 1);
+    std::string xHdr((const char *)gMkvEbmlSegHdr, sizeof(gMkvEbmlSegHdr));
+    std::string xFile;
+    size_t uCuesOffset = 0;
+
+    ASSERT_NE(nullptr, xRecorderHandle);
+    ASSERT_EQ(0, Kvs_recorderSetMkvEbmlSegHdr(xRecorderHandle, gMkvEbmlSegHdr, sizeof(gMkvEbmlSegHdr)));
+
+    /* Frames before the first cluster are ignored. */
+    EXPECT_EQ(0, Kvs_recorderWriteDataFrame(xRecorderHandle, 100, false, (const uint8_t *)"x", 1, (const uint8_t *)"x", 1));
+    prvWriteCluster(xRecorderHandle, 1000, "C1", "AAAA");
+    EXPECT_EQ(0, Kvs_recorderWriteDataFrame(xRecorderHandle, 1500, false, (const uint8_t *)"b", 1, (const uint8_t *)"BB", 2));
+    prvWriteCluster(xRecorderHandle, 1800, "C2", "DD");
+
+    /* The file duration has passed, so this cluster starts a new file. */
+    prvWriteCluster(xRecorderHandle, 2000, "C3", "EE");
+    Kvs_recorderTerminate(xRecorderHandle);
+
+    xFile = prvReadFile(1000);
+    uCuesOffset = xHdr.size() + strlen("C1AAAAbBBC2DD");
+    ASSERT_EQ(uCuesOffset + 12 + 2 * 27, xFile.size());
+    EXPECT_EQ(xHdr + "C1AAAAbBBC2DD", xFile.substr(0, uCuesOffset));
+    EXPECT_EQ(std::string("\x1C\x53\xBB\x6B\x01", 5), xFile.substr(uCuesOffset, 5));
+    EXPECT_EQ(2 * 27, prvGetBE64(xFile, uCuesOffset + 4) & 0x00FFFFFFFFFFFFFFULL);
+
+    /* Cue points have the cluster timestamps and positions relative to the segment data. */
+    EXPECT_EQ(1000, prvGetBE64(xFile, uCuesOffset + 12 + 4));
+    EXPECT_EQ(xHdr.size() - gSegmentDataOffset, prvGetBE64(xFile, uCuesOffset + 12 + 19));
+    EXPECT_EQ(1800, prvGetBE64(xFile, uCuesOffset + 12 + 27 + 4));
+    EXPECT_EQ(xHdr.size() - gSegmentDataOffset + strlen("C1AAAAbBB"), prvGetBE64(xFile, uCuesOffset + 12 + 27 + 19));
+
+    xFile = prvReadFile(2000);
+    ASSERT_EQ(xHdr.size() + 4 + 12 + 27, xFile.size());
+    EXPECT_EQ(xHdr + "C3EE", xFile.substr(0, xHdr.size() + 4));
+}
+
+TEST(Kvs_recorderWriteDataFrame, buffered_until_block_is_full)
+{
+    RecorderHandle xRecorderHandle = Kvs_recorderCreate(TEST_RECORDER_PREFIX, 60 * 1000, 1);
+    std::string xFilename = TEST_RECORDER_PREFIX + std::to_string(3000) + ".mkv";
+    std::string xData(RECORDER_WRITE_BLOCK_SIZE, 'A');
+    FILE *fp = NULL;
+    long xFileLen = 0;
+
+    ASSERT_NE(nullptr, xRecorderHandle);
+    ASSERT_EQ(0, Kvs_recorderSetMkvEbmlSegHdr(xRecorderHandle, gMkvEbmlSegHdr, sizeof(gMkvEbmlSegHdr)));
+    EXPECT_EQ(0, Kvs_recorderWriteDataFrame(xRecorderHandle, 3000, true, NULL, 0, (const uint8_t *)xData.c_str(), xData.size()));
+
+    /* Only a whole block is written, and the rest stays in the buffer. */
+    fp = fopen(xFilename.c_str(), "rb");
+    ASSERT_NE(nullptr, fp);
+    fseek(fp, 0, SEEK_END);
+    xFileLen = ftell(fp);
+    fclose(fp);
+    EXPECT_EQ(RECORDER_WRITE_BLOCK_SIZE, xFileLen);
+
+    /* A new header completes the current file. */
+    EXPECT_EQ(0, Kvs_recorderSetMkvEbmlSegHdr(xRecorderHandle, gMkvEbmlSegHdr, sizeof(gMkvEbmlSegHdr)));
+    EXPECT_EQ(sizeof(gMkvEbmlSegHdr) + xData.size() + 12 + 27, prvReadFile(3000).size());
+
+    Kvs_recorderTerminate(xRecorderHandle);
+}
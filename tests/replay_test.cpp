@@ -0,0 +1,125 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "stream/replay.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+
+static std::string prvReadAll(ReplayHandle xReplayHandle, size_t uMaxLen)
+{
+    std::string xOut;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+
+    while (Kvs_replayRead(xReplayHandle, uMaxLen, &pData, &uDataLen) == KVS_ERRNO_NONE)
+    {
+        xOut.append((const char *)pData, uDataLen);
+    }
+
+    return xOut;
+}
+
+static void prvAppendCluster(ReplayHandle xReplayHandle, uint64_t uTimecodeMs, const char *pcData)
+{
+    Kvs_replayBeginCluster(xReplayHandle, uTimecodeMs);
+    Kvs_replayAppend(xReplayHandle, (const uint8_t *)pcData, strlen(pcData));
+}
+
+TEST(Kvs_replayCreate, invalid_parameter)
+{
+    EXPECT_EQ(nullptr, Kvs_replayCreate(0));
+}
+
+TEST(Kvs_replayRead, replay_clusters_not_acked)
+{
+    ReplayHandle xReplayHandle = Kvs_replayCreate(64);
+
+    ASSERT_NE(nullptr, xReplayHandle);
+
+    /* Bytes before the first cluster are ignored. */
+    Kvs_replayAppend(xReplayHandle, (const uint8_t *)"xx", 2);
+    prvAppendCluster(xReplayHandle, 1000, "AAAA");
+    prvAppendCluster(xReplayHandle, 2000, "BBBB");
+    Kvs_replayAppend(xReplayHandle, (const uint8_t *)"bb", 2);
+    prvAppendCluster(xReplayHandle, 3000, "CC");
+
+    EXPECT_FALSE(Kvs_replayIsPending(xReplayHandle));
+
+    Kvs_replayAck(xReplayHandle, 1000);
+    Kvs_replayRewind(xReplayHandle);
+    EXPECT_TRUE(Kvs_replayIsPending(xReplayHandle));
+    EXPECT_EQ("BBBBbbCC", prvReadAll(xReplayHandle, 3));
+    EXPECT_FALSE(Kvs_replayIsPending(xReplayHandle));
+
+    /* Bytes sent after the replay are not read again until the next rewind. */
+    Kvs_replayAppend(xReplayHandle, (const uint8_t *)"cc", 2);
+    EXPECT_FALSE(Kvs_replayIsPending(xReplayHandle));
+
+    /* An ack of a newer cluster also removes older ones that are never acked. */
+    Kvs_replayAck(xReplayHandle, 2500);
+    Kvs_replayRewind(xReplayHandle);
+    EXPECT_EQ("CCcc", prvReadAll(xReplayHandle, 64));
+
+    Kvs_replayAck(xReplayHandle, 3000);
+    Kvs_replayRewind(xReplayHandle);
+    EXPECT_FALSE(Kvs_replayIsPending(xReplayHandle));
+
+    Kvs_replayTerminate(xReplayHandle);
+}
+
+TEST(Kvs_replayAppend, drop_oldest_and_wrap_around)
+{
+    ReplayHandle xReplayHandle = Kvs_replayCreate(10);
+
+    ASSERT_NE(nullptr, xReplayHandle);
+
+    prvAppendCluster(xReplayHandle, 1000, "AAAA");
+    prvAppendCluster(xReplayHandle, 2000, "BBBB");
+
+    /* The oldest cluster is dropped to make room, and the new one wraps around the end of the ring. */
+    prvAppendCluster(xReplayHandle, 3000, "CCCC");
+    Kvs_replayRewind(xReplayHandle);
+    EXPECT_EQ("BBBBCCCC", prvReadAll(xReplayHandle, 64));
+
+    /* A cluster that doesn't fit is not kept at all, including the rest of it. */
+    prvAppendCluster(xReplayHandle, 4000, "DDDDDD");
+    Kvs_replayAppend(xReplayHandle, (const uint8_t *)"DDDDDD", 6);
+    Kvs_replayAppend(xReplayHandle, (const uint8_t *)"dd", 2);
+    Kvs_replayRewind(xReplayHandle);
+    EXPECT_FALSE(Kvs_replayIsPending(xReplayHandle));
+
+    prvAppendCluster(xReplayHandle, 5000, "EE");
+    Kvs_replayRewind(xReplayHandle);
+    EXPECT_EQ("EE", prvReadAll(xReplayHandle, 64));
+
+    Kvs_replayTerminate(xReplayHandle);
+}
+
+TEST(Kvs_replayAck, ack_while_replaying)
+{
+    ReplayHandle xReplayHandle = Kvs_replayCreate(64);
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+
+    ASSERT_NE(nullptr, xReplayHandle);
+
+    prvAppendCluster(xReplayHandle, 1000, "AAAA");
+    prvAppendCluster(xReplayHandle, 2000, "BBBB");
+
+    Kvs_replayRewind(xReplayHandle);
+    ASSERT_EQ(0, Kvs_replayRead(xReplayHandle, 2, &pData, &uDataLen));
+    EXPECT_EQ(2, uDataLen);
+
+    /* The rest of an acked cluster is skipped, and reading goes on from the next one. */
+    Kvs_replayAck(xReplayHandle, 1000);
+    EXPECT_EQ("BBBB", prvReadAll(xReplayHandle, 64));
+
+    EXPECT_NE(0, Kvs_replayRead(xReplayHandle, 0, &pData, &uDataLen));
+    EXPECT_EQ(KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME, Kvs_replayRead(xReplayHandle, 64, &pData, &uDataLen));
+
+    Kvs_replayTerminate(xReplayHandle);
+}
@@ -0,0 +1,94 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/restapi.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <string>
+
+TEST(Kvs_parseFragmentAck, invalid_parameter)
+{
+    std::string xAck = "14\r\n{\"EventType\":\"IDLE\"}\r\n";
+    ePutMediaFragmentAckEventType eAckEventType = eUnknown;
+    uint64_t uFragmentTimecode = 0;
+    unsigned int uErrorId = 0;
+    size_t uFragAckLen = 0;
+
+    EXPECT_NE(0, Kvs_parseFragmentAck(NULL, xAck.size(), &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen));
+    EXPECT_NE(0, Kvs_parseFragmentAck(xAck.data(), 0, &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen));
+    EXPECT_NE(0, Kvs_parseFragmentAck(xAck.data(), xAck.size(), NULL, &uFragmentTimecode, &uErrorId, &uFragAckLen));
+    EXPECT_NE(0, Kvs_parseFragmentAck(xAck.data(), xAck.size(), &eAckEventType, &uFragmentTimecode, &uErrorId, NULL));
+}
+
+TEST(Kvs_parseFragmentAck, acks_in_a_row)
+{
+    std::string xBody =
+        "5a\r\n{\"EventType\":\"PERSISTED\",\"FragmentTimecode\":1633651200000,\"FragmentNumber\":\"913438523331\"}\r\n"
+        "65\r\n{\"EventType\":\"ERROR\",\"FragmentTimecode\":1633651202000,\"ErrorId\":4002,\"ErrorCode\":\"MAX_FRAGMENT_SIZE\"}\r\n";
+    ePutMediaFragmentAckEventType eAckEventType = eUnknown;
+    uint64_t uFragmentTimecode = 0;
+    unsigned int uErrorId = 0;
+    size_t uFragAckLen = 0;
+
+    ASSERT_EQ(0, Kvs_parseFragmentAck(xBody.data(), xBody.size(), &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen));
+    EXPECT_EQ(ePersisted, eAckEventType);
+    EXPECT_EQ(1633651200000ULL, uFragmentTimecode);
+    EXPECT_EQ(96, uFragAckLen);
+
+    ASSERT_EQ(0, Kvs_parseFragmentAck(xBody.data() + uFragAckLen, xBody.size() - uFragAckLen, &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen));
+    EXPECT_EQ(eError, eAckEventType);
+    EXPECT_EQ(1633651202000ULL, uFragmentTimecode);
+    EXPECT_EQ(4002, uErrorId);
+}
+
+TEST(Kvs_parseFragmentAck, incomplete_ack)
+{
+    std::string xAck = "14\r\n{\"EventType\":\"IDLE\"}\r\n";
+    ePutMediaFragmentAckEventType eAckEventType = eUnknown;
+    uint64_t uFragmentTimecode = 0;
+    unsigned int uErrorId = 0;
+    size_t uFragAckLen = 0;
+
+    for (size_t uLen = 1; uLen < xAck.size(); uLen++)
+    {
+        EXPECT_EQ(KVS_ERROR_INCOMPLETE_FRAGMENT_ACK, Kvs_parseFragmentAck(xAck.data(), uLen, &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen));
+    }
+    ASSERT_EQ(0, Kvs_parseFragmentAck(xAck.data(), xAck.size(), &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen));
+    EXPECT_EQ(eIdle, eAckEventType);
+    EXPECT_EQ(xAck.size(), uFragAckLen);
+
+    /* A huge chunk length doesn't wrap around the buffer length. */
+    xAck = "FFFFFFFFFFFFFFFE\r\n{}\r\n";
+    EXPECT_EQ(KVS_ERROR_INCOMPLETE_FRAGMENT_ACK, Kvs_parseFragmentAck(xAck.data(), xAck.size(), &eAckEventType, &uFragmentTimecode, &uErrorId, &uFragAckLen));
+}
+
+TEST(Kvs_putMediaConnectStart, invalid_parameter)
+{
+    KvsServiceParameter_t xServPara = {0};
+    KvsPutMediaParameter_t xPutMediaPara = {0};
+    PutMediaHandle xPutMediaHandle = NULL;
+
+    xPutMediaPara.pcStreamName = (char *)"stream";
+    EXPECT_NE(0, Kvs_putMediaConnectStart(NULL, &xPutMediaPara, &xPutMediaHandle));
+    /* The data endpoint is needed, but the credentials aren't. */
+    EXPECT_NE(0, Kvs_putMediaConnectStart(&xServPara, &xPutMediaPara, &xPutMediaHandle));
+    xServPara.pcPutMediaEndpoint = (char *)"127.0.0.1";
+    EXPECT_NE(0, Kvs_putMediaConnectStart(&xServPara, NULL, &xPutMediaHandle));
+    EXPECT_NE(0, Kvs_putMediaConnectStart(&xServPara, &xPutMediaPara, NULL));
+    EXPECT_EQ((PutMediaHandle)NULL, xPutMediaHandle);
+}
+
+TEST(Kvs_putMediaStartRequest, invalid_parameter)
+{
+    KvsServiceParameter_t xServPara = {0};
+    KvsPutMediaParameter_t xPutMediaPara = {0};
+
+    EXPECT_NE(0, Kvs_putMediaStartRequest(NULL, &xServPara, &xPutMediaPara));
+}
+
+TEST(Kvs_putMediaEnd, invalid_parameter)
+{
+    EXPECT_NE(0, Kvs_putMediaEnd(NULL));
+}
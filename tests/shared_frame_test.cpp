@@ -0,0 +1,154 @@
+#ifdef __cplusplus
+extern "C" {
+#include "shared_frame/shared_frame.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+/* A 3 bytes start code grows by one byte when it's converted to AVCC. */
+static uint8_t pAnnexBFrame[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+
+static void prvCountDestructor(uint8_t *pData, size_t uLen, void *pAppData)
+{
+    (*(int *)pAppData)++;
+    free(pData);
+}
+
+static uint8_t *prvCopyFrame(const uint8_t *pFrame, size_t uLen)
+{
+    uint8_t *pData = (uint8_t *)malloc(uLen);
+
+    memcpy(pData, pFrame, uLen);
+    return pData;
+}
+
+TEST(SharedFrame, released_by_last_reference)
+{
+    int destructed = 0;
+    SharedFrameDestructorInfo_t xDestructorInfo = {prvCountDestructor, &destructed};
+    SharedFrameHandle xFrame = SharedFrame_create(prvCopyFrame(pAnnexBFrame, sizeof(pAnnexBFrame)), sizeof(pAnnexBFrame), false, &xDestructorInfo);
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+
+    ASSERT_NE(nullptr, xFrame);
+    EXPECT_EQ(xFrame, SharedFrame_retain(xFrame));
+    ASSERT_EQ(0, SharedFrame_getData(xFrame, &pData, &uLen));
+    EXPECT_EQ(sizeof(pAnnexBFrame), uLen);
+
+    SharedFrame_release(xFrame);
+    EXPECT_EQ(0, destructed);
+    SharedFrame_release(xFrame);
+    EXPECT_EQ(1, destructed);
+
+    EXPECT_EQ(nullptr, SharedFrame_create(NULL, 1, false, NULL));
+}
+
+TEST(SharedFrame, avcc_view_keeps_payload)
+{
+    SharedFrameHandle xFrame = SharedFrame_create(prvCopyFrame(pAnnexBFrame, sizeof(pAnnexBFrame)), sizeof(pAnnexBFrame), false, NULL);
+    uint8_t pExpected[] = {0x00, 0x00, 0x00, 0x02, 0x67, 0x64, 0x00, 0x00, 0x00, 0x03, 0x65, 0x88, 0x84};
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    uint8_t *pAvcc = NULL;
+    size_t uAvccLen = 0;
+    uint8_t *pAvcc2 = NULL;
+    size_t uAvccLen2 = 0;
+
+    ASSERT_NE(nullptr, xFrame);
+    ASSERT_EQ(0, SharedFrame_getAvcc(xFrame, &pAvcc, &uAvccLen));
+    ASSERT_EQ(sizeof(pExpected), uAvccLen);
+    EXPECT_EQ(0, memcmp(pExpected, pAvcc, uAvccLen));
+
+    /* The view is derived once, and the payload is not modified. */
+    ASSERT_EQ(0, SharedFrame_getAvcc(xFrame, &pAvcc2, &uAvccLen2));
+    EXPECT_EQ(pAvcc, pAvcc2);
+    ASSERT_EQ(0, SharedFrame_getData(xFrame, &pData, &uLen));
+    EXPECT_EQ(0, memcmp(pAnnexBFrame, pData, sizeof(pAnnexBFrame)));
+
+    SharedFrame_release(xFrame);
+}
+
+TEST(SharedFrame, avcc_payload_is_its_own_view)
+{
+    uint8_t pAvccFrame[] = {0x00, 0x00, 0x00, 0x03, 0x65, 0x88, 0x84};
+    SharedFrameHandle xFrame = SharedFrame_create(prvCopyFrame(pAvccFrame, sizeof(pAvccFrame)), sizeof(pAvccFrame), false, NULL);
+    uint8_t *pData = NULL;
+    size_t uLen = 0;
+    uint8_t *pAvcc = NULL;
+    size_t uAvccLen = 0;
+
+    ASSERT_NE(nullptr, xFrame);
+    ASSERT_EQ(0, SharedFrame_getData(xFrame, &pData, &uLen));
+    ASSERT_EQ(0, SharedFrame_getAvcc(xFrame, &pAvcc, &uAvccLen));
+    EXPECT_EQ(pData, pAvcc);
+    EXPECT_EQ(uLen, uAvccLen);
+
+    SharedFrame_release(xFrame);
+}
+
+TEST(SharedFrame, frame_info_of_avcc_view)
+{
+    SharedFrameHandle xFrame = SharedFrame_create(prvCopyFrame(pAnnexBFrame, sizeof(pAnnexBFrame)), sizeof(pAnnexBFrame), false, NULL);
+    const NaluFrameInfo_t *pxFrameInfo = NULL;
+    const NaluFrameInfo_t *pxFrameInfo2 = NULL;
+    uint8_t *pAvcc = NULL;
+    size_t uAvccLen = 0;
+
+    ASSERT_NE(nullptr, xFrame);
+    ASSERT_EQ(0, SharedFrame_getFrameInfo(xFrame, &pxFrameInfo));
+    ASSERT_EQ(0, SharedFrame_getAvcc(xFrame, &pAvcc, &uAvccLen));
+
+    /* The info describes the AVCC view, so its offsets index into the view. */
+    EXPECT_FALSE(pxFrameInfo->bIsAnnexB);
+    EXPECT_TRUE(pxFrameInfo->bIsKeyFrame);
+    EXPECT_EQ(uAvccLen, pxFrameInfo->uLen);
+    ASSERT_EQ(2u, pxFrameInfo->uNaluCount);
+    EXPECT_EQ(0x65, pAvcc[pxFrameInfo->pxNalus[1].uOffset]);
+    EXPECT_EQ(3u, pxFrameInfo->pxNalus[1].uLen);
+
+    ASSERT_EQ(0, SharedFrame_getFrameInfo(xFrame, &pxFrameInfo2));
+    EXPECT_EQ(pxFrameInfo, pxFrameInfo2);
+    EXPECT_NE(0, SharedFrame_getFrameInfo(xFrame, NULL));
+
+    SharedFrame_release(xFrame);
+}
+
+TEST(SharedFrame, concurrent_consumers)
+{
+    int destructed = 0;
+    SharedFrameDestructorInfo_t xDestructorInfo = {prvCountDestructor, &destructed};
+    SharedFrameHandle xFrame = SharedFrame_create(prvCopyFrame(pAnnexBFrame, sizeof(pAnnexBFrame)), sizeof(pAnnexBFrame), false, &xDestructorInfo);
+    std::vector<std::thread> xThreads;
+    std::vector<uint8_t *> xViews(8);
+    size_t i = 0;
+
+    ASSERT_NE(nullptr, xFrame);
+    for (i = 0; i < xViews.size(); i++)
+    {
+        SharedFrame_retain(xFrame);
+        xThreads.emplace_back([&xFrame, &xViews, i] {
+            size_t uLen = 0;
+
+            SharedFrame_getAvcc(xFrame, &xViews[i], &uLen);
+            SharedFrame_release(xFrame);
+        });
+    }
+    for (std::thread &xThread : xThreads)
+    {
+        xThread.join();
+    }
+
+    /* All consumers see the same view, and the frame is alive until the creator releases it. */
+    for (i = 0; i < xViews.size(); i++)
+    {
+        EXPECT_EQ(xViews[0], xViews[i]);
+    }
+    EXPECT_EQ(0, destructed);
+    SharedFrame_release(xFrame);
+    EXPECT_EQ(1, destructed);
+}
@@ -0,0 +1,574 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/pool_allocator.h"
+}
+#endif
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+/* The memory of a device built with USE_POOL_ALLOCATOR_ALL, i.e. POOL_ALLOCATOR_SIZE of the T31 sample. */
+#define SOAK_POOL_SIZE              (2 * 1024 * 1024 + 128 * 1024 + 1536 * 1024)
+#define SOAK_RING_BUFFER_LIMIT      (2 * 1024 * 1024)
+
+/* The pool of media in the split layout has this headroom above the ring buffer limit for the frame metadata. */
+#define SOAK_MEDIA_POOL_HEADROOM    (256 * 1024)
+
+#define SOAK_VIDEO_FPS              (25)
+#define SOAK_GOP_FRAMES             (50)
+#define SOAK_AUDIO_FRAME_MS         (20)
+#define SOAK_FRAGMENT_MS            (SOAK_GOP_FRAMES * 1000 / SOAK_VIDEO_FPS)
+#define SOAK_TICK_MS                (1000 / SOAK_VIDEO_FPS)
+
+/* mbedTLS record buffers of MBEDTLS_SSL_IN_CONTENT_LEN and MBEDTLS_SSL_OUT_CONTENT_LEN of 16 KB with the overhead. */
+#define SOAK_TLS_RECORD_BUF_SIZE    (16 * 1024 + 29 + 256)
+
+#define SOAK_MS_PER_HOUR            (60ULL * 60 * 1000)
+#define SOAK_MS_PER_DAY             (24 * SOAK_MS_PER_HOUR)
+
+/* The largest free block is sampled this often between reports, so its minimum catches the stalls. */
+#define SOAK_SAMPLE_MS              (60 * 1000)
+
+typedef enum SoakLifetime
+{
+    /* Frames and their metadata, which live until they're sent or dropped. */
+    SOAK_LIFETIME_MEDIA = 0,
+
+    /* TLS contexts, certificates and credentials, which live until the next reconnection. */
+    SOAK_LIFETIME_CONNECTION,
+
+    /* HTTP requests, handshakes and parsed acks, which are freed right away. */
+    SOAK_LIFETIME_TRANSIENT,
+
+    SOAK_LIFETIME_COUNT
+} SoakLifetime_t;
+
+typedef struct SoakBlock
+{
+    void *ptr;
+    SoakLifetime_t xLifetime;
+} SoakBlock_t;
+
+typedef struct SoakFrame
+{
+    SoakBlock_t xData;
+    SoakBlock_t xMeta;
+    size_t uSize;
+    uint64_t uSendAtMs;
+} SoakFrame_t;
+
+/**
+ * A layout of the pool allocator under test. Each lifetime is allocated from one of the pools, or from the pool of
+ * poolAllocatorInit() if the layout has no pools, which keeps small blocks in the thread cache.
+ */
+typedef struct SoakLayout
+{
+    const char *pcName;
+    std::vector<PoolAllocatorHandle> xPools;
+    std::vector<std::string> xPoolNames;
+    size_t pxPoolOfLifetime[SOAK_LIFETIME_COUNT];
+} SoakLayout_t;
+
+typedef struct SoakCounters
+{
+    uint64_t uAllocs;
+    uint64_t uAllocFailures;
+    uint64_t uDroppedFrames;
+    uint64_t uReconnections;
+    uint64_t uAcks;
+} SoakCounters_t;
+
+/* xorshift64*, so a seed replays the same trace on every platform. */
+static uint64_t uRandState = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t prvRand()
+{
+    uRandState ^= uRandState >> 12;
+    uRandState ^= uRandState << 25;
+    uRandState ^= uRandState >> 27;
+    return uRandState * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t prvRandRange(size_t uMin, size_t uMax)
+{
+    return uMin + (size_t)(prvRand() % (uint64_t)(uMax - uMin + 1));
+}
+
+static bool prvRandChance(double dProbability)
+{
+    return (double)(prvRand() >> 11) / (double)(1ULL << 53) < dProbability;
+}
+
+/* Sizes of the recorded frames in the order of the stream, so key frames come with their GOP. */
+static std::vector<size_t> prvLoadFrameSizes(const std::string &xDir)
+{
+    std::vector<std::string> xNames;
+    std::vector<size_t> xSizes;
+    DIR *pxDir = opendir(xDir.c_str());
+    struct dirent *pxEntry = NULL;
+    struct stat xStat;
+
+    if (pxDir != NULL)
+    {
+        while ((pxEntry = readdir(pxDir)) != NULL)
+        {
+            if (pxEntry->d_name[0] != '.')
+            {
+                xNames.push_back(pxEntry->d_name);
+            }
+        }
+        closedir(pxDir);
+    }
+
+    std::sort(xNames.begin(), xNames.end());
+    for (const std::string &xName : xNames)
+    {
+        if (stat((xDir + "/" + xName).c_str(), &xStat) == 0 && xStat.st_size > 0)
+        {
+            xSizes.push_back((size_t)xStat.st_size);
+        }
+    }
+
+    return xSizes;
+}
+
+class SoakHeap
+{
+public:
+    SoakHeap(SoakLayout_t &xLayout, SoakCounters_t &xCounters) : mxLayout(xLayout), mxCounters(xCounters) {}
+
+    SoakBlock_t alloc(SoakLifetime_t xLifetime, size_t uSize)
+    {
+        SoakBlock_t xBlock = {NULL, xLifetime};
+
+        if (mxLayout.xPools.empty())
+        {
+            xBlock.ptr = poolAllocatorMalloc(uSize);
+        }
+        else
+        {
+            xBlock.ptr = poolAllocatorMallocFrom(mxLayout.xPools[mxLayout.pxPoolOfLifetime[xLifetime]], uSize);
+        }
+
+        mxCounters.uAllocs++;
+        if (xBlock.ptr == NULL)
+        {
+            mxCounters.uAllocFailures++;
+        }
+        else
+        {
+            /* Touch the block like its owner would, so a broken pool crashes here instead of passing silently. */
+            memset(xBlock.ptr, 0xA5, std::min(uSize, (size_t)64));
+        }
+
+        return xBlock;
+    }
+
+    void free(SoakBlock_t &xBlock)
+    {
+        if (xBlock.ptr == NULL)
+        {
+            /* nop */
+        }
+        else if (mxLayout.xPools.empty())
+        {
+            poolAllocatorFree(xBlock.ptr);
+        }
+        else
+        {
+            poolAllocatorFreeFrom(mxLayout.xPools[mxLayout.pxPoolOfLifetime[xBlock.xLifetime]], xBlock.ptr);
+        }
+        xBlock.ptr = NULL;
+    }
+
+private:
+    SoakLayout_t &mxLayout;
+    SoakCounters_t &mxCounters;
+};
+
+/**
+ * The allocation trace of a KVS producer with its network. Frames are queued until they're sent, or dropped from the
+ * head like STREAM_POLICY_RING_BUFFER. The uplink stalls from time to time, and the connection is made again after a
+ * stall and periodically for new credentials, which frees and allocates the TLS contexts in between the frames.
+ */
+class SoakProducer
+{
+public:
+    SoakProducer(SoakHeap &xHeap, SoakCounters_t &xCounters, const std::vector<size_t> &xFrameSizes)
+        : mxHeap(xHeap), mxCounters(xCounters), mxFrameSizes(xFrameSizes)
+    {
+    }
+
+    ~SoakProducer()
+    {
+        while (!mxFrames.empty())
+        {
+            prvPopFrame();
+        }
+        prvDisconnect();
+        mxHeap.free(mxCredential);
+    }
+
+    void tick(uint64_t uNowMs)
+    {
+        size_t i = 0;
+
+        if (uNowMs >= muStallUntilMs && !mbConnected)
+        {
+            prvConnect(uNowMs);
+        }
+        else if (mbConnected && uNowMs >= muReconnectAtMs)
+        {
+            prvDisconnect();
+            prvConnect(uNowMs);
+        }
+        else if (mbConnected && muStallUntilMs <= uNowMs && prvRandChance(2.0 * SOAK_TICK_MS / SOAK_MS_PER_HOUR))
+        {
+            /* A stall of about twice an hour, from seconds to minutes, and the connection is dropped by it. */
+            muStallUntilMs = uNowMs + prvRandRange(5 * 1000, 5 * 60 * 1000);
+            prvDisconnect();
+        }
+
+        prvAddVideoFrame(uNowMs);
+        for (i = 0; i < SOAK_TICK_MS / SOAK_AUDIO_FRAME_MS; i++)
+        {
+            prvAddFrame(uNowMs, prvRandRange(200, 400));
+        }
+
+        if (mbConnected)
+        {
+            prvSend(uNowMs);
+        }
+    }
+
+private:
+    void prvAddVideoFrame(uint64_t uNowMs)
+    {
+        size_t uSize = 0;
+
+        if (!mxFrameSizes.empty())
+        {
+            uSize = mxFrameSizes[muVideoFrames % mxFrameSizes.size()];
+        }
+        else if (muVideoFrames % SOAK_GOP_FRAMES == 0)
+        {
+            uSize = prvRandRange(40 * 1024, 120 * 1024);
+        }
+        else
+        {
+            uSize = prvRandRange(2 * 1024, 20 * 1024);
+        }
+
+        /* The encoder varies the frame sizes around the recorded ones. */
+        uSize = uSize * prvRandRange(80, 120) / 100;
+        muVideoFrames++;
+
+        prvAddFrame(uNowMs, uSize);
+    }
+
+    void prvAddFrame(uint64_t uNowMs, size_t uSize)
+    {
+        SoakFrame_t xFrame;
+
+        /* The ring buffer drops the oldest frames to make room, including frames that fail to be allocated. */
+        while (!mxFrames.empty() && muQueuedBytes + uSize > SOAK_RING_BUFFER_LIMIT)
+        {
+            prvPopFrame();
+            mxCounters.uDroppedFrames++;
+        }
+
+        xFrame.uSize = uSize;
+        xFrame.uSendAtMs = uNowMs + prvRandRange(50, 800);
+        xFrame.xData = mxHeap.alloc(SOAK_LIFETIME_MEDIA, uSize);
+        xFrame.xMeta = mxHeap.alloc(SOAK_LIFETIME_MEDIA, prvRandRange(80, 160));
+        if (xFrame.xData.ptr == NULL || xFrame.xMeta.ptr == NULL)
+        {
+            mxHeap.free(xFrame.xData);
+            mxHeap.free(xFrame.xMeta);
+            mxCounters.uDroppedFrames++;
+        }
+        else
+        {
+            mxFrames.push_back(xFrame);
+            muQueuedBytes += uSize;
+        }
+    }
+
+    void prvPopFrame()
+    {
+        SoakFrame_t &xFrame = mxFrames.front();
+
+        mxHeap.free(xFrame.xData);
+        mxHeap.free(xFrame.xMeta);
+        muQueuedBytes -= xFrame.uSize;
+        mxFrames.pop_front();
+    }
+
+    void prvSend(uint64_t uNowMs)
+    {
+        /* A sent frame is freed, and the MKV header of its simple block is built on the fly. */
+        while (!mxFrames.empty() && mxFrames.front().uSendAtMs <= uNowMs)
+        {
+            SoakBlock_t xHdr = mxHeap.alloc(SOAK_LIFETIME_TRANSIENT, prvRandRange(32, 64));
+
+            mxHeap.free(xHdr);
+            prvPopFrame();
+        }
+
+        /* Fragments are acked as buffering, received and persisted, and the acks of a stall come in a burst. */
+        while (muNextAckMs <= uNowMs)
+        {
+            prvParseAck();
+            prvParseAck();
+            prvParseAck();
+            muNextAckMs += SOAK_FRAGMENT_MS;
+        }
+    }
+
+    void prvParseAck()
+    {
+        SoakBlock_t pxBlocks[8];
+        size_t uCount = prvRandRange(4, 8);
+        size_t i = 0;
+
+        for (i = 0; i < uCount; i++)
+        {
+            pxBlocks[i] = mxHeap.alloc(SOAK_LIFETIME_TRANSIENT, prvRandRange(24, 256));
+        }
+        for (i = 0; i < uCount; i++)
+        {
+            mxHeap.free(pxBlocks[i]);
+        }
+        mxCounters.uAcks++;
+    }
+
+    void prvConnect(uint64_t uNowMs)
+    {
+        std::vector<SoakBlock_t> xTransient;
+        size_t i = 0;
+
+        /* Credentials are kept for an hour, and they're got again with a request of their own. */
+        if (mxCredential.ptr == NULL || uNowMs >= muCredentialExpiryMs)
+        {
+            mxHeap.free(mxCredential);
+            xTransient.push_back(mxHeap.alloc(SOAK_LIFETIME_TRANSIENT, prvRandRange(1024, 4096)));
+            mxCredential = mxHeap.alloc(SOAK_LIFETIME_CONNECTION, prvRandRange(1024, 2048));
+            muCredentialExpiryMs = uNowMs + SOAK_MS_PER_HOUR;
+        }
+
+        /* Describe stream and get data endpoint, each with its own request and response. */
+        for (i = 0; i < 4; i++)
+        {
+            xTransient.push_back(mxHeap.alloc(SOAK_LIFETIME_TRANSIENT, prvRandRange(512, 4096)));
+        }
+
+        /* The TLS context, record buffers, and the CA and client certificates parsed into many small blocks. */
+        mxConnection.push_back(mxHeap.alloc(SOAK_LIFETIME_CONNECTION, 700));
+        mxConnection.push_back(mxHeap.alloc(SOAK_LIFETIME_CONNECTION, SOAK_TLS_RECORD_BUF_SIZE));
+        mxConnection.push_back(mxHeap.alloc(SOAK_LIFETIME_CONNECTION, SOAK_TLS_RECORD_BUF_SIZE));
+        for (i = 0; i < 40; i++)
+        {
+            mxConnection.push_back(mxHeap.alloc(SOAK_LIFETIME_CONNECTION, prvRandRange(32, 1600)));
+        }
+
+        /* The handshake frees its key exchange and the certificate chain of the server when it's done. */
+        for (i = 0; i < 30; i++)
+        {
+            xTransient.push_back(mxHeap.alloc(SOAK_LIFETIME_TRANSIENT, prvRandRange(64, 2048)));
+        }
+
+        /* The PUT MEDIA request headers and the receive buffer of acks live with the connection. */
+        mxConnection.push_back(mxHeap.alloc(SOAK_LIFETIME_CONNECTION, prvRandRange(1024, 1536)));
+        mxConnection.push_back(mxHeap.alloc(SOAK_LIFETIME_CONNECTION, 2048));
+
+        for (SoakBlock_t &xBlock : xTransient)
+        {
+            mxHeap.free(xBlock);
+        }
+
+        mbConnected = true;
+        muNextAckMs = uNowMs + SOAK_FRAGMENT_MS;
+        muReconnectAtMs = uNowMs + prvRandRange(30, 90) * 60 * 1000;
+        mxCounters.uReconnections++;
+    }
+
+    void prvDisconnect()
+    {
+        for (SoakBlock_t &xBlock : mxConnection)
+        {
+            mxHeap.free(xBlock);
+        }
+        mxConnection.clear();
+        mbConnected = false;
+    }
+
+    SoakHeap &mxHeap;
+    SoakCounters_t &mxCounters;
+    const std::vector<size_t> &mxFrameSizes;
+
+    std::deque<SoakFrame_t> mxFrames;
+    size_t muQueuedBytes = 0;
+    uint64_t muVideoFrames = 0;
+
+    std::vector<SoakBlock_t> mxConnection;
+    SoakBlock_t mxCredential = {NULL, SOAK_LIFETIME_CONNECTION};
+    uint64_t muCredentialExpiryMs = 0;
+    bool mbConnected = false;
+    uint64_t muReconnectAtMs = 0;
+    uint64_t muStallUntilMs = 0;
+    uint64_t muNextAckMs = 0;
+};
+
+static void prvGetStats(const SoakLayout_t &xLayout, size_t uPool, PoolStats_t *pxStats)
+{
+    if (xLayout.xPools.empty())
+    {
+        poolAllocatorGetStats(pxStats);
+    }
+    else
+    {
+        poolAllocatorGetStatsFrom(xLayout.xPools[uPool], pxStats);
+    }
+}
+
+/* The share of free memory that can't be allocated as one block. */
+static double prvFragmentation(const PoolStats_t &xStats)
+{
+    return (xStats.uSumOfFreeMemory == 0) ? 0.0 : 1.0 - (double)xStats.uSizeOfLargestFreeBlock / (double)xStats.uSumOfFreeMemory;
+}
+
+static void prvSample(const SoakLayout_t &xLayout, std::vector<size_t> &xMinLargestFree)
+{
+    PoolStats_t xStats;
+    size_t i = 0;
+
+    for (i = 0; i < xMinLargestFree.size(); i++)
+    {
+        prvGetStats(xLayout, i, &xStats);
+        xMinLargestFree[i] = std::min(xMinLargestFree[i], xStats.uSizeOfLargestFreeBlock);
+    }
+}
+
+static void prvReport(const SoakLayout_t &xLayout, uint64_t uNowMs, const SoakCounters_t &xCounters, std::vector<size_t> &xMinLargestFree)
+{
+    PoolStats_t xStats;
+    size_t i = 0;
+
+    prvSample(xLayout, xMinLargestFree);
+    for (i = 0; i < xMinLargestFree.size(); i++)
+    {
+        prvGetStats(xLayout, i, &xStats);
+        printf("%-8s %-10s %6.2f %9zu %9zu %6zu %9zu %9zu %6.3f %8llu %8llu\n", xLayout.pcName, xLayout.xPoolNames[i].c_str(), (double)uNowMs / SOAK_MS_PER_DAY,
+               xStats.uSumOfUsedMemory, xStats.uSumOfFreeMemory, xStats.uNumberOfFreeBlocks, xStats.uSizeOfLargestFreeBlock, xMinLargestFree[i],
+               prvFragmentation(xStats), (unsigned long long)xCounters.uAllocFailures, (unsigned long long)xCounters.uDroppedFrames);
+    }
+}
+
+static void prvSoak(SoakLayout_t &xLayout, uint64_t uDurationMs, uint64_t uReportMs, uint64_t uSeed, const std::vector<size_t> &xFrameSizes)
+{
+    SoakCounters_t xCounters = {0};
+    std::vector<size_t> xMinLargestFree(std::max(xLayout.xPools.size(), (size_t)1), (size_t)-1);
+    auto xStart = std::chrono::steady_clock::now();
+    uint64_t uNowMs = 0;
+
+    uRandState = uSeed;
+
+    {
+        SoakHeap xHeap(xLayout, xCounters);
+        SoakProducer xProducer(xHeap, xCounters, xFrameSizes);
+
+        for (uNowMs = 0; uNowMs < uDurationMs; uNowMs += SOAK_TICK_MS)
+        {
+            xProducer.tick(uNowMs);
+            if (uNowMs % uReportMs == 0 && uNowMs > 0)
+            {
+                prvReport(xLayout, uNowMs, xCounters, xMinLargestFree);
+            }
+            else if (uNowMs % SOAK_SAMPLE_MS == 0)
+            {
+                prvSample(xLayout, xMinLargestFree);
+            }
+        }
+        prvReport(xLayout, uNowMs, xCounters, xMinLargestFree);
+    }
+
+    printf("%-8s %llu allocs, %llu failures, %llu dropped frames, %llu acks, %llu connections in %.1f s\n\n", xLayout.pcName,
+           (unsigned long long)xCounters.uAllocs, (unsigned long long)xCounters.uAllocFailures, (unsigned long long)xCounters.uDroppedFrames,
+           (unsigned long long)xCounters.uAcks, (unsigned long long)xCounters.uReconnections,
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - xStart).count());
+}
+
+static void prvPrintUsage(const char *pcProgram)
+{
+    printf("Usage: %s [days] [report hours] [seed] [media dir]\n", pcProgram);
+}
+
+/**
+ * Replay days of a producer's allocations in an accelerated loop against the pool allocator, and report the
+ * fragmentation of PoolStats_t and the largest free block over the simulated time. Layouts are:
+ *  - single:  one pool of poolAllocatorCreate() for everything, like USE_POOL_ALLOCATOR_ALL.
+ *  - default: the pool of poolAllocatorInit(), whose thread cache keeps small blocks of size classes.
+ *  - split:   a pool of media and a pool of the rest, so frames don't fragment around long-lived TLS contexts.
+ */
+int main(int argc, char *argv[])
+{
+    double dDays = (argc > 1) ? atof(argv[1]) : 5.0;
+    double dReportHours = (argc > 2) ? atof(argv[2]) : 6.0;
+    uint64_t uSeed = (argc > 3) ? strtoull(argv[3], NULL, 0) : 1;
+    std::string xMediaDir = (argc > 4) ? argv[4] : SOAK_MEDIA_DIR;
+    std::vector<size_t> xFrameSizes = prvLoadFrameSizes(xMediaDir);
+    uint64_t uDurationMs = (uint64_t)(dDays * SOAK_MS_PER_DAY);
+    uint64_t uReportMs = (uint64_t)(dReportHours * SOAK_MS_PER_HOUR) / SOAK_TICK_MS * SOAK_TICK_MS;
+    std::vector<uint8_t> xMemPool(SOAK_POOL_SIZE + 16);
+    uint8_t *pMemPool = (uint8_t *)(((uintptr_t)xMemPool.data() + 15) & ~(uintptr_t)15);
+    size_t uMediaPoolSize = SOAK_RING_BUFFER_LIMIT + SOAK_MEDIA_POOL_HEADROOM;
+    SoakLayout_t xLayout;
+
+    if (dDays <= 0 || uReportMs == 0 || uSeed == 0)
+    {
+        prvPrintUsage(argv[0]);
+        return 1;
+    }
+
+    printf("%.2f days, %zu recorded frame sizes from %s, seed %llu\n", dDays, xFrameSizes.size(), xMediaDir.c_str(), (unsigned long long)uSeed);
+    printf("%-8s %-10s %6s %9s %9s %6s %9s %9s %6s %8s %8s\n", "layout", "pool", "days", "used", "free", "blocks", "largest", "min", "frag", "failures",
+           "dropped");
+
+    xLayout.pcName = "single";
+    xLayout.xPools.push_back(poolAllocatorCreate(pMemPool, SOAK_POOL_SIZE));
+    xLayout.xPoolNames.push_back("all");
+    std::fill(xLayout.pxPoolOfLifetime, xLayout.pxPoolOfLifetime + SOAK_LIFETIME_COUNT, 0);
+    prvSoak(xLayout, uDurationMs, uReportMs, uSeed, xFrameSizes);
+    poolAllocatorTerminate(xLayout.xPools[0]);
+
+    xLayout.pcName = "default";
+    xLayout.xPools.clear();
+    if (poolAllocatorInit(pMemPool, SOAK_POOL_SIZE) == 0)
+    {
+        prvSoak(xLayout, uDurationMs, uReportMs, uSeed, xFrameSizes);
+        poolAllocatorDeinit();
+    }
+
+    xLayout.pcName = "split";
+    xLayout.xPools.push_back(poolAllocatorCreate(pMemPool, uMediaPoolSize));
+    xLayout.xPools.push_back(poolAllocatorCreate(pMemPool + uMediaPoolSize, SOAK_POOL_SIZE - uMediaPoolSize));
+    xLayout.xPoolNames.assign({"media", "other"});
+    xLayout.pxPoolOfLifetime[SOAK_LIFETIME_MEDIA] = 0;
+    xLayout.pxPoolOfLifetime[SOAK_LIFETIME_CONNECTION] = 1;
+    xLayout.pxPoolOfLifetime[SOAK_LIFETIME_TRANSIENT] = 1;
+    prvSoak(xLayout, uDurationMs, uReportMs, uSeed, xFrameSizes);
+    poolAllocatorTerminate(xLayout.xPools[0]);
+    poolAllocatorTerminate(xLayout.xPools[1]);
+
+    return 0;
+}
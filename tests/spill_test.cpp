@@ -0,0 +1,196 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "stream/spill.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string>
+
+static std::string prvSpillFilename()
+{
+    return ::testing::TempDir() + "kvs_spill_test.bin";
+}
+
+static int prvAppendRecord(SpillHandle xSpillHandle, uint64_t uTimestampMs, MkvClusterType_t xClusterType, uint8_t *pData, size_t uDataLen)
+{
+    SpillRecordInfo_t xInfo = {};
+    uint8_t pMkvHeader[] = {0xA3, 0x80, 0x81};
+
+    xInfo.uTimestampMs = uTimestampMs;
+    xInfo.xTrackType = TRACK_VIDEO;
+    xInfo.xClusterType = xClusterType;
+
+    return Kvs_spillAppend(xSpillHandle, &xInfo, pMkvHeader, sizeof(pMkvHeader), pData, uDataLen);
+}
+
+TEST(Kvs_spillCreate, invalid_parameter)
+{
+    EXPECT_EQ(nullptr, Kvs_spillCreate(NULL, 1024));
+    EXPECT_EQ(nullptr, Kvs_spillCreate(prvSpillFilename().c_str(), 0));
+}
+
+TEST(Kvs_spillReadRecord, sequential_read_in_parts)
+{
+    std::string xFilename = prvSpillFilename();
+    SpillHandle xSpillHandle = Kvs_spillCreate(xFilename.c_str(), 1024);
+    SpillRecordInfo_t xInfo = {};
+    uint8_t pData[100];
+    uint8_t pBuf[64];
+    size_t uReadLen = 0;
+
+    ASSERT_NE(nullptr, xSpillHandle);
+    for (size_t i = 0; i < sizeof(pData); i++)
+    {
+        pData[i] = (uint8_t)i;
+    }
+
+    EXPECT_TRUE(Kvs_spillIsEmpty(xSpillHandle));
+    EXPECT_EQ(KVS_ERROR_STREAM_NO_AVAILABLE_DATA_FRAME, Kvs_spillPeekRecord(xSpillHandle, &xInfo));
+
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 1000, MKV_CLUSTER, pData, sizeof(pData)));
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 1033, MKV_SIMPLE_BLOCK, pData, 10));
+    EXPECT_FALSE(Kvs_spillIsEmpty(xSpillHandle));
+
+    /* The first record is MKV header and data, and it's read in 2 parts. */
+    ASSERT_EQ(0, Kvs_spillPeekRecord(xSpillHandle, &xInfo));
+    EXPECT_EQ(1000, xInfo.uTimestampMs);
+    EXPECT_EQ(MKV_CLUSTER, xInfo.xClusterType);
+    EXPECT_EQ(103, xInfo.uLen);
+    EXPECT_EQ(103, xInfo.uRemainingLen);
+
+    ASSERT_EQ(0, Kvs_spillReadRecord(xSpillHandle, pBuf, sizeof(pBuf), &uReadLen));
+    EXPECT_EQ(64, uReadLen);
+    EXPECT_EQ(0xA3, pBuf[0]);
+    EXPECT_EQ(0, pBuf[3]);
+    EXPECT_EQ(60, pBuf[63]);
+    ASSERT_EQ(0, Kvs_spillPeekRecord(xSpillHandle, &xInfo));
+    EXPECT_EQ(39, xInfo.uRemainingLen);
+
+    ASSERT_EQ(0, Kvs_spillReadRecord(xSpillHandle, pBuf, sizeof(pBuf), &uReadLen));
+    EXPECT_EQ(39, uReadLen);
+    EXPECT_EQ(61, pBuf[0]);
+    EXPECT_EQ(99, pBuf[38]);
+
+    /* Then it goes to the next record. */
+    ASSERT_EQ(0, Kvs_spillPeekRecord(xSpillHandle, &xInfo));
+    EXPECT_EQ(1033, xInfo.uTimestampMs);
+    EXPECT_EQ(MKV_SIMPLE_BLOCK, xInfo.xClusterType);
+    ASSERT_EQ(0, Kvs_spillSkipRecord(xSpillHandle));
+    EXPECT_TRUE(Kvs_spillIsEmpty(xSpillHandle));
+
+    Kvs_spillTerminate(xSpillHandle);
+    remove(xFilename.c_str());
+}
+
+TEST(Kvs_spillAppend, full_and_start_over)
+{
+    std::string xFilename = prvSpillFilename();
+    SpillHandle xSpillHandle = Kvs_spillCreate(xFilename.c_str(), 512);
+    uint8_t pData[200] = {0};
+
+    ASSERT_NE(nullptr, xSpillHandle);
+
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 0, MKV_CLUSTER, pData, sizeof(pData)));
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 33, MKV_SIMPLE_BLOCK, pData, sizeof(pData)));
+    EXPECT_EQ(KVS_ERROR_STREAM_SPILL_FULL, prvAppendRecord(xSpillHandle, 66, MKV_SIMPLE_BLOCK, pData, sizeof(pData)));
+
+    /* Space is reclaimed once all records are consumed. */
+    ASSERT_EQ(0, Kvs_spillSkipRecord(xSpillHandle));
+    EXPECT_EQ(KVS_ERROR_STREAM_SPILL_FULL, prvAppendRecord(xSpillHandle, 66, MKV_SIMPLE_BLOCK, pData, sizeof(pData)));
+    ASSERT_EQ(0, Kvs_spillSkipRecord(xSpillHandle));
+    EXPECT_EQ(0, prvAppendRecord(xSpillHandle, 100, MKV_CLUSTER, pData, sizeof(pData)));
+
+    Kvs_spillTerminate(xSpillHandle);
+    remove(xFilename.c_str());
+}
+
+TEST(Kvs_spillRecover, skip_persisted_fragments)
+{
+    std::string xFilename = prvSpillFilename();
+    SpillHandle xSpillHandle = Kvs_spillCreate(xFilename.c_str(), 1024);
+    SpillRecordInfo_t xInfo = {};
+    uint8_t pData[50] = {0};
+
+    ASSERT_NE(nullptr, xSpillHandle);
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 1000, MKV_CLUSTER, pData, sizeof(pData)));
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 1033, MKV_SIMPLE_BLOCK, pData, sizeof(pData)));
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 2000, MKV_CLUSTER, pData, sizeof(pData)));
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 2033, MKV_SIMPLE_BLOCK, pData, sizeof(pData)));
+    Kvs_spillTerminate(xSpillHandle);
+
+    /* The fragment of 1000 is persisted, so the records are recovered from the cluster of 2000. */
+    xSpillHandle = Kvs_spillRecover(xFilename.c_str(), 1024, 1000);
+    ASSERT_NE(nullptr, xSpillHandle);
+    ASSERT_EQ(0, Kvs_spillPeekRecord(xSpillHandle, &xInfo));
+    EXPECT_EQ(2000, xInfo.uTimestampMs);
+    EXPECT_EQ(MKV_CLUSTER, xInfo.xClusterType);
+    ASSERT_EQ(0, Kvs_spillSkipRecord(xSpillHandle));
+
+    /* New records are appended after the recovered ones. */
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 3000, MKV_CLUSTER, pData, sizeof(pData)));
+    ASSERT_EQ(0, Kvs_spillPeekRecord(xSpillHandle, &xInfo));
+    EXPECT_EQ(2033, xInfo.uTimestampMs);
+    ASSERT_EQ(0, Kvs_spillSkipRecord(xSpillHandle));
+    ASSERT_EQ(0, Kvs_spillPeekRecord(xSpillHandle, &xInfo));
+    EXPECT_EQ(3000, xInfo.uTimestampMs);
+    ASSERT_EQ(0, Kvs_spillSkipRecord(xSpillHandle));
+    EXPECT_TRUE(Kvs_spillIsEmpty(xSpillHandle));
+
+    /* After the log starts over, older records behind the new one are not recovered. */
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 4000, MKV_CLUSTER, pData, sizeof(pData)));
+    Kvs_spillTerminate(xSpillHandle);
+
+    xSpillHandle = Kvs_spillRecover(xFilename.c_str(), 1024, 0);
+    ASSERT_NE(nullptr, xSpillHandle);
+    ASSERT_EQ(0, Kvs_spillPeekRecord(xSpillHandle, &xInfo));
+    EXPECT_EQ(4000, xInfo.uTimestampMs);
+    ASSERT_EQ(0, Kvs_spillSkipRecord(xSpillHandle));
+    EXPECT_TRUE(Kvs_spillIsEmpty(xSpillHandle));
+
+    Kvs_spillTerminate(xSpillHandle);
+    remove(xFilename.c_str());
+}
+
+TEST(Kvs_spillRecover, create_if_size_changed)
+{
+    std::string xFilename = prvSpillFilename();
+    SpillHandle xSpillHandle = Kvs_spillCreate(xFilename.c_str(), 1024);
+    uint8_t pData[50] = {0};
+
+    ASSERT_NE(nullptr, xSpillHandle);
+    ASSERT_EQ(0, prvAppendRecord(xSpillHandle, 1000, MKV_CLUSTER, pData, sizeof(pData)));
+    Kvs_spillTerminate(xSpillHandle);
+
+    xSpillHandle = Kvs_spillRecover(xFilename.c_str(), 2048, 0);
+    ASSERT_NE(nullptr, xSpillHandle);
+    EXPECT_TRUE(Kvs_spillIsEmpty(xSpillHandle));
+
+    Kvs_spillTerminate(xSpillHandle);
+    remove(xFilename.c_str());
+}
+
+TEST(Kvs_spillSaveCheckpoint, save_and_load)
+{
+    std::string xFilename = ::testing::TempDir() + "kvs_checkpoint_test.bin";
+    uint64_t uTimecodeMs = 0;
+    FILE *fp = NULL;
+
+    remove(xFilename.c_str());
+    EXPECT_EQ(KVS_ERROR_STREAM_SPILL_IO_ERROR, Kvs_spillLoadCheckpoint(xFilename.c_str(), &uTimecodeMs));
+
+    ASSERT_EQ(0, Kvs_spillSaveCheckpoint(xFilename.c_str(), 1620367399995ULL));
+    ASSERT_EQ(0, Kvs_spillLoadCheckpoint(xFilename.c_str(), &uTimecodeMs));
+    EXPECT_EQ(1620367399995ULL, uTimecodeMs);
+
+    /* A torn checkpoint is invalid. */
+    ASSERT_NE(nullptr, fp = fopen(xFilename.c_str(), "r+b"));
+    fseek(fp, 8, SEEK_SET);
+    fputc(0x5A, fp);
+    fclose(fp);
+    EXPECT_EQ(KVS_ERROR_STREAM_SPILL_IO_ERROR, Kvs_spillLoadCheckpoint(xFilename.c_str(), &uTimecodeMs));
+
+    remove(xFilename.c_str());
+}
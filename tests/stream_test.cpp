@@ -0,0 +1,835 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/mkv_generator.h"
+#include "kvs/stream.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+static uint8_t pCodecPrivate[] = {0x01, 0x64, 0x00, 0x0A, 0xFF, 0xE1, 0x00, 0x00, 0x01, 0x00, 0x00};
+static char pFrameData[] = {0x00, 0x01, 0x02, 0x03};
+
+static StreamHandle prvCreateStreamEx(bool bHasAudio, size_t uFrameSlabSize, size_t uUserDataSize)
+{
+    VideoTrackInfo_t xVideoTrackInfo = {0};
+    AudioTrackInfo_t xAudioTrackInfo = {0};
+
+    xVideoTrackInfo.pTrackName = (char *)"kvs video track";
+    xVideoTrackInfo.pCodecName = (char *)"V_MPEG4/ISO/AVC";
+    xVideoTrackInfo.uWidth = 640;
+    xVideoTrackInfo.uHeight = 480;
+    xVideoTrackInfo.pCodecPrivate = pCodecPrivate;
+    xVideoTrackInfo.uCodecPrivateLen = sizeof(pCodecPrivate);
+
+    xAudioTrackInfo.pTrackName = (char *)"kvs audio track";
+    xAudioTrackInfo.pCodecName = (char *)"A_AAC";
+    xAudioTrackInfo.uFrequency = 8000;
+    xAudioTrackInfo.uChannelNumber = 1;
+    xAudioTrackInfo.pCodecPrivate = pCodecPrivate;
+    xAudioTrackInfo.uCodecPrivateLen = 2;
+
+    StreamConfig_t xConfig = {};
+    xConfig.uFrameSlabSize = uFrameSlabSize;
+    xConfig.uUserDataSize = uUserDataSize;
+
+    return Kvs_streamCreateEx(&xVideoTrackInfo, bHasAudio ? &xAudioTrackInfo : NULL, &xConfig);
+}
+
+static StreamHandle prvCreateStream(bool bHasAudio)
+{
+    return prvCreateStreamEx(bHasAudio, 0, 0);
+}
+
+static DataFrameHandle prvAddFrameWithUserData(StreamHandle xStreamHandle, uint64_t uTimestampMs, TrackType_t xTrackType, MkvClusterType_t xClusterType, void *pUserData)
+{
+    DataFrameIn_t xDataFrameIn = {};
+
+    xDataFrameIn.xClusterType = xClusterType;
+    xDataFrameIn.pData = pFrameData;
+    xDataFrameIn.uDataLen = sizeof(pFrameData);
+    xDataFrameIn.uTimestampMs = uTimestampMs;
+    xDataFrameIn.bIsKeyFrame = (xClusterType == MKV_CLUSTER) ? true : false;
+    xDataFrameIn.xTrackType = xTrackType;
+    xDataFrameIn.pUserData = pUserData;
+
+    return Kvs_streamAddDataFrame(xStreamHandle, &xDataFrameIn);
+}
+
+static DataFrameHandle prvAddFrame(StreamHandle xStreamHandle, uint64_t uTimestampMs, TrackType_t xTrackType, MkvClusterType_t xClusterType)
+{
+    return prvAddFrameWithUserData(xStreamHandle, uTimestampMs, xTrackType, xClusterType, NULL);
+}
+
+static uint16_t prvGetDeltaTimestamp(DataFrameHandle xDataFrameHandle)
+{
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+
+    Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen);
+
+    /* Delta timestamp is the big endian 16 bits value at offset 10 of a simple block header. */
+    return (uint16_t)((pMkvHeader[10] << 8) | pMkvHeader[11]);
+}
+
+TEST(Kvs_streamAddDataFrame, in_order_frames)
+{
+    StreamHandle xStreamHandle = prvCreateStream(true);
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1000, TRACK_VIDEO, MKV_CLUSTER) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1000, TRACK_AUDIO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1033, TRACK_VIDEO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1040, TRACK_AUDIO, MKV_SIMPLE_BLOCK) != NULL);
+
+    uint64_t puExpectedTimestamp[] = {1000, 1000, 1033, 1040};
+    TrackType_t pxExpectedTrack[] = {TRACK_VIDEO, TRACK_AUDIO, TRACK_VIDEO, TRACK_AUDIO};
+    for (size_t i = 0; i < 4; i++)
+    {
+        DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+        ASSERT_TRUE(xDataFrameHandle != NULL);
+        EXPECT_EQ(puExpectedTimestamp[i], ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+        EXPECT_EQ(pxExpectedTrack[i], ((DataFrameIn_t *)xDataFrameHandle)->xTrackType);
+        if (i > 0)
+        {
+            EXPECT_EQ(puExpectedTimestamp[i] - 1000, prvGetDeltaTimestamp(xDataFrameHandle));
+        }
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+    EXPECT_TRUE(Kvs_streamIsEmpty(xStreamHandle));
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamAddDataFrame, out_of_order_frames)
+{
+    StreamHandle xStreamHandle = prvCreateStream(true);
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    /* Audio lags behind video and is inserted between pending video frames. */
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1000, TRACK_VIDEO, MKV_CLUSTER) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1033, TRACK_VIDEO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1066, TRACK_VIDEO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 2000, TRACK_VIDEO, MKV_CLUSTER) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 2033, TRACK_VIDEO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1010, TRACK_AUDIO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1050, TRACK_AUDIO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 2010, TRACK_AUDIO, MKV_SIMPLE_BLOCK) != NULL);
+
+    /* A cluster inserted in the middle corrects the delta timestamp of the following frames. */
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1040, TRACK_VIDEO, MKV_CLUSTER) != NULL);
+
+    uint64_t puExpectedTimestamp[] = {1000, 1010, 1033, 1040, 1050, 1066, 2000, 2010, 2033};
+    uint16_t puExpectedDelta[] = {0, 10, 33, 0, 10, 26, 0, 10, 33};
+    for (size_t i = 0; i < sizeof(puExpectedTimestamp) / sizeof(puExpectedTimestamp[0]); i++)
+    {
+        DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+        ASSERT_TRUE(xDataFrameHandle != NULL);
+        EXPECT_EQ(puExpectedTimestamp[i], ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+        if (((DataFrameIn_t *)xDataFrameHandle)->xClusterType == MKV_SIMPLE_BLOCK)
+        {
+            EXPECT_EQ(puExpectedDelta[i], prvGetDeltaTimestamp(xDataFrameHandle));
+        }
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+    EXPECT_TRUE(Kvs_streamIsEmpty(xStreamHandle));
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamAvailOnTrack, track_availability)
+{
+    StreamHandle xStreamHandle = prvCreateStream(true);
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    EXPECT_FALSE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_VIDEO));
+    EXPECT_FALSE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_AUDIO));
+
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1000, TRACK_VIDEO, MKV_CLUSTER) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1010, TRACK_AUDIO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_VIDEO));
+    EXPECT_TRUE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_AUDIO));
+
+    Kvs_dataFrameTerminate(Kvs_streamPop(xStreamHandle));
+    EXPECT_FALSE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_VIDEO));
+    EXPECT_TRUE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_AUDIO));
+
+    Kvs_dataFrameTerminate(Kvs_streamPop(xStreamHandle));
+    EXPECT_FALSE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_AUDIO));
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamMemStatTotal, incremental_accounting)
+{
+    size_t uMemEmpty = 0;
+    size_t uMemTotal = 0;
+    size_t uVideoMem = 0;
+    size_t uVideoCount = 0;
+    size_t uAudioMem = 0;
+    size_t uAudioCount = 0;
+    StreamHandle xStreamHandle = prvCreateStream(true);
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    EXPECT_EQ(KVS_ERRNO_NONE, Kvs_streamMemStatTotal(xStreamHandle, &uMemEmpty));
+
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1000, TRACK_VIDEO, MKV_CLUSTER) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1010, TRACK_AUDIO, MKV_SIMPLE_BLOCK) != NULL);
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 1033, TRACK_VIDEO, MKV_SIMPLE_BLOCK) != NULL);
+
+    EXPECT_EQ(KVS_ERRNO_NONE, Kvs_streamMemStatOnTrack(xStreamHandle, TRACK_VIDEO, &uVideoMem, &uVideoCount));
+    EXPECT_EQ(KVS_ERRNO_NONE, Kvs_streamMemStatOnTrack(xStreamHandle, TRACK_AUDIO, &uAudioMem, &uAudioCount));
+    EXPECT_EQ(2, uVideoCount);
+    EXPECT_EQ(1, uAudioCount);
+    EXPECT_GT(uVideoMem, 2 * sizeof(pFrameData));
+    EXPECT_GT(uAudioMem, sizeof(pFrameData));
+
+    EXPECT_EQ(KVS_ERRNO_NONE, Kvs_streamMemStatTotal(xStreamHandle, &uMemTotal));
+    EXPECT_EQ(uMemEmpty + uVideoMem + uAudioMem, uMemTotal);
+
+    while (!Kvs_streamIsEmpty(xStreamHandle))
+    {
+        Kvs_dataFrameTerminate(Kvs_streamPop(xStreamHandle));
+    }
+
+    EXPECT_EQ(KVS_ERRNO_NONE, Kvs_streamMemStatTotal(xStreamHandle, &uMemTotal));
+    EXPECT_EQ(uMemEmpty, uMemTotal);
+    EXPECT_EQ(KVS_ERRNO_NONE, Kvs_streamMemStatOnTrack(xStreamHandle, TRACK_VIDEO, &uVideoMem, &uVideoCount));
+    EXPECT_EQ(0, uVideoMem);
+    EXPECT_EQ(0, uVideoCount);
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamCreateEx, frame_slab_with_user_data)
+{
+    uint64_t uUserData = 0;
+    StreamHandle xStreamHandle = prvCreateStreamEx(true, 2, sizeof(uint64_t));
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    /* The third data frame runs out of slab slots and is allocated from heap. */
+    for (uint64_t i = 0; i < 3; i++)
+    {
+        uUserData = 0x1122334455667788ULL + i;
+        EXPECT_TRUE(prvAddFrameWithUserData(xStreamHandle, 1000 + i * 33, TRACK_VIDEO, (i == 0) ? MKV_CLUSTER : MKV_SIMPLE_BLOCK, &uUserData) != NULL);
+    }
+
+    for (uint64_t i = 0; i < 3; i++)
+    {
+        DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+        ASSERT_TRUE(xDataFrameHandle != NULL);
+        DataFrameIn_t *pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+        ASSERT_TRUE(pDataFrameIn->pUserData != NULL);
+        EXPECT_TRUE(pDataFrameIn->pUserData != &uUserData);
+        EXPECT_EQ(0x1122334455667788ULL + i, *((uint64_t *)(pDataFrameIn->pUserData)));
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+
+    /* Slots are reused after data frames are terminated. */
+    EXPECT_TRUE(prvAddFrame(xStreamHandle, 2000, TRACK_VIDEO, MKV_CLUSTER) != NULL);
+    Kvs_dataFrameTerminate(Kvs_streamPop(xStreamHandle));
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamCreateEx, frame_slab_with_unaligned_user_data)
+{
+    uint8_t pUserData[5] = {0x11, 0x22, 0x33, 0x44, 0x55};
+    StreamHandle xStreamHandle = prvCreateStreamEx(false, 1, sizeof(pUserData));
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    /* Only the configured size is copied, from both a slab slot and the heap. */
+    EXPECT_TRUE(prvAddFrameWithUserData(xStreamHandle, 1000, TRACK_VIDEO, MKV_CLUSTER, pUserData) != NULL);
+    EXPECT_TRUE(prvAddFrameWithUserData(xStreamHandle, 1033, TRACK_VIDEO, MKV_SIMPLE_BLOCK, pUserData) != NULL);
+
+    for (int i = 0; i < 2; i++)
+    {
+        DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+        ASSERT_TRUE(xDataFrameHandle != NULL);
+        DataFrameIn_t *pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+        ASSERT_TRUE(pDataFrameIn->pUserData != NULL);
+        EXPECT_EQ(0, memcmp(pDataFrameIn->pUserData, pUserData, sizeof(pUserData)));
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_dataFrameGetContent, mkv_header_in_headroom)
+{
+    uint64_t uUserData = 0x1122334455667788ULL;
+    size_t uClusterHdrLen = Mkv_getClusterHdrLen(MKV_CLUSTER);
+    char pBuf[64] = {0};
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+    StreamHandle xStreamHandle = prvCreateStreamEx(false, 0, sizeof(uint64_t));
+    ASSERT_TRUE(xStreamHandle != NULL);
+    ASSERT_TRUE(uClusterHdrLen + sizeof(pFrameData) <= sizeof(pBuf));
+
+    /* The 1st data frame has just enough headroom, and the 2nd one has 1 byte less. */
+    for (size_t i = 0; i < 2; i++)
+    {
+        DataFrameIn_t xDataFrameIn = {};
+        xDataFrameIn.xClusterType = MKV_CLUSTER;
+        xDataFrameIn.uHeadroom = uClusterHdrLen - i;
+        xDataFrameIn.pData = pBuf + uClusterHdrLen;
+        xDataFrameIn.uDataLen = sizeof(pFrameData);
+        xDataFrameIn.uTimestampMs = 1000 + i * 1000;
+        xDataFrameIn.bIsKeyFrame = true;
+        xDataFrameIn.xTrackType = TRACK_VIDEO;
+        xDataFrameIn.pUserData = &uUserData;
+        ASSERT_TRUE(Kvs_streamAddDataFrame(xStreamHandle, &xDataFrameIn) != NULL);
+    }
+
+    DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    ASSERT_TRUE(xDataFrameHandle != NULL);
+    ASSERT_EQ(KVS_ERRNO_NONE, Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen));
+    EXPECT_EQ((uint8_t *)pBuf, pMkvHeader);
+    EXPECT_EQ(pMkvHeader + uMkvHeaderLen, pData);
+    EXPECT_EQ(0x1F, pMkvHeader[0]);
+    EXPECT_EQ(0x1122334455667788ULL, *((uint64_t *)(((DataFrameIn_t *)xDataFrameHandle)->pUserData)));
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+
+    xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    ASSERT_TRUE(xDataFrameHandle != NULL);
+    ASSERT_EQ(KVS_ERRNO_NONE, Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen));
+    EXPECT_NE((uint8_t *)pBuf, pMkvHeader);
+    EXPECT_EQ(0x1122334455667788ULL, *((uint64_t *)(((DataFrameIn_t *)xDataFrameHandle)->pUserData)));
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_dataFrameGetSegments, segment_list_is_copied)
+{
+    uint8_t pSegment1[] = {0x00, 0x00, 0x00, 0x02, 0x67, 0x64};
+    uint8_t pSegment2[] = {0x00, 0x00, 0x00, 0x02, 0x65, 0x88};
+    DataFrameSegment_t xSegments[2] = {{pSegment1, sizeof(pSegment1)}, {pSegment2, sizeof(pSegment2)}};
+    const DataFrameSegment_t *pxSegments = NULL;
+    size_t uSegmentCount = 0;
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    uint8_t *pData = NULL;
+    size_t uDataLen = 0;
+    StreamHandle xStreamHandle = prvCreateStream(false);
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    DataFrameIn_t xDataFrameIn = {};
+    xDataFrameIn.xClusterType = MKV_CLUSTER;
+    xDataFrameIn.uTimestampMs = 1000;
+    xDataFrameIn.bIsKeyFrame = true;
+    xDataFrameIn.xTrackType = TRACK_VIDEO;
+    xDataFrameIn.pxSegments = xSegments;
+    xDataFrameIn.uSegmentCount = 2;
+
+    /* The data length must be the sum of segments. */
+    xDataFrameIn.uDataLen = sizeof(pSegment1);
+    EXPECT_TRUE(Kvs_streamAddDataFrame(xStreamHandle, &xDataFrameIn) == NULL);
+    xDataFrameIn.uDataLen = sizeof(pSegment1) + sizeof(pSegment2);
+    ASSERT_TRUE(Kvs_streamAddDataFrame(xStreamHandle, &xDataFrameIn) != NULL);
+
+    /* The list of the caller can go away once it's added. */
+    memset(xSegments, 0, sizeof(xSegments));
+
+    DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    ASSERT_TRUE(xDataFrameHandle != NULL);
+    ASSERT_EQ(KVS_ERRNO_NONE, Kvs_dataFrameGetContent(xDataFrameHandle, &pMkvHeader, &uMkvHeaderLen, &pData, &uDataLen));
+    EXPECT_TRUE(pData == NULL);
+    EXPECT_EQ(sizeof(pSegment1) + sizeof(pSegment2), uDataLen);
+    EXPECT_EQ((char *)pSegment1, ((DataFrameIn_t *)xDataFrameHandle)->pData);
+    ASSERT_EQ(KVS_ERRNO_NONE, Kvs_dataFrameGetSegments(xDataFrameHandle, &pxSegments, &uSegmentCount));
+    ASSERT_EQ(2, uSegmentCount);
+    EXPECT_EQ(pSegment1, pxSegments[0].pData);
+    EXPECT_EQ(sizeof(pSegment1), pxSegments[0].uLen);
+    EXPECT_EQ(pSegment2, pxSegments[1].pData);
+    EXPECT_EQ(sizeof(pSegment2), pxSegments[1].uLen);
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+
+    /* A contiguous data frame has no segment. */
+    xDataFrameHandle = prvAddFrame(xStreamHandle, 2000, TRACK_VIDEO, MKV_CLUSTER);
+    ASSERT_TRUE(xDataFrameHandle != NULL);
+    ASSERT_EQ(KVS_ERRNO_NONE, Kvs_dataFrameGetSegments(xDataFrameHandle, &pxSegments, &uSegmentCount));
+    EXPECT_TRUE(pxSegments == NULL);
+    EXPECT_EQ(0, uSegmentCount);
+    xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+
+    /* Length prefixes of segments are counted in the data length. */
+    xSegments[0] = {pSegment1 + 4, sizeof(pSegment1) - 4};
+    xSegments[1] = {pSegment2 + 4, sizeof(pSegment2) - 4};
+    xDataFrameIn.pData = (char *)pSegment1;
+    xDataFrameIn.bPrefixSegmentLen = true;
+    xDataFrameIn.uDataLen = sizeof(pSegment1) + sizeof(pSegment2) - 8;
+    EXPECT_TRUE(Kvs_streamAddDataFrame(xStreamHandle, &xDataFrameIn) == NULL);
+    xDataFrameIn.uDataLen = sizeof(pSegment1) + sizeof(pSegment2);
+    ASSERT_TRUE(Kvs_streamAddDataFrame(xStreamHandle, &xDataFrameIn) != NULL);
+    xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    ASSERT_TRUE(xDataFrameHandle != NULL);
+    EXPECT_EQ((char *)pSegment1, ((DataFrameIn_t *)xDataFrameHandle)->pData);
+    EXPECT_TRUE(((DataFrameIn_t *)xDataFrameHandle)->bPrefixSegmentLen);
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamIngestDataFrame, single_producer_single_consumer)
+{
+    const uint64_t uFrameCount = 2000;
+    StreamConfig_t xConfig = {};
+    VideoTrackInfo_t xVideoTrackInfo = {};
+    uint64_t uExpectedTimestamp = 0;
+
+    xVideoTrackInfo.pTrackName = (char *)"kvs video track";
+    xVideoTrackInfo.pCodecName = (char *)"V_MPEG4/ISO/AVC";
+    xVideoTrackInfo.pCodecPrivate = pCodecPrivate;
+    xVideoTrackInfo.uCodecPrivateLen = sizeof(pCodecPrivate);
+    xConfig.uIngestRingSize = 8;
+    StreamHandle xStreamHandle = Kvs_streamCreateEx(&xVideoTrackInfo, NULL, &xConfig);
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    std::thread xProducer([&]() {
+        for (uint64_t i = 0; i < uFrameCount; i++)
+        {
+            DataFrameIn_t xDataFrameIn = {};
+            xDataFrameIn.xClusterType = (i % 30 == 0) ? MKV_CLUSTER : MKV_SIMPLE_BLOCK;
+            xDataFrameIn.pData = pFrameData;
+            xDataFrameIn.uDataLen = sizeof(pFrameData);
+            xDataFrameIn.uTimestampMs = 1000 + i;
+            xDataFrameIn.xTrackType = TRACK_VIDEO;
+            while (Kvs_streamIngestDataFrame(xStreamHandle, &xDataFrameIn) == KVS_ERROR_STREAM_INGEST_RING_FULL)
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    while (uExpectedTimestamp < uFrameCount)
+    {
+        DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+        if (xDataFrameHandle == NULL)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        EXPECT_EQ(1000 + uExpectedTimestamp, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+        uExpectedTimestamp++;
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+
+    xProducer.join();
+    EXPECT_TRUE(Kvs_streamIsEmpty(xStreamHandle));
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamIngestDataFrame, unaligned_user_data)
+{
+    uint8_t pUserData[5] = {0x11, 0x22, 0x33, 0x44, 0x55};
+    StreamConfig_t xConfig = {};
+    VideoTrackInfo_t xVideoTrackInfo = {};
+
+    xVideoTrackInfo.pTrackName = (char *)"kvs video track";
+    xVideoTrackInfo.pCodecName = (char *)"V_MPEG4/ISO/AVC";
+    xVideoTrackInfo.pCodecPrivate = pCodecPrivate;
+    xVideoTrackInfo.uCodecPrivateLen = sizeof(pCodecPrivate);
+    xConfig.uIngestRingSize = 4;
+    xConfig.uUserDataSize = sizeof(pUserData);
+    StreamHandle xStreamHandle = Kvs_streamCreateEx(&xVideoTrackInfo, NULL, &xConfig);
+    ASSERT_TRUE(xStreamHandle != NULL);
+
+    /* Only the configured size is copied into adjacent ring slots. */
+    for (uint64_t i = 0; i < 2; i++)
+    {
+        DataFrameIn_t xDataFrameIn = {};
+        xDataFrameIn.xClusterType = (i == 0) ? MKV_CLUSTER : MKV_SIMPLE_BLOCK;
+        xDataFrameIn.pData = pFrameData;
+        xDataFrameIn.uDataLen = sizeof(pFrameData);
+        xDataFrameIn.uTimestampMs = 1000 + i;
+        xDataFrameIn.xTrackType = TRACK_VIDEO;
+        xDataFrameIn.pUserData = pUserData;
+        EXPECT_EQ(0, Kvs_streamIngestDataFrame(xStreamHandle, &xDataFrameIn));
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+        ASSERT_TRUE(xDataFrameHandle != NULL);
+        DataFrameIn_t *pDataFrameIn = (DataFrameIn_t *)xDataFrameHandle;
+        ASSERT_TRUE(pDataFrameIn->pUserData != NULL);
+        EXPECT_EQ(0, memcmp(pDataFrameIn->pUserData, pUserData, sizeof(pUserData)));
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+static void prvOnDataFrameEvicted(DataFrameHandle xDataFrameHandle, void *pAppData)
+{
+    (*(size_t *)pAppData)++;
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+}
+
+TEST(Kvs_streamEvictGopsUntilMem, whole_gops)
+{
+    StreamHandle xStreamHandle = prvCreateStream(true);
+    DataFrameHandle xDataFrameHandle = NULL;
+    size_t uMemTotal = 0;
+    size_t uEvictedCount = 0;
+    uint64_t puAudioTimestamps[] = {0, 50, 100, 150, 200, 250};
+    uint64_t puVideoTimestamps[] = {0, 33, 66, 100, 133, 166, 200, 233};
+
+    ASSERT_NE(nullptr, xStreamHandle);
+
+    /* Audio runs ahead of video, so its frames are moved into the GOP of clusters that come later. */
+    for (size_t i = 0; i < sizeof(puAudioTimestamps) / sizeof(puAudioTimestamps[0]); i++)
+    {
+        ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, puAudioTimestamps[i], TRACK_AUDIO, MKV_SIMPLE_BLOCK));
+    }
+    for (size_t i = 0; i < sizeof(puVideoTimestamps) / sizeof(puVideoTimestamps[0]); i++)
+    {
+        ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, puVideoTimestamps[i], TRACK_VIDEO, (puVideoTimestamps[i] % 100 == 0) ? MKV_CLUSTER : MKV_SIMPLE_BLOCK));
+    }
+
+    /* Nothing is evicted under the limit. */
+    ASSERT_EQ(0, Kvs_streamMemStatTotal(xStreamHandle, &uMemTotal));
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilMem(xStreamHandle, uMemTotal, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(0, uEvictedCount);
+
+    /* The first GOP has video 0, 33, 66 and audio 0, 50. */
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilMem(xStreamHandle, uMemTotal - 1, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(5, uEvictedCount);
+    xDataFrameHandle = Kvs_streamPeek(xStreamHandle);
+    ASSERT_NE(nullptr, xDataFrameHandle);
+    EXPECT_EQ(100, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+    EXPECT_EQ(MKV_CLUSTER, ((DataFrameIn_t *)xDataFrameHandle)->xClusterType);
+
+    /* The GOP of the newest cluster is always kept. */
+    uEvictedCount = 0;
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilMem(xStreamHandle, 0, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(5, uEvictedCount);
+    xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    ASSERT_NE(nullptr, xDataFrameHandle);
+    EXPECT_EQ(200, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+    EXPECT_EQ(0, prvGetDeltaTimestamp(xDataFrameHandle));
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+
+    /* The rest of a popped GOP is evicted once no cluster is pending. */
+    uEvictedCount = 0;
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilMem(xStreamHandle, 0, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(3, uEvictedCount);
+    EXPECT_TRUE(Kvs_streamIsEmpty(xStreamHandle));
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamEvictGopsUntilTimeWindow, cluster_boundaries)
+{
+    StreamHandle xStreamHandle = prvCreateStream(false);
+    DataFrameHandle xDataFrameHandle = NULL;
+    size_t uEvictedCount = 0;
+
+    ASSERT_NE(nullptr, xStreamHandle);
+
+    /* A GOP is 1 second with 2 frames. */
+    for (uint64_t uTimestampMs = 0; uTimestampMs < 5000; uTimestampMs += 500)
+    {
+        ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, uTimestampMs, TRACK_VIDEO, (uTimestampMs % 1000 == 0) ? MKV_CLUSTER : MKV_SIMPLE_BLOCK));
+    }
+
+    /* Clusters are at 0 ~ 4000 ms, and it's within the window. */
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilTimeWindow(xStreamHandle, 4000, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(0, uEvictedCount);
+
+    /* Keep clusters at 2000 ~ 4000 ms. */
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilTimeWindow(xStreamHandle, 2500, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(4, uEvictedCount);
+    xDataFrameHandle = Kvs_streamPeek(xStreamHandle);
+    ASSERT_NE(nullptr, xDataFrameHandle);
+    EXPECT_EQ(2000, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+    EXPECT_EQ(MKV_CLUSTER, ((DataFrameIn_t *)xDataFrameHandle)->xClusterType);
+
+    /* The GOP of the newest cluster is always kept. */
+    uEvictedCount = 0;
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilTimeWindow(xStreamHandle, 0, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(4, uEvictedCount);
+    xDataFrameHandle = Kvs_streamPeek(xStreamHandle);
+    ASSERT_NE(nullptr, xDataFrameHandle);
+    EXPECT_EQ(4000, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+
+    while ((xDataFrameHandle = Kvs_streamPop(xStreamHandle)) != NULL)
+    {
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamEvictGopsUntilLatency, skip_to_next_cluster)
+{
+    StreamHandle xStreamHandle = prvCreateStream(false);
+    DataFrameHandle xDataFrameHandle = NULL;
+    size_t uEvictedCount = 0;
+
+    ASSERT_NE(nullptr, xStreamHandle);
+    EXPECT_NE(0, Kvs_streamEvictGopsUntilLatency(NULL, 1000, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_NE(0, Kvs_streamEvictGopsUntilLatency(xStreamHandle, 1000, NULL, NULL));
+
+    /* A GOP is 1 second with 2 frames. */
+    for (uint64_t uTimestampMs = 0; uTimestampMs < 3000; uTimestampMs += 500)
+    {
+        ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, uTimestampMs, TRACK_VIDEO, (uTimestampMs % 1000 == 0) ? MKV_CLUSTER : MKV_SIMPLE_BLOCK));
+    }
+
+    /* The stream is 2500 ms behind. */
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilLatency(xStreamHandle, 2500, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(0, uEvictedCount);
+
+    /* Skip the first GOP, and the cluster at 1000 ms is 1500 ms behind. */
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilLatency(xStreamHandle, 2000, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(2, uEvictedCount);
+
+    /* Inter frames left from a popped cluster are dropped up to the next cluster. */
+    xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    ASSERT_NE(nullptr, xDataFrameHandle);
+    EXPECT_EQ(1000, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+    uEvictedCount = 0;
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilLatency(xStreamHandle, 500, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(1, uEvictedCount);
+    xDataFrameHandle = Kvs_streamPeek(xStreamHandle);
+    ASSERT_NE(nullptr, xDataFrameHandle);
+    EXPECT_EQ(2000, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+    EXPECT_EQ(MKV_CLUSTER, ((DataFrameIn_t *)xDataFrameHandle)->xClusterType);
+
+    /* There is no later cluster to skip to. */
+    uEvictedCount = 0;
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilLatency(xStreamHandle, 0, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(0, uEvictedCount);
+
+    while ((xDataFrameHandle = Kvs_streamPop(xStreamHandle)) != NULL)
+    {
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamDropDisposableUntilMem, keep_clusters_and_reference_frames)
+{
+    StreamHandle xStreamHandle = prvCreateStream(false);
+    DataFrameHandle xDataFrameHandle = NULL;
+    DataFrameIn_t xDataFrameIn = {};
+    size_t uMemTotal = 0;
+    size_t uFrameCount = 0;
+    size_t uEvictedCount = 0;
+
+    ASSERT_NE(nullptr, xStreamHandle);
+
+    /* A cluster followed by reference and non-reference frames in turn. */
+    for (uint64_t uTimestampMs = 0; uTimestampMs < 200; uTimestampMs += 20)
+    {
+        memset(&xDataFrameIn, 0, sizeof(xDataFrameIn));
+        xDataFrameIn.xClusterType = (uTimestampMs == 0) ? MKV_CLUSTER : MKV_SIMPLE_BLOCK;
+        xDataFrameIn.pData = pFrameData;
+        xDataFrameIn.uDataLen = sizeof(pFrameData);
+        xDataFrameIn.uTimestampMs = uTimestampMs;
+        xDataFrameIn.bIsKeyFrame = (uTimestampMs == 0);
+        xDataFrameIn.bIsDisposable = (uTimestampMs % 40 != 0);
+        xDataFrameIn.xTrackType = TRACK_VIDEO;
+        ASSERT_NE(nullptr, Kvs_streamAddDataFrame(xStreamHandle, &xDataFrameIn));
+    }
+    ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, 200, TRACK_VIDEO, MKV_CLUSTER));
+
+    /* Only the oldest disposable frame is dropped. */
+    ASSERT_EQ(0, Kvs_streamMemStatTotal(xStreamHandle, &uMemTotal));
+    ASSERT_EQ(0, Kvs_streamDropDisposableUntilMem(xStreamHandle, uMemTotal - 1, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(1, uEvictedCount);
+    ASSERT_EQ(0, Kvs_streamMemStatOnTrack(xStreamHandle, TRACK_VIDEO, &uMemTotal, &uFrameCount));
+    EXPECT_EQ(10, uFrameCount);
+
+    /* All disposable frames are dropped at most, and GOP memory stays consistent for eviction. */
+    uEvictedCount = 0;
+    ASSERT_EQ(0, Kvs_streamDropDisposableUntilMem(xStreamHandle, 0, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(4, uEvictedCount);
+    uEvictedCount = 0;
+    ASSERT_EQ(0, Kvs_streamEvictGopsUntilMem(xStreamHandle, 0, prvOnDataFrameEvicted, &uEvictedCount));
+    EXPECT_EQ(5, uEvictedCount);
+
+    xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    ASSERT_NE(nullptr, xDataFrameHandle);
+    EXPECT_EQ(200, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+    EXPECT_TRUE(Kvs_streamIsEmpty(xStreamHandle));
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamGetStats, incremental_stats)
+{
+    StreamHandle xStreamHandle = prvCreateStream(true);
+    DataFrameHandle xDataFrameHandle = NULL;
+    StreamStats_t xStats = {};
+
+    ASSERT_NE(nullptr, xStreamHandle);
+
+    ASSERT_EQ(0, Kvs_streamGetStats(xStreamHandle, &xStats, false));
+    EXPECT_EQ(0, xStats.uVideoFrameCount);
+    EXPECT_EQ(0, xStats.uOldestTimestampMs);
+    EXPECT_EQ(0, xStats.uNewestTimestampMs);
+    EXPECT_EQ(0, xStats.uMaxFrameCount);
+
+    ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, 100, TRACK_VIDEO, MKV_CLUSTER));
+    ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, 90, TRACK_AUDIO, MKV_SIMPLE_BLOCK));
+    ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, 133, TRACK_VIDEO, MKV_SIMPLE_BLOCK));
+
+    ASSERT_EQ(0, Kvs_streamGetStats(xStreamHandle, &xStats, false));
+    EXPECT_EQ(2, xStats.uVideoFrameCount);
+    EXPECT_EQ(1, xStats.uAudioFrameCount);
+    EXPECT_LT(0, xStats.uVideoMemTotal);
+    EXPECT_LT(0, xStats.uAudioMemTotal);
+    EXPECT_EQ(90, xStats.uOldestTimestampMs);
+    EXPECT_EQ(133, xStats.uNewestTimestampMs);
+    EXPECT_EQ(3, xStats.uMaxFrameCount);
+
+    /* The max number of frames is kept until it's reset. */
+    xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+    ASSERT_NE(nullptr, xDataFrameHandle);
+    Kvs_dataFrameTerminate(xDataFrameHandle);
+    ASSERT_EQ(0, Kvs_streamGetStats(xStreamHandle, &xStats, true));
+    EXPECT_EQ(0, xStats.uAudioFrameCount);
+    EXPECT_EQ(0, xStats.uAudioMemTotal);
+    EXPECT_EQ(100, xStats.uOldestTimestampMs);
+    EXPECT_EQ(3, xStats.uMaxFrameCount);
+    ASSERT_EQ(0, Kvs_streamGetStats(xStreamHandle, &xStats, false));
+    EXPECT_EQ(2, xStats.uMaxFrameCount);
+
+    while ((xDataFrameHandle = Kvs_streamPop(xStreamHandle)) != NULL)
+    {
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamUpdateMkvEbmlSegHdr, new_codec_private_data)
+{
+    StreamHandle xStreamHandle = prvCreateStream(false);
+    VideoTrackInfo_t xVideoTrackInfo = {0};
+    uint8_t pNewCodecPrivate[] = {0x01, 0x4D, 0x00, 0x1F, 0xFF, 0xE1, 0x00, 0x00, 0x01, 0x00, 0x00, 0x5A};
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    size_t uOldMkvHeaderLen = 0;
+
+    ASSERT_NE(nullptr, xStreamHandle);
+    ASSERT_EQ(0, Kvs_streamGetMkvEbmlSegHdr(xStreamHandle, &pMkvHeader, &uOldMkvHeaderLen));
+
+    xVideoTrackInfo.pTrackName = (char *)"kvs video track";
+    xVideoTrackInfo.pCodecName = (char *)"V_MPEG4/ISO/AVC";
+    xVideoTrackInfo.uWidth = 1280;
+    xVideoTrackInfo.uHeight = 720;
+    xVideoTrackInfo.pCodecPrivate = pNewCodecPrivate;
+    xVideoTrackInfo.uCodecPrivateLen = sizeof(pNewCodecPrivate);
+
+    EXPECT_NE(0, Kvs_streamUpdateMkvEbmlSegHdr(NULL, &xVideoTrackInfo, NULL));
+    EXPECT_NE(0, Kvs_streamUpdateMkvEbmlSegHdr(xStreamHandle, NULL, NULL));
+
+    ASSERT_EQ(0, Kvs_streamUpdateMkvEbmlSegHdr(xStreamHandle, &xVideoTrackInfo, NULL));
+    ASSERT_EQ(0, Kvs_streamGetMkvEbmlSegHdr(xStreamHandle, &pMkvHeader, &uMkvHeaderLen));
+    EXPECT_LT(uOldMkvHeaderLen, uMkvHeaderLen);
+    EXPECT_TRUE(std::search(pMkvHeader, pMkvHeader + uMkvHeaderLen, pNewCodecPrivate, pNewCodecPrivate + sizeof(pNewCodecPrivate)) != pMkvHeader + uMkvHeaderLen);
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamCreateEx, audio_only)
+{
+    AudioTrackInfo_t xAudioTrackInfo = {0};
+    StreamHandle xStreamHandle = NULL;
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+    const char *pcVideoCodec = "V_MPEG4/ISO/AVC";
+    const char *pcAudioCodec = "A_AAC";
+
+    EXPECT_EQ(nullptr, Kvs_streamCreateEx(NULL, NULL, NULL));
+
+    xAudioTrackInfo.pTrackName = (char *)"kvs audio track";
+    xAudioTrackInfo.pCodecName = (char *)pcAudioCodec;
+    xAudioTrackInfo.uFrequency = 8000;
+    xAudioTrackInfo.uChannelNumber = 1;
+    xAudioTrackInfo.pCodecPrivate = pCodecPrivate;
+    xAudioTrackInfo.uCodecPrivateLen = 2;
+
+    xStreamHandle = Kvs_streamCreateEx(NULL, &xAudioTrackInfo, NULL);
+    ASSERT_NE(nullptr, xStreamHandle);
+    ASSERT_EQ(0, Kvs_streamGetMkvEbmlSegHdr(xStreamHandle, &pMkvHeader, &uMkvHeaderLen));
+    EXPECT_TRUE(std::search(pMkvHeader, pMkvHeader + uMkvHeaderLen, pcAudioCodec, pcAudioCodec + strlen(pcAudioCodec)) != pMkvHeader + uMkvHeaderLen);
+    EXPECT_TRUE(std::search(pMkvHeader, pMkvHeader + uMkvHeaderLen, pcVideoCodec, pcVideoCodec + strlen(pcVideoCodec)) == pMkvHeader + uMkvHeaderLen);
+
+    /* Video track info is ignored without a video track. */
+    EXPECT_EQ(0, Kvs_streamUpdateMkvEbmlSegHdr(xStreamHandle, NULL, &xAudioTrackInfo));
+
+    ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, 0, TRACK_AUDIO, MKV_CLUSTER));
+    ASSERT_NE(nullptr, prvAddFrame(xStreamHandle, 20, TRACK_AUDIO, MKV_SIMPLE_BLOCK));
+    EXPECT_TRUE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_AUDIO));
+    EXPECT_FALSE(Kvs_streamAvailOnTrack(xStreamHandle, TRACK_VIDEO));
+
+    /* Data frames are popped from the audio track alone. */
+    for (uint64_t uTimestampMs = 0; uTimestampMs <= 20; uTimestampMs += 20)
+    {
+        DataFrameHandle xDataFrameHandle = Kvs_streamPop(xStreamHandle);
+        ASSERT_NE(nullptr, xDataFrameHandle);
+        EXPECT_EQ(uTimestampMs, ((DataFrameIn_t *)xDataFrameHandle)->uTimestampMs);
+        Kvs_dataFrameTerminate(xDataFrameHandle);
+    }
+    EXPECT_TRUE(Kvs_streamIsEmpty(xStreamHandle));
+
+    Kvs_streamTermintate(xStreamHandle);
+}
+
+TEST(Kvs_streamAcquireMkvEbmlSegHdr, kept_until_released)
+{
+    StreamHandle xStreamHandle = prvCreateStream(false);
+    VideoTrackInfo_t xVideoTrackInfo = {0};
+    uint8_t pNewCodecPrivate[] = {0x01, 0x4D, 0x00, 0x1F, 0xFF, 0xE1, 0x00, 0x00, 0x01, 0x00, 0x00, 0x5A};
+    MkvEbmlSegHdrHandle xMkvEbmlSegHdr = NULL;
+    uint8_t *pAcquiredHeader = NULL;
+    size_t uAcquiredHeaderLen = 0;
+    uint8_t *pMkvHeader = NULL;
+    size_t uMkvHeaderLen = 0;
+
+    ASSERT_NE(nullptr, xStreamHandle);
+    EXPECT_NE(0, Kvs_streamAcquireMkvEbmlSegHdr(xStreamHandle, NULL, &pAcquiredHeader, &uAcquiredHeaderLen));
+    ASSERT_EQ(0, Kvs_streamAcquireMkvEbmlSegHdr(xStreamHandle, &xMkvEbmlSegHdr, &pAcquiredHeader, &uAcquiredHeaderLen));
+    std::vector<uint8_t> xCopy(pAcquiredHeader, pAcquiredHeader + uAcquiredHeaderLen);
+
+    /* The same track info keeps the header. */
+    xVideoTrackInfo.pTrackName = (char *)"kvs video track";
+    xVideoTrackInfo.pCodecName = (char *)"V_MPEG4/ISO/AVC";
+    xVideoTrackInfo.uWidth = 640;
+    xVideoTrackInfo.uHeight = 480;
+    xVideoTrackInfo.pCodecPrivate = pCodecPrivate;
+    xVideoTrackInfo.uCodecPrivateLen = sizeof(pCodecPrivate);
+    ASSERT_EQ(0, Kvs_streamUpdateMkvEbmlSegHdr(xStreamHandle, &xVideoTrackInfo, NULL));
+    ASSERT_EQ(0, Kvs_streamGetMkvEbmlSegHdr(xStreamHandle, &pMkvHeader, &uMkvHeaderLen));
+    EXPECT_EQ(pAcquiredHeader, pMkvHeader);
+
+    /* New codec private data moves the stream to a new header, and the acquired one is intact. */
+    xVideoTrackInfo.pCodecPrivate = pNewCodecPrivate;
+    xVideoTrackInfo.uCodecPrivateLen = sizeof(pNewCodecPrivate);
+    ASSERT_EQ(0, Kvs_streamUpdateMkvEbmlSegHdr(xStreamHandle, &xVideoTrackInfo, NULL));
+    ASSERT_EQ(0, Kvs_streamGetMkvEbmlSegHdr(xStreamHandle, &pMkvHeader, &uMkvHeaderLen));
+    EXPECT_NE(pAcquiredHeader, pMkvHeader);
+    EXPECT_TRUE(std::equal(xCopy.begin(), xCopy.end(), pAcquiredHeader));
+
+    /* The stream can go before the reference. */
+    Kvs_streamTermintate(xStreamHandle);
+    EXPECT_TRUE(std::equal(xCopy.begin(), xCopy.end(), pAcquiredHeader));
+    Kvs_streamReleaseMkvEbmlSegHdr(xMkvEbmlSegHdr);
+    Kvs_streamReleaseMkvEbmlSegHdr(NULL);
+}
@@ -0,0 +1,99 @@
+#ifdef __cplusplus
+extern "C" {
+#include "kvs/errors.h"
+#include "kvs/tracepoint.h"
+#include "os/tracepoint.h"
+}
+#endif
+
+#include <gtest/gtest.h>
+#include <string>
+
+static int prvAppendJson(const char *pcData, size_t uLen, void *pAppData)
+{
+    ((std::string *)pAppData)->append(pcData, uLen);
+    return 0;
+}
+
+static int prvFailJson(const char *pcData, size_t uLen, void *pAppData)
+{
+    return 1;
+}
+
+#ifdef KVS_USE_TRACEPOINTS
+
+static size_t prvCount(const std::string &xJson, const std::string &xPattern)
+{
+    size_t uCount = 0;
+
+    for (size_t uPos = xJson.find(xPattern); uPos != std::string::npos; uPos = xJson.find(xPattern, uPos + 1))
+    {
+        uCount++;
+    }
+
+    return uCount;
+}
+
+TEST(kvsTraceDump, dump_chrome_trace_events)
+{
+    std::string xJson;
+
+    EXPECT_EQ(KVS_ERROR_INVALID_ARGUMENT, kvsTraceDump(NULL, NULL));
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsTraceClear());
+
+    KVS_TRACE_BEGIN(KVS_TRACE_APP_ADD_FRAME);
+    KVS_TRACE_BEGIN(KVS_TRACE_STREAM_ADD_FRAME);
+    KVS_TRACE_END(KVS_TRACE_STREAM_ADD_FRAME, 100);
+    KVS_TRACE_END(KVS_TRACE_APP_ADD_FRAME, 100);
+
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsTraceDump(prvAppendJson, &xJson));
+    EXPECT_EQ(0, xJson.find("{\"traceEvents\":[{\"name\":\"KvsApp_addFrame\""));
+    EXPECT_EQ(xJson.size() - 2, xJson.rfind("]}"));
+    EXPECT_EQ(2, prvCount(xJson, "\"ph\":\"B\""));
+    EXPECT_EQ(2, prvCount(xJson, "\"ph\":\"E\""));
+    EXPECT_EQ(2, prvCount(xJson, "\"name\":\"Kvs_streamAddDataFrame\""));
+    EXPECT_EQ(2, prvCount(xJson, "\"v\":100"));
+
+    EXPECT_NE(KVS_ERRNO_NONE, kvsTraceDump(prvFailJson, NULL));
+
+    /* Cleared events are not dumped. */
+    xJson.clear();
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsTraceClear());
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsTraceDump(prvAppendJson, &xJson));
+    EXPECT_EQ(std::string("{\"traceEvents\":[]}"), xJson);
+}
+
+TEST(kvsTraceDump, keep_newest_events)
+{
+    std::string xJson;
+
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsTraceClear());
+    for (uint32_t i = 0; i < KVS_TRACE_RING_SIZE + 10; i++)
+    {
+        KVS_TRACE_END(KVS_TRACE_NETIO_SEND, i);
+    }
+
+    ASSERT_EQ(KVS_ERRNO_NONE, kvsTraceDump(prvAppendJson, &xJson));
+    EXPECT_EQ(KVS_TRACE_RING_SIZE, prvCount(xJson, "\"name\":\"NetIo_send\""));
+    EXPECT_EQ(std::string::npos, xJson.find("\"v\":9}"));
+    EXPECT_NE(std::string::npos, xJson.find("\"v\":10}"));
+    EXPECT_NE(std::string::npos, xJson.find("\"v\":" + std::to_string(KVS_TRACE_RING_SIZE + 9) + "}"));
+}
+
+#else
+
+TEST(kvsTraceDump, not_enabled)
+{
+    std::string xJson;
+
+    /* Tracepoints compile to nothing. */
+    KVS_TRACE_BEGIN(KVS_TRACE_APP_ADD_FRAME);
+    KVS_TRACE_END(KVS_TRACE_APP_ADD_FRAME, 0);
+
+    EXPECT_EQ(KVS_ERROR_TRACEPOINTS_NOT_ENABLED, kvsTraceDump(prvAppendJson, &xJson));
+    EXPECT_EQ(KVS_ERROR_TRACEPOINTS_NOT_ENABLED, kvsTraceClear());
+    EXPECT_TRUE(xJson.empty());
+    EXPECT_NE(0, prvFailJson(NULL, 0, NULL));
+}
+
+#endif /* KVS_USE_TRACEPOINTS */